@@ -0,0 +1,120 @@
+//==----- Target.h - Target hooks for GCC to LLVM conversion -----*- C++ -*-==//
+//
+// Copyright (C) 2007 to 2013  Anton Korobeynikov, Duncan Sands et al.
+//
+// This file is part of DragonEgg.
+//
+// DragonEgg is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2, or (at your option) any later version.
+//
+// DragonEgg is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// DragonEgg; see the file COPYING.  If not, write to the Free Software
+// Foundation, 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+//
+//===----------------------------------------------------------------------===//
+// This file declares some target-specific hooks for GCC to LLVM conversion.
+//===----------------------------------------------------------------------===//
+
+#ifndef DRAGONEGG_TARGET_H
+#define DRAGONEGG_TARGET_H
+
+namespace llvm { class SubtargetFeatures; }
+
+#ifdef DRAGONEGG_ABI_H
+
+extern bool llvm_aarch64_should_pass_aggregate_by_reference(tree_node *);
+
+/* Composites bigger than 16 bytes that are not homogeneous floating point or
+   short vector aggregates are copied to memory by the caller, which passes a
+   pointer to the copy.  */
+#define LLVM_SHOULD_PASS_AGGREGATE_BY_REFERENCE(X)                             \
+  llvm_aarch64_should_pass_aggregate_by_reference(X)
+
+extern bool llvm_aarch64_should_pass_aggregate_in_mixed_regs(
+    tree_node *, llvm::Type *Ty, std::vector<llvm::Type *> &);
+
+/* Homogeneous aggregates are passed in consecutive floating point or vector
+   registers.  They are handed to the code generator as an array, which tells
+   it to put them all in registers or all on the stack.  */
+#define LLVM_SHOULD_PASS_AGGREGATE_IN_MIXED_REGS(T, TY, CC, E)                 \
+  llvm_aarch64_should_pass_aggregate_in_mixed_regs((T), (TY), (E))
+
+extern bool llvm_aarch64_should_pass_aggregate_in_integer_regs(tree_node *,
+                                                               unsigned *,
+                                                               bool *);
+
+/* Other aggregates of up to 16 bytes are passed in one or two X registers,
+   whatever their alignment.  */
+#define LLVM_SHOULD_PASS_AGGREGATE_IN_INTEGER_REGS(X, Y, Z)                    \
+  llvm_aarch64_should_pass_aggregate_in_integer_regs((X), (Y), (Z))
+
+extern bool llvm_aarch64_is_homogeneous_aggregate(tree_node *);
+
+/* LLVM_SHOULD_NOT_USE_SHADOW_RETURN - Return true is the given type should
+  not be returned via a shadow parameter with the given calling conventions. */
+#define LLVM_SHOULD_NOT_USE_SHADOW_RETURN(X, CC)                               \
+  llvm_aarch64_is_homogeneous_aggregate(X)
+
+extern llvm::Type *llvm_aarch64_aggr_type_for_struct_return(tree_node *type);
+
+/* LLVM_AGGR_TYPE_FOR_STRUCT_RETURN - Return LLVM Type if X can be
+  returned as an aggregate, otherwise return NULL. */
+#define LLVM_AGGR_TYPE_FOR_STRUCT_RETURN(X, CC)                                \
+  llvm_aarch64_aggr_type_for_struct_return(X)
+
+extern void llvm_aarch64_extract_multiple_return_value(
+    llvm::Value *Src, llvm::Value *Dest, bool isVolatile, LLVMBuilder &B);
+
+/* LLVM_EXTRACT_MULTIPLE_RETURN_VALUE - Extract multiple return value from
+  SRC and assign it to DEST. */
+#define LLVM_EXTRACT_MULTIPLE_RETURN_VALUE(Src, Dest, V, B)                    \
+  llvm_aarch64_extract_multiple_return_value((Src), (Dest), (V), (B))
+
+/* Vectors bigger than 128 are returned using sret.  */
+#define LLVM_SHOULD_RETURN_VECTOR_AS_SHADOW(X, isBuiltin)                      \
+  (TREE_INT_CST_LOW(TYPE_SIZE(X)) > 128)
+
+#endif /* DRAGONEGG_ABI_H */
+
+/* LLVM_TARGET_INTRINSIC_PREFIX - Specify what prefix this target uses for its
+ * intrinsics.
+ */
+#define LLVM_TARGET_INTRINSIC_PREFIX "aarch64"
+
+/* LLVM_TARGET_NAME - This specifies the name of the target, which correlates to
+ * the llvm::InitializeXXXTarget() function.
+ */
+#define LLVM_TARGET_NAME AArch64
+
+/* Turn -mcpu=xx and -march=armv8.x+yy into a CPU type and features.
+ */
+extern void llvm_aarch64_set_subtarget_features(std::string &C,
+                                                llvm::SubtargetFeatures &F);
+#define LLVM_SET_SUBTARGET_FEATURES(C, F)                                      \
+  llvm_aarch64_set_subtarget_features(C, F)
+
+/* LLVM_TARGET_INTRINSIC_LOWER - To handle builtins, we want to expand the
+ * invocation into normal LLVM code.  If the target can handle the builtin, this
+ * macro should call the target TreeToLLVM::TargetIntrinsicLower method and
+ *  return true.This macro is invoked from a method in the TreeToLLVM class.
+ */
+#define LLVM_TARGET_INTRINSIC_LOWER(STMT, FNDECL, DESTLOC, RESULT, DESTTY,     \
+                                    OPS)                                       \
+  TargetIntrinsicLower(STMT, FNDECL, DESTLOC, RESULT, DESTTY, OPS);
+
+/* Propagate code model setting to backend.  LLVM has no tiny code model, but
+   code for the small model works there too.  */
+#define LLVM_SET_CODE_MODEL(CMModel)                                           \
+  CMModel = aarch64_cmodel == AARCH64_CMODEL_LARGE ? CodeModel::Large          \
+                                                   : CodeModel::Small
+
+/* LLVM_NAMED_REGISTER_P - The AArch64 code generator only lets global register
+   variables live in the stack pointer. */
+#define LLVM_NAMED_REGISTER_P(NAME) (!strcmp((NAME), "sp"))
+
+#endif /* DRAGONEGG_TARGET_H */
@@ -197,6 +197,13 @@ inline llvm::Type *getLLVMAggregateTypeForStructReturn(tree_node */*type*/) {
 #define LLVM_SHOULD_PASS_AGGREGATE_USING_BYVAL_ATTR(X, TY) false
 #endif
 
+// LLVM_SHOULD_PASS_AGGREGATE_BY_REFERENCE - Return true if this aggregate
+// value should be copied to memory by the caller, which passes a pointer to the
+// copy in its place.  The default is false.
+#ifndef LLVM_SHOULD_PASS_AGGREGATE_BY_REFERENCE
+#define LLVM_SHOULD_PASS_AGGREGATE_BY_REFERENCE(X) false
+#endif
+
 // LLVM_SHOULD_PASS_AGGREGATE_AS_FCA - Return true if this aggregate value
 // should be passed by value as a first class aggregate. The default is false.
 #ifndef LLVM_SHOULD_PASS_AGGREGATE_AS_FCA
@@ -269,7 +276,7 @@ inline llvm::Type *getLLVMAggregateTypeForStructReturn(tree_node */*type*/) {
 // LLVM_SCALAR_TYPE_FOR_STRUCT_RETURN - Return LLVM Type if X can be
 // returned as a scalar, otherwise return NULL.
 #ifndef LLVM_SCALAR_TYPE_FOR_STRUCT_RETURN
-#define LLVM_SCALAR_TYPE_FOR_STRUCT_RETURN(X, Y)                               \
+#define LLVM_SCALAR_TYPE_FOR_STRUCT_RETURN(X, Y, CC)                           \
   getLLVMScalarTypeForStructReturn((X), (Y))
 #endif
 
@@ -319,6 +326,11 @@ public:
   void HandleArgument(tree_node *type, std::vector<llvm::Type *> &ScalarElts,
                       llvm::AttrBuilder *AttrBuilder = NULL);
 
+  /// HandleArgumentElements - Pass each element of the given aggregate, which
+  /// was converted to Ty, as if it were a separate argument.
+  void HandleArgumentElements(tree_node *type, llvm::Type *Ty,
+                              std::vector<llvm::Type *> &ScalarElts);
+
   /// HandleUnion - Handle a UNION_TYPE or QUAL_UNION_TYPE tree.
   ///
   void HandleUnion(tree_node *type, std::vector<llvm::Type *> &ScalarElts);
@@ -337,4 +349,9 @@ public:
                             std::vector<llvm::Type *> &ScalarElts);
 };
 
+/// flushArgumentPlans - Forget how arguments of each type are passed, as
+/// remembered by DefaultABI::HandleArgument.  Must be called whenever the
+/// garbage collector runs.
+extern void flushArgumentPlans();
+
 #endif /* DRAGONEGG_ABI_H */
@@ -30,6 +30,10 @@
 // LLVM headers
 #include "llvm/ADT/SmallVector.h"
 
+// System headers
+#include <algorithm>
+#include <queue>
+
 /// IntervalList - Maintains a list of disjoint intervals.  Type 'T' represents
 /// an interval, and should have a getRange method which returns a range of 'U'
 /// values.  In addition it should provide ChangeRangeTo for growing, shrinking
@@ -43,6 +47,15 @@ template <class T, typename U, unsigned N> class IntervalList {
   List Intervals;
   // The actual intervals.  Always disjoint, sorted and non-empty.
 
+  List Pending;
+  // Intervals that were added out of order and have not yet been merged into
+  // the actual intervals, in the order they were added.  None of them is empty.
+
+  /// MinPending - Out of order intervals are only set aside to be merged later
+  /// once there are at least this many intervals.  Below that it is cheaper to
+  /// insert them straight away.
+  static const unsigned MinPending = 512;
+
   /// CmpFirst - Compare intervals based on where they start.
   static bool CmpFirst(const T &L, const T &R) {
     return L.getRange().getFirst() < R.getRange().getFirst();
@@ -53,6 +66,13 @@ template <class T, typename U, unsigned N> class IntervalList {
     return L.getRange().getLast() < R.getRange().getLast();
   }
 
+  /// InsertInterval - Insert a non-empty interval into the actual intervals,
+  /// pruning any it overlaps.
+  void InsertInterval(const T &Interval);
+
+  /// MergePending - Merge any pending intervals into the actual intervals.
+  void MergePending();
+
   /// isSane - Return true if the intervals are non-empty, disjoint and
   /// sorted.
   bool isSane() const {
@@ -77,10 +97,16 @@ public:
   void AddInterval(const T &S);
 
   /// getNumIntervals - Return the number of intervals in the list.
-  unsigned getNumIntervals() const { return (unsigned) Intervals.size(); }
+  unsigned getNumIntervals() {
+    MergePending();
+    return (unsigned) Intervals.size();
+  }
 
   /// getInterval - Return the interval with the given index.
-  T getInterval(unsigned Idx) { return Intervals[Idx]; }
+  T getInterval(unsigned Idx) {
+    MergePending();
+    return Intervals[Idx];
+  }
 
   /// AlignBoundaries - Ensure that all intervals begin and end on a multiple of
   /// the given value.
@@ -99,12 +125,59 @@ void IntervalList<T, U, N>::AddInterval(const T &Interval) {
   if (NewRange.empty())
     return;
 
-  // If this is the first interval then it cannot overlap any others.
-  if (Intervals.empty()) {
-    Intervals.push_back(Interval);
-    return;
+  // Intervals waiting to be merged were added earlier, so if there are any then
+  // the new interval has to wait its turn.
+  if (Pending.empty()) {
+    // If this is the first interval, or it starts after the last one stops,
+    // then it cannot overlap any others.  This is by far the most common case,
+    // since fields and initializers usually come in order, so handle it without
+    // any searching or shuffling of the existing intervals.
+    if (Intervals.empty() ||
+        NewRange.getFirst() >= Intervals.back().getRange().getLast()) {
+      Intervals.push_back(Interval);
+      return;
+    }
+
+    // If it starts inside the last interval then it only overlaps that one, as
+    // when the elements of a zeroed array are then initialized in order.  Keep
+    // the parts of the last interval before and after the new one.
+    if (NewRange.getFirst() >= Intervals.back().getRange().getFirst()) {
+      const T Last = Intervals.back();
+      const Range<U> LastRange = Last.getRange();
+      const Range<U> LowerRange(LastRange.getFirst(), NewRange.getFirst());
+      const Range<U> UpperRange(NewRange.getLast(), LastRange.getLast());
+      Intervals.pop_back();
+      if (!LowerRange.empty()) {
+        Intervals.push_back(Last);
+        Intervals.back().ChangeRangeTo(LowerRange);
+      }
+      Intervals.push_back(Interval);
+      if (!UpperRange.empty()) {
+        Intervals.push_back(Last);
+        Intervals.back().ChangeRangeTo(UpperRange);
+      }
+      return;
+    }
+
+    // While the list is short, moving intervals to make room is cheap.
+    if (Intervals.size() < MinPending) {
+      InsertInterval(Interval);
+      return;
+    }
   }
 
+  // Otherwise the new interval may overlap existing intervals.  Rather than
+  // making room for it now, which means moving all the intervals after it, set
+  // it aside to be merged in along with any others added out of order.
+  Pending.push_back(Interval);
+}
+
+/// InsertInterval - Insert a non-empty interval into the actual intervals,
+/// pruning any it overlaps.
+template <class T, typename U, unsigned N>
+void IntervalList<T, U, N>::InsertInterval(const T &Interval) {
+  const Range<U> NewRange = Interval.getRange();
+
   // Check for overlap with existing intervals.
   iterator Lo =
       std::lower_bound(Intervals.begin(), Intervals.end(), Interval, CmpFirst);
@@ -156,11 +229,79 @@ void IntervalList<T, U, N>::AddInterval(const T &Interval) {
   assert(isSane() && "Interval added wrong!");
 }
 
+/// MergePending - Merge any pending intervals into the actual intervals.  The
+/// result is the same as if the pending intervals had been added one by one,
+/// each pruning the intervals it overlaps, but rather than shuffling the list
+/// once for every pending interval, which is quadratic when many are added out
+/// of order, the whole list is rebuilt in one sweep over the boundaries.
+template <class T, typename U, unsigned N>
+void IntervalList<T, U, N>::MergePending() {
+  if (Pending.empty())
+    return;
+
+  // Number the intervals so that one added later has a bigger number.  Those
+  // already in the list are disjoint, so the order among them does not matter.
+  List All;
+  All.append(Intervals.begin(), Intervals.end());
+  All.append(Pending.begin(), Pending.end());
+  Pending.clear();
+
+  // Visit the intervals in order of where they start, and the boundaries of all
+  // intervals in increasing order.
+  llvm::SmallVector<unsigned, N> ByFirst;
+  llvm::SmallVector<U, 2 * N> Boundaries;
+  for (unsigned i = 0, e = (unsigned) All.size(); i != e; ++i) {
+    ByFirst.push_back(i);
+    Boundaries.push_back(All[i].getRange().getFirst());
+    Boundaries.push_back(All[i].getRange().getLast());
+  }
+  std::sort(ByFirst.begin(), ByFirst.end(), [&All](unsigned L, unsigned R) {
+    return All[L].getRange().getFirst() < All[R].getRange().getFirst();
+  });
+  std::sort(Boundaries.begin(), Boundaries.end());
+  Boundaries.erase(std::unique(Boundaries.begin(), Boundaries.end()),
+                   Boundaries.end());
+
+  // Between two consecutive boundaries the last added of the intervals covering
+  // that stretch wins.  Active holds the intervals started so far, latest on
+  // top; those that have stopped are only thrown away once they reach the top.
+  std::priority_queue<unsigned, llvm::SmallVector<unsigned, N> > Active;
+  const unsigned NoOwner = ~0U;
+  unsigned Owner = NoOwner; // The interval the current piece comes from.
+  U PieceFirst = U();       // Where the current piece starts.
+  List Merged;
+  for (unsigned b = 0, n = 0, e = (unsigned) Boundaries.size(); b != e; ++b) {
+    const U Point = Boundaries[b];
+    for (; n != ByFirst.size() && All[ByFirst[n]].getRange().getFirst() == Point;
+         ++n)
+      Active.push(ByFirst[n]);
+    while (!Active.empty() && !(Point < All[Active.top()].getRange().getLast()))
+      Active.pop();
+    const unsigned NewOwner = Active.empty() ? NoOwner : Active.top();
+    if (NewOwner == Owner)
+      continue;
+    // The current piece stops here.  Cut it out of the interval it came from.
+    if (Owner != NoOwner) {
+      const Range<U> PieceRange(PieceFirst, Point);
+      Merged.push_back(All[Owner]);
+      if (!(PieceRange == All[Owner].getRange()))
+        Merged.back().ChangeRangeTo(PieceRange);
+    }
+    Owner = NewOwner;
+    PieceFirst = Point;
+  }
+  assert(Owner == NoOwner && "Interval runs past the last boundary!");
+
+  Intervals.swap(Merged);
+  assert(isSane() && "Intervals merged wrong!");
+}
+
 /// AlignBoundaries - Ensure that all intervals begin and end on a multiple of
 /// the given value.
 template <class T, typename U, unsigned N>
 void IntervalList<T, U, N>::AlignBoundaries(unsigned Alignment) {
   assert(Alignment > 0 && "Alignment should be positive!");
+  MergePending();
   for (iterator SI = Intervals.begin(); SI != Intervals.end(); ++SI) {
     T &Interval = *SI;
     Range<U> OrigRange = Interval.getRange();
@@ -32,4 +32,18 @@ union tree_node;
 /// to the given tree may alias.
 extern llvm::MDNode *describeAliasSet(tree_node *t);
 
+/// AliasingStatistics - Counts of the TBAA nodes created by describeAliasSet.
+struct AliasingStatistics {
+  unsigned Queries;        // Number of calls to describeAliasSet.
+  unsigned NodesCreated;   // Number of TBAA nodes created.
+  unsigned NodesDropped;   // Number of nodes later made to alias everything.
+  unsigned LeafNodes;      // Number of nodes currently in use as leaves.
+  unsigned RecordsSkipped; // Records seen not to be leaves from their fields.
+  unsigned RecordNodes;    // Number of struct type nodes created for records.
+  unsigned FieldTags;      // Number of accesses given a struct-path tag.
+};
+
+/// getAliasingStatistics - Return statistics about the TBAA nodes created.
+extern const AliasingStatistics &getAliasingStatistics();
+
 #endif /* DRAGONEGG_ALIASING_H */
@@ -41,6 +41,11 @@ extern bool getCachedInteger(union tree_node *t, int &Val);
 /// returns the integer.
 extern void setCachedInteger(union tree_node *t, int Val);
 
+/// flushFrontCaches - Forget everything in the small direct mapped caches that
+/// sit in front of the integer and type caches.  Must be called whenever the
+/// garbage collector runs.
+extern void flushFrontCaches();
+
 /// getCachedType - Returns the type associated with the given GCC tree, or null
 /// if none.
 extern llvm::Type *getCachedType(union tree_node *t);
@@ -58,4 +63,36 @@ extern llvm::Value *getCachedValue(union tree_node *t);
 /// or the value deleted.
 extern void setCachedValue(union tree_node *t, llvm::Value *V);
 
+/// getCachedDeclValue - Returns the value associated with the given GCC
+/// declaration, or null if none.
+extern llvm::Value *getCachedDeclValue(union tree_node *t);
+
+/// setCachedDeclValue - Associates the given value (which may be null) with
+/// the given GCC declaration.  The association is removed if the declaration
+/// is garbage collected or the value deleted.
+extern void setCachedDeclValue(union tree_node *t, llvm::Value *V);
+
+/// reserveDeclCache - Make room in the declaration cache for the given number
+/// of declarations, so that it does not have to grow while the unit is being
+/// converted.  Does nothing if the cache is already in use.
+extern void reserveDeclCache(unsigned NumDecls);
+
+/// CacheStatistics - The number of lookups in each cache that found, or failed
+/// to find, an associated entry (the hits in the direct mapped caches in front
+/// of the integer and type caches are counted apart), and the number of entries
+/// in and the size of each cache.
+struct CacheStatistics {
+  unsigned IntegerFrontHits, IntegerHits, IntegerMisses;
+  unsigned TypeFrontHits, TypeHits, TypeMisses;
+  unsigned ValueHits, ValueMisses;
+  unsigned DeclHits, DeclMisses;
+  unsigned long IntegerEntries, IntegerSlots;
+  unsigned long TypeEntries, TypeSlots;
+  unsigned long ValueEntries, ValueSlots;
+  unsigned long DeclEntries, DeclSlots;
+};
+
+/// getCacheStatistics - Return lookup statistics for the caches.
+extern const CacheStatistics &getCacheStatistics();
+
 #endif /* DRAGONEGG_CACHE_H */
@@ -0,0 +1,257 @@
+//=--- CodeGenDaemon.h - Messages to and from the codegen daemon --*- C++ -*-=//
+//
+// This file is part of DragonEgg.
+//
+// DragonEgg is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2, or (at your option) any later version.
+//
+// DragonEgg is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// DragonEgg; see the file COPYING.  If not, write to the Free Software
+// Foundation, 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+//
+//===----------------------------------------------------------------------===//
+// This file declares the messages passed between the plugin and the code
+// generation daemon (utils/CodeGenDaemon.cpp) over a Unix domain socket.  The
+// plugin sends a request holding the optimized module as bitcode, along with
+// everything needed to create a target machine like its own.  The daemon
+// replies with the assembler or object code, or with an error message.  Both
+// sides only need LLVM, so everything is defined here.
+//===----------------------------------------------------------------------===//
+
+#ifndef DRAGONEGG_CODEGENDAEMON_H
+#define DRAGONEGG_CODEGENDAEMON_H
+
+#ifndef _WIN32
+
+// LLVM headers
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Target/TargetOptions.h"
+
+// System headers
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdint.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/// CodeGenDaemonVersion - Changed whenever the format of the messages changes,
+/// so that a daemon never misreads a request from a different plugin.
+static const uint64_t CodeGenDaemonVersion = 1;
+
+/// DaemonMessageWriter - Builds a message out of integers and strings.
+class DaemonMessageWriter {
+  std::string Data;
+
+public:
+  void addInt(uint64_t V) {
+    for (unsigned i = 0; i != 8; ++i)
+      Data += char(V >> (8 * i));
+  }
+  void addString(llvm::StringRef S) {
+    addInt(S.size());
+    Data += S;
+  }
+  const std::string &getData() const { return Data; }
+};
+
+/// DaemonMessageReader - Takes the integers and strings back out of a message,
+/// in the order they were added.  Each method returns false if the message is
+/// too short.
+class DaemonMessageReader {
+  llvm::StringRef Data;
+
+public:
+  explicit DaemonMessageReader(llvm::StringRef D) : Data(D) {}
+
+  bool getInt(uint64_t &V) {
+    if (Data.size() < 8)
+      return false;
+    V = 0;
+    for (unsigned i = 0; i != 8; ++i)
+      V |= uint64_t((unsigned char)Data[i]) << (8 * i);
+    Data = Data.drop_front(8);
+    return true;
+  }
+  bool getString(std::string &S) {
+    uint64_t Size;
+    if (!getInt(Size) || Data.size() < Size)
+      return false;
+    S = Data.substr(0, Size).str();
+    Data = Data.drop_front(Size);
+    return true;
+  }
+};
+
+/// CodeGenRequest - Everything the daemon needs to generate code for a module
+/// the way the plugin would.  Only the target options the plugin sets are
+/// passed on; the others keep their default values.
+struct CodeGenRequest {
+  std::string Triple, CPU, Features;
+  std::string LLVMOptions; // Separated by null characters.
+  uint64_t RelocModel, CodeModel, OptLevel;
+  bool EmitObj;
+  llvm::TargetOptions Options;
+  std::string Bitcode;
+
+  CodeGenRequest() : RelocModel(0), CodeModel(0), OptLevel(0), EmitObj(false) {}
+
+  /// getMachineKey - The part of the request that determines the target
+  /// machine, used by the daemon to reuse machines between requests.
+  std::string getMachineKey() const {
+    DaemonMessageWriter W;
+    writeMachine(W);
+    return W.getData();
+  }
+
+  void write(DaemonMessageWriter &W) const {
+    W.addInt(CodeGenDaemonVersion);
+    writeMachine(W);
+    W.addString(LLVMOptions);
+    W.addInt(EmitObj);
+    W.addString(Bitcode);
+  }
+
+  bool read(DaemonMessageReader &R) {
+    uint64_t Version, UnsafeFPMath, NoInfsFPMath, NoNaNsFPMath, NoZerosInBSS,
+        UseInitArray, FunctionSections, DataSections, UseDwarfDirectory,
+        AllowFPOpFusion, FloatABIType, CompressDebugSections, StackSizeSection,
+        Obj;
+    if (!R.getInt(Version) || Version != CodeGenDaemonVersion ||
+        !R.getString(Triple) || !R.getString(CPU) || !R.getString(Features) ||
+        !R.getInt(RelocModel) || !R.getInt(CodeModel) || !R.getInt(OptLevel) ||
+        !R.getInt(UnsafeFPMath) || !R.getInt(NoInfsFPMath) ||
+        !R.getInt(NoNaNsFPMath) || !R.getInt(NoZerosInBSS) ||
+        !R.getInt(UseInitArray) || !R.getInt(FunctionSections) ||
+        !R.getInt(DataSections) || !R.getInt(UseDwarfDirectory) ||
+        !R.getInt(AllowFPOpFusion) || !R.getInt(FloatABIType) ||
+        !R.getInt(CompressDebugSections) || !R.getInt(StackSizeSection) ||
+        !R.getString(Options.MCOptions.ABIName) ||
+        !R.getString(LLVMOptions) || !R.getInt(Obj) || !R.getString(Bitcode))
+      return false;
+    Options.UnsafeFPMath = UnsafeFPMath;
+    Options.NoInfsFPMath = NoInfsFPMath;
+    Options.NoNaNsFPMath = NoNaNsFPMath;
+    Options.NoZerosInBSS = NoZerosInBSS;
+    Options.UseInitArray = UseInitArray;
+    Options.FunctionSections = FunctionSections;
+    Options.DataSections = DataSections;
+    Options.MCOptions.MCUseDwarfDirectory = UseDwarfDirectory;
+    Options.AllowFPOpFusion = (llvm::FPOpFusion::FPOpFusionMode)AllowFPOpFusion;
+    Options.FloatABIType = (llvm::FloatABI::ABIType)FloatABIType;
+    Options.CompressDebugSections =
+        (llvm::DebugCompressionType)CompressDebugSections;
+#if LLVM_VERSION_MAJOR > 5
+    Options.EmitStackSizeSection = StackSizeSection;
+#endif
+    EmitObj = Obj;
+    return true;
+  }
+
+private:
+  void writeMachine(DaemonMessageWriter &W) const {
+    W.addString(Triple);
+    W.addString(CPU);
+    W.addString(Features);
+    W.addInt(RelocModel);
+    W.addInt(CodeModel);
+    W.addInt(OptLevel);
+    W.addInt(Options.UnsafeFPMath);
+    W.addInt(Options.NoInfsFPMath);
+    W.addInt(Options.NoNaNsFPMath);
+    W.addInt(Options.NoZerosInBSS);
+    W.addInt(Options.UseInitArray);
+    W.addInt(Options.FunctionSections);
+    W.addInt(Options.DataSections);
+    W.addInt(Options.MCOptions.MCUseDwarfDirectory);
+    W.addInt(Options.AllowFPOpFusion);
+    W.addInt(Options.FloatABIType);
+    W.addInt((uint64_t)Options.CompressDebugSections);
+#if LLVM_VERSION_MAJOR > 5
+    W.addInt(Options.EmitStackSizeSection);
+#else
+    W.addInt(0);
+#endif
+    W.addString(Options.MCOptions.ABIName);
+  }
+};
+
+/// ConnectToCodeGenDaemon - Connect to the daemon listening on the socket with
+/// the given path.  Returns the socket, or -1 with errno set.
+inline int ConnectToCodeGenDaemon(const char *Path) {
+  struct sockaddr_un Addr;
+  if (strlen(Path) >= sizeof(Addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  memset(&Addr, 0, sizeof(Addr));
+  Addr.sun_family = AF_UNIX;
+  strcpy(Addr.sun_path, Path);
+  int FD = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (FD < 0)
+    return -1;
+  if (connect(FD, (struct sockaddr *)&Addr, sizeof(Addr))) {
+    int Err = errno;
+    close(FD);
+    errno = Err;
+    return -1;
+  }
+  return FD;
+}
+
+/// SendDaemonMessage - Send a message over the given socket, preceded by its
+/// length.  Returns false with errno set if it could not all be sent.
+inline bool SendDaemonMessage(int FD, const std::string &Message) {
+  DaemonMessageWriter Length;
+  Length.addInt(Message.size());
+  std::string Data = Length.getData() + Message;
+  for (size_t Done = 0; Done != Data.size();) {
+    ssize_t N = write(FD, Data.data() + Done, Data.size() - Done);
+    if (N < 0 && errno == EINTR)
+      continue;
+    if (N <= 0)
+      return false;
+    Done += N;
+  }
+  return true;
+}
+
+/// ReceiveDaemonMessage - Read a message sent with SendDaemonMessage from the
+/// given socket.  Returns false if the socket was closed or could not be read.
+inline bool ReceiveDaemonMessage(int FD, std::string &Message) {
+  std::string Data;
+  uint64_t Size = 8; // The length comes first.
+  bool HaveLength = false;
+  while (true) {
+    while (Data.size() < Size) {
+      char Buffer[65536];
+      size_t Want = std::min<uint64_t>(Size - Data.size(), sizeof(Buffer));
+      ssize_t N = read(FD, Buffer, Want);
+      if (N < 0 && errno == EINTR)
+        continue;
+      if (N <= 0)
+        return false;
+      Data.append(Buffer, N);
+    }
+    if (HaveLength)
+      break;
+    DaemonMessageReader R(Data);
+    R.getInt(Size);
+    Data.clear();
+    HaveLength = true;
+  }
+  Message.swap(Data);
+  return true;
+}
+
+#endif /* _WIN32 */
+
+#endif /* DRAGONEGG_CODEGENDAEMON_H */
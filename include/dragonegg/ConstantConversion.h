@@ -24,10 +24,13 @@
 #ifndef DRAGONEGG_CONSTANTS_H
 #define DRAGONEGG_CONSTANTS_H
 
+#include "llvm/Support/DataTypes.h"
+
 // Forward declarations.
 namespace llvm {
 class Constant;
 class Type;
+class raw_ostream;
 }
 union tree_node;
 
@@ -50,6 +53,41 @@ extern llvm::Constant *AddressOf(tree_node *exp);
 /// it is never smaller than the alloc size.
 extern llvm::Constant *ConvertInitializer(tree_node *exp);
 
+/// isRawInitializer - Return whether the initial value for an object of the
+/// given size in bytes is nothing but data, with no addresses needing to be
+/// relocated, in a form that WriteRawInitializer can output.
+extern bool isRawInitializer(tree_node *exp, uint64_t Size);
+
+/// WriteRawInitializer - Output the bytes of an object of the given size with
+/// the given initial value, which must satisfy isRawInitializer, in target
+/// format.  This avoids creating LLVM constants for huge initial values.
+extern void WriteRawInitializer(tree_node *exp, uint64_t Size,
+                                llvm::raw_ostream &OS);
+
+/// ConvertRawInitializer - Convert the initial value for an object of the given
+/// size in bytes, which must satisfy isRawInitializer, to an array of bytes.
+/// Much quicker than ConvertInitializer for huge tables since no constant is
+/// created for each element, but the element types are lost.
+extern llvm::Constant *ConvertRawInitializer(tree_node *exp, uint64_t Size);
+
+/// flushAddressCache - Forget the addresses remembered by AddressOf.  Must be
+/// called whenever the garbage collector runs.
+extern void flushAddressCache();
+
+/// ConstantStatistics - How often converting an initializer or taking the
+/// address of a constant found the result for the same tree was known already,
+/// and how many constants whose address was taken shared a global with an
+/// identical constant.
+struct ConstantStatistics {
+  unsigned InitializerHits, InitializerMisses;
+  unsigned AddressHits, AddressMisses;
+  unsigned Slots, MergedSlots;
+};
+
+/// getConstantStatistics - Return reuse statistics for ConvertInitializer and
+/// AddressOf.
+extern const ConstantStatistics &getConstantStatistics();
+
 /// ExtractRegisterFromConstant - Extract a value of the given scalar GCC type
 /// from a constant.  The returned value is of in-register type, as returned by
 /// getRegType, and is what you would get by storing the constant to memory and
@@ -36,11 +36,10 @@
 #include "llvm/DIBuilder.h"
 #include "llvm/Support/ValueHandle.h"
 #endif
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/Support/Allocator.h"
 
-// System headers
-#include <map>
-
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
 typedef llvm::DIType * MigDIType;
 typedef llvm::DIScope * MigDIScope;
@@ -70,10 +69,24 @@ class Function;
 class Module;
 }
 
+/// DebugInfoStatistics - The number of entries in the caches kept while
+/// producing debug info.
+struct DebugInfoStatistics {
+  unsigned long Types;       // Descriptions of types.
+  unsigned long Subprograms; // Subprograms, including those only seen inlined.
+  unsigned long Scopes;      // Regions and namespaces.
+  unsigned long Variables;   // Variables described in the current function.
+  unsigned long Locations;   // Locations created in the current function.
+  unsigned long Files;       // File descriptors.
+};
+
 /// DebugInfo - This class gathers all debug information during compilation and
 /// is responsible for emitting to llvm globals or pass directly to the backend.
 class DebugInfo {
 private:
+  /// TreeMDMap - Debug info metadata for GCC trees, looked up by pointer.
+  typedef llvm::DenseMap<tree_node *, MigTrackingMDRefType> TreeMDMap;
+
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
   llvm::SmallVector<llvm::Metadata *, 4>
 #else
@@ -82,7 +95,7 @@ private:
       RegionStack;
   // Stack to track declarative scopes.
 
-  std::map<tree_node *, MigTrackingMDRefType> RegionMap;
+  TreeMDMap RegionMap;
 
   llvm::Module &M;
   llvm::LLVMContext &VMContext;
@@ -90,28 +103,71 @@ private:
   llvm::Function *DeclareFn; // llvm.dbg.declare
   llvm::Function *ValueFn;   // llvm.dbg.value
 
-  const char *CurFullPath;  // Previous location file encountered.
-  const char *PrevFullPath; // Previous location file encountered.
-  int CurLineNo;            // Previous location line# encountered.
+  const char *CurFullPath;  // Current location file.
+  unsigned CurFileID;       // Interned CurFullPath, 0 if there is none.
+  unsigned PrevFileID;      // Interned previous location file.
+  int CurLineNo;            // Current location line#.
   int PrevLineNo;           // Previous location line# encountered.
+  int CurColumnNo;          // Current location column.
+  int PrevColumnNo;         // Previous location column encountered.
+  tree_node *CurBlock;      // Current location GCC BLOCK, if known.
+  tree_node *PrevBlock;     // Previous location BLOCK encountered.
   llvm::BasicBlock *PrevBB;       // Last basic block encountered.
 
-  std::map<tree_node *, MigTrackingMDRefType> TypeCache;
+  /// LineTablesOnly - Whether only subprograms and locations are wanted, as
+  /// for -g1.  No types, variables or namespaces are described then.
+  bool LineTablesOnly;
+
+  /// LocationsOnly - Whether locations are only wanted inside the compiler,
+  /// for optimization remarks, and no debug info is to be output.
+  bool LocationsOnly;
+
+  /// FileIDsByPointer, FileIDs - Numbers for the location files seen so far,
+  /// looked up by the pointer GCC handed out and failing that by contents.
+  llvm::DenseMap<const char *, unsigned> FileIDsByPointer;
+  llvm::StringMap<unsigned> FileIDs;
+
+  /// LocCache - Locations created in the current function, by scope and the
+  /// location it was inlined at (if any), and by line and column packed into
+  /// 64 bits.
+  typedef std::pair<std::pair<llvm::MDNode *, llvm::MDNode *>, uint64_t>
+      LocKeyType;
+  typedef llvm::DenseMap<LocKeyType, llvm::DebugLoc> LocCacheType;
+  LocCacheType LocCache;
+
+  /// InlineScopeCache - The scope and inlined-at location for the outermost
+  /// BLOCK of each inlined function body seen in the current function.
+  typedef llvm::DenseMap<tree_node *,
+                         std::pair<llvm::MDNode *, llvm::MDNode *> >
+      InlineScopeMap;
+  InlineScopeMap InlineScopeCache;
+
+  /// InlinedSPCache - Subprograms made for functions only seen inlined.
+  TreeMDMap InlinedSPCache;
+
+  TreeMDMap TypeCache;
   // Cache of previously constructed
   // Types.
-  std::map<tree_node *, MigTrackingMDRefType> SPCache;
+  TreeMDMap SPCache;
   // Cache of previously constructed
   // Subprograms.
-  std::map<tree_node *, MigTrackingMDRefType> NameSpaceCache;
+  TreeMDMap NameSpaceCache;
   // Cache of previously constructed name
   // spaces.
+  TreeMDMap VarCache;
+  // Cache of variables described by
+  // dbg.value in the current function.
+
+  /// FileCache - File descriptors, looked up by the path pointer GCC uses.
+  typedef llvm::DenseMap<const char *, MigTrackingMDRefType> FileMDMap;
+  FileMDMap FileCache;
 
   /// FunctionNames - This is a storage for function names that are
   /// constructed on demand. For example, C++ destructors, C++ operators etc..
   llvm::BumpPtrAllocator FunctionNames;
 
 public:
-  DebugInfo(llvm::Module *m);
+  DebugInfo(llvm::Module *m, bool LocationsOnly = false);
 
   ~DebugInfo() { Builder.finalize(); }
 
@@ -120,9 +176,18 @@ public:
   /// initialization is done.
   void Initialize();
 
+  /// reserveCaches - Make room in the caches for the debug info of roughly the
+  /// given number of declarations, so they do not keep growing.
+  void reserveCaches(unsigned NumDecls);
+
+  /// getStatistics - Return the number of entries in each of the caches.
+  DebugInfoStatistics getStatistics() const;
+
   // Accessors.
-  void setLocationFile(const char *FullPath) { CurFullPath = FullPath; }
+  void setLocationFile(const char *FullPath);
   void setLocationLine(int LineNo) { CurLineNo = LineNo; }
+  void setLocationColumn(int ColumnNo);
+  void setLocationBlock(tree_node *Block) { CurBlock = Block; }
 
   /// EmitFunctionStart - Constructs the debug code for entering a function -
   /// "llvm.dbg.func.start."
@@ -137,6 +202,10 @@ public:
   void EmitDeclare(tree_node *decl, unsigned Tag, llvm::StringRef Name,
                    tree_node *type, llvm::Value *AI, LLVMBuilder &Builder);
 
+  /// EmitValue - Constructs the debug code for a new value of a variable that
+  /// lives in registers - "llvm.dbg.value."
+  void EmitValue(tree_node *decl, llvm::Value *V, LLVMBuilder &Builder);
+
   /// EmitStopPoint - Emit a call to llvm.dbg.stoppoint to indicate a change of
   /// source line.
   void EmitStopPoint(llvm::BasicBlock *CurBB, LLVMBuilder &Builder);
@@ -155,6 +224,20 @@ public:
   /// createMethodType - Create MethodType.
   MigDIType createMethodType(tree_node *type);
 
+  /// getInlinedSubprogram - Get the subprogram used as the scope of the body of
+  /// the given function where it has been inlined.
+  MigDISubprogram getInlinedSubprogram(tree_node *FnDecl);
+
+  /// getBlockScope - Work out the scope of code in the given BLOCK, and the
+  /// location it was inlined at if it comes from an inlined function.  Scope
+  /// and InlinedAt describe the current function on entry.
+  void getBlockScope(tree_node *Block, llvm::MDNode *&Scope,
+                     llvm::MDNode *&InlinedAt);
+
+  /// createOpaqueFunctionType - Create a function type with no result or
+  /// argument types, for use when only line tables are wanted.
+  MigDIType createOpaqueFunctionType();
+
   /// createPointerType - Create PointerType.
   MigDIType createPointerType(tree_node *type);
 
@@ -207,7 +290,8 @@ private:
       MigDIFile F, unsigned LineNumber, uint64_t SizeInBits,
       uint64_t AlignInBits, uint64_t OffsetInBits, unsigned Flags,
       MigDIType DerivedFrom, MigDINodeArray Elements,
-      unsigned RunTimeLang = 0, llvm::MDNode *ContainingType = 0);
+      unsigned RunTimeLang = 0, llvm::MDNode *ContainingType = 0,
+      llvm::StringRef UniqueIdentifier = llvm::StringRef());
 
   /// CreateSubprogram - Create a new descriptor for the specified subprogram.
   /// See comments in DISubprogram for descriptions of these fields.
@@ -58,6 +58,7 @@
 #endif
 
 struct basic_block_def;
+struct loop;
 union gimple_statement_d;
 #if GCC_VERSION_CODE > GCC_VERSION(4, 8)
 #if GCC_MAJOR > 4
@@ -86,6 +87,7 @@ class ConstantInt;
 class Type;
 class TargetMachine;
 class DataLayout;
+class Metadata;
 template <typename> class AssertingVH;
 template <typename> class TrackingVH;
 }
@@ -132,6 +134,40 @@ extern bool flag_odr;
 /// the arguments given in the function type.
 extern bool flag_functions_from_args;
 
+/// flag_unique_types - Give record types with exactly the same layout the same
+/// LLVM type, rather than one named type each.
+extern bool flag_unique_types;
+
+/// flag_whole_program_vtables - Describe C++ virtual tables and virtual calls
+/// using type metadata, so that LLVM can turn virtual calls into direct calls
+/// when it sees the whole program at link time.
+extern bool flag_whole_program_vtables;
+
+/// flag_gc_statepoints - Report garbage collector roots at calls using
+/// gc.statepoint rather than marking their stack slots with llvm.gcroot.
+extern bool flag_gc_statepoints;
+
+/// flag_minsize - When optimizing for size, make the code as small as possible
+/// even where that makes it slower, as for clang -Oz.
+extern bool flag_minsize;
+
+/// flag_discard_value_names - Do not give LLVM values, basic blocks and types
+/// names: nobody will see them.
+extern bool flag_discard_value_names;
+
+/// flag_llvm_sanitize_address, flag_llvm_sanitize_thread - Instrument functions
+/// using LLVM's AddressSanitizer or ThreadSanitizer rather than GCC's.
+extern bool flag_llvm_sanitize_address;
+extern bool flag_llvm_sanitize_thread;
+
+/// RelaxedSyncPrefix - If not null, __sync read-modify-write builtins acting on
+/// a variable whose name starts with this prefix use monotonic ordering.
+extern const char *RelaxedSyncPrefix;
+
+/// getNumRelaxedSyncOps - The number of __sync builtins that were given
+/// monotonic ordering because of RelaxedSyncPrefix.
+extern unsigned getNumRelaxedSyncOps();
+
 /// AttributeUsedGlobals - The list of globals that are marked attribute(used).
 extern llvm::SmallSetVector<llvm::Constant *, 32> AttributeUsedGlobals;
 
@@ -141,6 +177,75 @@ extern llvm::Constant *ConvertMetadataStringToGV(const char *str);
 /// annotate attribute to a vector to be emitted later.
 extern void AddAnnotateAttrsToGlobal(llvm::GlobalValue *GV, tree_node *decl);
 
+/// getVTableTypeId - Return the identifier that type metadata uses for the
+/// given C++ class, or null if the class has no virtual table.
+extern llvm::Metadata *getVTableTypeId(tree_node *type);
+
+/// EmitProfileSummary - If any of the functions converted had profile data,
+/// attach a summary of the execution counts to the module.
+extern void EmitProfileSummary();
+
+/// EmitCallGraphProfile - If any direct calls had profile data, record how
+/// often each function called each other one, for the linker to use when
+/// ordering functions.
+extern void EmitCallGraphProfile();
+
+/// EmitOpenMPChildAttributes - Tell the outlined bodies of the OpenMP regions
+/// in the module what they know about the data libgomp passes them.
+extern void EmitOpenMPChildAttributes();
+
+/// ExceptionStatistics - Counts of the exception handling code output.
+struct ExceptionStatistics {
+  unsigned LandingPads;         // Number of landingpad instructions created.
+  unsigned SharedLandingPads;   // Number of regions sharing another's pad.
+  unsigned FailureBlocks;       // Number of failure blocks created.
+  unsigned SharedFailureBlocks; // Number of regions sharing a failure block.
+};
+
+/// getExceptionStatistics - Return statistics about the exception handling
+/// code output.
+extern const ExceptionStatistics &getExceptionStatistics();
+
+/// ConversionStatistics - Counts of what function bodies were turned into.
+struct ConversionStatistics {
+  unsigned AggregateCopiesByElement; // Aggregates copied one field at a time.
+  unsigned AggregateCopiesByMemcpy;  // Aggregates copied using memcpy.
+  unsigned AggregateZeroesByElement; // Aggregates zeroed one field at a time.
+  unsigned AggregateZeroesByMemset;  // Aggregates zeroed using memset.
+  unsigned Temporaries;              // Number of allocas created.
+  unsigned ScratchReused;            // Scratch temporaries given an old slot.
+  unsigned PhiNodes;                 // Phi nodes created from GCC phis.
+  unsigned BuiltinsLowered;          // Builtin calls given special treatment.
+  unsigned BuiltinsCalled;           // Builtin calls output as plain calls.
+  unsigned TargetBuiltinsExpanded;   // Target builtins lowered to generic IR.
+  unsigned TargetBuiltinsIntrinsic;  // Target builtins output as intrinsics.
+  unsigned Mem2RegConversions;       // Values changed to their register type.
+  unsigned Reg2MemConversions;       // Values changed to their memory type.
+  unsigned NoUnwindFunctions;        // Definitions found not to throw.
+  unsigned NoUnwindCalls;            // Calls not invokes as callee can't throw.
+};
+
+/// getConversionStatistics - Return statistics about the conversion of
+/// function bodies.
+extern const ConversionStatistics &getConversionStatistics();
+
+struct PhaseTime;
+
+/// PhaseTimer - Charges the time spent while this object is alive to the given
+/// item in the -ftime-report output, the statistics file and the time trace.
+/// Items nest like GCC timevars.  The detail, for example the name of the
+/// function being converted, only shows up in the time trace.
+class PhaseTimer {
+  PhaseTime *Phase;
+  const char *Item;
+  std::string Detail;
+
+public:
+  explicit PhaseTimer(const char *Item,
+                      const std::string &Detail = std::string());
+  ~PhaseTimer();
+};
+
 // Mapping between GCC declarations and LLVM values.  The GCC declaration must
 // satisfy HAS_RTL_P.
 
@@ -174,6 +279,26 @@ void register_ctor_dtor(llvm::Function *, int, bool);
 const char *extractRegisterName(tree_node *);
 void handleVisibility(tree_node *decl, llvm::GlobalValue *GV);
 
+/// USER_ALIGNMENT_LOG - The log base 2 of the alignment in bytes given by the
+/// user with one of -falign-functions, -falign-loops or -falign-jumps, or -1 if
+/// the user did not give one, leaving it to the target.  Any maximum number of
+/// bytes to skip (-falign-loops=N:M) is ignored.
+#if (GCC_MAJOR > 8)
+#define USER_ALIGNMENT_LOG(NAME)                                               \
+  (global_options_set.x_str_##NAME ? (int)NAME.levels[0].log : -1)
+#elif GCC_VERSION_CODE > GCC_VERSION(4, 5)
+#define USER_ALIGNMENT_LOG(NAME)                                               \
+  (global_options_set.x_##NAME && NAME > 0 ? floor_log2(NAME * 2 - 1) : -1)
+#else
+#define USER_ALIGNMENT_LOG(NAME) (-1)
+#endif
+
+#if (GCC_MAJOR > 4)
+/// NoteTrampolineUses - Record how the given function body uses trampolines.
+/// Must be called for every function body before any function is converted.
+void NoteTrampolineUses(struct function *fn);
+#endif
+
 /// Return true if and only if field no. N from struct type T is a padding
 /// element added to match llvm struct type size and gcc struct type size.
 bool isPaddingElement(tree_node *, unsigned N);
@@ -223,33 +348,70 @@ public:
 /// the Ptr member indicates the memory that the lvalue lives in.  Alignment
 /// is the alignment of the memory (in bytes).If this is a bitfield reference,
 /// BitStart indicates the first bit in the memory that is part of the field
-/// and BitSize indicates the extent.
+/// and BitSize indicates the extent.  AccessSize is the number of bits to load
+/// or store when accessing the bitfield, or zero for the fewest bytes covering
+/// it.
 ///
 /// "LValue" is intended to be a light-weight object passed around by-value.
 class LValue : public MemRef {
 public:
   unsigned char BitStart;
   unsigned char BitSize;
+  unsigned char AccessSize;
 public:
-  explicit LValue() : BitStart(255), BitSize(255) {}
-  explicit LValue(MemRef &M) : MemRef(M), BitStart(255), BitSize(255) {}
+  explicit LValue() : BitStart(255), BitSize(255), AccessSize(0) {}
+  explicit LValue(MemRef &M)
+      : MemRef(M), BitStart(255), BitSize(255), AccessSize(0) {}
   LValue(llvm::Value *P, uint32_t A, bool V = false)
-      : MemRef(P, A, V), BitStart(255), BitSize(255) {}
+      : MemRef(P, A, V), BitStart(255), BitSize(255), AccessSize(0) {}
   LValue(llvm::Value *P, uint32_t A, unsigned BSt, unsigned BSi, bool V = false)
       : MemRef(P, A, V), BitStart((unsigned char) BSt),
-        BitSize((unsigned char) BSi) {
+        BitSize((unsigned char) BSi), AccessSize(0) {
     assert(BitStart == BSt && BitSize == BSi && "Bit values larger than 256?");
   }
 
   bool isBitfield() const { return BitStart != 255; }
 };
 
+/// AccessTags - The metadata to attach to a load or store: its TBAA tag and,
+/// when GCC has worked out which other accesses it cannot alias (for example
+/// because of restrict), the alias scope and noalias lists saying so.
+struct AccessTags {
+  llvm::MDNode *TBAA;
+  llvm::MDNode *Scope;
+  llvm::MDNode *NoAlias;
+
+  AccessTags(llvm::MDNode *T = 0) : TBAA(T), Scope(0), NoAlias(0) {}
+};
+
 /// PhiRecord - This struct holds the LLVM PHI node associated with a GCC phi.
 struct PhiRecord {
   GimpleTy *gcc_phi;
   llvm::PHINode *PHI;
 };
 
+/// FunctionTables - The tables TreeToLLVM fills in while converting a function
+/// body.  A single set of tables is used for every function, being cleared
+/// rather than freed once a function is done, so the memory they grew to is
+/// reused by the next function rather than allocated afresh.
+struct FunctionTables {
+  llvm::DenseMap<basic_block_def *, llvm::BasicBlock *> BasicBlocks;
+  llvm::SmallPtrSet<llvm::BasicBlock *, 16> NamedBlocks;
+  llvm::DenseMap<tree_node *, llvm::AssertingVH<llvm::Value> > LocalDecls;
+  llvm::SmallVector<PhiRecord, 16> PendingPhis;
+  std::vector<llvm::Value *> SSANames;
+  llvm::SmallVector<std::pair<tree_node *, llvm::Value *>, 16> SSAPlaceholders;
+  llvm::DenseMap<llvm::Value *, llvm::Value *> ReplacedPlaceholders;
+  llvm::SmallVector<llvm::SmallVector<llvm::InvokeInst *, 8>, 16> NormalInvokes;
+  llvm::SmallVector<llvm::AllocaInst *, 16> ExceptionPtrs;
+  llvm::SmallVector<llvm::AllocaInst *, 16> ExceptionFilters;
+  llvm::SmallVector<llvm::BasicBlock *, 16> FailureBlocks;
+  llvm::DenseMap<tree_node *, llvm::BasicBlock *> FailureBlocksByDecl;
+
+  /// clear - Empty the tables, keeping their memory.
+  void clear();
+};
+
 /// TreeToLLVM - An instance of this class is created and used to convert the
 /// body of each function to LLVM.
 ///
@@ -271,21 +433,71 @@ class TreeToLLVM {
   // and managed by CreateTemporary.
   llvm::Instruction *AllocaInsertionPoint;
 
+  // LiveScratch - Scratch temporaries in use by the current statement.
+  // FreeScratch - Scratch temporaries available for reuse.
+  llvm::SmallVector<llvm::AllocaInst *, 8> LiveScratch, FreeScratch;
+
+  // LifetimeStarts - The local variables whose lifetime starts at a statement,
+  // or at the start of a basic block if they are first mentioned by phi nodes.
+  // Filled in by ComputeLifetimeStarts.
+  llvm::DenseMap<const void *, llvm::SmallVector<tree_node *, 2> >
+  LifetimeStarts;
+
+  // DependenceScopes - For each GCC dependence clique, the alias scope domain
+  // followed by the scopes made so far for the bases in it, indexed by base
+  // plus one.  Filled in lazily by describeAccess.
+  std::vector<llvm::SmallVector<llvm::MDNode *, 4> > DependenceScopes;
+
+  // RestrictScopes - When GCC did not compute dependence cliques, the alias
+  // scope domain for the function's restrict pointers, followed by the scopes
+  // made so far for them.  RestrictBases gives the index of the scope for each
+  // pointer, see getRestrictBase.  Filled in lazily by describeAccess.
+  llvm::SmallVector<llvm::MDNode *, 4> RestrictScopes;
+  llvm::DenseMap<std::pair<tree_node *, tree_node *>, unsigned> RestrictBases;
+
+  // GCRoots - The stack slots of the function's garbage collector roots when
+  // they are passed to calls using gc.statepoint rather than being marked with
+  // llvm.gcroot, see EmitTypeGcroot.
+  llvm::SmallVector<llvm::AllocaInst *, 4> GCRoots;
+
+  // LoopIDs - The llvm.loop metadata made for GCC loops, null for loops GCC
+  // has no hints for.  Filled in lazily by getLoopID.
+  llvm::DenseMap<loop *, llvm::MDNode *> LoopIDs;
+
   // SSAInsertionPoint - Place to insert reads corresponding to SSA default
   // definitions.
   llvm::Instruction *SSAInsertionPoint;
 
+  /// Tables - Storage for the tables below, shared by all functions.
+  FunctionTables &Tables;
+
   /// BasicBlocks - Map from GCC to LLVM basic blocks.
-  llvm::DenseMap<basic_block_def *, llvm::BasicBlock *> BasicBlocks;
+  llvm::DenseMap<basic_block_def *, llvm::BasicBlock *> &BasicBlocks;
+
+  /// NamedBlocks - The basic blocks that are not artificial, see getBasicBlock.
+  /// Kept here rather than deduced from the block names, which are dropped if
+  /// value names are being discarded.
+  llvm::SmallPtrSet<llvm::BasicBlock *, 16> &NamedBlocks;
 
   /// LocalDecls - Map from local declarations to their associated LLVM values.
-  llvm::DenseMap<tree_node *, llvm::AssertingVH<llvm::Value> > LocalDecls;
+  llvm::DenseMap<tree_node *, llvm::AssertingVH<llvm::Value> > &LocalDecls;
 
   /// PendingPhis - Phi nodes which have not yet been populated with operands.
-  llvm::SmallVector<PhiRecord, 16> PendingPhis;
+  llvm::SmallVector<PhiRecord, 16> &PendingPhis;
+
+  /// SSANames - Map from the version number of a GCC ssa name to the defining
+  /// LLVM value, see getSSAName.
+  std::vector<llvm::Value *> &SSANames;
 
-  // SSANames - Map from GCC ssa names to the defining LLVM value.
-  llvm::DenseMap<tree_node *, llvm::TrackingVH<llvm::Value> > SSANames;
+  /// SSAPlaceholders - The placeholders created for ssa names that were used
+  /// before being defined, along with the ssa names.
+  llvm::SmallVector<std::pair<tree_node *, llvm::Value *>, 16> &
+      SSAPlaceholders;
+
+  /// ReplacedPlaceholders - Map from a placeholder to the value that replaced
+  /// it once the ssa name was defined.  Placeholders are only deleted once the
+  /// function is done, since other ssa names may have been defined to be one.
+  llvm::DenseMap<llvm::Value *, llvm::Value *> &ReplacedPlaceholders;
 
 public:
 
@@ -323,20 +535,25 @@ private:
 
   /// NormalInvokes - Mapping from landing pad number to the set of invoke
   /// instructions that unwind to that landing pad.
-  llvm::SmallVector<llvm::SmallVector<llvm::InvokeInst *, 8>, 16> NormalInvokes;
+  llvm::SmallVector<llvm::SmallVector<llvm::InvokeInst *, 8>, 16> &
+      NormalInvokes;
 
   /// ExceptionPtrs - Mapping from EH region index to the local holding the
   /// exception pointer for that region.
-  llvm::SmallVector<llvm::AllocaInst *, 16> ExceptionPtrs;
+  llvm::SmallVector<llvm::AllocaInst *, 16> &ExceptionPtrs;
 
   /// ExceptionFilters - Mapping from EH region index to the local holding the
   /// filter value for that region.
-  llvm::SmallVector<llvm::AllocaInst *, 16> ExceptionFilters;
+  llvm::SmallVector<llvm::AllocaInst *, 16> &ExceptionFilters;
 
   /// FailureBlocks - Mapping from the index of a must-not-throw EH region to
   /// the block containing the failure code for the region (the code that is
   /// run if an exception is thrown in this region).
-  llvm::SmallVector<llvm::BasicBlock *, 16> FailureBlocks;
+  llvm::SmallVector<llvm::BasicBlock *, 16> &FailureBlocks;
+
+  /// FailureBlocksByDecl - Mapping from a failure function to the block that
+  /// calls it, shared by all the must-not-throw regions that use it.
+  llvm::DenseMap<tree_node *, llvm::BasicBlock *> &FailureBlocksByDecl;
 
 public:
   TreeToLLVM(tree_node *fndecl);
@@ -403,6 +620,19 @@ public:
   /// CreateTempLoc - Like CreateTemporary, but returns a MemRef.
   MemRef CreateTempLoc(llvm::Type *Ty);
 
+  /// CreateScratchTemporary - Like CreateTemporary, but for a temporary that is
+  /// only used while converting the current statement.  Slots are recycled
+  /// once the statement is done, so the returned alloca may not be new.
+  llvm::AllocaInst *CreateScratchTemporary(llvm::Type *Ty, unsigned align = 0);
+
+  /// ReleaseScratchTemporaries - End the lifetime of the scratch temporaries
+  /// used by the current statement, and make them available for reuse.
+  void ReleaseScratchTemporaries();
+
+  /// describeAccess - Return the metadata to attach to a load from or store to
+  /// the memory reference 'exp'.
+  AccessTags describeAccess(tree_node *exp);
+
   /// EmitAggregateCopy - Copy the elements from SrcLoc to DestLoc, using the
   /// GCC type specified by GCCType to know which elements to copy.
   void EmitAggregateCopy(MemRef DestLoc, MemRef SrcLoc, tree_node *GCCType);
@@ -425,20 +655,57 @@ private : // Helper functions.
   /// given scope.
   void EmitVariablesInScope(tree_node *scope);
 
+  /// ComputeLifetimeStarts - Work out where the lifetimes of local variables
+  /// that GCC clobbers at the end of their scope start.
+  void ComputeLifetimeStarts();
+
+  /// EmitLifetimeStarts - Output lifetime start markers for the variables that
+  /// ComputeLifetimeStarts associated with Key.
+  void EmitLifetimeStarts(const void *Key);
+
+  /// getLoopID - Return the llvm.loop metadata carrying the hints GCC has for
+  /// the given loop, such as those from #pragma GCC ivdep, or null if none.
+  llvm::MDNode *getLoopID(loop *L);
+
+  /// EmitLoopHints - Attach loop metadata to the code just output for the
+  /// given basic block: to its branches back to the headers of the loops it
+  /// belongs to, and if the loops are known to be parallel to its accesses.
+  void EmitLoopHints(basic_block_def *bb);
+
   /// PopulatePhiNodes - Populate generated phi nodes with their operands.
   void PopulatePhiNodes();
 
   /// getBasicBlock - Find or create the LLVM basic block corresponding to BB.
   llvm::BasicBlock *getBasicBlock(basic_block_def *bb);
 
+  /// CreateNamedBlock - Create a basic block with the given name, which is not
+  /// considered artificial (see getBasicBlock).
+  llvm::BasicBlock *CreateNamedBlock(const llvm::Twine &Name,
+                                     llvm::Function *Parent = 0,
+                                     llvm::BasicBlock *InsertBefore = 0);
+
+  /// isNamedBlock - Whether the basic block is not artificial.
+  bool isNamedBlock(llvm::BasicBlock *BB) { return NamedBlocks.count(BB); }
+
   /// getLabelDeclBlock - Lazily get and create a basic block for the specified
   /// label.
   llvm::BasicBlock *getLabelDeclBlock(tree_node *LabelDecl);
 
+  /// getSSAName - The value associated with the given SSA name, or null if
+  /// there is none yet.
+  llvm::Value *getSSAName(tree_node *reg);
+
+  /// setSSAName - Associate the given value with the given SSA name.
+  void setSSAName(tree_node *reg, llvm::Value *Val);
+
   /// DefineSSAName - Use the given value as the definition of the given SSA
   /// name.  Returns the provided value as a convenience.
   llvm::Value *DefineSSAName(tree_node *reg, llvm::Value *Val);
 
+  /// EmitDebugValue - Describe the given value to the debugger as the new
+  /// value of the user variable that the SSA name is a version of, if any.
+  void EmitDebugValue(tree_node *reg, llvm::Value *Val);
+
   /// BeginBlock - Add the specified basic block to the end of the function.  If
   /// the previous block falls through into it, add an explicit branch.
   void BeginBlock(llvm::BasicBlock *BB);
@@ -464,6 +731,14 @@ private : // Helper functions.
   llvm::Value *EmitMemSet(llvm::Value *DestPtr, llvm::Value *SrcVal,
                           llvm::Value *Size, unsigned Align);
 
+  /// usesExceptionSlots - Whether the exception pointer or filter value of the
+  /// given exception handling region is read anywhere.
+  bool usesExceptionSlots(unsigned RegionNo);
+
+  /// ShareLandingPads - Have exception handling regions that would get
+  /// identical landing pads share one.
+  void ShareLandingPads();
+
   /// EmitLandingPads - Emit EH landing pads.
   void EmitLandingPads();
 
@@ -504,6 +779,7 @@ private:
 
   void RenderGIMPLE_ASM(GimpleTy *stmt);
   void RenderGIMPLE_ASSIGN(GimpleTy *stmt);
+  GimpleTy *EmitConstantStoreRun(GimpleTy *stmt);
   void RenderGIMPLE_CALL(GimpleTy *stmt);
   void RenderGIMPLE_COND(GimpleTy *stmt);
   void RenderGIMPLE_EH_DISPATCH(GimpleTy *stmt);
@@ -524,6 +800,9 @@ private:
   /// OutputCallRHS - Convert the RHS of a GIMPLE_CALL.
   llvm::Value *OutputCallRHS(GimpleTy *stmt, const MemRef *DestLoc);
 
+  /// EmitTypeTest - Tell LLVM which class a virtual call is made through.
+  void EmitTypeTest(tree_node *call_expr);
+
   /// WriteScalarToLHS - Store RHS, a non-aggregate value, into the given LHS.
   void WriteScalarToLHS(tree_node *lhs, llvm::Value *Scalar);
 
@@ -586,6 +865,10 @@ private:
                                unsigned Opc);
   llvm::Value *EmitReg_VecUnpackHiExpr(tree_node *type, tree_node *op0);
   llvm::Value *EmitReg_VecUnpackLoExpr(tree_node *type, tree_node *op0);
+#if GCC_VERSION_CODE > GCC_VERSION(4, 7)
+  llvm::Value *EmitReg_VecWidenMultEvenOddExpr(tree_node *type, tree_node *op0,
+                                               tree_node *op1, unsigned First);
+#endif
   llvm::Value *EmitReg_BIT_AND_EXPR(tree_node *op0, tree_node *op1);
   llvm::Value *EmitReg_BIT_IOR_EXPR(tree_node *op0, tree_node *op1);
   llvm::Value *EmitReg_BIT_XOR_EXPR(tree_node *op0, tree_node *op1);
@@ -629,6 +912,15 @@ private:
   llvm::Value *EmitReg_VEC_PERM_EXPR(tree_node *op0, tree_node *op1,
                                      tree_node *op2);
 #endif
+#if (GCC_MAJOR > 6)
+  llvm::Value *EmitReg_BIT_INSERT_EXPR(tree_node *op0, tree_node *op1,
+                                       tree_node *op2);
+#endif
+
+  /// EmitReg_BIT_FIELD_REF - If the BIT_FIELD_REF selects whole elements of a
+  /// vector register, extract them with vector operations.  Otherwise return
+  /// null: the reference has to go through memory.
+  llvm::Value *EmitReg_BIT_FIELD_REF(tree_node *exp);
 
   llvm::Value *EmitLoadOfLValue(tree_node *exp);
   llvm::Value *EmitOBJ_TYPE_REF(tree_node *exp);
@@ -656,6 +948,12 @@ private:
                                  unsigned PostOp = 0);
   llvm::Value *
   BuildCmpAndSwapAtomic(GimpleTy *stmt, unsigned Bits, bool isBool);
+  llvm::Value *BuildAtomicLoad(GimpleTy *stmt, unsigned Bits);
+  void BuildAtomicStore(GimpleTy *stmt, unsigned Bits);
+  llvm::Value *BuildAtomicRMW(GimpleTy *stmt, unsigned Bits,
+                              llvm::AtomicRMWInst::BinOp Kind,
+                              unsigned PostOp = 0);
+  llvm::Value *BuildAtomicCompareExchange(GimpleTy *stmt, unsigned Bits);
 
   // Builtin Function Expansion.
   bool EmitBuiltinCall(GimpleTy *stmt, tree_node *fndecl,
@@ -717,10 +1015,22 @@ private:
                                     llvm::Value *&Result);
   bool EmitBuiltinUnwindInit(GimpleTy *stmt, llvm::Value *&Result);
 
+#if GCC_VERSION_CODE > GCC_VERSION(4, 6)
+  // Internal Function Expansion.
+  llvm::Value *EmitInternalCall(GimpleTy *stmt);
+  llvm::Value *EmitCheckedArithmetic(llvm::Instruction::BinaryOps Opc,
+                                     tree_node *op0, tree_node *op1,
+                                     tree_node *type, llvm::Value *&Overflow);
+  void EmitTrapIf(llvm::Value *Cond);
+#endif
+
   // Complex Math Expressions.
   llvm::Value *CreateComplex(llvm::Value *Real, llvm::Value *Imag);
   void SplitComplex(llvm::Value *Complex, llvm::Value *&Real,
                     llvm::Value *&Imag);
+  llvm::Value *EmitComplexLibCall(llvm::StringRef Op, tree_node *type,
+                                  llvm::Value *LHSr, llvm::Value *LHSi,
+                                  llvm::Value *RHSr, llvm::Value *RHSi);
 
   // L-Value Expressions.
   LValue EmitLV_ARRAY_REF(tree_node *exp);
@@ -803,6 +1113,11 @@ private:
                             llvm::Type *ResultType,
                             std::vector<llvm::Value *> &Ops);
 
+  // Optional target defined expansion of vector permutations with a variable
+  // mask.
+  llvm::Value *TargetVectorPermute(llvm::Value *V0, llvm::Value *V1,
+                                   llvm::Value *Mask, bool OneInput);
+
 public:
   // Helper for taking the address of a label.
   llvm::Constant *AddressOfLABEL_DECL(tree_node *exp);
@@ -82,8 +82,9 @@ template <enum dragonegg_tree_code code> bool isa(const_tree t) {
 /// be used for everything that will end up with a name in the final assembler.
 /// It should not be used for anything else: GCC will usually crash if you try
 /// to use this with types, function arguments or anything else that doesn't
-/// have a name in the final assembler.
-std::string getAssemblerName(tree t);
+/// have a name in the final assembler.  The string is nul terminated and lives
+/// as long as the compiler does, so there is no need to copy it.
+llvm::StringRef getAssemblerName(tree t);
 
 /// getDescriptiveName - Return a helpful name for the given tree, or an empty
 /// string if no sensible name was found.  These names are used to make the IR
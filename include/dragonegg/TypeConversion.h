@@ -25,6 +25,7 @@
 #define DRAGONEGG_TYPES_H
 
 // LLVM headers
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/IR/CallingConv.h"
 
 // Forward declarations.
@@ -62,6 +63,25 @@ extern uint64_t ArrayLengthOf(tree_node *type);
 /// INT_MAX if there is no such LLVM field.
 int GetFieldIndex(tree_node *decl, llvm::Type *Ty);
 
+/// FieldLayout - The position and size of a field of a record type, as found
+/// by getRecordLayout.
+struct FieldLayout {
+  tree_node *Field;  // The FIELD_DECL.
+  uint64_t FirstBit; // The offset of the field from the start of the record.
+  uint64_t BitWidth; // The DECL_SIZE of the field, or NO_LENGTH if variable.
+  bool Bitfield;     // Whether the field has to be treated as a bitfield.
+};
+
+/// getRecordLayout - Return the fields of the given complete record or union
+/// type whose position the LLVM type system can represent (those satisfying
+/// OffsetIsLLVMCompatible), in declaration order.  The summary is computed once
+/// per type and stays valid until flushRecordLayouts is called.
+extern llvm::ArrayRef<FieldLayout> getRecordLayout(tree_node *type);
+
+/// flushRecordLayouts - Forget the results of previous calls to
+/// getRecordLayout.  Must be called whenever the garbage collector runs.
+extern void flushRecordLayouts();
+
 /// GetUnitType - Returns an integer one address unit wide if 'NumUnits' is 1;
 /// otherwise returns an array of such integers with 'NumUnits' elements.  For
 /// example, on a machine which has 16 bit bytes returns an i16 or an array of
@@ -85,8 +105,12 @@ extern bool isSizeCompatible(tree_node *type);
 /// variant of the type.
 extern llvm::Type *getRegType(tree_node *type);
 
+/// getAddressSpace - Returns the LLVM address space of memory holding a value
+/// of the given GCC type, which may be qualified with a named address space.
+extern unsigned getAddressSpace(tree_node *type);
+
 /// getPointerToType - Returns the LLVM register type to use for a pointer to
-/// the given GCC type.
+/// the given GCC type.  The pointer is into the type's address space.
 extern llvm::Type *getPointerToType(tree_node *type);
 
 /// ConvertType - Returns the LLVM type to use for memory that holds a value
@@ -101,6 +125,27 @@ extern llvm::FunctionType *
 ConvertFunctionType(tree_node *type, tree_node *decl, tree_node *static_chain,
                     llvm::CallingConv::ID &CC, MigAttributeSet &PAL);
 
+/// getNumRecordTypesMerged - The number of record types that were given the
+/// LLVM type of an earlier record with the same layout (see flag_unique_types).
+extern unsigned getNumRecordTypesMerged();
+
+/// TypeConversionStatistics - The number of entries in the tables kept by type
+/// conversion.
+struct TypeConversionStatistics {
+  unsigned long RecordLayouts; // Records whose field layout is known.
+  unsigned long UniqueRecords; // Record types later ones may be merged with.
+  unsigned long FunctionTypes; // Results of ConvertFunctionType.
+};
+
+/// getTypeConversionStatistics - Return the sizes of the type conversion
+/// tables.
+extern const TypeConversionStatistics &getTypeConversionStatistics();
+
+/// flushFunctionTypeCache - Forget the results of previous calls to
+/// ConvertFunctionType, and how arguments of each type are passed.  Must be
+/// called whenever the garbage collector runs.
+extern void flushFunctionTypeCache();
+
 /// ConvertArgListToFnType - Given a DECL_ARGUMENTS list on an GCC tree,
 /// return the LLVM type corresponding to the function.  This is useful for
 /// turning "T foo(...)" functions into "T foo(void)" functions.
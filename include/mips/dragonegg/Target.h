@@ -24,8 +24,117 @@
 #ifndef DRAGONEGG_TARGET_H
 #define DRAGONEGG_TARGET_H
 
+namespace llvm { class SubtargetFeatures; }
+
+#ifdef DRAGONEGG_ABI_H
+
+extern bool llvm_mips_should_pass_aggregate_in_mixed_regs(
+    tree_node *, llvm::Type *Ty, std::vector<llvm::Type *> &);
+
+/* Under O32, N32 and N64 an aggregate is passed as a sequence of register
+   sized words, each in the next argument slot whether that is a register or
+   the stack.  Under N32 and N64 a word holding a double field of a structure
+   goes in a floating point register.  */
+#define LLVM_SHOULD_PASS_AGGREGATE_IN_MIXED_REGS(T, TY, CC, E)                 \
+  llvm_mips_should_pass_aggregate_in_mixed_regs((T), (TY), (E))
+
+extern bool llvm_mips_should_pass_aggregate_using_byval_attr(tree_node *);
+
+/* Aggregates more aligned than a word, which start at an even numbered
+   argument slot, and those too big for the argument registers are passed
+   byval.  The code generator knows how to place those.  */
+#define LLVM_SHOULD_PASS_AGGREGATE_USING_BYVAL_ATTR(X, TY)                     \
+  llvm_mips_should_pass_aggregate_using_byval_attr(X)
+
+/* Under N32 and N64 the parts of a complex floating point number are passed
+   in floating point registers, one per argument slot, so pass them as
+   separate elements.  */
+#define LLVM_SHOULD_PASS_AGGREGATE_IN_INTEGER_REGS(X, Y, Z)                    \
+  (!(TARGET_NEWABI && TARGET_HARD_FLOAT_ABI && isa<COMPLEX_TYPE>(X) &&         \
+     SCALAR_FLOAT_TYPE_P(TREE_TYPE(X))) &&                                     \
+   !isSingleElementStructOrArray((X), false, true))
+
+extern llvm::Type *llvm_mips_scalar_type_for_struct_return(tree_node *type,
+                                                           unsigned *Offset);
+
+/* LLVM_SCALAR_TYPE_FOR_STRUCT_RETURN - Return LLVM Type if X can be
+  returned as a scalar, otherwise return NULL. */
+#define LLVM_SCALAR_TYPE_FOR_STRUCT_RETURN(X, Y, CC)                           \
+  llvm_mips_scalar_type_for_struct_return((X), (Y))
+
+extern llvm::Type *llvm_mips_aggr_type_for_struct_return(tree_node *type);
+
+/* LLVM_AGGR_TYPE_FOR_STRUCT_RETURN - Return LLVM Type if X can be
+  returned as an aggregate, otherwise return NULL. */
+#define LLVM_AGGR_TYPE_FOR_STRUCT_RETURN(X, CC)                                \
+  llvm_mips_aggr_type_for_struct_return(X)
+
+extern void llvm_mips_extract_multiple_return_value(
+    llvm::Value *Src, llvm::Value *Dest, bool isVolatile, LLVMBuilder &B);
+
+/* LLVM_EXTRACT_MULTIPLE_RETURN_VALUE - Extract multiple return value from
+  SRC and assign it to DEST. */
+#define LLVM_EXTRACT_MULTIPLE_RETURN_VALUE(Src, Dest, V, B)                    \
+  llvm_mips_extract_multiple_return_value((Src), (Dest), (V), (B))
+
+extern llvm::Value *llvm_mips_load_scalar_argument(llvm::Value *L,
+                                                   llvm::Type *LLVMTy,
+                                                   unsigned RealSize,
+                                                   LLVMBuilder &B);
+
+/* A partial word at the end of an aggregate goes in the high part of its
+   register on big endian machines, as if the whole word had been loaded.  */
+#define LLVM_LOAD_SCALAR_ARGUMENT(LOC, TY, SIZE, BUILDER)                      \
+  llvm_mips_load_scalar_argument((LOC), (TY), (SIZE), (BUILDER))
+
+extern void llvm_mips_store_scalar_argument(llvm::Value *Loc,
+                                            llvm::Value *ArgVal,
+                                            llvm::Type *LLVMTy,
+                                            unsigned RealSize,
+                                            LLVMBuilder &B);
+
+#define LLVM_STORE_SCALAR_ARGUMENT(LOC, ARG, TYPE, SIZE, BUILDER)              \
+  llvm_mips_store_scalar_argument((LOC), (ARG), (TYPE), (SIZE), (BUILDER))
+
+#endif /* DRAGONEGG_ABI_H */
+
+/* LLVM_TARGET_INTRINSIC_PREFIX - Specify what prefix this target uses for its
+ * intrinsics.
+ */
 #define LLVM_TARGET_INTRINSIC_PREFIX "mips"
 
+/* LLVM_TARGET_NAME - This specifies the name of the target, which correlates to
+ * the llvm::InitializeXXXTarget() function.
+ */
 #define LLVM_TARGET_NAME Mips
 
+/* A compiler for a 64 bit triple may be producing O32 code and vice versa, so
+   choose the architecture from the ABI.  */
+#define LLVM_OVERRIDE_TARGET_ARCH()                                            \
+  (mips_abi == ABI_32 ? (BYTES_BIG_ENDIAN ? "mips" : "mipsel")                 \
+                      : (BYTES_BIG_ENDIAN ? "mips64" : "mips64el"))
+
+/* LLVM_TARGET_ABI_NAME - The name LLVM uses for the ABI in use, or the empty
+   string to let it choose from the triple.  N32 shares its triple with N64.
+ */
+#define LLVM_TARGET_ABI_NAME                                                   \
+  (mips_abi == ABI_32 ? "o32" : mips_abi == ABI_N32                            \
+                                    ? "n32"                                    \
+                                    : mips_abi == ABI_64 ? "n64" : "")
+
+/* Turn -march=xx, -mmsa, -mfp64 and friends into a CPU type and features.
+ */
+extern void llvm_mips_set_subtarget_features(std::string &C,
+                                             llvm::SubtargetFeatures &F);
+#define LLVM_SET_SUBTARGET_FEATURES(C, F) llvm_mips_set_subtarget_features(C, F)
+
+/* LLVM_TARGET_INTRINSIC_LOWER - To handle builtins, we want to expand the
+ * invocation into normal LLVM code.  If the target can handle the builtin, this
+ * macro should call the target TreeToLLVM::TargetIntrinsicLower method and
+ *  return true.This macro is invoked from a method in the TreeToLLVM class.
+ */
+#define LLVM_TARGET_INTRINSIC_LOWER(STMT, FNDECL, DESTLOC, RESULT, DESTTY,     \
+                                    OPS)                                       \
+  TargetIntrinsicLower(STMT, FNDECL, DESTLOC, RESULT, DESTTY, OPS);
+
 #endif /* DRAGONEGG_TARGET_H */
@@ -26,6 +26,8 @@
 namespace llvm { class SubtargetFeatures; }
 
 /* LLVM specific stuff for supporting calling convention output */
+/* On x86-64 the ms_abi and sysv_abi attributes select the Microsoft or the
+   System V convention when it differs from the default for the target. */
 #define TARGET_ADJUST_LLVM_CC(CC, type)                                        \
   {                                                                            \
     tree_node *type_attributes = TYPE_ATTRIBUTES(type);                        \
@@ -33,6 +35,14 @@ namespace llvm { class SubtargetFeatures; }
       CC = CallingConv::X86_StdCall;                                           \
     } else if (lookup_attribute("fastcall", type_attributes)) {                \
       CC = CallingConv::X86_FastCall;                                          \
+    } else if (lookup_attribute("thiscall", type_attributes)) {                \
+      CC = CallingConv::X86_ThisCall;                                          \
+    } else if (TARGET_64BIT && ix86_abi != MS_ABI &&                           \
+               lookup_attribute("ms_abi", type_attributes)) {                  \
+      CC = CallingConv::X86_64_Win64;                                          \
+    } else if (TARGET_64BIT && ix86_abi == MS_ABI &&                           \
+               lookup_attribute("sysv_abi", type_attributes)) {                \
+      CC = CallingConv::X86_64_SysV;                                           \
     }                                                                          \
   }
 
@@ -126,19 +136,21 @@ extern bool llvm_x86_should_pass_aggregate_in_integer_regs(tree_node *,
   llvm_x86_should_pass_aggregate_in_integer_regs((X), (Y), (Z))
 
 extern llvm::Type *
-llvm_x86_scalar_type_for_struct_return(tree_node *type, unsigned *Offset);
+llvm_x86_scalar_type_for_struct_return(tree_node *type, unsigned *Offset,
+                                       llvm::CallingConv::ID CC);
 
 /* LLVM_SCALAR_TYPE_FOR_STRUCT_RETURN - Return LLVM Type if X can be
    returned as a scalar, otherwise return NULL. */
-#define LLVM_SCALAR_TYPE_FOR_STRUCT_RETURN(X, Y)                               \
-  llvm_x86_scalar_type_for_struct_return((X), (Y))
+#define LLVM_SCALAR_TYPE_FOR_STRUCT_RETURN(X, Y, CC)                           \
+  llvm_x86_scalar_type_for_struct_return((X), (Y), (CC))
 
-extern llvm::Type *llvm_x86_aggr_type_for_struct_return(tree_node *type);
+extern llvm::Type *llvm_x86_aggr_type_for_struct_return(tree_node *type,
+                                                       llvm::CallingConv::ID);
 
 /* LLVM_AGGR_TYPE_FOR_STRUCT_RETURN - Return LLVM Type if X can be
    returned as an aggregate, otherwise return NULL. */
 #define LLVM_AGGR_TYPE_FOR_STRUCT_RETURN(X, CC)                                \
-  llvm_x86_aggr_type_for_struct_return(X)
+  llvm_x86_aggr_type_for_struct_return((X), (CC))
 
 extern void llvm_x86_extract_multiple_return_value(
     llvm::Value *Src, llvm::Value *Dest, bool isVolatile, LLVMBuilder &B);
@@ -195,6 +207,14 @@ extern bool llvm_x86_should_pass_aggregate_as_fca(tree_node *type,
   llvm_x86_should_pass_aggregate_as_fca(X, TY)
 #endif
 
+extern unsigned llvm_x86_aggregate_copy_cost(tree_node *);
+
+/* The code generator expands a small memcpy or memset into moves using the
+   widest vector registers available, so use one when that takes fewer moves
+   than doing each element of the aggregate in turn.  */
+#define TARGET_DRAGONEGG_MEMCPY_COST(TYPE) llvm_x86_aggregate_copy_cost(TYPE)
+#define TARGET_DRAGONEGG_MEMSET_COST(TYPE) llvm_x86_aggregate_copy_cost(TYPE)
+
 extern bool llvm_x86_should_pass_aggregate_in_memory(tree_node *, llvm::Type *);
 
 #define LLVM_SHOULD_PASS_AGGREGATE_USING_BYVAL_ATTR(X, TY)                     \
@@ -210,6 +230,18 @@ extern bool llvm_x86_32_should_pass_aggregate_in_mixed_regs(
        ? llvm_x86_64_should_pass_aggregate_in_mixed_regs((T), (TY), (E))       \
        : llvm_x86_32_should_pass_aggregate_in_mixed_regs((T), (TY), (E)))
 
+struct DefaultABIClient;
+extern bool llvm_x86_try_pass_aggregate_custom(tree_node *,
+                                               std::vector<llvm::Type *> &,
+                                               llvm::CallingConv::ID CC,
+                                               struct DefaultABIClient *);
+
+/* LLVM_TRY_PASS_AGGREGATE_CUSTOM - Aggregates passed to functions using the
+   Microsoft x64 convention go in an integer register if they are 1, 2, 4 or 8
+   bytes long, and otherwise by reference to a copy. */
+#define LLVM_TRY_PASS_AGGREGATE_CUSTOM(T, E, CC, C)                            \
+  llvm_x86_try_pass_aggregate_custom((T), (E), (CC), (C))
+
 extern bool llvm_x86_64_aggregate_partially_passed_in_regs(
     std::vector<llvm::Type *> &, std::vector<llvm::Type *> &, bool);
 
@@ -258,11 +290,10 @@ extern void llvm_x86_set_subtarget_features(std::string &C,
                                             llvm::SubtargetFeatures &F);
 #define LLVM_SET_SUBTARGET_FEATURES(C, F) llvm_x86_set_subtarget_features(C, F)
 
-#define LLVM_SET_IMPLICIT_FLOAT(flag_no_implicit_float)                        \
-  if (!TARGET_80387)                                                           \
-    flag_no_implicit_float = 1;                                                \
-  else                                                                         \
-    flag_no_implicit_float = 0;
+/* LLVM_HAS_OWN_SUBTARGET - Whether a function needs its own subtarget even
+   without the target attribute, because it changes the Spectre mitigations. */
+extern bool llvm_x86_has_own_subtarget(tree_node *);
+#define LLVM_HAS_OWN_SUBTARGET(FNDECL) llvm_x86_has_own_subtarget(FNDECL)
 
 /* LLVM ABI definition macros. */
 
@@ -292,6 +323,13 @@ extern const char *llvm_x86_override_target_environment();
                                     OPS)                                       \
   TargetIntrinsicLower(STMT, FNDECL, DESTLOC, RESULT, DESTTY, OPS);
 
+/* LLVM_TARGET_VECTOR_PERMUTE - Expand a permutation of two vectors by a mask
+ * that is not constant, returning null if the target has nothing better than
+ * going through memory.  Use pshufb for 128 bit vectors when SSSE3 is on.
+ */
+#define LLVM_TARGET_VECTOR_PERMUTE(V0, V1, MASK, ONEINPUT)                     \
+  TargetVectorPermute(V0, V1, MASK, ONEINPUT)
+
 /* LLVM_GET_REG_NAME - When extracting a register name for a constraint, use
    the string extracted from the magic symbol built for that register, rather
    than reg_names.  The latter maps both AH and AL to the same thing, which
@@ -304,6 +342,18 @@ extern const char *llvm_x86_override_target_environment();
     ((!nm || ISDIGIT(*nm)) ? reg_names[REG_NUM] : nm);                                                              \
   })
 
+/* LLVM_NAMED_REGISTER_P - The x86 code generator only lets global register
+   variables live in the stack pointer. */
+#define LLVM_NAMED_REGISTER_P(NAME)                                            \
+  (!strcmp((NAME), TARGET_64BIT ? "rsp" : "esp"))
+
+/* LLVM_ADDRESS_SPACE - GCC numbers the __seg_fs and __seg_gs address spaces 1
+   and 2, while LLVM uses 257 for fs-relative and 256 for gs-relative memory.
+ */
+#if (GCC_MAJOR > 5)
+#define LLVM_ADDRESS_SPACE(AS) ((AS) == 1 ? 257 : (AS) == 2 ? 256 : (AS))
+#endif
+
 /* LLVM_CANONICAL_ADDRESS_CONSTRAINTS - Valid x86 memory addresses include
    symbolic values and immediates.  Canonicalize GCC's "p" constraint for
    memory addresses to allow both memory and immediate operands. */
@@ -354,11 +404,24 @@ extern const char *llvm_x86_override_target_environment();
   }
 #endif
 
+/* Before LLVM 3.9 -mstackrealign could only be given for the whole module. */
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 9)
 #define LLVM_SET_MACHINE_OPTIONS(argvec)                                       \
   do {                                                                         \
     if (ix86_force_align_arg_pointer)                                          \
       argvec.push_back("-force-align-stack");                                  \
   } while (0)
+#endif
+
+/* LLVM_LOOP_ALIGNMENT_OPTION - The LLVM option giving the log base 2 of the
+   alignment of loop headers, used for -falign-loops. */
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 7)
+#define LLVM_LOOP_ALIGNMENT_OPTION "x86-experimental-pref-loop-alignment"
+#endif
+
+/* LLVM_OMIT_LEAF_FRAME_POINTER - Whether frame pointers are only kept in
+   functions that make calls (-momit-leaf-frame-pointer). */
+#define LLVM_OMIT_LEAF_FRAME_POINTER TARGET_OMIT_LEAF_FRAME_POINTER
 
 #define LLVM_SET_TARGET_MACHINE_OPTIONS(O)                                     \
   do {                                                                         \
@@ -366,10 +429,35 @@ extern const char *llvm_x86_override_target_environment();
       O.NoFramePointerElim = false;                                            \
   } while (0)
 
+/* LLVM_SET_TARGET_MACHINE_ATTRIBUTES - Per function code generation options.
+   The target options have already been switched to those of the function, so
+   -mno-red-zone, -mgeneral-regs-only (which turns off the x87 unit along with
+   SSE and MMX), -mstackrealign and -mprefer-vector-width= can differ between
+   functions given the target attribute. */
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+#define LLVM_SET_STACK_REALIGN_ATTRIBUTE(F)                                    \
+  if (ix86_force_align_arg_pointer)                                            \
+    F->addFnAttr("stackrealign");
+#else
+#define LLVM_SET_STACK_REALIGN_ATTRIBUTE(F)
+#endif
+#if (GCC_MAJOR > 7) && LLVM_VERSION_CODE > LLVM_VERSION(6, 0)
+#define LLVM_SET_VECTOR_WIDTH_ATTRIBUTE(F)                                     \
+  if (prefer_vector_width_type != PVW_NONE)                                    \
+    F->addFnAttr("prefer-vector-width",                                        \
+                 prefer_vector_width_type == PVW_AVX128 ? "128" :              \
+                 prefer_vector_width_type == PVW_AVX256 ? "256" : "512");
+#else
+#define LLVM_SET_VECTOR_WIDTH_ATTRIBUTE(F)
+#endif
 #define LLVM_SET_TARGET_MACHINE_ATTRIBUTES(F)                                  \
   do {                                                                         \
-    if (TARGET_OMIT_LEAF_FRAME_POINTER)                                        \
-      F->addFnAttr("no-frame-pointer-elim-non-leaf", "true");                  \
+    if (!TARGET_RED_ZONE)                                                      \
+      F->addFnAttr(llvm::Attribute::NoRedZone);                                \
+    if (!TARGET_80387)                                                         \
+      F->addFnAttr(llvm::Attribute::NoImplicitFloat);                          \
+    LLVM_SET_STACK_REALIGN_ATTRIBUTE(F)                                        \
+    LLVM_SET_VECTOR_WIDTH_ATTRIBUTE(F)                                         \
   } while (0)
 
 #endif /* DRAGONEGG_TARGET_H */
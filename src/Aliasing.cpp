@@ -36,6 +36,7 @@
 // System headers
 #include <gmp.h>
 #include <map>
+#include <vector>
 
 // GCC headers
 #include "auto-host.h"
@@ -88,9 +89,51 @@ static MDNode *getTBAARoot() {
   return Root;
 }
 
-/// describeAliasSet - Return TBAA metadata describing what a load from or store
-/// to the given tree may alias.
-MDNode *describeAliasSet(tree t) {
+/// getAnyTypeNode - Return the TBAA type node that all other scalar type nodes
+/// hang off.  An access with this type may alias anything.  It takes the place
+/// of nodes that turn out not to be leaves of GCC's alias set DAG after all.
+static MDNode *getAnyTypeNode() {
+  static MDNode *Any;
+  if (!Any) {
+    LLVMContext &Context =
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+        TheModule->getContext();
+#else
+        TheContext;
+#endif
+    MDBuilder MDHelper(Context);
+    Any = MDHelper.createTBAAScalarTypeNode("alias set 0", getTBAARoot());
+  }
+  return Any;
+}
+
+/// Stats - Statistics about the TBAA nodes created by describeAliasSet.
+static AliasingStatistics Stats;
+
+const AliasingStatistics &getAliasingStatistics() { return Stats; }
+
+/// hasComponentSubset - Return whether the alias set of some field of the given
+/// record or union type, other than alias set 0, is a subset of the type's
+/// alias set.  GCC records such an edge for every field that can be accessed on
+/// its own (see record_component_aliases), so this is usually the case.
+static bool hasComponentSubset(tree type, alias_set_type alias_set) {
+  if (!isa<RECORD_OR_UNION_TYPE>(type))
+    return false;
+  for (tree field = TYPE_FIELDS(type); field; field = TREE_CHAIN(field)) {
+    if (!isa<FIELD_DECL>(field))
+      continue;
+    alias_set_type field_set = get_alias_set(TREE_TYPE(field));
+    if (field_set > 0 && field_set != alias_set &&
+        alias_set_subset_of(field_set, alias_set))
+      return true;
+  }
+  return false;
+}
+
+/// getLeafTypeNode - Return the TBAA type node for the alias set of the given
+/// tree, or null if the alias set is not (or no longer known to be) a leaf of
+/// GCC's alias set DAG, in which case accesses may alias anything.
+static MDNode *getLeafTypeNode(tree t) {
   alias_set_type alias_set = get_alias_set(t);
   // Alias set 0 is the root of the alias graph and can alias anything.  A
   // negative value represents an unknown alias set, which as far as we know
@@ -104,23 +147,22 @@ MDNode *describeAliasSet(tree t) {
   // each record type with, for every field, an edge from the node to the node
   // for the field's type.  As a result the leaves of the DAG are usually scalar
   // types, with an incoming edge from every record type with a field with that
-  // scalar type.  On the other hand, LLVM requires TBAA nodes to form a tree.
-  // In short we need to come up with a tree and a graph map (i.e. a map that
-  // takes nodes to nodes and edges to edges) from GCC's DAG to this tree.  (An
-  // alternative is to complicate LLVM so that it too uses DAGs for TBAA).  An
-  // additional difficulty is that we don't actually know the edges in the DAG:
-  // GCC's alias analysis interface does not expose them.  All that we have is
-  // alias_set_subset_of(s, t) which returns true iff there is a path from t to
-  // s in the DAG.  Finally, we don't know the nodes of the DAG either!  We only
-  // discover them progressively as we convert functions.
-  // For the moment we take a very simple approach: we only use the leaf nodes
-  // of GCC's DAG.  This means that we do a good job for scalars and a poor job
-  // for record types, including complex types.
-  static std::map<alias_set_type, MDNode *> NodeTags; // Node -> metadata map.
-  static SmallVector<alias_set_type, 8> LeafNodes;    // Current set of leaves.
-
-  std::map<alias_set_type, MDNode *>::iterator I = NodeTags.find(alias_set);
-  if (I != NodeTags.end())
+  // scalar type.  On the other hand, LLVM requires TBAA scalar type nodes to
+  // form a tree.  In short we need to come up with a tree and a graph map (i.e.
+  // a map that takes nodes to nodes and edges to edges) from GCC's DAG to this
+  // tree.  An additional difficulty is that we don't actually know the edges in
+  // the DAG: GCC's alias analysis interface does not expose them.  All that we
+  // have is alias_set_subset_of(s, t) which returns true iff there is a path
+  // from t to s in the DAG.  Finally, we don't know the nodes of the DAG
+  // either!  We only discover them progressively as we convert functions.
+  // We take a simple approach: scalar type nodes are only made for the leaf
+  // nodes of GCC's DAG.  Record types are described by struct type nodes built
+  // from their fields instead (see getRecordTypeNode).
+  static std::map<alias_set_type, MDNode *> NodeTypes; // Node -> type node map.
+  static SmallVector<alias_set_type, 8> LeafNodes;     // Current set of leaves.
+
+  std::map<alias_set_type, MDNode *>::iterator I = NodeTypes.find(alias_set);
+  if (I != NodeTypes.end())
     return I->second;
 
   if (LeafNodes.empty())
@@ -128,15 +170,28 @@ MDNode *describeAliasSet(tree t) {
     // This is handled automatically (below) except when there are not yet any
     // known leaf nodes.
     if (alias_set_subset_of(0, alias_set)) {
-      NodeTags[alias_set] = 0;
+      NodeTypes[alias_set] = 0;
       return 0;
     }
 
+  // Most alias sets are those of records, which have an edge to the alias set
+  // of each of their fields and so are never leaves.  Checking the fields is
+  // cheaper than checking against every known leaf below, and avoids making a
+  // leaf of a record only to drop it once the type of a field turns up.  This
+  // keeps the cost linear in the number of record types.
+  tree type =
+      TYPE_CANONICAL(TYPE_MAIN_VARIANT(isa<TYPE>(t) ? t : TREE_TYPE(t)));
+  if (get_alias_set(type) == alias_set && hasComponentSubset(type, alias_set)) {
+    NodeTypes[alias_set] = 0;
+    ++Stats.RecordsSkipped;
+    return 0;
+  }
+
   // If there is a path from this node to any leaf node then it is not a leaf
   // node and can be discarded.
   for (unsigned i = 0, e = (unsigned) LeafNodes.size(); i != e; ++i)
     if (alias_set_subset_of(LeafNodes[i], alias_set)) {
-      NodeTags[alias_set] = 0;
+      NodeTypes[alias_set] = 0;
       return 0;
     }
   assert(!alias_set_subset_of(0, alias_set) && "'May alias' not transitive?");
@@ -147,18 +202,18 @@ MDNode *describeAliasSet(tree t) {
     alias_set_type leaf_set = LeafNodes[--i];
     if (alias_set_subset_of(alias_set, leaf_set)) {
       LeafNodes.erase(LeafNodes.begin() + i);
-      MDNode *&LeafTag = NodeTags[leaf_set];
+      MDNode *&LeafType = NodeTypes[leaf_set];
       // It would be neat to strip the tbaa tag from any instructions using it
-      // but it is simpler to just replace it with the root tag everywhere.
-      LeafTag->replaceAllUsesWith(getTBAARoot());
-      LeafTag = 0;
+      // but it is simpler to make it alias everything instead.  This also
+      // updates any record type nodes with a field of this type.
+      LeafType->replaceAllUsesWith(getAnyTypeNode());
+      LeafType = 0;
+      ++Stats.NodesDropped;
     }
   }
 
-  // Create metadata describing the new node hanging off root.  The name doesn't
-  // matter much but needs to be unique for the compilation unit.
-  tree type =
-      TYPE_CANONICAL(TYPE_MAIN_VARIANT(isa<TYPE>(t) ? t : TREE_TYPE(t)));
+  // Create metadata describing the new node hanging off the "any" node.  The
+  // name doesn't matter much but needs to be unique for the compilation unit.
   std::string TreeName =
       ("alias set " + Twine(alias_set) + ": " + getDescriptiveName(type)).str();
   LLVMContext &Context =
@@ -169,8 +224,175 @@ MDNode *describeAliasSet(tree t) {
 #endif
   MDBuilder MDHelper(Context);
 
-  MDNode *AliasTag = MDHelper.createTBAANode(TreeName, getTBAARoot());
-  NodeTags[alias_set] = AliasTag;
+  MDNode *TypeNode =
+      MDHelper.createTBAAScalarTypeNode(TreeName, getAnyTypeNode());
+  NodeTypes[alias_set] = TypeNode;
   LeafNodes.push_back(alias_set);
-  return AliasTag;
+  ++Stats.NodesCreated;
+  Stats.LeafNodes = LeafNodes.size();
+  return TypeNode;
+}
+
+namespace {
+
+/// RecordNode - A TBAA struct type node for a record type, along with which of
+/// the fields it describes exactly.  The others are given the "any" type.
+struct RecordNode {
+  MDNode *Node;
+  std::vector<bool> Exact; // Indexed like the fields in getRecordLayout.
+
+  RecordNode() : Node(0) {}
+};
+
+} // Unnamed namespace.
+
+/// getRecordTypeNode - Return the TBAA struct type node for the given record
+/// type, or null if the type cannot be described this way.  The exactly
+/// described fields are those with a known position that starts on a byte
+/// boundary after the previous field, that are not bitfields, and which have a
+/// leaf or record type.
+static const RecordNode &getRecordTypeNode(tree type) {
+  static std::map<alias_set_type, RecordNode> RecordNodes;
+  static const RecordNode None;
+  // Unions have all their fields at the same offset, which LLVM cannot follow.
+  alias_set_type alias_set = get_alias_set(type);
+  if (!isa<RECORD_TYPE>(type) || alias_set <= 0)
+    return None;
+  std::map<alias_set_type, RecordNode>::iterator I =
+      RecordNodes.find(alias_set);
+  if (I != RecordNodes.end())
+    return I->second;
+
+  ArrayRef<FieldLayout> Fields = getRecordLayout(type);
+  SmallVector<std::pair<MDNode *, uint64_t>, 16> Members;
+  std::vector<bool> Exact(Fields.size());
+  unsigned LastMember = 0; // The field described by the last member.
+  for (unsigned i = 0, e = Fields.size(); i != e; ++i) {
+    tree field = Fields[i].Field;
+    tree field_type = TREE_TYPE(field);
+    uint64_t FirstBit = Fields[i].FirstBit;
+    uint64_t Offset = FirstBit / BITS_PER_UNIT;
+    if (!Members.empty() && Offset <= Members.back().second) {
+      // Several fields starting in the same byte, for example bitfields or
+      // fields of size zero: the byte may hold any of them.
+      Members.back().first = getAnyTypeNode();
+      Exact[LastMember] = false;
+      continue;
+    }
+    MDNode *Member = 0;
+    if (!Fields[i].Bitfield && FirstBit % BITS_PER_UNIT == 0) {
+      if (!isa<AGGREGATE_TYPE>(field_type))
+        Member = getLeafTypeNode(field_type);
+      else if (isa<RECORD_TYPE>(field_type))
+        Member = getRecordTypeNode(TYPE_MAIN_VARIANT(field_type)).Node;
+    }
+    Exact[i] = Member != 0;
+    LastMember = i;
+    Members.push_back(std::make_pair(Member ? Member : getAnyTypeNode(),
+                                     Offset));
+  }
+
+  LLVMContext &Context =
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+      TheModule->getContext();
+#else
+      TheContext;
+#endif
+  MDBuilder MDHelper(Context);
+  std::string TreeName =
+      ("alias set " + Twine(alias_set) + ": " + getDescriptiveName(type)).str();
+  RecordNode &R = RecordNodes[alias_set];
+  R.Node = MDHelper.createTBAAStructTypeNode(TreeName, Members);
+  R.Exact.swap(Exact);
+  ++Stats.RecordNodes;
+  return R;
+}
+
+/// isExactField - Whether the given field is described exactly by the struct
+/// type node for its record type.
+static bool isExactField(const RecordNode &R, tree type, tree field) {
+  if (!R.Node)
+    return false;
+  ArrayRef<FieldLayout> Fields = getRecordLayout(type);
+  for (unsigned i = 0, e = Fields.size(); i != e; ++i)
+    if (Fields[i].Field == field)
+      return R.Exact[i];
+  return false;
+}
+
+/// describeFieldAccess - Return a struct-path TBAA tag for an access to a field
+/// of a record, or null if the access cannot be described this way.  The base
+/// type is the outermost record in the chain of field references leading to
+/// the field, so that accesses to different fields of the same record do not
+/// alias.
+static MDNode *describeFieldAccess(tree t, MDNode *AccessType) {
+  MDNode *BaseType = 0;
+  uint64_t BaseOffset = 0;
+  // The type node expected for the field referenced by t.
+  MDNode *Expected = AccessType;
+  uint64_t Offset = 0;
+  for (; isa<COMPONENT_REF>(t); t = TREE_OPERAND(t, 0)) {
+    tree field = TREE_OPERAND(t, 1);
+    tree type = TYPE_MAIN_VARIANT(TREE_TYPE(TREE_OPERAND(t, 0)));
+    // Variable offsets are given by the third operand.
+    if (TREE_OPERAND(t, 2))
+      break;
+    const RecordNode &R = getRecordTypeNode(type);
+    if (!isExactField(R, type, field))
+      break;
+    // The member must have the expected type, which it might not have if the
+    // access is to part of the field only, or if the reference changes the
+    // alias set.
+    tree field_type = TREE_TYPE(field);
+    MDNode *Member = isa<RECORD_TYPE>(field_type)
+                     ? getRecordTypeNode(TYPE_MAIN_VARIANT(field_type)).Node
+                     : getLeafTypeNode(field_type);
+    if (Member != Expected)
+      break;
+    Offset += getFieldOffsetInBits(field) / BITS_PER_UNIT;
+    BaseType = R.Node;
+    BaseOffset = Offset;
+    Expected = R.Node;
+  }
+  if (!BaseType)
+    return 0;
+
+  LLVMContext &Context =
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+      TheModule->getContext();
+#else
+      TheContext;
+#endif
+  MDBuilder MDHelper(Context);
+  ++Stats.FieldTags;
+  return MDHelper.createTBAAStructTagNode(BaseType, AccessType, BaseOffset);
+}
+
+/// describeAliasSet - Return TBAA metadata describing what a load from or store
+/// to the given tree may alias.
+MDNode *describeAliasSet(tree t) {
+  ++Stats.Queries;
+  MDNode *AccessType = getLeafTypeNode(t);
+  if (!AccessType)
+    return 0;
+
+  // Accesses to fields get a tag with the record as base type, so LLVM can
+  // tell apart accesses to different fields.
+  if (isa<COMPONENT_REF>(t))
+    if (MDNode *Tag = describeFieldAccess(t, AccessType))
+      return Tag;
+
+  static std::map<MDNode *, MDNode *> ScalarTags; // Type node -> access tag.
+  MDNode *&Tag = ScalarTags[AccessType];
+  if (!Tag) {
+    LLVMContext &Context =
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+        TheModule->getContext();
+#else
+        TheContext;
+#endif
+    MDBuilder MDHelper(Context);
+    Tag = MDHelper.createTBAAStructTagNode(AccessType, AccessType, 0);
+  }
+  return Tag;
 }
@@ -21,7 +21,9 @@
 //===----------------------------------------------------------------------===//
 
 // Plugin headers
+#include "dragonegg/Aliasing.h"
 #include "dragonegg/Cache.h"
+#include "dragonegg/CodeGenDaemon.h"
 #include "dragonegg/ConstantConversion.h"
 #include "dragonegg/Debug.h"
 #include "dragonegg/OS.h"
@@ -37,6 +39,7 @@
 #include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/Transforms/IPO/AlwaysInliner.h"
 #endif
+#include "llvm/Bitcode/BitcodeWriterPass.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/Target/TargetOptions.h"
@@ -56,20 +59,49 @@
 #include "llvm/Analysis/Verifier.h"
 #include "llvm/Assembly/PrintModulePass.h"
 #endif
+#include "llvm/IR/Instructions.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/MC/MCAsmInfo.h"
 #include "llvm/MC/SubtargetFeature.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Process.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/Timer.h"
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 9)
+#include "llvm/ADT/EquivalenceClasses.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(4, 0)
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Transforms/IPO/SampleProfile.h"
+#include "llvm/Transforms/Scalar/EarlyCSE.h"
+#include "llvm/Transforms/Scalar/LoopDataPrefetch.h"
+#include "llvm/Transforms/Scalar/LowerExpectIntrinsic.h"
+#include "llvm/Transforms/Scalar/SROA.h"
+#include "llvm/Transforms/Scalar/SimplifyCFG.h"
+#endif
 #if LLVM_VERSION_CODE > LLVM_VERSION(5, 0)
 #include "llvm/CodeGen/TargetSubtargetInfo.h"
+#include "llvm/IR/DiagnosticHandler.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/Support/Regex.h"
+#include "llvm/Support/YAMLTraits.h"
 #else
 #include "llvm/Target/TargetSubtargetInfo.h"
 #endif
 #include "llvm/Transforms/IPO.h"
 #include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/Instrumentation.h"
+#include "llvm/Transforms/Scalar.h"
 #include "llvm-c/Target.h"
 
 #ifdef ENABLE_LLVM_PLUGINS
@@ -79,6 +111,20 @@
 
 // System headers
 #include <gmp.h>
+#include <map>
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 9)
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#endif
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 // GCC headers
 #include "auto-host.h"
@@ -97,6 +143,7 @@ extern "C" {
 #include "debug.h"
 #include "diagnostic.h"
 #include "flags.h"
+#include "ggc.h"
 #include "gcc-plugin.h"
 #if GCC_VERSION_CODE > GCC_VERSION(4, 8)
 #include "cgraph.h"
@@ -106,18 +153,37 @@ extern "C" {
 #endif
 #include "intl.h"
 #include "langhooks.h"
+#if GCC_VERSION_CODE > GCC_VERSION(4, 5)
+#include "opts.h"
+#endif
 #include "output.h"
 #include "params.h"
 #ifndef DISABLE_VERSION_CHECK
 #include "plugin-version.h"
 #endif
 #include "target.h" // For targetm.
+#if (GCC_MAJOR > 5)
+#include "timevar.h"
+#endif
 #include "toplev.h"
 #if (GCC_MAJOR > 4 || GCC_MAJOR == 4 && GCC_MINOR > 8)
 #include "tree-cfg.h"
 #else
 #include "tree-flow.h"
 #endif
+#if (GCC_MAJOR > 4)
+#include "cfg.h"
+#include "cfganal.h"
+#include "function.h"
+#include "basic-block.h"
+#include "tree-ssa-alias.h"
+#include "internal-fn.h"
+#include "is-a.h"
+#include "gimple-expr.h"
+#include "gimple.h"
+#include "tree-ssa.h"
+#endif
+#include "cfgloop.h"
 #include "tree-pass.h"
 #include "version.h"
 #if (GCC_MAJOR > 7)
@@ -149,12 +215,6 @@ int flag_no_simplify_libcalls;
 extern int flag_no_builtin __attribute__((weak));
 #endif
 
-// Non-zero if red-zone is disabled.
-//TODOstatic int flag_disable_red_zone = 0;
-
-// Non-zero if implicit floating point instructions are disabled.
-//TODOstatic int flag_no_implicit_float = 0;
-
 // LLVM command line arguments specified by the user.
 std::vector<std::string> ArgStrings;
 
@@ -164,7 +224,7 @@ static const char *llvm_asm_file_name;
 // Global state for the LLVM backend.
 Module *TheModule = 0;
 DebugInfo *TheDebugInfo = 0;
-PassManagerBuilder PassBuilder;
+PassManagerBuilder PMBuilder;
 TargetMachine *TheTarget = 0;
 TargetFolder *TheFolder = 0;
 TargetOptions TargetOpts;
@@ -179,13 +239,152 @@ formatted_raw_ostream FormattedOutStream;
 static bool DebugPassArguments;
 static bool DebugPassStructure;
 static bool EnableGCCOptimizations;
+
+/// KeepGCCIPAPasses - Whether GCC's early and interprocedural optimizers are run
+/// before the LLVM optimizers, while its later optimizers are not.  Set by the
+/// gcc-ipa-then-llvm pipeline.
+static bool KeepGCCIPAPasses;
+
+/// ValueNames - Whether LLVM values are named after the GCC trees they come
+/// from: 1 to name them, 0 not to, -1 (the default) to name them only if the
+/// LLVM IR or debug info is output.  Set by -fplugin-arg-dragonegg-value-names.
+static int ValueNames = -1;
+
 static bool EmitIR;
+static bool EmitThinLTO;
+static bool EmitBitcode;
+static bool BitcodeModuleHash;
 static bool EmitObj;
 static bool SaveGCCOutput;
+static bool EmbedBitcode;
+static bool FunctionTimeReport;
+static bool IRLint;
+static bool ConvertOnly;
+static bool UseNewPassManager;
+static bool UseLLVMSanitizers;
+static bool PruneFunctions;
+static bool MergeConstructors;
+static bool AsyncOutput;
+static bool UseGCCLTO;
+
+/// InLTRANS - Whether this is lto1 generating code for a partition of the
+/// program after GCC's whole program analysis.
+static bool InLTRANS;
 static int LLVMCodeGenOptimizeArg = -1;
 static int LLVMIROptimizeArg = -1;
 
+/// AutoIROptLevel - Whether the IR optimization level of each function is
+/// chosen by looking at its loops, see llvm-ir-optimize=auto.
+static bool AutoIROptLevel;
+
+/// SawLoopHeavyFunction - Whether AutoIROptLevel put some function at -O3.
+static bool SawLoopHeavyFunction;
+
+/// PrefetchLoopArrays - Whether the module level optimizers should prefetch
+/// the data that later loop iterations use, see ConfigureLoopOptimizations.
+static bool PrefetchLoopArrays;
+
+/// CodeGenThreads - If non-zero, the module is split into pieces after the IR
+/// optimizers have run and code is generated for the pieces using this many
+/// threads.
+static unsigned CodeGenThreads = 0;
+
+/// GCBatch - The number of functions to convert between chances for GCC to
+/// collect garbage.  FunctionsSinceGC - How many have been converted since the
+/// last chance.
+static unsigned GCBatch = 1;
+static unsigned FunctionsSinceGC = 0;
+
+/// StatsFileName - If not null, statistics about the compilation are written
+/// to this file in JSON format once the compilation unit has been finished.
+static const char *StatsFileName = 0;
+
+/// TraceFileName - If not null, the time spent in each phase of the compilation
+/// is written to this file in the Chrome trace event format once the
+/// compilation unit has been finished.
+static const char *TraceFileName = 0;
+
+/// StreamGlobalsThreshold - If not zero, global variables of at least this many
+/// bytes with an initial value that is just data have the initial value written
+/// to a file which the assembler includes, rather than converting it to LLVM
+/// constants.
+static uint64_t StreamGlobalsThreshold = 0;
+
+/// FlatInitializersThreshold - If not zero, global variables of at least this
+/// many bytes with an initial value that is just data have the initial value
+/// converted to an array of bytes rather than to typed LLVM constants.
+static uint64_t FlatInitializersThreshold = 0;
+
+/// SampleProfileFile - If not null, a sample profile (as collected with perf
+/// and converted by AutoFDO tools) for the module level optimizers to use.
+static const char *SampleProfileFile = 0;
+
+/// InstrProfileGenerate - If not null, have LLVM instrument the code to count
+/// how often each part of it runs, writing the counts to this file (LLVM's
+/// default file if empty) when the program exits.
+static const char *InstrProfileGenerate = 0;
+
+/// InstrProfileUse - If not null, a profile written by code instrumented with
+/// InstrProfileGenerate and merged with llvm-profdata, for the module level
+/// optimizers to use.
+static const char *InstrProfileUse = 0;
+
+/// CompressDebugSections - How to compress the debug sections of object files
+/// written by the plugin: 0 for not at all, 1 for the SHF_COMPRESSED (gABI)
+/// format, 2 for the older .zdebug format.
+static unsigned CompressDebugSections = 0;
+
+/// SpilledInitializers - The files holding initial values written out because
+/// of StreamGlobalsThreshold.
+static std::vector<std::string> SpilledInitializers;
+
+/// CacheDir - If not null, the output for each compilation unit is kept in this
+/// directory and reused if the same module is compiled with the same options.
+static const char *CacheDir = 0;
+
+/// CodeGenDaemon - If not null, the socket of a code generation daemon (see
+/// utils/CodeGenDaemon.cpp) that generates code for the optimized module, so
+/// that this process does not have to.
+static const char *CodeGenDaemon = 0;
+
+/// CacheKey - The name under which the output of this compilation unit is to
+/// be stored in CacheDir, or empty if it is not to be stored.
+static std::string CacheKey;
+
+/// CodeGenCache - Whether the code generated for each piece of the module is
+/// kept in CacheDir and reused for as long as the piece does not change.
+static bool CodeGenCache;
+
+/// CodeGenByFunction - Whether code is generated for the module one function
+/// at a time once the IR optimizers have run, freeing the IR as it goes.
+static bool CodeGenByFunction;
+
+/// LLVMOptions - The options passed to LLVM by ConfigureLLVM, separated by
+/// null characters.
+static std::string LLVMOptions;
+
+/// RemarksFileName - If not null, optimization remarks are written to this file
+/// in YAML format.
+static const char *RemarksFileName = 0;
+
+/// RemarksFilter - A regular expression picking the passes whose optimization
+/// remarks are written to RemarksFileName.
+static const char *RemarksFilter = ".*";
+
+/// EmitStackUsage - Write the stack frame size of each function to a .su file,
+/// as for -fstack-usage.
+static bool EmitStackUsage;
+
+/// StackSizeSection - Record the stack frame size of each function in the
+/// .stack_sizes section of the object file.
+static bool StackSizeSection;
+
 std::vector<std::pair<Constant *, int> > StaticCtors, StaticDtors;
+
+/// StructorIndex - The positions at which each constant occurs in StaticCtors
+/// (2 * i) and StaticDtors (2 * i + 1), so that replacing a global does not
+/// mean scanning all of them.
+static DenseMap<Constant *, SmallVector<unsigned, 1> > StructorIndex;
 SmallSetVector<Constant *, 32> AttributeUsedGlobals;
 SmallSetVector<Constant *, 32> AttributeCompilerUsedGlobals;
 std::vector<Constant *> AttributeAnnotateGlobals;
@@ -203,6 +402,83 @@ static PassManager *PerModulePasses = 0;
 static FunctionPassManager *CodeGenPasses = 0;
 #endif
 
+/// FunctionOptLevel - The IR optimization level and size level for a function.
+typedef std::pair<int, int> FunctionOptLevel;
+
+/// PerLevelFunctionPasses - Per-function passes for functions that were given
+/// their own optimization level with __attribute__((optimize)), one pass
+/// manager for each level used.  PerFunctionPasses handles the rest.
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+static std::map<FunctionOptLevel, legacy::FunctionPassManager *>
+    PerLevelFunctionPasses;
+#else
+static std::map<FunctionOptLevel, FunctionPassManager *> PerLevelFunctionPasses;
+#endif
+
+/// FunctionOptLevels - The optimization level of each function that is not
+/// optimized at the level of the compilation unit.
+static DenseMap<const Function *, FunctionOptLevel> FunctionOptLevels;
+
+#if LLVM_VERSION_CODE > LLVM_VERSION(4, 0)
+/// NewPassManager - The IR optimizers when the new pass manager is used, see
+/// the new-pass-manager flag.  Code generation still uses CodeGenPasses.
+#if LLVM_VERSION_CODE > LLVM_VERSION(5, 0)
+/// getPGOOptions - How the new pass manager should instrument the code or use
+/// a profile, see InstrProfileGenerate and InstrProfileUse.
+static Optional<PGOOptions> getPGOOptions() {
+  if (!InstrProfileGenerate && !InstrProfileUse)
+    return None;
+  PGOOptions Options;
+  if (InstrProfileGenerate) {
+    Options.ProfileGenFile = InstrProfileGenerate;
+    Options.RunProfileGen = true;
+  }
+  if (InstrProfileUse)
+    Options.ProfileUseFile = InstrProfileUse;
+  return Options;
+}
+#endif
+
+struct NewPassManager {
+  llvm::PassBuilder Builder;
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+  /// FunctionPasses - Per-function passes for each optimization level used.
+  std::map<FunctionOptLevel, FunctionPassManager> FunctionPasses;
+  ModulePassManager ModulePasses;
+  /// HasModulePasses - Whether ModulePasses has been set up.
+  bool HasModulePasses;
+
+  NewPassManager(bool DebugLogging)
+      : Builder(TheTarget
+#if LLVM_VERSION_CODE > LLVM_VERSION(5, 0)
+                , getPGOOptions()
+#endif
+                ), LAM(DebugLogging), FAM(DebugLogging),
+        CGAM(DebugLogging), MAM(DebugLogging), ModulePasses(DebugLogging),
+        HasModulePasses(false) {}
+};
+static NewPassManager *NewPM = 0;
+#endif
+
+/// SimplifiedFunctions - Functions that the per-function passes were run on as
+/// soon as they were converted, see CanRunPerFunctionPassesEarly.
+static SmallPtrSet<const Function *, 32> SimplifiedFunctions;
+
+/// UnreachableFunctions - Functions with a body that nothing can refer to, so
+/// that there is no need to convert them.
+static SmallPtrSet<tree, 32> UnreachableFunctions;
+
+/// SplitCodeGen - Whether code is generated for pieces of the module in
+/// parallel, see EmitModuleInParallel.  In this case there are no CodeGenPasses.
+static bool SplitCodeGen = false;
+
+/// DaemonCodeGen - Whether code for the module is generated by CodeGenDaemon,
+/// see EmitModuleWithDaemon.  In this case there are no CodeGenPasses.
+static bool DaemonCodeGen = false;
+
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
 static LLVMContext TheContext;
 #else
@@ -211,6 +487,7 @@ static LLVMContext &TheContext = getGlobalContext();
 
 static void createPerFunctionOptimizationPasses();
 static void createPerModuleOptimizationPasses();
+static void ConfigureCodeAlignment();
 
 // Compatibility hacks for older versions of GCC.
 #if GCC_VERSION_CODE < GCC_VERSION(4, 8)
@@ -258,6 +535,551 @@ static symtab_node_base *varpool_symbol(varpool_node *N) { return &N->symbol; }
 
 #endif
 
+//===----------------------------------------------------------------------===//
+//                                  Timing
+//===----------------------------------------------------------------------===//
+
+/// getWallTime - Return the wall clock time in seconds.
+static double getWallTime() {
+  return TimeRecord::getCurrentTime().getWallTime();
+}
+
+/// PhaseTime - The wall time charged to a phase, for the statistics file.
+struct PhaseTime {
+  double Seconds;  // Time spent in the phase.
+  double Start;    // When the outermost active timer for the phase started.
+  unsigned Active; // Number of timers for the phase currently alive.
+  PhaseTime() : Seconds(0), Start(0), Active(0) {}
+};
+
+/// PhaseTimes - Time spent in each phase, only gathered if a statistics file
+/// or time trace was requested.
+static std::map<std::string, PhaseTime> PhaseTimes;
+
+/// GCCPassRuns - How many times each GCC pass was run, only gathered if a
+/// statistics file was requested.
+static std::map<std::string, unsigned> GCCPassRuns;
+
+/// TraceEvent - A phase that appears in the time trace.
+struct TraceEvent {
+  const char *Item;   // The phase.
+  std::string Detail; // What the phase was working on, if anything.
+  double Start;       // When the phase started, in seconds.
+  double Duration;    // How long the phase lasted, in seconds.
+};
+
+/// TraceEvents - The phases seen so far, only gathered if a time trace was
+/// requested.  TraceStart is the time that events are measured from.
+static std::vector<TraceEvent> TraceEvents;
+static double TraceStart;
+
+PhaseTimer::PhaseTimer(const char *Item, const std::string &Detail)
+    : Phase(0), Item(Item), Detail(Detail) {
+#if (GCC_MAJOR > 5)
+  if (g_timer)
+    g_timer->push_client_item(Item);
+#endif
+  if (StatsFileName || TraceFileName) {
+    // Only the outermost timer for a phase counts, so that a phase entered
+    // recursively is not charged twice.
+    Phase = &PhaseTimes[Item];
+    if (!Phase->Active++)
+      Phase->Start = getWallTime();
+  }
+}
+
+PhaseTimer::~PhaseTimer() {
+  if (Phase && !--Phase->Active) {
+    double Elapsed = getWallTime() - Phase->Start;
+    Phase->Seconds += Elapsed;
+    if (TraceFileName) {
+      TraceEvent Event = { Item, Detail, Phase->Start, Elapsed };
+      TraceEvents.push_back(Event);
+    }
+  }
+#if (GCC_MAJOR > 5)
+  if (g_timer)
+    g_timer->pop_client_item();
+#endif
+}
+
+/// FunctionStats - Information about a function for the per-function report.
+struct FunctionStats {
+  std::string Name;
+  unsigned InstsBefore; // Number of instructions before optimization.
+  unsigned InstsAfter;  // Number of instructions after optimization.
+  double ConvertTime;   // Seconds spent converting from gimple.
+  double OptimizeTime;  // Seconds spent in the per-function passes.
+};
+
+/// FunctionReport - Statistics for each function converted, if the user asked
+/// for a per-function report.
+static std::vector<FunctionStats> FunctionReport;
+static DenseMap<const Function *, unsigned> FunctionReportIndex;
+
+/// CountInstructions - Return the number of instructions in the given function.
+static unsigned CountInstructions(const Function &F) {
+  unsigned Count = 0;
+  for (Function::const_iterator BB = F.begin(), E = F.end(); BB != E; ++BB)
+    Count += BB->size();
+  return Count;
+}
+
+/// LintStats - Patterns in the IR converted for a function that usually mean
+/// conversion made it harder to optimize, see -fplugin-arg-dragonegg-ir-lint.
+struct LintStats {
+  std::string Name;
+  unsigned AggregateRoundTrips; // Allocas aggregates are stored to and loaded
+                                // from, mostly for Mem2Reg and Reg2Mem.
+  unsigned UnalignedAccesses;   // Multi-byte loads and stores of alignment 1.
+  unsigned UntaggedAccesses;    // Non-local loads and stores without TBAA.
+  unsigned OpaqueBuiltinCalls;  // Builtins called rather than lowered.
+  unsigned EntryAllocas;        // Allocas in the entry block.
+
+  /// getScore - How much there is to improve, for ranking functions.  Only a
+  /// large number of entry block allocas is a problem.
+  unsigned getScore() const {
+    return AggregateRoundTrips + UnalignedAccesses + UntaggedAccesses +
+           OpaqueBuiltinCalls + (EntryAllocas >= 32 ? EntryAllocas : 0);
+  }
+};
+
+/// LintReport - The patterns found in each function converted, if the user
+/// asked for them.
+static std::vector<LintStats> LintReport;
+
+/// getAccessBase - Return the object that the given address points into,
+/// looking through casts and offsets.
+static const Value *getAccessBase(const Value *Ptr) {
+  while (true) {
+    Ptr = Ptr->stripPointerCasts();
+    const GEPOperator *GEP = dyn_cast<GEPOperator>(Ptr);
+    if (!GEP)
+      return Ptr;
+    Ptr = GEP->getPointerOperand();
+  }
+}
+
+/// LintFunction - Note the patterns in the freshly converted function F that
+/// get in the way of optimizing it.  OpaqueBuiltinCalls is the number of calls
+/// to builtins that conversion did not lower.
+static void LintFunction(const Function &F, unsigned OpaqueBuiltinCalls) {
+  LintStats S;
+  S.Name = F.getName().str();
+  S.AggregateRoundTrips = S.UnalignedAccesses = S.UntaggedAccesses = 0;
+  S.OpaqueBuiltinCalls = OpaqueBuiltinCalls;
+  S.EntryAllocas = 0;
+
+  const DataLayout &DL = getDataLayout();
+  SmallPtrSet<const Value *, 8> AggregatesStored, AggregatesLoaded;
+  for (Function::const_iterator BB = F.begin(), E = F.end(); BB != E; ++BB)
+    for (BasicBlock::const_iterator I = BB->begin(), IE = BB->end(); I != IE;
+         ++I) {
+      if (isa<AllocaInst>(I) && &*BB == &F.getEntryBlock()) {
+        ++S.EntryAllocas;
+        continue;
+      }
+
+      const Value *Ptr;
+      Type *Ty;
+      unsigned Align;
+      if (const LoadInst *LI = dyn_cast<LoadInst>(I)) {
+        Ptr = LI->getPointerOperand();
+        Ty = LI->getType();
+        Align = LI->getAlignment();
+      } else if (const StoreInst *SI = dyn_cast<StoreInst>(I)) {
+        Ptr = SI->getPointerOperand();
+        Ty = SI->getValueOperand()->getType();
+        Align = SI->getAlignment();
+      } else {
+        continue;
+      }
+
+      const Value *Base = getAccessBase(Ptr);
+      bool Local = isa<AllocaInst>(Base);
+      if (Local && Ty->isAggregateType())
+        (isa<LoadInst>(I) ? AggregatesLoaded : AggregatesStored).insert(Base);
+      if (Align == 1 && DL.getTypeStoreSize(Ty) > 1)
+        ++S.UnalignedAccesses;
+      // Without strict aliasing nothing gets a tag.
+      if (flag_strict_aliasing && !Local &&
+          !I->getMetadata(LLVMContext::MD_tbaa))
+        ++S.UntaggedAccesses;
+    }
+  for (SmallPtrSet<const Value *, 8>::const_iterator
+           I = AggregatesStored.begin(), E = AggregatesStored.end();
+       I != E; ++I)
+    if (AggregatesLoaded.count(*I))
+      ++S.AggregateRoundTrips;
+
+  LintReport.push_back(S);
+}
+
+/// NumFunctionsEmitted, NumGlobalsEmitted - The number of function bodies and
+/// global variables converted, for the statistics file.
+static unsigned NumFunctionsEmitted = 0;
+static unsigned NumGlobalsEmitted = 0;
+
+/// NumFunctionsPruned - The number of function bodies that were not converted
+/// because nothing can refer to them, see FindUnreachableFunctions.
+static unsigned NumFunctionsPruned = 0;
+
+/// PrintFunctionReport - Output the per-function report, most expensive first.
+static void PrintFunctionReport() {
+  std::vector<FunctionStats> Report(FunctionReport);
+  std::stable_sort(Report.begin(), Report.end(),
+                   [](const FunctionStats &A, const FunctionStats &B) {
+    return A.ConvertTime + A.OptimizeTime > B.ConvertTime + B.OptimizeTime;
+  });
+
+  raw_ostream &OS = errs();
+  OS << "===" << std::string(73, '-') << "===\n"
+     << "                      DragonEgg per-function report\n"
+     << "===" << std::string(73, '-') << "===\n"
+     << "   Convert   Optimize  Insts before  Insts after  Function\n";
+  double TotalConvert = 0, TotalOptimize = 0;
+  for (unsigned i = 0, e = Report.size(); i != e; ++i) {
+    const FunctionStats &S = Report[i];
+    OS << format("  %7.4fs   %7.4fs  %12u  %11u  ", S.ConvertTime,
+                 S.OptimizeTime, S.InstsBefore, S.InstsAfter) << S.Name << '\n';
+    TotalConvert += S.ConvertTime;
+    TotalOptimize += S.OptimizeTime;
+  }
+  OS << format("  %7.4fs   %7.4fs  ", TotalConvert, TotalOptimize)
+     << "Total (" << Report.size() << " functions)\n\n";
+  OS.flush();
+}
+
+/// WriteJSONString - Output the given string as a JSON string literal.
+static void WriteJSONString(raw_ostream &OS, StringRef Str) {
+  OS << '"';
+  for (unsigned char C : Str) {
+    if (C == '"' || C == '\\')
+      OS << '\\' << C;
+    else if (C < 0x20)
+      OS << format("\\u%04x", C);
+    else
+      OS << C;
+  }
+  OS << '"';
+}
+
+/// getPeakMemoryUsage - Return the peak resident memory use of the compiler in
+/// bytes, or zero if this is not known.
+static uint64_t getPeakMemoryUsage() {
+#if defined(HAVE_GETRUSAGE) && !defined(_WIN32)
+  struct rusage Usage;
+  if (getrusage(RUSAGE_SELF, &Usage))
+    return 0;
+#ifdef __APPLE__
+  return Usage.ru_maxrss; // Already in bytes.
+#else
+  return (uint64_t)Usage.ru_maxrss * 1024; // In kilobytes.
+#endif
+#else
+  return 0;
+#endif
+}
+
+/// getCurrentMemoryUsage - Return the resident memory use of the compiler in
+/// bytes, or zero if this is not known.
+static uint64_t getCurrentMemoryUsage() {
+#ifdef __linux__
+  // The second field is the number of resident pages.
+  FILE *F = fopen("/proc/self/statm", "r");
+  if (!F)
+    return 0;
+  unsigned long Size = 0, Resident = 0;
+  int Fields = fscanf(F, "%lu %lu", &Size, &Resident);
+  fclose(F);
+  return Fields == 2 ? (uint64_t)Resident * sysconf(_SC_PAGESIZE) : 0;
+#else
+  return 0;
+#endif
+}
+
+/// MemoryUsage - How big things were at some point in the compilation, for the
+/// statistics file.  Memory that is neither used by malloc nor by anything the
+/// plugin knows about mostly belongs to GCC's garbage collected heap.
+struct MemoryUsage {
+  const char *Phase;           // What had just finished.
+  uint64_t ResidentBytes;      // Resident memory use of the compiler.
+  uint64_t MallocBytes;        // Memory allocated with malloc.
+  unsigned long Functions;     // Functions in the module with a body.
+  unsigned long BasicBlocks;   // Basic blocks in the module.
+  unsigned long Instructions;  // Instructions in the module.
+  unsigned long Globals;       // Global variables in the module.
+  unsigned long Metadata;      // Metadata attached to instructions or named.
+  CacheStatistics Cache;       // Sizes of the tree caches.
+  TypeConversionStatistics Types;
+  DebugInfoStatistics Debug;   // All zero if there is no debug info.
+};
+
+/// MemoryUsages - How big things were at the end of each major phase, only
+/// gathered if a statistics file was requested.
+static std::vector<MemoryUsage> MemoryUsages;
+
+/// RecordMemoryUsage - Note how big things are now that the given phase has
+/// finished, if a statistics file was requested.
+static void RecordMemoryUsage(const char *Phase) {
+  if (!StatsFileName)
+    return;
+  MemoryUsage U;
+  memset(&U, 0, sizeof(U));
+  U.Phase = Phase;
+  U.ResidentBytes = getCurrentMemoryUsage();
+  U.MallocBytes = sys::Process::GetMallocUsage();
+  if (TheModule) {
+    SmallVector<std::pair<unsigned, MDNode *>, 8> MDs;
+    for (Module::iterator F = TheModule->begin(), FE = TheModule->end();
+         F != FE; ++F) {
+      if (F->isDeclaration())
+        continue;
+      ++U.Functions;
+      for (Function::iterator BB = F->begin(), BE = F->end(); BB != BE; ++BB) {
+        ++U.BasicBlocks;
+        U.Instructions += BB->size();
+        for (BasicBlock::iterator I = BB->begin(), IE = BB->end(); I != IE;
+             ++I) {
+          I->getAllMetadata(MDs);
+          U.Metadata += MDs.size();
+        }
+      }
+    }
+    U.Globals = TheModule->global_size();
+    for (Module::named_metadata_iterator I = TheModule->named_metadata_begin(),
+                                         E = TheModule->named_metadata_end();
+         I != E; ++I)
+      U.Metadata += I->getNumOperands();
+  }
+  U.Cache = getCacheStatistics();
+  U.Types = getTypeConversionStatistics();
+  if (TheDebugInfo)
+    U.Debug = TheDebugInfo->getStatistics();
+  MemoryUsages.push_back(U);
+}
+
+/// WriteTraceFile - Output the phases of the compilation unit to the file named
+/// by TraceFileName, in the Chrome trace event format.
+static void WriteTraceFile() {
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 3)
+  std::error_code EC;
+  raw_fd_ostream OS(TraceFileName, EC, sys::fs::F_Text);
+  std::string Error = EC ? EC.message() : "";
+#else
+  std::string Error;
+  raw_fd_ostream OS(TraceFileName, Error);
+#endif
+  if (!Error.empty()) {
+    warning(0, G_("cannot open time trace file '%s': %s"), TraceFileName,
+            Error.c_str());
+    return;
+  }
+
+  // Events are recorded when they finish; list them in the order they started,
+  // outermost first, which is what trace viewers expect.
+  std::vector<TraceEvent> Events(TraceEvents);
+  std::stable_sort(Events.begin(), Events.end(),
+                   [](const TraceEvent &A, const TraceEvent &B) {
+    return A.Start < B.Start || (A.Start == B.Start && A.Duration > B.Duration);
+  });
+
+  int PID = getpid();
+  OS << "{\"traceEvents\":[\n";
+  for (unsigned i = 0, e = Events.size(); i != e; ++i) {
+    const TraceEvent &Event = Events[i];
+    OS << "{\"pid\":" << PID << ",\"tid\":0,\"ph\":\"X\",\"name\":";
+    WriteJSONString(OS, Event.Item);
+    OS << format(",\"ts\":%.0f,\"dur\":%.0f",
+                 (Event.Start - TraceStart) * 1e6, Event.Duration * 1e6);
+    if (!Event.Detail.empty()) {
+      OS << ",\"args\":{\"detail\":";
+      WriteJSONString(OS, Event.Detail);
+      OS << "}";
+    }
+    OS << "},\n";
+  }
+  OS << "{\"pid\":" << PID << ",\"tid\":0,\"ph\":\"M\","
+     << "\"name\":\"process_name\",\"args\":{\"name\":";
+  WriteJSONString(OS, main_input_filename ? main_input_filename : "");
+  OS << "}}\n]}\n";
+}
+
+/// WriteStatsFile - Output statistics about the compilation unit to the file
+/// named by StatsFileName, as a JSON object.
+static void WriteStatsFile() {
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 3)
+  std::error_code EC;
+  raw_fd_ostream OS(StatsFileName, EC, sys::fs::F_Text);
+  std::string Error = EC ? EC.message() : "";
+#else
+  std::string Error;
+  raw_fd_ostream OS(StatsFileName, Error);
+#endif
+  if (!Error.empty()) {
+    warning(0, G_("cannot open statistics file '%s': %s"), StatsFileName,
+            Error.c_str());
+    return;
+  }
+
+  OS << "{\n  \"input\": ";
+  WriteJSONString(OS, main_input_filename ? main_input_filename : "");
+
+  OS << ",\n  \"phases\": {";
+  for (std::map<std::string, PhaseTime>::const_iterator I = PhaseTimes.begin(),
+                                                        E = PhaseTimes.end();
+       I != E; ++I) {
+    OS << (I == PhaseTimes.begin() ? "\n    " : ",\n    ");
+    WriteJSONString(OS, I->first);
+    OS << format(": %.6f", I->second.Seconds);
+  }
+  OS << "\n  },\n";
+
+  OS << "  \"gcc_passes\": {";
+  for (std::map<std::string, unsigned>::const_iterator I = GCCPassRuns.begin(),
+                                                       E = GCCPassRuns.end();
+       I != E; ++I) {
+    OS << (I == GCCPassRuns.begin() ? "\n    " : ",\n    ");
+    WriteJSONString(OS, I->first);
+    OS << ": " << I->second;
+  }
+  OS << "\n  },\n";
+
+  OS << "  \"functions_emitted\": " << NumFunctionsEmitted << ",\n"
+     << "  \"globals_emitted\": " << NumGlobalsEmitted << ",\n"
+     << "  \"functions_pruned\": " << NumFunctionsPruned << ",\n"
+     << "  \"record_types_merged\": " << getNumRecordTypesMerged() << ",\n"
+     << "  \"sync_ops_relaxed\": " << getNumRelaxedSyncOps() << ",\n";
+
+  const CacheStatistics &Cache = getCacheStatistics();
+  OS << "  \"cache\": {\n"
+     << "    \"integer\": { \"front_hits\": " << Cache.IntegerFrontHits
+     << ", \"hits\": " << Cache.IntegerHits
+     << ", \"misses\": " << Cache.IntegerMisses
+     << ", \"entries\": " << Cache.IntegerEntries
+     << ", \"slots\": " << Cache.IntegerSlots << " },\n"
+     << "    \"type\": { \"front_hits\": " << Cache.TypeFrontHits
+     << ", \"hits\": " << Cache.TypeHits
+     << ", \"misses\": " << Cache.TypeMisses
+     << ", \"entries\": " << Cache.TypeEntries
+     << ", \"slots\": " << Cache.TypeSlots << " },\n"
+     << "    \"value\": { \"hits\": " << Cache.ValueHits
+     << ", \"misses\": " << Cache.ValueMisses
+     << ", \"entries\": " << Cache.ValueEntries
+     << ", \"slots\": " << Cache.ValueSlots << " },\n"
+     << "    \"decl\": { \"hits\": " << Cache.DeclHits
+     << ", \"misses\": " << Cache.DeclMisses
+     << ", \"entries\": " << Cache.DeclEntries
+     << ", \"slots\": " << Cache.DeclSlots << " }\n"
+     << "  },\n";
+
+  const ConstantStatistics &Constants = getConstantStatistics();
+  OS << "  \"constants\": {\n"
+     << "    \"initializer\": { \"hits\": " << Constants.InitializerHits
+     << ", \"misses\": " << Constants.InitializerMisses << " },\n"
+     << "    \"address\": { \"hits\": " << Constants.AddressHits
+     << ", \"misses\": " << Constants.AddressMisses << " },\n"
+     << "    \"slots\": { \"created\": " << Constants.Slots
+     << ", \"merged\": " << Constants.MergedSlots << " }\n"
+     << "  },\n";
+
+  const AliasingStatistics &TBAA = getAliasingStatistics();
+  OS << "  \"tbaa\": {\n"
+     << "    \"queries\": " << TBAA.Queries << ",\n"
+     << "    \"nodes_created\": " << TBAA.NodesCreated << ",\n"
+     << "    \"nodes_dropped\": " << TBAA.NodesDropped << ",\n"
+     << "    \"leaf_nodes\": " << TBAA.LeafNodes << ",\n"
+     << "    \"records_skipped\": " << TBAA.RecordsSkipped << ",\n"
+     << "    \"record_nodes\": " << TBAA.RecordNodes << ",\n"
+     << "    \"field_tags\": " << TBAA.FieldTags << "\n"
+     << "  },\n";
+
+  const ExceptionStatistics &EH = getExceptionStatistics();
+  OS << "  \"eh\": {\n"
+     << "    \"landing_pads\": " << EH.LandingPads << ",\n"
+     << "    \"shared_landing_pads\": " << EH.SharedLandingPads << ",\n"
+     << "    \"failure_blocks\": " << EH.FailureBlocks << ",\n"
+     << "    \"shared_failure_blocks\": " << EH.SharedFailureBlocks << "\n"
+     << "  },\n";
+
+  const ConversionStatistics &Conv = getConversionStatistics();
+  OS << "  \"conversion\": {\n"
+     << "    \"aggregate_copies\": { \"by_element\": "
+     << Conv.AggregateCopiesByElement
+     << ", \"by_memcpy\": " << Conv.AggregateCopiesByMemcpy << " },\n"
+     << "    \"aggregate_zeroes\": { \"by_element\": "
+     << Conv.AggregateZeroesByElement
+     << ", \"by_memset\": " << Conv.AggregateZeroesByMemset << " },\n"
+     << "    \"temporaries\": " << Conv.Temporaries << ",\n"
+     << "    \"scratch_reused\": " << Conv.ScratchReused << ",\n"
+     << "    \"phi_nodes\": " << Conv.PhiNodes << ",\n"
+     << "    \"builtins\": { \"lowered\": " << Conv.BuiltinsLowered
+     << ", \"called\": " << Conv.BuiltinsCalled << " },\n"
+     << "    \"target_builtins\": { \"expanded\": "
+     << Conv.TargetBuiltinsExpanded
+     << ", \"intrinsic\": " << Conv.TargetBuiltinsIntrinsic << " },\n"
+     << "    \"mem2reg\": " << Conv.Mem2RegConversions << ",\n"
+     << "    \"reg2mem\": " << Conv.Reg2MemConversions << ",\n"
+     << "    \"nounwind\": { \"functions\": " << Conv.NoUnwindFunctions
+     << ", \"calls\": " << Conv.NoUnwindCalls << " }\n"
+     << "  },\n";
+
+  if (IRLint) {
+    // Worst first, leaving out functions with nothing to report.
+    std::vector<LintStats> Report;
+    for (unsigned i = 0, e = LintReport.size(); i != e; ++i)
+      if (LintReport[i].getScore())
+        Report.push_back(LintReport[i]);
+    std::stable_sort(Report.begin(), Report.end(),
+                     [](const LintStats &A, const LintStats &B) {
+      return A.getScore() > B.getScore();
+    });
+    OS << "  \"ir_lint\": [";
+    for (unsigned i = 0, e = Report.size(); i != e; ++i) {
+      const LintStats &S = Report[i];
+      OS << (i ? ",\n" : "\n") << "    { \"function\": ";
+      WriteJSONString(OS, S.Name);
+      OS << ", \"score\": " << S.getScore()
+         << ", \"aggregate_round_trips\": " << S.AggregateRoundTrips
+         << ", \"unaligned_accesses\": " << S.UnalignedAccesses
+         << ", \"untagged_accesses\": " << S.UntaggedAccesses
+         << ", \"opaque_builtin_calls\": " << S.OpaqueBuiltinCalls
+         << ", \"entry_allocas\": " << S.EntryAllocas << " }";
+    }
+    OS << "\n  ],\n";
+  }
+
+  OS << "  \"memory\": [";
+  for (unsigned i = 0, e = MemoryUsages.size(); i != e; ++i) {
+    const MemoryUsage &U = MemoryUsages[i];
+    OS << (i ? ",\n" : "\n") << "    { \"phase\": ";
+    WriteJSONString(OS, U.Phase);
+    OS << ", \"resident_bytes\": " << U.ResidentBytes
+       << ", \"malloc_bytes\": " << U.MallocBytes << ",\n"
+       << "      \"module\": { \"functions\": " << U.Functions
+       << ", \"basic_blocks\": " << U.BasicBlocks
+       << ", \"instructions\": " << U.Instructions
+       << ", \"globals\": " << U.Globals
+       << ", \"metadata\": " << U.Metadata << " },\n"
+       << "      \"cache_entries\": { \"integer\": " << U.Cache.IntegerEntries
+       << ", \"type\": " << U.Cache.TypeEntries
+       << ", \"value\": " << U.Cache.ValueEntries
+       << ", \"decl\": " << U.Cache.DeclEntries << " },\n"
+       << "      \"types\": { \"record_layouts\": " << U.Types.RecordLayouts
+       << ", \"unique_records\": " << U.Types.UniqueRecords
+       << ", \"function_types\": " << U.Types.FunctionTypes << " },\n"
+       << "      \"debug_info\": { \"types\": " << U.Debug.Types
+       << ", \"subprograms\": " << U.Debug.Subprograms
+       << ", \"scopes\": " << U.Debug.Scopes
+       << ", \"variables\": " << U.Debug.Variables
+       << ", \"locations\": " << U.Debug.Locations
+       << ", \"files\": " << U.Debug.Files << " } }";
+  }
+  OS << "\n  ],\n";
+
+  OS << "  \"peak_memory_bytes\": " << getPeakMemoryUsage() << "\n}\n";
+}
+
 //===----------------------------------------------------------------------===//
 //                   Matching LLVM Values with GCC DECL trees
 //===----------------------------------------------------------------------===//
@@ -267,7 +1089,7 @@ Value *set_decl_llvm(tree t, Value *V) {
   assert((isa<CONST_DECL>(t) || HAS_RTL_P(t)) &&
          "Expected a declaration with RTL!");
   assert((!V || isa<GlobalValue>(V)) && "Expected a global value!");
-  setCachedValue(t, V);
+  setCachedDeclValue(t, V);
   return V;
 }
 
@@ -275,7 +1097,7 @@ Value *set_decl_llvm(tree t, Value *V) {
 Value *get_decl_llvm(tree t) {
   assert((isa<CONST_DECL>(t) || HAS_RTL_P(t)) &&
          "Expected a declaration with RTL!");
-  Value *V = getCachedValue(t);
+  Value *V = getCachedDeclValue(t);
   return V ? V->stripPointerCasts() : 0;
 }
 
@@ -295,14 +1117,18 @@ void changeLLVMConstant(Constant *Old, Constant *New) {
     AttributeCompilerUsedGlobals.insert(New);
   }
 
-  for (unsigned i = 0, e = StaticCtors.size(); i != e; ++i) {
-    if (StaticCtors[i].first == Old)
-      StaticCtors[i].first = New;
-  }
-
-  for (unsigned i = 0, e = StaticDtors.size(); i != e; ++i) {
-    if (StaticDtors[i].first == Old)
-      StaticDtors[i].first = New;
+  DenseMap<Constant *, SmallVector<unsigned, 1> >::iterator I =
+      StructorIndex.find(Old);
+  if (I != StructorIndex.end()) {
+    SmallVector<unsigned, 1> Positions;
+    Positions.swap(I->second);
+    StructorIndex.erase(I);
+    for (unsigned i = 0, e = Positions.size(); i != e; ++i) {
+      unsigned Pos = Positions[i];
+      (Pos & 1 ? StaticDtors : StaticCtors)[Pos / 2].first = New;
+    }
+    SmallVector<unsigned, 1> &NewPositions = StructorIndex[New];
+    NewPositions.append(Positions.begin(), Positions.end());
   }
 
   // No need to update the value cache - it autoupdates on RAUW.
@@ -322,6 +1148,22 @@ void handleVisibility(tree decl, GlobalValue *GV) {
     else if (DECL_VISIBILITY(decl) == VISIBILITY_DEFAULT)
       GV->setVisibility(Function::DefaultVisibility);
   }
+
+#if LLVM_VERSION_CODE > LLVM_VERSION(5, 0)
+  // If GCC knows that references to the declaration resolve within the module
+  // or executable being linked then they need not go through the GOT or PLT.
+  if (!GV->hasLocalLinkage() && targetm.binds_local_p(decl))
+    GV->setDSOLocal(true);
+
+#if (GCC_MAJOR > 5)
+  // With -fno-plt, or the noplt attribute, calls to functions that may be
+  // defined elsewhere load the function's address from the GOT rather than
+  // going through the PLT.
+  if (isa<Function>(GV) && !GV->isDSOLocal() && !GV->hasLocalLinkage() &&
+      (!flag_plt || lookup_attribute("noplt", DECL_ATTRIBUTES(decl))))
+    cast<Function>(GV)->addFnAttr(Attribute::NonLazyBind);
+#endif
+#endif
 }
 
 /// CodeGenOptLevel - The optimization level to be used by the code generators.
@@ -337,14 +1179,60 @@ static CodeGenOpt::Level CodeGenOptLevel() {
   return CodeGenOpt::Aggressive;
 }
 
-/// PerFunctionOptLevel - The optimization level to be used by the per-function
-/// IR optimizers.
-static int PerFunctionOptLevel() {
+/// getSizeLevel - The LLVM size level for the given value of GCC's
+/// optimize_size: 2, as for clang -Oz, if optimizing for size with
+/// -fplugin-arg-dragonegg-minsize.
+static int getSizeLevel(int OptimizeSize) {
+  return OptimizeSize && flag_minsize ? 2 : OptimizeSize;
+}
+
+/// getFunctionOptLevel - The optimization level and size level to be used by
+/// the per-function IR optimizers for the given function.  If the function has
+/// no optimization options of its own, or is null, then this is the level for
+/// the compilation unit as a whole.
+static FunctionOptLevel getFunctionOptLevel(tree fndecl) {
+  tree opts = fndecl ? DECL_FUNCTION_SPECIFIC_OPTIMIZATION(fndecl) : NULL_TREE;
+  // Use the options from the command line rather than the global variables,
+  // since GCC sets those to the options of whatever function it is working on.
+  if (!opts)
+    opts = optimization_default_node;
+  struct cl_optimization *Opts = TREE_OPTIMIZATION(opts);
+#if GCC_VERSION_CODE > GCC_VERSION(4, 5)
+  int OptLevel = Opts->x_optimize, SizeLevel = Opts->x_optimize_size;
+#else
+  int OptLevel = Opts->optimize, SizeLevel = Opts->optimize_size;
+#endif
   // If the user supplied an LLVM optimization level then use it.
   if (LLVMIROptimizeArg >= 0)
-    return LLVMIROptimizeArg;
-  // Otherwise use the GCC optimization level.
-  return optimize;
+    OptLevel = LLVMIROptimizeArg;
+  // Functions that are not loop heavy get light optimization, see
+  // emit_current_function.  Functions that are not to be optimized at all are
+  // left alone.
+  if (AutoIROptLevel)
+    OptLevel = std::min(OptLevel, 1);
+  return FunctionOptLevel(OptLevel, getSizeLevel(SizeLevel));
+}
+
+/// isLoopHeavy - Whether the current function looks like it spends its time in
+/// loops: it contains loops nested at least two deep, or at least half of its
+/// basic blocks are in loops.
+static bool isLoopHeavy() {
+  if (!current_loops)
+    // Without the loop tree, settle for any cycle in the control flow graph.
+    return mark_dfs_back_edges();
+
+  unsigned Blocks = 0, BlocksInLoops = 0, MaxDepth = 0;
+  basic_block bb;
+  FOR_EACH_BB_FN(bb, cfun) {
+    ++Blocks;
+    if (!bb->loop_father)
+      continue;
+    unsigned Depth = loop_depth(bb->loop_father);
+    if (Depth)
+      ++BlocksInLoops;
+    MaxDepth = std::max(MaxDepth, Depth);
+  }
+  return MaxDepth > 1 || (BlocksInLoops && 2 * BlocksInLoops >= Blocks);
 }
 
 /// ModuleOptLevel - The optimization level to be used by the module level IR
@@ -353,6 +1241,9 @@ static int ModuleOptLevel() {
   // If the user supplied an LLVM optimization level then use it.
   if (LLVMIROptimizeArg >= 0)
     return LLVMIROptimizeArg;
+  // In auto mode, the highest level given to any function.
+  if (AutoIROptLevel)
+    return SawLoopHeavyFunction ? 3 : getFunctionOptLevel(NULL_TREE).first;
   // If the GCC optimizers were run then tone down the LLVM optimization level:
   //   GCC | LLVM
   //   ----------
@@ -425,20 +1316,12 @@ static void ConfigureLLVM(void) {
   std::vector<const char *> Args;
   Args.push_back(progname); // program name
 
-//TODO  // Allow targets to specify PIC options and other stuff to the corresponding
-//TODO  // LLVM backends.
-//TODO#ifdef LLVM_SET_RED_ZONE_FLAG
-//TODO  LLVM_SET_RED_ZONE_FLAG(flag_disable_red_zone)
-//TODO#endif
 #ifdef LLVM_SET_TARGET_OPTIONS
   LLVM_SET_TARGET_OPTIONS(Args);
 #endif
 #ifdef LLVM_SET_MACHINE_OPTIONS
   LLVM_SET_MACHINE_OPTIONS(Args);
 #endif
-  //TODO#ifdef LLVM_SET_IMPLICIT_FLOAT
-  //TODO  LLVM_SET_IMPLICIT_FLOAT(flag_no_implicit_float)
-  //TODO#endif
 
   if (time_report || !quiet_flag || flag_detailed_statistics)
     Args.push_back("--time-passes");
@@ -460,6 +1343,41 @@ static void ConfigureLLVM(void) {
     Args.push_back("--ffunction-sections");
   if (flag_data_sections)
     Args.push_back("--fdata-sections");
+#if (GCC_MAJOR > 4) && LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  // With -fipa-ra, callers only save the registers that a callee defined in
+  // the module really clobbers.  The code generator then works through the
+  // functions bottom up in the call graph, so callees are done first.
+  if (flag_ipa_ra)
+    Args.push_back("--enable-ipra");
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(4, 0) && \
+    LLVM_VERSION_CODE < LLVM_VERSION(7, 0)
+  // Outline code sequences that occur many times into functions of their own.
+  // From LLVM 7 the targets that support this do it by default for functions
+  // with the minsize attribute; before that it has to be asked for, and then
+  // applies to every function.
+  if (optimize_size && flag_minsize)
+    Args.push_back("--enable-machine-outliner");
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 9)
+  // Only move hot and unlikely functions into sections of their own if GCC
+  // would.
+  if (!flag_reorder_functions)
+    Args.push_back("--profile-guided-section-prefix=false");
+#endif
+#if (GCC_MAJOR > 4) && LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  // Put C++ types with an ODR identifier into comdat type units.
+  if (debug_info_level > DINFO_LEVEL_NONE && flag_debug_types_section &&
+      dwarf_version >= 4)
+    Args.push_back("--generate-type-units");
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 3) && \
+    GCC_VERSION_CODE > GCC_VERSION(4, 7)
+  // Emit the bulk of the debug info into .dwo sections, for GCC's driver to
+  // move into a separate file.
+  if (debug_info_level > DINFO_LEVEL_NONE && dwarf_split_debug_info)
+    Args.push_back("--split-dwarf=Enable");
+#endif
 
   // If there are options that should be passed through to the LLVM backend
   // directly from the command line, do so now.  This is mainly for debugging
@@ -483,6 +1401,12 @@ static void ConfigureLLVM(void) {
   //TODO    }
   //TODO  }
 
+  // Remember the options, since they affect the output.
+  for (unsigned i = 1, e = Args.size(); i != e; ++i) {
+    LLVMOptions += Args[i];
+    LLVMOptions += '\0';
+  }
+
   Args.push_back(0); // Null terminator.
   int pseudo_argc = Args.size() - 1;
   llvm::cl::ParseCommandLineOptions(pseudo_argc, const_cast<char **>(&Args[0]));
@@ -534,23 +1458,6 @@ static std::string ComputeTargetTriple() {
   return NewTriple;
 }
 
-#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
-static void setNoFramePointerElim(bool NoFramePointerElim) {
-  for (auto &F : *TheModule) {
-    auto Attrs = F.getAttributes();
-    StringRef Value(NoFramePointerElim ? "false" : "true");
-    Attrs = Attrs.addAttribute(F.getContext(),
-#if LLVM_VERSION_CODE > LLVM_VERSION(3, 9)
-                               AttributeList::FunctionIndex,
-#else
-                               AttributeSet::FunctionIndex,
-#endif
-                               "no-frame-pointer-elim", Value);
-    F.setAttributes(Attrs);
-  }
-}
-#endif
-
 /// CreateTargetMachine - Create the TargetMachine we will generate code with.
 static void CreateTargetMachine(const std::string &TargetTriple) {
   // Create the module itself.
@@ -596,24 +1503,19 @@ static void CreateTargetMachine(const std::string &TargetTriple) {
   LLVM_SET_CODE_MODEL(CMModel);
 #endif
 
-  // https://reviews.llvm.org/D9830
-#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
-  setNoFramePointerElim(flag_omit_frame_pointer);
-#else
-  if (flag_omit_frame_pointer) {
-    // Eliminate frame pointers everywhere.
-    TargetOpts.NoFramePointerElim = false;
-  } else {
-    // Keep frame pointers everywhere.
-    TargetOpts.NoFramePointerElim = true;
-  }
-#endif
-
-  // If a target has an option to eliminate frame pointers in leaf functions
-  // only then it should set
+  // Frame pointers are kept or eliminated per function by StartFunctionBody, so
+  // that optimize attributes are honoured; the target option would override
+  // the function attributes, so turn it off.  Older LLVM only has the target
+  // option, and if a target has an option to eliminate frame pointers in leaf
+  // functions only then it should set
   //   NoFramePointerElim = false;
   //   NoFramePointerElimNonLeaf = true;
   // in its LLVM_SET_TARGET_MACHINE_OPTIONS method when this option is true.
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 3) && LLVM_VERSION_CODE < LLVM_VERSION(3, 9)
+  TargetOpts.NoFramePointerElim = false;
+#elif LLVM_VERSION_CODE < LLVM_VERSION(3, 4)
+  TargetOpts.NoFramePointerElim = !flag_omit_frame_pointer;
+#endif
 
 #ifdef HAVE_INITFINI_ARRAY
   TargetOpts.UseInitArray = true;
@@ -623,7 +1525,14 @@ static void CreateTargetMachine(const std::string &TargetTriple) {
 
   // TODO: Set float ABI type.
 
-  // TODO: Set FP fusion mode.
+  // Fuse multiplies and adds as -ffp-contract says.  GCC implements "on" as
+  // "off"; the LLVM equivalent only fuses llvm.fmuladd, which is never output.
+#if GCC_VERSION_CODE > GCC_VERSION(4, 5)
+  TargetOpts.AllowFPOpFusion =
+      flag_fp_contract_mode == FP_CONTRACT_FAST ? FPOpFusion::Fast :
+      flag_fp_contract_mode == FP_CONTRACT_ON ? FPOpFusion::Standard :
+      FPOpFusion::Strict;
+#endif
 
   // TODO: LessPreciseFPMADOption.
   TargetOpts.NoInfsFPMath = flag_finite_math_only;
@@ -647,13 +1556,15 @@ static void CreateTargetMachine(const std::string &TargetTriple) {
 #else
   TargetOpts.PositionIndependentExecutable = flag_pie;
 #endif
+#if (GCC_MAJOR > 5) && LLVM_VERSION_CODE > LLVM_VERSION(5, 0)
+  // With -fno-plt, calls to runtime library functions go through the GOT too.
+  if (!flag_plt)
+    TheModule->setRtLibUseGOT();
+#endif
 
 #ifdef LLVM_SET_TARGET_MACHINE_OPTIONS
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
-#ifdef TARGET_OMIT_LEAF_FRAME_POINTER
-  // X86
-  setNoFramePointerElim(TARGET_OMIT_LEAF_FRAME_POINTER);
-#else
+#ifndef TARGET_OMIT_LEAF_FRAME_POINTER
   // ARM
   {
     if (TARGET_SOFT_FLOAT) {
@@ -682,6 +1593,32 @@ static void CreateTargetMachine(const std::string &TargetTriple) {
   TargetOpts.MCOptions.MCUseDwarfDirectory = false;
 #endif
 
+  // The target can set LLVM_TARGET_ABI_NAME to select an ABI that cannot be
+  // deduced from the triple (eg: MIPS N32).
+#if defined(LLVM_TARGET_ABI_NAME) && LLVM_VERSION_CODE > LLVM_VERSION(3, 5)
+  TargetOpts.MCOptions.ABIName = LLVM_TARGET_ABI_NAME;
+#endif
+
+  // Record the stack frame size of each function, see stack-size-section.
+#if LLVM_VERSION_CODE > LLVM_VERSION(5, 0)
+  TargetOpts.EmitStackSizeSection = StackSizeSection;
+#endif
+
+  // Compressing debug sections is the assembler's job unless the plugin writes
+  // the object file itself.
+  if (EmitObj && CompressDebugSections) {
+#if LLVM_VERSION_CODE > LLVM_VERSION(4, 0)
+    TargetOpts.CompressDebugSections = CompressDebugSections == 1 ?
+       DebugCompressionType::Z : DebugCompressionType::GNU;
+#elif LLVM_VERSION_CODE > LLVM_VERSION(3, 9)
+    TargetOpts.CompressDebugSections = CompressDebugSections == 1 ?
+       DebugCompressionType::DCT_Zlib : DebugCompressionType::DCT_ZlibGnu;
+#elif LLVM_VERSION_CODE > LLVM_VERSION(3, 5)
+    // Only the .zdebug format is available.
+    TargetOpts.CompressDebugSections = true;
+#endif
+  }
+
 #ifdef DRAGONEGG_DEBUG
   printf("DEBUG: %s, line %d: %s: triple: %s cpu: %s feature: %s\n", __FILE__,
           __LINE__, __func__, TargetTriple.c_str(), CPU.c_str(),
@@ -719,6 +1656,162 @@ static void output_ident(const char *ident_str) {
   TheModule->setModuleInlineAsm(Directive);
 }
 
+#if LLVM_VERSION_CODE > LLVM_VERSION(5, 0)
+namespace {
+/// FunctionStackUsage - The stack frame size of a function, and whether it
+/// allocates more stack as it runs.
+struct FunctionStackUsage {
+  uint64_t Size;
+  bool Dynamic;
+};
+} // namespace
+
+/// StackUsage - The stack usage of each function code was generated for, by
+/// name.
+static StringMap<FunctionStackUsage> StackUsage;
+
+/// NoteStackUsage - Record the stack frame size reported by the code
+/// generator's prologue/epilogue inserter in the given remark.
+static void NoteStackUsage(const DiagnosticInfoOptimizationBase &Remark) {
+  const Function &F = Remark.getFunction();
+  for (const DiagnosticInfoOptimizationBase::Argument &Arg : Remark.getArgs()) {
+    if (Arg.Key != "NumStackBytes")
+      continue;
+    FunctionStackUsage &Usage = StackUsage[F.getName()];
+    Usage.Size = 0;
+    StringRef(Arg.Val).getAsInteger(10, Usage.Size);
+    // Variable sized objects are allocated on top of the frame.
+    Usage.Dynamic = false;
+    for (const BasicBlock &BB : F)
+      for (const Instruction &I : BB)
+        if (const AllocaInst *AI = dyn_cast<AllocaInst>(&I))
+          Usage.Dynamic |= !AI->isStaticAlloca();
+  }
+}
+
+namespace {
+/// RemarkHandler - Writes the optimization remarks of the passes matching a
+/// regular expression to a file as YAML, and notes the stack frame sizes the
+/// code generator reports if they are wanted, leaving every other diagnostic
+/// to LLVM's default handling.
+class RemarkHandler : public DiagnosticHandler {
+  mutable Regex Filter;
+  std::unique_ptr<raw_fd_ostream> OS;
+  std::unique_ptr<yaml::Output> YAML;
+
+  /// isWritten - Whether remarks from the given pass go to the file.
+  bool isWritten(StringRef PassName) const {
+    return YAML && Filter.match(PassName);
+  }
+
+public:
+  RemarkHandler(StringRef Pattern, std::unique_ptr<raw_fd_ostream> Stream)
+      : Filter(Pattern), OS(std::move(Stream)) {
+    if (OS)
+      YAML.reset(new yaml::Output(*OS));
+  }
+
+  bool isAnalysisRemarkEnabled(StringRef PassName) const override {
+    return isWritten(PassName) ||
+           (EmitStackUsage && PassName == "prologepilog");
+  }
+  bool isMissedOptRemarkEnabled(StringRef PassName) const override {
+    return isWritten(PassName);
+  }
+  bool isPassedOptRemarkEnabled(StringRef PassName) const override {
+    return isWritten(PassName);
+  }
+  bool isAnyRemarkEnabled() const override { return true; }
+
+  bool handleDiagnostics(const DiagnosticInfo &DI) override {
+    const DiagnosticInfoOptimizationBase *Remark =
+        dyn_cast<DiagnosticInfoOptimizationBase>(&DI);
+    if (!Remark)
+      return false;
+    if (EmitStackUsage && Remark->getRemarkName() == "StackSize")
+      NoteStackUsage(*Remark);
+    if (isWritten(Remark->getPassName())) {
+      DiagnosticInfoOptimizationBase *P =
+          const_cast<DiagnosticInfoOptimizationBase *>(Remark);
+      *YAML << P;
+    }
+    return true;
+  }
+};
+} // namespace
+#endif
+
+/// SetUpOptimizationRemarks - Arrange for the optimization remarks of the
+/// passes selected by RemarksFilter to be written to RemarksFileName, if there
+/// is one, and for stack frame sizes to be noted if a .su file is wanted.
+static void SetUpOptimizationRemarks() {
+#if LLVM_VERSION_CODE > LLVM_VERSION(5, 0)
+  std::unique_ptr<raw_fd_ostream> OS;
+  if (RemarksFileName) {
+    std::error_code EC;
+    OS.reset(new raw_fd_ostream(RemarksFileName, EC, sys::fs::F_Text));
+    if (EC) {
+      warning(0, G_("cannot open optimization remarks file '%s': %s"),
+              RemarksFileName, EC.message().c_str());
+      if (!EmitStackUsage)
+        return;
+      OS.reset();
+    }
+  }
+  // Diagnostics that are not enabled never reach the handler, so only remarks
+  // from the passes matching the filter need to be dealt with.
+  TheContext.setDiagnosticHandler(
+      std::unique_ptr<DiagnosticHandler>(
+          new RemarkHandler(RemarksFilter, std::move(OS))),
+      /*RespectFilters*/ true);
+#endif
+}
+
+/// FinishOptimizationRemarks - Close the optimization remarks file.
+static void FinishOptimizationRemarks() {
+#if LLVM_VERSION_CODE > LLVM_VERSION(5, 0)
+  TheContext.setDiagnosticHandler(
+      std::unique_ptr<DiagnosticHandler>(new DiagnosticHandler()));
+#endif
+}
+
+#if LLVM_VERSION_CODE > LLVM_VERSION(5, 0)
+/// WriteStackUsageFile - Write the stack usage of each function to a .su file,
+/// in the format used by GCC for -fstack-usage.  Like GCC, the sizes include
+/// the return address.
+static void WriteStackUsageFile() {
+  // The declaration of each function converted, by name.
+  StringMap<tree> Decls;
+  struct cgraph_node *node;
+  FOR_EACH_FUNCTION(node) {
+    tree decl = cgraph_symbol(node)->decl;
+    if (DECL_LLVM_SET_P(decl))
+      Decls[DECL_LLVM_IF_SET(decl)->getName()] = decl;
+  }
+
+  std::string FileName = std::string(aux_base_name) + ".su";
+  std::error_code EC;
+  raw_fd_ostream OS(FileName, EC, sys::fs::F_Text);
+  if (EC) {
+    warning(0, G_("cannot open stack usage file '%s': %s"), FileName.c_str(),
+            EC.message().c_str());
+    return;
+  }
+  for (Module::iterator I = TheModule->begin(), E = TheModule->end(); I != E;
+       ++I) {
+    StringMap<FunctionStackUsage>::iterator U = StackUsage.find(I->getName());
+    StringMap<tree>::iterator D = Decls.find(I->getName());
+    if (U == StackUsage.end() || D == Decls.end())
+      continue;
+    expanded_location Loc = expand_location(DECL_SOURCE_LOCATION(D->second));
+    OS << lbasename(Loc.file) << ':' << Loc.line << ':' << Loc.column << ':'
+       << lang_hooks.decl_printable_name(D->second, 2) << '\t'
+       << U->second.Size + INCOMING_FRAME_SP_OFFSET << '\t'
+       << (U->second.Dynamic ? "dynamic" : "static") << '\n';
+  }
+}
+#endif
+
 /// CreateModule - Create and initialize a module to output LLVM IR to.
 static void CreateModule(const std::string &TargetTriple) {
 #if GCC_VERSION_CODE < GCC_VERSION(4, 8)
@@ -763,6 +1856,9 @@ static void CreateModule(const std::string &TargetTriple) {
   TheModule->setDataLayout(
       TheTarget->getDataLayout()->getStringRepresentation());
 #endif
+
+  if (RemarksFileName || EmitStackUsage)
+    SetUpOptimizationRemarks();
 }
 
 /// flag_default_initialize_globals - Whether global variables with no explicit
@@ -780,6 +1876,33 @@ bool flag_odr;
 /// the arguments given in the function type.
 bool flag_functions_from_args;
 
+/// flag_unique_types - Give record types with exactly the same layout the same
+/// LLVM type, rather than one named type each.
+bool flag_unique_types;
+
+/// flag_whole_program_vtables - Describe C++ virtual tables and virtual calls
+/// using type metadata, so that LLVM can turn virtual calls into direct calls
+/// when it sees the whole program at link time.
+bool flag_whole_program_vtables;
+
+/// flag_gc_statepoints - Report garbage collector roots at calls using
+/// gc.statepoint rather than marking their stack slots with llvm.gcroot.
+bool flag_gc_statepoints;
+
+/// flag_minsize - When optimizing for size, make the code as small as possible
+/// even where that makes it slower, as for clang -Oz.
+bool flag_minsize;
+
+/// flag_discard_value_names - Do not give LLVM values, basic blocks and types
+/// names: nobody will see them.
+bool flag_discard_value_names;
+
+/// flag_llvm_sanitize_address, flag_llvm_sanitize_thread - Instrument functions
+/// using LLVM's AddressSanitizer or ThreadSanitizer, after the IR optimizers,
+/// rather than using GCC's instrumentation.
+bool flag_llvm_sanitize_address;
+bool flag_llvm_sanitize_thread;
+
 /// InstallLanguageSettings - Do any language-specific back-end configuration.
 static void InstallLanguageSettings() {
   // The principal here is that not doing any language-specific configuration
@@ -815,6 +1938,17 @@ static void InitializeBackend(void) {
 
   // Initialize and configure LLVM.
   ConfigureLLVM();
+  ConfigureCodeAlignment();
+
+  // Names cost time and memory, and are only seen in the LLVM IR, or when
+  // debugging the generated code.
+  if (ValueNames < 0)
+    flag_discard_value_names = !EmitIR && debug_info_level == DINFO_LEVEL_NONE;
+  else
+    flag_discard_value_names = !ValueNames;
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  TheContext.setDiscardValueNames(flag_discard_value_names);
+#endif
 
   // Create the target machine to generate code for.
   const std::string TargetTriple = ComputeTargetTriple();
@@ -835,8 +1969,10 @@ static void InitializeBackend(void) {
   TheFolder = new TargetFolder(TheTarget->getDataLayout());
 #endif
 
-  if (debug_info_level > DINFO_LEVEL_NONE) {
-    TheDebugInfo = new DebugInfo(TheModule);
+  // Optimization remarks need locations even if no debug info is to be output.
+  if (debug_info_level > DINFO_LEVEL_NONE || RemarksFileName) {
+    TheDebugInfo = new DebugInfo(TheModule,
+                                 debug_info_level == DINFO_LEVEL_NONE);
     TheDebugInfo->Initialize();
   }
 
@@ -844,45 +1980,162 @@ static void InitializeBackend(void) {
   InstallLanguageSettings();
 
   // Configure the pass builder.
-  PassBuilder.SizeLevel = optimize_size;
-  PassBuilder.DisableUnitAtATime = !flag_unit_at_a_time;
-  PassBuilder.DisableUnrollLoops = !flag_unroll_loops;
-  // Don't turn on the SLP vectorizer by default at -O3 for the moment.
-#if (GCC_MAJOR > 4)
-  PassBuilder.SLPVectorize = flag_tree_slp_vectorize;
-#endif
-  PassBuilder.LoopVectorize =
-#if (GCC_MAJOR > 7)
-      flag_tree_loop_vectorize;
-#else
-      flag_tree_vectorize;
-#endif
+  PMBuilder.SizeLevel = getSizeLevel(optimize_size);
+  PMBuilder.DisableUnitAtATime = !flag_unit_at_a_time;
 
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
-  PassBuilder.MergeFunctions = false;
-  PassBuilder.RerollLoops = false;
-  PassBuilder.LibraryInfo = new TargetLibraryInfoImpl(Triple(TargetTriple));
+  PMBuilder.MergeFunctions = false;
+  PMBuilder.RerollLoops = false;
+  PMBuilder.LibraryInfo = new TargetLibraryInfoImpl(Triple(TargetTriple));
 #else
-  PassBuilder.LibraryInfo = new TargetLibraryInfo(Triple(TargetTriple));
+  PMBuilder.LibraryInfo = new TargetLibraryInfo(Triple(TargetTriple));
 #endif
   if (flag_no_simplify_libcalls) {
 #ifdef DRAGONEGG_DEBUG
     printf("DEBUG: %s, line %d: %s: disable all library functions.\n",
             __FILE__, __LINE__, __func__);
 #endif
-    PassBuilder.LibraryInfo->disableAllFunctions();
+    PMBuilder.LibraryInfo->disableAllFunctions();
   }
 
   Initialized = true;
 }
 
-/// InitializeOutputStreams - Initialize the assembly code output streams.
-static void InitializeOutputStreams(bool Binary) {
-  assert(!OutStream && "Output stream already initialized!");
-#if LLVM_VERSION_CODE > LLVM_VERSION(3, 3)
-  std::error_code EC;
-
-  OutStream.reset(new raw_fd_ostream(
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 9)
+/// AsyncOutputStream - An output stream that hands what is written to it to a
+/// background thread, which writes it to the underlying stream.  This lets the
+/// code generator get on with things while output to a slow file system is in
+/// progress.  At most MaxBuffered bytes are held in memory; once there are that
+/// many, writing waits for the background thread to catch up.
+class AsyncOutputStream : public raw_pwrite_stream {
+  std::unique_ptr<raw_fd_ostream> Out; // Only used by the background thread
+                                       // while there is pending output.
+  std::string FileName;
+  uint64_t Pos;
+
+  std::mutex Lock;
+  std::condition_variable Changed;
+  std::deque<std::string> Pending; // Output not yet handed to Out.
+  size_t PendingBytes;             // Output not yet written by Out.
+  bool Closing;
+  bool Failed;   // Whether Out reported an error.
+  bool Reported; // Whether the error was reported.
+  std::thread Writer;
+
+  static const size_t MaxBuffered = 16 << 20;
+
+  /// run - The body of the background thread.
+  void run() {
+    std::unique_lock<std::mutex> Guard(Lock);
+    while (true) {
+      Changed.wait(Guard, [this] { return !Pending.empty() || Closing; });
+      if (Pending.empty())
+        return;
+      std::string Chunk = std::move(Pending.front());
+      Pending.pop_front();
+      bool Skip = Failed;
+      Guard.unlock();
+      if (!Skip) {
+        Out->write(Chunk.data(), Chunk.size());
+        Out->flush();
+      }
+      Guard.lock();
+      Failed |= Out->has_error();
+      PendingBytes -= Chunk.size();
+      Changed.notify_all();
+    }
+  }
+
+  /// reportError - Report any error writing the output.  Must be called without
+  /// holding the lock since report_fatal_error does not return.
+  void reportError() {
+    if (Reported)
+      return;
+    bool Error;
+    {
+      std::lock_guard<std::mutex> Guard(Lock);
+      Error = Failed;
+    }
+    if (!Error)
+      return;
+    Reported = true;
+    Out->clear_error();
+    report_fatal_error(Twine("cannot write to '") + FileName + "'");
+  }
+
+  void write_impl(const char *Ptr, size_t Size) override {
+    Pos += Size;
+    if (Reported)
+      return;
+    {
+      std::unique_lock<std::mutex> Guard(Lock);
+      Changed.wait(Guard, [this, Size] {
+        return !PendingBytes || PendingBytes + Size <= MaxBuffered || Failed;
+      });
+      Pending.emplace_back(Ptr, Size);
+      PendingBytes += Size;
+    }
+    Changed.notify_all();
+    reportError();
+  }
+
+  void pwrite_impl(const char *Ptr, size_t Size, uint64_t Offset) override {
+    // Overwrite output that has already been written.
+    flush();
+    wait();
+    if (!Reported) {
+      Out->pwrite(Ptr, Size, Offset);
+      Out->flush();
+      std::lock_guard<std::mutex> Guard(Lock);
+      Failed |= Out->has_error();
+    }
+    reportError();
+  }
+
+  uint64_t current_pos() const override { return Pos; }
+
+  size_t preferred_buffer_size() const override { return 64 << 10; }
+
+public:
+  AsyncOutputStream(std::unique_ptr<raw_fd_ostream> Out, StringRef FileName)
+      : Out(std::move(Out)), FileName(FileName), Pos(0), PendingBytes(0),
+        Closing(false), Failed(false), Reported(false),
+        Writer(&AsyncOutputStream::run, this) {}
+
+  ~AsyncOutputStream() override {
+    flush();
+    {
+      std::lock_guard<std::mutex> Guard(Lock);
+      Closing = true;
+    }
+    Changed.notify_all();
+    Writer.join();
+    reportError();
+  }
+
+  /// wait - Wait until everything handed to the background thread has been
+  /// written to the underlying stream, and report any error.
+  void wait() {
+    {
+      std::unique_lock<std::mutex> Guard(Lock);
+      Changed.wait(Guard, [this] { return !PendingBytes; });
+    }
+    reportError();
+  }
+};
+
+/// AsyncOut - The output stream if output is being written on a background
+/// thread, see the async-output flag.
+static AsyncOutputStream *AsyncOut = 0;
+#endif
+
+/// InitializeOutputStreams - Initialize the assembly code output streams.
+static void InitializeOutputStreams(bool Binary) {
+  assert(!OutStream && "Output stream already initialized!");
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 3)
+  std::error_code EC;
+
+  OutStream.reset(new raw_fd_ostream(
               llvm_asm_file_name, EC,
               Binary ? sys::fs::F_None : sys::fs::F_Text));
 
@@ -898,6 +2151,17 @@ static void InitializeOutputStreams(bool Binary) {
     report_fatal_error(Error);
 #endif
 
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 9)
+  // Write output to a file in the background, if requested.  The object writer
+  // goes back and overwrites bits of the output, so this needs a proper file.
+  if (AsyncOutput && OutStream->supportsSeeking()) {
+    OutStream->SetUnbuffered();
+    AsyncOut = new AsyncOutputStream(std::move(OutStream), llvm_asm_file_name);
+    FormattedOutStream.reset(AsyncOut);
+    return;
+  }
+#endif
+
   // https://reviews.llvm.org/rL234535
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 3)
   if (!Binary || OutStream->supportsSeeking()) {
@@ -914,38 +2178,303 @@ static void InitializeOutputStreams(bool Binary) {
 #endif
 }
 
-static void createPerFunctionOptimizationPasses() {
-  if (PerFunctionPasses)
-    return;
+/// FlushOutputStream - Make sure that everything output so far has reached the
+/// output file.
+static void FlushOutputStream() {
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  FormattedOutStream->flush();
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 9)
+  if (AsyncOut)
+    AsyncOut->wait();
+#endif
+#else
+  FormattedOutStream.flush();
+  OutStream->flush();
+#endif
+}
 
-  // Create and set up the per-function pass manager.
-  // FIXME: Move the code generator to be function-at-a-time.
+/// ReleaseFunctionBody - Code has been generated for the given function so its
+/// IR is no longer needed.  Free the body, leaving a declaration in place
+/// so that any references to the function remain valid.
+static void ReleaseFunctionBody(Function *Fn) {
+  // Global initializers that have not been output yet may refer to the address
+  // of a block in this function.  Deleting the block would break them.
+  for (Function::iterator BB = Fn->begin(), E = Fn->end(); BB != E; ++BB)
+    if (BB->hasAddressTaken())
+      return;
+  Fn->deleteBody();
+}
+
+/// CreateFunctionPassManager - Create a pass manager holding the per-function
+/// IR optimizers for the given optimization level.
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+static legacy::FunctionPassManager *
+#else
+static FunctionPassManager *
+#endif
+CreateFunctionPassManager(FunctionOptLevel Level) {
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
-  PerFunctionPasses = new legacy::FunctionPassManager(TheModule);
+  legacy::FunctionPassManager *PM = new legacy::FunctionPassManager(TheModule);
 #else
-  PerFunctionPasses = new FunctionPassManager(TheModule);
+  FunctionPassManager *PM = new FunctionPassManager(TheModule);
 #endif
   // https://reviews.llvm.org/D7992
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
-  PerFunctionPasses->add(
+  PM->add(
         createTargetTransformInfoWrapperPass(TheTarget->getTargetIRAnalysis()));
 #elif LLVM_VERSION_CODE > LLVM_VERSION(3, 3)
-  PerFunctionPasses->add(new DataLayoutPass());
+  PM->add(new DataLayoutPass());
 #else
-  PerFunctionPasses->add(new DataLayout(TheModule));
+  PM->add(new DataLayout(TheModule));
 #endif
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 3) && LLVM_VERSION_CODE < LLVM_VERSION(3, 7)
-  TheTarget->addAnalysisPasses(*PerFunctionPasses);
+  TheTarget->addAnalysisPasses(*PM);
 #endif
 
 #ifndef NDEBUG
-  PerFunctionPasses->add(createVerifierPass());
+  PM->add(createVerifierPass());
 #endif
 
-#if LLVM_VERSION_CODE < LLVM_VERSION(3, 9)
-  PassBuilder.OptLevel = PerFunctionOptLevel();
+  // The size level is shared with the module level optimizers, so restore it.
+  unsigned SizeLevel = PMBuilder.SizeLevel;
+  PMBuilder.OptLevel = Level.first;
+  PMBuilder.SizeLevel = Level.second;
+  PMBuilder.populateFunctionPassManager(*PM);
+  PMBuilder.SizeLevel = SizeLevel;
+  return PM;
+}
+
+/// LLVMInlinesSmallFunctions - Whether the LLVM inliner should inline small
+/// functions, rather than only those marked always_inline.  Not if GCC's
+/// inliner already did.
+static bool LLVMInlinesSmallFunctions() {
+  return flag_inline_small_functions && !flag_no_inline && !KeepGCCIPAPasses;
+}
+
+/// getInlineThreshold - The threshold used by the inliner for inlining small
+/// functions.
+static unsigned getInlineThreshold() {
+  // GCC has many options that control inlining, but we have decided not to
+  // support anything like that for dragonegg.
+  if (getSizeLevel(optimize_size) > 1)
+    // Only inline where that does not make the code bigger, as for clang -Oz.
+    return 25;
+  if (optimize_size)
+    // Reduce inline limit.
+    return 75;
+  if (ModuleOptLevel() >= 3)
+    return 275;
+  return 225;
+}
+
+/// SetLLVMOptionDefault - Set the given LLVM command line option, unless the
+/// user set it with -fplugin-arg-dragonegg-llvm-option.  Does nothing if this
+/// version of LLVM has no such option.
+static void SetLLVMOptionDefault(const char *Name, unsigned Value) {
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 6)
+  StringMap<cl::Option *> &Options = cl::getRegisteredOptions();
+#else
+  StringMap<cl::Option *> Options;
+  cl::getRegisteredOptions(Options);
+#endif
+  StringMap<cl::Option *>::iterator I = Options.find(Name);
+  if (I != Options.end() && !I->second->getNumOccurrences()) {
+    I->second->addOccurrence(0, Name, utostr(Value));
+    // Remember the option, since it affects the output.
+    LLVMOptions += "-" + std::string(Name) + "=" + utostr(Value);
+    LLVMOptions += '\0';
+  }
+}
+
+/// ConfigureCodeAlignment - Have the code generator align loops and the targets
+/// of jumps as the user asked with -falign-loops and -falign-jumps.  Otherwise
+/// the target's own preferences are used, which for the common processors are
+/// the same as GCC's.  Function alignment is set on each function.
+static void ConfigureCodeAlignment() {
+#ifdef LLVM_LOOP_ALIGNMENT_OPTION
+  int LoopAlignLog = USER_ALIGNMENT_LOG(align_loops);
+  if (LoopAlignLog >= 0)
+    SetLLVMOptionDefault(LLVM_LOOP_ALIGNMENT_OPTION, LoopAlignLog);
+#endif
+  // GCC aligns labels only reached by jumping, LLVM blocks that are not
+  // reached by falling through from the previous block.
+  int JumpAlignLog = USER_ALIGNMENT_LOG(align_jumps);
+  if (JumpAlignLog > 0)
+    SetLLVMOptionDefault("align-all-nofallthru-blocks", JumpAlignLog);
+}
+
+/// ConfigureLoopOptimizations - Have the module level optimizers vectorize and
+/// unroll loops as the GCC options say.  The options for the compilation unit
+/// are used, not those of whatever function GCC last looked at.
+static void ConfigureLoopOptimizations() {
+  struct cl_optimization *Opts = TREE_OPTIMIZATION(optimization_default_node);
+#if GCC_VERSION_CODE > GCC_VERSION(4, 5)
+  // GCC completely unrolls small loops at -O3 or with -fpeel-loops, and only
+  // unrolls other loops with -funroll-loops.  The LLVM unroller does both.
+  PMBuilder.DisableUnrollLoops = !Opts->x_flag_unroll_loops &&
+                                 !Opts->x_flag_peel_loops &&
+                                 Opts->x_optimize < 3;
+#if (GCC_MAJOR > 4)
+  PMBuilder.SLPVectorize = Opts->x_flag_tree_slp_vectorize;
+#endif
+  PMBuilder.LoopVectorize =
+#if (GCC_MAJOR > 7)
+      Opts->x_flag_tree_loop_vectorize;
+#else
+      Opts->x_flag_tree_vectorize;
+#endif
+#else
+  PMBuilder.DisableUnrollLoops = !Opts->flag_unroll_loops &&
+                                 !Opts->flag_peel_loops && Opts->optimize < 3;
+  PMBuilder.LoopVectorize = Opts->flag_tree_vectorize;
+#endif
+
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  // Prefetch the arrays used by loops if GCC would.  LLVM measures how far
+  // ahead to prefetch in instructions, GCC the latency of a prefetch in cycles,
+  // and GCC prefetches data that will be written as well as read.
+#if GCC_VERSION_CODE > GCC_VERSION(4, 5)
+  PrefetchLoopArrays = Opts->x_flag_prefetch_loop_arrays > 0;
+#else
+  PrefetchLoopArrays = Opts->flag_prefetch_loop_arrays > 0;
+#endif
+  if (PrefetchLoopArrays) {
+    SetLLVMOptionDefault("prefetch-distance",
+                         PARAM_VALUE(PARAM_PREFETCH_LATENCY));
+    SetLLVMOptionDefault("loop-prefetch-writes", 1);
+  }
 #endif
-  PassBuilder.populateFunctionPassManager(*PerFunctionPasses);
+
+  // Pass on the GCC limits for unrolling, if the user changed them.
+  if (PARAM_SET_P(PARAM_MAX_UNROLLED_INSNS))
+    SetLLVMOptionDefault("unroll-threshold",
+                         PARAM_VALUE(PARAM_MAX_UNROLLED_INSNS));
+  if (PARAM_SET_P(PARAM_MAX_UNROLL_TIMES))
+    SetLLVMOptionDefault("unroll-max-count",
+                         PARAM_VALUE(PARAM_MAX_UNROLL_TIMES));
+}
+
+#if LLVM_VERSION_CODE > LLVM_VERSION(4, 0)
+/// getNewPMOptLevel - The new pass manager optimization level corresponding to
+/// the given IR optimization level and size level.
+static llvm::PassBuilder::OptimizationLevel getNewPMOptLevel(int OptLevel,
+                                                             int SizeLevel) {
+  if (OptLevel <= 0)
+    return llvm::PassBuilder::O0;
+  if (SizeLevel == 1)
+    return llvm::PassBuilder::Os;
+  if (SizeLevel > 1)
+    return llvm::PassBuilder::Oz;
+  if (OptLevel == 1)
+    return llvm::PassBuilder::O1;
+  if (OptLevel == 2)
+    return llvm::PassBuilder::O2;
+  return llvm::PassBuilder::O3;
+}
+
+/// CreateNewPassManager - Set up the analysis managers of the new pass manager,
+/// which are shared by the per-function and module level optimizers.
+static void CreateNewPassManager() {
+  NewPM = new NewPassManager(DebugPassStructure);
+
+  // Honour -fno-builtin and friends, see PMBuilder.LibraryInfo.  This has to
+  // be registered before the default analyses.
+  TargetLibraryInfoImpl TLII(*PMBuilder.LibraryInfo);
+  NewPM->FAM.registerPass([TLII] { return TargetLibraryAnalysis(TLII); });
+
+  NewPM->Builder.registerModuleAnalyses(NewPM->MAM);
+  NewPM->Builder.registerCGSCCAnalyses(NewPM->CGAM);
+  NewPM->Builder.registerFunctionAnalyses(NewPM->FAM);
+  NewPM->Builder.registerLoopAnalyses(NewPM->LAM);
+  NewPM->Builder.crossRegisterProxies(NewPM->LAM, NewPM->FAM, NewPM->CGAM,
+                                      NewPM->MAM);
+}
+
+/// getNewFunctionPassManager - The per-function IR optimizers of the new pass
+/// manager for the given optimization level.  These are the same passes as
+/// populateFunctionPassManager adds to a legacy pass manager.
+static FunctionPassManager &getNewFunctionPassManager(FunctionOptLevel Level) {
+  std::map<FunctionOptLevel, FunctionPassManager>::iterator I =
+      NewPM->FunctionPasses.find(Level);
+  if (I != NewPM->FunctionPasses.end())
+    return I->second;
+
+  FunctionPassManager PM(DebugPassStructure);
+#ifndef NDEBUG
+  PM.addPass(VerifierPass());
+#endif
+  if (Level.first > 0) {
+    PM.addPass(SimplifyCFGPass());
+    PM.addPass(SROA());
+    PM.addPass(EarlyCSEPass());
+    PM.addPass(LowerExpectIntrinsicPass());
+  }
+  return NewPM->FunctionPasses.emplace(Level, std::move(PM)).first->second;
+}
+
+/// createNewModuleOptimizationPasses - Set up the module level IR optimizers of
+/// the new pass manager.  The inliner is chosen as for the legacy pass manager,
+/// see createPerModuleOptimizationPasses.
+static void createNewModuleOptimizationPasses() {
+  NewPM->HasModulePasses = true;
+  ModulePassManager &MPM = NewPM->ModulePasses;
+
+  if (!ModuleOptLevel()) {
+    // If the user asked for no LLVM optimization, then don't do any inlining.
+    // Otherwise handle functions marked as always_inline.
+    if (LLVMIROptimizeArg)
+      MPM.addPass(AlwaysInlinerPass());
+    return;
+  }
+
+  llvm::PassBuilder::OptimizationLevel Level =
+      getNewPMOptLevel(ModuleOptLevel(), getSizeLevel(optimize_size));
+
+  if (!LLVMInlinesSmallFunctions()) {
+    // The default pipelines always inline small functions, so build a reduced
+    // pipeline that only inlines functions marked as always_inline.
+    MPM.addPass(AlwaysInlinerPass());
+    MPM.addPass(createModuleToFunctionPassAdaptor(
+        NewPM->Builder.buildFunctionSimplificationPipeline(
+            Level, llvm::PassBuilder::ThinLTOPhase::None, DebugPassStructure)));
+    return;
+  }
+
+  // The default pipelines take the inline threshold from the command line, so
+  // pass ours on that way.
+  SetLLVMOptionDefault("inline-threshold", getInlineThreshold());
+
+  // Annotate the IR with the sample profile before anything looks at it.
+  if (SampleProfileFile)
+    MPM.addPass(SampleProfileLoaderPass(SampleProfileFile));
+
+  if (EmitThinLTO)
+    // Leave work that benefits from seeing other modules to the ThinLTO link.
+    MPM.addPass(NewPM->Builder.buildThinLTOPreLinkDefaultPipeline(
+        Level, DebugPassStructure));
+  else
+    MPM.addPass(NewPM->Builder.buildPerModuleDefaultPipeline(
+        Level, DebugPassStructure));
+
+  if (PrefetchLoopArrays && !EmitThinLTO)
+    MPM.addPass(createModuleToFunctionPassAdaptor(LoopDataPrefetchPass()));
+}
+#endif
+
+static void createPerFunctionOptimizationPasses() {
+#if LLVM_VERSION_CODE > LLVM_VERSION(4, 0)
+  if (UseNewPassManager) {
+    if (!NewPM)
+      CreateNewPassManager();
+    return;
+  }
+#endif
+  if (PerFunctionPasses)
+    return;
+
+  // Create and set up the per-function pass manager.
+  // FIXME: Move the code generator to be function-at-a-time.
+  PerFunctionPasses = CreateFunctionPassManager(getFunctionOptLevel(NULL_TREE));
 
   // If there are no module-level passes that have to be run, we codegen as
   // each function is parsed.
@@ -985,15 +2514,88 @@ static void createPerFunctionOptimizationPasses() {
       llvm_unreachable("Error interfacing to target machine!");
   }
 
-#if LLVM_VERSION_CODE < LLVM_VERSION(3, 9)
   PerFunctionPasses->doInitialization();
+}
+
+/// CanUseCodeGenDaemon - Whether code for the module can be generated by
+/// CodeGenDaemon.  Not if anything the code generator reports is wanted, since
+/// that would be lost in the daemon.
+static bool CanUseCodeGenDaemon() {
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 9) && !defined(_WIN32)
+  return CodeGenDaemon && !RemarksFileName && !EmitStackUsage;
+#else
+  return false;
 #endif
 }
 
-static void createPerModuleOptimizationPasses() {
-  if (PerModulePasses)
-    return;
+/// CanSplitCodeGen - Whether code can be generated for pieces of the module in
+/// parallel.  The pieces are output one after the other as a single assembler
+/// file, which only works if nothing in them is numbered module-wide.
+static bool CanSplitCodeGen() {
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 9)
+  if (!(CodeGenThreads || CodeGenCache || CodeGenByFunction) || EmitIR ||
+      EmitObj)
+    return false;
+
+  // Each piece would get its own compile unit and file numbering.
+  if (debug_info_level > DINFO_LEVEL_NONE)
+    return false;
+
+  // Remarks from the pieces would be lost, as each piece is code generated in
+  // a context of its own.  Stack frame sizes are reported as remarks.
+  if (RemarksFileName || EmitStackUsage)
+    return false;
+
+  // Pass timers are not thread safe.
+  if (TimePassesIsEnabled)
+    return false;
+
+  // Assembler local symbols need to be renamed in each piece, which is only
+  // done if they can be recognized unambiguously (as on ELF targets).
+  return StringRef(TheTarget->getMCAsmInfo()->getPrivateGlobalPrefix())
+             .startswith(".") &&
+         StringRef(TheTarget->getMCAsmInfo()->getPrivateLabelPrefix())
+             .startswith(".");
+#else
+  return false;
+#endif
+}
+
+/// AddAddressSanitizerPasses - Add LLVM's AddressSanitizer, which instruments
+/// functions with the sanitize_address attribute and the module's globals.
+static void AddAddressSanitizerPasses(const PassManagerBuilder &,
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 4)
+                                      legacy::PassManagerBase &PM) {
+#else
+                                      PassManagerBase &PM) {
+#endif
+  PM.add(createAddressSanitizerFunctionPass());
+  PM.add(createAddressSanitizerModulePass());
+}
+
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+/// AddLoopDataPrefetchPass - Add the pass that prefetches the data used by
+/// later loop iterations.
+static void AddLoopDataPrefetchPass(const PassManagerBuilder &,
+                                    legacy::PassManagerBase &PM) {
+  PM.add(createLoopDataPrefetchPass());
+}
+#endif
+
+/// AddThreadSanitizerPass - Add LLVM's ThreadSanitizer, which instruments
+/// functions with the sanitize_thread attribute.
+static void AddThreadSanitizerPass(const PassManagerBuilder &,
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 4)
+                                   legacy::PassManagerBase &PM) {
+#else
+                                   PassManagerBase &PM) {
+#endif
+  PM.add(createThreadSanitizerPass());
+}
 
+/// createLegacyModuleOptimizationPasses - Set up the module level IR optimizers
+/// of the legacy pass manager.
+static void createLegacyModuleOptimizationPasses() {
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
   PerModulePasses = new legacy::PassManager();
 #else
@@ -1015,19 +2617,11 @@ static void createPerModuleOptimizationPasses() {
   if (!LLVMIROptimizeArg)
     // If the user asked for no LLVM optimization, then don't do any inlining.
     InliningPass = 0;
-  else if (flag_inline_small_functions && !flag_no_inline) {
-    // Inline small functions.  Figure out a reasonable threshold to pass llvm's
-    // inliner.  GCC has many options that control inlining, but we have decided
-    // not to support anything like that for dragonegg.
-    unsigned Threshold;
-    if (optimize_size)
-      // Reduce inline limit.
-      Threshold = 75;
-    else if (ModuleOptLevel() >= 3)
-      Threshold = 275;
-    else
-      Threshold = 225;
-    InliningPass = createFunctionInliningPass(Threshold);
+  else if (LLVMInlinesSmallFunctions()) {
+    // Inline small functions.  If there is profile data (see
+    // EmitProfileSummary) then the inliner raises the threshold for hot call
+    // sites and lowers it for cold ones.
+    InliningPass = createFunctionInliningPass(getInlineThreshold());
   } else {
     // Run the always-inline pass to handle functions marked as always_inline.
     // TODO: Consider letting the GCC inliner do this.
@@ -1038,14 +2632,160 @@ static void createPerModuleOptimizationPasses() {
 #endif
   }
 
-  PassBuilder.OptLevel = ModuleOptLevel();
-  PassBuilder.Inliner = InliningPass;
-  PassBuilder.populateModulePassManager(*PerModulePasses);
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 4)
+  // Annotate the IR with the sample profile, so the inliner and the block
+  // placement see which code is hot.
+  if (SampleProfileFile && LLVMIROptimizeArg)
+    PerModulePasses->add(createSampleProfileLoaderPass(SampleProfileFile));
+#endif
 
-  if (EmitIR) {
+  PMBuilder.OptLevel = ModuleOptLevel();
+  PMBuilder.Inliner = InliningPass;
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  // Prefetch once the loops have taken their final shape.
+  if (PrefetchLoopArrays)
+    PMBuilder.addExtension(PassManagerBuilder::EP_OptimizerLast,
+                           AddLoopDataPrefetchPass);
+#endif
+  // Instrument the code for the sanitizers once it has been optimized, so that
+  // checks the optimizers made redundant are not done.
+  if (flag_llvm_sanitize_address) {
+    PMBuilder.addExtension(PassManagerBuilder::EP_OptimizerLast,
+                           AddAddressSanitizerPasses);
+    PMBuilder.addExtension(PassManagerBuilder::EP_EnabledOnOptLevel0,
+                           AddAddressSanitizerPasses);
+  }
+  if (flag_llvm_sanitize_thread) {
+    PMBuilder.addExtension(PassManagerBuilder::EP_OptimizerLast,
+                           AddThreadSanitizerPass);
+    PMBuilder.addExtension(PassManagerBuilder::EP_EnabledOnOptLevel0,
+                           AddThreadSanitizerPass);
+  }
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 9)
+  // Instrument the code, or annotate it with the counts from a profile, using
+  // LLVM's profiling rather than GCC's.
+  if (InstrProfileGenerate) {
+    PMBuilder.EnablePGOInstrGen = true;
+    PMBuilder.PGOInstrGen = InstrProfileGenerate;
+  }
+  if (InstrProfileUse)
+    PMBuilder.PGOInstrUse = InstrProfileUse;
+#endif
+  if (SawLoopHeavyFunction)
+    // Vectorize the loops that earned the module its optimization level.
+    PMBuilder.LoopVectorize = PMBuilder.SLPVectorize = true;
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 9)
+  // Leave work that benefits from seeing other modules to the ThinLTO link.
+  PMBuilder.PrepareForThinLTO = EmitThinLTO;
+#endif
+  PMBuilder.populateModulePassManager(*PerModulePasses);
+}
+
+/// ModuleIsEmpty - Whether the module defines no functions, variables or
+/// aliases, in which case the IR optimizers have nothing to do.
+static bool ModuleIsEmpty() {
+  for (Module::iterator I = TheModule->begin(), E = TheModule->end(); I != E;
+       ++I)
+    if (!I->isDeclaration())
+      return false;
+  for (Module::global_iterator I = TheModule->global_begin(),
+                               E = TheModule->global_end();
+       I != E; ++I)
+    if (!I->isDeclaration())
+      return false;
+  return TheModule->alias_empty();
+}
+
+static void createPerModuleOptimizationPasses() {
+  if (PerModulePasses)
+    return;
+
+  // Building the optimization pipeline is a noticeable part of the time taken
+  // to compile a tiny file, so don't bother if there is nothing to optimize.
+  bool Empty = ModuleIsEmpty();
+  if (!Empty)
+    ConfigureLoopOptimizations();
+
+#if LLVM_VERSION_CODE > LLVM_VERSION(5, 0)
+  if (InstrProfileGenerate) {
+    // Keep the counters for a loop in registers while it runs, only adding
+    // them to memory when it exits.
+    SetLLVMOptionDefault("do-counter-promotion", 1);
+#if (GCC_MAJOR > 6)
+    // Only update the counters atomically if -fprofile-update=atomic.
+    if (flag_profile_update == PROFILE_UPDATE_ATOMIC)
+      SetLLVMOptionDefault("instrprof-atomic-counter-update-all", 1);
+#endif
+  }
+#endif
+
+#if LLVM_VERSION_CODE > LLVM_VERSION(4, 0)
+  if (NewPM) {
+    if (NewPM->HasModulePasses)
+      return;
+    if (Empty)
+      NewPM->HasModulePasses = true;
+    else
+      createNewModuleOptimizationPasses();
+  } else
+#endif
+  if (Empty)
+    // Only the passes that write out the module are needed.
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+    PerModulePasses = new legacy::PassManager();
+#else
+    PerModulePasses = new PassManager();
+#endif
+  else
+    createLegacyModuleOptimizationPasses();
+
+  if (EmitThinLTO) {
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 9)
+    // Emit an LLVM bitcode file with a module summary, for use by a ThinLTO
+    // capable linker.
+    InitializeOutputStreams(true);
+#if LLVM_VERSION_CODE > LLVM_VERSION(4, 0)
+    if (NewPM)
+      NewPM->ModulePasses.addPass(BitcodeWriterPass(
+          *FormattedOutStream, false, /*EmitSummaryIndex*/ true,
+          /*EmitModuleHash*/ true));
+    else
+#endif
+    PerModulePasses->add(createBitcodeWriterPass(*FormattedOutStream, false,
+                                                 /*EmitSummaryIndex*/ true,
+                                                 /*EmitModuleHash*/ true));
+#endif
+  } else if (EmitIR && (EmitBitcode || EmitObj)) {
+    // Emit an LLVM .bc file to the output.  This is used when passed
+    // -emit-llvm -c to the GCC driver, which with the integrated assembler
+    // specs expects the plugin to write the object file itself.
+    InitializeOutputStreams(true);
+#if LLVM_VERSION_CODE > LLVM_VERSION(4, 0)
+    if (NewPM)
+      NewPM->ModulePasses.addPass(BitcodeWriterPass(
+          *FormattedOutStream, false, /*EmitSummaryIndex*/ false,
+          BitcodeModuleHash));
+    else
+#endif
+    PerModulePasses->add(createBitcodeWriterPass(
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 3)
+                *FormattedOutStream
+#else
+                *OutStream
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 9)
+                , false, /*EmitSummaryIndex*/ false, BitcodeModuleHash
+#endif
+                ));
+  } else if (EmitIR) {
     // Emit an LLVM .ll file to the output.  This is used when passed
     // -emit-llvm -S to the GCC driver.
     InitializeOutputStreams(false);
+#if LLVM_VERSION_CODE > LLVM_VERSION(4, 0)
+    if (NewPM)
+      NewPM->ModulePasses.addPass(PrintModulePass(*FormattedOutStream));
+    else
+#endif
     PerModulePasses->add(createPrintModulePass(
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 3)
                 *FormattedOutStream
@@ -1053,6 +2793,16 @@ static void createPerModuleOptimizationPasses() {
                 OutStream
 #endif
                 ));
+  } else if (CanUseCodeGenDaemon()) {
+    // Code is generated once the module level optimizers have run, see
+    // EmitModuleWithDaemon.
+    DaemonCodeGen = true;
+    InitializeOutputStreams(EmitObj);
+  } else if (CanSplitCodeGen()) {
+    // Code is generated once the module level optimizers have run, see
+    // EmitModuleInParallel.
+    SplitCodeGen = true;
+    InitializeOutputStreams(false);
   } else {
     // If there are passes we have to run on the entire module, we do codegen
     // as a separate "pass" after that happens.
@@ -1063,7 +2813,7 @@ static void createPerModuleOptimizationPasses() {
     if (PerModulePasses || 1) {
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
 #if LLVM_VERSION_MAJOR > 4
-      TheTarget->adjustPassManager(PassBuilder);
+      TheTarget->adjustPassManager(PMBuilder);
 #endif
       CodeGenPasses = new legacy::PassManager();
       CodeGenPasses->add(
@@ -1139,6 +2889,72 @@ static void CreateStructorsList(std::vector<std::pair<Constant *, int> > &Tors,
                      GlobalValue::AppendingLinkage, Array, Name);
 }
 
+/// MergeStaticCtors - Replace the static constructors with the same priority by
+/// one function calling them in the order they were registered, placed in the
+/// startup section, see -fplugin-arg-dragonegg-merge-constructors.  Those only
+/// called from there can then be inlined into it, so that starting a program
+/// made of many units touches fewer pages.
+static void MergeStaticCtors() {
+  std::map<int, std::vector<Constant *> > ByPriority;
+  for (unsigned i = 0, e = StaticCtors.size(); i != e; ++i)
+    ByPriority[StaticCtors[i].second].push_back(StaticCtors[i].first);
+  if (ByPriority.size() == StaticCtors.size())
+    return; // Nothing to merge.
+
+  LLVMContext &Context =
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+      TheModule->getContext();
+#else
+      TheContext;
+#endif
+  FunctionType *FTy = FunctionType::get(Type::getVoidTy(Context), false);
+
+  std::vector<std::pair<Constant *, int> > Merged;
+  for (std::map<int, std::vector<Constant *> >::iterator
+           I = ByPriority.begin(), E = ByPriority.end();
+       I != E; ++I) {
+    const std::vector<Constant *> &Ctors = I->second;
+    if (Ctors.size() == 1) {
+      Merged.push_back(std::make_pair(Ctors[0], I->first));
+      continue;
+    }
+
+    Function *Fn = Function::Create(FTy, GlobalValue::InternalLinkage,
+                                    "_GLOBAL__I_merged", TheModule);
+    // Take the target attributes and the like from a constructor, so that
+    // nothing stops them being inlined, but not any section it was put in.
+    if (Function *First = dyn_cast<Function>(Ctors[0]->stripPointerCasts())) {
+      Fn->copyAttributesFrom(First);
+      Fn->setSection("");
+    }
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 9)
+    Fn->setSectionPrefix(".startup");
+#endif
+
+    // __attribute__(constructor) can be on a function with any type; call it
+    // as void() like the startup code would.
+    IRBuilder<> Builder(BasicBlock::Create(Context, "entry", Fn));
+    for (unsigned i = 0, e = Ctors.size(); i != e; ++i)
+      Builder.CreateCall(
+          TheFolder->CreateBitCast(Ctors[i], FTy->getPointerTo()));
+    Builder.CreateRetVoid();
+    Merged.push_back(std::make_pair(Fn, I->first));
+  }
+  StaticCtors.swap(Merged);
+
+  // The constructors have moved, so update their positions in StructorIndex.
+  for (DenseMap<Constant *, SmallVector<unsigned, 1> >::iterator
+           I = StructorIndex.begin(), E = StructorIndex.end();
+       I != E; ++I) {
+    SmallVector<unsigned, 1> &Positions = I->second;
+    Positions.erase(std::remove_if(Positions.begin(), Positions.end(),
+                                   [](unsigned Pos) { return !(Pos & 1); }),
+                    Positions.end());
+  }
+  for (unsigned i = 0, e = StaticCtors.size(); i != e; ++i)
+    StructorIndex[StaticCtors[i].first].push_back(2 * i);
+}
+
 /// ConvertMetadataStringToGV - Convert string to global value. Use existing
 /// global if possible.
 Constant *ConvertMetadataStringToGV(const char *str) {
@@ -1309,6 +3125,20 @@ static void emit_alias(tree decl, tree target) {
 
   GlobalValue::LinkageTypes Linkage = GetLinkageForAlias(decl);
 
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  if (lookup_attribute("ifunc", DECL_ATTRIBUTES(decl))) {
+    // An indirect function: the target is the resolver that returns the
+    // implementation to use.  This is also how GCC dispatches target_clones.
+    auto *GI = GlobalIFunc::create(V->getType()->getElementType(), 0,
+                                   Linkage, "", Aliasee, TheModule);
+    handleVisibility(decl, GI);
+
+    // Associate it with decl instead of V.
+    V->replaceAllUsesWith(ConstantExpr::getBitCast(GI, V->getType()));
+    changeLLVMConstant(V, GI);
+    GI->takeName(V);
+  } else
+#endif
   if (Linkage != GlobalValue::InternalLinkage && !IsWeakRef) {
     auto *GV = cast<GlobalValue>(Aliasee->stripPointerCasts());
     if (auto *GA = llvm::dyn_cast<GlobalAlias>(GV))
@@ -1374,6 +3204,272 @@ static void emit_varpool_aliases(struct varpool_node *node) {
 #endif
 }
 
+/// StreamGlobal - Try to output the initial value of a huge global variable
+/// directly as raw data, bypassing the creation of LLVM constants.  The data is
+/// written to a file next to the output file and the variable is defined by
+/// module level asm that includes it, leaving GV as a declaration.  Returns
+/// false, changing nothing, if the variable is not suitable for this, notably
+/// if the initial value contains addresses that would need relocating.
+static bool StreamGlobal(tree decl, GlobalVariable *GV) {
+#if (GCC_MAJOR > 4) && LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  // Only plain ELF definitions are output this way.  Aliases need a definition
+  // in the LLVM module to point to.
+  tree init = DECL_INITIAL(decl);
+  if (!isa<VAR_DECL>(decl) || !init || init == error_mark_node ||
+      DECL_WEAK(decl) || DECL_ONE_ONLY(decl) || DECL_COMDAT(decl) ||
+      DECL_THREAD_LOCAL_P(decl) || !isInt64(DECL_SIZE_UNIT(decl), true) ||
+      !Triple(TheModule->getTargetTriple()).isOSBinFormatELF() ||
+      !strcmp(llvm_asm_file_name, "-"))
+    return false;
+  uint64_t Size = getInt64(DECL_SIZE_UNIT(decl), true);
+  if (Size < StreamGlobalsThreshold || initializer_zerop(init))
+    return false;
+  if (varpool_node *vnode = varpool_node::get(decl))
+    if (vnode->has_aliases_p())
+      return false;
+  StringRef Name = GV->getName();
+  if (Name.startswith("\1"))
+    Name = Name.substr(1);
+  if (Name.empty() || !isRawInitializer(init, Size))
+    return false;
+
+  PhaseTimer Timer("LLVM streamed initializers");
+  std::string FileName = std::string(llvm_asm_file_name) + "." +
+                         utostr(SpilledInitializers.size()) + ".bin";
+  std::error_code EC;
+  raw_fd_ostream OS(FileName, EC, sys::fs::F_None);
+  if (!EC) {
+    WriteRawInitializer(init, Size, OS);
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      EC = std::make_error_code(std::errc::io_error);
+      sys::fs::remove(FileName);
+    }
+  }
+  if (EC) {
+    warning(0, G_("cannot write initial value of %qD to '%s': %s"), decl,
+            FileName.c_str(), EC.message().c_str());
+    return false;
+  }
+  SpilledInitializers.push_back(FileName);
+
+  // Define the variable, using the same section as the code generator would.
+  bool ReadOnly = TREE_READONLY(decl) && !TREE_SIDE_EFFECTS(decl);
+  std::string Section = DECL_SECTION_NAME(decl)
+                        ? std::string(DECL_SECTION_NAME(decl))
+                        : ReadOnly ? ".rodata" : ".data";
+  if (!DECL_SECTION_NAME(decl) && flag_data_sections)
+    Section += "." + Name.str();
+  std::string Asm;
+  raw_string_ostream AS(Asm);
+  AS << "\t.pushsection\t" << Section << ",\"a" << (ReadOnly ? "" : "w")
+     << "\",%progbits\n";
+  if (TREE_PUBLIC(decl)) {
+    AS << "\t.globl\t" << Name << "\n";
+    if (DECL_VISIBILITY(decl) == VISIBILITY_HIDDEN ||
+        DECL_VISIBILITY(decl) == VISIBILITY_INTERNAL)
+      AS << "\t.hidden\t" << Name << "\n";
+    else if (DECL_VISIBILITY(decl) == VISIBILITY_PROTECTED)
+      AS << "\t.protected\t" << Name << "\n";
+  }
+  AS << "\t.type\t" << Name << ",%object\n"
+     << "\t.size\t" << Name << ", " << Size << "\n"
+     << "\t.p2align\t" << Log2_32(DECL_ALIGN(decl) / 8) << "\n"
+     << Name << ":\n"
+     << "\t.incbin\t\"";
+  for (char C : FileName) {
+    if (C == '"' || C == '\\')
+      AS << '\\';
+    AS << C;
+  }
+  AS << "\"\n\t.popsection\n";
+  TheModule->appendModuleInlineAsm(AS.str());
+
+  // References to the variable from the rest of the module are to a symbol
+  // defined elsewhere, as far as LLVM knows.
+  GV->setInitializer(0);
+  GV->setLinkage(GlobalValue::ExternalLinkage);
+  handleVisibility(decl, GV);
+  return true;
+#else
+  return false;
+#endif
+}
+
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+/// getVTableAddress - If the given expression is the address of a point in a
+/// C++ virtual table, return the virtual table and set Offset to the offset in
+/// bytes of the point.  Otherwise return null.
+static tree getVTableAddress(tree exp, uint64_t &Offset) {
+  STRIP_NOPS(exp);
+  Offset = 0;
+  if (isa<POINTER_PLUS_EXPR>(exp)) {
+    if (!isInt64(TREE_OPERAND(exp, 1), true))
+      return NULL_TREE;
+    Offset = getInt64(TREE_OPERAND(exp, 1), true);
+    exp = TREE_OPERAND(exp, 0);
+    STRIP_NOPS(exp);
+  }
+  if (!isa<ADDR_EXPR>(exp) || !isa<VAR_DECL>(TREE_OPERAND(exp, 0)) ||
+      !DECL_VIRTUAL_P(TREE_OPERAND(exp, 0)))
+    return NULL_TREE;
+  return TREE_OPERAND(exp, 0);
+}
+
+/// getMangledClassName - Return the mangled name of the given C++ class, found
+/// from the name of its virtual table, or an empty string if it has none.
+static std::string getMangledClassName(tree type) {
+  if (!isa<RECORD_TYPE>(type))
+    return std::string();
+  tree binfo = TYPE_BINFO(TYPE_MAIN_VARIANT(type));
+  uint64_t Offset;
+  tree vtable =
+      binfo && BINFO_VTABLE(binfo) ? getVTableAddress(BINFO_VTABLE(binfo),
+                                                      Offset) : NULL_TREE;
+  if (!vtable)
+    return std::string();
+  StringRef Name = getAssemblerName(vtable);
+  return Name.startswith("_ZTV") ? Name.substr(4).str() : std::string();
+}
+
+/// getVTableTypeId - Return the identifier that type metadata uses for the
+/// given C++ class, or null if the class has no virtual table.  This is the
+/// mangled name of its type_info name, as used by clang.
+Metadata *getVTableTypeId(tree type) {
+  std::string Name = getMangledClassName(type);
+  if (Name.empty())
+    return 0;
+  return MDString::get(TheModule->getContext(), "_ZTS" + Name);
+}
+
+/// AddTypeMetadata - Record that the given offset into a virtual table is the
+/// address point for the given class.
+static void AddTypeMetadata(GlobalVariable *GV, uint64_t Offset, tree type) {
+  Metadata *TypeId = getVTableTypeId(type);
+  if (!TypeId)
+    return;
+  LLVMContext &Context = GV->getContext();
+  Metadata *Ops[] = { ConstantAsMetadata::get(ConstantInt::get(
+                          Type::getInt64Ty(Context), Offset)),
+                      TypeId };
+  GV->addMetadata(LLVMContext::MD_type, *MDNode::get(Context, Ops));
+}
+
+/// AddVTableTypes - Add type metadata to the virtual table of a class for the
+/// class and for each of its bases, at the address points that their virtual
+/// table pointers are set to.
+static void AddVTableTypes(tree binfo, tree vtable, GlobalVariable *GV,
+                           SmallPtrSet<tree, 8> &Visited) {
+  if (!Visited.insert(binfo).second)
+    return; // A virtual base seen already.
+  uint64_t Offset;
+  if (BINFO_VTABLE(binfo) &&
+      getVTableAddress(BINFO_VTABLE(binfo), Offset) == vtable)
+    AddTypeMetadata(GV, Offset, BINFO_TYPE(binfo));
+  for (unsigned i = 0, e = BINFO_N_BASE_BINFOS(binfo); i != e; ++i)
+    AddVTableTypes(BINFO_BASE_BINFO(binfo, i), vtable, GV, Visited);
+}
+
+/// findBinfo - Return the base of the given class hierarchy which is of the
+/// class with the given mangled name and lies at the given offset.
+static tree findBinfo(tree binfo, const std::string &Name, uint64_t Offset) {
+  if (getInt64(BINFO_OFFSET(binfo), true) == Offset &&
+      getMangledClassName(BINFO_TYPE(binfo)) == Name)
+    return binfo;
+  for (unsigned i = 0, e = BINFO_N_BASE_BINFOS(binfo); i != e; ++i)
+    if (tree found = findBinfo(BINFO_BASE_BINFO(binfo, i), Name, Offset))
+      return found;
+  return NULL_TREE;
+}
+
+/// AddTypesAtOffset - Add type metadata for the classes in the given hierarchy
+/// that have a virtual table pointer at the given offset.
+static void AddTypesAtOffset(tree binfo, uint64_t ObjectOffset, tree vtable,
+                             uint64_t Offset, SmallPtrSet<tree, 8> &Visited) {
+  if (!Visited.insert(binfo).second)
+    return;
+  if (BINFO_VTABLE(binfo) &&
+      getInt64(BINFO_OFFSET(binfo), true) == ObjectOffset)
+    AddTypeMetadata(cast<GlobalVariable>(DECL_LLVM(vtable)), Offset,
+                    BINFO_TYPE(binfo));
+  for (unsigned i = 0, e = BINFO_N_BASE_BINFOS(binfo); i != e; ++i)
+    AddTypesAtOffset(BINFO_BASE_BINFO(binfo, i), ObjectOffset, vtable, Offset,
+                     Visited);
+}
+
+/// AddConstructionVTableTypes - While a base with virtual bases is being built,
+/// virtual table pointers point into construction virtual tables, which hold
+/// the virtual functions of the base but allow for where the virtual bases are
+/// in the complete object.  Every such address point is in the VTT, so go through it and add
+/// type metadata to the construction virtual tables for the classes at each.
+static void AddConstructionVTableTypes(tree vtt) {
+  tree type = DECL_CONTEXT(vtt);
+  std::string ClassName = getMangledClassName(type);
+  tree init = DECL_INITIAL(vtt);
+  if (ClassName.empty() || !init || !isa<CONSTRUCTOR>(init))
+    return;
+  std::string Prefix = "_ZTC" + ClassName;
+
+  unsigned HOST_WIDE_INT ix;
+  tree elt_index, value;
+  FOR_EACH_CONSTRUCTOR_ELT(CONSTRUCTOR_ELTS(init), ix, elt_index, value) {
+    // Construction virtual tables are named _ZTC <class> <offset> _ <base>,
+    // where the offset is that of the base being built.
+    uint64_t Offset;
+    tree vtable = getVTableAddress(value, Offset);
+    if (!vtable)
+      continue;
+    StringRef Name = getAssemblerName(vtable);
+    if (!Name.startswith(Prefix))
+      continue;
+    char *End;
+    uint64_t BaseOffset = strtoull(Name.data() + Prefix.size(), &End, 10);
+    if (*End != '_')
+      continue;
+    tree base = findBinfo(TYPE_BINFO(TYPE_MAIN_VARIANT(type)), End + 1,
+                          BaseOffset);
+    if (!base)
+      continue;
+
+    // The address point is preceded by the offset from the virtual table
+    // pointer to the start of the base, then by the RTTI pointer.
+    tree vinit = DECL_INITIAL(vtable);
+    tree eltype = TREE_TYPE(TREE_TYPE(vtable));
+    if (!vinit || !isa<CONSTRUCTOR>(vinit) ||
+        !isInt64(TYPE_SIZE_UNIT(eltype), true))
+      continue;
+    uint64_t EltSize = getInt64(TYPE_SIZE_UNIT(eltype), true);
+    uint64_t Elt = Offset / EltSize;
+    if (Offset % EltSize || Elt < 2 || Elt - 2 >= CONSTRUCTOR_NELTS(vinit))
+      continue;
+    tree offset_to_top = CONSTRUCTOR_ELT(vinit, Elt - 2)->value;
+    STRIP_NOPS(offset_to_top);
+    if (!isa<INTEGER_CST>(offset_to_top))
+      continue;
+    uint64_t ObjectOffset =
+        BaseOffset - (int64_t)TREE_INT_CST_LOW(offset_to_top);
+    SmallPtrSet<tree, 8> Visited;
+    AddTypesAtOffset(base, ObjectOffset, vtable, Offset, Visited);
+  }
+}
+
+/// AddVTableTypeMetadata - Describe the given C++ virtual table or VTT using
+/// type metadata, so that LLVM can tell which virtual functions virtual calls
+/// might go to.
+static void AddVTableTypeMetadata(tree decl, GlobalVariable *GV) {
+  StringRef Name = getAssemblerName(decl);
+  if (Name.startswith("_ZTT")) {
+    AddConstructionVTableTypes(decl);
+  } else if (Name.startswith("_ZTV") &&
+             isa<RECORD_TYPE>(DECL_CONTEXT(decl)) &&
+             TYPE_BINFO(DECL_CONTEXT(decl))) {
+    SmallPtrSet<tree, 8> Visited;
+    AddVTableTypes(TYPE_BINFO(DECL_CONTEXT(decl)), decl, GV, Visited);
+  }
+}
+#endif
+
 /// emit_global - Emit the specified VAR_DECL or aggregate CONST_DECL to LLVM as
 /// a global variable.  This function implements the end of assemble_variable.
 static void emit_global(tree decl) {
@@ -1390,11 +3486,22 @@ static void emit_global(tree decl) {
   if (!TYPE_SIZE(TREE_TYPE(decl)))
     return;
 
-  //TODO  timevar_push(TV_LLVM_GLOBALS);
+  PhaseTimer Timer("LLVM global variables",
+                   TraceFileName ? getDescriptiveName(decl) : std::string());
+  ++NumGlobalsEmitted;
 
   // Get or create the global variable now.
   GlobalVariable *GV = cast<GlobalVariable>(DECL_LLVM(decl));
 
+  // Output huge tables of data without turning them into LLVM constants first.
+  // No debug info is generated for them.
+  if (StreamGlobalsThreshold && StreamGlobal(decl, GV)) {
+#if GCC_VERSION_CODE < GCC_VERSION(4, 8)
+    TREE_ASM_WRITTEN(decl) = 1;
+#endif
+    return;
+  }
+
   // Convert the initializer over.
   Constant *Init;
   if (DECL_INITIAL(decl) == 0 || DECL_INITIAL(decl) == error_mark_node) {
@@ -1409,7 +3516,18 @@ static void emit_global(tree decl) {
     // When constructing the initializer it might refer to itself.
     // This can happen for things like void *G = &G;
     GV->setInitializer(UndefValue::get(GV->getType()->getElementType()));
-    Init = ConvertInitializer(DECL_INITIAL(decl));
+    Init = 0;
+    // Huge tables of plain data are snapshotted as bytes in one go, rather than
+    // creating a constant for every element.
+    if (FlatInitializersThreshold && isa<VAR_DECL>(decl) &&
+        isInt64(DECL_SIZE_UNIT(decl), true)) {
+      uint64_t Size = getInt64(DECL_SIZE_UNIT(decl), true);
+      if (Size >= FlatInitializersThreshold &&
+          isRawInitializer(DECL_INITIAL(decl), Size))
+        Init = ConvertRawInitializer(DECL_INITIAL(decl), Size);
+    }
+    if (!Init)
+      Init = ConvertInitializer(DECL_INITIAL(decl));
   }
 
   // Set the initializer.
@@ -1427,8 +3545,17 @@ static void emit_global(tree decl) {
     GV->removeFromParent();
     GlobalVariable *NGV =
         new GlobalVariable(*TheModule, Init->getType(), GV->isConstant(),
-                           GlobalValue::ExternalLinkage, 0, GV->getName());
+                           GlobalValue::ExternalLinkage, 0, GV->getName(), 0,
+                           GV->getThreadLocalMode(),
+                           GV->getType()->getAddressSpace());
     NGV->setInitializer(Init);
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+    // Keep any type metadata added while outputting a VTT.
+    SmallVector<MDNode *, 4> Types;
+    GV->getMetadata(LLVMContext::MD_type, Types);
+    for (MDNode *MD : Types)
+      NGV->addMetadata(LLVMContext::MD_type, *MD);
+#endif
     GV->replaceAllUsesWith(TheFolder->CreateBitCast(NGV, GV->getType()));
     changeLLVMConstant(GV, NGV);
     SET_DECL_LLVM(decl, NGV);
@@ -1490,6 +3617,12 @@ static void emit_global(tree decl) {
 
   handleVisibility(decl, GV);
 
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  // Describe C++ virtual tables, for devirtualization at link time.
+  if (flag_whole_program_vtables && isa<VAR_DECL>(decl) && DECL_VIRTUAL_P(decl))
+    AddVTableTypeMetadata(decl, GV);
+#endif
+
   // Set the section for the global.
   if (isa<VAR_DECL>(decl)) {
     if (DECL_SECTION_NAME(decl)) {
@@ -1570,8 +3703,6 @@ static void emit_global(tree decl) {
 #endif
         )
       emit_varpool_aliases(vnode);
-
-  //TODO  timevar_pop(TV_LLVM_GLOBALS);
 }
 
 /// ValidateRegisterVariable - Check that a static "asm" variable is
@@ -1656,9 +3787,9 @@ Value *make_decl_llvm(tree decl) {
     return NULL;
   }
 
-  //TODO  timevar_push(TV_LLVM_GLOBALS);
+  PhaseTimer Timer("LLVM global variables");
 
-  std::string Name;
+  StringRef Name;
   if (!isa<CONST_DECL>(decl)) // CONST_DECLs do not have assembler names.
     Name = getAssemblerName(decl);
 
@@ -1667,7 +3798,7 @@ Value *make_decl_llvm(tree decl) {
   if (!Name.empty() && Name[0] == 1) {
 #ifdef REGISTER_PREFIX
     if (strlen(REGISTER_PREFIX) != 0) {
-      int reg_number = decode_reg_name(Name.c_str());
+      int reg_number = decode_reg_name(Name.data());
       if (reg_number >= 0 || reg_number == -3)
         error("register name given for non-register variable %q+D", decl);
     }
@@ -1743,6 +3874,8 @@ Value *make_decl_llvm(tree decl) {
     assert((isa<VAR_DECL>(decl) || isa<CONST_DECL>(decl)) &&
            "Not a function or var decl?");
     Type *Ty = ConvertType(TREE_TYPE(decl));
+    // Place the global in the address space its type is qualified with.
+    unsigned AS = getAddressSpace(TREE_TYPE(decl));
     GlobalVariable *GV;
 
     // If we have "extern void foo", make the global have type {} instead of
@@ -1752,7 +3885,8 @@ Value *make_decl_llvm(tree decl) {
 
     if (Name.empty()) { // Global has no name.
       GV = new GlobalVariable(*TheModule, Ty, false,
-                              GlobalValue::ExternalLinkage, 0, "");
+                              GlobalValue::ExternalLinkage, 0, "", 0,
+                              GlobalVariable::NotThreadLocal, AS);
 
       // Check for external weak linkage.
       if (DECL_EXTERNAL(decl) && DECL_WEAK(decl))
@@ -1770,7 +3904,8 @@ Value *make_decl_llvm(tree decl) {
 
       if (GVE == 0) {
         GV = new GlobalVariable(*TheModule, Ty, false,
-                                GlobalValue::ExternalLinkage, 0, Name);
+                                GlobalValue::ExternalLinkage, 0, Name, 0,
+                                GlobalVariable::NotThreadLocal, AS);
 
         // Check for external weak linkage.
         if (DECL_EXTERNAL(decl) && DECL_WEAK(decl))
@@ -1858,7 +3993,6 @@ Value *make_decl_llvm(tree decl) {
 
     return SET_DECL_LLVM(decl, GV);
   }
-  //TODO  timevar_pop(TV_LLVM_GLOBALS);
 }
 
 /// make_definition_llvm - Ensures that the body or initial value of the given
@@ -1887,8 +4021,10 @@ Value *make_definition_llvm(tree decl) {
 /// Fn is a 'void()' ctor/dtor function to be run, initprio is the init
 /// priority, and isCtor indicates whether this is a ctor or dtor.
 void register_ctor_dtor(Function *Fn, int InitPrio, bool isCtor) {
-  (isCtor ? &StaticCtors : &StaticDtors)
-      ->push_back(std::make_pair(Fn, InitPrio));
+  std::vector<std::pair<Constant *, int> > &Tors =
+      isCtor ? StaticCtors : StaticDtors;
+  StructorIndex[Fn].push_back(2 * Tors.size() + !isCtor);
+  Tors.push_back(std::make_pair(Fn, InitPrio));
 }
 
 /// extractRegisterName - Get a register name given its decl. In 4.2 unlike 4.0
@@ -1905,10 +4041,18 @@ static void FinalizePlugin(void) {
   if (Finalized)
     return;
 
+  if (FunctionTimeReport)
+    PrintFunctionReport();
+
 #ifndef NDEBUG
   delete PerModulePasses;
   delete PerFunctionPasses;
+  for (auto &I : PerLevelFunctionPasses)
+    delete I.second;
   delete CodeGenPasses;
+#if LLVM_VERSION_CODE > LLVM_VERSION(4, 0)
+  delete NewPM;
+#endif
   delete TheModule;
   llvm_shutdown();
 #endif
@@ -1973,27 +4117,40 @@ int plugin_is_GPL_compatible __attribute__((visibility("default")));
 /// before processing the compilation unit.
 /// NOTE: called even when only doing syntax checking, so do not initialize the
 /// module etc here.
+/// llvm_ggc_start - Called before the garbage collector runs.
+static void llvm_ggc_start(void * /*gcc_data*/, void * /*user_data*/) {
+  flushFrontCaches();
+  flushFunctionTypeCache();
+  flushRecordLayouts();
+  flushAddressCache();
+}
+
 static void llvm_start_unit(void */*gcc_data*/, void */*user_data*/) {
 #ifdef DRAGONEGG_DEBUG
   printf("DEBUG: %s, line %d: %s\n", __FILE__, __LINE__, __func__);
 #endif
   if (!quiet_flag)
     errs() << "Starting compilation unit\n";
+  PhaseTimer Timer("LLVM start unit");
 
 #ifdef ENABLE_LTO
-  // Output LLVM IR if the user requested generation of lto data.
-  EmitIR |= flag_generate_lto != 0;
-  // We have the same needs as GCC's LTO.  Always claim to be doing LTO.
+  // The partitions compiled by lto1 after GCC's whole program analysis are
+  // turned into code as usual.
+  if (!InLTRANS) {
+    // Output LLVM IR if the user requested generation of lto data.
+    EmitIR |= flag_generate_lto != 0;
+    // We have the same needs as GCC's LTO.  Always claim to be doing LTO.
 #if (GCC_MAJOR < 5)
-  flag_lto =
+    flag_lto =
 #if GCC_VERSION_CODE > GCC_VERSION(4, 5)
-      "";
+        "";
 #else
-  1;
+    1;
 #endif
 #endif
-  flag_generate_lto = 1;
-  flag_whole_program = 0;
+    flag_generate_lto = 1;
+    flag_whole_program = 0;
+  }
 #endif
 
   // Stop GCC outputting serious amounts of debug info.
@@ -2015,6 +4172,8 @@ static void llvm_start_unit(void */*gcc_data*/, void */*user_data*/) {
   // versions to be inserted into the final assembler.
   targetm.asm_out.output_ident = output_ident;
 #endif
+
+  RecordMemoryUsage("start unit");
 }
 
 /// emit_cgraph_aliases - Output any aliases associated with the given cgraph
@@ -2053,18 +4212,117 @@ static void emit_cgraph_aliases(struct cgraph_node *node) {
 #endif
 }
 
+/// RunPerFunctionPasses - Run the per-function passes on the given function,
+/// using the pass manager for its optimization level.
+static void RunPerFunctionPasses(Function &F) {
+  PhaseTimer Timer("LLVM per-function optimization",
+                   TraceFileName ? F.getName().str() : std::string());
+  double Start = FunctionTimeReport ? getWallTime() : 0;
+  DenseMap<const Function *, FunctionOptLevel>::iterator L =
+      FunctionOptLevels.find(&F);
+#if LLVM_VERSION_CODE > LLVM_VERSION(4, 0)
+  if (NewPM) {
+    FunctionOptLevel Level = L != FunctionOptLevels.end()
+                                 ? L->second
+                                 : getFunctionOptLevel(NULL_TREE);
+    getNewFunctionPassManager(Level).run(F, NewPM->FAM);
+    // Don't hold on to the analyses of every function until the module level
+    // optimizers run.
+    NewPM->FAM.invalidate(F, PreservedAnalyses::none());
+  } else {
+#else
+  {
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+    legacy::FunctionPassManager *PM = PerFunctionPasses;
+#else
+    FunctionPassManager *PM = PerFunctionPasses;
+#endif
+    if (L != FunctionOptLevels.end()) {
+      PM = PerLevelFunctionPasses[L->second];
+      if (!PM) {
+        PM = PerLevelFunctionPasses[L->second] =
+            CreateFunctionPassManager(L->second);
+        PM->doInitialization();
+      }
+    }
+    PM->run(F);
+  }
+  if (FunctionTimeReport) {
+    DenseMap<const Function *, unsigned>::iterator I =
+        FunctionReportIndex.find(&F);
+    if (I != FunctionReportIndex.end()) {
+      FunctionStats &S = FunctionReport[I->second];
+      S.OptimizeTime += getWallTime() - Start;
+      S.InstsAfter = CountInstructions(F);
+    }
+  }
+}
+
+/// CanRunPerFunctionPassesEarly - Whether the per-function passes can be run on
+/// each function as soon as it has been converted, rather than on all of them
+/// once the compilation unit is complete.  Doing it early means that only one
+/// unoptimized function body is around at a time.
+static bool CanRunPerFunctionPassesEarly() {
+#if LLVM_VERSION_CODE > LLVM_VERSION(4, 0)
+  if (NewPM)
+    return !TheDebugInfo;
+#endif
+  if (!PerFunctionPasses)
+    return false;
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  // Debug info metadata is only complete once it has been finalized at the end
+  // of the compilation unit, and until then the verifier rejects it.
+  if (TheDebugInfo)
+    return false;
+#endif
+  return true;
+}
+
 /// emit_current_function - Turn the current gimple function into LLVM IR.  This
 /// is called once for each function in the compilation unit.
 static void emit_current_function() {
   if (!quiet_flag && DECL_NAME(current_function_decl))
     errs() << getDescriptiveName(current_function_decl);
 
+  // Look at the loops before conversion, which may not preserve them.
+  bool Loopy = AutoIROptLevel && isLoopHeavy();
+
   // Convert the AST to raw/ugly LLVM code.
   Function *Fn;
+  double Start = FunctionTimeReport ? getWallTime() : 0;
+  unsigned BuiltinsCalled = getConversionStatistics().BuiltinsCalled;
   {
+    PhaseTimer Timer("LLVM gimple to IR conversion",
+                     TraceFileName ? getDescriptiveName(current_function_decl)
+                                   : std::string());
     TreeToLLVM Emitter(current_function_decl);
     Fn = Emitter.EmitFunction();
   }
+  ++NumFunctionsEmitted;
+
+  // Remember if the function has its own optimization level.
+  FunctionOptLevel Level = getFunctionOptLevel(current_function_decl);
+  if (Loopy && Level.first > 0) {
+    Level.first = 3;
+    SawLoopHeavyFunction = true;
+  }
+  if (Level != getFunctionOptLevel(NULL_TREE))
+    FunctionOptLevels[Fn] = Level;
+
+  if (FunctionTimeReport) {
+    FunctionStats S;
+    S.Name = Fn->getName().str();
+    S.InstsBefore = S.InstsAfter = CountInstructions(*Fn);
+    S.ConvertTime = getWallTime() - Start;
+    S.OptimizeTime = 0;
+    FunctionReportIndex[Fn] = FunctionReport.size();
+    FunctionReport.push_back(S);
+  }
+
+  if (IRLint && StatsFileName)
+    LintFunction(*Fn,
+                 getConversionStatistics().BuiltinsCalled - BuiltinsCalled);
 
   // Output any associated aliases.
 #if (GCC_MAJOR > 4)
@@ -2073,17 +4331,17 @@ static void emit_current_function() {
   emit_cgraph_aliases(cgraph_get_node(current_function_decl));
 #endif
 
-  if (!errorcount && !sorrycount) { // Do not process broken code.
+  // Do not process broken code, or code that is only being converted.
+  if (!errorcount && !sorrycount && !ConvertOnly) {
     createPerFunctionOptimizationPasses();
 
-    if (PerFunctionPasses) {
+    if (CanRunPerFunctionPassesEarly()) {
 #ifdef DRAGONEGG_DEBUG
       printf("DEBUG: %s, line %d: %s: %s\n", __FILE__, __LINE__, __func__,
               Fn->getName().str().c_str());
 #endif
-#if LLVM_VERSION_CODE < LLVM_VERSION(3, 9)
-      PerFunctionPasses->run(*Fn);
-#endif
+      RunPerFunctionPasses(*Fn);
+      SimplifiedFunctions.insert(Fn);
     }
 
     // TODO: Nuke the .ll code for the function at -O[01] if we don't want to
@@ -2095,7 +4353,10 @@ static void emit_current_function() {
 /// once for each function in the compilation unit if GCC optimizations are
 /// enabled.
 static unsigned int rtl_emit_function(void) {
-  if (!errorcount && !sorrycount) {
+  if (UnreachableFunctions.count(current_function_decl)) {
+    // Nothing can refer to this function, so don't bother converting it.
+    ++NumFunctionsPruned;
+  } else if (!errorcount && !sorrycount) {
     InitializeBackend();
     // Convert the function.
     emit_current_function();
@@ -2115,8 +4376,37 @@ static unsigned int rtl_emit_function(void) {
 #endif
 #endif
 
+#if (GCC_MAJOR > 4)
+  // Nothing needs the gimple body once the function has been converted, so
+  // release it now rather than leaving it to cgraph after the rest of the
+  // (disabled) passes.  The garbage collection at the end of this pass can
+  // then reclaim it, instead of the body staying around until the next
+  // function's passes.  This does what release_function_body does except
+  // that the function itself is kept, as the pass manager is still using it.
+  if (loops_for_fn(cfun)) {
+    cfun->curr_properties &= ~PROP_loops;
+    loop_optimizer_finalize();
+  }
+  if (cfun->gimple_df)
+    delete_tree_ssa(cfun);
+  if (cfun->cfg) {
+    clear_edges(cfun);
+    cfun->cfg = NULL;
+    cfun->curr_properties &= ~PROP_cfg;
+  }
+  gimple_set_body(current_function_decl, NULL);
+#endif
+
   // Finally, we have written out this function!
   TREE_ASM_WRITTEN(current_function_decl) = 1;
+
+  // Give GCC a chance to collect garbage once every GCBatch functions.  It only
+  // actually collects if its heap has grown enough since the last time, but
+  // even deciding that has a cost when there are many small functions.
+  if (++FunctionsSinceGC >= GCBatch) {
+    FunctionsSinceGC = 0;
+    ggc_collect();
+  }
   return 0;
 }
 
@@ -2137,7 +4427,7 @@ static struct rtl_opt_pass pass_rtl_emit_function = { {
   0,                                     /* properties_provided */
   PROP_ssa | PROP_trees,                 /* properties_destroyed */
   TODO_verify_ssa | TODO_verify_flow | TODO_verify_stmts, /* todo_flags_start */
-  TODO_ggc_collect /* todo_flags_finish */
+  0 /* todo_flags_finish */
 } };
 #else
 const pass_data pass_data_rtl_emit_function = {
@@ -2153,7 +4443,7 @@ const pass_data pass_data_rtl_emit_function = {
   0,                                     /* properties_provided */
   PROP_ssa | PROP_trees,                 /* properties_destroyed */
   0,                                     /* todo_flags_start */
-  0,                                     /* todo_flags_finish */
+  TODO_do_not_ggc_collect,               /* todo_flags_finish */
 };
 
 class pass_rtl_emit_function : public rtl_opt_pass {
@@ -2242,6 +4532,52 @@ static void emit_varpool_weakrefs() {
 INSTANTIATE_VECTOR(alias_pair);
 #endif
 
+#if (GCC_MAJOR > 4)
+/// FindUnreachableFunctions - Work out which functions can never be referred to
+/// by walking the call graph and the references from everything that has to be
+/// output, and fill in UnreachableFunctions.
+static void FindUnreachableFunctions() {
+  // Aliases that are not represented in cgraph or varpool may refer to any
+  // function, so play safe.
+  if (alias_pairs && alias_pairs->length())
+    return;
+
+  SmallPtrSet<symtab_node *, 64> Reachable;
+  SmallVector<symtab_node *, 64> Worklist;
+
+  struct cgraph_node *node;
+  FOR_EACH_FUNCTION(node)
+    if (node->definition &&
+        (!node->can_remove_if_no_direct_calls_and_refs_p() ||
+         DECL_STATIC_CONSTRUCTOR(node->decl) ||
+         DECL_STATIC_DESTRUCTOR(node->decl)) &&
+        Reachable.insert(node).second)
+      Worklist.push_back(node);
+  struct varpool_node *vnode;
+  FOR_EACH_VARIABLE(vnode)
+    if (!vnode->can_remove_if_no_refs_p() && Reachable.insert(vnode).second)
+      Worklist.push_back(vnode);
+
+  while (!Worklist.empty()) {
+    symtab_node *N = Worklist.pop_back_val();
+    struct ipa_ref *ref;
+    for (unsigned i = 0; N->iterate_reference(i, ref); i++)
+      if (Reachable.insert(ref->referred).second)
+        Worklist.push_back(ref->referred);
+    if (N->type != SYMTAB_FUNCTION)
+      continue;
+    for (struct cgraph_edge *e = static_cast<cgraph_node *>(N)->callees; e;
+         e = e->next_callee)
+      if (Reachable.insert(e->callee).second)
+        Worklist.push_back(e->callee);
+  }
+
+  FOR_EACH_FUNCTION(node)
+    if (node->definition && !node->alias && !Reachable.count(node))
+      UnreachableFunctions.insert(node->decl);
+}
+#endif
+
 /// llvm_emit_globals - Output GCC global variables, aliases and asm's to the
 /// LLVM IR.
 static void llvm_emit_globals(void * /*gcc_data*/, void * /*user_data*/) {
@@ -2253,6 +4589,37 @@ static void llvm_emit_globals(void * /*gcc_data*/, void * /*user_data*/) {
 
   InitializeBackend();
 
+  // The call graph is now complete, so the number of declarations that will be
+  // given an LLVM value is known roughly.  Size the cache for them up front.
+  {
+    unsigned NumDecls = 0;
+    struct cgraph_node *node;
+    FOR_EACH_FUNCTION(node)
+      ++NumDecls;
+    struct varpool_node *vnode;
+    FOR_EACH_VARIABLE(vnode)
+      ++NumDecls;
+    reserveDeclCache(NumDecls);
+    if (TheDebugInfo)
+      TheDebugInfo->reserveCaches(NumDecls);
+  }
+
+#if (GCC_MAJOR > 4)
+  // Work out which functions can be skipped before any are output.
+  if (PruneFunctions)
+    FindUnreachableFunctions();
+
+  // Trampolines that are only used to call nested functions are not set up,
+  // which can only be known once every function using them has been seen.
+  {
+    struct cgraph_node *node;
+    FOR_EACH_FUNCTION(node)
+      if (node->has_gimple_body_p() && DECL_STRUCT_FUNCTION(node->decl) &&
+          DECL_STRUCT_FUNCTION(node->decl)->cfg)
+        NoteTrampolineUses(DECL_STRUCT_FUNCTION(node->decl));
+  }
+#endif
+
   // Emit any file-scope asms.
   emit_file_scope_asms();
 
@@ -2318,9 +4685,14 @@ static void llvm_emit_globals(void * /*gcc_data*/, void * /*user_data*/) {
   }
 }
 
+/// InlineAsmDiagnosticHandler - Report a problem found by the code generator
+/// or the integrated assembler in inline asm as a GCC diagnostic.
 static void InlineAsmDiagnosticHandler(const SMDiagnostic &D, void */*Data*/,
                                        location_t loc) {
   std::string S = D.getMessage().str(); // Ensure Message is not dangling.
+  // File-scope asm has no location, so quote the offending line instead.
+  if (loc == UNKNOWN_LOCATION && !D.getLineContents().empty())
+    S += " in asm '" + D.getLineContents().trim().str() + "'";
   const char *Message = S.c_str();
   switch (D.getKind()) {
   case SourceMgr::DK_Error:
@@ -2335,17 +4707,702 @@ static void InlineAsmDiagnosticHandler(const SMDiagnostic &D, void */*Data*/,
   }
 }
 
-/// llvm_finish_unit - Finish the .s file.  This is called by GCC once the
-/// compilation unit has been completely processed.
-static void llvm_finish_unit(void */*gcc_data*/, void */*user_data*/) {
-  if (errorcount || sorrycount)
-    return; // Do not process broken code.
+/// AddToCompilerUsed - Add the given global to llvm.compiler.used, so that the
+/// code generator outputs it even though nothing refers to it.
+static void AddToCompilerUsed(GlobalValue *GV) {
+  LLVMContext &Context = TheModule->getContext();
+  Type *SBP = Type::getInt8PtrTy(Context);
+
+  std::vector<Constant *> Used;
+  if (GlobalVariable *Old = TheModule->getNamedGlobal("llvm.compiler.used")) {
+    if (ConstantArray *Init = dyn_cast<ConstantArray>(Old->getInitializer()))
+      for (unsigned i = 0, e = Init->getNumOperands(); i != e; ++i)
+        Used.push_back(Init->getOperand(i));
+    Old->eraseFromParent();
+  }
+  Used.push_back(TheFolder->CreateBitCast(GV, SBP));
+
+  ArrayType *AT = ArrayType::get(SBP, Used.size());
+  GlobalVariable *New =
+      new GlobalVariable(*TheModule, AT, false, GlobalValue::AppendingLinkage,
+                         ConstantArray::get(AT, Used), "llvm.compiler.used");
+  New->setSection("llvm.metadata");
+}
+
+/// EmbedModuleBitcode - Put a copy of the optimized module, as bitcode, in a
+/// section of the output.  The object file can then be linked as usual, or the
+/// bitcode extracted from it and used for link time optimization.
+static void EmbedModuleBitcode() {
+  std::string Bitcode;
+  raw_string_ostream OS(Bitcode);
+  WriteBitcodeToFile(TheModule, OS);
+  OS.flush();
+
+  Constant *Data =
+      ConstantDataArray::getString(TheModule->getContext(), Bitcode, false);
+  GlobalVariable *GV =
+      new GlobalVariable(*TheModule, Data->getType(), true,
+                         GlobalValue::PrivateLinkage, Data,
+                         "llvm.embedded.module");
+  // Use the same section as clang's -fembed-bitcode, so that existing tools
+  // know where to find it.
+  GV->setSection(Triple(TheModule->getTargetTriple()).isOSDarwin()
+                     ? "__LLVM,__bitcode"
+                     : ".llvmbc");
+  GV->setAlignment(1);
+  AddToCompilerUsed(GV);
+}
+
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8) && \
+    GCC_VERSION_CODE > GCC_VERSION(4, 5)
+/// isCacheNeutralOption - Whether the given GCC command line option makes no
+/// difference to the output, so should not be part of the cache key.
+static bool isCacheNeutralOption(StringRef Opt) {
+  // Options naming output and dump files.
+  if (Opt.startswith("-o") || Opt.startswith("-dumpbase") ||
+      Opt.startswith("-dumpdir") || Opt.startswith("-auxbase"))
+    return true;
+  // Plugin options which only control reporting, or the cache itself.
+  if (Opt.startswith("-fplugin-arg-"))
+    return Opt.find("-cache-dir=") != StringRef::npos ||
+           Opt.find("-stats-file=") != StringRef::npos ||
+           Opt.endswith("-function-time-report");
+  return false;
+}
+
+/// HashString - Add the given string to the hash, followed by a separator.
+static void HashString(MD5 &Hash, StringRef Str) {
+  Hash.update(Str);
+  Hash.update(StringRef("", 1));
+}
+
+/// ComputeCacheKey - Return a hash of everything that determines the output for
+/// the given module, which is passed as bitcode: the module itself, the target,
+/// the compiler versions and the options.
+static std::string ComputeCacheKey(StringRef Bitcode) {
+  MD5 Hash;
+
+  // Another version of LLVM, GCC or the plugin changes the key, since its
+  // output may differ.  Rebuilding the same sources does not.
+  HashString(Hash, LLVM_VERSION_STRING);
+  HashString(Hash, version_string);
+#ifdef DRAGONEGG_REVISION
+  HashString(Hash, DRAGONEGG_REVISION);
+#endif
+
+  HashString(Hash, TheTarget->getTargetTriple().str());
+  HashString(Hash, TheTarget->getTargetCPU());
+  HashString(Hash, TheTarget->getTargetFeatureString());
+  HashString(Hash, LLVMOptions);
+
+  // The GCC options, which include any options given to the plugin.
+  for (unsigned i = 0; i != save_decoded_options_count; ++i) {
+    const cl_decoded_option &Opt = save_decoded_options[i];
+    if (Opt.opt_index == OPT_SPECIAL_input_file ||
+        isCacheNeutralOption(Opt.orig_option_with_args_text))
+      continue;
+    HashString(Hash, Opt.orig_option_with_args_text);
+  }
+
+  HashString(Hash, Bitcode);
+
+  MD5::MD5Result Result;
+  Hash.final(Result);
+  SmallString<32> Key;
+  MD5::stringifyResult(Result, Key);
+  return Key.str().str();
+}
+
+/// getCacheFileName - The name of the file in CacheDir holding the output with
+/// the given key.
+static std::string getCacheFileName(StringRef Key, StringRef Suffix) {
+  return (Twine(CacheDir) + "/" + Key + Suffix).str();
+}
+
+/// WriteCacheFile - Store the given data in the cache under the given name.
+/// The data is written under a temporary name and then renamed, so that
+/// concurrent compiles never see a partial file.
+static void WriteCacheFile(const std::string &Name, StringRef Data) {
+  int FD;
+  SmallString<128> TempName;
+  std::error_code EC = sys::fs::create_directories(CacheDir);
+  if (!EC)
+    EC = sys::fs::createUniqueFile(Name + "-%%%%%%", FD, TempName);
+  if (!EC) {
+    raw_fd_ostream OS(FD, /*shouldClose*/ true);
+    OS << Data;
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      EC = std::make_error_code(std::errc::io_error);
+    }
+    if (!EC)
+      EC = sys::fs::rename(TempName, Name);
+    if (EC)
+      sys::fs::remove(TempName);
+  }
+  if (EC)
+    warning(0, G_("cannot write to the cache directory '%s': %s"), CacheDir,
+            EC.message().c_str());
+}
+
+/// LoadCachedOutput - If the output for the compilation unit is in the cache,
+/// write it to the output file and return true.  Otherwise arrange for the
+/// output to be stored once it has been generated and return false.
+static bool LoadCachedOutput() {
+  // Output that is not going to a file cannot be cached.
+  if (!strcmp(llvm_asm_file_name, "-"))
+    return false;
+
+  std::string Bitcode;
+  raw_string_ostream OS(Bitcode);
+  WriteBitcodeToFile(TheModule, OS);
+  std::string Key = ComputeCacheKey(OS.str());
+
+  ErrorOr<std::unique_ptr<MemoryBuffer> > Cached =
+      MemoryBuffer::getFile(getCacheFileName(Key, ".out"));
+  if (!Cached) {
+    CacheKey = Key;
+    return false;
+  }
+
+  *FormattedOutStream << (*Cached)->getBuffer();
+  return true;
+}
+
+/// SaveCachedOutput - Copy the output file for the compilation unit into the
+/// cache.
+static void SaveCachedOutput() {
+  ErrorOr<std::unique_ptr<MemoryBuffer> > Output =
+      MemoryBuffer::getFile(llvm_asm_file_name);
+  if (!Output) {
+    warning(0, G_("cannot read '%s' for the cache: %s"), llvm_asm_file_name,
+            Output.getError().message().c_str());
+    return;
+  }
+  WriteCacheFile(getCacheFileName(CacheKey, ".out"), (*Output)->getBuffer());
+}
+#endif
+
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 9)
+/// MaxCodeGenPartitions - The maximum number of pieces the module is split into
+/// for parallel code generation.  The number of pieces only depends on the
+/// module and not on the number of threads, so that the output is the same
+/// whatever the thread count.
+static const unsigned MaxCodeGenPartitions = 16;
+
+/// FindJobServer - Look for a GNU make jobserver in MAKEFLAGS, and if there is
+/// one open descriptors for taking tokens from it (ReadFD, which never blocks)
+/// and giving them back (WriteFD).  WriteFD is only owned by the caller if
+/// OwnWriteFD is set; otherwise it is the descriptor inherited from make.
+/// Return false if there is a jobserver but it cannot be used.
+static bool FindJobServer(int &ReadFD, int &WriteFD, bool &OwnWriteFD) {
+  ReadFD = WriteFD = -1;
+  OwnWriteFD = false;
+#ifndef _WIN32
+  const char *MakeFlags = getenv("MAKEFLAGS");
+  if (!MakeFlags)
+    return true;
+
+  // Newer versions of make use --jobserver-auth, older ones --jobserver-fds.
+  // If there are several then the last one counts.
+  StringRef Auth;
+  SmallVector<StringRef, 16> Flags;
+  StringRef(MakeFlags).split(Flags, ' ', -1, /*KeepEmpty*/ false);
+  for (StringRef Flag : Flags)
+    if (Flag.startswith("--jobserver-auth="))
+      Auth = Flag.substr(strlen("--jobserver-auth="));
+    else if (Flag.startswith("--jobserver-fds="))
+      Auth = Flag.substr(strlen("--jobserver-fds="));
+  if (Auth.empty())
+    return true;
+
+  // Taking a token must never wait, but the jobserver is shared with make and
+  // the other jobs so changing its flags is not an option.  Open it afresh
+  // instead, which for a pipe is only possible on systems with /proc.
+  std::string Path;
+  int Write = -1;
+  if (Auth.startswith("fifo:")) {
+    Path = Auth.substr(strlen("fifo:")).str();
+    Write = open(Path.c_str(), O_WRONLY);
+    OwnWriteFD = true;
+  } else {
+    std::pair<StringRef, StringRef> FDs = Auth.split(',');
+    int InheritedReadFD;
+    // Make only passes the pipe on to jobs it knows to be sub-makes; the
+    // descriptors may have been closed or even reused otherwise.
+    struct stat ReadStat, WriteStat;
+    if (FDs.first.getAsInteger(10, InheritedReadFD) ||
+        FDs.second.getAsInteger(10, Write) ||
+        fstat(InheritedReadFD, &ReadStat) || fstat(Write, &WriteStat) ||
+        !S_ISFIFO(ReadStat.st_mode) || !S_ISFIFO(WriteStat.st_mode))
+      return false;
+    Path = "/proc/self/fd/" + itostr(InheritedReadFD);
+  }
+  if (Write < 0)
+    return false;
+  ReadFD = open(Path.c_str(), O_RDONLY | O_NONBLOCK);
+  if (ReadFD < 0) {
+    if (OwnWriteFD)
+      close(Write);
+    OwnWriteFD = false;
+    return false;
+  }
+  WriteFD = Write;
+#endif
+  return true;
+}
+
+/// JobTokens - Tokens taken from the make jobserver, given back when this
+/// object is destroyed, along with the descriptors opened to take them.
+class JobTokens {
+  std::string Tokens;
+  int ReadFD, WriteFD;
+  bool OwnWriteFD;
+
+public:
+  JobTokens() : ReadFD(-1), WriteFD(-1), OwnWriteFD(false) {}
+
+  /// connect - Find the make jobserver, if any.  Return false if there is one
+  /// but it cannot be used.
+  bool connect() { return FindJobServer(ReadFD, WriteFD, OwnWriteFD); }
+
+  /// hasJobServer - Whether tokens have to be taken from a jobserver.
+  bool hasJobServer() const { return ReadFD >= 0; }
+
+  /// acquire - Take up to Max tokens, as many as are free right now, and return
+  /// the number taken.
+  unsigned acquire(unsigned Max) {
+#ifndef _WIN32
+    while (Tokens.size() < Max) {
+      char Token;
+      ssize_t Read = read(ReadFD, &Token, 1);
+      if (Read < 0 && errno == EINTR)
+        continue;
+      if (Read != 1)
+        break;
+      Tokens += Token;
+    }
+#endif
+    return Tokens.size();
+  }
+
+  ~JobTokens() {
+#ifndef _WIN32
+    const char *Data = Tokens.data();
+    size_t Size = Tokens.size();
+    while (Size) {
+      ssize_t Written = write(WriteFD, Data, Size);
+      if (Written < 0 && errno == EINTR)
+        continue;
+      if (Written <= 0)
+        break;
+      Data += Written;
+      Size -= Written;
+    }
+    if (ReadFD >= 0)
+      close(ReadFD);
+    if (OwnWriteFD)
+      close(WriteFD);
+#endif
+  }
+};
+
+/// getCodeGenThreads - The number of threads to generate code with, taking the
+/// tokens needed from the make jobserver if there is one.  The compiler itself
+/// holds a token, so one thread can always be used.
+static unsigned getCodeGenThreads(JobTokens &Tokens) {
+  if (CodeGenThreads <= 1)
+    return 1;
+
+  if (!Tokens.connect()) {
+    static bool Warned = false;
+    if (!Warned)
+      warning(0, G_("cannot use the make jobserver, generating code using a "
+                    "single thread"));
+    Warned = true;
+    return 1;
+  }
+  if (!Tokens.hasJobServer())
+    return CodeGenThreads;
+  return 1 + Tokens.acquire(CodeGenThreads - 1);
+}
+
+/// isAsmIdentifierChar - Whether C can occur in an assembler symbol name.
+static bool isAsmIdentifierChar(char C) {
+  return isalnum(C) || C == '_' || C == '.' || C == '$';
+}
+
+/// WritePartitionAsm - Write the assembler generated for the given piece of the
+/// module to the output.  The code generator numbers assembler local symbols
+/// (basic block labels, constant pool entries, exception tables etc) starting
+/// from zero in every piece, so rename them to make them distinct from those in
+/// other pieces.
+static void WritePartitionAsm(StringRef Asm, unsigned Part, raw_ostream &OS) {
+  if (!Part) {
+    OS << Asm;
+    return;
+  }
+
+  const MCAsmInfo *MAI = TheTarget->getMCAsmInfo();
+  StringRef Prefixes[] = { MAI->getPrivateGlobalPrefix(),
+                           MAI->getPrivateLabelPrefix(), "GCC_except_table" };
+  std::string Tag = "p" + utostr(Part) + "_";
+
+  while (!Asm.empty()) {
+    std::pair<StringRef, StringRef> Split = Asm.split('\n');
+    StringRef Line = Split.first;
+    Asm = Split.second;
+
+    // The first piece already named the source file.
+    if (Line.startswith("\t.file\t\""))
+      continue;
+
+    bool InString = false;
+    for (size_t i = 0, e = Line.size(); i != e; ++i) {
+      char C = Line[i];
+      if (InString) {
+        OS << C;
+        if (C == '\\' && i + 1 != e)
+          OS << Line[++i];
+        else if (C == '"')
+          InString = false;
+        continue;
+      }
+      if (C == '"') {
+        InString = true;
+      } else if (!i || !isAsmIdentifierChar(Line[i - 1])) {
+        StringRef Rest = Line.substr(i);
+        unsigned j = 0;
+        while (j != array_lengthof(Prefixes) && !Rest.startswith(Prefixes[j]))
+          ++j;
+        if (j != array_lengthof(Prefixes)) {
+          OS << Prefixes[j] << Tag;
+          i += Prefixes[j].size() - 1;
+          continue;
+        }
+      }
+      OS << C;
+    }
+    OS << '\n';
+  }
+}
+
+#if GCC_VERSION_CODE > GCC_VERSION(4, 5)
+/// FindUserGlobals - Add the globals whose definitions refer to V to Users.
+static void FindUserGlobals(const Value *V,
+                            SmallPtrSetImpl<const GlobalValue *> &Users) {
+  for (const User *U : V->users())
+    if (const Instruction *I = dyn_cast<Instruction>(U))
+      Users.insert(I->getParent()->getParent());
+    else if (const GlobalValue *GV = dyn_cast<GlobalValue>(U))
+      Users.insert(GV);
+    else
+      FindUserGlobals(U, Users);
+}
+
+/// SplitModuleByFunction - Split TheModule into the smallest pieces that can
+/// be code generated separately, passing each piece to the callback.  Anything
+/// with local linkage goes in the same piece as whatever refers to it, and
+/// aliases and comdats go with their members, so most functions get a piece of
+/// their own.  Unlike with SplitModule, the piece a function ends up in does
+/// not depend on the size of the other functions, so changing one function
+/// only changes its own piece.  If ReleaseBodies then the bodies of the
+/// functions in each piece are deleted from TheModule once the piece has been
+/// passed to the callback, so that TheModule shrinks as the pieces are made.
+static void
+SplitModuleByFunction(function_ref<void(std::unique_ptr<Module>)> Callback,
+                      bool ReleaseBodies) {
+  EquivalenceClasses<const GlobalValue *> Pieces;
+  DenseMap<const Comdat *, const GlobalValue *> ComdatMembers;
+  std::vector<const GlobalValue *> Definitions;
+
+  auto AddDefinition = [&](const GlobalValue &GV) {
+    if (GV.isDeclaration())
+      return;
+    Definitions.push_back(&GV);
+    Pieces.insert(&GV);
+
+    if (const Comdat *C = GV.getComdat()) {
+      const GlobalValue *&Member = ComdatMembers[C];
+      if (Member)
+        Pieces.unionSets(Member, &GV);
+      else
+        Member = &GV;
+    }
+
+    SmallPtrSet<const GlobalValue *, 8> Users;
+    if (GV.hasLocalLinkage())
+      FindUserGlobals(&GV, Users);
+    if (const Function *F = dyn_cast<Function>(&GV)) {
+      // Blocks whose address is taken can only be referred to from the piece
+      // holding the function.
+      for (const BasicBlock &BB : *F)
+        if (BB.hasAddressTaken())
+          if (const BlockAddress *BA = BlockAddress::lookup(&BB))
+            FindUserGlobals(BA, Users);
+    } else if (const GlobalAlias *GA = dyn_cast<GlobalAlias>(&GV)) {
+      if (const GlobalObject *Base = GA->getBaseObject())
+        Users.insert(Base);
+    }
+    for (const GlobalValue *User : Users)
+      Pieces.unionSets(&GV, User);
+  };
+  for (const Function &F : *TheModule)
+    AddDefinition(F);
+  for (const GlobalVariable &GV : TheModule->globals())
+    AddDefinition(GV);
+  for (const GlobalAlias &GA : TheModule->aliases())
+    AddDefinition(GA);
+
+  // Number the pieces in the order in which they first occur in the module.
+  DenseMap<const GlobalValue *, unsigned> PieceNumbers;
+  DenseMap<const GlobalValue *, unsigned> PieceOf;
+  for (const GlobalValue *GV : Definitions) {
+    const GlobalValue *Leader = Pieces.getLeaderValue(GV);
+    unsigned Number = PieceNumbers.insert(std::make_pair(
+        Leader, PieceNumbers.size())).first->second;
+    PieceOf[GV] = Number;
+  }
+
+  std::vector<SmallVector<Function *, 1> > PieceFunctions;
+  if (ReleaseBodies) {
+    PieceFunctions.resize(PieceNumbers.size());
+    for (Function &F : *TheModule)
+      if (!F.isDeclaration())
+        PieceFunctions[PieceOf[&F]].push_back(&F);
+  }
+
+  for (unsigned i = 0, e = PieceNumbers.size(); i != e; ++i) {
+    ValueToValueMapTy VMap;
+    Callback(CloneModule(TheModule, VMap, [&](const GlobalValue *GV) {
+      DenseMap<const GlobalValue *, unsigned>::const_iterator I =
+          PieceOf.find(GV);
+      return I != PieceOf.end() && I->second == i;
+    }));
+    // Later pieces only need declarations of these functions, if anything.
+    if (ReleaseBodies)
+      for (Function *F : PieceFunctions[i])
+        ReleaseFunctionBody(F);
+  }
+}
+#endif
+
+/// EmitModuleInParallel - Split TheModule into pieces, generate assembler for
+/// each of them on CodeGenThreads threads and write the result to the output.
+/// If CodeGenCache then the assembler for any piece that was generated before
+/// is taken from the cache instead.  TheModule is consumed.
+static void EmitModuleInParallel() {
+  unsigned NumFunctions = 0;
+  for (Module::iterator I = TheModule->begin(), E = TheModule->end(); I != E;
+       ++I)
+    if (!I->isDeclaration())
+      ++NumFunctions;
+  unsigned NumParts = std::max(1U, std::min(MaxCodeGenPartitions,
+                                            NumFunctions));
+
+  // File scope asm must only be output once.  Put it in the first piece.
+  std::string ModuleAsm = TheModule->getModuleInlineAsm();
+  TheModule->setModuleInlineAsm("");
+
+  // Every piece is code generated in a context of its own, so hand the pieces
+  // over as bitcode.  Local symbols are kept in the same piece as their users
+  // so they do not need to be externalized.
+  std::vector<SmallString<0> > Bitcode;
+  auto AddPiece = [&](std::unique_ptr<Module> MPart) {
+    if (Bitcode.empty())
+      MPart->setModuleInlineAsm(ModuleAsm);
+    Bitcode.emplace_back();
+    raw_svector_ostream BCOS(Bitcode.back());
+    WriteBitcodeToFile(MPart.get(), BCOS);
+  };
+#if GCC_VERSION_CODE > GCC_VERSION(4, 5)
+  if (CodeGenCache || CodeGenByFunction) {
+    SplitModuleByFunction(AddPiece, /*ReleaseBodies*/ CodeGenByFunction);
+    delete TheModule;
+  } else
+#endif
+  SplitModule(std::unique_ptr<Module>(TheModule), NumParts, AddPiece,
+              /*PreserveLocals*/ true);
+  TheModule = 0;
+
+  std::vector<SmallString<0> > Asm(Bitcode.size());
+  std::vector<bool> Cached(Bitcode.size());
+  std::vector<std::string> Keys(Bitcode.size());
+#if GCC_VERSION_CODE > GCC_VERSION(4, 5)
+  if (CodeGenCache)
+    for (unsigned i = 0, e = Bitcode.size(); i != e; ++i) {
+      Keys[i] = ComputeCacheKey(Bitcode[i]);
+      ErrorOr<std::unique_ptr<MemoryBuffer> > Buffer =
+          MemoryBuffer::getFile(getCacheFileName(Keys[i], ".s"));
+      if (Buffer) {
+        Asm[i] = (*Buffer)->getBuffer();
+        Cached[i] = true;
+      }
+    }
+#endif
+
+// Request that addPassesToEmitFile run the Verifier after running
+// passes which modify the IR.
+#ifndef NDEBUG
+  bool DisableVerify = false;
+#else
+  bool DisableVerify = true;
+#endif
+
+  // Threads beyond the first have to be paid for with jobserver tokens, which
+  // are given back once all threads are done, i.e. after Pool is destroyed.
+  // The pieces do not depend on the number of threads, so neither does the
+  // output.
+  JobTokens Tokens;
+  ThreadPool Pool(getCodeGenThreads(Tokens));
+  std::vector<std::shared_future<void> > Done(Bitcode.size());
+  for (unsigned i = 0, e = Bitcode.size(); i != e; ++i) {
+    if (Cached[i])
+      continue;
+    Done[i] = Pool.async([&, i]() {
+      LLVMContext Context;
+      Expected<std::unique_ptr<Module> > MOrErr = parseBitcodeFile(
+          MemoryBufferRef(StringRef(Bitcode[i].data(), Bitcode[i].size()),
+                          "<partition>"),
+          Context);
+      if (!MOrErr)
+        report_fatal_error(toString(MOrErr.takeError()));
+      std::unique_ptr<Module> M = std::move(*MOrErr);
+      {
+        SmallString<0> Freed(std::move(Bitcode[i])); // Free the bitcode.
+      }
+
+      std::unique_ptr<TargetMachine> TM(
+          TheTarget->getTarget().createTargetMachine(
+              TheTarget->getTargetTriple().str(), TheTarget->getTargetCPU(),
+              TheTarget->getTargetFeatureString(), TheTarget->Options,
+              TheTarget->getRelocationModel(), TheTarget->getCodeModel(),
+              TheTarget->getOptLevel()));
+
+      legacy::PassManager PM;
+      PM.add(createTargetTransformInfoWrapperPass(TM->getTargetIRAnalysis()));
+      TargetLibraryInfoImpl TLII(Triple(M->getTargetTriple()));
+      PM.add(new TargetLibraryInfoWrapperPass(TLII));
+
+      raw_svector_ostream OS(Asm[i]);
+      if (TM->addPassesToEmitFile(PM, OS, TargetMachine::CGFT_AssemblyFile,
+                                  DisableVerify))
+        llvm_unreachable("Error interfacing to target machine!");
+      PM.run(*M);
+    });
+  }
 
-  //TODO  timevar_push(TV_LLVM_PERFILE);
+  // Output the pieces in order, whichever thread finished first.  Each piece is
+  // output as soon as it and those before it are done, so that writing it out
+  // overlaps with generating code for the rest.
+  for (unsigned i = 0, e = Asm.size(); i != e; ++i) {
+    if (!Cached[i]) {
+      Done[i].wait();
+#if GCC_VERSION_CODE > GCC_VERSION(4, 5)
+      if (CodeGenCache)
+        WriteCacheFile(getCacheFileName(Keys[i], ".s"), Asm[i]);
+#endif
+    }
+    SmallString<0> PieceAsm(std::move(Asm[i])); // Freed once output.
+    WritePartitionAsm(PieceAsm, i, *FormattedOutStream);
+  }
+}
+#endif
+
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 9) && !defined(_WIN32)
+/// AskCodeGenDaemon - Send TheModule to CodeGenDaemon and put the code it
+/// generates in Output.  Returns false with an error message if the daemon
+/// cannot be reached or fails.
+static bool AskCodeGenDaemon(std::string &Output, std::string &Error) {
+  CodeGenRequest Req;
+  Req.Triple = TheTarget->getTargetTriple().str();
+  Req.CPU = TheTarget->getTargetCPU();
+  Req.Features = TheTarget->getTargetFeatureString();
+  Req.LLVMOptions = LLVMOptions;
+  Req.RelocModel = TheTarget->getRelocationModel();
+  Req.CodeModel = TheTarget->getCodeModel();
+  Req.OptLevel = TheTarget->getOptLevel();
+  Req.EmitObj = EmitObj;
+  Req.Options = TheTarget->Options;
+  {
+    raw_string_ostream OS(Req.Bitcode);
+    WriteBitcodeToFile(TheModule, OS);
+  }
+  DaemonMessageWriter Request;
+  Req.write(Request);
+
+  int FD = ConnectToCodeGenDaemon(CodeGenDaemon);
+  if (FD < 0) {
+    Error = std::error_code(errno, std::generic_category()).message();
+    return false;
+  }
+  std::string Reply;
+  bool Answered = SendDaemonMessage(FD, Request.getData()) &&
+                  ReceiveDaemonMessage(FD, Reply);
+  close(FD);
+
+  DaemonMessageReader R(Reply);
+  uint64_t OK;
+  if (!Answered || !R.getInt(OK)) {
+    Error = "no reply";
+    return false;
+  }
+  if (!OK) {
+    R.getString(Error);
+    return false;
+  }
+  return R.getString(Output);
+}
+
+/// EmitModuleWithDaemon - Have CodeGenDaemon generate code for TheModule and
+/// write it to the output.  If the daemon cannot, generate the code here.
+static void EmitModuleWithDaemon() {
+  std::string Output, Error;
+  if (AskCodeGenDaemon(Output, Error)) {
+    *FormattedOutStream << Output;
+    return;
+  }
+  warning(0, G_("code generation daemon '%s' failed, generating code "
+                "locally: %s"), CodeGenDaemon, Error.c_str());
+
+// Request that addPassesToEmitFile run the Verifier after running
+// passes which modify the IR.
+#ifndef NDEBUG
+  bool DisableVerify = false;
+#else
+  bool DisableVerify = true;
+#endif
+
+  LLVMContext &Context = TheModule->getContext();
+  LLVMContext::InlineAsmDiagHandlerTy OldHandler =
+      Context.getInlineAsmDiagnosticHandler();
+  void *OldHandlerData = Context.getInlineAsmDiagnosticContext();
+  Context.setInlineAsmDiagnosticHandler(InlineAsmDiagnosticHandler, 0);
+
+  legacy::PassManager PM;
+  PM.add(createTargetTransformInfoWrapperPass(TheTarget->getTargetIRAnalysis()));
+  TargetLibraryInfoImpl TLII(Triple(TheModule->getTargetTriple()));
+  PM.add(new TargetLibraryInfoWrapperPass(TLII));
+  if (TheTarget->addPassesToEmitFile(PM, *FormattedOutStream,
+                                     EmitObj ? TargetMachine::CGFT_ObjectFile
+                                             : TargetMachine::CGFT_AssemblyFile,
+                                     DisableVerify))
+    llvm_unreachable("Error interfacing to target machine!");
+  PM.run(*TheModule);
+
+  Context.setInlineAsmDiagnosticHandler(OldHandler, OldHandlerData);
+}
+#endif
+
+/// FinishUnit - Add the module level globals, optimize the module and generate
+/// code for it.
+static void FinishUnit() {
   if (!quiet_flag)
     errs() << "Finishing compilation unit\n";
 
   InitializeBackend();
+  RecordMemoryUsage("conversion");
   if (TheDebugInfo) {
     delete TheDebugInfo;
     TheDebugInfo = 0;
@@ -2358,18 +5415,13 @@ static void llvm_finish_unit(void */*gcc_data*/, void */*user_data*/) {
       TheContext;
 #endif
 
-  createPerFunctionOptimizationPasses();
-
-  //TODO  for (Module::iterator I = TheModule->begin(), E = TheModule->end();
-  //TODO       I != E; ++I)
-  //TODO    if (!I->isDeclaration()) {
-  //TODO      if (flag_disable_red_zone)
-  //TODO        I->addFnAttr(Attribute::NoRedZone);
-  //TODO      if (flag_no_implicit_float)
-  //TODO        I->addFnAttr(Attribute::NoImplicitFloat);
-  //TODO    }
+  // If nothing was output then the optimizers have nothing to work on.
+  if (!ModuleIsEmpty() && !ConvertOnly)
+    createPerFunctionOptimizationPasses();
 
   // Add an llvm.global_ctors global if needed.
+  if (MergeConstructors)
+    MergeStaticCtors();
   if (!StaticCtors.empty())
     CreateStructorsList(StaticCtors, "llvm.global_ctors");
   // Add an llvm.global_dtors global if needed.
@@ -2429,31 +5481,116 @@ static void llvm_finish_unit(void */*gcc_data*/, void */*user_data*/) {
     AttributeAnnotateGlobals.clear();
   }
 
+  // Tell the optimizers what the bodies of OpenMP regions are passed.
+  EmitOpenMPChildAttributes();
+
+  // Tell the optimizers which code is hot, if there was profile data.
+  EmitProfileSummary();
+  // The default pipelines of the new pass manager work out the call graph
+  // profile themselves, after inlining.
+  if (!UseNewPassManager)
+    EmitCallGraphProfile();
+
+  // If only measuring the cost of conversion, check the IR and stop.  Nothing
+  // is output, but the output file is still created for the benefit of the
+  // GCC driver.
+  if (ConvertOnly) {
+    {
+      PhaseTimer Timer("LLVM verification");
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 4)
+      if (verifyModule(*TheModule, &errs()))
+#else
+      if (verifyModule(*TheModule, PrintMessageAction))
+#endif
+        error(G_("LLVM IR for the compilation unit is broken"));
+    }
+    InitializeOutputStreams(false);
+    FlushOutputStream();
+    return;
+  }
+
   // Run module-level optimizers, if any are present.
   createPerModuleOptimizationPasses();
 
   // Finish off the per-function pass.
   if (PerFunctionPasses) {
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
-    PerFunctionPasses->doInitialization();
     for (Function &F : *TheModule) {
-      if (!F.isDeclaration()) {
+      if (!F.isDeclaration() && !SimplifiedFunctions.count(&F)) {
 #ifdef DRAGONEGG_DEBUG
         printf("DEBUG: %s, line %d: %s: Per-function optimization for %s\n",
                 __FILE__, __LINE__, __func__, F.getName().str().c_str());
 #endif
-        PerFunctionPasses->run(F);
+        RunPerFunctionPasses(F);
       }
     }
 #endif
     PerFunctionPasses->doFinalization();
   }
+  for (auto &I : PerLevelFunctionPasses)
+    I.second->doFinalization();
+#if LLVM_VERSION_CODE > LLVM_VERSION(4, 0)
+  if (NewPM) {
+    for (Function &F : *TheModule)
+      if (!F.isDeclaration() && !SimplifiedFunctions.count(&F))
+        RunPerFunctionPasses(F);
+    // Function bodies may have changed since they were optimized, and anyway
+    // the module level optimizers will compute what they need.
+    NewPM->FAM.clear();
+  }
+#endif
 
-  if (PerModulePasses)
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8) && \
+    GCC_VERSION_CODE > GCC_VERSION(4, 5)
+  // If this module was compiled before then reuse the output.  Optimization
+  // remarks and stack frame sizes only come from running the passes, so then
+  // the output is stored but never reused.
+  if (CacheDir && !RemarksFileName && !EmitStackUsage) {
+    PhaseTimer Timer("LLVM output cache");
+    if (LoadCachedOutput()) {
+      FlushOutputStream();
+      return;
+    }
+  }
+#endif
+
+  if (PerModulePasses) {
+    PhaseTimer Timer("LLVM module optimization");
     PerModulePasses->run(*TheModule);
+  }
+#if LLVM_VERSION_CODE > LLVM_VERSION(4, 0)
+  if (NewPM) {
+    PhaseTimer Timer("LLVM module optimization");
+    NewPM->ModulePasses.run(*TheModule, NewPM->MAM);
+  }
+#endif
+  RecordMemoryUsage("module optimization");
+
+  // Embed the optimized module in the output, if requested.
+  if (EmbedBitcode && !EmitIR) {
+    PhaseTimer Timer("LLVM bitcode embedding");
+    EmbedModuleBitcode();
+  }
+
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 9)
+  // Generate code for pieces of the module in parallel, if requested.
+  if (SplitCodeGen) {
+    PhaseTimer Timer("LLVM code generation");
+    EmitModuleInParallel();
+  }
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 9) && !defined(_WIN32)
+  // Have the code generation daemon generate code, if requested.
+  if (DaemonCodeGen) {
+    PhaseTimer Timer("LLVM code generation");
+    EmitModuleWithDaemon();
+  }
+#endif
 
   // Run the code generator, if present.
   if (CodeGenPasses) {
+    PhaseTimer Timer("LLVM code generation");
+
     // Arrange for inline asm problems to be printed nicely.
     LLVMContext::InlineAsmDiagHandlerTy OldHandler =
         Context.getInlineAsmDiagnosticHandler();
@@ -2474,19 +5611,60 @@ static void llvm_finish_unit(void */*gcc_data*/, void */*user_data*/) {
     Context.setInlineAsmDiagnosticHandler(OldHandler, OldHandlerData);
   }
 
-#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
-  FormattedOutStream->flush();
-#else
-  FormattedOutStream.flush();
-  OutStream->flush();
+  FlushOutputStream();
+
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8) && \
+    GCC_VERSION_CODE > GCC_VERSION(4, 5)
+  if (!CacheKey.empty()) {
+    PhaseTimer Timer("LLVM output cache");
+    SaveCachedOutput();
+  }
+#endif
+}
+
+/// llvm_finish_unit - Finish the .s file.  This is called by GCC once the
+/// compilation unit has been completely processed.
+static void llvm_finish_unit(void */*gcc_data*/, void */*user_data*/) {
+  if (errorcount || sorrycount)
+    return; // Do not process broken code.
+
+  {
+    PhaseTimer Timer("LLVM finish unit");
+    FinishUnit();
+  }
+  RecordMemoryUsage("finish unit");
+
+#if LLVM_VERSION_CODE > LLVM_VERSION(5, 0)
+  if (EmitStackUsage)
+    WriteStackUsageFile();
 #endif
-  //TODO  timevar_pop(TV_LLVM_PERFILE);
+  if (RemarksFileName || EmitStackUsage)
+    FinishOptimizationRemarks();
+
+  // Initial values included in an object file written by the plugin itself are
+  // no longer needed.  When outputting assembler they are needed by the GNU
+  // assembler, so are left behind.
+  if (EmitObj && !EmitIR)
+    for (unsigned i = 0, e = SpilledInitializers.size(); i != e; ++i)
+      sys::fs::remove(SpilledInitializers[i]);
+
+  if (StatsFileName)
+    WriteStatsFile();
+  if (TraceFileName)
+    WriteTraceFile();
 
   // We have finished - shutdown the plugin.  Doing this here ensures that timer
   // info and other statistics are not intermingled with those produced by GCC.
   FinalizePlugin();
 }
 
+/// llvm_pass_execution - Count the GCC passes run, for the statistics file.
+static void llvm_pass_execution(void *gcc_data, void */*user_data*/) {
+  opt_pass *Pass = (opt_pass *)gcc_data;
+  if (Pass && Pass->name)
+    ++GCCPassRuns[Pass->name];
+}
+
 /// llvm_finish - Run shutdown code when GCC exits.
 static void llvm_finish(void */*gcc_data*/, void */*user_data*/) {
   FinalizePlugin();
@@ -2776,8 +5954,28 @@ static FlagDescriptor PluginFlags[] = {
   { "debug-pass-structure", &DebugPassStructure },
   { "debug-pass-arguments", &DebugPassArguments },
   { "enable-gcc-optzns", &EnableGCCOptimizations }, { "emit-ir", &EmitIR },
+  { "emit-thinlto", &EmitThinLTO },
+  { "emit-bitcode", &EmitBitcode },
+  { "bitcode-module-hash", &BitcodeModuleHash },
   { "emit-obj", &EmitObj },
-  { "save-gcc-output", &SaveGCCOutput }, { NULL, NULL } // Terminator.
+  { "save-gcc-output", &SaveGCCOutput },
+  { "embed-bitcode", &EmbedBitcode },
+  { "codegen-cache", &CodeGenCache },
+  { "codegen-by-function", &CodeGenByFunction },
+  { "function-time-report", &FunctionTimeReport },
+  { "ir-lint", &IRLint },
+  { "convert-only", &ConvertOnly },
+  { "new-pass-manager", &UseNewPassManager },
+  { "prune-functions", &PruneFunctions },
+  { "merge-constructors", &MergeConstructors },
+  { "unique-types", &flag_unique_types },
+  { "whole-program-vtables", &flag_whole_program_vtables },
+  { "gc-statepoints", &flag_gc_statepoints },
+  { "minsize", &flag_minsize },
+  { "stack-size-section", &StackSizeSection },
+  { "llvm-sanitizers", &UseLLVMSanitizers },
+  { "async-output", &AsyncOutput }, { "gcc-lto", &UseGCCLTO },
+  { NULL, NULL } // Terminator.
 };
 
 /// llvm_plugin_info - Information about this plugin.  Users can access this
@@ -2837,6 +6035,11 @@ int __attribute__((visibility("default"))) plugin_init(
                 plugin_name, argv[i].key);
           continue;
         }
+        if (argv[i].key[5] == 'i' && !strcmp(argv[i].value, "auto")) {
+          AutoIROptLevel = true;
+          LLVMIROptimizeArg = -1;
+          continue;
+        }
         if (argv[i].value[0] < '0' || argv[i].value[0] > '9' ||
             argv[i].value[1]) {
           error(G_("invalid option argument '-fplugin-arg-%s-%s=%s'"),
@@ -2844,13 +6047,270 @@ int __attribute__((visibility("default"))) plugin_init(
           continue;
         }
         int OptLevel = argv[i].value[0] - '0';
-        if (argv[i].key[5] == 'i')
+        if (argv[i].key[5] == 'i') {
           LLVMIROptimizeArg = OptLevel;
-        else
+          AutoIROptLevel = false;
+        } else
           LLVMCodeGenOptimizeArg = OptLevel;
         continue;
       }
 
+      if (!strcmp(argv[i].key, "codegen-threads")) {
+        if (!argv[i].value) {
+          error(G_("no value supplied for option '-fplugin-arg-%s-%s'"),
+                plugin_name, argv[i].key);
+          continue;
+        }
+        char *End;
+        long Threads = strtol(argv[i].value, &End, 10);
+        if (*End || Threads < 1) {
+          error(G_("invalid option argument '-fplugin-arg-%s-%s=%s'"),
+                plugin_name, argv[i].key, argv[i].value);
+          continue;
+        }
+        CodeGenThreads = Threads;
+        continue;
+      }
+
+      if (!strcmp(argv[i].key, "gc-batch")) {
+        if (!argv[i].value) {
+          error(G_("no value supplied for option '-fplugin-arg-%s-%s'"),
+                plugin_name, argv[i].key);
+          continue;
+        }
+        char *End;
+        long Batch = strtol(argv[i].value, &End, 10);
+        if (*End || Batch < 1) {
+          error(G_("invalid option argument '-fplugin-arg-%s-%s=%s'"),
+                plugin_name, argv[i].key, argv[i].value);
+          continue;
+        }
+        GCBatch = Batch;
+        continue;
+      }
+
+      if (!strcmp(argv[i].key, "codegen-daemon")) {
+        if (!argv[i].value) {
+          error(G_("no value supplied for option '-fplugin-arg-%s-%s'"),
+                plugin_name, argv[i].key);
+          continue;
+        }
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 9) && !defined(_WIN32)
+        CodeGenDaemon = argv[i].value;
+#else
+        warning(0, G_("'-fplugin-arg-%s-%s' is not supported by this version "
+                      "of LLVM or on this system"), plugin_name, argv[i].key);
+#endif
+        continue;
+      }
+
+      if (!strcmp(argv[i].key, "cache-dir")) {
+        if (!argv[i].value) {
+          error(G_("no value supplied for option '-fplugin-arg-%s-%s'"),
+                plugin_name, argv[i].key);
+          continue;
+        }
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8) && \
+    GCC_VERSION_CODE > GCC_VERSION(4, 5)
+        CacheDir = argv[i].value;
+#else
+        warning(0, G_("'-fplugin-arg-%s-%s' is not supported by this version "
+                      "of LLVM or GCC"), plugin_name, argv[i].key);
+#endif
+        continue;
+      }
+
+      if (!strcmp(argv[i].key, "stats-file")) {
+        if (!argv[i].value) {
+          error(G_("no value supplied for option '-fplugin-arg-%s-%s'"),
+                plugin_name, argv[i].key);
+          continue;
+        }
+        StatsFileName = argv[i].value;
+        continue;
+      }
+
+      if (!strcmp(argv[i].key, "time-trace")) {
+        if (!argv[i].value) {
+          error(G_("no value supplied for option '-fplugin-arg-%s-%s'"),
+                plugin_name, argv[i].key);
+          continue;
+        }
+        TraceFileName = argv[i].value;
+        TraceStart = getWallTime();
+        continue;
+      }
+
+      if (!strcmp(argv[i].key, "opt-remarks-file") ||
+          !strcmp(argv[i].key, "opt-remarks-filter")) {
+        if (!argv[i].value) {
+          error(G_("no value supplied for option '-fplugin-arg-%s-%s'"),
+                plugin_name, argv[i].key);
+          continue;
+        }
+#if LLVM_VERSION_CODE > LLVM_VERSION(5, 0)
+        if (!strcmp(argv[i].key, "opt-remarks-file")) {
+          RemarksFileName = argv[i].value;
+          continue;
+        }
+        std::string Error;
+        if (!Regex(argv[i].value).isValid(Error)) {
+          error(G_("invalid option argument '-fplugin-arg-%s-%s=%s': %s"),
+                plugin_name, argv[i].key, argv[i].value, Error.c_str());
+          continue;
+        }
+        RemarksFilter = argv[i].value;
+#else
+        warning(0, G_("'-fplugin-arg-%s-%s' is not supported by this version "
+                      "of LLVM"), plugin_name, argv[i].key);
+#endif
+        continue;
+      }
+
+      if (!strcmp(argv[i].key, "flat-initializers")) {
+        if (!argv[i].value) {
+          error(G_("no value supplied for option '-fplugin-arg-%s-%s'"),
+                plugin_name, argv[i].key);
+          continue;
+        }
+        char *End;
+        unsigned long long Threshold = strtoull(argv[i].value, &End, 10);
+        if (*End || !Threshold) {
+          error(G_("invalid option argument '-fplugin-arg-%s-%s=%s'"),
+                plugin_name, argv[i].key, argv[i].value);
+          continue;
+        }
+        FlatInitializersThreshold = Threshold;
+        continue;
+      }
+
+      if (!strcmp(argv[i].key, "sample-profile")) {
+        if (!argv[i].value) {
+          error(G_("no value supplied for option '-fplugin-arg-%s-%s'"),
+                plugin_name, argv[i].key);
+          continue;
+        }
+        SampleProfileFile = argv[i].value;
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+        warning(0, G_("'-fplugin-arg-%s-%s' is not supported by this version "
+                      "of LLVM"), plugin_name, argv[i].key);
+#else
+        // Samples are matched to the code by source line.
+        if (debug_info_level == DINFO_LEVEL_NONE)
+          warning(0, G_("'-fplugin-arg-%s-%s' has no effect without debug "
+                        "info, use -g1 or above"), plugin_name, argv[i].key);
+#endif
+        continue;
+      }
+
+      if (!strcmp(argv[i].key, "profile-instr-generate")) {
+        InstrProfileGenerate = argv[i].value ? argv[i].value : "";
+#if LLVM_VERSION_CODE < LLVM_VERSION(4, 0)
+        warning(0, G_("'-fplugin-arg-%s-%s' is not supported by this version "
+                      "of LLVM"), plugin_name, argv[i].key);
+#else
+        // Counting everything twice only makes the program slower.
+        if (profile_arc_flag)
+          warning(0, G_("'-fplugin-arg-%s-%s' used together with "
+                        "-fprofile-generate or -fprofile-arcs"), plugin_name,
+                  argv[i].key);
+#endif
+        continue;
+      }
+
+      if (!strcmp(argv[i].key, "profile-instr-use")) {
+        if (!argv[i].value) {
+          error(G_("no value supplied for option '-fplugin-arg-%s-%s'"),
+                plugin_name, argv[i].key);
+          continue;
+        }
+        InstrProfileUse = argv[i].value;
+#if LLVM_VERSION_CODE < LLVM_VERSION(4, 0)
+        warning(0, G_("'-fplugin-arg-%s-%s' is not supported by this version "
+                      "of LLVM"), plugin_name, argv[i].key);
+#endif
+        continue;
+      }
+
+      if (!strcmp(argv[i].key, "pipeline")) {
+        if (!argv[i].value) {
+          error(G_("no value supplied for option '-fplugin-arg-%s-%s'"),
+                plugin_name, argv[i].key);
+        } else if (!strcmp(argv[i].value, "gcc-then-llvm")) {
+          EnableGCCOptimizations = true;
+        } else if (!strcmp(argv[i].value, "gcc-ipa-then-llvm")) {
+          KeepGCCIPAPasses = true;
+        } else if (strcmp(argv[i].value, "llvm")) {
+          error(G_("invalid option argument '-fplugin-arg-%s-%s=%s'"),
+                plugin_name, argv[i].key, argv[i].value);
+        }
+        continue;
+      }
+
+      if (!strcmp(argv[i].key, "value-names")) {
+        if (!argv[i].value) {
+          error(G_("no value supplied for option '-fplugin-arg-%s-%s'"),
+                plugin_name, argv[i].key);
+        } else if (!strcmp(argv[i].value, "keep")) {
+          ValueNames = 1;
+        } else if (!strcmp(argv[i].value, "discard")) {
+          ValueNames = 0;
+        } else {
+          error(G_("invalid option argument '-fplugin-arg-%s-%s=%s'"),
+                plugin_name, argv[i].key, argv[i].value);
+        }
+        continue;
+      }
+
+      if (!strcmp(argv[i].key, "compress-debug-sections")) {
+        if (!argv[i].value || !strcmp(argv[i].value, "zlib"))
+          CompressDebugSections = 1;
+        else if (!strcmp(argv[i].value, "zlib-gnu"))
+          CompressDebugSections = 2;
+        else if (!strcmp(argv[i].value, "none"))
+          CompressDebugSections = 0;
+        else
+          error(G_("invalid option argument '-fplugin-arg-%s-%s=%s'"),
+                plugin_name, argv[i].key, argv[i].value);
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 6)
+        warning(0, G_("'-fplugin-arg-%s-%s' is not supported by this version "
+                      "of LLVM"), plugin_name, argv[i].key);
+#endif
+        continue;
+      }
+
+      if (!strcmp(argv[i].key, "stream-globals")) {
+        if (!argv[i].value) {
+          error(G_("no value supplied for option '-fplugin-arg-%s-%s'"),
+                plugin_name, argv[i].key);
+          continue;
+        }
+        char *End;
+        unsigned long long Threshold = strtoull(argv[i].value, &End, 10);
+        if (*End || !Threshold) {
+          error(G_("invalid option argument '-fplugin-arg-%s-%s=%s'"),
+                plugin_name, argv[i].key, argv[i].value);
+          continue;
+        }
+#if (GCC_MAJOR > 4) && LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+        StreamGlobalsThreshold = Threshold;
+#else
+        warning(0, G_("'-fplugin-arg-%s-%s' is not supported by this version "
+                      "of LLVM or GCC"), plugin_name, argv[i].key);
+#endif
+        continue;
+      }
+
+      if (!strcmp(argv[i].key, "relaxed-sync")) {
+        if (!argv[i].value) {
+          error(G_("no value supplied for option '-fplugin-arg-%s-%s'"),
+                plugin_name, argv[i].key);
+          continue;
+        }
+        RelaxedSyncPrefix = argv[i].value;
+        continue;
+      }
+
       if (!strcmp(argv[i].key, "llvm-option")) {
         if (!argv[i].value) {
           error(G_("no value supplied for option '-fplugin-arg-%s-%s'"),
@@ -2908,6 +6368,153 @@ int __attribute__((visibility("default"))) plugin_init(
     }
   }
 
+  // The code generator cache lives in the cache directory.
+  if (CodeGenCache && !CacheDir) {
+    warning(0, G_("'-fplugin-arg-%s-codegen-cache' needs a cache directory, "
+                  "see '-fplugin-arg-%s-cache-dir'"), plugin_name, plugin_name);
+    CodeGenCache = false;
+  }
+
+  // ThinLTO output is LLVM IR too, just written differently.
+#if LLVM_VERSION_CODE < LLVM_VERSION(4, 0)
+  if (EmitThinLTO) {
+    error(G_("'-fplugin-arg-%s-emit-thinlto' is not supported by this version "
+             "of LLVM"), plugin_name);
+    EmitThinLTO = false;
+  }
+#endif
+  EmitIR |= EmitThinLTO;
+
+  // Bitcode is LLVM IR too.
+  EmitIR |= EmitBitcode;
+#if LLVM_VERSION_CODE < LLVM_VERSION(4, 0)
+  if (BitcodeModuleHash) {
+    warning(0, G_("'-fplugin-arg-%s-bitcode-module-hash' is not supported by "
+                  "this version of LLVM"), plugin_name);
+    BitcodeModuleHash = false;
+  }
+#endif
+
+  // Converting code without optimizing it is done to find where the time goes.
+  FunctionTimeReport |= ConvertOnly;
+
+  if (IRLint && !StatsFileName)
+    warning(0, G_("'-fplugin-arg-%s-ir-lint' has no effect without "
+                  "'-fplugin-arg-%s-stats-file'"), plugin_name, plugin_name);
+
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 9)
+  if (flag_whole_program_vtables) {
+    warning(0, G_("'-fplugin-arg-%s-whole-program-vtables' is not supported by "
+                  "this version of LLVM"), plugin_name);
+    flag_whole_program_vtables = false;
+  }
+#endif
+#if LLVM_VERSION_CODE < LLVM_VERSION(6, 0)
+  if (StackSizeSection) {
+    warning(0, G_("'-fplugin-arg-%s-stack-size-section' is not supported by "
+                  "this version of LLVM"), plugin_name);
+    StackSizeSection = false;
+  }
+#endif
+#if GCC_VERSION_CODE > GCC_VERSION(4, 5)
+  // The stack frame sizes are taken from the remarks of the code generator.
+  if (flag_stack_usage) {
+#if LLVM_VERSION_CODE > LLVM_VERSION(5, 0)
+    EmitStackUsage = true;
+#else
+    warning(0, G_("'-fstack-usage' is not supported by this version of LLVM"));
+#endif
+  }
+#endif
+#if GCC_VERSION_CODE > GCC_VERSION(4, 5) && \
+    LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+  if (flag_split_stack > 0)
+    warning(0, G_("'-fsplit-stack' is not supported by this version of LLVM"));
+#endif
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 8)
+  if (flag_gc_statepoints) {
+    warning(0, G_("'-fplugin-arg-%s-gc-statepoints' is not supported by this "
+                  "version of LLVM"), plugin_name);
+    flag_gc_statepoints = false;
+  }
+#endif
+  // The type tests at virtual calls are only removed by the link time
+  // optimizers, so they cannot be used when generating code directly.
+  if (flag_whole_program_vtables && !EmitIR
+#ifdef ENABLE_LTO
+      && !flag_generate_lto
+#endif
+      ) {
+    warning(0, G_("'-fplugin-arg-%s-whole-program-vtables' is ignored unless "
+                  "LLVM IR is output"), plugin_name);
+    flag_whole_program_vtables = false;
+  }
+
+  if (UseLLVMSanitizers) {
+#if GCC_VERSION_CODE > GCC_VERSION(4, 8)
+    // Take the address and thread sanitizers over from GCC.  Turning them off
+    // in GCC means that neither its instrumentation passes nor its start-up
+    // code for the runtime are run.
+#if (GCC_MAJOR > 4)
+    flag_llvm_sanitize_address = flag_sanitize & SANITIZE_USER_ADDRESS;
+    flag_sanitize &= ~SANITIZE_USER_ADDRESS;
+#else
+    flag_llvm_sanitize_address = flag_sanitize & SANITIZE_ADDRESS;
+    flag_sanitize &= ~SANITIZE_ADDRESS;
+#endif
+    flag_llvm_sanitize_thread = flag_sanitize & SANITIZE_THREAD;
+    flag_sanitize &= ~SANITIZE_THREAD;
+#else
+    warning(0, G_("'-fplugin-arg-%s-llvm-sanitizers' is not supported by this "
+                  "version of GCC"), plugin_name);
+#endif
+  }
+
+#if (GCC_MAJOR < 5)
+  if (PruneFunctions) {
+    warning(0, G_("'-fplugin-arg-%s-prune-functions' is not supported by this "
+                  "version of GCC"), plugin_name);
+    PruneFunctions = false;
+  }
+#endif
+
+#if LLVM_VERSION_CODE < LLVM_VERSION(5, 0)
+  if (UseNewPassManager) {
+    warning(0, G_("'-fplugin-arg-%s-new-pass-manager' is not supported by this "
+                  "version of LLVM, using the legacy pass manager instead"),
+            plugin_name);
+    UseNewPassManager = false;
+  }
+#elif LLVM_VERSION_CODE < LLVM_VERSION(6, 0)
+  if (UseNewPassManager && (InstrProfileGenerate || InstrProfileUse)) {
+    warning(0, G_("LLVM profiling is not supported by the new pass manager of "
+                  "this version of LLVM, using the legacy pass manager "
+                  "instead"));
+    UseNewPassManager = false;
+  }
+#endif
+  if (UseNewPassManager &&
+      (flag_llvm_sanitize_address || flag_llvm_sanitize_thread)) {
+    warning(0, G_("LLVM sanitizers are not supported by the new pass manager "
+                  "of this version of LLVM, using the legacy pass manager "
+                  "instead"));
+    UseNewPassManager = false;
+  }
+
+#ifdef ENABLE_LTO
+  // With GCC's own link time optimization the whole program analysis (WPA) is
+  // left to GCC, and the plugin takes over once lto1 generates code for each
+  // partition of the program (LTRANS).  If asked, -flto compiles are left to
+  // GCC too, so that the object files hold GIMPLE for WPA to work on.
+  if (flag_wpa || (UseGCCLTO && flag_generate_lto && !flag_ltrans))
+    return 0;
+  InLTRANS = flag_ltrans;
+#else
+  if (UseGCCLTO)
+    warning(0, G_("'-fplugin-arg-%s-gcc-lto' is not supported by this version "
+                  "of GCC"), plugin_name);
+#endif
+
   // Obtain exclusive use of the assembly code output file.  This stops GCC from
   // writing anything at all to the assembly file - only we get to write to it.
   TakeoverAsmOutput();
@@ -2922,6 +6529,10 @@ int __attribute__((visibility("default"))) plugin_init(
                     const_cast<ggc_cache_tab *>(gt_ggc_rc__gt_cache_h));
 #endif
 
+  // Trees may be freed and reallocated by the garbage collector, making the
+  // fast front end caches and the function type cache stale.
+  register_callback(plugin_name, PLUGIN_GGC_START, llvm_ggc_start, NULL);
+
   // Perform late initialization just before processing the compilation unit.
   register_callback(plugin_name, PLUGIN_START_UNIT, llvm_start_unit, NULL);
 
@@ -2930,8 +6541,17 @@ int __attribute__((visibility("default"))) plugin_init(
           EnableGCCOptimizations ? "Enable all gcc optimization passes." :
           "Turn off all gcc optimization passes.");
 #endif
-  // Turn off all gcc optimization passes.
-  if (!EnableGCCOptimizations) {
+  // Record which GCC passes run, so it can be seen what each pipeline costs.
+  if (StatsFileName)
+    register_callback(plugin_name, PLUGIN_PASS_EXECUTION, llvm_pass_execution,
+                      NULL);
+
+  // Turn off all gcc optimization passes.  In LTRANS the early passes have
+  // already run, and the IPA passes must be left alone: they apply the
+  // decisions made during whole program analysis, such as what to inline.
+  // The same goes for the gcc-ipa-then-llvm pipeline, where the IPA passes
+  // need the early optimizations to have simplified functions first.
+  if (!EnableGCCOptimizations && !KeepGCCIPAPasses && !InLTRANS) {
 // TODO: figure out a good way of turning off ipa optimization passes.
 // Could just set optimize to zero (after taking a copy), but this would
 // also impact front-end optimizations.
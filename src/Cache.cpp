@@ -95,6 +95,10 @@ struct intCacheHasher : ggc_cache_ptr_hash<tree2int> {
   static inline bool equal(tree2int *a, tree2int *b) {
     return a->base.from == b->base.from;
   }
+
+  static int keep_cache_entry(tree2int *&t2i) {
+    return ggc_marked_p(t2i->base.from);
+  }
 };
 static GTY((cache)) hash_table<intCacheHasher> *intCache;
 #endif
@@ -140,11 +144,17 @@ struct TypeCacheHaser : ggc_cache_ptr_hash<tree2Type> {
   static inline bool equal(tree2Type *a, tree2Type *b) {
     return a->base.from == b->base.from;
   }
+
+  static int keep_cache_entry(tree2Type *&t2T) {
+    return ggc_marked_p(t2T->base.from);
+  }
 };
 static GTY((cache)) hash_table<TypeCacheHaser> *TypeCache;
 #endif
 
-// Hash table mapping trees to WeakVH.
+// Hash tables mapping trees to WeakVH.  Declarations, which mostly live until
+// the end of the unit, are kept in their own table (DeclCache) rather than
+// mixed in with the constants and other values in WeakVHCache.
 
 // Forward declare WeakVH for the benefit of gengtype.
 #ifndef IN_GCC
@@ -172,6 +182,8 @@ struct GTY(())
 // FIXME: gengtype does not support macro https://gcc.gnu.org/ml/gcc/2017-07/msg00061.html
 static GTY((if_marked("tree2WeakVH_marked_p"), param_is(struct tree2WeakVH)))
     htab_t WeakVHCache;
+static GTY((if_marked("tree2WeakVH_marked_p"), param_is(struct tree2WeakVH)))
+    htab_t DeclCache;
 #else
 #if (GCC_MAJOR == 5)
 struct WeakVHCacheHasher : ggc_cache_hasher<tree2WeakVH *> {
@@ -191,6 +203,7 @@ struct WeakVHCacheHasher : ggc_cache_ptr_hash<tree2WeakVH> {
   }
 };
 static GTY((cache)) hash_table<WeakVHCacheHasher> *WeakVHCache;
+static GTY((cache)) hash_table<WeakVHCacheHasher> *DeclCache;
 #endif
 
 // Include the garbage collector header.
@@ -214,9 +227,67 @@ extern "C" {
 } // extern "C"
 #endif
 
+/// Stats - Lookup statistics for all of the caches.
+static CacheStatistics Stats;
+
+// Direct mapped caches in front of the integer and type hash tables, which are
+// much slower to look things up in.  A tree freed by the garbage collector can
+// have its memory reused for a new tree, so these are emptied whenever the
+// garbage collector runs.
+static const unsigned FrontCacheSize = 1024;
+static struct {
+  tree Key;
+  int Val;
+} IntegerFront[FrontCacheSize];
+static struct {
+  tree Key;
+  Type *Ty;
+} TypeFront[FrontCacheSize];
+
+/// getFrontIndex - The slot for the given tree in the direct mapped caches.
+static inline unsigned getFrontIndex(tree t) {
+  // Trees are allocated with at least 8 byte alignment.
+  return ((uintptr_t)t >> 3) & (FrontCacheSize - 1);
+}
+
+void flushFrontCaches() {
+  memset(IntegerFront, 0, sizeof(IntegerFront));
+  memset(TypeFront, 0, sizeof(TypeFront));
+}
+
+#if (GCC_MAJOR < 5)
+typedef htab_t WeakVHTable;
+#define CACHE_ENTRIES(C) ((C) ? htab_elements(C) : 0)
+#define CACHE_SLOTS(C) ((C) ? htab_size(C) : 0)
+#else
+typedef hash_table<WeakVHCacheHasher> *WeakVHTable;
+#define CACHE_ENTRIES(C) ((C) ? (C)->elements() : 0)
+#define CACHE_SLOTS(C) ((C) ? (C)->size() : 0)
+#endif
+
+const CacheStatistics &getCacheStatistics() {
+  Stats.IntegerEntries = CACHE_ENTRIES(intCache);
+  Stats.IntegerSlots = CACHE_SLOTS(intCache);
+  Stats.TypeEntries = CACHE_ENTRIES(TypeCache);
+  Stats.TypeSlots = CACHE_SLOTS(TypeCache);
+  Stats.ValueEntries = CACHE_ENTRIES(WeakVHCache);
+  Stats.ValueSlots = CACHE_SLOTS(WeakVHCache);
+  Stats.DeclEntries = CACHE_ENTRIES(DeclCache);
+  Stats.DeclSlots = CACHE_SLOTS(DeclCache);
+  return Stats;
+}
+
 bool getCachedInteger(tree t, int &Val) {
-  if (!intCache)
+  unsigned Idx = getFrontIndex(t);
+  if (IntegerFront[Idx].Key == t) {
+    ++Stats.IntegerFrontHits;
+    Val = IntegerFront[Idx].Val;
+    return true;
+  }
+  if (!intCache) {
+    ++Stats.IntegerMisses;
     return false;
+  }
 #if (GCC_MAJOR < 5)
   tree_map_base in = { t };
   tree2int *h = (tree2int *)htab_find(intCache, &in);
@@ -225,9 +296,14 @@ bool getCachedInteger(tree t, int &Val) {
   in.base.from = t;
   tree2int *h = intCache->find(&in);
 #endif
-  if (!h)
+  if (!h) {
+    ++Stats.IntegerMisses;
     return false;
+  }
+  ++Stats.IntegerHits;
   Val = h->val;
+  IntegerFront[Idx].Key = t;
+  IntegerFront[Idx].Val = Val;
   return true;
 }
 
@@ -262,11 +338,22 @@ void setCachedInteger(tree t, int Val) {
   }
 
   (*slot)->val = Val;
+
+  unsigned Idx = getFrontIndex(t);
+  IntegerFront[Idx].Key = t;
+  IntegerFront[Idx].Val = Val;
 }
 
 Type *getCachedType(tree t) {
-  if (!TypeCache)
+  unsigned Idx = getFrontIndex(t);
+  if (TypeFront[Idx].Key == t) {
+    ++Stats.TypeFrontHits;
+    return TypeFront[Idx].Ty;
+  }
+  if (!TypeCache) {
+    ++Stats.TypeMisses;
     return 0;
+  }
 #if (GCC_MAJOR < 5)
   tree_map_base in = { t };
   tree2Type *h = (tree2Type *)htab_find(TypeCache, &in);
@@ -275,7 +362,14 @@ Type *getCachedType(tree t) {
   in.base.from = t;
   tree2Type *h = TypeCache->find(&in);
 #endif
-  return h ? h->Ty : 0;
+  if (!h) {
+    ++Stats.TypeMisses;
+    return 0;
+  }
+  ++Stats.TypeHits;
+  TypeFront[Idx].Key = t;
+  TypeFront[Idx].Ty = h->Ty;
+  return h->Ty;
 }
 
 void setCachedType(tree t, Type *Ty) {
@@ -286,6 +380,10 @@ void setCachedType(tree t, Type *Ty) {
   in.base.from = t;
 #endif
 
+  unsigned Idx = getFrontIndex(t);
+  TypeFront[Idx].Key = Ty ? t : 0;
+  TypeFront[Idx].Ty = Ty;
+
   /* If deleting, remove the slot.  */
   if (!Ty) {
     if (TypeCache)
@@ -326,30 +424,49 @@ void setCachedType(tree t, Type *Ty) {
   (*slot)->Ty = Ty;
 }
 
-/// getCachedValue - Returns the value associated with the given GCC tree, or
-/// null if none.
-Value *getCachedValue(tree t) {
-  if (!WeakVHCache)
+/// lookupWeakVH - Returns the value associated with the given GCC tree in the
+/// given table, or null if none, counting the lookup in Hits or Misses.
+static Value *lookupWeakVH(WeakVHTable Table, tree t, unsigned &Hits,
+                           unsigned &Misses) {
+  if (!Table) {
+    ++Misses;
     return 0;
+  }
 #if (GCC_MAJOR < 5)
   tree_map_base in = { t };
-  tree2WeakVH *h = (tree2WeakVH *)htab_find(WeakVHCache, &in);
+  tree2WeakVH *h = (tree2WeakVH *)htab_find(Table, &in);
 #else
   tree2WeakVH in;
   in.base.from = t;
-  tree2WeakVH *h = WeakVHCache->find(&in);
-#endif
-  return h ? h->V : 0;
+  tree2WeakVH *h = Table->find(&in);
+#endif
+  // A null value means the value was deleted, which counts as a miss.
+  Value *V = h ? h->V : 0;
+  if (V)
+    ++Hits;
+  else
+    ++Misses;
+  return V;
 }
 
 static void DestructWeakVH(void *p) {
   ((WeakVH *)&((tree2WeakVH *)p)->V)->~WeakVH();
 }
 
-/// setCachedValue - Associates the given value (which may be null) with the
-/// given GCC tree.  The association is removed if tree is garbage collected
-/// or the value deleted.
-void setCachedValue(tree t, Value *V) {
+/// createWeakVHTable - Create a table mapping trees to WeakVH with room for
+/// about Size entries.
+static WeakVHTable createWeakVHTable(size_t Size) {
+#if (GCC_MAJOR < 5)
+  return htab_create_ggc(Size, tree2WeakVH_hash, tree2WeakVH_eq,
+                         DestructWeakVH);
+#else
+  return hash_table<WeakVHCacheHasher>::create_ggc(Size);
+#endif
+}
+
+/// storeWeakVH - Associates the given value (which may be null) with the given
+/// GCC tree in the given table, creating the table if need be.
+static void storeWeakVH(WeakVHTable &Table, tree t, Value *V) {
 #if (GCC_MAJOR < 5)
   tree_map_base in = { t };
 #else
@@ -359,27 +476,22 @@ void setCachedValue(tree t, Value *V) {
 
   // If deleting, remove the slot.
   if (!V) {
-    if (WeakVHCache)
+    if (Table)
 #if (GCC_MAJOR < 5)
-      htab_remove_elt(WeakVHCache, &in);
+      htab_remove_elt(Table, &in);
 #else
-      WeakVHCache->remove_elt(&in);
+      Table->remove_elt(&in);
 #endif
     return;
   }
 
-  if (!WeakVHCache)
-    WeakVHCache =
-#if (GCC_MAJOR < 5)
-        htab_create_ggc(1024, tree2WeakVH_hash, tree2WeakVH_eq, DestructWeakVH);
-#else
-        hash_table<WeakVHCacheHasher>::create_ggc(1024);
-#endif
+  if (!Table)
+    Table = createWeakVHTable(1024);
 
 #if (GCC_MAJOR < 5)
-  tree2WeakVH **slot = (tree2WeakVH **)htab_find_slot(WeakVHCache, &in, INSERT);
+  tree2WeakVH **slot = (tree2WeakVH **)htab_find_slot(Table, &in, INSERT);
 #else
-  tree2WeakVH **slot = WeakVHCache->find_slot(&in, INSERT);
+  tree2WeakVH **slot = Table->find_slot(&in, INSERT);
 #endif
   assert(slot && "Failed to create hash table slot!");
 
@@ -401,3 +513,34 @@ void setCachedValue(tree t, Value *V) {
   assert(W == &(*slot)->V && "Pointer was displaced!");
   (void)W;
 }
+
+/// getCachedValue - Returns the value associated with the given GCC tree, or
+/// null if none.
+Value *getCachedValue(tree t) {
+  return lookupWeakVH(WeakVHCache, t, Stats.ValueHits, Stats.ValueMisses);
+}
+
+/// setCachedValue - Associates the given value (which may be null) with the
+/// given GCC tree.  The association is removed if tree is garbage collected
+/// or the value deleted.
+void setCachedValue(tree t, Value *V) { storeWeakVH(WeakVHCache, t, V); }
+
+/// getCachedDeclValue - Returns the value associated with the given GCC
+/// declaration, or null if none.
+Value *getCachedDeclValue(tree t) {
+  return lookupWeakVH(DeclCache, t, Stats.DeclHits, Stats.DeclMisses);
+}
+
+/// setCachedDeclValue - Associates the given value (which may be null) with
+/// the given GCC declaration.  The association is removed if the declaration
+/// is garbage collected or the value deleted.
+void setCachedDeclValue(tree t, Value *V) { storeWeakVH(DeclCache, t, V); }
+
+/// reserveDeclCache - Make room in the declaration cache for the given number
+/// of declarations, so that it does not have to grow while the unit is being
+/// converted.  Does nothing if the cache is already in use.
+void reserveDeclCache(unsigned NumDecls) {
+  if (!DeclCache)
+    // The tables grow once they are three quarters full.
+    DeclCache = createWeakVHTable(NumDecls * 4 / 3 + 1024);
+}
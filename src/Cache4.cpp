@@ -111,6 +111,8 @@ struct GTY(()) tree2WeakVH {
 
 static GTY((if_marked("tree2WeakVH_marked_p"), param_is(struct tree2WeakVH)))
     htab_t WeakVHCache;
+static GTY((if_marked("tree2WeakVH_marked_p"), param_is(struct tree2WeakVH)))
+    htab_t DeclCache;
 
 // Include the garbage collector header.
 #ifndef ENABLE_BUILD_WITH_CXX
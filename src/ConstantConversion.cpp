@@ -34,6 +34,12 @@
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Support/Host.h"
+#include "llvm/Support/raw_ostream.h"
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 3)
+#include "llvm/IR/ValueHandle.h"
+#else
+#include "llvm/Support/ValueHandle.h"
+#endif
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
 #include "llvm/Target/TargetMachine.h"
 #endif
@@ -81,6 +87,11 @@ static LLVMContext &TheContext = getGlobalContext();
 static Constant *ConvertInitializerImpl(tree, TargetFolder &);
 static Constant *AddressOfImpl(tree, TargetFolder &);
 
+/// Stats - How often converted initializers and addresses were reused.
+static ConstantStatistics Stats;
+
+const ConstantStatistics &getConstantStatistics() { return Stats; }
+
 //===----------------------------------------------------------------------===//
 //                           ... InterpretAsType ...
 //===----------------------------------------------------------------------===//
@@ -434,6 +445,47 @@ static BitSlice ViewAsBits(Constant *C, SignedRange R, TargetFolder &Folder) {
   }
 }
 
+/// getContainingElement - If bits [StartingBit, StartingBit + NumBits) of the
+/// aggregate or vector constant C all lie in one of its elements then return
+/// that element, changing StartingBit to be relative to the element.  Returns
+/// null otherwise, for example if the bits span several elements.
+static Constant *getContainingElement(Constant *C, int &StartingBit,
+                                      unsigned NumBits) {
+  Type *Ty = C->getType();
+  if (StartingBit < 0 || !(Ty->isAggregateType() || Ty->isVectorTy()))
+    return 0;
+  const DataLayout &DL = getDataLayout();
+  uint64_t First = StartingBit;
+  unsigned Idx;
+  uint64_t EltOffset;
+  if (StructType *STy = dyn_cast<StructType>(Ty)) {
+    const StructLayout *SL = DL.getStructLayout(STy);
+    if (First >= SL->getSizeInBits())
+      return 0;
+    Idx = SL->getElementContainingOffset(First / 8);
+    EltOffset = SL->getElementOffsetInBits(Idx);
+  } else {
+    // Elements are laid out as in ViewAsBits.
+    bool isArray = Ty->isArrayTy();
+    Type *EltTy = isArray ? cast<ArrayType>(Ty)->getElementType()
+                          : cast<VectorType>(Ty)->getElementType();
+    uint64_t NumElts = isArray ? cast<ArrayType>(Ty)->getNumElements()
+                               : cast<VectorType>(Ty)->getNumElements();
+    uint64_t Stride = DL.getTypeAllocSizeInBits(EltTy);
+    if (!Stride || First / Stride >= NumElts)
+      return 0;
+    Idx = First / Stride;
+    EltOffset = Idx * Stride;
+  }
+  // Constant expressions of aggregate type have no elements to hand.
+  Constant *Elt = C->getAggregateElement(Idx);
+  if (!Elt ||
+      First - EltOffset + NumBits > DL.getTypeStoreSizeInBits(Elt->getType()))
+    return 0;
+  StartingBit -= EltOffset;
+  return Elt;
+}
+
 /// InterpretAsType - Interpret the bits of the given constant (starting from
 /// StartingBit) as representing a constant of type 'Ty'.  This results in the
 /// same constant as you would get by storing the bits of 'C' to memory (with
@@ -451,6 +503,29 @@ InterpretAsType(Constant *C, Type *Ty, int StartingBit, TargetFolder &Folder) {
   if (C->isNullValue())
     return Constant::getNullValue(Ty);
 
+  // Bits that all come from one element of an aggregate can be read from that
+  // element, without viewing the aggregate as a bunch of bits.  This is the
+  // usual case when reading a field or vector element out of a constant.
+  const DataLayout &DL = getDataLayout();
+  unsigned StoreSize = DL.getTypeStoreSizeInBits(Ty);
+  int EltStartingBit = StartingBit;
+  if (Constant *Elt = getContainingElement(C, EltStartingBit, StoreSize))
+    return InterpretAsType(Elt, Ty, EltStartingBit, Folder);
+
+  // Whole units of an integer can be shifted out of it directly.  Bit zero in
+  // memory is the most significant bit on big-endian machines.
+  if (ConstantInt *CI = dyn_cast<ConstantInt>(C))
+    if (Ty->isIntegerTy() && Ty->getPrimitiveSizeInBits() == StoreSize &&
+        CI->getBitWidth() == DL.getTypeStoreSizeInBits(CI->getType()) &&
+        StartingBit >= 0 && StartingBit % BITS_PER_UNIT == 0 &&
+        StartingBit + StoreSize <= CI->getBitWidth()) {
+      unsigned Shift = BYTES_BIG_ENDIAN
+                       ? CI->getBitWidth() - StartingBit - StoreSize
+                       : StartingBit;
+      APInt Bits = CI->getValue().lshr(Shift);
+      return ConstantInt::get(Ty, Bits.trunc(StoreSize));
+    }
+
   LLVMContext &Context =
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
       Ty->getContext();
@@ -464,7 +539,6 @@ InterpretAsType(Constant *C, Type *Ty, int StartingBit, TargetFolder &Folder) {
     llvm_unreachable("Unsupported type!");
   case Type::IntegerTyID: {
     unsigned BitWidth = Ty->getPrimitiveSizeInBits();
-    unsigned StoreSize = getDataLayout().getTypeStoreSizeInBits(Ty);
     // Convert the constant into a bunch of bits.  Only the bits to be "loaded"
     // out are needed, so rather than converting the entire constant this only
     // converts enough to get all of the required bits.
@@ -810,76 +884,224 @@ static Constant *ConvertSTRING_CST(tree exp, TargetFolder &) {
 #endif
 
   unsigned Len = (unsigned) TREE_STRING_LENGTH(exp);
-
-  std::vector<Constant *> Elts;
-  if (ElTy->isIntegerTy(8)) {
-    const unsigned char *InStr =
-        (const unsigned char *)TREE_STRING_POINTER(exp);
-    for (unsigned i = 0; i != Len; ++i)
-      Elts.push_back(ConstantInt::get(Type::getInt8Ty(Context), InStr[i]));
-  } else if (ElTy->isIntegerTy(16)) {
-    assert((Len & 1) == 0 &&
-           "Length in bytes should be a multiple of element size");
-    const uint16_t *InStr = (const unsigned short *)TREE_STRING_POINTER(exp);
-    for (unsigned i = 0; i != Len / 2; ++i) {
-      // gcc has constructed the initializer elements in the target endianness,
-      // but we're going to treat them as ordinary shorts from here, with
-      // host endianness.  Adjust if necessary.
-      if (llvm::sys::IsBigEndianHost == BYTES_BIG_ENDIAN)
-        Elts.push_back(ConstantInt::get(Type::getInt16Ty(Context), InStr[i]));
-      else
-        Elts.push_back(
-            ConstantInt::get(Type::getInt16Ty(Context), ByteSwap_16(InStr[i])));
-    }
-  } else if (ElTy->isIntegerTy(32)) {
-    assert((Len & 3) == 0 &&
-           "Length in bytes should be a multiple of element size");
-    const uint32_t *InStr = (const uint32_t *)TREE_STRING_POINTER(exp);
-    for (unsigned i = 0; i != Len / 4; ++i) {
-      // gcc has constructed the initializer elements in the target endianness,
-      // but we're going to treat them as ordinary ints from here, with
-      // host endianness.  Adjust if necessary.
-      if (llvm::sys::IsBigEndianHost == BYTES_BIG_ENDIAN)
-        Elts.push_back(ConstantInt::get(Type::getInt32Ty(Context), InStr[i]));
-      else
-        Elts.push_back(
-            ConstantInt::get(Type::getInt32Ty(Context), ByteSwap_32(InStr[i])));
-    }
-  } else {
-    llvm_unreachable("Unknown character type!");
-  }
+  unsigned EltSize = ElTy->getPrimitiveSizeInBits() / 8;
+  assert(Len % EltSize == 0 &&
+         "Length in bytes should be a multiple of element size");
 
   unsigned LenInElts =
       Len / TREE_INT_CST_LOW(TYPE_SIZE_UNIT(main_type(main_type(exp))));
   unsigned ConstantSize = StrTy->getNumElements();
 
-  if (LenInElts != ConstantSize) {
-    // If this is a variable sized array type, set the length to LenInElts.
-    if (ConstantSize == 0) {
-      tree Domain = TYPE_DOMAIN(main_type(exp));
-      if (!Domain || !TYPE_MAX_VALUE(Domain)) {
-        ConstantSize = LenInElts;
-        StrTy = ArrayType::get(ElTy, LenInElts);
-      }
-    }
+  // If this is a variable sized array type, set the length to LenInElts.
+  if (LenInElts != ConstantSize && ConstantSize == 0) {
+    tree Domain = TYPE_DOMAIN(main_type(exp));
+    if (!Domain || !TYPE_MAX_VALUE(Domain))
+      ConstantSize = LenInElts;
+  }
 
-    if (ConstantSize < LenInElts) {
-      // Only some chars are being used, truncate the string: char X[2] = "foo";
-      Elts.resize(ConstantSize);
-    } else {
-      // Fill the end of the string with nulls.
-      Constant *C = Constant::getNullValue(ElTy);
-      for (; LenInElts != ConstantSize; ++LenInElts)
-        Elts.push_back(C);
-    }
+  // Only some chars may be used, truncating the string: char X[2] = "foo";
+  // Otherwise the end of the string is filled with nulls.
+  unsigned NumCopied = std::min(LenInElts, ConstantSize);
+  const char *InStr = TREE_STRING_POINTER(exp);
+
+  if (ElTy->isIntegerTy(8)) {
+    // The common case: use the string contents as they are.
+    StringRef Str(InStr, NumCopied);
+    if (NumCopied == ConstantSize)
+      return ConstantDataArray::getString(Context, Str, /*AddNull*/ false);
+    std::string Padded = Str.str();
+    Padded.resize(ConstantSize);
+    return ConstantDataArray::getString(Context, Padded, /*AddNull*/ false);
+  }
+
+  // gcc has constructed the initializer elements in the target endianness,
+  // but we're going to treat them as ordinary integers from here, with host
+  // endianness.  Adjust if necessary.
+  bool Swap = llvm::sys::IsBigEndianHost != BYTES_BIG_ENDIAN;
+  if (ElTy->isIntegerTy(16)) {
+    std::vector<uint16_t> Elts(ConstantSize);
+    memcpy(Elts.data(), InStr, NumCopied * 2);
+    if (Swap)
+      for (unsigned i = 0; i != NumCopied; ++i)
+        Elts[i] = ByteSwap_16(Elts[i]);
+    return ConstantDataArray::get(Context, makeArrayRef(Elts));
   }
-  return ConstantArray::get(StrTy, Elts);
+  if (ElTy->isIntegerTy(32)) {
+    std::vector<uint32_t> Elts(ConstantSize);
+    memcpy(Elts.data(), InStr, NumCopied * 4);
+    if (Swap)
+      for (unsigned i = 0; i != NumCopied; ++i)
+        Elts[i] = ByteSwap_32(Elts[i]);
+    return ConstantDataArray::get(Context, makeArrayRef(Elts));
+  }
+  llvm_unreachable("Unknown character type!");
 }
 
 static Constant *ConvertADDR_EXPR(tree exp, TargetFolder &Folder) {
   return AddressOfImpl(TREE_OPERAND(exp, 0), Folder);
 }
 
+/// ElementRun - A run of consecutive array elements which all have the same
+/// initial value.
+namespace {
+
+class ElementRun {
+  Range<uint64_t> R; // The indices of the elements in the run.
+  Constant *Val;     // The initial value of each element.
+public:
+  ElementRun(uint64_t First, uint64_t Last, Constant *V)
+      : R(First, Last), Val(V) {}
+
+  /// getRange - Return the indices of the elements in the run.
+  Range<uint64_t> getRange() const { return R; }
+
+  /// getValue - Return the initial value of the elements in the run.
+  Constant *getValue() const { return Val; }
+
+  /// ChangeRangeTo - Change the run to cover the given elements.  Every element
+  /// has the same value, so this is just a matter of updating the range.
+  void ChangeRangeTo(Range<uint64_t> NewR) { R = NewR; }
+};
+
+} // Unnamed namespace.
+
+/// SparseArrayMinGap - Runs of at least this many default initialized array
+/// elements are given a single aggregate default value rather than having a
+/// default value for each element.
+static const uint64_t SparseArrayMinGap = 256;
+
+/// AppendSameTypeGroups - Append the given elements to StructElts, grouping
+/// consecutive elements of the same type into arrays.
+static void AppendSameTypeGroups(ArrayRef<Constant *> Elts,
+                                 std::vector<Constant *> &StructElts) {
+  unsigned First = 0, E = Elts.size();
+  while (First < E) {
+    // Find the maximal value of Last s.t. all elements in the range
+    // [First, Last) have the same type.
+    Type *Ty = Elts[First]->getType();
+    unsigned Last = First + 1;
+    for (; Last != E; ++Last)
+      if (Elts[Last]->getType() != Ty)
+        break;
+    unsigned NumSameType = Last - First;
+    Constant *StructElt;
+    if (NumSameType == 1)
+      StructElt = Elts[First];
+    else
+      StructElt = ConstantArray::get(ArrayType::get(Ty, NumSameType),
+                                     Elts.slice(First, NumSameType));
+    StructElts.push_back(StructElt);
+    First = Last;
+  }
+}
+
+/// getScalarBits - Return the target representation of an INTEGER_CST or of a
+/// REAL_CST with a precision of 32 or 64 bits, truncated to the given width.
+static uint64_t getScalarBits(tree value, unsigned Bits) {
+  if (isa<INTEGER_CST>(value))
+    return getAPIntValue(value, Bits).getZExtValue();
+  // Get the bits of the constant in target format from GCC, as 32 bit words
+  // (one per long).
+  long Buf[2];
+  real_to_target(Buf, TREE_REAL_CST_PTR(value), TYPE_MODE(TREE_TYPE(value)));
+  if (Bits == 32)
+    return (uint64_t) Buf[0] & 0xffffffff;
+  if (FLOAT_WORDS_BIG_ENDIAN)
+    std::swap(Buf[0], Buf[1]);
+  return ((uint64_t) Buf[0] & 0xffffffff) | ((uint64_t) Buf[1] << 32);
+}
+
+/// getScalarDataArray - Turn the initial values of the first NumVals elements
+/// of an array, which must be simple scalar constants, into a data array with
+/// elements of type T and length NumElts.  U is an unsigned integer type of the
+/// same size as T.  Missing elements are zero.
+template <typename T, typename U>
+static Constant *getScalarDataArray(tree exp, uint64_t NumVals,
+                                    uint64_t NumElts, LLVMContext &Context) {
+  std::vector<T> Data(NumElts);
+  unsigned HOST_WIDE_INT ix;
+  tree elt_index, elt_value;
+  FOR_EACH_CONSTRUCTOR_ELT(CONSTRUCTOR_ELTS(exp), ix, elt_index, elt_value) {
+    assert(ix < NumVals && "Too many initial values!");
+    U Bits = (U) getScalarBits(elt_value, sizeof(U) * 8);
+    memcpy(&Data[ix], &Bits, sizeof(T));
+  }
+  return ConstantDataArray::get(Context, makeArrayRef(Data));
+}
+
+/// ConvertScalarArrayCONSTRUCTOR - Convert a CONSTRUCTOR for an array of plain
+/// integers or floating point numbers directly into a ConstantDataArray, rather
+/// than creating a constant for each element.  Returns null if the constructor
+/// is not simple enough for this, for example if not every element is given an
+/// INTEGER_CST or REAL_CST initial value in turn.
+static Constant *ConvertScalarArrayCONSTRUCTOR(tree exp, LLVMContext &Context) {
+  tree init_type = main_type(exp);
+  tree elt_type = main_type(init_type);
+  Type *EltTy = ConvertType(elt_type);
+  uint64_t NumElts = ArrayLengthOf(init_type);
+  if (NumElts == NO_LENGTH)
+    return 0;
+  if (TYPE_DOMAIN(init_type) &&
+      !integer_zerop(TYPE_MIN_VALUE(TYPE_DOMAIN(init_type))))
+    return 0;
+
+  unsigned Bits = EltTy->getPrimitiveSizeInBits();
+  bool isInteger = INTEGRAL_TYPE_P(elt_type) && EltTy->isIntegerTy() &&
+                   TYPE_PRECISION(elt_type) == Bits;
+  bool isReal = isa<REAL_TYPE>(elt_type) &&
+                (EltTy->isFloatTy() || EltTy->isDoubleTy()) &&
+                TYPE_PRECISION(elt_type) == Bits;
+  if ((!isInteger && !isReal) || (Bits != 8 && Bits != 16 && Bits != 32 &&
+                                  Bits != 64))
+    return 0;
+  // Elements more aligned than the array need a packed struct.
+  const DataLayout &DL = getDataLayout();
+  if (DL.getABITypeAlignment(EltTy) * 8 > TYPE_ALIGN(init_type) ||
+      DL.getTypeAllocSizeInBits(EltTy) != Bits)
+    return 0;
+
+  // Check that the elements are initialized in order with simple constants.
+  uint64_t NumVals = 0;
+  unsigned HOST_WIDE_INT ix;
+  tree elt_index, elt_value;
+  FOR_EACH_CONSTRUCTOR_ELT(CONSTRUCTOR_ELTS(exp), ix, elt_index, elt_value) {
+    if (elt_index && !(isa<INTEGER_CST>(elt_index) &&
+                       isInt64(elt_index, true) &&
+                       getInt64(elt_index, true) == ix))
+      return 0;
+    if (main_type(elt_value) != elt_type ||
+        !(isInteger ? isa<INTEGER_CST>(elt_value) : isa<REAL_CST>(elt_value)))
+      return 0;
+    ++NumVals;
+  }
+  // Leave arrays the general logic would represent sparsely to it.  The rest
+  // of the array has to be zero.
+  if (NumVals > NumElts || NumElts - NumVals >= SparseArrayMinGap ||
+      (NumVals < NumElts && !flag_default_initialize_globals))
+    return 0;
+
+  if (isReal)
+    return Bits == 32
+           ? getScalarDataArray<float, uint32_t>(exp, NumVals, NumElts, Context)
+           : getScalarDataArray<double, uint64_t>(exp, NumVals, NumElts,
+                                                  Context);
+  switch (Bits) {
+  default:
+    llvm_unreachable("Unexpected integer width!");
+  case 8:
+    return getScalarDataArray<uint8_t, uint8_t>(exp, NumVals, NumElts, Context);
+  case 16:
+    return getScalarDataArray<uint16_t, uint16_t>(exp, NumVals, NumElts,
+                                                  Context);
+  case 32:
+    return getScalarDataArray<uint32_t, uint32_t>(exp, NumVals, NumElts,
+                                                  Context);
+  case 64:
+    return getScalarDataArray<uint64_t, uint64_t>(exp, NumVals, NumElts,
+                                                  Context);
+  }
+}
+
 /// ConvertArrayCONSTRUCTOR - Convert a CONSTRUCTOR with array or vector type.
 static Constant *ConvertArrayCONSTRUCTOR(tree exp, TargetFolder &Folder) {
   const DataLayout &DL = getDataLayout();
@@ -893,6 +1115,11 @@ static Constant *ConvertArrayCONSTRUCTOR(tree exp, TargetFolder &Folder) {
       TheContext;
 #endif
 
+  // Tables of numbers are common and can be huge, so convert them quickly.
+  if (isa<ARRAY_TYPE>(init_type))
+    if (Constant *C = ConvertScalarArrayCONSTRUCTOR(exp, Context))
+      return C;
+
   tree elt_type = main_type(init_type);
   Type *EltTy = ConvertType(elt_type);
 
@@ -900,18 +1127,18 @@ static Constant *ConvertArrayCONSTRUCTOR(tree exp, TargetFolder &Folder) {
   assert(isSizeCompatible(elt_type) && "Variable sized array element!");
   uint64_t EltSize = DL.getTypeAllocSizeInBits(EltTy);
 
-  /// Elts - The initial values to use for the array elements.  A null entry
-  /// means that the corresponding array element should be default initialized.
-  std::vector<Constant *> Elts;
+  /// Runs - The initial values given for the array elements.  An element not
+  /// in any run should be default initialized.  Later initial values for an
+  /// element override earlier ones.
+  IntervalList<ElementRun, uint64_t, 8> Runs;
 
-  // Resize to the number of array elements if known.  This ensures that every
+  // Use the number of array elements if known.  This ensures that every
   // element will be at least default initialized even if no initial value is
   // given for it.
   uint64_t TypeElts =
       isa<ARRAY_TYPE>(init_type) ? ArrayLengthOf(init_type)
                                  : TYPE_VECTOR_SUBPARTS(init_type);
-  if (TypeElts != NO_LENGTH)
-    Elts.resize(TypeElts);
+  uint64_t NumElts = TypeElts != NO_LENGTH ? TypeElts : 0;
 
   // If GCC indices into the array need adjusting to make them zero indexed then
   // record here the value to subtract off.
@@ -989,26 +1216,82 @@ static Constant *ConvertArrayCONSTRUCTOR(tree exp, TargetFolder &Folder) {
       LastIndex = FirstIndex;
     }
 
-    // Process all of the elements in the range.
-    if (LastIndex >= Elts.size())
-      Elts.resize(LastIndex + 1);
-    for (; FirstIndex <= LastIndex; ++FirstIndex)
-      Elts[FirstIndex] = Val;
+    // Record the value of all of the elements in the range.
+    Runs.AddInterval(ElementRun(FirstIndex, (uint64_t) LastIndex + 1, Val));
+    NumElts = std::max(NumElts, (uint64_t) LastIndex + 1);
 
-    NextIndex = FirstIndex;
+    NextIndex = LastIndex + 1;
   }
 
-  unsigned NumElts = Elts.size();
-
   // Zero length array.
   if (!NumElts)
     return getDefaultValue(InitTy);
 
-  // Default initialize any elements that had no initial value specified.
   Constant *DefaultElt = getDefaultValue(EltTy);
-  for (unsigned i = 0; i != NumElts; ++i)
-    if (!Elts[i])
-      Elts[i] = DefaultElt;
+  uint64_t TypeSize = DL.getTypeAllocSizeInBits(InitTy);
+
+  // If a big chunk of an array is default initialized, as in a huge lookup
+  // table with just a few entries given, then return a struct in which each
+  // such chunk is a single default valued array rather than creating a value
+  // for every element.
+  bool isSparse = false;
+  if (isa<ARRAY_TYPE>(init_type)) {
+    uint64_t End = 0;
+    for (unsigned i = 0, e = Runs.getNumIntervals(); i != e && !isSparse; ++i) {
+      isSparse = Runs.getInterval(i).getRange().getFirst() - End >=
+                 SparseArrayMinGap;
+      End = Runs.getInterval(i).getRange().getLast();
+    }
+    isSparse |= NumElts - End >= SparseArrayMinGap;
+  }
+  if (isSparse) {
+    std::vector<Constant *> StructElts, Pending;
+    unsigned MaxAlign = DL.getABITypeAlignment(EltTy);
+    uint64_t End = 0;
+    for (unsigned i = 0, e = Runs.getNumIntervals(); i <= e; ++i) {
+      uint64_t Start = i == e ? NumElts : Runs.getInterval(i).getRange()
+                                              .getFirst();
+      // Default initialize the elements before this run.
+      if (Start - End >= SparseArrayMinGap) {
+        AppendSameTypeGroups(Pending, StructElts);
+        Pending.clear();
+        StructElts.push_back(
+            getDefaultValue(ArrayType::get(EltTy, Start - End)));
+      } else {
+        Pending.insert(Pending.end(), Start - End, DefaultElt);
+      }
+      if (i == e)
+        break;
+      ElementRun Run = Runs.getInterval(i);
+      Constant *Val = Run.getValue();
+      MaxAlign = std::max(DL.getABITypeAlignment(Val->getType()), MaxAlign);
+      Pending.insert(Pending.end(), Run.getRange().getWidth(), Val);
+      End = Run.getRange().getLast();
+    }
+    AppendSameTypeGroups(Pending, StructElts);
+
+    // We guarantee that initializers are always at least as big as the LLVM
+    // type for the initializer.  If needed, append padding to ensure this.
+    if (NumElts * EltSize < TypeSize) {
+      uint64_t PadBits = TypeSize - NumElts * EltSize;
+      assert(PadBits % BITS_PER_UNIT == 0 && "Non-unit type size?");
+      unsigned Units = PadBits / BITS_PER_UNIT;
+      StructElts.push_back(getDefaultValue(GetUnitType(Context, Units)));
+    }
+
+    // Use a packed struct if any elements are more aligned than the GCC type.
+    return ConstantStruct::getAnon(Context, StructElts,
+                                   MaxAlign * 8 > TYPE_ALIGN(init_type));
+  }
+
+  // Default initialize any elements that had no initial value specified.
+  std::vector<Constant *> Elts(NumElts, DefaultElt);
+  for (unsigned i = 0, e = Runs.getNumIntervals(); i != e; ++i) {
+    ElementRun Run = Runs.getInterval(i);
+    Range<uint64_t> R = Run.getRange();
+    std::fill(Elts.begin() + R.getFirst(), Elts.begin() + R.getLast(),
+              Run.getValue());
+  }
 
   // Check whether any of the elements have different types.  If so we need to
   // return a struct instead of an array.  This can occur in cases where we have
@@ -1025,7 +1308,6 @@ static Constant *ConvertArrayCONSTRUCTOR(tree exp, TargetFolder &Folder) {
 
   // We guarantee that initializers are always at least as big as the LLVM type
   // for the initializer.  If needed, append padding to ensure this.
-  uint64_t TypeSize = DL.getTypeAllocSizeInBits(InitTy);
   if (NumElts * EltSize < TypeSize) {
     unsigned PadBits = TypeSize - NumElts * EltSize;
     assert(PadBits % BITS_PER_UNIT == 0 && "Non-unit type size?");
@@ -1043,26 +1325,7 @@ static Constant *ConvertArrayCONSTRUCTOR(tree exp, TargetFolder &Folder) {
   // Return as a struct if the contents are not homogeneous.
   if (!isHomogeneous) {
     std::vector<Constant *> StructElts;
-    unsigned First = 0, E = Elts.size();
-    while (First < E) {
-      // Find the maximal value of Last s.t. all elements in the range
-      // [First, Last) have the same type.
-      Type *Ty = Elts[First]->getType();
-      unsigned Last = First + 1;
-      for (; Last != E; ++Last)
-        if (Elts[Last]->getType() != Ty)
-          break;
-      unsigned NumSameType = Last - First;
-      Constant *StructElt;
-      if (NumSameType == 1)
-        StructElt = Elts[First];
-      else
-        StructElt =
-            ConstantArray::get(ArrayType::get(Ty, NumSameType),
-                               ArrayRef<Constant *>(&Elts[First], NumSameType));
-      StructElts.push_back(StructElt);
-      First = Last;
-    }
+    AppendSameTypeGroups(Elts, StructElts);
     return ConstantStruct::getAnon(Context, StructElts);
   }
 
@@ -1234,6 +1497,62 @@ void FieldContents::JoinWith(const FieldContents &S) {
   Starts = R.empty() ? 0 : R.getFirst();
 }
 
+namespace {
+
+/// PackedBitfields - The initial values of a run of bitfields sharing address
+/// units, assembled directly into the bits of those units.  Pasting bitfields
+/// together one at a time with BitSlice creates several temporary constants
+/// per field, while this creates a single ConstantInt for the whole run.
+class PackedBitfields {
+  int First;   // First bit of the units covered by the run.
+  int Last;    // One past the last bit of the units covered by the run.
+  int End;     // One past the last bit of the last field added.
+  APInt Bits;  // The contents of the units, least significant bit first.
+
+public:
+  PackedBitfields() : First(0), Last(0), End(0) {}
+
+  bool empty() const { return First == Last; }
+
+  /// add - Add a bitfield occupying bits [FieldFirst, FieldLast) with the
+  /// given initial value to the run.  Returns false, changing nothing, if the
+  /// field does not start inside the last unit of the run.
+  bool add(int FieldFirst, int FieldLast, const APInt &Val) {
+    int UnitsLast = (FieldLast + BITS_PER_UNIT - 1) / BITS_PER_UNIT *
+                    BITS_PER_UNIT;
+    if (empty()) {
+      First = FieldFirst / BITS_PER_UNIT * BITS_PER_UNIT;
+      Last = UnitsLast;
+      Bits = APInt(Last - First, 0);
+    } else if (FieldFirst < End || FieldFirst >= Last) {
+      return false;
+    } else if (UnitsLast > Last) {
+      Last = UnitsLast;
+      Bits = Bits.zext(Last - First);
+    }
+    End = FieldLast;
+    APInt FieldBits = Val.zextOrTrunc(FieldLast - FieldFirst);
+    Bits |= FieldBits.zextOrTrunc(Last - First).shl(FieldFirst - First);
+    return true;
+  }
+
+  /// flush - Set the bits of the units covered by the run in the given layout
+  /// and start a new, empty, run.  Returns one past the last bit set (zero if
+  /// the run was empty).
+  int flush(IntervalList<FieldContents, int, 8> &Layout, LLVMContext &Context,
+            TargetFolder &Folder) {
+    if (empty())
+      return 0;
+    Constant *C = ConstantInt::get(Context, Bits);
+    Layout.AddInterval(FieldContents::get(First, Last, C, Folder));
+    int Flushed = Last;
+    First = Last = End = 0;
+    return Flushed;
+  }
+};
+
+} // Unnamed namespace.
+
 static Constant *ConvertRecordCONSTRUCTOR(tree exp, TargetFolder &Folder) {
   // FIXME: This new logic, especially the handling of bitfields, is untested
   // and probably wrong on big-endian machines.
@@ -1248,44 +1567,30 @@ static Constant *ConvertRecordCONSTRUCTOR(tree exp, TargetFolder &Folder) {
       TheContext;
 #endif
   uint64_t TypeSize = DL.getTypeAllocSizeInBits(Ty);
+  ArrayRef<FieldLayout> Fields = getRecordLayout(type);
 
   // Ensure that fields without an initial value are default initialized by
   // explicitly setting the starting value for all fields to be zero.  If an
   // initial value is supplied for a field then the value will overwrite and
   // replace the zero starting value later.
   if (flag_default_initialize_globals) {
-    // Record all interesting fields so they can easily be visited backwards.
-    SmallVector<tree, 16> Fields;
-    for (tree field = TYPE_FIELDS(type); field; field = TREE_CHAIN(field)) {
-      if (!isa<FIELD_DECL>(field))
-        continue;
-      // Ignore fields with variable or unknown position since they cannot be
-      // default initialized.
-      if (!OffsetIsLLVMCompatible(field))
-        continue;
-      Fields.push_back(field);
-    }
-
     // Process the fields in reverse order.  This is for the benefit of union
     // types for which the first field must be default initialized (iterating
-    // in forward order would default initialize the last field).
-    for (SmallVector<tree, 16>::reverse_iterator I = Fields.rbegin(),
-                                                 E = Fields.rend();
-         I != E; ++I) {
-      tree field = *I;
-      uint64_t FirstBit = getFieldOffsetInBits(field);
+    // in forward order would default initialize the last field).  Fields with
+    // variable or unknown position are not in the layout since they cannot be
+    // default initialized.
+    for (unsigned i = Fields.size(); i--;) {
+      tree field = Fields[i].Field;
+      uint64_t FirstBit = Fields[i].FirstBit;
       assert(FirstBit <= TypeSize && "Field off end of type!");
-      // Determine the width of the field.
-      uint64_t BitWidth;
+      // Determine the width of the field.  If the field has a size and it is a
+      // constant then use it.  Note that this size may be smaller than the
+      // type size.  For example, if the next field starts inside alignment
+      // padding at the end of this one then DECL_SIZE will be the size with
+      // the padding used by the next field not included.
+      uint64_t BitWidth = Fields[i].BitWidth;
       Type *FieldTy = ConvertType(TREE_TYPE(field));
-      if (isInt64(DECL_SIZE(field), true)) {
-        // The field has a size and it is a constant, so use it.  Note that
-        // this size may be smaller than the type size.  For example, if the
-        // next field starts inside alignment padding at the end of this one
-        // then DECL_SIZE will be the size with the padding used by the next
-        // field not included.
-        BitWidth = getInt64(DECL_SIZE(field), true);
-      } else {
+      if (BitWidth == NO_LENGTH) {
         // If the field has variable or unknown size then use the size of the
         // LLVM type instead as it gives the minimum size the field may have.
         if (!FieldTy->isSized())
@@ -1310,6 +1615,14 @@ static Constant *ConvertRecordCONSTRUCTOR(tree exp, TargetFolder &Folder) {
   unsigned HOST_WIDE_INT ix;
   tree field, next_field, value;
   next_field = TYPE_FIELDS(type);
+  unsigned Pos = 0;
+  // Constant bitfields need not be pasted together bit by bit.  On little
+  // endian targets the bits of a field are simply the low bits of its initial
+  // value, so runs of them are packed into whole units as they are found.  Runs
+  // never start inside a unit touched by an earlier field, as the run would
+  // then overwrite it.
+  PackedBitfields Packed;
+  int ExplicitEnd = 0;
   FOR_EACH_CONSTRUCTOR_ELT(CONSTRUCTOR_ELTS(exp), ix, field, value) {
     if (!field) {
       // Move on to the next FIELD_DECL, skipping contained methods, types etc.
@@ -1328,19 +1641,41 @@ static Constant *ConvertRecordCONSTRUCTOR(tree exp, TargetFolder &Folder) {
     // Turn the initial value for this field into an LLVM constant.
     Constant *Init =
         ConvertInitializerWithCast(value, main_type(field), Folder);
+    // Find the field in the layout.  Initial values are usually given in the
+    // order the fields are declared in, so search onwards from the last one.
+    while (Pos < Fields.size() && Fields[Pos].Field != field)
+      ++Pos;
+    if (Pos == Fields.size())
+      for (Pos = 0; Fields[Pos].Field != field; ++Pos)
+        assert(Pos + 1 < Fields.size() && "Field not in record layout!");
     // Work out the range of bits occupied by the field.
-    uint64_t FirstBit = getFieldOffsetInBits(field);
+    uint64_t FirstBit = Fields[Pos].FirstBit;
     assert(FirstBit <= TypeSize && "Field off end of type!");
     // If a size was specified for the field then use it.  Otherwise take the
     // size from the initial value.
-    uint64_t BitWidth = isInt64(DECL_SIZE(field), true)
-                        ? getInt64(DECL_SIZE(field), true)
+    uint64_t BitWidth = Fields[Pos].BitWidth != NO_LENGTH
+                        ? Fields[Pos].BitWidth
                         : DL.getTypeAllocSizeInBits(Init->getType());
     uint64_t LastBit = FirstBit + BitWidth;
 
+    if (!BYTES_BIG_ENDIAN && Fields[Pos].Bitfield && isa<ConstantInt>(Init)) {
+      const APInt &Val = cast<ConstantInt>(Init)->getValue();
+      if (!Packed.empty() && Packed.add(FirstBit, LastBit, Val))
+        continue;
+      int RunEnd = Packed.flush(Layout, Context, Folder);
+      ExplicitEnd = std::max(ExplicitEnd, RunEnd);
+      if ((int)(FirstBit / BITS_PER_UNIT * BITS_PER_UNIT) >= ExplicitEnd &&
+          Packed.add(FirstBit, LastBit, Val))
+        continue;
+    }
+    int Flushed = Packed.flush(Layout, Context, Folder);
+    ExplicitEnd = std::max(ExplicitEnd, Flushed);
+
     // Set the bits occupied by the field to the initial value.
     Layout.AddInterval(FieldContents::get(FirstBit, LastBit, Init, Folder));
+    ExplicitEnd = std::max(ExplicitEnd, (int)LastBit);
   }
+  Packed.flush(Layout, Context, Folder);
 
   // Force all fields to begin and end on a byte boundary.  This automagically
   // takes care of bitfields.
@@ -1521,8 +1856,11 @@ static Constant *ConvertInitializerImpl(tree exp, TargetFolder &Folder) {
          "Cache collision with decl_llvm!");
 
   // If we already converted the initializer then return the cached copy.
-  if (Constant *C = cast_or_null<Constant>(getCachedValue(exp)))
+  if (Constant *C = cast_or_null<Constant>(getCachedValue(exp))) {
+    ++Stats.InitializerHits;
     return C;
+  }
+  ++Stats.InitializerMisses;
 
   Constant *Init;
   switch (TREE_CODE(exp)) {
@@ -1614,6 +1952,122 @@ Constant *ConvertInitializer(tree exp) {
   return ConvertInitializerImpl(exp, Folder);
 }
 
+/// isRawInitializer - Return whether the initial value 'exp' for an object of
+/// the given size in bytes is nothing but data, with no addresses needing to be
+/// relocated, in a form that WriteRawInitializer can output.
+bool isRawInitializer(tree exp, uint64_t Size) {
+  switch (TREE_CODE(exp)) {
+  default:
+    // Addresses need relocating.  Records may contain padding and bitfields,
+    // which need the full machinery of ConvertRecordCONSTRUCTOR.
+    return false;
+  case INTEGER_CST:
+  case REAL_CST:
+  case COMPLEX_CST:
+  case VECTOR_CST: {
+    unsigned char Buffer[64];
+    return Size <= sizeof(Buffer) &&
+           native_encode_expr(exp, Buffer, Size) == (int) Size;
+  }
+  case STRING_CST:
+    return true;
+  case CONSTRUCTOR: {
+    tree type = main_type(exp);
+    if (!isa<ARRAY_TYPE>(type))
+      return false;
+    if (TYPE_DOMAIN(type) && !integer_zerop(TYPE_MIN_VALUE(TYPE_DOMAIN(type))))
+      return false;
+    tree elt_type = main_type(type);
+    if (!isInt64(TYPE_SIZE_UNIT(elt_type), true))
+      return false;
+    uint64_t EltSize = getInt64(TYPE_SIZE_UNIT(elt_type), true);
+    // Elements must be given in order and fit in the object.
+    uint64_t NextIndex = 0;
+    unsigned HOST_WIDE_INT ix;
+    tree elt_index, elt_value;
+    FOR_EACH_CONSTRUCTOR_ELT(CONSTRUCTOR_ELTS(exp), ix, elt_index, elt_value) {
+      uint64_t Index = NextIndex;
+      if (elt_index) {
+        if (!isa<INTEGER_CST>(elt_index) || !isInt64(elt_index, true))
+          return false;
+        Index = getInt64(elt_index, true);
+      }
+      if (!EltSize || Index < NextIndex || Index >= Size / EltSize ||
+          !isRawInitializer(elt_value, EltSize))
+        return false;
+      NextIndex = Index + 1;
+    }
+    return true;
+  }
+  }
+}
+
+/// WriteZeros - Output the given number of zero bytes.
+static void WriteZeros(uint64_t Count, raw_ostream &OS) {
+  static const char Zeros[256] = {};
+  while (Count) {
+    uint64_t Chunk = std::min(Count, (uint64_t) sizeof(Zeros));
+    OS.write(Zeros, Chunk);
+    Count -= Chunk;
+  }
+}
+
+/// WriteRawInitializer - Output the bytes of an object of the given size with
+/// initial value 'exp', which must satisfy isRawInitializer, in target format.
+/// Bytes not given a value by 'exp' are zero.
+void WriteRawInitializer(tree exp, uint64_t Size, raw_ostream &OS) {
+  switch (TREE_CODE(exp)) {
+  default: {
+    unsigned char Buffer[64];
+    int Written = native_encode_expr(exp, Buffer, Size);
+    assert(Written == (int) Size && "Failed to fully encode expression!");
+    (void) Written; // Avoid unused variable warning when assertions disabled.
+    OS.write((const char *) Buffer, Size);
+    return;
+  }
+  case STRING_CST: {
+    // The string is already in target format.
+    uint64_t Len = std::min(Size, (uint64_t) TREE_STRING_LENGTH(exp));
+    OS.write(TREE_STRING_POINTER(exp), Len);
+    WriteZeros(Size - Len, OS);
+    return;
+  }
+  case CONSTRUCTOR: {
+    uint64_t EltSize = getInt64(TYPE_SIZE_UNIT(main_type(main_type(exp))),
+                                true);
+    uint64_t NextIndex = 0;
+    unsigned HOST_WIDE_INT ix;
+    tree elt_index, elt_value;
+    FOR_EACH_CONSTRUCTOR_ELT(CONSTRUCTOR_ELTS(exp), ix, elt_index, elt_value) {
+      uint64_t Index = elt_index ? getInt64(elt_index, true) : NextIndex;
+      WriteZeros((Index - NextIndex) * EltSize, OS);
+      WriteRawInitializer(elt_value, EltSize, OS);
+      NextIndex = Index + 1;
+    }
+    WriteZeros(Size - NextIndex * EltSize, OS);
+    return;
+  }
+  }
+}
+
+/// ConvertRawInitializer - Convert the initial value for an object of the given
+/// size in bytes, which must satisfy isRawInitializer, to an array of bytes.
+Constant *ConvertRawInitializer(tree exp, uint64_t Size) {
+  assert(isRawInitializer(exp, Size) && "Initial value is not plain data!");
+  std::string Bytes;
+  Bytes.reserve(Size);
+  raw_string_ostream OS(Bytes);
+  WriteRawInitializer(exp, Size, OS);
+  OS.flush();
+  LLVMContext &Context =
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+      TheModule->getContext();
+#else
+      TheContext;
+#endif
+  return ConstantDataArray::getString(Context, Bytes, false);
+}
+
 //===----------------------------------------------------------------------===//
 //                            ... AddressOf ...
 //===----------------------------------------------------------------------===//
@@ -1623,20 +2077,29 @@ Constant *ConvertInitializer(tree exp) {
 static Constant *AddressOfSimpleConstant(tree exp, TargetFolder &Folder) {
   Constant *Init = ConvertInitializerImpl(exp, Folder);
 
-  // Cache the constants to avoid making obvious duplicates that have to be
-  // folded by the optimizer.
+  unsigned align = TYPE_ALIGN(main_type(exp));
+#ifdef CONSTANT_ALIGNMENT
+  align = CONSTANT_ALIGNMENT(exp, align);
+#endif
+
+  // Constants with the same type and contents are the same LLVM constant, so
+  // caching by constant gives every identical constant in the unit one global,
+  // as GCC does, rather than making duplicates for the optimizer to fold.  The
+  // different trees for the same string literal in each inline function thus
+  // all end up pointing to the same global.
   static DenseMap<Constant *, GlobalVariable *> CSTCache;
   GlobalVariable *&Slot = CSTCache[Init];
-  if (Slot)
+  if (Slot) {
+    ++Stats.MergedSlots;
+    if (Slot->getAlignment() < align)
+      Slot->setAlignment(align);
     return Slot;
+  }
+  ++Stats.Slots;
 
   // Create a new global variable.
   Slot = new GlobalVariable(*TheModule, Init->getType(), true,
                             GlobalVariable::PrivateLinkage, Init, ".cst");
-  unsigned align = TYPE_ALIGN(main_type(exp));
-#ifdef CONSTANT_ALIGNMENT
-  align = CONSTANT_ALIGNMENT(exp, align);
-#endif
   Slot->setAlignment(align);
   // Allow identical constants to be merged if the user allowed it.
   // FIXME: maybe this flag should be set unconditionally, and instead the
@@ -1679,7 +2142,17 @@ static Constant *AddressOfARRAY_REF(tree exp, TargetFolder &Folder) {
   // doing the GEP on a pointer to the first array element.
   Constant *ArrayAddr = AddressOfImpl(array, Folder);
   Type *EltTy = ConvertType(main_type(main_type(array)));
-  ArrayAddr = Folder.CreateBitCast(ArrayAddr, EltTy->getPointerTo());
+  ArrayAddr = Folder.CreateBitCast(
+      ArrayAddr,
+      EltTy->getPointerTo(ArrayAddr->getType()->getPointerAddressSpace()));
+
+  // GEP indices are implicitly sign extended to the width of a pointer, so a
+  // narrower unsigned index needs to be zero extended explicitly.
+  Type *IntPtrTy = getDataLayout().getIntPtrType(ArrayAddr->getType());
+  if (TYPE_UNSIGNED(index_type) &&
+      IndexVal->getType()->getPrimitiveSizeInBits() <
+          IntPtrTy->getPrimitiveSizeInBits())
+    IndexVal = Folder.CreateZExtOrBitCast(IndexVal, IntPtrTy);
 
   return
 #if (GCC_MAJOR > 7)
@@ -1810,7 +2283,28 @@ static Constant *AddressOfMEM_REF(tree exp, TargetFolder &Folder) {
 #endif
 
 /// AddressOfImpl - Implementation of AddressOf.
+/// AddressCache - The result of AddressOfImpl for each tree, since the same
+/// address is often taken many times, for example in C++ vtables.  An entry is
+/// cleared if its constant is deleted, as happens when a global is replaced by
+/// changeLLVMConstant.  Trees freed by the garbage collector may have their
+/// memory reused, so the cache is emptied whenever the garbage collector runs.
+static DenseMap<tree, WeakVH> AddressCache;
+
+void flushAddressCache() { AddressCache.clear(); }
+
 static Constant *AddressOfImpl(tree exp, TargetFolder &Folder) {
+  // The address of a label is specific to the function containing it, so is
+  // not worth remembering.
+  bool Cache = !isa<LABEL_DECL>(exp);
+  if (Cache) {
+    DenseMap<tree, WeakVH>::iterator I = AddressCache.find(exp);
+    if (I != AddressCache.end() && I->second) {
+      ++Stats.AddressHits;
+      return cast<Constant>(I->second);
+    }
+    ++Stats.AddressMisses;
+  }
+
   Constant *Addr = NULL;
 
   switch (TREE_CODE(exp)) {
@@ -1869,11 +2363,15 @@ static Constant *AddressOfImpl(tree exp, TargetFolder &Folder) {
       TheContext;
 #endif
   if (isa<VOID_TYPE>(TREE_TYPE(exp)))
-    Ty = GetUnitPointerType(Context); // void* -> i8*.
+    Ty = GetUnitPointerType(Context, getAddressSpace(TREE_TYPE(exp)));
   else
-    Ty = ConvertType(TREE_TYPE(exp))->getPointerTo();
+    Ty = ConvertType(TREE_TYPE(exp))->getPointerTo(
+        getAddressSpace(TREE_TYPE(exp)));
 
-  return Folder.CreateBitCast(Addr, Ty);
+  Addr = Folder.CreateBitCast(Addr, Ty);
+  if (Cache)
+    AddressCache[exp] = Addr;
+  return Addr;
 }
 
 /// AddressOf - Given an expression with a constant address such as a constant,
@@ -23,15 +23,23 @@
 // Plugin headers
 #include "dragonegg/ABI.h"
 #include "dragonegg/Aliasing.h"
+#include "dragonegg/Cache.h"
 #include "dragonegg/ConstantConversion.h"
 #include "dragonegg/Debug.h"
 #include "dragonegg/TypeConversion.h"
 
 // LLVM headers
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
+#include "llvm/MC/SubtargetFeature.h"
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 9)
+#include "llvm/IR/ProfileSummary.h"
+#endif
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 3)
 #include "llvm/IR/CFG.h"
 #else
@@ -46,6 +54,7 @@
 
 // System headers
 #include <gmp.h>
+#include <map>
 
 // GCC headers
 #include "auto-host.h"
@@ -60,6 +69,7 @@ extern "C" {
 #include "coretypes.h"
 #include "tm.h"
 #include "tree.h"
+#include "real.h"
 
 #include "diagnostic.h"
 #include "except.h"
@@ -103,6 +113,9 @@ extern "C" {
 #include "gimple.h"
 #include "tree-cfg.h"
 #include "gimple-iterator.h"
+#include "gimple-walk.h"
+#include "tree-ssanames.h"
+#include "cfgloop.h"
 #include "tree-eh.h"
 #if (GCC_MAJOR > 7)
 #include "memmodel.h"
@@ -176,6 +189,17 @@ static LLVMContext &TheContext = getGlobalContext();
 STATISTIC(NumBasicBlocks, "Number of basic blocks converted");
 STATISTIC(NumStatements, "Number of gimple statements converted");
 
+/// RelaxedSyncPrefix - If not null, __sync read-modify-write builtins acting on
+/// a variable whose name starts with this prefix use monotonic ordering rather
+/// than being full barriers.  Meant for statistics counters.
+const char *RelaxedSyncPrefix = 0;
+
+/// NumRelaxedSyncOps - The number of __sync builtins given monotonic ordering
+/// because of RelaxedSyncPrefix.
+static unsigned NumRelaxedSyncOps;
+
+unsigned getNumRelaxedSyncOps() { return NumRelaxedSyncOps; }
+
 /// getPointerAlignment - Return the alignment in bytes of exp, a pointer valued
 /// expression, or 1 if the alignment is not known.
 static unsigned int getPointerAlignment(tree exp) {
@@ -185,6 +209,19 @@ static unsigned int getPointerAlignment(tree exp) {
       get_pointer_alignment(exp, BIGGEST_ALIGNMENT);
 #else
   get_pointer_alignment(exp);
+#endif
+#if GCC_VERSION_CODE > GCC_VERSION(4, 6)
+  // For the address of something like p->f, GCC only trusts what is known
+  // about the value of p, which is often nothing.  But &p->f can only be formed
+  // if p points to a properly aligned object, so use the alignment GCC would
+  // give an access to p->f, which takes the type of *p into account.
+  tree addr = exp;
+  STRIP_NOPS(addr);
+  if (isa<ADDR_EXPR>(addr)) {
+    tree ref = TREE_OPERAND(addr, 0);
+    if (handled_component_p(ref) || isa<MEM_REF>(ref))
+      align = std::max(align, get_object_alignment(ref));
+  }
 #endif
   return align >= 8 ? align / 8 : 1;
 }
@@ -214,7 +251,7 @@ static bool isSSAPlaceholder(Value *V) {
 /// the GCC tree node has no sensible name then it does nothing.  If the value
 /// already has a name then it is not changed.
 static void NameValue(Value *V, tree t) {
-  if (!V->hasName()) {
+  if (!flag_discard_value_names && !V->hasName()) {
     const std::string &Name = getDescriptiveName(t);
     if (!Name.empty())
       V->setName(Name);
@@ -262,28 +299,51 @@ DisplaceLocationByUnits(MemRef Loc, int32_t Offset, LLVMBuilder &Builder) {
   return MemRef(Ptr, Align, Loc.Volatile);
 }
 
+/// ConvStats - Statistics about the conversion of function bodies.
+static ConversionStatistics ConvStats;
+
+const ConversionStatistics &getConversionStatistics() { return ConvStats; }
+
+/// getPointerInSameSpace - Return a pointer to the given type in the address
+/// space that the pointer 'Ptr' points into.
+static PointerType *getPointerInSameSpace(Type *Ty, Value *Ptr) {
+  return Ty->getPointerTo(Ptr->getType()->getPointerAddressSpace());
+}
+
+/// SetAccessTags - Attach the given aliasing metadata to a load or store.
+static void SetAccessTags(Instruction *I, const AccessTags &Tags) {
+  if (Tags.TBAA)
+    I->setMetadata(LLVMContext::MD_tbaa, Tags.TBAA);
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 5)
+  if (Tags.Scope)
+    I->setMetadata(LLVMContext::MD_alias_scope, Tags.Scope);
+  if (Tags.NoAlias)
+    I->setMetadata(LLVMContext::MD_noalias, Tags.NoAlias);
+#endif
+}
+
 /// LoadFromLocation - Load a value of the given type from a memory location.
 static LoadInst *
-LoadFromLocation(MemRef Loc, Type *Ty, MDNode *AliasTag, LLVMBuilder &Builder) {
+LoadFromLocation(MemRef Loc, Type *Ty, const AccessTags &Tags,
+                 LLVMBuilder &Builder) {
   unsigned AddrSpace = Loc.Ptr->getType()->getPointerAddressSpace();
   Value *Ptr = Builder.CreateBitCast(Loc.Ptr, Ty->getPointerTo(AddrSpace));
   LoadInst *LI =
       Builder.CreateAlignedLoad(Ptr, Loc.getAlignment(), Loc.Volatile);
-  if (AliasTag)
-    LI->setMetadata(LLVMContext::MD_tbaa, AliasTag);
+  SetAccessTags(LI, Tags);
   return LI;
 }
 
 /// StoreToLocation - Store a value to the given memory location.
 static StoreInst *
-StoreToLocation(Value *V, MemRef Loc, MDNode *AliasTag, LLVMBuilder &Builder) {
+StoreToLocation(Value *V, MemRef Loc, const AccessTags &Tags,
+                LLVMBuilder &Builder) {
   Type *Ty = V->getType();
   unsigned AddrSpace = Loc.Ptr->getType()->getPointerAddressSpace();
   Value *Ptr = Builder.CreateBitCast(Loc.Ptr, Ty->getPointerTo(AddrSpace));
   StoreInst *SI =
       Builder.CreateAlignedStore(V, Ptr, Loc.getAlignment(), Loc.Volatile);
-  if (AliasTag)
-    SI->setMetadata(LLVMContext::MD_tbaa, AliasTag);
+  SetAccessTags(SI, Tags);
   return SI;
 }
 
@@ -299,6 +359,7 @@ static Value *Mem2Reg(Value *V, tree type, LLVMBuilder &Builder) {
 
   if (MemTy == RegTy)
     return V;
+  ++ConvStats.Mem2RegConversions;
 
   if (RegTy->isIntegerTy()) {
     assert(MemTy->isIntegerTy() && "Type mismatch!");
@@ -353,6 +414,7 @@ static Value *Reg2Mem(Value *V, tree type, LLVMBuilder &Builder) {
 
   if (RegTy == MemTy)
     return V;
+  ++ConvStats.Reg2MemConversions;
 
   if (MemTy->isIntegerTy()) {
     assert(RegTy->isIntegerTy() && "Type mismatch!");
@@ -485,7 +547,8 @@ static bool isDirectMemoryAccessSafe(Type *RegTy, tree type) {
 /// the memory location pointed to by Loc.  Takes care of adjusting for any
 /// differences between in-memory and in-register types (the returned value
 /// is of in-register type, as returned by getRegType).
-static Value *LoadRegisterFromMemory(MemRef Loc, tree type, MDNode *AliasTag,
+static Value *LoadRegisterFromMemory(MemRef Loc, tree type,
+                                     const AccessTags &Tags,
                                      LLVMBuilder &Builder) {
   // NOTE: Needs to be kept in sync with getRegType.
   Type *RegTy = getRegType(type);
@@ -493,7 +556,7 @@ static Value *LoadRegisterFromMemory(MemRef Loc, tree type, MDNode *AliasTag,
   // If loading the register type directly out of memory gives the right result,
   // then just do that.
   if (isDirectMemoryAccessSafe(RegTy, type)) {
-    LoadInst *LI = LoadFromLocation(Loc, RegTy, AliasTag, Builder);
+    LoadInst *LI = LoadFromLocation(Loc, RegTy, Tags, Builder);
     MDNode *Range = describeTypeRange(type);
     if (Range)
       LI->setMetadata(LLVMContext::MD_range, Range);
@@ -523,7 +586,7 @@ static Value *LoadRegisterFromMemory(MemRef Loc, tree type, MDNode *AliasTag,
     // big endian machines.
     unsigned Size = GET_MODE_BITSIZE(TYPE_MODE(type));
     Type *MemTy = IntegerType::get(Context, Size);
-    LoadInst *LI = LoadFromLocation(Loc, MemTy, AliasTag, Builder);
+    LoadInst *LI = LoadFromLocation(Loc, MemTy, Tags, Builder);
     MDNode *Range = describeTypeRange(type);
     if (Range)
       LI->setMetadata(LLVMContext::MD_range, Range);
@@ -534,9 +597,9 @@ static Value *LoadRegisterFromMemory(MemRef Loc, tree type, MDNode *AliasTag,
     // Load the complex number component by component.
     tree elt_type = main_type(type);
     unsigned Stride = GET_MODE_SIZE(TYPE_MODE(elt_type));
-    Value *RealPart = LoadRegisterFromMemory(Loc, elt_type, AliasTag, Builder);
+    Value *RealPart = LoadRegisterFromMemory(Loc, elt_type, Tags, Builder);
     Loc = DisplaceLocationByUnits(Loc, Stride, Builder);
-    Value *ImagPart = LoadRegisterFromMemory(Loc, elt_type, AliasTag, Builder);
+    Value *ImagPart = LoadRegisterFromMemory(Loc, elt_type, Tags, Builder);
     Value *Res = UndefValue::get(RegTy);
     Res = Builder.CreateInsertValue(Res, RealPart, 0);
     Res = Builder.CreateInsertValue(Res, ImagPart, 1);
@@ -558,7 +621,7 @@ static Value *LoadRegisterFromMemory(MemRef Loc, tree type, MDNode *AliasTag,
         // It does!  Load out the memory as a vector of that type then truncate
         // to the register size.
         Type *MemVecTy = VectorType::get(MemTy, NumElts);
-        LoadInst *LI = LoadFromLocation(Loc, MemVecTy, AliasTag, Builder);
+        LoadInst *LI = LoadFromLocation(Loc, MemVecTy, Tags, Builder);
         return Builder.CreateTruncOrBitCast(LI, RegTy);
       }
     }
@@ -567,7 +630,7 @@ static Value *LoadRegisterFromMemory(MemRef Loc, tree type, MDNode *AliasTag,
     unsigned Stride = GET_MODE_SIZE(TYPE_MODE(elt_type));
     for (unsigned i = 0; i != NumElts; ++i) {
       Value *Idx = Builder.getInt32(i);
-      Value *Elt = LoadRegisterFromMemory(Loc, elt_type, AliasTag, Builder);
+      Value *Elt = LoadRegisterFromMemory(Loc, elt_type, Tags, Builder);
       Res = Builder.CreateInsertElement(Res, Elt, Idx);
       if (i + 1 != NumElts)
         Loc = DisplaceLocationByUnits(Loc, Stride, Builder);
@@ -581,14 +644,15 @@ static Value *LoadRegisterFromMemory(MemRef Loc, tree type, MDNode *AliasTag,
 /// Loc.  Takes care of adjusting for any differences between the value's type
 /// (which is the in-register type given by getRegType) and the in-memory type.
 static void StoreRegisterToMemory(Value *V, MemRef Loc, tree type,
-                                  MDNode *AliasTag, LLVMBuilder &Builder) {
+                                  const AccessTags &Tags,
+                                  LLVMBuilder &Builder) {
   // NOTE: Needs to be kept in sync with getRegType.
   assert(V->getType() == getRegType(type) && "Not of register type!");
 
   // If storing the register directly to memory gives the right result, then
   // just do that.
   if (isDirectMemoryAccessSafe(V->getType(), type)) {
-    StoreToLocation(V, Loc, AliasTag, Builder);
+    StoreToLocation(V, Loc, Tags, Builder);
     return;
   }
 
@@ -615,7 +679,7 @@ static void StoreRegisterToMemory(Value *V, MemRef Loc, tree type,
     unsigned Size = GET_MODE_BITSIZE(TYPE_MODE(type));
     Type *MemTy = IntegerType::get(Context, Size);
     V = Builder.CreateIntCast(V, MemTy, /*isSigned*/ !TYPE_UNSIGNED(type));
-    StoreToLocation(V, Loc, AliasTag, Builder);
+    StoreToLocation(V, Loc, Tags, Builder);
     break;
   }
 
@@ -625,9 +689,9 @@ static void StoreRegisterToMemory(Value *V, MemRef Loc, tree type,
     unsigned Stride = GET_MODE_SIZE(TYPE_MODE(elt_type));
     Value *RealPart = Builder.CreateExtractValue(V, 0);
     Value *ImagPart = Builder.CreateExtractValue(V, 1);
-    StoreRegisterToMemory(RealPart, Loc, elt_type, AliasTag, Builder);
+    StoreRegisterToMemory(RealPart, Loc, elt_type, Tags, Builder);
     Loc = DisplaceLocationByUnits(Loc, Stride, Builder);
-    StoreRegisterToMemory(ImagPart, Loc, elt_type, AliasTag, Builder);
+    StoreRegisterToMemory(ImagPart, Loc, elt_type, Tags, Builder);
     break;
   }
 
@@ -648,7 +712,7 @@ static void StoreRegisterToMemory(Value *V, MemRef Loc, tree type,
         Type *MemVecTy = VectorType::get(MemTy, NumElts);
         V = Builder.CreateIntCast(V, MemVecTy,
                                   /*isSigned*/ !TYPE_UNSIGNED(elt_type));
-        StoreToLocation(V, Loc, AliasTag, Builder);
+        StoreToLocation(V, Loc, Tags, Builder);
         break;
       }
     }
@@ -657,7 +721,7 @@ static void StoreRegisterToMemory(Value *V, MemRef Loc, tree type,
     for (unsigned i = 0; i != NumElts; ++i) {
       Value *Idx = Builder.getInt32(i);
       Value *Elt = Builder.CreateExtractElement(V, Idx);
-      StoreRegisterToMemory(Elt, Loc, elt_type, AliasTag, Builder);
+      StoreRegisterToMemory(Elt, Loc, elt_type, Tags, Builder);
       if (i + 1 != NumElts)
         Loc = DisplaceLocationByUnits(Loc, Stride, Builder);
     }
@@ -666,6 +730,316 @@ static void StoreRegisterToMemory(Value *V, MemRef Loc, tree type,
   }
 }
 
+//===----------------------------------------------------------------------===//
+//                           ... Profile Data ...
+//===----------------------------------------------------------------------===//
+
+/// hasProfileCounts - Whether the execution counts for the current function
+/// were read from a profile, for example because of -fprofile-use.
+static bool hasProfileCounts() {
+#if GCC_VERSION_CODE > GCC_VERSION(4, 8)
+  return profile_status_for_fn(cfun) == PROFILE_READ;
+#else
+  return profile_status_for_function(cfun) == PROFILE_READ;
+#endif
+}
+
+/// hasGuessedProbabilities - Whether GCC estimated how likely each edge of the
+/// current function is to be taken, which it does when its optimizers run.
+/// The estimates take __builtin_expect, noreturn calls and the like into
+/// account.
+static bool hasGuessedProbabilities() {
+#if GCC_VERSION_CODE > GCC_VERSION(4, 8)
+  return profile_status_for_fn(cfun) == PROFILE_GUESSED;
+#else
+  return profile_status_for_function(cfun) == PROFILE_GUESSED;
+#endif
+}
+
+/// getEdgeProbability - GCC's estimate of how likely the given edge is to be
+/// taken, out of REG_BR_PROB_BASE.
+static uint64_t getEdgeProbability(edge e) {
+#if (GCC_MAJOR > 7)
+  return e->probability.initialized_p() ? e->probability.to_reg_br_prob_base()
+                                        : REG_BR_PROB_BASE / 2;
+#else
+  return e->probability;
+#endif
+}
+
+/// getBlockCount - The number of times the given basic block was executed.
+static uint64_t getBlockCount(basic_block bb) {
+#if (GCC_MAJOR > 7)
+  return bb->count.initialized_p() ? bb->count.to_gcov_type() : 0;
+#else
+  return bb->count > 0 ? bb->count : 0;
+#endif
+}
+
+/// getEdgeCount - The number of times the given edge was taken.
+static uint64_t getEdgeCount(edge e) {
+#if (GCC_MAJOR > 7)
+  profile_count Count = e->count();
+  return Count.initialized_p() ? Count.to_gcov_type() : 0;
+#else
+  return e->count > 0 ? e->count : 0;
+#endif
+}
+
+/// isCheckFailureBlock - Whether the basic block starts by calling a function
+/// that does not return, like the routines raising Ada's Constraint_Error
+/// (__gnat_rcheck_*), abort or __builtin_trap.  Such blocks are where language
+/// and user checks go when they fail, so are almost never executed.
+static bool isCheckFailureBlock(basic_block bb) {
+  for (gimple_stmt_iterator gsi = gsi_start_bb(bb); !gsi_end_p(gsi);
+       gsi_next(&gsi)) {
+    GimpleTy *S = gsi_stmt(gsi);
+    if (is_gimple_debug(S) || gimple_code(S) == GIMPLE_LABEL)
+      continue;
+    return is_gimple_call(S) && (gimple_call_flags(S) & ECF_NORETURN);
+  }
+  return false;
+}
+
+/// isUnreachableBlock - Whether the basic block starts by calling
+/// __builtin_unreachable, which is how users tell the compiler that a
+/// condition leading there never holds.
+static bool isUnreachableBlock(basic_block bb) {
+  for (gimple_stmt_iterator gsi = gsi_start_bb(bb); !gsi_end_p(gsi);
+       gsi_next(&gsi)) {
+    GimpleTy *S = gsi_stmt(gsi);
+    if (is_gimple_debug(S) || gimple_code(S) == GIMPLE_LABEL)
+      continue;
+    if (!is_gimple_call(S))
+      return false;
+    tree fndecl = gimple_call_fndecl(S);
+    return fndecl && DECL_BUILT_IN_CLASS(fndecl) == BUILT_IN_NORMAL &&
+           DECL_FUNCTION_CODE(fndecl) == BUILT_IN_UNREACHABLE;
+  }
+  return false;
+}
+
+/// createBranchWeights - Return branch weight metadata for a branch whose
+/// successors were executed the given number of times, or null if the branch
+/// was never executed.
+static MDNode *createBranchWeights(LLVMContext &Context,
+                                   ArrayRef<uint64_t> Counts) {
+  uint64_t Max = 0;
+  for (unsigned i = 0, e = Counts.size(); i != e; ++i)
+    Max = std::max(Max, Counts[i]);
+  if (!Max)
+    return 0;
+
+  // Weights are 32 bits wide, so scale big counts down.  Adding one means that
+  // a successor that was never executed does not get a weight of zero.
+  uint64_t Scale = Max < UINT32_MAX ? 1 : Max / UINT32_MAX + 1;
+  SmallVector<uint32_t, 8> Weights;
+  for (unsigned i = 0, e = Counts.size(); i != e; ++i)
+    Weights.push_back(Counts[i] / Scale + 1);
+  return MDBuilder(Context).createBranchWeights(Weights);
+}
+
+/// ProfileBlockCounts, ProfileEntryCounts - The execution counts of all basic
+/// blocks with profile data converted so far, and the entry counts of their
+/// functions.  Used to build the module's profile summary.
+static std::vector<uint64_t> ProfileBlockCounts, ProfileEntryCounts;
+
+/// EmitProfileSummary - If any of the functions converted had profile data,
+/// attach a summary of the execution counts to the module.  This is what lets
+/// the optimizers, in particular the inliner, tell hot code from cold code.
+void EmitProfileSummary() {
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 9)
+  if (ProfileEntryCounts.empty() || TheModule->getProfileSummary())
+    return;
+
+  std::vector<uint64_t> Counts(ProfileBlockCounts);
+  Counts.insert(Counts.end(), ProfileEntryCounts.begin(),
+                ProfileEntryCounts.end());
+  std::sort(Counts.begin(), Counts.end(), std::greater<uint64_t>());
+  uint64_t Total = 0;
+  for (unsigned i = 0, e = Counts.size(); i != e; ++i)
+    Total += Counts[i];
+
+  // For each cutoff, the smallest count such that blocks executed at least that
+  // often account for the given fraction (in millionths) of all execution.
+  // These are the cutoffs used by LLVM's own profile readers.
+  static const uint32_t Cutoffs[] = { 10000,  100000, 200000, 300000, 400000,
+                                      500000, 600000, 700000, 800000, 900000,
+                                      950000, 990000, 999000, 999900, 999990,
+                                      999999 };
+  SummaryEntryVector DetailedSummary;
+  uint64_t Accumulated = 0;
+  unsigned Index = 0;
+  for (unsigned i = 0, e = array_lengthof(Cutoffs); i != e; ++i) {
+    uint64_t Desired = (uint64_t)((long double)Total * Cutoffs[i] / 1000000);
+    while (Index != Counts.size() && (Accumulated < Desired || !Index))
+      Accumulated += Counts[Index++];
+    DetailedSummary.push_back(
+        ProfileSummaryEntry(Cutoffs[i], Counts[Index - 1], Index));
+  }
+
+  uint64_t MaxInternal = 0, MaxEntry = 0;
+  for (unsigned i = 0, e = ProfileBlockCounts.size(); i != e; ++i)
+    MaxInternal = std::max(MaxInternal, ProfileBlockCounts[i]);
+  for (unsigned i = 0, e = ProfileEntryCounts.size(); i != e; ++i)
+    MaxEntry = std::max(MaxEntry, ProfileEntryCounts[i]);
+
+  ProfileSummary Summary(ProfileSummary::PSK_Instr, DetailedSummary, Total,
+                         Counts.front(), MaxInternal, MaxEntry, Counts.size(),
+                         ProfileEntryCounts.size());
+  TheModule->setProfileSummary(Summary.getMD(TheModule->getContext()));
+#endif
+}
+
+/// CallGraphCounts - For each caller and callee with profile data, how many
+/// times the callee was called directly from the caller.
+static DenseMap<std::pair<tree, tree>, uint64_t> CallGraphCounts;
+
+/// EmitCallGraphProfile - If any direct calls were found to be executed when
+/// profiling, record how often each function called each other function in
+/// the module, so that the linker can place functions that call each other a
+/// lot next to each other.
+void EmitCallGraphProfile() {
+#if LLVM_VERSION_CODE > LLVM_VERSION(6, 0)
+  if (CallGraphCounts.empty())
+    return;
+
+  LLVMContext &Context = TheModule->getContext();
+  std::vector<Metadata *> Edges;
+  for (DenseMap<std::pair<tree, tree>, uint64_t>::iterator
+           I = CallGraphCounts.begin(), E = CallGraphCounts.end();
+       I != E; ++I) {
+    Value *Caller = DECL_LLVM_IF_SET(I->first.first);
+    Value *Callee = DECL_LLVM_IF_SET(I->first.second);
+    if (!Caller || !Callee || !I->second)
+      continue;
+    Function *From = dyn_cast<Function>(Caller->stripPointerCasts());
+    Function *To = dyn_cast<Function>(Callee->stripPointerCasts());
+    if (!From || !To)
+      continue;
+    Metadata *Edge[] = { ValueAsMetadata::get(From), ValueAsMetadata::get(To),
+                         ConstantAsMetadata::get(ConstantInt::get(
+                             Type::getInt64Ty(Context), I->second)) };
+    Edges.push_back(MDTuple::get(Context, Edge));
+  }
+  CallGraphCounts.clear();
+
+  if (!Edges.empty())
+    TheModule->addModuleFlag(Module::Append, "CG Profile",
+                             MDTuple::get(Context, Edges));
+#endif
+}
+
+//===----------------------------------------------------------------------===//
+//                       ... OpenMP Outlined Regions ...
+//===----------------------------------------------------------------------===//
+
+/// OpenMPRegionKind - How a libgomp routine runs the outlined body of an OpenMP
+/// region: on a team of threads that have finished when it returns, on a team
+/// of threads that finish in GOMP_parallel_end, or as a task given a copy of
+/// the data.
+enum OpenMPRegionKind {
+  OMP_REGION_NONE = 0,
+  OMP_REGION_PARALLEL,
+  OMP_REGION_START,
+  OMP_REGION_TASK
+};
+
+/// getOpenMPRegionKind - If the given function is a libgomp routine taking the
+/// outlined body of an OpenMP region and its data as its first two arguments,
+/// return how it runs the body.
+static unsigned getOpenMPRegionKind(tree fndecl) {
+  if (!DECL_NAME(fndecl) || !DECL_EXTERNAL(fndecl))
+    return OMP_REGION_NONE;
+  StringRef Name = IDENTIFIER_POINTER(DECL_NAME(fndecl));
+  if (Name == "GOMP_task")
+    return OMP_REGION_TASK;
+  if (!Name.startswith("GOMP_parallel") || Name.endswith("_end"))
+    return OMP_REGION_NONE;
+  return Name.endswith("_start") ? OMP_REGION_START : OMP_REGION_PARALLEL;
+}
+
+/// OpenMPChildData - What is known about the block of data that the outlined
+/// body of an OpenMP region is passed.  Only calls from libgomp pass it, so the
+/// optimizers cannot work this out for themselves.
+struct OpenMPChildData {
+  uint64_t Size;  // The number of bytes that can be read, or zero if unknown.
+  unsigned Align; // The alignment in bytes, or zero if unknown.
+};
+
+/// OpenMPChildren - The outlined bodies of the OpenMP regions started so far,
+/// and the data they are passed.
+static DenseMap<tree, OpenMPChildData> OpenMPChildren;
+
+/// NoteOpenMPChild - Record what the given call starting an OpenMP region
+/// passes to the outlined body of the region.
+static void NoteOpenMPChild(GimpleTy *stmt, unsigned Kind) {
+  tree fn = gimple_call_arg(MIG_TO_GCALL(stmt), 0);
+  if (!isa<ADDR_EXPR>(fn) || !isa<FUNCTION_DECL>(TREE_OPERAND(fn, 0)))
+    return;
+  tree data = gimple_call_arg(MIG_TO_GCALL(stmt), 1);
+
+  OpenMPChildData Data = { 0, 0 };
+  if (Kind == OMP_REGION_TASK) {
+    // The body is passed a copy of the data made by libgomp, of the given size
+    // and alignment.
+    tree size = gimple_call_num_args(MIG_TO_GCALL(stmt)) > 4 ?
+                gimple_call_arg(MIG_TO_GCALL(stmt), 3) : NULL_TREE;
+    tree align = size ? gimple_call_arg(MIG_TO_GCALL(stmt), 4) : NULL_TREE;
+    if (size && isInt64(size, true) && align && isInt64(align, true)) {
+      Data.Size = getInt64(size, true);
+      Data.Align = (unsigned) getInt64(align, true);
+    }
+  } else if (isa<ADDR_EXPR>(data) && isa<VAR_DECL>(TREE_OPERAND(data, 0))) {
+    tree decl = TREE_OPERAND(data, 0);
+    if (DECL_SIZE_UNIT(decl) && isInt64(DECL_SIZE_UNIT(decl), true))
+      Data.Size = getInt64(DECL_SIZE_UNIT(decl), true);
+    Data.Align = DECL_ALIGN_UNIT(decl);
+  }
+
+  // If several calls start the same body, only keep what holds for all.
+  std::pair<DenseMap<tree, OpenMPChildData>::iterator, bool> Entry =
+      OpenMPChildren.insert(std::make_pair(TREE_OPERAND(fn, 0), Data));
+  if (!Entry.second) {
+    OpenMPChildData &Old = Entry.first->second;
+    Old.Size = std::min(Old.Size, Data.Size);
+    Old.Align = std::min(Old.Align, Data.Align);
+  }
+}
+
+/// EmitOpenMPChildAttributes - Tell the outlined bodies of the OpenMP regions
+/// in the module that the data they are passed is not null, and how big and
+/// how aligned it is.
+void EmitOpenMPChildAttributes() {
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 5)
+  for (DenseMap<tree, OpenMPChildData>::iterator I = OpenMPChildren.begin(),
+                                                  E = OpenMPChildren.end();
+       I != E; ++I) {
+    Value *V = DECL_LLVM_IF_SET(I->first);
+    Function *F = V ? dyn_cast<Function>(V->stripPointerCasts()) : 0;
+    if (!F || F->arg_size() != 1 || !F->arg_begin()->getType()->isPointerTy())
+      continue;
+    const OpenMPChildData &Data = I->second;
+    AttrBuilder AttrBuilder;
+    if (Data.Size) {
+      if (flag_delete_null_pointer_checks)
+        AttrBuilder.addAttribute(Attribute::NonNull);
+      AttrBuilder.addDereferenceableAttr(Data.Size);
+    }
+    if (Data.Align > 1)
+      AttrBuilder.addAlignmentAttr(Data.Align);
+    if (!AttrBuilder.hasAttributes())
+      continue;
+#if LLVM_VERSION_CODE > LLVM_VERSION(4, 0)
+    F->addParamAttrs(0, AttrBuilder);
+#else
+    F->addAttributes(1, MigAttributeSet::get(F->getContext(), 1, AttrBuilder));
+#endif
+  }
+#endif
+  OpenMPChildren.clear();
+}
+
 //===----------------------------------------------------------------------===//
 //                         ... High-Level Methods ...
 //===----------------------------------------------------------------------===//
@@ -683,6 +1057,25 @@ const DataLayout &getDataLayout() {
 #endif
 }
 
+#if GCC_VERSION_CODE > GCC_VERSION(4, 8)
+/// isNotSanitized - Whether the given function has an attribute asking for the
+/// sanitizer with the given GCC flag not to instrument it.  Before GCC 8 each
+/// sanitizer has its own attribute.
+static bool isNotSanitized(tree fndecl, unsigned Flag, const char *AttrName) {
+#if (GCC_MAJOR > 7)
+  (void)AttrName;
+  tree attr = lookup_attribute("no_sanitize", DECL_ATTRIBUTES(fndecl));
+  return attr && (tree_to_uhwi(TREE_VALUE(attr)) & Flag);
+#else
+  (void)Flag;
+  return lookup_attribute(AttrName, DECL_ATTRIBUTES(fndecl)) ||
+         (!strcmp(AttrName, "no_sanitize_address") &&
+          lookup_attribute("no_address_safety_analysis",
+                           DECL_ATTRIBUTES(fndecl)));
+#endif
+}
+#endif
+
 /// EmitDebugInfo - Return true if debug info is to be emitted for current
 /// function.
 bool TreeToLLVM::EmitDebugInfo() {
@@ -691,6 +1084,25 @@ bool TreeToLLVM::EmitDebugInfo() {
   return false;
 }
 
+/// TheFunctionTables - The tables used by whichever function is being
+/// converted.
+static FunctionTables TheFunctionTables;
+
+void FunctionTables::clear() {
+  BasicBlocks.clear();
+  NamedBlocks.clear();
+  LocalDecls.clear();
+  PendingPhis.clear();
+  SSANames.clear();
+  SSAPlaceholders.clear();
+  ReplacedPlaceholders.clear();
+  NormalInvokes.clear();
+  ExceptionPtrs.clear();
+  ExceptionFilters.clear();
+  FailureBlocks.clear();
+  FailureBlocksByDecl.clear();
+}
+
 TreeToLLVM::TreeToLLVM(tree fndecl)
     : DL(getDataLayout()), Builder(
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
@@ -698,30 +1110,61 @@ TreeToLLVM::TreeToLLVM(tree fndecl)
 #else
             TheContext,
 #endif
-            *TheFolder) {
+            *TheFolder),
+      Tables(TheFunctionTables), BasicBlocks(Tables.BasicBlocks),
+      NamedBlocks(Tables.NamedBlocks),
+      LocalDecls(Tables.LocalDecls), PendingPhis(Tables.PendingPhis),
+      SSANames(Tables.SSANames), SSAPlaceholders(Tables.SSAPlaceholders),
+      ReplacedPlaceholders(Tables.ReplacedPlaceholders),
+      NormalInvokes(Tables.NormalInvokes),
+      ExceptionPtrs(Tables.ExceptionPtrs),
+      ExceptionFilters(Tables.ExceptionFilters),
+      FailureBlocks(Tables.FailureBlocks),
+      FailureBlocksByDecl(Tables.FailureBlocksByDecl) {
   FnDecl = fndecl;
   AllocaInsertionPoint = 0;
   Fn = 0;
   ReturnBB = 0;
   ReturnOffset = 0;
 
+  // GCC knows how big the function is, so size the tables up front rather than
+  // having them grow (and rehash) as the function is converted.
+  if (cfun && cfun->decl == fndecl) {
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+#if GCC_VERSION_CODE > GCC_VERSION(4, 8)
+    BasicBlocks.reserve(n_basic_blocks_for_fn(cfun));
+#else
+    BasicBlocks.reserve(n_basic_blocks);
+#endif
+#endif
+    if (cfun->gimple_df)
+      SSANames.resize(num_ssa_names);
+  }
+
   if (EmitDebugInfo()) {
     expanded_location Location = expand_location(DECL_SOURCE_LOCATION(fndecl));
 
     if (Location.file) {
       TheDebugInfo->setLocationFile(Location.file);
       TheDebugInfo->setLocationLine(Location.line);
+      TheDebugInfo->setLocationColumn(Location.column);
     } else {
       TheDebugInfo->setLocationFile("");
       TheDebugInfo->setLocationLine(0);
+      TheDebugInfo->setLocationColumn(0);
     }
+    TheDebugInfo->setLocationBlock(NULL);
   }
 
   assert(TheTreeToLLVM == 0 && "Reentering function creation?");
   TheTreeToLLVM = this;
 }
 
-TreeToLLVM::~TreeToLLVM() { TheTreeToLLVM = 0; }
+TreeToLLVM::~TreeToLLVM() {
+  // Keep the memory for the next function.
+  Tables.clear();
+  TheTreeToLLVM = 0;
+}
 
 //===----------------------------------------------------------------------===//
 //                         ... Local declarations ...
@@ -1034,6 +1477,77 @@ static bool isPassedByVal(tree type, Type *Ty, std::vector<Type *> &ScalarArgs,
   return false;
 }
 
+/// needsUnwindTables - Whether GCC would give the given function unwind tables
+/// even if it cannot throw: -funwind-tables or -fasynchronous-unwind-tables,
+/// which may differ from those of the compilation unit because of an optimize
+/// attribute or pragma.
+static bool needsUnwindTables(tree fndecl) {
+  tree opts = DECL_FUNCTION_SPECIFIC_OPTIMIZATION(fndecl);
+  struct cl_optimization *Opts =
+      TREE_OPTIMIZATION(opts ? opts : optimization_default_node);
+#if GCC_VERSION_CODE > GCC_VERSION(4, 5)
+  return Opts->x_flag_unwind_tables || Opts->x_flag_asynchronous_unwind_tables;
+#else
+  (void)Opts; // Not optimization options in GCC 4.5.
+  return flag_unwind_tables || flag_asynchronous_unwind_tables;
+#endif
+}
+
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 3)
+/// getExplicitOmitFramePointer - Whether the optimize attribute of the given
+/// function, which #pragma GCC optimize also provides, asks for frame pointers
+/// to be omitted (1) or kept (0).  Returns -1 if it says nothing about them.
+static int getExplicitOmitFramePointer(tree fndecl) {
+  int Result = -1;
+  for (tree attr = lookup_attribute("optimize", DECL_ATTRIBUTES(fndecl)); attr;
+       attr = lookup_attribute("optimize", TREE_CHAIN(attr)))
+    for (tree arg = TREE_VALUE(attr); arg; arg = TREE_CHAIN(arg)) {
+      if (TREE_CODE(TREE_VALUE(arg)) != STRING_CST)
+        continue;
+      SmallVector<StringRef, 4> Options;
+      StringRef(TREE_STRING_POINTER(TREE_VALUE(arg))).split(Options, ",");
+      for (unsigned i = 0, e = Options.size(); i != e; ++i) {
+        StringRef Option = Options[i];
+        if (Option.startswith("-f"))
+          Option = Option.substr(2);
+        if (Option == "omit-frame-pointer")
+          Result = 1;
+        else if (Option == "no-omit-frame-pointer")
+          Result = 0;
+      }
+    }
+  return Result;
+}
+
+/// getFramePointerPolicy - Which frame pointers to keep for the given function:
+/// "all", "non-leaf" or "none", as for LLVM's "frame-pointer" attribute.  Uses
+/// the function's own -fomit-frame-pointer setting, which may differ from that
+/// of the compilation unit because of an optimize attribute or pragma.
+static StringRef getFramePointerPolicy(tree fndecl) {
+  // An optimize attribute naming the option decides, even over
+  // -momit-leaf-frame-pointer.
+  int Explicit = getExplicitOmitFramePointer(fndecl);
+  if (Explicit >= 0)
+    return Explicit ? "none" : "all";
+#ifdef LLVM_OMIT_LEAF_FRAME_POINTER
+  // Checked before the function's options since GCC turns on
+  // -fomit-frame-pointer along with it, then keeps the frame pointer anyway in
+  // functions that make calls.
+  if (LLVM_OMIT_LEAF_FRAME_POINTER)
+    return "non-leaf";
+#endif
+  tree opts = DECL_FUNCTION_SPECIFIC_OPTIMIZATION(fndecl);
+  struct cl_optimization *Opts =
+      TREE_OPTIMIZATION(opts ? opts : optimization_default_node);
+#if GCC_VERSION_CODE > GCC_VERSION(4, 5)
+  bool OmitFramePointer = Opts->x_flag_omit_frame_pointer;
+#else
+  bool OmitFramePointer = Opts->flag_omit_frame_pointer;
+#endif
+  return OmitFramePointer ? "none" : "all";
+}
+#endif
+
 void TreeToLLVM::StartFunctionBody() {
   // TODO: Add support for dropping the leading '\1' in order to support
   //   unsigned bswap(unsigned) __asm__("llvm.bswap");
@@ -1079,7 +1593,7 @@ void TreeToLLVM::StartFunctionBody() {
     // function. Set to current.
     handleVisibility(FnDecl, Fn);
   } else {
-    std::string Name = getAssemblerName(FnDecl);
+    StringRef Name = getAssemblerName(FnDecl);
     Function *FnEntry = TheModule->getFunction(Name);
     if (FnEntry) {
       assert(FnEntry->getName() == Name && "Same entry, different name?");
@@ -1148,9 +1662,17 @@ void TreeToLLVM::StartFunctionBody() {
   if (DECL_STATIC_DESTRUCTOR(FnDecl))
     register_ctor_dtor(Fn, DECL_FINI_PRIORITY(FnDecl), false);
 
-  // Handle attribute "aligned".
-  if (DECL_ALIGN(FnDecl) != FUNCTION_BOUNDARY)
-    Fn->setAlignment(DECL_ALIGN(FnDecl) / 8);
+  // Handle attribute "aligned", and -falign-functions if the user gave it.  As
+  // in GCC, the option does not apply if the alignment was given explicitly,
+  // nor to functions optimized for size.  The code generator never aligns
+  // functions less than the target prefers.
+  unsigned FnAlign = DECL_ALIGN(FnDecl);
+  int AlignLog = USER_ALIGNMENT_LOG(align_functions);
+  if (!DECL_USER_ALIGN(FnDecl) && AlignLog >= 0 && !optimize_size &&
+      !lookup_attribute("cold", DECL_ATTRIBUTES(FnDecl)))
+    FnAlign = std::max(FnAlign, 8U << AlignLog);
+  if (FnAlign != FUNCTION_BOUNDARY)
+    Fn->setAlignment(FnAlign / 8);
 
   // Handle functions in specified sections.
   if (DECL_SECTION_NAME(FnDecl))
@@ -1178,20 +1700,79 @@ void TreeToLLVM::StartFunctionBody() {
   if (DECL_DECLARED_INLINE_P(FnDecl))
     Fn->addFnAttr(Attribute::InlineHint);
 
-  if (optimize_size)
+  // With -fplugin-arg-dragonegg-minsize, or GCC's own -Oz, size matters more
+  // than speed, except in functions marked hot.  The code generator then also
+  // outlines repeated code sequences, on targets that support it.
+  if (optimize_size) {
     Fn->addFnAttr(Attribute::OptimizeForSize);
+    if ((optimize_size > 1 || flag_minsize) &&
+        !lookup_attribute("hot", DECL_ATTRIBUTES(FnDecl)))
+      Fn->addFnAttr(Attribute::MinSize);
+  }
 
-  // Handle stack smashing protection.
-  if (flag_stack_protect == 1)
-    Fn->addFnAttr(Attribute::StackProtect);
-  else if (flag_stack_protect == 2)
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 9)
+  // With -freorder-functions GCC puts functions marked cold or hot in
+  // .text.unlikely or .text.hot, so that code which runs together shares
+  // pages.  Other functions are placed by the code generator if there is
+  // profile data, using the profile summary.
+  if (flag_reorder_functions) {
+    if (lookup_attribute("cold", DECL_ATTRIBUTES(FnDecl)))
+      Fn->setSectionPrefix(".unlikely");
+    else if (lookup_attribute("hot", DECL_ATTRIBUTES(FnDecl)))
+      Fn->setSectionPrefix(".hot");
+  }
+#endif
+
+  // Handle stack smashing protection the way GCC does: -fstack-protector-all
+  // and the stack_protect attribute protect the function whatever it contains,
+  // while -fstack-protector-explicit (4) protects nothing else.  Otherwise the
+  // code generator works out which functions need protecting.
+  bool ExplicitSSP =
+#if (GCC_MAJOR > 4)
+      lookup_attribute("stack_protect", DECL_ATTRIBUTES(FnDecl));
+#else
+      false;
+#endif
+  bool Protected = true;
+  if (flag_stack_protect == 2 || (flag_stack_protect && ExplicitSSP))
     Fn->addFnAttr(Attribute::StackProtectReq);
+  else if (flag_stack_protect == 1)
+    Fn->addFnAttr(Attribute::StackProtect);
   else if (flag_stack_protect == 3)
     Fn->addFnAttr(Attribute::StackProtectStrong);
+  else
+    Protected = false;
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 3)
-  if (flag_stack_protect)
+  if (Protected)
     Fn->addFnAttr("stack-protector-buffer-size",
                   utostr(PARAM_VALUE(PARAM_SSP_BUFFER_SIZE)));
+#else
+  (void)Protected; // Avoid compiler warning.
+#endif
+
+#if GCC_VERSION_CODE > GCC_VERSION(4, 5) && \
+    LLVM_VERSION_CODE > LLVM_VERSION(3, 4)
+  // With -fsplit-stack, which gccgo turns on by default, the function starts
+  // by checking for stack space and calling libgcc's __morestack to get more
+  // when there is not enough, so that goroutines can start with tiny stacks.
+  if (flag_split_stack > 0 &&
+      !lookup_attribute("no_split_stack", DECL_ATTRIBUTES(FnDecl)))
+    Fn->addFnAttr("split-stack");
+#endif
+
+#if GCC_VERSION_CODE > GCC_VERSION(4, 8)
+  // Have LLVM's sanitizers instrument the function, unless it asks not to be.
+#if (GCC_MAJOR > 4)
+  if (flag_llvm_sanitize_address &&
+      !isNotSanitized(FnDecl, SANITIZE_USER_ADDRESS, "no_sanitize_address"))
+#else
+  if (flag_llvm_sanitize_address &&
+      !isNotSanitized(FnDecl, SANITIZE_ADDRESS, "no_sanitize_address"))
+#endif
+    Fn->addFnAttr(Attribute::SanitizeAddress);
+  if (flag_llvm_sanitize_thread &&
+      !isNotSanitized(FnDecl, SANITIZE_THREAD, "no_sanitize_thread"))
+    Fn->addFnAttr(Attribute::SanitizeThread);
 #endif
 
   // Handle naked attribute
@@ -1200,12 +1781,17 @@ void TreeToLLVM::StartFunctionBody() {
 
   // Handle frame pointers.
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 3)
-  if (flag_omit_frame_pointer) {
-    // Eliminate frame pointers everywhere.
-    Fn->addFnAttr("no-frame-pointer-elim-non-leaf", "false");
-  } else {
-    // Keep frame pointers everywhere.
-    Fn->addFnAttr("no-frame-pointer-elim-non-leaf", "true");
+  {
+    StringRef Policy = getFramePointerPolicy(FnDecl);
+#if LLVM_VERSION_CODE > LLVM_VERSION(9, 0)
+    Fn->addFnAttr("frame-pointer", Policy);
+#else
+    // Older LLVM only looks at whether the non-leaf attribute is present, not
+    // at its value.
+    Fn->addFnAttr("no-frame-pointer-elim", Policy == "all" ? "true" : "false");
+    if (Policy == "non-leaf")
+      Fn->addFnAttr("no-frame-pointer-elim-non-leaf");
+#endif
   }
 #endif
 
@@ -1213,6 +1799,26 @@ void TreeToLLVM::StartFunctionBody() {
 #ifdef LLVM_SET_TARGET_MACHINE_ATTRIBUTES
   LLVM_SET_TARGET_MACHINE_ATTRIBUTES(Fn);
 #endif
+#endif
+
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 6)
+#ifdef LLVM_SET_SUBTARGET_FEATURES
+  // Handle the target attribute, and the clones GCC makes for target_clones.
+  // GCC has already switched the target options over to those of the current
+  // function, so this gives the function its own subtarget.
+  if ((DECL_FUNCTION_SPECIFIC_TARGET(FnDecl) &&
+       DECL_FUNCTION_SPECIFIC_TARGET(FnDecl) != target_option_default_node)
+#ifdef LLVM_HAS_OWN_SUBTARGET
+      || LLVM_HAS_OWN_SUBTARGET(FnDecl)
+#endif
+      ) {
+    std::string CPU;
+    SubtargetFeatures Features;
+    LLVM_SET_SUBTARGET_FEATURES(CPU, Features);
+    Fn->addFnAttr("target-cpu", CPU);
+    Fn->addFnAttr("target-features", Features.getString());
+  }
+#endif
 #endif
 
   // Handle annotate attributes
@@ -1223,11 +1829,15 @@ void TreeToLLVM::StartFunctionBody() {
   if (!flag_exceptions)
     Fn->setDoesNotThrow();
 
-  if (flag_unwind_tables)
+  // GCC gives every function unwind tables if either of these is set for it,
+  // which an optimize attribute or pragma can do.  If not then LLVM only emits
+  // them for functions that may throw, like GCC does, so nothing is output for
+  // functions that are, or turn out to be, nounwind.
+  if (needsUnwindTables(FnDecl))
     Fn->setHasUWTable();
 
   // Create a new basic block for the function.
-  BasicBlock *EntryBlock = BasicBlock::Create(Context, "entry", Fn);
+  BasicBlock *EntryBlock = CreateNamedBlock("entry", Fn);
   BasicBlocks[ENTRY_BLOCK_PTR] = EntryBlock;
   Builder.SetInsertPoint(EntryBlock);
 
@@ -1255,7 +1865,8 @@ void TreeToLLVM::StartFunctionBody() {
   // Scalar arguments processed so far.
   std::vector<Type *> ScalarArgs;
   while (Args) {
-    std::string Name = getDescriptiveName(Args);
+    std::string Name =
+        flag_discard_value_names ? std::string() : getDescriptiveName(Args);
     if (Name.empty())
       Name = "unnamed_arg";
 
@@ -1345,6 +1956,18 @@ void TreeToLLVM::StartFunctionBody() {
   EmitVariablesInScope(DECL_INITIAL(FnDecl));
 }
 
+/// isSSAOnlyVariable - Whether the given local variable is only accessed via
+/// SSA names, so that no memory need be set aside for it unless some use of
+/// the variable turns up that asks for it.
+static bool isSSAOnlyVariable(tree decl) {
+  if (!is_gimple_reg(decl) || DECL_ATTRIBUTES(decl))
+    return false;
+  // Garbage collector roots are given memory and cleared on function entry.
+  tree type = TREE_TYPE(decl);
+  return !isa<ACCESS_TYPE>(type) ||
+         !lookup_attribute("gcroot", TYPE_ATTRIBUTES(type));
+}
+
 /// EmitVariablesInScope - Output a declaration for every variable in the
 /// given scope.
 void TreeToLLVM::EmitVariablesInScope(tree scope) {
@@ -1352,49 +1975,369 @@ void TreeToLLVM::EmitVariablesInScope(tree scope) {
     if (isa<VAR_DECL>(t))
       // If this is just the rotten husk of a variable that the gimplifier
       // eliminated all uses of, but is preserving for debug info, ignore it.
-      if (!DECL_HAS_VALUE_EXPR_P(t))
+      // Variables living entirely in SSA names would only get an alloca that
+      // is never used, which in big generated functions leaves the optimizers
+      // with thousands of them to delete.  Debug info describes variables by
+      // their memory though, so they still get one then.
+      if (!DECL_HAS_VALUE_EXPR_P(t) &&
+          (EmitDebugInfo() || !isSSAOnlyVariable(t)))
         make_decl_local(t);
   // Declare variables in contained scopes.
   for (tree t = BLOCK_SUBBLOCKS(scope); t; t = BLOCK_CHAIN(t))
     EmitVariablesInScope(t);
 }
 
+#if GCC_VERSION_CODE > GCC_VERSION(4, 6)
+/// isClobber - Whether the statement says that its left-hand side is dead.
+static bool isClobber(GimpleTy *stmt) {
+  return is_gimple_assign(stmt) &&
+         get_gimple_rhs_class(gimple_expr_code(stmt)) == GIMPLE_SINGLE_RHS &&
+         TREE_CLOBBER_P(gimple_assign_rhs1(stmt));
+}
+
+namespace {
+/// ScopedVarMentions - The variables of interest mentioned by a statement,
+/// gathered by walk_stmt_load_store_addr_ops.
+struct ScopedVarMentions {
+  const DenseMap<tree, unsigned> &Index;
+  SmallVector<unsigned, 4> Mentioned;
+  explicit ScopedVarMentions(const DenseMap<tree, unsigned> &I) : Index(I) {}
+};
+}
+
+#if GCC_VERSION_CODE > GCC_VERSION(4, 8)
+static bool NoteScopedVarMention(GimpleTy *, tree op, tree, void *data) {
+#else
+static bool NoteScopedVarMention(GimpleTy *, tree op, void *data) {
+#endif
+  ScopedVarMentions *M = (ScopedVarMentions *)data;
+  op = get_base_address(op);
+  if (op && DECL_P(op)) {
+    DenseMap<tree, unsigned>::const_iterator I = M->Index.find(op);
+    if (I != M->Index.end())
+      M->Mentioned.push_back(I->second);
+  }
+  return false;
+}
+
+/// ScanBlockLifetimes - Update Live, the variables that may be live, going
+/// through the basic block: a variable becomes live when it is mentioned and
+/// dies when it is clobbered.  If Starts is not null, record there where the
+/// variables that were certainly dead are mentioned.
+static void
+ScanBlockLifetimes(basic_block bb, BitVector &Live, ScopedVarMentions &M,
+                   const SmallVectorImpl<tree> &Vars,
+                   DenseMap<const void *, SmallVector<tree, 2> > *Starts) {
+  for (gimple_stmt_iterator gsi = gsi_start_phis(bb); !gsi_end_p(gsi);
+       gsi_next(&gsi)) {
+    M.Mentioned.clear();
+    walk_stmt_load_store_addr_ops(gsi_stmt(gsi), &M, NoteScopedVarMention,
+                                  NoteScopedVarMention, NoteScopedVarMention);
+    for (unsigned i = 0, e = M.Mentioned.size(); i != e; ++i)
+      if (!Live.test(M.Mentioned[i])) {
+        Live.set(M.Mentioned[i]);
+        if (Starts)
+          (*Starts)[bb].push_back(Vars[M.Mentioned[i]]);
+      }
+  }
+
+  for (gimple_stmt_iterator gsi = gsi_start_bb(bb); !gsi_end_p(gsi);
+       gsi_next(&gsi)) {
+    GimpleTy *stmt = gsi_stmt(gsi);
+    if (is_gimple_debug(stmt))
+      continue;
+    if (isClobber(stmt)) {
+      DenseMap<tree, unsigned>::const_iterator I =
+          M.Index.find(gimple_assign_lhs(stmt));
+      if (I != M.Index.end())
+        Live.reset(I->second);
+      continue;
+    }
+    M.Mentioned.clear();
+    walk_stmt_load_store_addr_ops(stmt, &M, NoteScopedVarMention,
+                                  NoteScopedVarMention, NoteScopedVarMention);
+    for (unsigned i = 0, e = M.Mentioned.size(); i != e; ++i)
+      if (!Live.test(M.Mentioned[i])) {
+        Live.set(M.Mentioned[i]);
+        if (Starts)
+          (*Starts)[stmt].push_back(Vars[M.Mentioned[i]]);
+      }
+  }
+}
+
+/// ComputeLifetimeStarts - Work out where the lifetimes of local variables
+/// that GCC clobbers at the end of their scope start.  The clobbers become
+/// lifetime end markers, but GIMPLE has nothing marking the start of a scope.
+/// Like GCC's own stack slot sharing, take a variable to be live from when it
+/// is mentioned until it is clobbered, and start its lifetime wherever it is
+/// mentioned at a point where it is dead on every path.
+void TreeToLLVM::ComputeLifetimeStarts() {
+  // The variables of interest are those that are clobbered somewhere.
+  DenseMap<tree, unsigned> Index;
+  SmallVector<tree, 16> Vars;
+  basic_block bb;
+  FOR_EACH_BB(bb)
+    for (gimple_stmt_iterator gsi = gsi_start_bb(bb); !gsi_end_p(gsi);
+         gsi_next(&gsi)) {
+      GimpleTy *stmt = gsi_stmt(gsi);
+      if (!isClobber(stmt))
+        continue;
+      tree var = gimple_assign_lhs(stmt);
+      if (!isa<VAR_DECL>(var) || TREE_STATIC(var) || DECL_EXTERNAL(var) ||
+          DECL_HAS_VALUE_EXPR_P(var) || DECL_HARD_REGISTER(var) ||
+          !isInt64(DECL_SIZE_UNIT(var), true))
+        continue;
+      if (Index.insert(std::make_pair(var, (unsigned) Vars.size())).second)
+        Vars.push_back(var);
+    }
+  if (Vars.empty())
+    return;
+
+  // Iterate to find the variables that may be live at the end of each block.
+#if GCC_VERSION_CODE > GCC_VERSION(4, 8)
+  unsigned NumBlocks = last_basic_block_for_fn(cfun);
+#else
+  unsigned NumBlocks = last_basic_block;
+#endif
+  std::vector<BitVector> LiveOut(NumBlocks, BitVector(Vars.size()));
+  ScopedVarMentions M(Index);
+  for (bool Changed = true; Changed;) {
+    Changed = false;
+    FOR_EACH_BB(bb) {
+      BitVector Live(Vars.size());
+      edge e;
+      edge_iterator ei;
+      FOR_EACH_EDGE(e, ei, bb->preds) Live |= LiveOut[e->src->index];
+      ScanBlockLifetimes(bb, Live, M, Vars, 0);
+      if (Live != LiveOut[bb->index]) {
+        LiveOut[bb->index] = Live;
+        Changed = true;
+      }
+    }
+  }
+
+  // Now note the places where the lifetimes start.
+  FOR_EACH_BB(bb) {
+    BitVector Live(Vars.size());
+    edge e;
+    edge_iterator ei;
+    FOR_EACH_EDGE(e, ei, bb->preds) Live |= LiveOut[e->src->index];
+    ScanBlockLifetimes(bb, Live, M, Vars, &LifetimeStarts);
+  }
+}
+
+/// EmitLifetimeStarts - Output lifetime start markers for the variables that
+/// ComputeLifetimeStarts associated with Key.
+void TreeToLLVM::EmitLifetimeStarts(const void *Key) {
+  DenseMap<const void *, SmallVector<tree, 2> >::iterator I =
+      LifetimeStarts.find(Key);
+  if (I == LifetimeStarts.end())
+    return;
+  for (unsigned i = 0, e = I->second.size(); i != e; ++i) {
+    tree var = I->second[i];
+    Value *Ptr = DECL_LOCAL(var);
+    if (isa<AllocaInst>(Ptr))
+      Builder.CreateLifetimeStart(
+          Ptr, Builder.getInt64(getInt64(DECL_SIZE_UNIT(var), true)));
+  }
+}
+#endif
+
+/// getSSAName - The value associated with the given SSA name, or null if there
+/// is none yet.
+Value *TreeToLLVM::getSSAName(tree reg) {
+  unsigned Version = SSA_NAME_VERSION(reg);
+  if (Version >= SSANames.size())
+    return 0;
+  Value *&Slot = SSANames[Version];
+  // The SSA name may have been defined to be a placeholder for another SSA name
+  // (a copy of a name that was not defined yet), since replaced.
+  if (!ReplacedPlaceholders.empty())
+    while (Slot && isSSAPlaceholder(Slot)) {
+      DenseMap<Value *, Value *>::iterator I = ReplacedPlaceholders.find(Slot);
+      if (I == ReplacedPlaceholders.end())
+        break;
+      Slot = I->second;
+    }
+  return Slot;
+}
+
+/// setSSAName - Associate the given value with the given SSA name.
+void TreeToLLVM::setSSAName(tree reg, Value *Val) {
+  unsigned Version = SSA_NAME_VERSION(reg);
+  if (Version >= SSANames.size())
+    SSANames.resize(Version + 1);
+  SSANames[Version] = Val;
+}
+
+#if GCC_VERSION_CODE > GCC_VERSION(4, 8)
+/// describeSSARange - Return metadata describing the values GCC's value range
+/// propagation worked out the given integer SSA name can take on, or null if
+/// it knows nothing useful.  The range is given for a BitWidth bit value.
+static MDNode *describeSSARange(tree reg, unsigned BitWidth) {
+  tree type = TREE_TYPE(reg);
+  if (!isa<INTEGRAL_TYPE>(type) || !SSA_NAME_RANGE_INFO(reg))
+    return 0;
+#if (GCC_MAJOR > 4)
+  wide_int Min, Max;
+#else
+  double_int Min, Max;
+#endif
+  enum value_range_type RangeType = get_range_info(reg, &Min, &Max);
+  if (RangeType != VR_RANGE && RangeType != VR_ANTI_RANGE)
+    return 0;
+#if (GCC_MAJOR > 4)
+  APInt Lo = getAPIntValue(wide_int_to_tree(type, Min), BitWidth);
+  APInt Hi = getAPIntValue(wide_int_to_tree(type, Max), BitWidth);
+#else
+  APInt Lo = getAPIntValue(double_int_to_tree(type, Min), BitWidth);
+  APInt Hi = getAPIntValue(double_int_to_tree(type, Max), BitWidth);
+#endif
+
+  // Unlike GCC's, LLVM ranges do not include the upper end point.  An anti-
+  // range [Min, Max] is the wrapped range [Max + 1, Min) in LLVM terms.
+  ++Hi;
+  if (RangeType == VR_ANTI_RANGE)
+    std::swap(Lo, Hi);
+  if (Lo == Hi)
+    return 0; // Every value is possible.
+
+  LLVMContext &Context =
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+      TheModule->getContext();
+#else
+      TheContext;
+#endif
+  MDBuilder MDHelper(Context);
+  return MDHelper.createRange(Lo, Hi);
+}
+
+/// AnnotateWithSSAInfo - If the SSA name is defined by a load from memory,
+/// attach what GCC knows about the SSA name's value to the load: its value
+/// range, or for pointers that it cannot be null.
+static void AnnotateWithSSAInfo(tree reg, Value *Val) {
+  LoadInst *LI = dyn_cast<LoadInst>(Val);
+  if (!LI)
+    return;
+  // Copies of other SSA names may have ranges that only hold where the copy
+  // is, so only annotate loads made for this SSA name.
+  GimpleTy *def = SSA_NAME_DEF_STMT(reg);
+  if (!is_gimple_assign(def) ||
+      get_gimple_rhs_class(gimple_assign_rhs_code(def)) != GIMPLE_SINGLE_RHS ||
+      is_gimple_reg(gimple_assign_rhs1(def)))
+    return;
+  if (LI->getType()->isIntegerTy()) {
+    if (MDNode *Range =
+            describeSSARange(reg, LI->getType()->getIntegerBitWidth()))
+      LI->setMetadata(LLVMContext::MD_range, Range);
+    return;
+  }
+#if (GCC_MAJOR > 6) && LLVM_VERSION_CODE > LLVM_VERSION(3, 5)
+  if (LI->getType()->isPointerTy() && POINTER_TYPE_P(TREE_TYPE(reg)) &&
+      get_ptr_nonnull(reg))
+    LI->setMetadata(LLVMContext::MD_nonnull,
+                    MDNode::get(LI->getContext(), None));
+#endif
+}
+#endif
+
 /// DefineSSAName - Use the given value as the definition of the given SSA name.
 /// Returns the provided value as a convenience.
 Value *TreeToLLVM::DefineSSAName(tree reg, Value *Val) {
   assert(isa<SSA_NAME>(reg) && "Not an SSA name!");
-  if (Value *ExistingValue = SSANames[reg]) {
+#if GCC_VERSION_CODE > GCC_VERSION(4, 8)
+  // Pass on anything GCC's optimizers worked out about the value.
+  AnnotateWithSSAInfo(reg, Val);
+#endif
+  // Phi nodes are described once all of those in the block exist.
+  if (EmitDebugInfo() && !isa<PHINode>(Val))
+    EmitDebugValue(reg, Val);
+  if (Value *ExistingValue = getSSAName(reg)) {
     if (Val != ExistingValue) {
       assert(isSSAPlaceholder(ExistingValue) && "Multiply defined SSA name!");
-      // Replace the placeholder with the value everywhere.  This also updates
-      // the map entry, because it is a TrackingVH.
+      // Replace the placeholder with the value everywhere.  Other SSA names
+      // may refer to the placeholder too, so remember what replaced it.
       ExistingValue->replaceAllUsesWith(Val);
-#if LLVM_VERSION_CODE > LLVM_VERSION(4, 0)
-      ExistingValue->deleteValue();
-#else
-      delete ExistingValue;
-#endif
+      ReplacedPlaceholders[ExistingValue] = Val;
+      setSSAName(reg, Val);
     }
     return Val;
   }
-  return SSANames[reg] = Val;
+  setSSAName(reg, Val);
+  return Val;
 }
 
-typedef SmallVector<std::pair<BasicBlock *, unsigned>, 8> PredVector;
-typedef SmallVector<std::pair<BasicBlock *, tree>, 8> TreeVector;
-typedef SmallVector<std::pair<BasicBlock *, Value *>, 8> ValueVector;
+/// EmitDebugValue - Describe the given value to the debugger as the new value
+/// of the user variable that the SSA name is a version of, if any.  Variables
+/// that live in memory are described by EmitDeclare instead.
+void TreeToLLVM::EmitDebugValue(tree reg, Value *Val) {
+  if (SSA_NAME_IS_DEFAULT_DEF(reg))
+    return;
+  tree var = SSA_NAME_VAR(reg);
+  if (!var || !isa<VAR_DECL>(var) || DECL_ARTIFICIAL(var) ||
+      DECL_LOCAL_SET_P(var))
+    return;
+  TheDebugInfo->EmitValue(var, Val, Builder);
+}
 
 /// PopulatePhiNodes - Populate generated phi nodes with their operands.
 void TreeToLLVM::PopulatePhiNodes() {
-  PredVector Predecessors;
-  TreeVector IncomingValues;
-  ValueVector PhiArguments;
+  // The LLVM basic block that directly corresponds to a GCC basic block for
+  // each predecessor seen so far.  Several LLVM basic blocks may be generated
+  // when emitting one GCC basic block.  The additional blocks always occur
+  // immediately after the main basic block, and can be identified by the fact
+  // that they are nameless.  Any of them may be a predecessor of the block
+  // containing a phi, and takes the incoming value for the GCC block.
+  DenseMap<BasicBlock *, BasicBlock *> MainBlocks;
+
+  // The predecessors of the block containing the phis being populated, in the
+  // order LLVM lists them, along with the main block for each.  Phis for the
+  // same block are next to each other in PendingPhis, so this is only worked
+  // out once per block.  In LLVM a predecessor can occur several times, for
+  // example a switch with several cases going to the block, and then every
+  // copy must be given the same incoming value.
+  SmallVector<std::pair<BasicBlock *, BasicBlock *>, 8> Predecessors;
+  BasicBlock *PhiBB = 0;
+
+  DenseMap<BasicBlock *, tree> IncomingValues;
+  DenseMap<BasicBlock *, Value *> PhiArguments;
+  SmallVector<PHINode *, 4> DeadPhis;
 
   for (unsigned Idx = 0, EIdx = (unsigned) PendingPhis.size(); Idx < EIdx;
        ++Idx) {
     // The phi node to process.
     PhiRecord &P = PendingPhis[Idx];
 
+    if (P.PHI->getParent() != PhiBB) {
+      PhiBB = P.PHI->getParent();
+      Predecessors.clear();
+      for (pred_iterator PI = pred_begin(PhiBB), PE = pred_end(PhiBB); PI != PE;
+           ++PI) {
+        BasicBlock *&Main = MainBlocks[*PI];
+        if (!Main) {
+          Function::iterator FI(*PI);
+          while (!isNamedBlock(&*FI))
+            --FI;
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+          Main = &*FI;
+#else
+          Main = FI;
+#endif
+        }
+        Predecessors.push_back(std::make_pair(*PI, Main));
+      }
+    }
+
+    if (Predecessors.empty()) {
+      // FIXME: If this happens then GCC has a control flow edge where LLVM has
+      // none - something has gone wrong.  For the moment be laid back about it
+      // because the fact we don't yet wire up exception handling code means it
+      // happens all the time in Ada and C++.  Phis populated later may still
+      // pick up this one as an operand, so only delete it once they are done.
+      DeadPhis.push_back(P.PHI);
+      continue;
+    }
+
     // Extract the incoming value for each predecessor from the GCC phi node.
     for (unsigned i = 0, e = gimple_phi_num_args(P.gcc_phi); i != e; ++i) {
       // The incoming GCC basic block.
@@ -1409,101 +2352,118 @@ void TreeToLLVM::PopulatePhiNodes() {
       assert(BI != BasicBlocks.end() && "GCC basic block not output?");
 
       // The incoming GCC expression.
-      tree val = gimple_phi_arg(P.gcc_phi, i)->def;
-
-      // Associate it with the LLVM basic block.
-      IncomingValues.push_back(std::make_pair(BI->second, val));
-
-      // Several LLVM basic blocks may be generated when emitting one GCC basic
-      // block.  The additional blocks always occur immediately after the main
-      // basic block, and can be identified by the fact that they are nameless.
-      // Associate the incoming expression with all of them, since any of them
-      // may occur as a predecessor of the LLVM basic block containing the phi.
-      Function::iterator FI(BI->second), FE = Fn->end();
-      for (++FI; FI != FE && !FI->hasName(); ++FI) {
-        assert(FI->getSinglePredecessor() == IncomingValues.back().first &&
-               "Anonymous block does not continue predecessor!");
-        IncomingValues.push_back(std::make_pair(
-#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
-                    llvm::dyn_cast<llvm::BasicBlock>(FI),
-#else
-                    FI,
-#endif
-                    val));
-      }
+      IncomingValues[BI->second] = gimple_phi_arg(P.gcc_phi, i)->def;
     }
 
-    // Sort the incoming values by basic block to help speed up queries.
-    std::sort(IncomingValues.begin(), IncomingValues.end());
-
-    // Get the LLVM predecessors for the basic block containing the phi node,
-    // and remember their positions in the list of predecessors (this is used
-    // to avoid adding phi operands in a non-deterministic order).
-    Predecessors.reserve(gimple_phi_num_args(P.gcc_phi)); // At least this many.
-    BasicBlock *PhiBB = P.PHI->getParent();
-    unsigned Index = 0;
-    for (pred_iterator PI = pred_begin(PhiBB), PE = pred_end(PhiBB); PI != PE;
-         ++PI, ++Index)
-      Predecessors.push_back(std::make_pair(*PI, Index));
-
-    if (Predecessors.empty()) {
-      // FIXME: If this happens then GCC has a control flow edge where LLVM has
-      // none - something has gone wrong.  For the moment be laid back about it
-      // because the fact we don't yet wire up exception handling code means it
-      // happens all the time in Ada and C++.
-      P.PHI->replaceAllUsesWith(UndefValue::get(P.PHI->getType()));
-      P.PHI->eraseFromParent();
-      IncomingValues.clear();
-      continue;
+    // Add the phi node arguments in the order of the LLVM predecessors, so the
+    // same bitcode is produced on any run.
+    for (unsigned i = 0, e = Predecessors.size(); i != e; ++i) {
+      // The predecessor basic block.
+      BasicBlock *BB = Predecessors[i].first;
+
+      // Every copy of the predecessor gets the same value, only compute it once.
+      Value *&Val = PhiArguments[BB];
+      if (!Val) {
+        DenseMap<BasicBlock *, tree>::iterator VI =
+            IncomingValues.find(Predecessors[i].second);
+        assert(VI != IncomingValues.end() && "No value for predecessor!");
+        Val = EmitRegister(VI->second);
+
+        // Need to bitcast to the right type (useless_type_conversion_p).  Place
+        // the bitcast at the end of the predecessor, before the terminator.
+        if (Val->getType() != P.PHI->getType())
+          Val = new BitCastInst(Val, P.PHI->getType(), "", BB->getTerminator());
+      }
+      P.PHI->addIncoming(Val, BB);
     }
 
-    // Sort the predecessors by basic block.  In GCC, each predecessor occurs
-    // exactly once.  However in LLVM a predecessor can occur several times,
-    // and then every copy of the predecessor must be associated with exactly
-    // the same incoming value in the phi node.  Sorting the predecessors groups
-    // multiple occurrences together, making this easy to handle.
-    std::sort(Predecessors.begin(), Predecessors.end());
+    IncomingValues.clear();
+    PhiArguments.clear();
+  }
 
-    // Now iterate over the predecessors, setting phi operands as we go.
-    TreeVector::iterator VI = IncomingValues.begin(), VE = IncomingValues.end();
-    PredVector::iterator PI = Predecessors.begin(), PE = Predecessors.end();
-    PhiArguments.resize((unsigned) Predecessors.size());
-    while (PI != PE) {
-      // The predecessor basic block.
-      BasicBlock *BB = PI->first;
+  // Nothing looks SSA names up once the phis are populated, so stale entries
+  // for these in SSANames are harmless.
+  for (unsigned i = 0, e = DeadPhis.size(); i != e; ++i) {
+    DeadPhis[i]->replaceAllUsesWith(UndefValue::get(DeadPhis[i]->getType()));
+    DeadPhis[i]->eraseFromParent();
+  }
 
-      // Find the incoming value for this predecessor.
-      while (VI != VE && VI->first != BB)
-        ++VI;
-      assert(VI != VE && "No value for predecessor!");
-      Value *Val = EmitRegister(VI->second);
+  PendingPhis.clear();
+}
 
-      // Need to bitcast to the right type (useless_type_conversion_p).  Place
-      // the bitcast at the end of the predecessor, before the terminator.
-      if (Val->getType() != P.PHI->getType())
-        Val = new BitCastInst(Val, P.PHI->getType(), "", BB->getTerminator());
+/// MaxUnfactoredEdges - Computed gotos are not given their own indirect branch
+/// if this would result in more than this many control flow edges.
+static const uint64_t MaxUnfactoredEdges = 100000;
+
+/// UnfactorComputedGotos - GCC sends every computed goto in a function through
+/// one block holding the only indirect branch, so as not to create an edge from
+/// every computed goto to every label whose address is taken.  Give each one
+/// its own indirect branch again, so that in threaded interpreters each opcode
+/// handler has an indirect jump of its own for the processor to predict.
+static void UnfactorComputedGotos(Function &F) {
+  SmallVector<IndirectBrInst *, 4> Factored;
+  for (Function::iterator BB = F.begin(), E = F.end(); BB != E; ++BB)
+    if (IndirectBrInst *Br = dyn_cast<IndirectBrInst>(BB->getTerminator()))
+      if (PHINode *PN = dyn_cast<PHINode>(Br->getAddress()))
+        // The block holds only the phi choosing the address and the branch.
+        if (PN->getParent() == &*BB && PN->hasOneUse() && &BB->front() == PN &&
+            PN->getNextNode() == Br)
+          Factored.push_back(Br);
+
+  for (unsigned i = 0, e = Factored.size(); i != e; ++i) {
+    IndirectBrInst *Br = Factored[i];
+    BasicBlock *BB = Br->getParent();
+    PHINode *PN = cast<PHINode>(Br->getAddress());
+    if ((uint64_t)PN->getNumIncomingValues() * Br->getNumDestinations() >
+        MaxUnfactoredEdges)
+      continue;
+    // Each computed goto must jump straight to the block.
+    bool AllGotos = true;
+    for (unsigned j = 0, je = PN->getNumIncomingValues(); j != je; ++j) {
+      BranchInst *Goto =
+          dyn_cast<BranchInst>(PN->getIncomingBlock(j)->getTerminator());
+      AllGotos &= Goto && Goto->isUnconditional();
+    }
+    if (!AllGotos)
+      continue;
 
-      // Add the phi node arguments for all occurrences of this predecessor.
-      do {
-        // Place the argument at the position given by PI->second, which is the
-        // original position before sorting of the predecessor in the pred list.
-        // Since the predecessors were sorted non-deterministically (by pointer
-        // value), this ensures that the same bitcode is produced on any run.
-        PhiArguments[PI++->second] = std::make_pair(BB, Val);
-      } while (PI != PE && PI->first == BB);
+    for (unsigned j = 0, je = PN->getNumIncomingValues(); j != je; ++j) {
+      BasicBlock *Pred = PN->getIncomingBlock(j);
+      TerminatorInst *Goto = Pred->getTerminator();
+      IndirectBrInst *NewBr = IndirectBrInst::Create(
+          PN->getIncomingValue(j), Br->getNumDestinations(), Goto);
+      NewBr->setDebugLoc(Br->getDebugLoc());
+      Goto->eraseFromParent();
+      for (unsigned k = 0, ke = Br->getNumDestinations(); k != ke; ++k) {
+        BasicBlock *Dest = Br->getDestination(k);
+        NewBr->addDestination(Dest);
+        for (BasicBlock::iterator I = Dest->begin(); isa<PHINode>(I); ++I) {
+          PHINode *DestPN = cast<PHINode>(I);
+          DestPN->addIncoming(DestPN->getIncomingValueForBlock(BB), Pred);
+        }
+      }
     }
 
-    // Add the operands to the phi node.
-    for (ValueVector::iterator I = PhiArguments.begin(), E = PhiArguments.end();
-         I != E; ++I)
-      P.PHI->addIncoming(I->second, I->first);
-
-    IncomingValues.clear();
-    PhiArguments.clear();
-    Predecessors.clear();
+    for (unsigned k = 0, ke = Br->getNumDestinations(); k != ke; ++k)
+      Br->getDestination(k)->removePredecessor(BB);
+    Br->eraseFromParent();
+    PN->eraseFromParent();
+    BB->eraseFromParent();
   }
+}
 
-  PendingPhis.clear();
+/// MayThrow - Whether anything in the given function may throw an exception.
+static bool MayThrow(const Function &F) {
+  for (Function::const_iterator BB = F.begin(), E = F.end(); BB != E; ++BB)
+    for (BasicBlock::const_iterator I = BB->begin(), E = BB->end(); I != E;
+         ++I) {
+      if (isa<InvokeInst>(I) || isa<ResumeInst>(I))
+        return true;
+      if (const CallInst *CI = dyn_cast<CallInst>(I))
+        if (!CI->doesNotThrow())
+          return true;
+    }
+  return false;
 }
 
 Function *TreeToLLVM::FinishFunctionBody() {
@@ -1605,7 +2565,7 @@ Function *TreeToLLVM::FinishFunctionBody() {
   } else { // !ReturnBB
     BasicBlock *CurBB = Builder.GetInsertBlock();
     if (CurBB->getTerminator() == 0) {
-      if (CurBB->getName().empty() && CurBB->begin() == CurBB->end()) {
+      if (!isNamedBlock(CurBB) && CurBB->begin() == CurBB->end()) {
         // If the previous block has no label and is empty, remove it: it is a
         // post-terminator block.
         CurBB->eraseFromParent();
@@ -1626,6 +2586,24 @@ Function *TreeToLLVM::FinishFunctionBody() {
   EmitLandingPads();
   EmitFailureBlocks();
 
+  UnfactorComputedGotos(*Fn);
+
+  // If nothing in the function can throw then neither can the function.  GCC
+  // only works this out if its IPA passes are run.  Not if another definition
+  // may be used at link time, or if loads and stores may throw.  That includes
+  // the linkonce_odr and weak_odr definitions of inline functions: another
+  // unit's copy may not have been optimized the same way, and may throw.
+  if (!Fn->doesNotThrow() && !flag_non_call_exceptions &&
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+      Fn->hasExactDefinition() &&
+#else
+      !Fn->isWeakForLinker() &&
+#endif
+      !MayThrow(*Fn)) {
+    Fn->setDoesNotThrow();
+    ++ConvStats.NoUnwindFunctions;
+  }
+
   if (ReturnBB) {
     // FIXME: This should be output just before the return call generated above.
     // But because EmitFunctionEnd pops the region stack, that means that if the
@@ -1638,39 +2616,30 @@ Function *TreeToLLVM::FinishFunctionBody() {
     }
   }
 
-#ifdef NDEBUG
-  // When processing broken code it can be awkward to ensure that every SSA name
-  // that was used has a definition.  So in this case we play it cool and create
-  // an artificial definition for such SSA names.  The choice of definition does
-  // not matter because the compiler is going to exit with an error anyway.
-  if (errorcount || sorrycount)
-#else
-// When checks are enabled, complain if an SSA name was used but not defined.
+  // Delete the placeholders for SSA names that were used before being defined.
+  for (unsigned i = 0, e = SSAPlaceholders.size(); i != e; ++i) {
+    Value *Placeholder = SSAPlaceholders[i].second;
+    if (!ReplacedPlaceholders.count(Placeholder)) {
+      // When processing broken code it can be awkward to ensure that every SSA
+      // name that was used has a definition.  So in this case we play it cool
+      // and create an artificial definition for such SSA names.  The choice of
+      // definition does not matter because the compiler is going to exit with
+      // an error anyway.  When checks are enabled, complain if there was no
+      // error.
+#ifndef NDEBUG
+      if (!errorcount && !sorrycount) {
+        debug_tree(SSAPlaceholders[i].first);
+        llvm_unreachable("SSA name never defined!");
+      }
 #endif
-    for (DenseMap<tree, TrackingVH<Value> >::const_iterator
-             I = SSANames.begin(),
-             E = SSANames.end();
-         I != E; ++I) {
-      Value *NameDef = I->second;
-      // If this is not a placeholder then the SSA name was defined.
-      if (!isSSAPlaceholder(NameDef))
-        continue;
-
-      // If an error occurred then replace the placeholder with undef.  Thanks
-      // to this we can just bail out on errors, without having to worry about
-      // whether we defined every SSA name.
-      if (errorcount || sorrycount) {
-        NameDef->replaceAllUsesWith(UndefValue::get(NameDef->getType()));
+      Placeholder->replaceAllUsesWith(UndefValue::get(Placeholder->getType()));
+    }
 #if LLVM_VERSION_CODE > LLVM_VERSION(4, 0)
-        NameDef->deleteValue();
+    Placeholder->deleteValue();
 #else
-        delete NameDef;
+    delete Placeholder;
 #endif
-      } else {
-        debug_tree(I->first);
-        llvm_unreachable("SSA name never defined!");
-      }
-    }
+  }
 
   return Fn;
 }
@@ -1692,9 +2661,12 @@ BasicBlock *TreeToLLVM::getBasicBlock(basic_block bb) {
   BasicBlock *BB = BasicBlock::Create(Context);
 
   // All basic blocks that directly correspond to GCC basic blocks (those
-  // created here) must have a name.  All artificial basic blocks produced
-  // while generating code must be nameless.  That way, artificial blocks
-  // can be easily identified.
+  // created here) are named.  All artificial basic blocks produced while
+  // generating code are nameless.  That way, artificial blocks can be easily
+  // identified.
+  NamedBlocks.insert(BB);
+  if (flag_discard_value_names)
+    return BasicBlocks[bb] = BB;
 
   // Give the basic block a name.  If the user specified -fverbose-asm then
   // use the same naming scheme as GCC.
@@ -1723,6 +2695,21 @@ BasicBlock *TreeToLLVM::getBasicBlock(basic_block bb) {
   return BasicBlocks[bb] = BB;
 }
 
+/// CreateNamedBlock - Create a basic block with the given name, which is not
+/// considered artificial (see getBasicBlock).
+BasicBlock *TreeToLLVM::CreateNamedBlock(const Twine &Name, Function *Parent,
+                                         BasicBlock *InsertBefore) {
+  LLVMContext &Context =
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+      TheModule->getContext();
+#else
+      TheContext;
+#endif
+  BasicBlock *BB = BasicBlock::Create(Context, Name, Parent, InsertBefore);
+  NamedBlocks.insert(BB);
+  return BB;
+}
+
 /// getLabelDeclBlock - Lazily get and create a basic block for the specified
 /// label.
 BasicBlock *TreeToLLVM::getLabelDeclBlock(tree LabelDecl) {
@@ -1741,6 +2728,107 @@ BasicBlock *TreeToLLVM::getLabelDeclBlock(tree LabelDecl) {
   return BB;
 }
 
+#if GCC_VERSION_CODE > GCC_VERSION(4, 8) && \
+    LLVM_VERSION_CODE > LLVM_VERSION(3, 6)
+/// LoopHint - Return a loop metadata operand setting the given hint.
+static MDNode *LoopHint(LLVMContext &Context, const char *Name, Constant *Val) {
+  Metadata *Ops[] = { MDString::get(Context, Name),
+                      ConstantAsMetadata::get(Val) };
+  return MDNode::get(Context, Ops);
+}
+
+MDNode *TreeToLLVM::getLoopID(loop *L) {
+  DenseMap<loop *, MDNode *>::iterator I = LoopIDs.find(L);
+  if (I != LoopIDs.end())
+    return I->second;
+
+  LLVMContext &Context = Fn->getContext();
+  SmallVector<Metadata *, 4> Ops;
+  Ops.push_back(0); // Replaced with the loop ID itself below.
+
+  // #pragma GCC ivdep and OpenMP simd loops without a safelen get a safelen
+  // of INT_MAX, meaning there are no loop carried dependencies at all; these
+  // are marked parallel by EmitLoopHints.  A finite safelen bounds the number
+  // of iterations that can be run at once, so use it as the vector width.
+  if (L->dont_vectorize) {
+    Ops.push_back(LoopHint(Context, "llvm.loop.vectorize.enable",
+                           ConstantInt::getFalse(Context)));
+  } else {
+    if (L->force_vectorize || L->safelen == INT_MAX)
+      Ops.push_back(LoopHint(Context, "llvm.loop.vectorize.enable",
+                             ConstantInt::getTrue(Context)));
+    if (L->safelen > 1 && L->safelen != INT_MAX)
+      Ops.push_back(LoopHint(Context, "llvm.loop.vectorize.width",
+                             ConstantInt::get(Type::getInt32Ty(Context),
+                                              PowerOf2Floor(L->safelen))));
+  }
+
+#if (GCC_MAJOR > 7)
+  // #pragma GCC unroll: 1 means do not unroll, USHRT_MAX means unroll without
+  // saying how much.
+  if (L->unroll == 1) {
+    Metadata *Name = MDString::get(Context, "llvm.loop.unroll.disable");
+    Ops.push_back(MDNode::get(Context, Name));
+  } else if (L->unroll == USHRT_MAX) {
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 7)
+    Metadata *Name = MDString::get(Context, "llvm.loop.unroll.enable");
+    Ops.push_back(MDNode::get(Context, Name));
+#endif
+  } else if (L->unroll > 1) {
+    Ops.push_back(LoopHint(Context, "llvm.loop.unroll.count",
+                           ConstantInt::get(Type::getInt32Ty(Context),
+                                            L->unroll)));
+  }
+#endif
+
+  MDNode *ID = 0;
+  if (Ops.size() > 1) {
+    ID = MDNode::getDistinct(Context, Ops);
+    ID->replaceOperandWith(0, ID);
+  }
+  LoopIDs[L] = ID;
+  return ID;
+}
+
+void TreeToLLVM::EmitLoopHints(basic_block bb) {
+  if (bb == ENTRY_BLOCK_PTR)
+    return;
+  // The LLVM basic blocks output for bb.
+  Function::iterator First(getBasicBlock(bb)), E = Fn->end();
+
+  SmallVector<Metadata *, 2> ParallelLoops;
+  for (loop *L = bb->loop_father; L && loop_outer(L); L = loop_outer(L)) {
+    MDNode *ID = getLoopID(L);
+    if (!ID)
+      continue;
+    if (L->safelen == INT_MAX)
+      ParallelLoops.push_back(ID);
+
+    // Hang the hints off any branch back to the loop header, which is where
+    // the LLVM loop passes look for them.
+    BasicBlock *Header = getBasicBlock(L->header);
+    for (Function::iterator BB = First; BB != E; ++BB) {
+      TerminatorInst *TI = BB->getTerminator();
+      if (!TI)
+        continue;
+      for (unsigned i = 0, e = TI->getNumSuccessors(); i != e; ++i)
+        if (TI->getSuccessor(i) == Header) {
+          TI->setMetadata("llvm.loop", ID);
+          break;
+        }
+    }
+  }
+
+  if (ParallelLoops.empty())
+    return;
+  MDNode *Parallel = MDNode::get(Fn->getContext(), ParallelLoops);
+  for (Function::iterator BB = First; BB != E; ++BB)
+    for (BasicBlock::iterator I = BB->begin(), IE = BB->end(); I != IE; ++I)
+      if (I->mayReadOrWriteMemory())
+        I->setMetadata("llvm.mem.parallel_loop_access", Parallel);
+}
+#endif
+
 void TreeToLLVM::EmitBasicBlock(basic_block bb) {
   location_t saved_loc = input_location;
   ++NumBasicBlocks;
@@ -1752,6 +2840,7 @@ void TreeToLLVM::EmitBasicBlock(basic_block bb) {
   // Create an LLVM phi node for each GCC phi and define the associated ssa name
   // using it.  Do not populate with operands at this point since some ssa names
   // the phi uses may not have been defined yet - phis are special this way.
+  unsigned FirstPhi = PendingPhis.size();
   for (gimple_stmt_iterator gsi = gsi_start_phis(bb); !gsi_end_p(gsi);
        gsi_next(&gsi)) {
     GimpleTy *gcc_phi = gsi_stmt(gsi);
@@ -1762,6 +2851,7 @@ void TreeToLLVM::EmitBasicBlock(basic_block bb) {
     // Create the LLVM phi node.
     Type *Ty = getRegType(TREE_TYPE(gimple_phi_result(gcc_phi)));
     PHINode *PHI = Builder.CreatePHI(Ty, gimple_phi_num_args(gcc_phi));
+    ++ConvStats.PhiNodes;
 
     // The phi defines the associated ssa name.
     tree name = gimple_phi_result(gcc_phi);
@@ -1775,6 +2865,18 @@ void TreeToLLVM::EmitBasicBlock(basic_block bb) {
     PendingPhis.push_back(P);
   }
 
+  // Describe the phi nodes to the debugger.  This is done after creating them
+  // all since phi nodes must come before anything else in the block.
+  if (EmitDebugInfo())
+    for (unsigned i = FirstPhi, e = PendingPhis.size(); i != e; ++i)
+      EmitDebugValue(gimple_phi_result(PendingPhis[i].gcc_phi),
+                     PendingPhis[i].PHI);
+
+#if GCC_VERSION_CODE > GCC_VERSION(4, 6)
+  // Start the lifetime of variables whose address is taken by the phi nodes.
+  EmitLifetimeStarts(bb);
+#endif
+
   // Render statements.
   for (gimple_stmt_iterator gsi = gsi_start_bb(bb); !gsi_end_p(gsi);
        gsi_next(&gsi)) {
@@ -1784,15 +2886,23 @@ void TreeToLLVM::EmitBasicBlock(basic_block bb) {
 
     if (EmitDebugInfo()) {
       if (gimple_has_location(stmt)) {
-        TheDebugInfo->setLocationFile(gimple_filename(stmt));
-        TheDebugInfo->setLocationLine(gimple_lineno(stmt));
+        expanded_location Loc = expand_location(gimple_location(stmt));
+        TheDebugInfo->setLocationFile(Loc.file);
+        TheDebugInfo->setLocationLine(Loc.line);
+        TheDebugInfo->setLocationColumn(Loc.column);
       } else {
         TheDebugInfo->setLocationFile("");
         TheDebugInfo->setLocationLine(0);
+        TheDebugInfo->setLocationColumn(0);
       }
+      TheDebugInfo->setLocationBlock(gimple_block(stmt));
       TheDebugInfo->EmitStopPoint(Builder.GetInsertBlock(), Builder);
     }
 
+#if GCC_VERSION_CODE > GCC_VERSION(4, 6)
+    EmitLifetimeStarts(stmt);
+#endif
+
     switch (gimple_code(stmt)) {
     default:
       debug_gimple_stmt(stmt);
@@ -1803,7 +2913,10 @@ void TreeToLLVM::EmitBasicBlock(basic_block bb) {
       break;
 
     case GIMPLE_ASSIGN:
-      RenderGIMPLE_ASSIGN(stmt);
+      if (GimpleTy *Last = EmitConstantStoreRun(stmt))
+        gsi = gsi_for_stmt(Last);
+      else
+        RenderGIMPLE_ASSIGN(stmt);
       break;
 
     case GIMPLE_CALL:
@@ -1843,11 +2956,16 @@ void TreeToLLVM::EmitBasicBlock(basic_block bb) {
       RenderGIMPLE_SWITCH(stmt);
       break;
     }
+
+    // Temporaries used to convert the statement are now dead.
+    ReleaseScratchTemporaries();
   }
 
   if (EmitDebugInfo()) {
     TheDebugInfo->setLocationFile("");
     TheDebugInfo->setLocationLine(0);
+    TheDebugInfo->setLocationColumn(0);
+    TheDebugInfo->setLocationBlock(NULL);
     TheDebugInfo->EmitStopPoint(Builder.GetInsertBlock(), Builder);
   }
 
@@ -1861,21 +2979,70 @@ void TreeToLLVM::EmitBasicBlock(basic_block bb) {
     break;
   }
 
+#if GCC_VERSION_CODE > GCC_VERSION(4, 8) && \
+    LLVM_VERSION_CODE > LLVM_VERSION(3, 6)
+  // Pass on GCC's hints for the loops containing the block, unless the loop
+  // tree is out of date.
+  if (current_loops && !loops_state_satisfies_p(LOOPS_NEED_FIXUP))
+    EmitLoopHints(bb);
+#endif
+
   input_location = saved_loc;
 }
 
-Function *TreeToLLVM::EmitFunction() {
+/// getFastMathFlags - The LLVM fast-math flags corresponding to the GCC floating
+/// point options for the given function, which may differ from those for the
+/// compilation unit because of an optimize attribute or pragma.
+static FastMathFlags getFastMathFlags(tree fndecl) {
+  tree opts = DECL_FUNCTION_SPECIFIC_OPTIMIZATION(fndecl);
+  struct cl_optimization *Opts =
+      TREE_OPTIMIZATION(opts ? opts : optimization_default_node);
+#if GCC_VERSION_CODE > GCC_VERSION(4, 5)
+  bool FiniteMath = Opts->x_flag_finite_math_only;
+  bool SignedZeros = Opts->x_flag_signed_zeros;
+  bool ReciprocalMath = Opts->x_flag_reciprocal_math;
+  bool AssociativeMath = Opts->x_flag_associative_math;
+  bool UnsafeMath = Opts->x_flag_unsafe_math_optimizations;
+#else
+  bool FiniteMath = Opts->flag_finite_math_only;
+  bool SignedZeros = Opts->flag_signed_zeros;
+  bool ReciprocalMath = Opts->flag_reciprocal_math;
+  bool AssociativeMath = Opts->flag_associative_math;
+  bool UnsafeMath = Opts->flag_unsafe_math_optimizations;
+#endif
+
   FastMathFlags FMF;
-  if (flag_finite_math_only) {
+  if (FiniteMath) {
     FMF.setNoInfs();
     FMF.setNoNaNs();
   }
-  if (!flag_signed_zeros)
+  if (!SignedZeros)
     FMF.setNoSignedZeros();
-  if (flag_reciprocal_math)
+  if (ReciprocalMath)
     FMF.setAllowReciprocal();
-  if (flag_unsafe_math_optimizations && flag_finite_math_only)
+#if LLVM_VERSION_CODE > LLVM_VERSION(5, 0)
+  // Each of the GCC options has its own flag.
+  if (AssociativeMath)
+    FMF.setAllowReassoc();
+  if (UnsafeMath)
+    FMF.setApproxFunc();
+#else
+  // Reassociation is only allowed together with everything else.
+  if (AssociativeMath && UnsafeMath && FiniteMath)
     FMF.setUnsafeAlgebra();
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(4, 0) && \
+    GCC_VERSION_CODE > GCC_VERSION(4, 5)
+  // GCC fuses multiplies and adds into FMA unless told not to.  This option is
+  // not per function.
+  if (flag_fp_contract_mode == FP_CONTRACT_FAST)
+    FMF.setAllowContract();
+#endif
+  return FMF;
+}
+
+Function *TreeToLLVM::EmitFunction() {
+  FastMathFlags FMF = getFastMathFlags(FnDecl);
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
   Builder.setFastMathFlags(FMF);
 #else
@@ -1885,6 +3052,22 @@ Function *TreeToLLVM::EmitFunction() {
   // Set up parameters and prepare for return, for the function.
   StartFunctionBody();
 
+#if GCC_VERSION_CODE > GCC_VERSION(4, 6)
+  // Work out where the lifetimes of scoped variables start.
+  ComputeLifetimeStarts();
+#endif
+
+  // Pass on how often the function was executed, if known.
+  if (hasProfileCounts()) {
+    uint64_t EntryCount = getBlockCount(ENTRY_BLOCK_PTR);
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 6)
+    Fn->setEntryCount(EntryCount);
+#endif
+    ProfileEntryCounts.push_back(EntryCount);
+    basic_block bb;
+    FOR_EACH_BB(bb) ProfileBlockCounts.push_back(getBlockCount(bb));
+  }
+
   // Output the basic blocks.
   basic_block bb;
   FOR_EACH_BB(bb) EmitBasicBlock(bb);
@@ -2219,6 +3402,7 @@ AllocaInst *TreeToLLVM::CreateTemporary(Type *Ty, unsigned align) {
     Fn->begin()->getInstList()
         .insert(Fn->begin()->begin(), AllocaInsertionPoint);
   }
+  ++ConvStats.Temporaries;
   return new AllocaInst(Ty,
 #if LLVM_VERSION_CODE > LLVM_VERSION(4, 0)
                         0, /* AddrSpace */
@@ -2226,6 +3410,57 @@ AllocaInst *TreeToLLVM::CreateTemporary(Type *Ty, unsigned align) {
                         0, align, "", AllocaInsertionPoint);
 }
 
+/// CreateScratchTemporary - Like CreateTemporary, but for a temporary that is
+/// only used while converting the current statement.  A slot of the same type
+/// and alignment released by an earlier statement is reused if there is one.
+/// The lifetime of the slot is marked as starting here, and as ending when the
+/// statement is done (see ReleaseScratchTemporaries).
+AllocaInst *TreeToLLVM::CreateScratchTemporary(Type *Ty, unsigned align) {
+  AllocaInst *AI = 0;
+  for (unsigned i = 0, e = FreeScratch.size(); i != e; ++i)
+    if (FreeScratch[i]->getAllocatedType() == Ty &&
+        FreeScratch[i]->getAlignment() == align) {
+      AI = FreeScratch[i];
+      FreeScratch.erase(FreeScratch.begin() + i);
+      ++ConvStats.ScratchReused;
+      break;
+    }
+  if (!AI)
+    AI = CreateTemporary(Ty, align);
+  LiveScratch.push_back(AI);
+  Builder.CreateLifetimeStart(AI, Builder.getInt64(DL.getTypeAllocSize(Ty)));
+  return AI;
+}
+
+/// ReleaseScratchTemporaries - End the lifetime of the scratch temporaries
+/// used by the current statement, and make them available for reuse.
+void TreeToLLVM::ReleaseScratchTemporaries() {
+  if (LiveScratch.empty())
+    return;
+
+  // If the statement ended the block, the markers go before the terminator.
+  // Leave them out if the terminator is an invoke, since it may be using the
+  // temporaries; the slots stay live on that path, which is conservative.
+  BasicBlock *BB = Builder.GetInsertBlock();
+  Instruction *Terminator = BB->getTerminator();
+  if (!Terminator || !isa<InvokeInst>(Terminator)) {
+    DebugLoc Loc = Builder.getCurrentDebugLocation();
+    if (Terminator)
+      Builder.SetInsertPoint(Terminator);
+    for (unsigned i = 0, e = LiveScratch.size(); i != e; ++i) {
+      AllocaInst *AI = LiveScratch[i];
+      Type *Ty = AI->getAllocatedType();
+      Builder.CreateLifetimeEnd(AI, Builder.getInt64(DL.getTypeAllocSize(Ty)));
+    }
+    if (Terminator)
+      Builder.SetInsertPoint(BB);
+    Builder.SetCurrentDebugLocation(Loc);
+  }
+
+  FreeScratch.append(LiveScratch.begin(), LiveScratch.end());
+  LiveScratch.clear();
+}
+
 /// CreateTempLoc - Like CreateTemporary, but returns a MemRef.
 MemRef TreeToLLVM::CreateTempLoc(Type *Ty) {
   AllocaInst *AI = CreateTemporary(Ty);
@@ -2243,7 +3478,7 @@ void TreeToLLVM::BeginBlock(BasicBlock *BB) {
   if (CurBB->getTerminator() == 0) {
     // If the previous block has no label and is empty, remove it: it is a
     // post-terminator block.
-    if (CurBB->getName().empty() && CurBB->begin() == CurBB->end())
+    if (!isNamedBlock(CurBB) && CurBB->begin() == CurBB->end())
       CurBB->eraseFromParent();
     else
       // Otherwise, fall through to this block.
@@ -2257,6 +3492,131 @@ void TreeToLLVM::BeginBlock(BasicBlock *BB) {
 
 static const unsigned TooCostly = 8;
 
+/// getConstantStore - If the statement stores a constant to a constant offset
+/// in a local variable, return the variable and set Offset and Size to the
+/// position and size in bytes of the stored value.  Otherwise return null.
+static tree getConstantStore(GimpleTy *stmt, uint64_t &Offset,
+                             uint64_t &Size) {
+  if (!is_gimple_assign(stmt) || !gimple_assign_single_p(stmt) ||
+      gimple_has_volatile_ops(stmt) || stmt_could_throw_p(stmt))
+    return 0;
+
+  // Only simple constants, which do not mention any local variables.
+  tree rhs = gimple_assign_rhs1(stmt);
+  switch (TREE_CODE(rhs)) {
+  default:
+    return 0;
+  case INTEGER_CST:
+  case REAL_CST:
+    break;
+  case ADDR_EXPR: {
+    tree Op = TREE_OPERAND(rhs, 0);
+    if (!isa<STRING_CST>(Op) && !(DECL_P(Op) && is_global_var(Op)))
+      return 0;
+    break;
+  }
+  }
+
+  tree ref = gimple_assign_lhs(stmt);
+  if (!isInt64(TYPE_SIZE_UNIT(TREE_TYPE(ref)), true))
+    return 0;
+  Size = getInt64(TYPE_SIZE_UNIT(TREE_TYPE(ref)), true);
+
+  Offset = 0;
+  for (;; ref = TREE_OPERAND(ref, 0)) {
+    if (TREE_THIS_VOLATILE(ref))
+      return 0;
+    if (isa<ARRAY_REF>(ref)) {
+      tree Index = TREE_OPERAND(ref, 1), LowBound = array_ref_low_bound(ref);
+      tree EltSize = array_ref_element_size(ref);
+      if (!isInt64(Index, false) || !isInt64(LowBound, false) ||
+          !isInt64(EltSize, true))
+        return 0;
+      int64_t Idx = getInt64(Index, false) - getInt64(LowBound, false);
+      if (Idx < 0)
+        return 0;
+      Offset += Idx * getInt64(EltSize, true);
+    } else if (isa<COMPONENT_REF>(ref)) {
+      tree Field = TREE_OPERAND(ref, 1);
+      if (!isa<FIELD_DECL>(Field) || isBitfield(Field) ||
+          !OffsetIsLLVMCompatible(Field) ||
+          isa<QUAL_UNION_TYPE>(TREE_TYPE(TREE_OPERAND(ref, 0))))
+        return 0;
+      uint64_t Bits = getFieldOffsetInBits(Field);
+      if (Bits % BITS_PER_UNIT)
+        return 0;
+      Offset += Bits / BITS_PER_UNIT;
+    } else {
+      break;
+    }
+  }
+
+  if (!isa<VAR_DECL>(ref) || TREE_STATIC(ref) || DECL_EXTERNAL(ref) ||
+      !AGGREGATE_TYPE_P(TREE_TYPE(ref)))
+    return 0;
+  return ref;
+}
+
+/// EmitConstantStoreRun - GCC turns an initializer for a local aggregate that
+/// is not entirely constant into one store per element.  If stmt starts a long
+/// run of stores of constants to consecutive bytes of a local variable, copy
+/// all of the constants in at once from a constant global and return the last
+/// statement of the run.  Otherwise output nothing and return null.
+GimpleTy *TreeToLLVM::EmitConstantStoreRun(GimpleTy *stmt) {
+  uint64_t Start, Size;
+  tree Base = getConstantStore(stmt, Start, Size);
+  if (!Base)
+    return 0;
+
+  std::vector<Constant *> Elts;
+  GimpleTy *Last = 0;
+  uint64_t End = Start;
+  for (gimple_stmt_iterator gsi = gsi_for_stmt(stmt); !gsi_end_p(gsi);
+       gsi_next(&gsi)) {
+    GimpleTy *S = gsi_stmt(gsi);
+    if (is_gimple_debug(S))
+      continue;
+#if GCC_VERSION_CODE > GCC_VERSION(4, 6)
+    // Later statements are not output on their own, so they must not be
+    // where the lifetime of some variable starts.
+    if (S != stmt && LifetimeStarts.count(S))
+      break;
+#endif
+    uint64_t Offset;
+    if (getConstantStore(S, Offset, Size) != Base || Offset != End)
+      break;
+    // The constant is copied as it is laid out in memory, so it must fill
+    // the stored bytes exactly.
+    Constant *C = ConvertInitializer(gimple_assign_rhs1(S));
+    if (DL.getTypeAllocSize(C->getType()) != Size ||
+        DL.getTypeStoreSize(C->getType()) != Size)
+      break;
+    Elts.push_back(C);
+    Last = S;
+    End += Size;
+  }
+  if (Elts.size() < TooCostly)
+    return 0;
+
+  Constant *Init = ConstantStruct::getAnon(Context, Elts, /*Packed*/ true);
+
+  LValue LV = EmitLV(gimple_assign_lhs(stmt));
+  GlobalVariable *GV = new GlobalVariable(*TheModule, Init->getType(), true,
+                                          GlobalVariable::PrivateLinkage, Init,
+                                          ".init");
+  GV->setAlignment(LV.getAlignment());
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  GV->setUnnamedAddr(flag_merge_constants >= 2 ?
+          llvm::GlobalValue::UnnamedAddr::Global :
+          llvm::GlobalValue::UnnamedAddr::Local);
+#else
+  GV->setUnnamedAddr(flag_merge_constants);
+#endif
+
+  EmitMemCpy(LV.Ptr, GV, Builder.getInt64(End - Start), LV.getAlignment());
+  return Last;
+}
+
 /// CostOfAccessingAllElements - Return a number representing the cost of doing
 /// an element by element copy of the specified type.  If it is clear that the
 /// type should not be copied this way, for example because it has a bazillion
@@ -2415,8 +3775,11 @@ void TreeToLLVM::CopyElementByElement(MemRef DestLoc, MemRef SrcLoc,
   }
 }
 
+/// TARGET_DRAGONEGG_MEMCPY_COST - The cost, as computed by
+/// CostOfAccessingAllElements, from which an aggregate of the given type is
+/// copied using memcpy rather than element by element.
 #ifndef TARGET_DRAGONEGG_MEMCPY_COST
-#define TARGET_DRAGONEGG_MEMCPY_COST 5
+#define TARGET_DRAGONEGG_MEMCPY_COST(TYPE) 5
 #endif
 
 /// EmitAggregateCopy - Copy the elements from SrcLoc to DestLoc, using the
@@ -2427,10 +3790,12 @@ void TreeToLLVM::EmitAggregateCopy(MemRef DestLoc, MemRef SrcLoc, tree type) {
 
   // If the type is small, copy element by element instead of using memcpy.
   unsigned Cost = CostOfAccessingAllElements(type);
-  if (Cost < TooCostly && Cost < TARGET_DRAGONEGG_MEMCPY_COST) {
+  if (Cost < TooCostly && Cost < TARGET_DRAGONEGG_MEMCPY_COST(type)) {
     CopyElementByElement(DestLoc, SrcLoc, type);
+    ++ConvStats.AggregateCopiesByElement;
     return;
   }
+  ++ConvStats.AggregateCopiesByMemcpy;
 
   Value *TypeSize = EmitRegister(TYPE_SIZE_UNIT(type));
   EmitMemCpy(DestLoc.Ptr, SrcLoc.Ptr, TypeSize,
@@ -2511,18 +3876,21 @@ void TreeToLLVM::ZeroElementByElement(MemRef DestLoc, tree type) {
   }
 }
 
+/// TARGET_DRAGONEGG_MEMSET_COST - Likewise for zeroing using memset.
 #ifndef TARGET_DRAGONEGG_MEMSET_COST
-#define TARGET_DRAGONEGG_MEMSET_COST 5
+#define TARGET_DRAGONEGG_MEMSET_COST(TYPE) 5
 #endif
 
 /// EmitAggregateZero - Zero the elements of DestLoc.
 void TreeToLLVM::EmitAggregateZero(MemRef DestLoc, tree type) {
   // If the type is small, zero element by element instead of using memset.
   unsigned Cost = CostOfAccessingAllElements(type);
-  if (Cost < TooCostly && Cost < TARGET_DRAGONEGG_MEMSET_COST) {
+  if (Cost < TooCostly && Cost < TARGET_DRAGONEGG_MEMSET_COST(type)) {
     ZeroElementByElement(DestLoc, type);
+    ++ConvStats.AggregateZeroesByElement;
     return;
   }
+  ++ConvStats.AggregateZeroesByMemset;
 
   EmitMemSet(DestLoc.Ptr, Builder.getInt8(0),
              EmitRegister(TYPE_SIZE_UNIT(type)), DestLoc.getAlignment());
@@ -2594,6 +3962,16 @@ Value *TreeToLLVM::EmitMemSet(Value *DestPtr, Value *SrcVal, Value *Size,
 
 // Emits code to do something for a type attribute
 void TreeToLLVM::EmitTypeGcroot(Value *V) {
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 7)
+  // The root is handed to each call that may collect, see EmitCallOf, leaving
+  // it free to live in a register in between.
+  if (flag_gc_statepoints) {
+    Fn->setGC("statepoint-example");
+    GCRoots.push_back(cast<AllocaInst>(V));
+    return;
+  }
+#endif
+
   // GC intrinsics can only be used in functions which specify a collector.
   Fn->setGC("shadow-stack");
 
@@ -2774,6 +4152,11 @@ static Constant *ConvertTypeInfo(tree type) {
   return AddressOf(type);
 }
 
+/// EHStats - Statistics about the exception handling code output.
+static ExceptionStatistics EHStats;
+
+const ExceptionStatistics &getExceptionStatistics() { return EHStats; }
+
 /// getExceptionPtr - Return the local holding the exception pointer for the
 /// given exception handling region, creating it if necessary.
 AllocaInst *TreeToLLVM::getExceptionPtr(int RegionNo) {
@@ -2831,17 +4214,142 @@ BasicBlock *TreeToLLVM::getFailureBlock(int RegionNo) {
     FailureBlocks.resize(RegionNo + 1, 0);
 
   BasicBlock *&FailureBlock = FailureBlocks[RegionNo];
-  LLVMContext &Context =
+  if (FailureBlock)
+    return FailureBlock;
+
+  // The failure code only depends on the function called, so regions that call
+  // the same function share a block.  In C++ this is usually std::terminate.
+  eh_region region = get_eh_region_from_number(RegionNo);
+  assert(region->type == ERT_MUST_NOT_THROW && "Unexpected region type!");
+  BasicBlock *&SharedBlock =
+      FailureBlocksByDecl[region->u.must_not_throw.failure_decl];
+  if (SharedBlock) {
+    ++EHStats.SharedFailureBlocks;
+  } else {
+    SharedBlock = CreateNamedBlock("fail");
+    ++EHStats.FailureBlocks;
+  }
+
+  FailureBlock = SharedBlock;
+  return FailureBlock;
+}
+
+/// getLandingPadClauses - Work out the clauses the landingpad instruction for
+/// the given exception handling region needs, and whether it is a cleanup.
+static void getLandingPadClauses(eh_region region,
+                                 std::vector<Constant *> &Clauses,
+                                 bool &IsCleanup) {
+  Type *Int8PtrTy = Type::getInt8PtrTy(
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
-      TheModule->getContext();
+      TheModule->getContext()
+#else
+      TheContext
+#endif
+      );
+  IsCleanup = false;
+  bool AllCaught = false; // Did we see a catch-all or no-throw?
+  SmallSet<Constant *, 8> AlreadyCaught; // Typeinfos known caught already.
+  for (; region && !AllCaught; region = region->outer)
+    switch (region->type) {
+    case ERT_ALLOWED_EXCEPTIONS: {
+      // Filter.  Compute the list of type infos.
+      AllCaught = true;
+      std::vector<Constant *> TypeInfos;
+      for (tree type = region->u.allowed.type_list; type;
+           type = TREE_CHAIN(type)) {
+        Constant *TypeInfo = ConvertTypeInfo(TREE_VALUE(type));
+        // No point in letting a typeinfo through if we know it can't reach
+        // the filter in the first place.
+        if (AlreadyCaught.count(TypeInfo))
+          continue;
+        TypeInfo = TheFolder->CreateBitCast(TypeInfo, Int8PtrTy);
+        TypeInfos.push_back(TypeInfo);
+        AllCaught = false;
+      }
+
+      // Add the list of typeinfos as a filter clause.
+      ArrayType *FilterTy = ArrayType::get(Int8PtrTy, TypeInfos.size());
+      Clauses.push_back(ConstantArray::get(FilterTy, TypeInfos));
+      break;
+    }
+    case ERT_CLEANUP:
+      IsCleanup = true;
+      break;
+    case ERT_MUST_NOT_THROW: {
+      // Same as a zero-length filter: add an empty filter clause.
+      ArrayType *FilterTy = ArrayType::get(Int8PtrTy, 0);
+      Clauses.push_back(ConstantArray::get(FilterTy, ArrayRef<Constant *>()));
+      AllCaught = true;
+      break;
+    }
+    case ERT_TRY:
+      // Catches.
+      for (eh_catch c = region->u.eh_try.first_catch; c; c = c->next_catch)
+        if (!c->type_list) {
+          // Catch-all - add a null pointer as a catch clause.
+          Clauses.push_back(Constant::getNullValue(Int8PtrTy));
+          AllCaught = true;
+          break;
+        } else {
+          // Add the type infos.
+          for (tree type = c->type_list; type; type = TREE_CHAIN(type)) {
+            Constant *TypeInfo = ConvertTypeInfo(TREE_VALUE(type));
+            // No point in trying to catch a typeinfo that was already caught.
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 3)
+            if (!AlreadyCaught.insert(TypeInfo).second)
 #else
-      TheContext;
+            if (!AlreadyCaught.insert(TypeInfo))
 #endif
+              continue;
+            Clauses.push_back(TypeInfo);
+          }
+        }
+      break;
+    }
+}
 
-  if (!FailureBlock)
-    FailureBlock = BasicBlock::Create(Context, "fail");
+/// usesExceptionSlots - Whether the exception pointer or filter value of the
+/// given exception handling region is read anywhere.
+bool TreeToLLVM::usesExceptionSlots(unsigned RegionNo) {
+  return (RegionNo < ExceptionPtrs.size() && ExceptionPtrs[RegionNo]) ||
+         (RegionNo < ExceptionFilters.size() && ExceptionFilters[RegionNo]);
+}
 
-  return FailureBlock;
+/// ShareLandingPads - Have exception handling regions that unwind to the same
+/// GCC post landing pad and catch the same exceptions share a landing pad,
+/// rather than each getting an identical one of its own.  The invokes for the
+/// regions sharing are moved to the list of the first of them.
+void TreeToLLVM::ShareLandingPads() {
+  typedef std::pair<BasicBlock *, std::pair<bool, std::vector<Constant *> > >
+  LandingPadKey;
+  std::map<LandingPadKey, unsigned> FirstWithKey;
+
+  for (unsigned LPadNo = 1; LPadNo < NormalInvokes.size(); ++LPadNo) {
+    SmallVector<InvokeInst *, 8> &InvokesForPad = NormalInvokes[LPadNo];
+    if (InvokesForPad.empty())
+      continue;
+
+    // Regions whose exception pointer or filter value is used need their own
+    // landing pad to store them.
+    eh_region region = get_eh_region_from_lp_number(LPadNo);
+    if (usesExceptionSlots(region->index))
+      continue;
+
+    LandingPadKey Key;
+    Key.first = InvokesForPad[0]->getUnwindDest();
+    getLandingPadClauses(region, Key.second.second, Key.second.first);
+
+    std::map<LandingPadKey, unsigned>::iterator I = FirstWithKey.find(Key);
+    if (I == FirstWithKey.end()) {
+      FirstWithKey[Key] = LPadNo;
+      continue;
+    }
+
+    SmallVector<InvokeInst *, 8> &Shared = NormalInvokes[I->second];
+    Shared.append(InvokesForPad.begin(), InvokesForPad.end());
+    InvokesForPad.clear();
+    ++EHStats.SharedLandingPads;
+  }
 }
 
 /// EmitLandingPads - Emit EH landing pads.
@@ -2850,6 +4358,8 @@ void TreeToLLVM::EmitLandingPads() {
   if (NormalInvokes.empty())
     return;
 
+  ShareLandingPads();
+
   // If a GCC post landing pad is shared by several exception handling regions,
   // or if there is a normal edge to it, then create LLVM landing pads for each
   // eh region.  The landing pad instruction will then go in the LLVM landing
@@ -2874,13 +4384,7 @@ void TreeToLLVM::EmitLandingPads() {
       continue;
 
     // Create the LLVM landing pad right before the GCC post landing pad.
-    LLVMContext &Context =
-#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
-        PostPad->getContext();
-#else
-        TheContext;
-#endif
-    BasicBlock *LPad = BasicBlock::Create(Context, "lpad", Fn, PostPad);
+    BasicBlock *LPad = CreateNamedBlock("lpad", Fn, PostPad);
 
     // Redirect invoke unwind edges from the GCC post landing pad to LPad.
     for (unsigned i = 0, e = InvokesForPad.size(); i < e; ++i)
@@ -2928,8 +4432,9 @@ void TreeToLLVM::EmitLandingPads() {
 
   // Create the landing pad instruction for each exception handling region at
   // the start of the corresponding landing pad.  At this point each exception
-  // handling region has its own landing pad, which is only reachable via the
-  // unwind edges of the region's invokes.
+  // handling region has its own landing pad, or shares one with regions that
+  // catch the same exceptions, which is only reachable via the unwind edges of
+  // their invokes.
   Type *UnwindDataTy =
       StructType::get(Builder.getInt8PtrTy(), Builder.getInt32Ty()
 #if LLVM_VERSION_CODE < LLVM_VERSION(5, 0)
@@ -2959,8 +4464,12 @@ void TreeToLLVM::EmitLandingPads() {
 #endif
                            LPad->getFirstNonPHI());
 
-    // Create the landingpad instruction without any clauses.  Clauses are added
-    // below.
+    // Work out the clauses.  These are added once the instruction is created.
+    std::vector<Constant *> Clauses;
+    bool IsCleanup;
+    getLandingPadClauses(region, Clauses, IsCleanup);
+
+    // Create the landingpad instruction, with room for the clauses.
     tree personality = DECL_FUNCTION_PERSONALITY(FnDecl);
     if (!personality) {
       assert(function_needs_eh_personality(cfun) == eh_personality_any &&
@@ -2973,7 +4482,7 @@ void TreeToLLVM::EmitLandingPads() {
 #if LLVM_VERSION_CODE < LLVM_VERSION(3, 9)
         DECL_LLVM(personality),
 #endif
-        0, "exc");
+        Clauses.size(), "exc");
 
     // Store the exception pointer if made use of elsewhere.
     if (RegionNo < ExceptionPtrs.size() && ExceptionPtrs[RegionNo]) {
@@ -2988,67 +4497,10 @@ void TreeToLLVM::EmitLandingPads() {
     }
 
     // Add clauses to the landing pad instruction.
-    bool AllCaught = false; // Did we see a catch-all or no-throw?
-    SmallSet<Constant *, 8> AlreadyCaught; // Typeinfos known caught already.
-    for (; region && !AllCaught; region = region->outer)
-      switch (region->type) {
-      case ERT_ALLOWED_EXCEPTIONS: {
-        // Filter.  Compute the list of type infos.
-        AllCaught = true;
-        std::vector<Constant *> TypeInfos;
-        for (tree type = region->u.allowed.type_list; type;
-             type = TREE_CHAIN(type)) {
-          Constant *TypeInfo = ConvertTypeInfo(TREE_VALUE(type));
-          // No point in letting a typeinfo through if we know it can't reach
-          // the filter in the first place.
-          if (AlreadyCaught.count(TypeInfo))
-            continue;
-          TypeInfo = TheFolder->CreateBitCast(TypeInfo, Builder.getInt8PtrTy());
-          TypeInfos.push_back(TypeInfo);
-          AllCaught = false;
-        }
-
-        // Add the list of typeinfos as a filter clause.
-        ArrayType *FilterTy =
-            ArrayType::get(Builder.getInt8PtrTy(), TypeInfos.size());
-        LPadInst->addClause(ConstantArray::get(FilterTy, TypeInfos));
-        break;
-      }
-      case ERT_CLEANUP:
-        LPadInst->setCleanup(true);
-        break;
-      case ERT_MUST_NOT_THROW: {
-        // Same as a zero-length filter: add an empty filter clause.
-        ArrayType *FilterTy = ArrayType::get(Builder.getInt8PtrTy(), 0);
-        LPadInst->addClause(
-            ConstantArray::get(FilterTy, ArrayRef<Constant *>()));
-        AllCaught = true;
-        break;
-      }
-      case ERT_TRY:
-        // Catches.
-        for (eh_catch c = region->u.eh_try.first_catch; c; c = c->next_catch)
-          if (!c->type_list) {
-            // Catch-all - add a null pointer as a catch clause.
-            LPadInst->addClause(Constant::getNullValue(Builder.getInt8PtrTy()));
-            AllCaught = true;
-            break;
-          } else {
-            // Add the type infos.
-            for (tree type = c->type_list; type; type = TREE_CHAIN(type)) {
-              Constant *TypeInfo = ConvertTypeInfo(TREE_VALUE(type));
-              // No point in trying to catch a typeinfo that was already caught.
-#if LLVM_VERSION_CODE > LLVM_VERSION(3, 3)
-              if (!AlreadyCaught.insert(TypeInfo).second)
-#else
-              if (!AlreadyCaught.insert(TypeInfo))
-#endif
-                continue;
-              LPadInst->addClause(TypeInfo);
-            }
-          }
-        break;
-      }
+    for (unsigned i = 0, e = Clauses.size(); i != e; ++i)
+      LPadInst->addClause(Clauses[i]);
+    LPadInst->setCleanup(IsCleanup);
+    ++EHStats.LandingPads;
   }
 
   NormalInvokes.clear();
@@ -3060,7 +4512,9 @@ void TreeToLLVM::EmitFailureBlocks() {
   for (unsigned RegionNo = 1; RegionNo < FailureBlocks.size(); ++RegionNo) {
     BasicBlock *FailureBlock = FailureBlocks[RegionNo];
 
-    if (!FailureBlock)
+    // Skip regions without failure code, and regions whose failure block was
+    // already output for another region.
+    if (!FailureBlock || FailureBlock->getParent())
       continue;
 
     LLVMContext &Context =
@@ -3096,7 +4550,7 @@ void TreeToLLVM::EmitFailureBlocks() {
       // If all predecessors are invokes, then the failure block can be used as
       // the landing pad.  Otherwise, create a landing pad.
       if (hasBranchPred)
-        LandingPad = BasicBlock::Create(Context, "pad");
+        LandingPad = CreateNamedBlock("pad");
       else
         LandingPad = FailureBlock;
     }
@@ -3181,6 +4635,119 @@ static bool canEmitRegisterVariable(tree exp) {
   return false;
 }
 
+#if (GCC_MAJOR > 4) && LLVM_VERSION_CODE > LLVM_VERSION(3, 5)
+/// getRestrictBase - If the pointer 'ptr' is based on a restrict qualified
+/// argument, return the argument.  If it is based on a restrict qualified
+/// pointer loaded from the object such an argument points to, like the data
+/// pointer of a Fortran array descriptor, return the argument and the field
+/// the pointer was loaded from.  Otherwise return a pair of nulls.
+static std::pair<tree, tree> getRestrictBase(tree ptr) {
+  tree field = NULL_TREE;
+  // Look through copies, conversions and pointer arithmetic, but give up after
+  // a few steps since this is done for every memory access.
+  for (unsigned Steps = 0; Steps != 8 && isa<SSA_NAME>(ptr); ++Steps) {
+    if (SSA_NAME_IS_DEFAULT_DEF(ptr)) {
+      tree var = SSA_NAME_VAR(ptr);
+      if (var && isa<PARM_DECL>(var) && isa<ACCESS_TYPE>(TREE_TYPE(var)) &&
+          TYPE_RESTRICT(TREE_TYPE(var)))
+        return std::make_pair(var, field);
+      break;
+    }
+
+    GimpleTy *def = SSA_NAME_DEF_STMT(ptr);
+    if (!is_gimple_assign(def))
+      break;
+    tree rhs = gimple_assign_rhs1(def);
+    tree_code code = gimple_assign_rhs_code(def);
+    if (code == SSA_NAME || code == POINTER_PLUS_EXPR ||
+        CONVERT_EXPR_CODE_P(code)) {
+      ptr = rhs;
+    } else if (code == COMPONENT_REF && !field &&
+               TYPE_RESTRICT(TREE_TYPE(TREE_OPERAND(rhs, 1))) &&
+               isa<MEM_REF>(TREE_OPERAND(rhs, 0))) {
+      // A restrict pointer loaded from a field of the pointed to object.
+      field = TREE_OPERAND(rhs, 1);
+      ptr = TREE_OPERAND(TREE_OPERAND(rhs, 0), 0);
+    } else {
+      break;
+    }
+  }
+  return std::make_pair(NULL_TREE, NULL_TREE);
+}
+#endif
+
+/// describeAccess - Return the metadata to attach to a load from or store to
+/// the memory reference 'exp'.
+AccessTags TreeToLLVM::describeAccess(tree exp) {
+  AccessTags Tags(describeAliasSet(exp));
+#if (GCC_MAJOR > 4) && LLVM_VERSION_CODE > LLVM_VERSION(3, 5)
+  tree base = exp;
+  while (handled_component_p(base))
+    base = TREE_OPERAND(base, 0);
+  if (!isa<MEM_REF>(base) && !isa<TARGET_MEM_REF>(base))
+    return Tags;
+
+  if (!MR_DEPENDENCE_CLIQUE(base)) {
+    // GCC's alias analysis did not run, as is usual when its optimizers are
+    // off, so work out the restrict pointer the access is based on directly.
+    // Arguments that Fortran promises do not alias, including the data of
+    // array descriptors, are passed this way.  As below, give each pointer its
+    // own alias scope and say that the access does not alias the others.
+    std::pair<tree, tree> Restrict = getRestrictBase(TREE_OPERAND(base, 0));
+    if (!Restrict.first)
+      return Tags;
+    MDBuilder MDHelper(Fn->getContext());
+    if (RestrictScopes.empty())
+      RestrictScopes.push_back(
+          MDHelper.createAnonymousAliasScopeDomain("restrict"));
+    unsigned &Index = RestrictBases[Restrict];
+    if (!Index) {
+      Index = RestrictScopes.size();
+      RestrictScopes.push_back(
+          MDHelper.createAnonymousAliasScope(RestrictScopes[0]));
+    }
+
+    SmallVector<Metadata *, 4> Others;
+    for (unsigned i = 1, e = RestrictScopes.size(); i != e; ++i)
+      if (i != Index)
+        Others.push_back(RestrictScopes[i]);
+    Tags.Scope = MDNode::get(Fn->getContext(), RestrictScopes[Index]);
+    if (!Others.empty())
+      Tags.NoAlias = MDNode::get(Fn->getContext(), Others);
+    return Tags;
+  }
+
+  // GCC uses restrict and its points-to results to split indirect references
+  // into dependence cliques: references in the same clique with different
+  // bases do not overlap.  Give each base its own alias scope, and say that
+  // the access does not alias the other bases seen so far in the clique.  One
+  // direction is enough for LLVM, so there is no need to know all the bases up
+  // front.
+  unsigned Clique = MR_DEPENDENCE_CLIQUE(base);
+  unsigned Index = MR_DEPENDENCE_BASE(base) + 1;
+
+  if (DependenceScopes.size() <= Clique)
+    DependenceScopes.resize(Clique + 1);
+  SmallVector<MDNode *, 4> &Scopes = DependenceScopes[Clique];
+  MDBuilder MDHelper(Fn->getContext());
+  if (Scopes.empty())
+    Scopes.push_back(MDHelper.createAnonymousAliasScopeDomain());
+  if (Scopes.size() <= Index)
+    Scopes.resize(Index + 1, 0);
+  if (!Scopes[Index])
+    Scopes[Index] = MDHelper.createAnonymousAliasScope(Scopes[0]);
+
+  SmallVector<Metadata *, 4> Others;
+  for (unsigned i = 1, e = Scopes.size(); i != e; ++i)
+    if (i != Index && Scopes[i])
+      Others.push_back(Scopes[i]);
+  Tags.Scope = MDNode::get(Fn->getContext(), Scopes[Index]);
+  if (!Others.empty())
+    Tags.NoAlias = MDNode::get(Fn->getContext(), Others);
+#endif
+  return Tags;
+}
+
 /// EmitLoadOfLValue - When an l-value expression is used in a context that
 /// requires an r-value, this method emits the lvalue computation, then loads
 /// the result.
@@ -3199,20 +4766,23 @@ Value *TreeToLLVM::EmitLoadOfLValue(tree exp) {
   tree type = TREE_TYPE(exp);
   if (!LV.isBitfield())
     // Scalar value: emit a load.
-    return LoadRegisterFromMemory(LV, type, describeAliasSet(exp), Builder);
+    return LoadRegisterFromMemory(LV, type, describeAccess(exp), Builder);
 
   // This is a bitfield reference.
   Type *Ty = getRegType(type);
   if (!LV.BitSize)
     return Constant::getNullValue(Ty);
 
-  // Load the minimum number of bytes that covers the field.
+  // Load the minimum number of bytes that covers the field, unless told how
+  // much to load.
   unsigned LoadSizeInBits = LV.BitStart + LV.BitSize;
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
   LoadSizeInBits = alignTo(LoadSizeInBits, BITS_PER_UNIT);
 #else
   LoadSizeInBits = RoundUpToAlignment(LoadSizeInBits, BITS_PER_UNIT);
 #endif
+  if (LV.AccessSize)
+    LoadSizeInBits = LV.AccessSize;
   LLVMContext &Context =
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
       Ty->getContext();
@@ -3222,7 +4792,8 @@ Value *TreeToLLVM::EmitLoadOfLValue(tree exp) {
   Type *LoadType = IntegerType::get(Context, LoadSizeInBits);
 
   // Load the bits.
-  Value *Ptr = Builder.CreateBitCast(LV.Ptr, LoadType->getPointerTo());
+  Value *Ptr =
+      Builder.CreateBitCast(LV.Ptr, getPointerInSameSpace(LoadType, LV.Ptr));
   Value *Val = Builder.CreateAlignedLoad(Ptr, Alignment, LV.Volatile);
 
   // Mask the bits out by shifting left first, then shifting right.  The
@@ -3258,7 +4829,7 @@ Value *TreeToLLVM::EmitLoadOfLValue(tree exp) {
   // both the integer and the real type.  Store the bits to it.
   Alignment = std::max(TYPE_ALIGN(type) / 8,
                        DL.getPrefTypeAlignment(ResIntTy));
-  MemRef Tmp(CreateTemporary(ResIntTy, Alignment), Alignment, false);
+  MemRef Tmp(CreateScratchTemporary(ResIntTy, Alignment), Alignment, false);
   Builder.CreateStore(ResInt, Tmp.Ptr);
 
   // At this point we have in essence just displaced the original set of bits to
@@ -3604,8 +5175,21 @@ struct FunctionCallArgumentConversion : public DefaultABIClient {
   /// HandleByInvisibleReferenceArgument - This callback is invoked if a
   /// pointer (of type PtrTy) to the argument is passed rather than the
   /// argument itself.
-  void HandleByInvisibleReferenceArgument(llvm::Type *PtrTy, tree /*type*/) {
+  void HandleByInvisibleReferenceArgument(llvm::Type *PtrTy, tree type) {
     Value *Loc = getAddress();
+    // If it is the target rather than the language that wants the argument
+    // passed by reference then the callee may change it, so pass a copy.  The
+    // language only does this for addressable types and those of variable size.
+    if ((isa<AGGREGATE_TYPE>(type) || isa<COMPLEX_TYPE>(type)) &&
+        !TREE_ADDRESSABLE(type) && TYPE_SIZE(type) &&
+        isa<INTEGER_CST>(TYPE_SIZE(type))) {
+      unsigned Align = TYPE_ALIGN_UNIT(type);
+      MemRef Copy(TheTreeToLLVM->CreateScratchTemporary(ConvertType(type),
+                                                        Align),
+                  Align, false);
+      TheTreeToLLVM->EmitAggregateCopy(Copy, MemRef(Loc, Align, false), type);
+      Loc = Copy.Ptr;
+    }
     Loc = Builder.CreateBitCast(Loc, PtrTy);
     CallOperands.push_back(Loc);
   }
@@ -3649,6 +5233,215 @@ struct FunctionCallArgumentConversion : public DefaultABIClient {
 };
 }
 
+namespace {
+/// ValueLeaf - A scalar or vector inside a first class aggregate: its type,
+/// its offset in bytes in the aggregate's memory layout, the indices that
+/// extract it and, if it is a single lane of a vector, which one.
+struct ValueLeaf {
+  Type *Ty;
+  uint64_t Offset;
+  SmallVector<unsigned, 4> Indices;
+  int Lane;
+};
+}
+
+/// FlattenValueType - Append the leaves of a value of type Ty, which lives at
+/// byte offset Offset and is extracted using Indices, to Leaves.  Vectors are
+/// broken up into their lanes if SplitVectors is set.
+static void FlattenValueType(Type *Ty, uint64_t Offset,
+                             SmallVectorImpl<unsigned> &Indices,
+                             bool SplitVectors,
+                             std::vector<ValueLeaf> &Leaves) {
+  const DataLayout &DL = getDataLayout();
+  if (StructType *STy = llvm::dyn_cast<StructType>(Ty)) {
+    const StructLayout *SL = DL.getStructLayout(STy);
+    for (unsigned i = 0, e = STy->getNumElements(); i != e; ++i) {
+      Indices.push_back(i);
+      FlattenValueType(STy->getElementType(i), Offset + SL->getElementOffset(i),
+                       Indices, SplitVectors, Leaves);
+      Indices.pop_back();
+    }
+    return;
+  }
+  if (ArrayType *ATy = llvm::dyn_cast<ArrayType>(Ty)) {
+    uint64_t EltSize = DL.getTypeAllocSize(ATy->getElementType());
+    for (unsigned i = 0, e = ATy->getNumElements(); i != e; ++i) {
+      Indices.push_back(i);
+      FlattenValueType(ATy->getElementType(), Offset + i * EltSize, Indices,
+                       SplitVectors, Leaves);
+      Indices.pop_back();
+    }
+    return;
+  }
+
+  ValueLeaf Leaf;
+  Leaf.Ty = Ty;
+  Leaf.Offset = Offset;
+  Leaf.Indices.append(Indices.begin(), Indices.end());
+  Leaf.Lane = -1;
+  VectorType *VTy = llvm::dyn_cast<VectorType>(Ty);
+  if (!SplitVectors || !VTy) {
+    Leaves.push_back(Leaf);
+    return;
+  }
+  Leaf.Ty = VTy->getElementType();
+  uint64_t EltSize = DL.getTypeAllocSize(Leaf.Ty);
+  for (unsigned i = 0, e = VTy->getNumElements(); i != e; ++i) {
+    Leaf.Offset = Offset + i * EltSize;
+    Leaf.Lane = i;
+    Leaves.push_back(Leaf);
+  }
+}
+
+/// MatchValueLeaves - For each leaf of Dest, find the leaf of Src with the same
+/// type and offset.  Leaves of Src that are not matched only hold padding of
+/// Dest.  Returns false if some leaf of Dest has no match.
+static bool MatchValueLeaves(const std::vector<ValueLeaf> &Src,
+                             const std::vector<ValueLeaf> &Dest,
+                             std::vector<unsigned> &Match) {
+  Match.clear();
+  unsigned s = 0;
+  for (unsigned d = 0, e = Dest.size(); d != e; ++d) {
+    while (s != Src.size() && Src[s].Offset < Dest[d].Offset)
+      ++s;
+    if (s == Src.size() || Src[s].Offset != Dest[d].Offset ||
+        Src[s].Ty != Dest[d].Ty)
+      return false;
+    Match.push_back(s);
+  }
+  return true;
+}
+
+/// BuildMultipleReturnValue - The registers Src returned by a call hold a value
+/// of type DestTy, in the sense that storing Src to memory and loading it back
+/// as a DestTy gives the value.  Build that value directly using insertvalue,
+/// without going through memory.  Returns null if the registers do not hold the
+/// elements of DestTy one for one.
+static Value *BuildMultipleReturnValue(Value *Src, Type *DestTy,
+                                       LLVMBuilder &Builder) {
+  if (Src->getType() == DestTy)
+    return Src;
+
+  SmallVector<unsigned, 4> Indices;
+  std::vector<ValueLeaf> DestLeaves, SrcLeaves;
+  std::vector<unsigned> Match;
+  FlattenValueType(DestTy, 0, Indices, false, DestLeaves);
+  FlattenValueType(Src->getType(), 0, Indices, false, SrcLeaves);
+  if (!MatchValueLeaves(SrcLeaves, DestLeaves, Match)) {
+    // Registers often hold several elements in one vector, for example a pair
+    // of floats returned in <2 x float>.
+    SrcLeaves.clear();
+    FlattenValueType(Src->getType(), 0, Indices, true, SrcLeaves);
+    if (!MatchValueLeaves(SrcLeaves, DestLeaves, Match))
+      return 0;
+  }
+
+  Value *Result = UndefValue::get(DestTy);
+  for (unsigned i = 0, e = DestLeaves.size(); i != e; ++i) {
+    const ValueLeaf &From = SrcLeaves[Match[i]];
+    Value *V = Builder.CreateExtractValue(Src, From.Indices, "mrv_gr");
+    if (From.Lane >= 0)
+      V = Builder.CreateExtractElement(V, Builder.getInt32(From.Lane), "mrv");
+    Result = Builder.CreateInsertValue(Result, V, DestLeaves[i].Indices);
+  }
+  return Result;
+}
+
+/// UsesLocalMemory - Whether any of the given call arguments points into the
+/// caller's stack frame, for example to a temporary copy of an aggregate.  The
+/// callee of a tail call must not access such memory.
+static bool UsesLocalMemory(ArrayRef<Value *> Ops) {
+  for (unsigned i = 0, e = Ops.size(); i != e; ++i)
+    if (Ops[i]->getType()->isPointerTy() &&
+        isa<AllocaInst>(Ops[i]->stripInBoundsOffsets()))
+      return true;
+  return false;
+}
+
+#if (GCC_MAJOR > 6) && LLVM_VERSION_CODE > LLVM_VERSION(3, 4)
+/// isInTailPosition - Whether the given call is followed by nothing but the
+/// return of its result.
+static bool isInTailPosition(GimpleTy *stmt) {
+  tree lhs = gimple_call_lhs(stmt);
+  basic_block bb = gimple_bb(stmt);
+  gimple_stmt_iterator gsi = gsi_for_stmt(stmt);
+  gsi_next(&gsi);
+  while (true) {
+    if (gsi_end_p(gsi)) {
+      // Carry on into the successor, if there is only one and it has no phis.
+      if (!single_succ_p(bb) ||
+          single_succ(bb) == EXIT_BLOCK_PTR_FOR_FN(cfun))
+        return false;
+      bb = single_succ(bb);
+      if (!gimple_seq_empty_p(phi_nodes(bb)))
+        return false;
+      gsi = gsi_start_bb(bb);
+      continue;
+    }
+    GimpleTy *S = gsi_stmt(gsi);
+    if (is_gimple_debug(S) || gimple_code(S) == GIMPLE_LABEL) {
+      gsi_next(&gsi);
+      continue;
+    }
+    return gimple_code(S) == GIMPLE_RETURN &&
+           gimple_return_retval(as_a<greturn *>(S)) == lhs;
+  }
+}
+
+/// getMustTailProblem - Return why the given call, which GCC says must be a
+/// tail call, cannot be a musttail call in LLVM IR, or null if it can.
+static const char *getMustTailProblem(GimpleTy *stmt, Function *Caller,
+                                      FunctionType *FTy, CallingConv::ID CC,
+                                      ArrayRef<Value *> Ops, bool IsInvoke) {
+  if (IsInvoke)
+    return "callee may throw an exception that is caught";
+  if (!isInTailPosition(stmt))
+    return "call is not in tail position";
+  FunctionType *CallerTy = Caller->getFunctionType();
+  if (FTy->isVarArg() || CallerTy->isVarArg())
+    return "variadic function";
+  if (CC != Caller->getCallingConv())
+    return "callee uses a different calling convention";
+  if (FTy->getNumParams() != CallerTy->getNumParams())
+    return "callee takes a different number of arguments";
+  // Pointer types may differ in what they point to, but nothing else.
+  for (unsigned i = 0, e = FTy->getNumParams() + 1; i != e; ++i) {
+    Type *CalleeArgTy = i ? FTy->getParamType(i - 1) : FTy->getReturnType();
+    Type *CallerArgTy =
+        i ? CallerTy->getParamType(i - 1) : CallerTy->getReturnType();
+    if (CalleeArgTy != CallerArgTy &&
+        (!CalleeArgTy->isPointerTy() || !CallerArgTy->isPointerTy() ||
+         CalleeArgTy->getPointerAddressSpace() !=
+             CallerArgTy->getPointerAddressSpace()))
+      return i ? "callee has different argument types" :
+                 "callee returns a different type";
+  }
+  if (UsesLocalMemory(Ops))
+    return "callee uses memory in the caller's stack frame";
+  return 0;
+}
+#endif
+
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 7)
+/// canCallThroughStatepoint - Return true if a call to 'Callee', of type 'FTy'
+/// and with attributes 'PAL', can be made using gc.statepoint.  The statepoint
+/// does not keep the attributes of the arguments, so calls with arguments that
+/// are passed specially because of their attributes are made normally.
+static bool canCallThroughStatepoint(Value *Callee, FunctionType *FTy,
+                                     const MigAttributeSet &PAL) {
+  if (FTy->isVarArg())
+    return false;
+  if (Function *F = dyn_cast<Function>(Callee->stripPointerCasts()))
+    if (F->isIntrinsic())
+      return false;
+  return !PAL.hasAttrSomewhere(Attribute::ByVal) &&
+         !PAL.hasAttrSomewhere(Attribute::InAlloca) &&
+         !PAL.hasAttrSomewhere(Attribute::InReg) &&
+         !PAL.hasAttrSomewhere(Attribute::Nest) &&
+         !PAL.hasAttrSomewhere(Attribute::StructRet);
+}
+#endif
+
 /// EmitCallOf - Emit a call to the specified callee with the operands specified
 /// in the GIMPLE_CALL 'stmt'. If the result of the call is a scalar, return the
 /// result, otherwise store it in DestLoc.
@@ -3662,10 +5455,19 @@ Value *TreeToLLVM::EmitCallOf(Value *Callee, GimpleTy *stmt,
     PAL = cast<Function>(Callee)->getAttributes();
 
   // Work out whether to use an invoke or an ordinary call.
-  if (!stmt_could_throw_p(stmt))
+  if (!stmt_could_throw_p(stmt)) {
     // This call does not throw - mark it 'nounwind'.
     PAL = PAL.addAttribute(Callee->getContext(), MigAttributeSet::FunctionIndex,
                            Attribute::NoUnwind);
+  } else if (Function *F = dyn_cast<Function>(Callee->stripPointerCasts())) {
+    // The callee may have been found not to throw after GCC built the call.
+    if (F->doesNotThrow()) {
+      PAL = PAL.addAttribute(Callee->getContext(),
+                             MigAttributeSet::FunctionIndex,
+                             Attribute::NoUnwind);
+      ++ConvStats.NoUnwindCalls;
+    }
+  }
 
   if (!PAL.hasAttribute(MigAttributeSet::FunctionIndex, Attribute::NoUnwind)) {
     // This call may throw.  Determine if we need to generate
@@ -3700,6 +5502,12 @@ Value *TreeToLLVM::EmitCallOf(Value *Callee, GimpleTy *stmt,
   tree fntype = gimple_call_fntype(stmt);
 #endif
 
+  // Remember how often the callee was called from here, for the call graph
+  // profile.
+  if (fndecl && hasProfileCounts())
+    CallGraphCounts[std::make_pair(FnDecl, fndecl)] +=
+        getBlockCount(gimple_bb(stmt));
+
   // Determine the calling convention.
   CallingConv::ID CallingConvention = CallingConv::C;
 #ifdef TARGET_ADJUST_LLVM_CC
@@ -3770,6 +5578,23 @@ Value *TreeToLLVM::EmitCallOf(Value *Callee, GimpleTy *stmt,
 
     ABIConverter.HandleArgument(type, ScalarArgs, &AttrBuilder);
 
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 5)
+    // The address of a variable is not null, and the whole variable can be
+    // read through it.
+    if (CallOperands.size() == OldSize + 1 &&
+        CallOperands.back()->getType()->isPointerTy() && isa<ADDR_EXPR>(arg)) {
+      tree decl = TREE_OPERAND(arg, 0);
+      if ((isa<PARM_DECL>(decl) || (isa<VAR_DECL>(decl) && !DECL_WEAK(decl)))
+          && ADDR_SPACE_GENERIC_P(TYPE_ADDR_SPACE(TREE_TYPE(decl))) &&
+          flag_delete_null_pointer_checks) {
+        AttrBuilder.addAttribute(Attribute::NonNull);
+        if (DECL_SIZE_UNIT(decl) && isInt64(DECL_SIZE_UNIT(decl), true))
+          if (uint64_t Size = getInt64(DECL_SIZE_UNIT(decl), true))
+            AttrBuilder.addDereferenceableAttr(Size);
+      }
+    }
+#endif
+
     if (AttrBuilder.hasAttributes()) {
       // If the argument is split into multiple scalars, assign the
       // attributes to all scalars of the aggregate.
@@ -3786,6 +5611,17 @@ Value *TreeToLLVM::EmitCallOf(Value *Callee, GimpleTy *stmt,
     Client.clear();
   }
 
+  // Calls starting an OpenMP parallel region or task pass the address of a
+  // block of data to the outlined body of the region.  Unless the region is
+  // started by the old GOMP_*_start interface, libgomp has finished with the
+  // address by the time it returns.
+  if (fndecl && CallOperands.size() > 1)
+    if (unsigned Kind = getOpenMPRegionKind(fndecl)) {
+      if (Kind != OMP_REGION_START)
+        PAL = PAL.addAttribute(Context, 2, Attribute::NoCapture);
+      NoteOpenMPChild(stmt, Kind);
+    }
+
   // If the caller and callee disagree about a parameter type but the difference
   // is trivial, correct the type used by the caller.
   for (unsigned i = 0, e = std::min((unsigned) CallOperands.size(),
@@ -3807,16 +5643,73 @@ Value *TreeToLLVM::EmitCallOf(Value *Callee, GimpleTy *stmt,
     for (unsigned i = CallOperands.size(), e = FTy->getNumParams(); i != e; ++i)
       CallOperands.push_back(UndefValue::get(FTy->getParamType(i)));
 
+  // Calls which GCC says must be tail calls are output as musttail calls, and
+  // followed by the return.  GCC would complain if it could not make one.
+  bool MustTail = false;
+#if (GCC_MAJOR > 6) && LLVM_VERSION_CODE > LLVM_VERSION(3, 4)
+  if (gimple_call_must_tail_p(MIG_TO_GCALL(stmt))) {
+    if (const char *Problem =
+            getMustTailProblem(stmt, Fn, FTy, CallingConvention, CallOperands,
+                               LandingPad != 0))
+      error("cannot tail-call: %s", Problem);
+    else
+      MustTail = true;
+  }
+#endif
+
+  // If the garbage collector roots are not in registered stack slots, pass them
+  // to the call using gc.statepoint so that the collector can find them, and
+  // reload them from their relocated values afterwards.
+  bool UseStatepoint = false;
+  SmallVector<Value *, 4> Roots;
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 7)
+  UseStatepoint = !GCRoots.empty() && !MustTail &&
+                  canCallThroughStatepoint(Callee, FTy, PAL);
+  if (UseStatepoint)
+    for (unsigned i = 0, e = GCRoots.size(); i != e; ++i)
+      Roots.push_back(Builder.CreateLoad(GCRoots[i]));
+#endif
+
   Value *Call;
   if (!LandingPad) {
-    Call = Builder.CreateCall(Callee, CallOperands);
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 7)
+    if (UseStatepoint)
+      Call = Builder.CreateGCStatepointCall(0, 0, Callee, CallOperands, None,
+                                            Roots);
+    else
+#endif
+      Call = Builder.CreateCall(Callee, CallOperands);
     cast<CallInst>(Call)->setCallingConv(CallingConvention);
-    cast<CallInst>(Call)->setAttributes(PAL);
+    if (!UseStatepoint)
+      cast<CallInst>(Call)->setAttributes(PAL);
+    if (MustTail) {
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 4)
+      cast<CallInst>(Call)->setTailCallKind(CallInst::TCK_MustTail);
+#endif
+      if (Call->getType()->isVoidTy())
+        Builder.CreateRetVoid();
+      else
+        Builder.CreateRet(Builder.CreateBitCast(Call, Fn->getReturnType()));
+      // Whatever GCC does with the result afterwards is now unreachable.
+      BeginBlock(BasicBlock::Create(Context));
+    } else if (gimple_call_tail_p(MIG_TO_GCALL(stmt)) && !UseStatepoint &&
+               !UsesLocalMemory(CallOperands)) {
+      // GCC found that the call can be a tail call.
+      cast<CallInst>(Call)->setTailCall();
+    }
   } else {
     BasicBlock *NextBlock = BasicBlock::Create(Context);
-    Call = Builder.CreateInvoke(Callee, NextBlock, LandingPad, CallOperands);
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 7)
+    if (UseStatepoint)
+      Call = Builder.CreateGCStatepointInvoke(0, 0, Callee, NextBlock,
+                                              LandingPad, CallOperands, None,
+                                              Roots);
+    else
+#endif
+      Call = Builder.CreateInvoke(Callee, NextBlock, LandingPad, CallOperands);
     cast<InvokeInst>(Call)->setCallingConv(CallingConvention);
-    cast<InvokeInst>(Call)->setAttributes(PAL);
+    if (!UseStatepoint)
+      cast<InvokeInst>(Call)->setAttributes(PAL);
 
     if (LPadNo > 0) {
       // The invoke's destination may change to an LLVM only landing pad, which
@@ -3831,6 +5724,22 @@ Value *TreeToLLVM::EmitCallOf(Value *Callee, GimpleTy *stmt,
     BeginBlock(NextBlock);
   }
 
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 7)
+  if (UseStatepoint) {
+    // The roots come after the call arguments, the transition arguments and the
+    // deoptimization arguments, each of which is preceded by a count.
+    Instruction *Statepoint = cast<Instruction>(Call);
+    unsigned FirstRoot = 7 + CallOperands.size();
+    for (unsigned i = 0, e = GCRoots.size(); i != e; ++i)
+      Builder.CreateStore(Builder.CreateGCRelocate(Statepoint, FirstRoot + i,
+                                                   FirstRoot + i,
+                                                   Roots[i]->getType()),
+                          GCRoots[i]);
+    if (!FTy->getReturnType()->isVoidTy())
+      Call = Builder.CreateGCResult(Statepoint, FTy->getReturnType());
+  }
+#endif
+
   // If the call statement has void type then either the callee does not return
   // a result, or it does but the result should be discarded.
   if (isa<VOID_TYPE>(gimple_call_return_type(MIG_TO_GCALL(stmt))))
@@ -3841,12 +5750,17 @@ Value *TreeToLLVM::EmitCallOf(Value *Callee, GimpleTy *stmt,
 
   if (Client.isAggrReturn()) {
     MemRef Target;
-    if (DestLoc)
+    if (DestLoc) {
       Target = *DestLoc;
-    else
-      // Destination is a first class value (eg: a complex number).  Extract to
-      // a temporary then load the value out later.
-      Target = CreateTempLoc(ConvertType(gimple_call_return_type(MIG_TO_GCALL(stmt))));
+    } else {
+      // Destination is a first class value (eg: a complex number).  Build it
+      // directly from the registers if possible, otherwise extract to a
+      // temporary then load the value out later.
+      Type *RetTy = ConvertType(gimple_call_return_type(MIG_TO_GCALL(stmt)));
+      if (Value *V = BuildMultipleReturnValue(Call, RetTy, Builder))
+        return V;
+      Target = CreateTempLoc(RetTy);
+    }
 
     if (DL.getTypeAllocSize(Call->getType()) <=
         DL.getTypeAllocSize(cast<PointerType>(Target.Ptr->getType())
@@ -3861,7 +5775,7 @@ Value *TreeToLLVM::EmitCallOf(Value *Callee, GimpleTy *stmt,
       // cast the temporary into the correct (smaller) type, and using
       // the correct type, copy the value into Target.  Assume the
       // optimizer will delete the temporary and clean this up.
-      AllocaInst *biggerTmp = CreateTemporary(Call->getType());
+      AllocaInst *biggerTmp = CreateScratchTemporary(Call->getType());
       LLVM_EXTRACT_MULTIPLE_RETURN_VALUE(Call, biggerTmp, /*Volatile=*/ false,
                                          Builder);
       EmitAggregateCopy(
@@ -3888,7 +5802,7 @@ Value *TreeToLLVM::EmitCallOf(Value *Callee, GimpleTy *stmt,
     // Probably a scalar to complex conversion.
     assert(DL.getTypeAllocSize(Call->getType()) == DL.getTypeAllocSize(RetTy) &&
            "Size mismatch in scalar to scalar conversion!");
-    Value *Tmp = CreateTemporary(Call->getType());
+    Value *Tmp = CreateScratchTemporary(Call->getType());
     Builder.CreateStore(Call, Tmp);
     return Builder.CreateLoad(
         Builder.CreateBitCast(Tmp, RetTy->getPointerTo()));
@@ -3923,7 +5837,7 @@ Value *TreeToLLVM::EmitCallOf(Value *Callee, GimpleTy *stmt,
     // be stored without overflowing the destination.
     // TODO: Check whether this works correctly on big-endian machines.
     // Store the scalar to a temporary.
-    Value *Tmp = CreateTemporary(Call->getType());
+    Value *Tmp = CreateScratchTemporary(Call->getType());
     Builder.CreateStore(Call, Tmp);
     // Load the desired number of bytes back out again as an integer of the
     // appropriate size.
@@ -4024,8 +5938,45 @@ CallInst *TreeToLLVM::EmitSimpleCall(StringRef CalleeName, tree ret_type,
 #define LLVM_CANONICAL_ADDRESS_CONSTRAINTS "r"
 #endif
 
+// LLVM_NAMED_REGISTER_P - Return true if the code generator can access the
+// register with the given (LLVM) name using llvm.read_register and
+// llvm.write_register.  Targets must list the registers their code generator
+// accepts, since any other name is a fatal error in the backend.
+#ifndef LLVM_NAMED_REGISTER_P
+#define LLVM_NAMED_REGISTER_P(NAME) false
+#endif
+
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 4)
+/// getNamedRegister - If 'decl' is a global register variable that can be
+/// accessed using llvm.read_register and llvm.write_register, return the
+/// metadata naming its register.  Otherwise return null.  Unlike inline asm,
+/// these intrinsics tell the code generator that the register is being used
+/// as a variable, so it is not clobbered between accesses.
+static Value *getNamedRegister(tree decl, LLVMContext &Context) {
+  if (!TREE_STATIC(decl) && !DECL_EXTERNAL(decl) && !TREE_PUBLIC(decl))
+    return 0;
+  // The intrinsics only work with integers as wide as a pointer.
+  tree type = TREE_TYPE(decl);
+  if ((!isa<INTEGRAL_TYPE>(type) && !isa<ACCESS_TYPE>(type)) ||
+      TYPE_PRECISION(type) != POINTER_SIZE)
+    return 0;
+  const char *Name = extractRegisterName(decl);
+  Name = LLVM_GET_REG_NAME(Name, decode_reg_name(Name));
+  if (!LLVM_NAMED_REGISTER_P(Name))
+    return 0;
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 5)
+  return MetadataAsValue::get(
+      Context, MDNode::get(Context, MDString::get(Context, Name)));
+#else
+  Value *RegName = MDString::get(Context, Name);
+  return MDNode::get(Context, RegName);
+#endif
+}
+#endif
+
 /// Reads from register variables are handled by emitting an inline asm node
-/// that copies the value out of the specified register.
+/// that copies the value out of the specified register, or by a call to
+/// llvm.read_register for global register variables the target supports.
 Value *TreeToLLVM::EmitReadOfRegisterVariable(tree decl) {
   Type *MemTy = ConvertType(TREE_TYPE(decl));
   Type *RegTy = getRegType(TREE_TYPE(decl));
@@ -4034,6 +5985,16 @@ Value *TreeToLLVM::EmitReadOfRegisterVariable(tree decl) {
   if (ValidateRegisterVariable(decl))
     return UndefValue::get(RegTy);
 
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 4)
+  if (Value *Reg = getNamedRegister(decl, TheModule->getContext())) {
+    Type *IntTy = IntegerType::get(Reg->getContext(), POINTER_SIZE);
+    Value *Val = Builder.CreateCall(
+        Intrinsic::getDeclaration(TheModule, Intrinsic::read_register, IntTy),
+        Reg);
+    return RegTy->isPointerTy() ? Builder.CreateIntToPtr(Val, RegTy) : Val;
+  }
+#endif
+
   // Turn this into a 'tmp = call Ty asm "", "={reg}"()'.
   FunctionType *FTy = FunctionType::get(MemTy, std::vector<Type *>(), false);
 
@@ -4049,12 +6010,26 @@ Value *TreeToLLVM::EmitReadOfRegisterVariable(tree decl) {
 }
 
 /// Stores to register variables are handled by emitting an inline asm node
-/// that copies the value into the specified register.
+/// that copies the value into the specified register, or by a call to
+/// llvm.write_register for global register variables the target supports.
 void TreeToLLVM::EmitModifyOfRegisterVariable(tree decl, Value *RHS) {
   // If there was an error, bail out.
   if (ValidateRegisterVariable(decl))
     return;
 
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 4)
+  if (Value *Reg = getNamedRegister(decl, TheModule->getContext())) {
+    Type *IntTy = IntegerType::get(Reg->getContext(), POINTER_SIZE);
+    if (RHS->getType()->isPointerTy())
+      RHS = Builder.CreatePtrToInt(RHS, IntTy);
+    Value *Ops[] = { Reg, RHS };
+    Builder.CreateCall(
+        Intrinsic::getDeclaration(TheModule, Intrinsic::write_register, IntTy),
+        Ops);
+    return;
+  }
+#endif
+
   // Convert to in-memory type.
   RHS = Reg2Mem(RHS, TREE_TYPE(decl), Builder);
 
@@ -4094,7 +6069,8 @@ void TreeToLLVM::EmitModifyOfRegisterVariable(tree decl, Value *RHS) {
 ///       punctuation.
 /// Other %xN expressions are turned into LLVM ${N:x} operands.
 ///
-static std::string ConvertInlineAsmStr(GimpleTy *stmt, unsigned NumOperands) {
+static std::string ConvertInlineAsmStrUncached(GimpleTy *stmt,
+                                               unsigned NumOperands) {
   const char *AsmStr = gimple_asm_string(MIG_TO_GASM(stmt));
 
   // gimple_asm_input_p - This flag is set if this is a non-extended ASM,
@@ -4188,6 +6164,24 @@ static std::string ConvertInlineAsmStr(GimpleTy *stmt, unsigned NumOperands) {
   }
 }
 
+/// SetAsmLocation - Pass the location of the given asm statement to the code
+/// generator using !srcloc metadata, so that problems it finds in the asm are
+/// reported there.
+static void SetAsmLocation(Instruction *I, GimpleTy *stmt) {
+  if (!gimple_has_location(stmt))
+    return;
+  LLVMContext &Context = I->getContext();
+  Constant *LocationCookie =
+      ConstantInt::get(Type::getInt64Ty(Context), gimple_location(stmt));
+  I->setMetadata("srcloc", MDNode::get(Context,
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+                 ConstantAsMetadata::get(LocationCookie)
+#else
+                 LocationCookie
+#endif
+                 ));
+}
+
 /// isOperandMentioned - Return true if the given operand is explicitly
 /// mentioned in the asm string.  For example if passed operand 1 then
 /// this routine checks that the asm string does not contain "%1".
@@ -4221,11 +6215,31 @@ static bool isOperandMentioned(GimpleTy *stmt, unsigned OpNum) {
   return false;
 }
 
-/// CanonicalizeConstraint - If we can canonicalize the constraint into
+/// ConvertInlineAsmStr - Inlining often leaves many copies of the same asm in a
+/// function or unit, so remember the conversion of each asm string.  Strings
+/// for which an error was reported are not remembered, so that the error is
+/// reported for each copy.
+static std::string ConvertInlineAsmStr(GimpleTy *stmt, unsigned NumOperands) {
+  static StringMap<std::string> ConvertedAsmStrs;
+  std::string Key = gimple_asm_string(MIG_TO_GASM(stmt));
+  Key += gimple_asm_input_p(MIG_TO_GASM(stmt)) ? '\1' : '\2';
+  Key += utostr(NumOperands);
+  StringMap<std::string>::iterator I = ConvertedAsmStrs.find(Key);
+  if (I != ConvertedAsmStrs.end())
+    return I->getValue();
+
+  int SavedErrorCount = errorcount;
+  std::string Result = ConvertInlineAsmStrUncached(stmt, NumOperands);
+  if (errorcount == SavedErrorCount)
+    ConvertedAsmStrs[Key] = Result;
+  return Result;
+}
+
+/// ComputeCanonicalConstraint - If we can canonicalize the constraint into
 /// something simpler, do so now.  This turns register classes with a single
 /// register into the register itself, expands builtin constraints to multiple
 /// alternatives, etc.
-static std::string CanonicalizeConstraint(const char *Constraint) {
+static std::string ComputeCanonicalConstraint(const char *Constraint) {
   std::string Result;
 
   // Skip over modifier characters.
@@ -4333,6 +6347,19 @@ static std::string CanonicalizeConstraint(const char *Constraint) {
   return Result;
 }
 
+/// CanonicalizeConstraint - As ComputeCanonicalConstraint, but remembering the
+/// answer for each constraint string since the same few constraints are used
+/// over and over again.
+static std::string CanonicalizeConstraint(const char *Constraint) {
+  static StringMap<std::string> CanonicalConstraints;
+  StringMap<std::string>::iterator I = CanonicalConstraints.find(Constraint);
+  if (I != CanonicalConstraints.end())
+    return I->getValue();
+  std::string Result = ComputeCanonicalConstraint(Constraint);
+  CanonicalConstraints[Constraint] = Result;
+  return Result;
+}
+
 /// See if operand "exp" can use the indicated Constraint (which is
 /// terminated by a null or a comma).
 /// Returns:  -1=no, 0=yes but auxiliary instructions needed, 1=yes and free
@@ -4416,8 +6443,32 @@ static void ChooseConstraintTuple(GimpleTy *stmt, const char **Constraints,
       (const char **)alloca((NumInputs + NumOutputs) * sizeof(const char *));
   memcpy(RunningConstraints, Constraints,
          (NumInputs + NumOutputs) * sizeof(const char *));
+
+  // The choice only depends on the constraints and on which operands are hard
+  // registers or integer constants (see MatchWeight), so remember it for each
+  // such combination.
+  static StringMap<unsigned> ChosenTuples;
+  std::string Key;
+  for (unsigned j = 0; j != NumInputs + NumOutputs; ++j) {
+    tree Operand = TREE_VALUE(
+        j < NumOutputs ? gimple_asm_output_op(MIG_TO_GASM(stmt), j) :
+                         gimple_asm_input_op(MIG_TO_GASM(stmt), j - NumOutputs));
+    Key += Constraints[j];
+    if (isa<VAR_DECL>(Operand) && DECL_HARD_REGISTER(Operand)) {
+      Key += '\1';
+      Key += extractRegisterName(Operand);
+    } else if (isa<INTEGER_CST>(Operand)) {
+      Key += '\2';
+    }
+    Key += '\3';
+  }
+  StringMap<unsigned>::iterator Chosen = ChosenTuples.find(Key);
+  bool Known = Chosen != ChosenTuples.end();
+  if (Known)
+    CommasToSkip = Chosen->getValue();
+
   // The entire point of this loop is to compute CommasToSkip.
-  for (unsigned i = 0; i != NumChoices; ++i) {
+  for (unsigned i = 0; !Known && i != NumChoices; ++i) {
     Weights[i] = 0;
     for (unsigned j = 0; j != NumOutputs; ++j) {
       tree Output = gimple_asm_output_op(MIG_TO_GASM(stmt), j);
@@ -4466,11 +6517,14 @@ static void ChooseConstraintTuple(GimpleTy *stmt, const char **Constraints,
       MaxWeight = Weights[i];
     }
   }
+  if (!Known)
+    ChosenTuples[Key] = CommasToSkip;
+
   // We have picked an alternative (the CommasToSkip'th one).
   // Change Constraints to point to malloc'd copies of the appropriate
   // constraints picked out of the original strings.
   for (unsigned int i = 0; i < NumInputs + NumOutputs; i++) {
-    assert(*(RunningConstraints[i]) == 0); // sanity check
+    assert((Known || *(RunningConstraints[i]) == 0)); // sanity check
     const char *start = Constraints[i];
     if (i < NumOutputs)
       start++; // skip '=' or '+'
@@ -4507,24 +6561,37 @@ static void ChooseConstraintTuple(GimpleTy *stmt, const char **Constraints,
 Value *TreeToLLVM::BuildVector(const std::vector<Value *> &Ops) {
   assert((Ops.size() & (Ops.size() - 1)) == 0 &&
          "Not a power-of-two sized vector!");
-  bool AllConstants = true;
-  for (unsigned i = 0, e = Ops.size(); i != e && AllConstants; ++i)
-    AllConstants &= isa<Constant>(Ops[i]);
-
-  // If this is a constant vector, create a ConstantVector.
-  if (AllConstants) {
-    SmallVector<Constant *, 16> CstOps;
-    for (unsigned i = 0, e = Ops.size(); i != e; ++i)
-      CstOps.push_back(cast<Constant>(Ops[i]));
-    return ConstantVector::get(CstOps);
-  }
-
-  // Otherwise, insertelement the values to build the vector.
-  Value *Result =
-      UndefValue::get(VectorType::get(Ops[0]->getType(), Ops.size()));
-
+  Type *EltTy = Ops[0]->getType();
+  VectorType *VecTy = VectorType::get(EltTy, Ops.size());
+
+  // If every element is the same non-constant value then broadcast it: insert
+  // it into the first element and shuffle it into the others, which the code
+  // generator turns into a single splat.
+  bool Uniform = !isa<Constant>(Ops[0]);
+  for (unsigned i = 1, e = Ops.size(); i != e && Uniform; ++i)
+    Uniform = Ops[i] == Ops[0];
+  if (Uniform && Ops.size() > 1) {
+    Value *Undef = UndefValue::get(VecTy);
+    Value *Result =
+        Builder.CreateInsertElement(Undef, Ops[0], Builder.getInt32(0));
+    return Builder.CreateShuffleVector(
+        Result, Undef,
+        ConstantAggregateZero::get(
+            VectorType::get(Builder.getInt32Ty(), Ops.size())));
+  }
+
+  // Otherwise start from a constant vector holding the constant elements, with
+  // the rest undefined, and insertelement the rest.  If all the elements are
+  // constant this is just a constant vector, and in any case the constant part
+  // can come from the constant pool rather than being built lane by lane.
+  SmallVector<Constant *, 16> CstOps;
   for (unsigned i = 0, e = Ops.size(); i != e; ++i)
-    Result = Builder.CreateInsertElement(Result, Ops[i], Builder.getInt32(i));
+    CstOps.push_back(isa<Constant>(Ops[i]) ? cast<Constant>(Ops[i])
+                                           : UndefValue::get(EltTy));
+  Value *Result = ConstantVector::get(CstOps);
+  for (unsigned i = 0, e = Ops.size(); i != e; ++i)
+    if (!isa<Constant>(Ops[i]))
+      Result = Builder.CreateInsertElement(Result, Ops[i], Builder.getInt32(i));
 
   return Result;
 }
@@ -4626,6 +6693,23 @@ bool TreeToLLVM::EmitFrontendExpandedBuiltinCall(GimpleTy *stmt, tree fndecl,
 /// builtin number.
 static std::vector<Constant *> TargetBuiltinCache;
 
+/// getSyncOrdering - The ordering for a __sync read-modify-write of the memory
+/// that ptr points to.  Such builtins are full barriers, except when acting on
+/// a variable named by RelaxedSyncPrefix.
+static AtomicOrdering getSyncOrdering(tree ptr) {
+  if (RelaxedSyncPrefix) {
+    STRIP_NOPS(ptr);
+    tree base = isa<ADDR_EXPR>(ptr) ? get_base_address(TREE_OPERAND(ptr, 0)) : 0;
+    if (base && isa<VAR_DECL>(base) && DECL_NAME(base) &&
+        !strncmp(IDENTIFIER_POINTER(DECL_NAME(base)), RelaxedSyncPrefix,
+                 strlen(RelaxedSyncPrefix))) {
+      ++NumRelaxedSyncOps;
+      return AtomicOrdering::Monotonic;
+    }
+  }
+  return AtomicOrdering::SequentiallyConsistent;
+}
+
 Value *TreeToLLVM::BuildBinaryAtomic(GimpleTy *stmt, AtomicRMWInst::BinOp Kind,
                                      unsigned PostOp) {
   tree return_type = gimple_call_return_type(MIG_TO_GCALL(stmt));
@@ -4640,8 +6724,8 @@ Value *TreeToLLVM::BuildBinaryAtomic(GimpleTy *stmt, AtomicRMWInst::BinOp Kind,
   C[0] = Builder.CreateBitCast(C[0], Ty[1]);
   C[1] = Builder.CreateIntCast(
       C[1], Ty[0], /*isSigned*/ !TYPE_UNSIGNED(return_type), "cast");
-  Value *Result =
-      Builder.CreateAtomicRMW(Kind, C[0], C[1], AtomicOrdering::SequentiallyConsistent);
+  Value *Result = Builder.CreateAtomicRMW(
+      Kind, C[0], C[1], getSyncOrdering(gimple_call_arg(MIG_TO_GCALL(stmt), 0)));
   if (PostOp)
     Result = Builder.CreateBinOp(Instruction::BinaryOps(PostOp), Result, C[1]);
 
@@ -4692,6 +6776,186 @@ TreeToLLVM::BuildCmpAndSwapAtomic(GimpleTy *stmt, unsigned Bits, bool isBool) {
   return Reg2Mem(Result, return_type, Builder);
 }
 
+#if GCC_VERSION_CODE > GCC_VERSION(4, 6)
+/// getMemoryModel - Return the memory model given by the argument of an
+/// __atomic builtin.  As in GCC, a model that is not a constant or is not valid
+/// is treated as sequentially consistent.  Target specific flags in the high
+/// bits (eg: HLE on x86) are ignored.
+static unsigned getMemoryModel(tree model) {
+  if (!isa<INTEGER_CST>(model))
+    return MEMMODEL_SEQ_CST;
+  unsigned Model = TREE_INT_CST_LOW(model) & 0xffff;
+  return Model <= MEMMODEL_SEQ_CST ? Model : MEMMODEL_SEQ_CST;
+}
+
+/// getAtomicOrdering - Return the LLVM ordering for a memory model.  LLVM has
+/// no consume ordering, so use the stronger acquire ordering.
+static AtomicOrdering getAtomicOrdering(unsigned Model) {
+  switch (Model) {
+  case MEMMODEL_RELAXED:
+    return AtomicOrdering::Monotonic;
+  case MEMMODEL_CONSUME:
+  case MEMMODEL_ACQUIRE:
+    return AtomicOrdering::Acquire;
+  case MEMMODEL_RELEASE:
+    return AtomicOrdering::Release;
+  case MEMMODEL_ACQ_REL:
+    return AtomicOrdering::AcquireRelease;
+  default:
+    return AtomicOrdering::SequentiallyConsistent;
+  }
+}
+
+/// BuildAtomicLoad - Emit an __atomic_load_N builtin as an atomic load of the
+/// given number of bits.
+Value *TreeToLLVM::BuildAtomicLoad(GimpleTy *stmt, unsigned Bits) {
+  tree ptr = gimple_call_arg(MIG_TO_GCALL(stmt), 0);
+  unsigned Model = getMemoryModel(gimple_call_arg(MIG_TO_GCALL(stmt), 1));
+  // A load cannot release.
+  if (Model == MEMMODEL_RELEASE || Model == MEMMODEL_ACQ_REL)
+    Model = MEMMODEL_SEQ_CST;
+
+  LLVMContext &Context =
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+      TheModule->getContext();
+#else
+      TheContext;
+#endif
+  Type *MemTy = IntegerType::get(Context, Bits);
+  Value *Ptr = Builder.CreateBitCast(EmitRegister(ptr), MemTy->getPointerTo());
+  LoadInst *LI = Builder.CreateLoad(Ptr);
+  LI->setAtomic(getAtomicOrdering(Model));
+  LI->setAlignment(Bits / 8);
+
+  tree return_type = gimple_call_return_type(MIG_TO_GCALL(stmt));
+  Value *Result =
+      CastToAnyType(LI, !TYPE_UNSIGNED(return_type), getRegType(return_type),
+                    !TYPE_UNSIGNED(return_type));
+  return Reg2Mem(Result, return_type, Builder);
+}
+
+/// BuildAtomicStore - Emit an __atomic_store_N builtin as an atomic store of
+/// the given number of bits.
+void TreeToLLVM::BuildAtomicStore(GimpleTy *stmt, unsigned Bits) {
+  tree ptr = gimple_call_arg(MIG_TO_GCALL(stmt), 0);
+  tree val = gimple_call_arg(MIG_TO_GCALL(stmt), 1);
+  unsigned Model = getMemoryModel(gimple_call_arg(MIG_TO_GCALL(stmt), 2));
+  // A store cannot acquire.
+  if (Model == MEMMODEL_CONSUME || Model == MEMMODEL_ACQUIRE ||
+      Model == MEMMODEL_ACQ_REL)
+    Model = MEMMODEL_SEQ_CST;
+
+  LLVMContext &Context =
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+      TheModule->getContext();
+#else
+      TheContext;
+#endif
+  Type *MemTy = IntegerType::get(Context, Bits);
+  Value *Ptr = Builder.CreateBitCast(EmitRegister(ptr), MemTy->getPointerTo());
+  Value *Val = CastToAnyType(EmitRegister(val), !TYPE_UNSIGNED(TREE_TYPE(val)),
+                             MemTy, !TYPE_UNSIGNED(TREE_TYPE(val)));
+  StoreInst *SI = Builder.CreateStore(Val, Ptr);
+  SI->setAtomic(getAtomicOrdering(Model));
+  SI->setAlignment(Bits / 8);
+}
+
+/// BuildAtomicRMW - Emit an __atomic_exchange_N, __atomic_fetch_OP_N or
+/// __atomic_OP_fetch_N builtin as an atomic read-modify-write of the given
+/// number of bits.  If PostOp is not zero then the new value is returned,
+/// computed by applying PostOp (followed by a "not" for nand) to the old value
+/// and the operand.  Otherwise the old value is returned.
+Value *TreeToLLVM::BuildAtomicRMW(GimpleTy *stmt, unsigned Bits,
+                                  AtomicRMWInst::BinOp Kind, unsigned PostOp) {
+  tree ptr = gimple_call_arg(MIG_TO_GCALL(stmt), 0);
+  tree val = gimple_call_arg(MIG_TO_GCALL(stmt), 1);
+  unsigned Model = getMemoryModel(gimple_call_arg(MIG_TO_GCALL(stmt), 2));
+
+  LLVMContext &Context =
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+      TheModule->getContext();
+#else
+      TheContext;
+#endif
+  Type *MemTy = IntegerType::get(Context, Bits);
+  Value *Ptr = Builder.CreateBitCast(EmitRegister(ptr), MemTy->getPointerTo());
+  Value *Val = CastToAnyType(EmitRegister(val), !TYPE_UNSIGNED(TREE_TYPE(val)),
+                             MemTy, !TYPE_UNSIGNED(TREE_TYPE(val)));
+  Value *Result =
+      Builder.CreateAtomicRMW(Kind, Ptr, Val, getAtomicOrdering(Model));
+  if (PostOp) {
+    Result = Builder.CreateBinOp(Instruction::BinaryOps(PostOp), Result, Val);
+    if (Kind == AtomicRMWInst::Nand)
+      Result = Builder.CreateNot(Result);
+  }
+
+  tree return_type = gimple_call_return_type(MIG_TO_GCALL(stmt));
+  Result = CastToAnyType(Result, !TYPE_UNSIGNED(return_type),
+                         getRegType(return_type), !TYPE_UNSIGNED(return_type));
+  return Reg2Mem(Result, return_type, Builder);
+}
+
+/// BuildAtomicCompareExchange - Emit an __atomic_compare_exchange_N builtin as
+/// a cmpxchg of the given number of bits.  If the exchange fails, the value
+/// found is stored in the expected value, and only then.
+Value *TreeToLLVM::BuildAtomicCompareExchange(GimpleTy *stmt, unsigned Bits) {
+  tree ptr = gimple_call_arg(MIG_TO_GCALL(stmt), 0);
+  tree expected = gimple_call_arg(MIG_TO_GCALL(stmt), 1);
+  tree desired = gimple_call_arg(MIG_TO_GCALL(stmt), 2);
+  tree weak = gimple_call_arg(MIG_TO_GCALL(stmt), 3);
+  unsigned Success = getMemoryModel(gimple_call_arg(MIG_TO_GCALL(stmt), 4));
+  unsigned Failure = getMemoryModel(gimple_call_arg(MIG_TO_GCALL(stmt), 5));
+  // Correct invalid combinations the same way as GCC does.
+  if (Failure == MEMMODEL_RELEASE || Failure == MEMMODEL_ACQ_REL)
+    Success = Failure = MEMMODEL_SEQ_CST;
+  if (Failure > Success)
+    Success = MEMMODEL_SEQ_CST;
+
+  LLVMContext &Context =
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+      TheModule->getContext();
+#else
+      TheContext;
+#endif
+  Type *MemTy = IntegerType::get(Context, Bits);
+  Type *MemPtrTy = MemTy->getPointerTo();
+  Value *Ptr = Builder.CreateBitCast(EmitRegister(ptr), MemPtrTy);
+  Value *ExpectedPtr = Builder.CreateBitCast(EmitRegister(expected), MemPtrTy);
+  Value *Expected = Builder.CreateLoad(ExpectedPtr);
+  Value *Desired =
+      CastToAnyType(EmitRegister(desired), !TYPE_UNSIGNED(TREE_TYPE(desired)),
+                    MemTy, !TYPE_UNSIGNED(TREE_TYPE(desired)));
+
+  AtomicCmpXchgInst *CXI =
+      Builder.CreateAtomicCmpXchg(Ptr, Expected, Desired,
+                                  getAtomicOrdering(Success),
+                                  getAtomicOrdering(Failure));
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 4)
+  // A strong exchange is always a correct implementation of a weak one.
+  if (isa<INTEGER_CST>(weak) && !integer_zerop(weak))
+    CXI->setWeak(true);
+#else
+  (void) weak;
+#endif
+
+  Value *Old = Builder.CreateExtractValue(CXI, 0);
+  Value *Result = Builder.CreateExtractValue(CXI, 1);
+
+  // Store the value found if it was not the one expected.
+  BasicBlock *StoreBB = BasicBlock::Create(Context);
+  BasicBlock *ContinueBB = BasicBlock::Create(Context);
+  Builder.CreateCondBr(Result, ContinueBB, StoreBB);
+  BeginBlock(StoreBB);
+  Builder.CreateStore(Old, ExpectedPtr);
+  BeginBlock(ContinueBB);
+
+  tree return_type = gimple_call_return_type(MIG_TO_GCALL(stmt));
+  Result = CastToAnyType(Result, !TYPE_UNSIGNED(return_type),
+                         getRegType(return_type), !TYPE_UNSIGNED(return_type));
+  return Reg2Mem(Result, return_type, Builder);
+}
+#endif
+
 /// EmitBuiltinCall - stmt is a call to fndecl, a builtin function.  Try to emit
 /// the call in a special way, setting Result to the scalar result if necessary.
 /// If we can't handle the builtin, return false, otherwise return true.
@@ -4710,8 +6974,10 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
 #endif
       // If the backend has some special code to lower, go ahead and try to
       // do that first.
-      if (EmitFrontendExpandedBuiltinCall(stmt, fndecl, DestLoc, Result))
+      if (EmitFrontendExpandedBuiltinCall(stmt, fndecl, DestLoc, Result)) {
+        ++ConvStats.TargetBuiltinsExpanded;
         return true;
+      }
 
       // If this builtin directly corresponds to an LLVM intrinsic, get the
       // IntrinsicID now.
@@ -4731,6 +6997,7 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
           Intrinsic::getDeclaration(TheModule, IntrinsicID);
     }
 
+    ++ConvStats.TargetBuiltinsIntrinsic;
     Result =
         EmitCallOf(TargetBuiltinCache[FnCode], stmt, DestLoc, MigAttributeSet());
     return true;
@@ -4848,31 +7115,44 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       return false;
     }
 
-    // LLVM doesn't handle type 1 or type 3. Deal with that here.
-    Value *Tmp = EmitMemory(gimple_call_arg(MIG_TO_GCALL(stmt), 1));
-
-    ConstantInt *CI = cast<ConstantInt>(Tmp);
-
-    // Clear the bottom bit since we only handle whole objects and shift to turn
-    // the second bit into our boolean.
-    uint64_t val = (CI->getZExtValue() & 0x2) >> 1;
-
-    Value *NewTy = ConstantInt::get(Tmp->getType(), val);
+    // Bit 1 of the type asks for the minimum rather than the maximum number of
+    // bytes left, which is what the second llvm.objectsize argument means too.
+    // If the intrinsic is still there when code is generated it becomes zero or
+    // -1 accordingly, like the GCC builtin when the object is not known.
+    unsigned ObjSizeType = TREE_INT_CST_LOW(ObjSizeTree);
+    bool Min = ObjSizeType & 2;
+    tree Ptr = gimple_call_arg(MIG_TO_GCALL(stmt), 0);
+    Type *ResultTy = ConvertType(gimple_call_return_type(MIG_TO_GCALL(stmt)));
+
+    // Bit 0 asks for the enclosing subobject rather than the whole object.
+    // LLVM only knows about whole objects, which bounds the maximum for the
+    // subobject but not the minimum, so give up on the minimum for a pointer
+    // into a field or array element.
+    if (ObjSizeType == 3) {
+      tree Base = Ptr;
+      STRIP_NOPS(Base);
+      if (isa<ADDR_EXPR>(Base) && handled_component_p(TREE_OPERAND(Base, 0))) {
+        Result = Constant::getNullValue(ResultTy);
+        return true;
+      }
+    }
 
-    Value *Args[] = { EmitMemory(gimple_call_arg(MIG_TO_GCALL(stmt), 0)), NewTy };
     Type *Int8PtrTy = Type::getInt8PtrTy(Context);
-
-    // Grab the current return type.
-    Type *Ty[2] = {
-      ConvertType(gimple_call_return_type(MIG_TO_GCALL(stmt))),
-      Int8PtrTy
+    Value *Args[] = {
+      Builder.CreateBitCast(EmitMemory(Ptr), Int8PtrTy),
+      Builder.getInt1(Min),
+#if LLVM_VERSION_CODE > LLVM_VERSION(4, 0)
+      // A null pointer does not point to an object of size zero: GCC returns
+      // the "unknown" value for it.
+      Builder.getTrue()
+#endif
     };
 
-    // Manually coerce the arg to the correct pointer type.
-    Args[0] = Builder.CreateBitCast(Args[0], Int8PtrTy);
-    Args[1] = Builder.CreateIntCast(Args[1], Type::getInt1Ty(Context),
-                                    /*isSigned*/ false);
+    Type *Ty[2] = { ResultTy, Int8PtrTy };
 
+    // Once inlining has exposed the object, LLVM folds this to a constant, and
+    // the library call simplifier turns checking calls like __memcpy_chk that
+    // cannot overflow into plain ones.
     Result = Builder.CreateCall(
         Intrinsic::getDeclaration(TheModule, Intrinsic::objectsize, Ty), Args);
     return true;
@@ -5486,13 +7766,9 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
     C[0] = Builder.CreateBitCast(C[0], ResultTy->getPointerTo());
     C[1] = Builder.CreateIntCast(
         C[1], ResultTy, /*isSigned*/ !TYPE_UNSIGNED(return_type), "cast");
-    Result = Builder.CreateAtomicRMW(AtomicRMWInst::Nand, C[0], C[1],
-#if LLVM_VERSION_CODE < LLVM_VERSION(3, 9)
-                                     SequentiallyConsistent
-#else
-                                     AtomicOrdering::SequentiallyConsistent
-#endif
-                                     );
+    Result = Builder.CreateAtomicRMW(
+        AtomicRMWInst::Nand, C[0], C[1],
+        getSyncOrdering(gimple_call_arg(MIG_TO_GCALL(stmt), 0)));
 
     Result = Builder.CreateAnd(Builder.CreateNot(Result), C[1]);
     Result = Builder.CreateIntToPtr(Result, ResultTy);
@@ -5566,6 +7842,238 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
 
 #endif //FIXME: these break the build for backends that haven't implemented them
 
+#if GCC_VERSION_CODE > GCC_VERSION(4, 6)
+  // The C11 and C++11 atomics.  The sized forms become LLVM atomic operations
+  // with the requested ordering; the code generator turns any it cannot do
+  // inline into calls to libatomic.  The generic forms, which work on objects
+  // of any size, are left to libatomic.  The 16 byte forms are only done when
+  // the code generator knows how to fall back to libatomic.
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  case BUILT_IN_ATOMIC_LOAD_16:
+#endif
+  case BUILT_IN_ATOMIC_LOAD_1:
+  case BUILT_IN_ATOMIC_LOAD_2:
+  case BUILT_IN_ATOMIC_LOAD_4:
+  case BUILT_IN_ATOMIC_LOAD_8:
+    Result = BuildAtomicLoad(
+        stmt, BITS_PER_UNIT << (fcode - BUILT_IN_ATOMIC_LOAD_1));
+    return true;
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  case BUILT_IN_ATOMIC_STORE_16:
+#endif
+  case BUILT_IN_ATOMIC_STORE_1:
+  case BUILT_IN_ATOMIC_STORE_2:
+  case BUILT_IN_ATOMIC_STORE_4:
+  case BUILT_IN_ATOMIC_STORE_8:
+    BuildAtomicStore(stmt, BITS_PER_UNIT << (fcode - BUILT_IN_ATOMIC_STORE_1));
+    Result = 0;
+    return true;
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  case BUILT_IN_ATOMIC_EXCHANGE_16:
+#endif
+  case BUILT_IN_ATOMIC_EXCHANGE_1:
+  case BUILT_IN_ATOMIC_EXCHANGE_2:
+  case BUILT_IN_ATOMIC_EXCHANGE_4:
+  case BUILT_IN_ATOMIC_EXCHANGE_8:
+    Result = BuildAtomicRMW(
+        stmt, BITS_PER_UNIT << (fcode - BUILT_IN_ATOMIC_EXCHANGE_1),
+        AtomicRMWInst::Xchg);
+    return true;
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  case BUILT_IN_ATOMIC_FETCH_ADD_16:
+#endif
+  case BUILT_IN_ATOMIC_FETCH_ADD_1:
+  case BUILT_IN_ATOMIC_FETCH_ADD_2:
+  case BUILT_IN_ATOMIC_FETCH_ADD_4:
+  case BUILT_IN_ATOMIC_FETCH_ADD_8:
+    Result = BuildAtomicRMW(
+        stmt, BITS_PER_UNIT << (fcode - BUILT_IN_ATOMIC_FETCH_ADD_1),
+        AtomicRMWInst::Add);
+    return true;
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  case BUILT_IN_ATOMIC_FETCH_SUB_16:
+#endif
+  case BUILT_IN_ATOMIC_FETCH_SUB_1:
+  case BUILT_IN_ATOMIC_FETCH_SUB_2:
+  case BUILT_IN_ATOMIC_FETCH_SUB_4:
+  case BUILT_IN_ATOMIC_FETCH_SUB_8:
+    Result = BuildAtomicRMW(
+        stmt, BITS_PER_UNIT << (fcode - BUILT_IN_ATOMIC_FETCH_SUB_1),
+        AtomicRMWInst::Sub);
+    return true;
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  case BUILT_IN_ATOMIC_FETCH_AND_16:
+#endif
+  case BUILT_IN_ATOMIC_FETCH_AND_1:
+  case BUILT_IN_ATOMIC_FETCH_AND_2:
+  case BUILT_IN_ATOMIC_FETCH_AND_4:
+  case BUILT_IN_ATOMIC_FETCH_AND_8:
+    Result = BuildAtomicRMW(
+        stmt, BITS_PER_UNIT << (fcode - BUILT_IN_ATOMIC_FETCH_AND_1),
+        AtomicRMWInst::And);
+    return true;
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  case BUILT_IN_ATOMIC_FETCH_NAND_16:
+#endif
+  case BUILT_IN_ATOMIC_FETCH_NAND_1:
+  case BUILT_IN_ATOMIC_FETCH_NAND_2:
+  case BUILT_IN_ATOMIC_FETCH_NAND_4:
+  case BUILT_IN_ATOMIC_FETCH_NAND_8:
+    Result = BuildAtomicRMW(
+        stmt, BITS_PER_UNIT << (fcode - BUILT_IN_ATOMIC_FETCH_NAND_1),
+        AtomicRMWInst::Nand);
+    return true;
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  case BUILT_IN_ATOMIC_FETCH_XOR_16:
+#endif
+  case BUILT_IN_ATOMIC_FETCH_XOR_1:
+  case BUILT_IN_ATOMIC_FETCH_XOR_2:
+  case BUILT_IN_ATOMIC_FETCH_XOR_4:
+  case BUILT_IN_ATOMIC_FETCH_XOR_8:
+    Result = BuildAtomicRMW(
+        stmt, BITS_PER_UNIT << (fcode - BUILT_IN_ATOMIC_FETCH_XOR_1),
+        AtomicRMWInst::Xor);
+    return true;
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  case BUILT_IN_ATOMIC_FETCH_OR_16:
+#endif
+  case BUILT_IN_ATOMIC_FETCH_OR_1:
+  case BUILT_IN_ATOMIC_FETCH_OR_2:
+  case BUILT_IN_ATOMIC_FETCH_OR_4:
+  case BUILT_IN_ATOMIC_FETCH_OR_8:
+    Result = BuildAtomicRMW(
+        stmt, BITS_PER_UNIT << (fcode - BUILT_IN_ATOMIC_FETCH_OR_1),
+        AtomicRMWInst::Or);
+    return true;
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  case BUILT_IN_ATOMIC_ADD_FETCH_16:
+#endif
+  case BUILT_IN_ATOMIC_ADD_FETCH_1:
+  case BUILT_IN_ATOMIC_ADD_FETCH_2:
+  case BUILT_IN_ATOMIC_ADD_FETCH_4:
+  case BUILT_IN_ATOMIC_ADD_FETCH_8:
+    Result = BuildAtomicRMW(
+        stmt, BITS_PER_UNIT << (fcode - BUILT_IN_ATOMIC_ADD_FETCH_1),
+        AtomicRMWInst::Add, Instruction::Add);
+    return true;
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  case BUILT_IN_ATOMIC_SUB_FETCH_16:
+#endif
+  case BUILT_IN_ATOMIC_SUB_FETCH_1:
+  case BUILT_IN_ATOMIC_SUB_FETCH_2:
+  case BUILT_IN_ATOMIC_SUB_FETCH_4:
+  case BUILT_IN_ATOMIC_SUB_FETCH_8:
+    Result = BuildAtomicRMW(
+        stmt, BITS_PER_UNIT << (fcode - BUILT_IN_ATOMIC_SUB_FETCH_1),
+        AtomicRMWInst::Sub, Instruction::Sub);
+    return true;
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  case BUILT_IN_ATOMIC_AND_FETCH_16:
+#endif
+  case BUILT_IN_ATOMIC_AND_FETCH_1:
+  case BUILT_IN_ATOMIC_AND_FETCH_2:
+  case BUILT_IN_ATOMIC_AND_FETCH_4:
+  case BUILT_IN_ATOMIC_AND_FETCH_8:
+    Result = BuildAtomicRMW(
+        stmt, BITS_PER_UNIT << (fcode - BUILT_IN_ATOMIC_AND_FETCH_1),
+        AtomicRMWInst::And, Instruction::And);
+    return true;
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  case BUILT_IN_ATOMIC_NAND_FETCH_16:
+#endif
+  case BUILT_IN_ATOMIC_NAND_FETCH_1:
+  case BUILT_IN_ATOMIC_NAND_FETCH_2:
+  case BUILT_IN_ATOMIC_NAND_FETCH_4:
+  case BUILT_IN_ATOMIC_NAND_FETCH_8:
+    Result = BuildAtomicRMW(
+        stmt, BITS_PER_UNIT << (fcode - BUILT_IN_ATOMIC_NAND_FETCH_1),
+        AtomicRMWInst::Nand, Instruction::And);
+    return true;
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  case BUILT_IN_ATOMIC_XOR_FETCH_16:
+#endif
+  case BUILT_IN_ATOMIC_XOR_FETCH_1:
+  case BUILT_IN_ATOMIC_XOR_FETCH_2:
+  case BUILT_IN_ATOMIC_XOR_FETCH_4:
+  case BUILT_IN_ATOMIC_XOR_FETCH_8:
+    Result = BuildAtomicRMW(
+        stmt, BITS_PER_UNIT << (fcode - BUILT_IN_ATOMIC_XOR_FETCH_1),
+        AtomicRMWInst::Xor, Instruction::Xor);
+    return true;
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  case BUILT_IN_ATOMIC_OR_FETCH_16:
+#endif
+  case BUILT_IN_ATOMIC_OR_FETCH_1:
+  case BUILT_IN_ATOMIC_OR_FETCH_2:
+  case BUILT_IN_ATOMIC_OR_FETCH_4:
+  case BUILT_IN_ATOMIC_OR_FETCH_8:
+    Result = BuildAtomicRMW(
+        stmt, BITS_PER_UNIT << (fcode - BUILT_IN_ATOMIC_OR_FETCH_1),
+        AtomicRMWInst::Or, Instruction::Or);
+    return true;
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  case BUILT_IN_ATOMIC_COMPARE_EXCHANGE_16:
+#endif
+  case BUILT_IN_ATOMIC_COMPARE_EXCHANGE_1:
+  case BUILT_IN_ATOMIC_COMPARE_EXCHANGE_2:
+  case BUILT_IN_ATOMIC_COMPARE_EXCHANGE_4:
+  case BUILT_IN_ATOMIC_COMPARE_EXCHANGE_8:
+    Result = BuildAtomicCompareExchange(
+        stmt, BITS_PER_UNIT << (fcode - BUILT_IN_ATOMIC_COMPARE_EXCHANGE_1));
+    return true;
+  case BUILT_IN_ATOMIC_TEST_AND_SET: {
+    // Set a byte to one, returning whether it was set before.
+    tree ptr = gimple_call_arg(MIG_TO_GCALL(stmt), 0);
+    unsigned Model = getMemoryModel(gimple_call_arg(MIG_TO_GCALL(stmt), 1));
+    Type *Int8Ty = Type::getInt8Ty(Context);
+    Value *Ptr =
+        Builder.CreateBitCast(EmitRegister(ptr), Int8Ty->getPointerTo());
+    Value *Old =
+        Builder.CreateAtomicRMW(AtomicRMWInst::Xchg, Ptr,
+                                ConstantInt::get(Int8Ty, 1),
+                                getAtomicOrdering(Model));
+    tree return_type = gimple_call_return_type(MIG_TO_GCALL(stmt));
+    Result = Reg2Mem(Builder.CreateIsNotNull(Old), return_type, Builder);
+    return true;
+  }
+  case BUILT_IN_ATOMIC_CLEAR: {
+    tree ptr = gimple_call_arg(MIG_TO_GCALL(stmt), 0);
+    unsigned Model = getMemoryModel(gimple_call_arg(MIG_TO_GCALL(stmt), 1));
+    // A store cannot acquire.
+    if (Model == MEMMODEL_CONSUME || Model == MEMMODEL_ACQUIRE ||
+        Model == MEMMODEL_ACQ_REL)
+      Model = MEMMODEL_SEQ_CST;
+    Type *Int8Ty = Type::getInt8Ty(Context);
+    Value *Ptr =
+        Builder.CreateBitCast(EmitRegister(ptr), Int8Ty->getPointerTo());
+    StoreInst *SI = Builder.CreateStore(ConstantInt::get(Int8Ty, 0), Ptr);
+    SI->setAtomic(getAtomicOrdering(Model));
+    SI->setAlignment(1);
+    Result = 0;
+    return true;
+  }
+  case BUILT_IN_ATOMIC_THREAD_FENCE:
+  case BUILT_IN_ATOMIC_SIGNAL_FENCE: {
+    unsigned Model = getMemoryModel(gimple_call_arg(MIG_TO_GCALL(stmt), 0));
+    // A relaxed fence does nothing.
+    if (Model != MEMMODEL_RELAXED) {
+      if (fcode == BUILT_IN_ATOMIC_THREAD_FENCE)
+        Builder.CreateFence(getAtomicOrdering(Model));
+      else
+        // Only orders against a signal handler running in the same thread.
+        Builder.CreateFence(getAtomicOrdering(Model),
+#if LLVM_VERSION_CODE > LLVM_VERSION(4, 0)
+                            SyncScope::SingleThread
+#else
+                            SingleThread
+#endif
+                            );
+    }
+    Result = 0;
+    return true;
+  }
+#endif
+
 #if 1 // FIXME: Should handle these GCC extensions eventually.
   case BUILT_IN_LONGJMP: {
     if (validate_gimple_arglist(MIG_TO_GCALL(stmt), POINTER_TYPE, INTEGER_TYPE, VOID_TYPE)) {
@@ -5770,8 +8278,8 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
 
         // Create stack slots to store the real (cos) and imaginary (sin) parts in.
         Value *Val = EmitRegister(arg);
-        Value *SinPtr = CreateTemporary(Val->getType());
-        Value *CosPtr = CreateTemporary(Val->getType());
+        Value *SinPtr = CreateScratchTemporary(Val->getType());
+        Value *CosPtr = CreateScratchTemporary(Val->getType());
 
         // Get the LLVM function declaration for sincos.
         Type *ArgTys[3] = { Val->getType(), SinPtr->getType(),
@@ -5890,6 +8398,9 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
           return Client.EmitShadowResult(cplx_type, 0);
 
         if (Client.isAggrReturn()) {
+          if (Value *V = BuildMultipleReturnValue(CI, CplxTy, Builder))
+            return V;
+
           // Extract to a temporary then load the value out later.
           MemRef Target = CreateTempLoc(CplxTy);
 
@@ -5910,7 +8421,7 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
         assert(DL.getTypeAllocSize(CI->getType()) ==
                DL.getTypeAllocSize(CplxTy) &&
                "Size mismatch in scalar to scalar conversion!");
-        Value *Tmp = CreateTemporary(CI->getType());
+        Value *Tmp = CreateScratchTemporary(CI->getType());
         Builder.CreateStore(CI, Tmp);
         Type *CplxPtrTy = CplxTy->getPointerTo();
         return Builder.CreateLoad(Builder.CreateBitCast(Tmp, CplxPtrTy));
@@ -6542,6 +9053,26 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
 #else
           TheContext;
 #endif
+
+#if GCC_VERSION_CODE > GCC_VERSION(4, 6)
+      // If a variable length array turns out to have a small constant size then
+      // give it a fixed slot in the frame, as GCC's constant propagator does.
+      // It is then allocated once in the entry block rather than each time its
+      // declaration is reached, so it does not grow the stack in loops and the
+      // optimizers treat it like any other local variable.  The stack save and
+      // restore around its scope become empty and are removed.
+      if (ConstantInt *Size = llvm::dyn_cast<ConstantInt>(Amt))
+        if (gimple_call_alloca_for_var_p(MIG_TO_GCALL(stmt)) &&
+            Size->getZExtValue() <=
+                (uint64_t) PARAM_VALUE(PARAM_LARGE_STACK_FRAME)) {
+          Type *SlotTy =
+              ArrayType::get(Type::getInt8Ty(Context), Size->getZExtValue());
+          Result = Builder.CreateBitCast(CreateTemporary(SlotTy, Align / 8),
+                                         Type::getInt8PtrTy(Context));
+          return true;
+        }
+#endif
+
       AllocaInst *Alloca = Builder.CreateAlloca(Type::getInt8Ty(Context), Amt);
       Alloca->setAlignment(Align / 8);
       Result = Alloca;
@@ -6637,7 +9168,7 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       if (!isa<AGGREGATE_TYPE>(va_list_type_node)) {
         // Emit it as a value, then store it to a temporary slot.
         Value *V2 = EmitMemory(Arg2T);
-        Arg2 = CreateTemporary(V2->getType());
+        Arg2 = CreateScratchTemporary(V2->getType());
         Builder.CreateStore(V2, Arg2);
       } else {
         // If the target has aggregate valists, then the second argument
@@ -6664,11 +9195,173 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       return true;
     }
 
+#if (GCC_MAJOR > 4)
+/// TrampolineTargets - The nested function each trampoline is initialized with,
+/// keyed by the frame field holding the trampoline.
+static DenseMap<tree, tree> TrampolineTargets;
+
+/// EscapingTrampolines - Trampolines whose address is used for something other
+/// than calling the nested function, for example by being stored to memory or
+/// passed to another function.
+static SmallPtrSet<tree, 8> EscapingTrampolines;
+
+/// getTrampolineField - If 'addr' is the address of a trampoline in a frame
+/// object, return the frame field holding it.
+static tree getTrampolineField(tree addr) {
+  if (!isa<ADDR_EXPR>(addr) || !isa<COMPONENT_REF>(TREE_OPERAND(addr, 0)))
+    return NULL_TREE;
+  return TREE_OPERAND(TREE_OPERAND(addr, 0), 1);
+}
+
+/// getTrampolineFrame - Return the address of the frame object holding the
+/// trampoline whose address is 'addr', or null if it is not simple enough to
+/// use directly as a static chain.
+static tree getTrampolineFrame(tree addr) {
+  tree frame = TREE_OPERAND(TREE_OPERAND(addr, 0), 0);
+  if (isa<VAR_DECL>(frame))
+    return build_fold_addr_expr(frame);
+  if (isa<MEM_REF>(frame) && integer_zerop(TREE_OPERAND(frame, 1)) &&
+      (isa<SSA_NAME>(TREE_OPERAND(frame, 0)) ||
+       isa<ADDR_EXPR>(TREE_OPERAND(frame, 0))))
+    return TREE_OPERAND(frame, 0);
+  return NULL_TREE;
+}
+
+/// isPointerCopy - Return true if 'stmt' copies an SSA name to another SSA
+/// name, maybe changing its type.
+static bool isPointerCopy(GimpleTy *stmt) {
+  return is_gimple_assign(stmt) && isa<SSA_NAME>(gimple_assign_lhs(stmt)) &&
+         (gimple_assign_rhs_code(stmt) == SSA_NAME ||
+          CONVERT_EXPR_CODE_P(gimple_assign_rhs_code(stmt)));
+}
+
+/// getAdjustedTrampoline - If 'name' holds a trampoline address returned by
+/// __builtin_adjust_trampoline, maybe converted to another type, return the
+/// call to __builtin_adjust_trampoline.
+static GimpleTy *getAdjustedTrampoline(tree name) {
+  while (isa<SSA_NAME>(name)) {
+    GimpleTy *def = SSA_NAME_DEF_STMT(name);
+    if (gimple_call_builtin_p(def, BUILT_IN_ADJUST_TRAMPOLINE))
+      return def;
+    if (!isPointerCopy(def))
+      return 0;
+    name = gimple_assign_rhs1(def);
+  }
+  return 0;
+}
+
+/// isDirectTrampoline - Return true if the trampoline held in the given frame
+/// field is only ever used to call its nested function.  Such calls are made
+/// directly, passing the static chain, and the trampoline is never set up.
+static bool isDirectTrampoline(tree field) {
+  return field && TrampolineTargets.count(field) &&
+         !EscapingTrampolines.count(field);
+}
+
+/// RedirectTrampolineCall - If 'stmt' calls through a trampoline that is only
+/// used for calling its nested function, turn it into a direct call to the
+/// nested function passing the frame holding the trampoline as static chain,
+/// which is what the trampoline would have passed.  Returns true if the call
+/// was changed.
+static bool RedirectTrampolineCall(gcall *stmt) {
+  GimpleTy *adjust = getAdjustedTrampoline(gimple_call_fn(stmt));
+  if (!adjust || gimple_call_chain(stmt))
+    return false;
+  tree addr = gimple_call_arg(adjust, 0);
+  tree field = getTrampolineField(addr);
+  if (!isDirectTrampoline(field))
+    return false;
+  gimple_call_set_fndecl(stmt, TrampolineTargets[field]);
+  gimple_call_set_chain(stmt, getTrampolineFrame(addr));
+  return true;
+}
+
+/// FindEscapingTrampolines - Callback for walk_tree marking any trampoline
+/// whose address, adjusted or not, is used as escaping.
+static tree FindEscapingTrampolines(tree *tp, int *walk_subtrees, void *) {
+  if (tree field = getTrampolineField(*tp)) {
+    EscapingTrampolines.insert(field);
+  } else if (isa<SSA_NAME>(*tp)) {
+    if (GimpleTy *adjust = getAdjustedTrampoline(*tp))
+      if (tree field = getTrampolineField(gimple_call_arg(adjust, 0)))
+        EscapingTrampolines.insert(field);
+    *walk_subtrees = 0;
+  } else if (TYPE_P(*tp)) {
+    *walk_subtrees = 0;
+  }
+  return NULL_TREE;
+}
+
+/// NoteTrampolineUses - Record which nested function each trampoline set up by
+/// the given function body calls, and whether any use of a trampoline in it
+/// lets the trampoline escape.
+void NoteTrampolineUses(struct function *fn) {
+  basic_block bb;
+  FOR_EACH_BB_FN(bb, fn) {
+    for (gphi_iterator gsi = gsi_start_phis(bb); !gsi_end_p(gsi);
+         gsi_next(&gsi)) {
+      gphi *phi = gsi.phi();
+      for (unsigned i = 0, e = gimple_phi_num_args(phi); i != e; ++i)
+        walk_tree(gimple_phi_arg_def_ptr(phi, i), FindEscapingTrampolines, NULL,
+                  NULL);
+    }
+
+    for (gimple_stmt_iterator gsi = gsi_start_bb(bb); !gsi_end_p(gsi);
+         gsi_next(&gsi)) {
+      GimpleTy *stmt = gsi_stmt(gsi);
+      if (is_gimple_debug(stmt))
+        continue;
+
+      // Calls can only be redirected if the frame is easy to get at.
+      if (gimple_call_builtin_p(stmt, BUILT_IN_ADJUST_TRAMPOLINE)) {
+        tree addr = gimple_call_arg(stmt, 0);
+        if (tree field = getTrampolineField(addr))
+          if (!getTrampolineFrame(addr))
+            EscapingTrampolines.insert(field);
+        continue;
+      }
+
+      if (gimple_call_builtin_p(stmt, BUILT_IN_INIT_TRAMPOLINE) ||
+          gimple_call_builtin_p(stmt, BUILT_IN_INIT_HEAP_TRAMPOLINE)) {
+        tree field = getTrampolineField(gimple_call_arg(stmt, 0));
+        tree target = gimple_call_arg(stmt, 1);
+        if (field && isa<ADDR_EXPR>(target) &&
+            isa<FUNCTION_DECL>(TREE_OPERAND(target, 0)))
+          TrampolineTargets[field] = TREE_OPERAND(target, 0);
+        else if (field)
+          EscapingTrampolines.insert(field);
+        continue;
+      }
+
+      // Copies are checked where the copy is used.
+      if (isPointerCopy(stmt))
+        continue;
+
+      // Calling through the trampoline is fine, any other use is an escape.
+      for (unsigned i = 0, e = gimple_num_ops(stmt); i != e; ++i)
+        if (gimple_op(stmt, i) && !(is_gimple_call(stmt) && i == 1))
+          walk_tree(gimple_op_ptr(stmt, i), FindEscapingTrampolines, NULL,
+                    NULL);
+    }
+  }
+}
+#endif
+
     bool TreeToLLVM::EmitBuiltinAdjustTrampoline(GimpleTy *stmt,
                                                  Value * &Result) {
       if (!validate_gimple_arglist(MIG_TO_GCALL(stmt), POINTER_TYPE, VOID_TYPE))
         return false;
 
+#if (GCC_MAJOR > 4)
+      // Calls through a trampoline that does not escape are made directly, so
+      // the adjusted address is never used.
+      if (isDirectTrampoline(
+              getTrampolineField(gimple_call_arg(MIG_TO_GCALL(stmt), 0)))) {
+        Result = Constant::getNullValue(Builder.getInt8PtrTy());
+        return true;
+      }
+#endif
+
       Function *Intr =
           Intrinsic::getDeclaration(TheModule, Intrinsic::adjust_trampoline);
       Value *Arg = Builder.CreateBitCast(EmitRegister(gimple_call_arg(MIG_TO_GCALL(stmt), 0)),
@@ -6682,6 +9375,14 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
                                    POINTER_TYPE, VOID_TYPE))
         return false;
 
+#if (GCC_MAJOR > 4)
+      // A trampoline that is only used to call its nested function need not be
+      // set up, see RedirectTrampolineCall.
+      if (isDirectTrampoline(
+              getTrampolineField(gimple_call_arg(MIG_TO_GCALL(stmt), 0))))
+        return true;
+#endif
+
       Value *Tramp = EmitRegister(gimple_call_arg(MIG_TO_GCALL(stmt), 0));
       Value *Func = EmitRegister(gimple_call_arg(MIG_TO_GCALL(stmt), 1));
       Value *Chain = EmitRegister(gimple_call_arg(MIG_TO_GCALL(stmt), 2));
@@ -6709,6 +9410,249 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       return true;
     }
 
+#if GCC_VERSION_CODE > GCC_VERSION(4, 6)
+    //===----------------------------------------------------------------------===//
+    //                       ... Internal Functions ...
+    //===----------------------------------------------------------------------===//
+
+    /// EmitTrapIf - Output a trap, taken if Cond holds.  Used for the checks of
+    /// the undefined behaviour sanitizer.
+    void TreeToLLVM::EmitTrapIf(Value * Cond) {
+      LLVMContext &Context =
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+          TheModule->getContext();
+#else
+          TheContext;
+#endif
+      BasicBlock *TrapBB = BasicBlock::Create(Context);
+      BasicBlock *ContBB = BasicBlock::Create(Context);
+      Builder.CreateCondBr(Cond, TrapBB, ContBB);
+      BeginBlock(TrapBB);
+      Builder.CreateCall(Intrinsic::getDeclaration(TheModule, Intrinsic::trap));
+      Builder.CreateUnreachable();
+      BeginBlock(ContBB);
+    }
+
+    /// EmitCheckedArithmetic - Compute op0 Opc op1 as if with infinite
+    /// precision and return the result truncated to the given integer type,
+    /// setting Overflow to whether the exact result did not fit.  When the
+    /// operands already have that type this is one of the LLVM *.with.overflow
+    /// intrinsics, which targets turn into a flag setting instruction.
+    Value *TreeToLLVM::EmitCheckedArithmetic(Instruction::BinaryOps Opc,
+                                             tree op0, tree op1, tree type,
+                                             Value * &Overflow) {
+      Type *Ty = getRegType(type);
+      bool isSigned = !TYPE_UNSIGNED(type);
+      Value *LHS = EmitRegister(op0);
+      Value *RHS = EmitRegister(op1);
+      bool LHSIsSigned = !TYPE_UNSIGNED(TREE_TYPE(op0));
+      bool RHSIsSigned = !TYPE_UNSIGNED(TREE_TYPE(op1));
+
+      if (LHS->getType() == Ty && RHS->getType() == Ty &&
+          LHSIsSigned == isSigned && RHSIsSigned == isSigned) {
+        Intrinsic::ID IID;
+        switch (Opc) {
+        default:
+          llvm_unreachable("Unexpected checked operation!");
+        case Instruction::Add:
+          IID = isSigned ? Intrinsic::sadd_with_overflow
+                         : Intrinsic::uadd_with_overflow;
+          break;
+        case Instruction::Sub:
+          IID = isSigned ? Intrinsic::ssub_with_overflow
+                         : Intrinsic::usub_with_overflow;
+          break;
+        case Instruction::Mul:
+          IID = isSigned ? Intrinsic::smul_with_overflow
+                         : Intrinsic::umul_with_overflow;
+          break;
+        }
+        Function *Intr = Intrinsic::getDeclaration(TheModule, IID, Ty);
+        Value *Pair =
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+            Builder.CreateCall(Intr, {LHS, RHS});
+#else
+            Builder.CreateCall2(Intr, LHS, RHS);
+#endif
+        Overflow = Builder.CreateExtractValue(Pair, 1);
+        return Builder.CreateExtractValue(Pair, 0);
+      }
+
+      // The operands and the result differ in precision or signedness.  Do the
+      // operation in a signed type wide enough that it cannot overflow, then
+      // see if the result survives the trip through the narrower type.
+      unsigned LHSBits = LHS->getType()->getPrimitiveSizeInBits();
+      unsigned RHSBits = RHS->getType()->getPrimitiveSizeInBits();
+      unsigned Bits = Opc == Instruction::Mul ? LHSBits + RHSBits + 2 :
+                      std::max(LHSBits, RHSBits) + 2;
+      Bits = std::max(Bits, (unsigned)Ty->getPrimitiveSizeInBits() + 1);
+      Type *WideTy = IntegerType::get(Ty->getContext(), Bits);
+      LHS = CastToAnyType(LHS, LHSIsSigned, WideTy, true);
+      RHS = CastToAnyType(RHS, RHSIsSigned, WideTy, true);
+      Value *Wide = Builder.CreateBinOp(Opc, LHS, RHS);
+      Value *Result = Builder.CreateTrunc(Wide, Ty);
+      Overflow = Builder.CreateICmpNE(
+          CastToAnyType(Result, isSigned, WideTy, true), Wide);
+      return Result;
+    }
+
+    /// EmitInternalCall - Convert a call to a GCC internal function, returning
+    /// the result in register form or null if there is none.  Internal
+    /// functions have no declaration or address, so are always expanded inline.
+    Value *TreeToLLVM::EmitInternalCall(GimpleTy *stmt) {
+      tree lhs = gimple_call_lhs(stmt);
+      tree type = lhs ? TREE_TYPE(lhs) : NULL_TREE;
+
+      switch (gimple_call_internal_fn(stmt)) {
+      default:
+        break;
+
+#if GCC_VERSION_CODE > GCC_VERSION(4, 8)
+      case IFN_ANNOTATE:
+        // Loop annotations only matter to the GCC loop optimizers.
+        return lhs ? EmitRegister(gimple_call_arg(MIG_TO_GCALL(stmt), 0)) : 0;
+
+      // The GCC vectorizer did not vectorize the loop, so the scalar versions
+      // of these are what is wanted.
+      case IFN_LOOP_VECTORIZED:
+        return lhs ? Constant::getNullValue(getRegType(type)) : 0;
+      case IFN_GOMP_SIMD_LANE:
+        return lhs ? Constant::getNullValue(getRegType(type)) : 0;
+      case IFN_GOMP_SIMD_VF:
+        return lhs ? ConstantInt::get(getRegType(type), 1) : 0;
+      case IFN_GOMP_SIMD_LAST_LANE:
+        return lhs ? EmitRegister(gimple_call_arg(MIG_TO_GCALL(stmt), 1)) : 0;
+
+      case IFN_MASK_LOAD:
+      case IFN_MASK_STORE: {
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 6)
+        bool isLoad = gimple_call_internal_fn(stmt) == IFN_MASK_LOAD;
+        if (isLoad && !lhs)
+          return 0;
+        tree vec_type =
+            isLoad ? type : TREE_TYPE(gimple_call_arg(MIG_TO_GCALL(stmt), 3));
+        Type *VecTy = getRegType(vec_type);
+        Value *Ptr = EmitRegister(gimple_call_arg(MIG_TO_GCALL(stmt), 0));
+        Ptr = Builder.CreateBitCast(Ptr, VecTy->getPointerTo());
+#if (GCC_MAJOR > 6)
+        unsigned Align = TREE_INT_CST_LOW(gimple_call_arg(MIG_TO_GCALL(stmt),
+                                                          1)) / BITS_PER_UNIT;
+#else
+        // Only the element alignment is known for sure.
+        unsigned Align = TYPE_ALIGN_UNIT(TREE_TYPE(vec_type));
+#endif
+        // The mask is a vector with all bits set in the active lanes.
+        Value *Mask = EmitRegister(gimple_call_arg(MIG_TO_GCALL(stmt), 2));
+        Mask = Builder.CreateICmpNE(Mask,
+                                    Constant::getNullValue(Mask->getType()));
+        if (isLoad)
+          return Builder.CreateMaskedLoad(Ptr, Align, Mask,
+                                          Constant::getNullValue(VecTy));
+        Value *Val = EmitRegister(gimple_call_arg(MIG_TO_GCALL(stmt), 3));
+        Builder.CreateMaskedStore(Val, Ptr, Align, Mask);
+        return 0;
+#else
+        break;
+#endif
+      }
+
+      // With the undefined behaviour sanitizer failing checks trap, as with
+      // -fsanitize-undefined-trap-on-error.
+      case IFN_UBSAN_CHECK_ADD:
+      case IFN_UBSAN_CHECK_SUB:
+      case IFN_UBSAN_CHECK_MUL: {
+        Instruction::BinaryOps Opc =
+            gimple_call_internal_fn(stmt) == IFN_UBSAN_CHECK_ADD
+                ? Instruction::Add
+                : gimple_call_internal_fn(stmt) == IFN_UBSAN_CHECK_SUB
+                      ? Instruction::Sub
+                      : Instruction::Mul;
+        tree op0 = gimple_call_arg(MIG_TO_GCALL(stmt), 0);
+        tree op1 = gimple_call_arg(MIG_TO_GCALL(stmt), 1);
+        Value *Overflow;
+        Value *Result = EmitCheckedArithmetic(
+            Opc, op0, op1, type ? type : TREE_TYPE(op0), Overflow);
+        EmitTrapIf(Overflow);
+        return lhs ? Result : 0;
+      }
+      case IFN_UBSAN_NULL: {
+        Value *Ptr = EmitRegister(gimple_call_arg(MIG_TO_GCALL(stmt), 0));
+        EmitTrapIf(Builder.CreateIsNull(Ptr));
+        return 0;
+      }
+      case IFN_UBSAN_BOUNDS: {
+        // The index is out of bounds if it is bigger than the maximum index.
+        tree bound = gimple_call_arg(MIG_TO_GCALL(stmt), 2);
+        tree index = gimple_call_arg(MIG_TO_GCALL(stmt), 1);
+        Value *Bound = EmitRegister(bound);
+        Value *Index = CastToAnyType(EmitRegister(index),
+                                     !TYPE_UNSIGNED(TREE_TYPE(index)),
+                                     Bound->getType(), false);
+        EmitTrapIf(Builder.CreateICmpUGT(Index, Bound));
+        return 0;
+      }
+#endif
+
+#if (GCC_MAJOR > 7)
+      // Reductions produced by the GCC vectorizer.
+      case IFN_REDUC_PLUS:
+      case IFN_REDUC_MAX:
+      case IFN_REDUC_MIN: {
+        if (!lhs)
+          return 0;
+        tree op = gimple_call_arg(MIG_TO_GCALL(stmt), 0);
+        if (gimple_call_internal_fn(stmt) == IFN_REDUC_PLUS)
+          return EmitReg_REDUC_PLUS_EXPR(op);
+        if (gimple_call_internal_fn(stmt) == IFN_REDUC_MAX)
+          return EmitReg_ReducMinMaxExpr(op, ICmpInst::ICMP_UGE,
+                                         ICmpInst::ICMP_SGE,
+                                         FCmpInst::FCMP_OGE);
+        return EmitReg_ReducMinMaxExpr(op, ICmpInst::ICMP_ULE,
+                                       ICmpInst::ICMP_SLE, FCmpInst::FCMP_OLE);
+      }
+#endif
+
+#if (GCC_MAJOR > 4)
+      case IFN_BUILTIN_EXPECT: {
+        if (!lhs)
+          return 0;
+        Value *Result;
+        EmitBuiltinExpect(stmt, Result);
+        return Mem2Reg(Result, type, Builder);
+      }
+
+      // The result is a complex number: the real part holds the wrapped result
+      // and the imaginary part is one if the exact result did not fit.
+      case IFN_ADD_OVERFLOW:
+      case IFN_SUB_OVERFLOW:
+      case IFN_MUL_OVERFLOW: {
+        if (!lhs)
+          return 0;
+        Instruction::BinaryOps Opc =
+            gimple_call_internal_fn(stmt) == IFN_ADD_OVERFLOW
+                ? Instruction::Add
+                : gimple_call_internal_fn(stmt) == IFN_SUB_OVERFLOW
+                      ? Instruction::Sub
+                      : Instruction::Mul;
+        tree op0 = gimple_call_arg(MIG_TO_GCALL(stmt), 0);
+        tree op1 = gimple_call_arg(MIG_TO_GCALL(stmt), 1);
+        Value *Overflow;
+        Value *Result =
+            EmitCheckedArithmetic(Opc, op0, op1, TREE_TYPE(type), Overflow);
+        return CreateComplex(Result,
+                             Builder.CreateZExt(Overflow, Result->getType()));
+      }
+#endif
+      }
+
+      error("unsupported internal function %<%s%> used",
+            internal_fn_name(gimple_call_internal_fn(stmt)));
+      if (!lhs || isa<AGGREGATE_TYPE>(type))
+        return 0;
+      return UndefValue::get(getRegType(type));
+    }
+#endif
+
     //===----------------------------------------------------------------------===//
     //                      ... Complex Math Expressions ...
     //===----------------------------------------------------------------------===//
@@ -6732,6 +9676,101 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       Imag = Builder.CreateExtractValue(Complex, 1);
     }
 
+    /// EmitComplexLibCall - Multiply or divide (LHSr+iLHSi) by (RHSr+iRHSi) by
+    /// calling the libgcc routine for the given complex type, such as __muldc3.
+    /// These get infinities and NaNs right as required by C99 Annex G.  Op is
+    /// either "mul" or "div".
+    Value *TreeToLLVM::EmitComplexLibCall(StringRef Op, tree type,
+                                          Value * LHSr, Value * LHSi,
+                                          Value * RHSr, Value * RHSi) {
+      // Form the name the same way as GCC's init_optabs does.
+      std::string Name = "__" + Op.str();
+      for (const char *p = GET_MODE_NAME(TYPE_MODE(type)); *p; ++p)
+        Name += TOLOWER(*p);
+      Name += '3';
+
+      // Get the GCC and LLVM function types for the routine.
+      tree elt_type = TREE_TYPE(type);
+      tree fntype = build_function_type_list(type, elt_type, elt_type, elt_type,
+                                             elt_type, NULL_TREE);
+      FunctionType *FTy = cast<FunctionType>(ConvertType(fntype));
+
+      // Get the LLVM function declaration for the routine.
+      Constant *Func = TheModule->getOrInsertFunction(Name, FTy);
+
+      // Determine the calling convention.
+      CallingConv::ID CC = CallingConv::C;
+#ifdef TARGET_ADJUST_LLVM_CC
+      // Query the target for the calling convention to use.
+      TARGET_ADJUST_LLVM_CC(CC, fntype);
+#endif
+
+      // If the function already existed with the wrong prototype then don't try
+      // to muck with its calling convention.  Otherwise, set the calling
+      // convention.
+      if (Function *F = llvm::dyn_cast<Function>(Func))
+        F->setCallingConv(CC);
+
+      SmallVector<Value *, 16> CallOperands;
+      FunctionCallArgumentConversion Client(CallOperands, FTy, /*destloc*/ 0,
+                                            /*ReturnSlotOpt*/ false, Builder,
+                                            CC);
+      DefaultABI ABIConverter(Client);
+
+      // Handle the result.
+      ABIConverter.HandleReturnType(type, fntype, false);
+
+      // Push the arguments.
+      Value *Args[4] = { LHSr, LHSi, RHSr, RHSi };
+      for (unsigned i = 0; i != 4; ++i) {
+        Client.pushValue(Args[i]);
+        AttrBuilder AttrBuilder;
+        std::vector<Type *> ScalarArgs;
+        ABIConverter.HandleArgument(elt_type, ScalarArgs, &AttrBuilder);
+        assert(!AttrBuilder.hasAttributes() &&
+               "Got attributes but none given!");
+        Client.clear();
+      }
+
+      // Create the call.
+      CallInst *CI = Builder.CreateCall(Func, CallOperands);
+      CI->setCallingConv(CC);
+      CI->setDoesNotThrow();
+
+      // Extract and return the result.
+      Type *CplxTy = getRegType(type);
+      if (Client.isShadowReturn())
+        return Client.EmitShadowResult(type, 0);
+
+      if (Client.isAggrReturn()) {
+        if (Value *V = BuildMultipleReturnValue(CI, CplxTy, Builder))
+          return V;
+
+        // Extract to a temporary then load the value out later.
+        MemRef Target = CreateTempLoc(CplxTy);
+
+        assert(DL.getTypeAllocSize(CI->getType()) <=
+               DL.getTypeAllocSize(CplxTy) &&
+               "Complex number returned in too large registers!");
+        Value *Dest =
+            Builder.CreateBitCast(Target.Ptr, CI->getType()->getPointerTo());
+        LLVM_EXTRACT_MULTIPLE_RETURN_VALUE(CI, Dest, Target.Volatile, Builder);
+        return Builder.CreateLoad(Target.Ptr);
+      }
+
+      if (CI->getType() == CplxTy)
+        return CI; // Normal scalar return.
+
+      // Probably { float, float } being returned as a double.
+      assert(DL.getTypeAllocSize(CI->getType()) ==
+             DL.getTypeAllocSize(CplxTy) &&
+             "Size mismatch in scalar to scalar conversion!");
+      Value *Tmp = CreateScratchTemporary(CI->getType());
+      Builder.CreateStore(CI, Tmp);
+      return Builder.CreateLoad(
+          Builder.CreateBitCast(Tmp, CplxTy->getPointerTo()));
+    }
+
     //===----------------------------------------------------------------------===//
     //                         ... L-Value Expressions ...
     //===----------------------------------------------------------------------===//
@@ -6830,16 +9869,24 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       ArrayAddr = ArrayAddrLV.Ptr;
       ArrayAlign = ArrayAddrLV.getAlignment();
 
+      // GEP indices are implicitly sign extended to the width of a pointer, so
+      // there is no need to extend a narrower signed index, and not doing so
+      // keeps the index in the form loop optimizations expect.  Unsigned and
+      // over wide indices still have to be converted explicitly.
       Type *IntPtrTy = getDataLayout().getIntPtrType(ArrayAddr->getType());
-      IndexVal = Builder.CreateIntCast(IndexVal, IntPtrTy,
-                                       /*isSigned*/ !TYPE_UNSIGNED(IndexType));
+      if (TYPE_UNSIGNED(IndexType) ||
+          IndexVal->getType()->getPrimitiveSizeInBits() >
+              IntPtrTy->getPrimitiveSizeInBits())
+        IndexVal = Builder.CreateIntCast(
+            IndexVal, IntPtrTy, /*isSigned*/ !TYPE_UNSIGNED(IndexType));
 
       // If we are indexing over a fixed-size type, just use a GEP.
       if (isSizeCompatible(ElementType)) {
         // Avoid any assumptions about how the array type is represented in LLVM by
         // doing the GEP on a pointer to the first array element.
         Type *EltTy = ConvertType(ElementType);
-        ArrayAddr = Builder.CreateBitCast(ArrayAddr, EltTy->getPointerTo());
+        ArrayAddr = Builder.CreateBitCast(
+            ArrayAddr, getPointerInSameSpace(EltTy, ArrayAddr));
         StringRef GEPName = flag_verbose_asm ? "ar" : "";
         Value *Ptr =
 #if (GCC_MAJOR > 7)
@@ -6853,7 +9900,7 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
             MinAlign(ArrayAlign, DL.getABITypeAlignment(EltTy));
         return LValue(
             Builder.CreateBitCast(
-                Ptr, PointerType::getUnqual(ConvertType(TREE_TYPE(exp)))),
+                Ptr, getPointerInSameSpace(ConvertType(TREE_TYPE(exp)), Ptr)),
             Alignment);
       }
 
@@ -6867,8 +9914,9 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
           TheContext;
 #endif
       if (isa<VOID_TYPE>(TREE_TYPE(ArrayTreeType))) {
-        ArrayAddr =
-            Builder.CreateBitCast(ArrayAddr, Type::getInt8PtrTy(Context));
+        ArrayAddr = Builder.CreateBitCast(
+            ArrayAddr, getPointerInSameSpace(Type::getInt8Ty(Context),
+                                             ArrayAddr));
         StringRef GEPName = flag_verbose_asm ? "va" : "";
         ArrayAddr =
 #if (GCC_MAJOR > 7)
@@ -6895,8 +9943,10 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
              "Unit size not a multiple of 8 bits!");
       // ScaleType is chosen to correct for the division in ScaleFactor.
       Type *ScaleType = IntegerType::get(Context, TYPE_ALIGN(ElementType));
-      ArrayAddr = Builder.CreateBitCast(ArrayAddr, ScaleType->getPointerTo());
+      ArrayAddr = Builder.CreateBitCast(
+          ArrayAddr, getPointerInSameSpace(ScaleType, ArrayAddr));
 
+      IndexVal = Builder.CreateIntCast(IndexVal, IntPtrTy, /*isSigned*/ true);
       IndexVal = Builder.CreateMul(IndexVal, ScaleFactor);
       unsigned Alignment = MinAlign(ArrayAlign, TYPE_ALIGN(ElementType) / 8);
       StringRef GEPName = flag_verbose_asm ? "ra" : "";
@@ -6910,7 +9960,7 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
                    : Builder.CreateGEP(ArrayAddr, IndexVal, GEPName);
       return LValue(
           Builder.CreateBitCast(
-              Ptr, PointerType::getUnqual(ConvertType(TREE_TYPE(exp)))),
+              Ptr, getPointerInSameSpace(ConvertType(TREE_TYPE(exp)), Ptr)),
           Alignment);
     }
 
@@ -6937,7 +9987,8 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       if (unsigned UnitOffset = BitStart / ValueSizeInBits) {
         // TODO: If Ptr.Ptr is a struct type or something, we can do much better
         // than this.  e.g. check out when compiling unwind-dw2-fde-darwin.c.
-        Ptr.Ptr = Builder.CreateBitCast(Ptr.Ptr, ValTy->getPointerTo());
+        Ptr.Ptr = Builder.CreateBitCast(Ptr.Ptr,
+                                        getPointerInSameSpace(ValTy, Ptr.Ptr));
         Ptr.Ptr = Builder.CreateGEP(Ptr.Ptr, Builder.getInt32(UnitOffset),
                                     flag_verbose_asm ? "bfr" : "");
         unsigned OctetOffset = (UnitOffset * ValueSizeInBits) / 8;
@@ -6947,12 +9998,14 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
 
       // If this is referring to the whole field, return the whole thing.
       if (BitStart == 0 && BitSize == ValueSizeInBits) {
-        return LValue(Builder.CreateBitCast(Ptr.Ptr, ValTy->getPointerTo()),
+        return LValue(Builder.CreateBitCast(
+                          Ptr.Ptr, getPointerInSameSpace(ValTy, Ptr.Ptr)),
                       Ptr.getAlignment());
       }
 
-      return LValue(Builder.CreateBitCast(Ptr.Ptr, ValTy->getPointerTo()), 1,
-                    BitStart, BitSize);
+      return LValue(Builder.CreateBitCast(
+                        Ptr.Ptr, getPointerInSameSpace(ValTy, Ptr.Ptr)),
+                    1, BitStart, BitSize);
     }
 
     LValue TreeToLLVM::EmitLV_COMPONENT_REF(tree exp) {
@@ -6967,8 +10020,8 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       assert((!StructAddrLV.isBitfield() || StructAddrLV.BitStart == 0) &&
              "structs cannot be bitfields!");
 
-      StructAddrLV.Ptr =
-          Builder.CreateBitCast(StructAddrLV.Ptr, StructTy->getPointerTo());
+      StructAddrLV.Ptr = Builder.CreateBitCast(
+          StructAddrLV.Ptr, getPointerInSameSpace(StructTy, StructAddrLV.Ptr));
       Type *FieldTy = ConvertType(TREE_TYPE(FieldDecl));
 
       // BitStart - This is the actual offset of the field from the start of the
@@ -7030,11 +10083,13 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
 #else
             TheContext;
 #endif
-        Type *BytePtrTy = Type::getInt8PtrTy(Context);
+        Type *BytePtrTy = getPointerInSameSpace(Type::getInt8Ty(Context),
+                                                StructAddrLV.Ptr);
         FieldPtr = Builder.CreateBitCast(StructAddrLV.Ptr, BytePtrTy);
         FieldPtr = Builder.CreateInBoundsGEP(FieldPtr, Offset,
                                              flag_verbose_asm ? "rc" : "");
-        FieldPtr = Builder.CreateBitCast(FieldPtr, FieldTy->getPointerTo());
+        FieldPtr = Builder.CreateBitCast(
+            FieldPtr, getPointerInSameSpace(FieldTy, FieldPtr));
       }
 
       // Compute the alignment of the octet containing the first bit of the field,
@@ -7047,7 +10102,8 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
 
       // Make sure we return a pointer to the right type.
       Type *EltTy = ConvertType(TREE_TYPE(exp));
-      FieldPtr = Builder.CreateBitCast(FieldPtr, EltTy->getPointerTo());
+      FieldPtr = Builder.CreateBitCast(FieldPtr,
+                                       getPointerInSameSpace(EltTy, FieldPtr));
 
       if (!isBitfield(FieldDecl)) {
         assert(BitStart == 0 && "Not a bitfield but not at a byte offset!");
@@ -7059,6 +10115,54 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       assert(DECL_SIZE(FieldDecl) && isa<INTEGER_CST>(DECL_SIZE(FieldDecl)) &&
              "Variable sized bitfield?");
       unsigned BitfieldSize = TREE_INT_CST_LOW(DECL_SIZE(FieldDecl));
+
+#if GCC_VERSION_CODE > GCC_VERSION(4, 6)
+      // GCC groups adjacent bitfields into a representative field, which is as
+      // big as can be accessed without touching other fields.  If it has an
+      // integer mode then access the bitfield using the whole representative,
+      // like GCC does.  All bitfields in the group are then loaded and stored
+      // the same way, so the optimizers can merge the accesses, which avoids
+      // store forwarding stalls from mixing narrow and wide accesses.  Volatile
+      // bitfields are left alone.
+      tree Repr = DECL_BIT_FIELD_REPRESENTATIVE(FieldDecl);
+      if (Repr && !TREE_THIS_VOLATILE(exp) && DECL_MODE(Repr) != BLKmode &&
+          GET_MODE_BITSIZE(DECL_MODE(Repr)) < 256 &&
+          isa<INTEGER_CST>(DECL_FIELD_OFFSET(FieldDecl)) &&
+          isa<INTEGER_CST>(DECL_FIELD_OFFSET(Repr))) {
+        // The position of the bitfield in bits from the start of Repr.
+        int64_t Delta = (getInt64(DECL_FIELD_OFFSET(FieldDecl), true) -
+                         getInt64(DECL_FIELD_OFFSET(Repr), true)) * 8 +
+                        getInt64(DECL_FIELD_BIT_OFFSET(FieldDecl), true) -
+                        getInt64(DECL_FIELD_BIT_OFFSET(Repr), true);
+        unsigned ReprSize = GET_MODE_BITSIZE(DECL_MODE(Repr));
+        if (Delta >= BitStart && (Delta - BitStart) % 8 == 0 &&
+            Delta + BitfieldSize <= ReprSize) {
+          LLVMContext &Context =
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+              FieldPtr->getContext();
+#else
+              TheContext;
+#endif
+          int64_t ByteOffset = (Delta - BitStart) / 8;
+          if (ByteOffset) {
+            Type *BytePtrTy = getPointerInSameSpace(Type::getInt8Ty(Context),
+                                                    FieldPtr);
+            FieldPtr = Builder.CreateBitCast(FieldPtr, BytePtrTy);
+            FieldPtr = Builder.CreateInBoundsGEP(
+                FieldPtr, ConstantInt::get(Type::getInt64Ty(Context),
+                                           -ByteOffset));
+            FieldPtr = Builder.CreateBitCast(
+                FieldPtr, getPointerInSameSpace(EltTy, FieldPtr));
+          }
+          LValue LV(FieldPtr, MinAlign(StructAddrLV.getAlignment(),
+                                       getFieldAlignment(Repr)),
+                    (unsigned) Delta, BitfieldSize);
+          LV.AccessSize = ReprSize;
+          return LV;
+        }
+      }
+#endif
+
       return LValue(FieldPtr, LVAlign, BitStart, BitfieldSize);
     }
 
@@ -7086,7 +10190,7 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       // type void.
       if (Ty->isVoidTy())
         Ty = StructType::get(Context);
-      PointerType *PTy = Ty->getPointerTo();
+      PointerType *PTy = getPointerInSameSpace(Ty, Decl);
       unsigned Alignment = DECL_ALIGN(exp) / 8;
       if (!Alignment)
         Alignment = 1;
@@ -7100,8 +10204,8 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
           LValue(EmitRegister(TREE_OPERAND(exp, 0)), expr_align(exp) / 8);
       // May need to change pointer type, for example when INDIRECT_REF is applied
       // to a void*, resulting in a non-void type.
-      LV.Ptr = Builder
-          .CreateBitCast(LV.Ptr, ConvertType(TREE_TYPE(exp))->getPointerTo());
+      LV.Ptr = Builder.CreateBitCast(
+          LV.Ptr, getPointerInSameSpace(ConvertType(TREE_TYPE(exp)), LV.Ptr));
       return LV;
     }
 
@@ -7117,7 +10221,9 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
 #else
             TheContext;
 #endif
-        Addr = Builder.CreateBitCast(Addr, GetUnitPointerType(Context));
+        unsigned AddrSpace = Addr->getType()->getPointerAddressSpace();
+        Addr = Builder.CreateBitCast(Addr,
+                                     GetUnitPointerType(Context, AddrSpace));
         APInt Offset = getAPIntValue(TREE_OPERAND(exp, 1));
         // The address is always inside the referenced object, so "inbounds".
         Addr =
@@ -7164,8 +10270,8 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       LValue LV = LValue(EmitRegister(TREE_OPERAND(exp, 0)), Alignment / 8);
       // May need to change pointer type, for example when MISALIGNED_INDIRECT_REF
       // is applied to a void*, resulting in a non-void type.
-      LV.Ptr = Builder
-          .CreateBitCast(LV.Ptr, ConvertType(TREE_TYPE(exp))->getPointerTo());
+      LV.Ptr = Builder.CreateBitCast(
+          LV.Ptr, getPointerInSameSpace(ConvertType(TREE_TYPE(exp)), LV.Ptr));
       return LV;
     }
 #endif
@@ -7174,8 +10280,8 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       // The address is the address of the operand.
       LValue LV = EmitLV(TREE_OPERAND(exp, 0));
       // The type is the type of the expression.
-      LV.Ptr = Builder
-          .CreateBitCast(LV.Ptr, ConvertType(TREE_TYPE(exp))->getPointerTo());
+      LV.Ptr = Builder.CreateBitCast(
+          LV.Ptr, getPointerInSameSpace(ConvertType(TREE_TYPE(exp)), LV.Ptr));
       return LV;
     }
 
@@ -7207,14 +10313,12 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
 
     LValue TreeToLLVM::EmitLV_SSA_NAME(tree exp) {
       // TODO: Check the ssa name is being used as an rvalue, see EmitLoadOfLValue.
-      Value *Temp = CreateTemporary(ConvertType(TREE_TYPE(exp)));
+      Value *Temp = CreateScratchTemporary(ConvertType(TREE_TYPE(exp)));
       Builder.CreateStore(EmitReg_SSA_NAME(exp), Temp);
       return LValue(Temp, 1);
     }
 
     LValue TreeToLLVM::EmitLV_TARGET_MEM_REF(tree exp) {
-      // TODO: Take the address space into account.
-
       Value *Addr;
       Value *Delta = 0; // Offset from base pointer in units
 #if GCC_VERSION_CODE >  GCC_VERSION(4, 5)
@@ -7243,11 +10347,15 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
 #else
           TheContext;
 #endif
+      // The index scaled by the step, unless the step is one in which case the
+      // index is simply part of the offset.
+      Value *Index = 0;
       if (TMR_INDEX(exp)) {
-        Value *Index = EmitRegister(TMR_INDEX(exp));
-        if (TMR_STEP(exp) && !integer_onep(TMR_STEP(exp)))
-          Index = Builder.CreateMul(Index, EmitRegisterConstant(TMR_STEP(exp)));
-        Delta = Delta ? Builder.CreateAdd(Delta, Index) : Index;
+        Index = EmitRegister(TMR_INDEX(exp));
+        if (!TMR_STEP(exp) || integer_onep(TMR_STEP(exp))) {
+          Delta = Delta ? Builder.CreateAdd(Delta, Index) : Index;
+          Index = 0;
+        }
       }
 
       if (TMR_OFFSET(exp) && !integer_zerop(TMR_OFFSET(exp))) {
@@ -7256,18 +10364,37 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
         Delta = Delta ? Builder.CreateAdd(Delta, Off) : Off;
       }
 
-      if (Delta) {
-        // Advance the base pointer by the given number of units.
-        Addr = Builder.CreateBitCast(Addr, GetUnitPointerType(Context));
-        StringRef GEPName = flag_verbose_asm ? "" : "tmrf";
-        Addr =
+      bool InBounds =
 #if (GCC_MAJOR > 7)
-            true
+          true;
 #else
-            POINTER_TYPE_OVERFLOW_UNDEFINED
+          POINTER_TYPE_OVERFLOW_UNDEFINED;
 #endif
-               ? Builder.CreateInBoundsGEP(Addr, Delta, GEPName)
-               : Builder.CreateGEP(Addr, Delta, GEPName);
+      StringRef GEPName = flag_verbose_asm ? "" : "tmrf";
+      unsigned AddrSpace = Addr->getType()->getPointerAddressSpace();
+      if (Delta) {
+        // Advance the base pointer by the given number of units.
+        Addr = Builder.CreateBitCast(Addr,
+                                     GetUnitPointerType(Context, AddrSpace));
+        // If the scaled index still has to be added then the pointer may be
+        // outside the object here, so only the final GEP can be inbounds.
+        Addr = InBounds && !Index
+                   ? Builder.CreateInBoundsGEP(Addr, Delta, GEPName)
+                   : Builder.CreateGEP(Addr, Delta, GEPName);
+      }
+
+      if (Index) {
+        // Advance by the index in units of the step, using a type of that size
+        // so that the scaling shows up in the GEP.  IVOPTs chose the step to
+        // match an addressing mode of the target, and this way codegen can use
+        // that mode without having to recognize a multiplication.
+        uint64_t Step = getInt64(TMR_STEP(exp), true);
+        Type *StepTy = ConvertType(TREE_TYPE(exp));
+        if (!StepTy->isSized() || DL.getTypeAllocSize(StepTy) != Step)
+          StepTy = ArrayType::get(Type::getInt8Ty(Context), Step);
+        Addr = Builder.CreateBitCast(Addr, StepTy->getPointerTo(AddrSpace));
+        Addr = InBounds ? Builder.CreateInBoundsGEP(Addr, Index, GEPName)
+                        : Builder.CreateGEP(Addr, Index, GEPName);
       }
 
       // The result can be of a different pointer type even if we didn't advance it.
@@ -7400,23 +10527,6 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       return CastToAnyType(C, SrcIsSigned, getRegType(type), DstIsSigned);
     }
 
-    /// EncodeExpr - Write the given expression into Buffer as it would appear in
-    /// memory on the target (the buffer is resized to contain exactly the bytes
-    /// written).  Return the number of bytes written; this can also be obtained
-    /// by querying the buffer's size.
-    /// The following kinds of expressions are currently supported: INTEGER_CST,
-    /// REAL_CST, COMPLEX_CST, VECTOR_CST, STRING_CST.
-    static unsigned EncodeExpr(tree exp,
-                               SmallVectorImpl<unsigned char> & Buffer) {
-      const tree type = TREE_TYPE(exp);
-      unsigned SizeInBytes = (TREE_INT_CST_LOW(TYPE_SIZE(type)) + 7) / 8;
-      Buffer.resize(SizeInBytes);
-      unsigned BytesWritten = native_encode_expr(exp, &Buffer[0], SizeInBytes);
-      assert(BytesWritten == SizeInBytes &&
-             "Failed to fully encode expression!");
-      return BytesWritten;
-    }
-
     /// EmitComplexRegisterConstant - Turn the given COMPLEX_CST into an LLVM
     /// constant of the corresponding register type.
     Constant *TreeToLLVM::EmitComplexRegisterConstant(tree reg) {
@@ -7449,62 +10559,78 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
     /// EmitRealRegisterConstant - Turn the given REAL_CST into an LLVM constant
     /// of the corresponding register type.
     Constant *TreeToLLVM::EmitRealRegisterConstant(tree reg) {
-      // TODO: Rather than going through memory, construct the APFloat directly from
-      // the real_value.  This works fine for zero, inf and nan values, but APFloat
-      // has no constructor for normal numbers, i.e. constructing a normal number
-      // from the exponent and significand.
-      // TODO: Test implementation on a big-endian machine.
-
-      // Encode the constant in Buffer in target format.
-      SmallVector<unsigned char, 16> Buffer;
-      EncodeExpr(reg, Buffer);
+      // The constant may already have been converted, either here or as the
+      // initial value of a global: the two agree for floating point types.
+      Type *Ty = getRegType(TREE_TYPE(reg));
+      if (Constant *C = cast_or_null<Constant>(getCachedValue(reg)))
+        if (C->getType() == Ty)
+          return C;
 
-      // Discard any alignment padding, which we assume comes at the end.
+      // Get the bits of the constant in target format from GCC, as 32 bit words
+      // (one per long), without going through a buffer of bytes.
+      // TODO: Test implementation on a big-endian machine.
       unsigned Precision = TYPE_PRECISION(TREE_TYPE(reg));
-      assert((Precision & 7) == 0 && "Unsupported real number precision!");
-      Buffer.resize(Precision / 8);
-
-      // We are going to view the buffer as an array of APInt words.  Ensure that
-      // the buffer contains a whole number of words by extending it if necessary.
-      unsigned Words = (Precision + integerPartWidth - 1) / integerPartWidth;
-      // On a little-endian machine extend the buffer by adding bytes to the end.
-      Buffer.resize(Words * (integerPartWidth / 8));
-      // On a big-endian machine extend the buffer by adding bytes to the beginning.
-      if (BYTES_BIG_ENDIAN)
-        std::copy_backward(Buffer.begin(), Buffer.begin() + Precision / 8,
-                           Buffer.end());
-
-      // Ensure that the least significant word comes first: we are going to make an
-      // APInt, and the APInt constructor wants the least significant word first.
-      integerPart *Parts = (integerPart *)&Buffer[0];
-      if (BYTES_BIG_ENDIAN)
-        std::reverse(Parts, Parts + Words);
+      assert(Precision <= 128 && "Unsupported real number precision!");
+      long Buf[128 / 32];
+      real_to_target(Buf, TREE_REAL_CST_PTR(reg), TYPE_MODE(TREE_TYPE(reg)));
+
+      // The APInt constructor wants the least significant word first.
+      unsigned Words = (Precision + 31) / 32;
+      if (FLOAT_WORDS_BIG_ENDIAN)
+        std::reverse(Buf, Buf + Words);
+      uint64_t Parts[128 / 64] = { 0, 0 };
+      for (unsigned i = 0; i != Words; ++i)
+        Parts[i / 2] |= ((uint64_t) Buf[i] & 0xffffffff) << (32 * (i % 2));
 
-      Type *Ty = getRegType(TREE_TYPE(reg));
       if (Ty->isPPC_FP128Ty()) {
         // This type is actually a pair of doubles in disguise.  They turn up the
         // wrong way round here, so flip them.
         assert(FLOAT_WORDS_BIG_ENDIAN && "PPC not big endian!");
-        assert(Words == 2 && Precision == 128 && "Strange size for PPC_FP128!");
+        assert(Precision == 128 && "Strange size for PPC_FP128!");
         std::swap(Parts[0], Parts[1]);
       }
 
-      // Form an APInt from the buffer, an APFloat from the APInt, and the desired
-      // floating point constant from the APFloat, phew!
-      const APInt &I = APInt(Precision, Words, Parts);
+      // Form an APInt from the words, an APFloat from the APInt, and the desired
+      // floating point constant from the APFloat.
+      const APInt &I = APInt(Precision, makeArrayRef(Parts, (Words + 1) / 2));
       LLVMContext &Context =
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
           Ty->getContext();
 #else
           TheContext;
 #endif
-      return ConstantFP::get(Context, APFloat(Ty->getFltSemantics(), I));
+      Constant *C = ConstantFP::get(Context, APFloat(Ty->getFltSemantics(), I));
+      setCachedValue(reg, C);
+      return C;
     }
 
     /// EmitConstantVectorConstructor - Turn the given constant CONSTRUCTOR into
     /// an LLVM constant of the corresponding vector register type.
     Constant *TreeToLLVM::EmitConstantVectorConstructor(tree reg) {
-      // Get the constructor as an LLVM constant.
+      // If the elements are all integer or floating point constants then build
+      // the vector from them directly.  This gives a plain constant vector, or a
+      // splat if they are all the same, that the code generator can put in the
+      // constant pool or materialize with a single instruction.
+      tree elt_type = TREE_TYPE(TREE_TYPE(reg));
+      SmallVector<Constant *, 16> Elts;
+      unsigned HOST_WIDE_INT idx;
+      tree value;
+      FOR_EACH_CONSTRUCTOR_VALUE(CONSTRUCTOR_ELTS(reg), idx, value) {
+        if (!isa<INTEGER_CST>(value) && !isa<REAL_CST>(value))
+          break;
+        Elts.push_back(EmitRegisterConstantWithCast(value, elt_type));
+      }
+      if (Elts.size() == CONSTRUCTOR_NELTS(reg)) {
+        // Any missing elements are zero.
+        if (Elts.size() < TYPE_VECTOR_SUBPARTS(TREE_TYPE(reg))) {
+          Constant *Default = getDefaultValue(getRegType(elt_type));
+          Elts.append(TYPE_VECTOR_SUBPARTS(TREE_TYPE(reg)) - Elts.size(),
+                      Default);
+        }
+        return ConstantVector::get(Elts);
+      }
+
+      // Otherwise get the constructor as an LLVM constant.
       Constant *C = ConvertInitializer(reg);
       // Load the vector register out of it.
       return ExtractRegisterFromConstant(C, TREE_TYPE(reg));
@@ -7612,7 +10738,8 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       assert(is_gimple_reg_type(TREE_TYPE(reg)) && "Not of register type!");
 
       // If we already found the definition of the SSA name, return it.
-      if (Value *ExistingValue = SSANames[reg]) {
+      Value *ExistingValue = getSSAName(reg);
+      if (ExistingValue) {
         assert(ExistingValue->getType() == getRegType(TREE_TYPE(reg)) &&
                "SSA name has wrong type!");
         if (!isSSAPlaceholder(ExistingValue))
@@ -7621,9 +10748,12 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
 
       // If this is not the definition of the SSA name, return a placeholder value.
       if (!SSA_NAME_IS_DEFAULT_DEF(reg)) {
-        if (Value *ExistingValue = SSANames[reg])
+        if (ExistingValue)
           return ExistingValue; // The type was sanity checked above.
-        return SSANames[reg] = GetSSAPlaceholder(getRegType(TREE_TYPE(reg)));
+        Value *Placeholder = GetSSAPlaceholder(getRegType(TREE_TYPE(reg)));
+        SSAPlaceholders.push_back(std::make_pair(reg, Placeholder));
+        setSSAName(reg, Placeholder);
+        return Placeholder;
       }
 
       // This SSA name is the default definition for the underlying symbol.
@@ -7977,6 +11107,10 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
         // Repeat, using half as many elements.
       }
 
+#if (GCC_MAJOR > 4)
+      // The result is the scalar in the first element.
+      Val = Builder.CreateExtractElement(Val, Builder.getInt32(0));
+#endif
       return Val;
     }
 
@@ -8025,6 +11159,10 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
         // Repeat, using half as many elements.
       }
 
+#if (GCC_MAJOR > 4)
+      // The result is the scalar in the first element.
+      Val = Builder.CreateExtractElement(Val, Builder.getInt32(0));
+#endif
       return Val;
     }
 
@@ -8417,6 +11555,42 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
           Value *Tmp3 = Builder.CreateFMul(LHSr, RHSi); // a*d
           Value *Tmp4 = Builder.CreateFMul(RHSr, LHSi); // c*b
           DSTi = Builder.CreateFAdd(Tmp3, Tmp4);        // ad+cb
+
+          // Unless -fcx-limited-range or -fcx-fortran-rules, the naive formula
+          // is only good enough if it did not produce NaN+iNaN, which can come
+          // from multiplying infinities by zeros.  In that case recompute the
+          // product using the libgcc routine, as GCC does.
+          if (flag_complex_method == 2 && HONOR_NANS(TYPE_MODE(elt_type))) {
+            LLVMContext &Context =
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+                TheModule->getContext();
+#else
+                TheContext;
+#endif
+            Value *IsNaN = Builder.CreateAnd(Builder.CreateFCmpUNO(DSTr, DSTr),
+                                             Builder.CreateFCmpUNO(DSTi, DSTi));
+            BasicBlock *FastBB = Builder.GetInsertBlock();
+            BasicBlock *LibCallBB = BasicBlock::Create(Context);
+            BasicBlock *ContBB = BasicBlock::Create(Context);
+            Builder.CreateCondBr(IsNaN, LibCallBB, ContBB,
+                                 MDBuilder(Context).createBranchWeights(1, 2000));
+
+            BeginBlock(LibCallBB);
+            Value *SlowR, *SlowI;
+            SplitComplex(EmitComplexLibCall("mul", type, LHSr, LHSi, RHSr,
+                                            RHSi), SlowR, SlowI);
+            LibCallBB = Builder.GetInsertBlock();
+
+            BeginBlock(ContBB);
+            PHINode *PhiR = Builder.CreatePHI(DSTr->getType(), 2);
+            PhiR->addIncoming(DSTr, FastBB);
+            PhiR->addIncoming(SlowR, LibCallBB);
+            PHINode *PhiI = Builder.CreatePHI(DSTi->getType(), 2);
+            PhiI->addIncoming(DSTi, FastBB);
+            PhiI->addIncoming(SlowI, LibCallBB);
+            DSTr = PhiR;
+            DSTi = PhiI;
+          }
         } else {
           // If overflow does not wrap in the element type then it is tempting to
           // use NSW operations here.  However that would be wrong since overflow
@@ -8493,10 +11667,46 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
         Value *RHSr, *RHSi;
         SplitComplex(RHS, RHSr, RHSi);
         Value *DSTr, *DSTi;
-
-        // (a+ib) / (c+id) = ((ac+bd)/(cc+dd)) + i((bc-ad)/(cc+dd))
         assert(isa<REAL_TYPE>(TREE_TYPE(type)) &&
                "RDIV_EXPR not floating point!");
+
+        // By default get infinities and NaNs right by calling libgcc, like GCC.
+        if (flag_complex_method == 2)
+          return EmitComplexLibCall("div", type, LHSr, LHSi, RHSr, RHSi);
+
+        if (flag_complex_method == 1) {
+          // -fcx-fortran-rules: use Smith's algorithm, which avoids overflow
+          // in the intermediate values.  Rather than branching on which of c
+          // and d is bigger, swap the operands so that |p| >= |q| and select
+          // the right formula, which keeps the code straight-line:
+          //   |c| >= |d|: r = d/c, s = c+dr, ((a+br)/s) + i((b-ar)/s)
+          //   |c| <  |d|: r = c/d, s = d+cr, ((ar+b)/s) + i((br-a)/s)
+          Type *EltTy = RHSr->getType();
+          Function *Fabs =
+              Intrinsic::getDeclaration(TheModule, Intrinsic::fabs, EltTy);
+          Value *AbsC = Builder.CreateCall(Fabs, RHSr);
+          Value *AbsD = Builder.CreateCall(Fabs, RHSi);
+          Value *Swap = Builder.CreateFCmpOLT(AbsC, AbsD);   // |c| < |d|
+          Value *P = Builder.CreateSelect(Swap, RHSi, RHSr); // bigger of c, d
+          Value *Q = Builder.CreateSelect(Swap, RHSr, RHSi); // other of c, d
+          Value *X = Builder.CreateSelect(Swap, LHSr, LHSi); // a or b
+          Value *Y = Builder.CreateSelect(Swap, LHSi, LHSr); // b or a
+
+          Value *Ratio = Builder.CreateFDiv(Q, P);          // r
+          Value *Tmp1 = Builder.CreateFMul(Q, Ratio);
+          Value *Div = Builder.CreateFAdd(Tmp1, P);         // s
+          Value *Tmp2 = Builder.CreateFMul(X, Ratio);
+          Value *Tmp3 = Builder.CreateFAdd(Tmp2, Y);
+          DSTr = Builder.CreateFDiv(Tmp3, Div);
+          Value *Tmp4 = Builder.CreateFMul(Y, Ratio);
+          Value *Tmp5 = Builder.CreateSelect(Swap, Builder.CreateFSub(Tmp4, X),
+                                             Builder.CreateFSub(X, Tmp4));
+          DSTi = Builder.CreateFDiv(Tmp5, Div);
+          return CreateComplex(DSTr, DSTi);
+        }
+
+        // -fcx-limited-range:
+        // (a+ib) / (c+id) = ((ac+bd)/(cc+dd)) + i((bc-ad)/(cc+dd))
         Value *Tmp1 = Builder.CreateFMul(LHSr, RHSr); // a*c
         Value *Tmp2 = Builder.CreateFMul(LHSi, RHSi); // b*d
         Value *Tmp3 = Builder.CreateFAdd(Tmp1, Tmp2); // ac+bd
@@ -8724,22 +11934,23 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       Value *LHS = EmitRegister(op0);
       Value *RHS = EmitRegister(op1);
 
-      // Truncate the input elements to the output element type, eg: <2 x double>
-      // -> <2 x float>.
+      // Concatenate the inputs into one vector of twice the length, eg:
+      // <2 x double>, <2 x double> -> <4 x double>.  Truncating that in one go
+      // is what the code generators turn into a single pack or narrowing
+      // conversion; truncating the halves first gives them illegal types (like
+      // <2 x float>), which they widen and then have to shuffle back together.
       unsigned Length = (unsigned) TYPE_VECTOR_SUBPARTS(TREE_TYPE(op0));
-      Type *DestTy = VectorType::get(getRegType(TREE_TYPE(type)), Length);
-      LHS = CastToAnyType(LHS, !TYPE_UNSIGNED(TREE_TYPE(TREE_TYPE(op0))),
-                          DestTy, !TYPE_UNSIGNED(TREE_TYPE(type)));
-      RHS = CastToAnyType(RHS, !TYPE_UNSIGNED(TREE_TYPE(TREE_TYPE(op0))),
-                          DestTy, !TYPE_UNSIGNED(TREE_TYPE(type)));
-
-      // Concatenate the truncated inputs into one vector of twice the length,
-      // eg: <2 x float>, <2 x float> -> <4 x float>.
       SmallVector<Constant *, 16> Mask;
       Mask.reserve(2 * Length);
       for (unsigned i = 0, e = 2 * Length; i != e; ++i)
         Mask.push_back(Builder.getInt32(i));
-      return Builder.CreateShuffleVector(LHS, RHS, ConstantVector::get(Mask));
+      Value *Concat =
+          Builder.CreateShuffleVector(LHS, RHS, ConstantVector::get(Mask));
+
+      // Truncate the elements to the output element type, eg: <4 x double>
+      // -> <4 x float>.
+      return CastToAnyType(Concat, !TYPE_UNSIGNED(TREE_TYPE(TREE_TYPE(op0))),
+                           getRegType(type), !TYPE_UNSIGNED(TREE_TYPE(type)));
     }
 
 #if GCC_VERSION_CODE > GCC_VERSION(4, 6)
@@ -8770,6 +11981,13 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       if (ShuffleVectorInst::isValidOperands(V0, V1, Mask32))
         return Builder.CreateShuffleVector(V0, V1, Mask32);
 
+#ifdef LLVM_TARGET_VECTOR_PERMUTE
+      // See if the target has instructions for permuting by a variable mask.
+      if (Value *Res = LLVM_TARGET_VECTOR_PERMUTE(V0, V1, Mask32,
+                                                  operand_equal_p(op0, op1, 0)))
+        return Res;
+#endif
+
       // Store the vectors to successive memory locations in a temporary.
       tree elt_type = TREE_TYPE(TREE_TYPE(op0));
       Type *EltTy = ConvertType(elt_type);
@@ -8781,7 +11999,7 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
                                     , NULL
 #endif
                                     );
-      AllocaInst *Tmp = CreateTemporary(TmpTy, Align);
+      AllocaInst *Tmp = CreateScratchTemporary(TmpTy, Align);
       // Store the first vector to the first element of the pair.
       Value *Tmp0 =
           Builder.CreateStructGEP(
@@ -8820,6 +12038,91 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
     }
 #endif
 
+#if (GCC_MAJOR > 6)
+    Value *TreeToLLVM::EmitReg_BIT_INSERT_EXPR(tree op0, tree op1, tree op2) {
+      Value *Container = EmitRegister(op0);
+      Value *Val = EmitRegister(op1);
+      unsigned BitStart = (unsigned) TREE_INT_CST_LOW(op2);
+
+      if (VectorType *VecTy = dyn_cast<VectorType>(Container->getType())) {
+        // Inserting the elements of a vector at a multiple of the element size.
+        Type *EltTy = VecTy->getElementType();
+        unsigned First = BitStart / DL.getTypeSizeInBits(EltTy);
+        VectorType *ValTy = dyn_cast<VectorType>(Val->getType());
+        if (!ValTy)
+          return Builder.CreateInsertElement(
+              Container, Builder.CreateBitCast(Val, EltTy),
+              Builder.getInt32(First));
+        // Widen the inserted vector to the length of the container, then
+        // blend the two.
+        unsigned NumElts = VecTy->getNumElements();
+        unsigned NumValElts = ValTy->getNumElements();
+        Val = Builder.CreateBitCast(Val, VectorType::get(EltTy, NumValElts));
+        SmallVector<Constant *, 16> Widen, Blend;
+        for (unsigned i = 0; i != NumElts; ++i) {
+          Widen.push_back(i < NumValElts ? Builder.getInt32(i)
+                                         : UndefValue::get(Builder.getInt32Ty()));
+          Blend.push_back(Builder.getInt32(
+              i >= First && i < First + NumValElts ? NumElts + i - First : i));
+        }
+        Val = Builder.CreateShuffleVector(Val, UndefValue::get(Val->getType()),
+                                          ConstantVector::get(Widen));
+        return Builder.CreateShuffleVector(Container, Val,
+                                           ConstantVector::get(Blend));
+      }
+
+      // Inserting bits into an integer, counting from the least significant bit.
+      IntegerType *IntTy = cast<IntegerType>(Container->getType());
+      unsigned BitSize = DL.getTypeSizeInBits(Val->getType());
+      if (isa<INTEGRAL_TYPE>(TREE_TYPE(op1)))
+        BitSize = TYPE_PRECISION(TREE_TYPE(op1));
+      Val = Builder.CreateBitCast(
+          Val, Builder.getIntNTy(DL.getTypeSizeInBits(Val->getType())));
+      Val = Builder.CreateZExtOrTrunc(Val, Builder.getIntNTy(BitSize));
+      Val = Builder.CreateShl(Builder.CreateZExt(Val, IntTy), BitStart);
+      APInt Mask = APInt::getBitsSet(IntTy->getBitWidth(), BitStart,
+                                     BitStart + BitSize);
+      Container = Builder.CreateAnd(Container, ConstantInt::get(IntTy, ~Mask));
+      return Builder.CreateOr(Container, Val);
+    }
+#endif
+
+    Value *TreeToLLVM::EmitReg_BIT_FIELD_REF(tree exp) {
+      tree vec = TREE_OPERAND(exp, 0);
+      if (!isa<VECTOR_TYPE>(TREE_TYPE(vec)) ||
+          (!isa<SSA_NAME>(vec) && !isa<VECTOR_CST>(vec)))
+        return 0;
+
+      VectorType *VecTy = cast<VectorType>(getRegType(TREE_TYPE(vec)));
+      Type *EltTy = VecTy->getElementType();
+      Type *ResTy = getRegType(TREE_TYPE(exp));
+      if (EltTy->isPointerTy() || ResTy->isPointerTy())
+        return 0;
+      unsigned EltBits = DL.getTypeSizeInBits(EltTy);
+      unsigned BitStart = (unsigned) TREE_INT_CST_LOW(TREE_OPERAND(exp, 2));
+      unsigned BitSize = (unsigned) TREE_INT_CST_LOW(TREE_OPERAND(exp, 1));
+      if (EltBits != DL.getTypeAllocSizeInBits(EltTy) || BitStart % EltBits ||
+          BitSize % EltBits || DL.getTypeSizeInBits(ResTy) != BitSize)
+        return 0;
+      unsigned First = BitStart / EltBits;
+      unsigned NumElts = BitSize / EltBits;
+      if (First + NumElts > VecTy->getNumElements())
+        return 0;
+
+      Value *Vec = EmitRegister(vec);
+      Value *Res;
+      if (NumElts == 1) {
+        Res = Builder.CreateExtractElement(Vec, Builder.getInt32(First));
+      } else {
+        SmallVector<Constant *, 16> Mask;
+        for (unsigned i = 0; i != NumElts; ++i)
+          Mask.push_back(Builder.getInt32(First + i));
+        Res = Builder.CreateShuffleVector(Vec, UndefValue::get(VecTy),
+                                          ConstantVector::get(Mask));
+      }
+      return Builder.CreateBitCast(Res, ResTy);
+    }
+
 #if GCC_VERSION_CODE > GCC_VERSION(4, 5)
     Value *TreeToLLVM::EmitReg_FMA_EXPR(tree op0, tree op1, tree op2) {
       Value *V0 = EmitRegister(op0);
@@ -8878,6 +12181,38 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       return Builder.CreateMul(Lo0, Lo1);
     }
 
+#if GCC_VERSION_CODE > GCC_VERSION(4, 7)
+    /// EmitReg_VecWidenMultEvenOddExpr - Multiply the elements of op0 and op1
+    /// with even (First is 0) or odd (First is 1) indices, giving results twice
+    /// as wide.  The extended operands are what the x86 code generator turns
+    /// into pmuldq/pmuludq, and the ARM one into vmull.
+    Value *TreeToLLVM::EmitReg_VecWidenMultEvenOddExpr(tree type, tree op0,
+                                                      tree op1,
+                                                      unsigned First) {
+      // Eg: <2 x i64> = VEC_WIDEN_MULT_EVEN_EXPR(<4 x i32>, <4 x i32>)
+      Value *LHS = EmitRegister(op0);
+      Value *RHS = EmitRegister(op1);
+      unsigned Length = (unsigned) TYPE_VECTOR_SUBPARTS(TREE_TYPE(op0));
+      SmallVector<Constant *, 16> Mask;
+      Mask.reserve(Length / 2);
+      for (unsigned i = First; i < Length; i += 2)
+        Mask.push_back(Builder.getInt32(i));
+      Value *UndefVec = UndefValue::get(LHS->getType());
+      LHS = Builder.CreateShuffleVector(LHS, UndefVec,
+                                        ConstantVector::get(Mask));
+      RHS = Builder.CreateShuffleVector(RHS, UndefVec,
+                                        ConstantVector::get(Mask));
+
+      // Extend to the output element type, eg: <2 x i32> -> <2 x i64>.
+      Type *DestTy = getRegType(type);
+      LHS = CastToAnyType(LHS, !TYPE_UNSIGNED(TREE_TYPE(TREE_TYPE(op0))),
+                          DestTy, !TYPE_UNSIGNED(TREE_TYPE(type)));
+      RHS = CastToAnyType(RHS, !TYPE_UNSIGNED(TREE_TYPE(TREE_TYPE(op1))),
+                          DestTy, !TYPE_UNSIGNED(TREE_TYPE(type)));
+      return Builder.CreateMul(LHS, RHS);
+    }
+#endif
+
     Value *TreeToLLVM::EmitReg_WIDEN_MULT_EXPR(tree type, tree op0, tree op1) {
       Value *LHS = EmitRegisterWithCast(op0, type);
       Value *RHS = EmitRegisterWithCast(op1, type);
@@ -8924,7 +12259,7 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       //                 : "r0", "r1", "r2", "r3", "r4", "r5");
       // The clobbers turn up as "r5", "r4", "r3", "r2", "r1", "r0".
 
-      // Here is an example of the "asm goto" construct (not yet supported by LLVM):
+      // Here is an example of the "asm goto" construct:
       //   int frob(int x) {
       //     int y;
       //     asm goto ("frob %%r5, %1; jc %l[error]; mov (%2), %%r5"
@@ -8936,17 +12271,28 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       // The number of labels, one in this case, is returned by gimple_asm_nlabels.
       // The labels themselves are returned by gimple_asm_label_op as a TREE_LIST
       // node with TREE_PURPOSE a string constant holding the label name ("error")
-      // and TREE_VALUE holding the appropriate LABEL_DECL.
-
-      // TODO: Add support for labels.
-      if (gimple_asm_nlabels(MIG_TO_GASM(stmt)) > 0) {
-        sorry("'asm goto' not supported");
-        return;
-      }
+      // and TREE_VALUE holding the appropriate LABEL_DECL.  The asm becomes an
+      // LLVM callbr that either falls through or jumps to one of the labels, which
+      // are passed to it as block addresses so that %l0 and friends can print them.
 
       const unsigned NumOutputs = gimple_asm_noutputs(MIG_TO_GASM(stmt));
       const unsigned NumInputs = gimple_asm_ninputs(MIG_TO_GASM(stmt));
       const unsigned NumClobbers = gimple_asm_nclobbers(MIG_TO_GASM(stmt));
+      const unsigned NumLabels = gimple_asm_nlabels(MIG_TO_GASM(stmt));
+
+#if LLVM_VERSION_CODE > LLVM_VERSION(8, 0)
+      // LLVM only makes the results of a callbr available on the fall through
+      // path, while GCC also makes them available at the labels.
+      if (NumLabels && NumOutputs) {
+        sorry("'asm goto' with outputs not supported");
+        return;
+      }
+#else
+      if (NumLabels) {
+        sorry("'asm goto' not supported by this version of LLVM");
+        return;
+      }
+#endif
 
       /// Constraints - The output/input constraints, concatenated together in array
       /// form instead of list form.  This way of doing things is forced on us by
@@ -9414,6 +12760,16 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
 #endif
       }
 
+      // Process labels.
+      SmallVector<BasicBlock *, 4> LabelBlocks;
+      for (unsigned i = 0; i != NumLabels; ++i) {
+        tree Label = TREE_VALUE(gimple_asm_label_op(MIG_TO_GASM(stmt), i));
+        BasicBlock *Dest = getLabelDeclBlock(Label);
+        LabelBlocks.push_back(Dest);
+        CallOps.push_back(BlockAddress::get(Fn, Dest));
+        ConstraintStr += ",X";
+      }
+
       // Process clobbers.
 
       // Some targets automatically clobber registers across an asm.
@@ -9563,23 +12919,27 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
         return;
       }
 
-      std::string NewAsmStr = ConvertInlineAsmStr(stmt, NumOutputs + NumInputs);
+      std::string NewAsmStr =
+          ConvertInlineAsmStr(stmt, NumOutputs + NumInputs + NumLabels);
       Value *Asm =
           InlineAsm::get(FTy, NewAsmStr, ConstraintStr, HasSideEffects);
+#if LLVM_VERSION_CODE > LLVM_VERSION(8, 0)
+      if (NumLabels) {
+        // The rest of the GCC basic block goes in a new block that the asm falls
+        // through to.
+        BasicBlock *FallThrough = BasicBlock::Create(Context);
+        CallBrInst *CBI = Builder.CreateCallBr(FTy, Asm, FallThrough,
+                                               LabelBlocks, CallOps);
+        CBI->setDoesNotThrow();
+        SetAsmLocation(CBI, stmt);
+        BeginBlock(FallThrough);
+        return;
+      }
+#endif
       CallInst *CV = Builder.CreateCall(
           Asm, CallOps, CallResultTypes.empty() ? "" : "asmtmp");
       CV->setDoesNotThrow();
-      if (gimple_has_location(stmt)) {
-        // Pass the location of the asm using a !srcloc metadata.
-        Constant *LocationCookie = Builder.getInt64(gimple_location(stmt));
-        CV->setMetadata("srcloc", MDNode::get(Context,
-#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
-                    ConstantAsMetadata::get(LocationCookie)
-#else
-                    LocationCookie
-#endif
-                    ));
-      }
+      SetAsmLocation(CV, stmt);
 
       // If the call produces a value, store it into the destination.
       for (unsigned i = 0, NumResults = (unsigned) CallResultTypes.size();
@@ -9632,18 +12992,12 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
         // saying that a RESULT_DECL is dead means we are dead - which is why we
         // don't even consider it.
         if (isa<PARM_DECL>(lhs) || isa<VAR_DECL>(lhs)) {
-          Value *LHSAddr =
-              Builder.CreateBitCast(DECL_LOCAL(lhs), Builder.getInt8PtrTy());
-          uint64_t LHSSize =
-              isInt64(DECL_SIZE(lhs), true) ? getInt64(DECL_SIZE(lhs), true) / 8
-                                            : ~0UL;
-          Function *EndIntr =
-              Intrinsic::getDeclaration(TheModule, Intrinsic::lifetime_end);
-#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
-          Builder.CreateCall(EndIntr, {Builder.getInt64(LHSSize), LHSAddr});
-#else
-          Builder.CreateCall2(EndIntr, Builder.getInt64(LHSSize), LHSAddr);
-#endif
+          // The size is left unspecified (-1) if it is not constant.
+          ConstantInt *LHSSize =
+              isInt64(DECL_SIZE(lhs), true)
+                  ? Builder.getInt64(getInt64(DECL_SIZE(lhs), true) / 8)
+                  : 0;
+          Builder.CreateLifetimeEnd(DECL_LOCAL(lhs), LHSSize);
         }
         return;
       }
@@ -9662,6 +13016,14 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
 
     void TreeToLLVM::RenderGIMPLE_CALL(GimpleTy *stmt) {
       tree lhs = gimple_call_lhs(stmt);
+#if GCC_VERSION_CODE > GCC_VERSION(4, 6)
+      if (gimple_call_internal_p(stmt)) {
+        Value *Result = EmitInternalCall(stmt);
+        if (Result)
+          WriteScalarToLHS(lhs, Result);
+        return;
+      }
+#endif
       if (!lhs) {
         // The returned value is not used.
         if (!isa<AGGREGATE_TYPE>(gimple_call_return_type(MIG_TO_GCALL(stmt)))) {
@@ -9697,8 +13059,49 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       BasicBlock *IfTrue = getBasicBlock(true_edge->dest);
       BasicBlock *IfFalse = getBasicBlock(false_edge->dest);
 
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 5)
+      // If one way leads straight to __builtin_unreachable then the condition
+      // always goes the other way.  Say so with an assumption: LLVM does not
+      // always work this out from the unreachable in time to use it, e.g. for
+      // the trip count or alignment when vectorizing.
+      if (optimize) {
+        bool TrueUnreachable = isUnreachableBlock(true_edge->dest);
+        bool FalseUnreachable = isUnreachableBlock(false_edge->dest);
+        if (TrueUnreachable != FalseUnreachable)
+          Builder.CreateCall(
+              Intrinsic::getDeclaration(TheModule, Intrinsic::assume),
+              TrueUnreachable ? Builder.CreateNot(Cond) : Cond);
+      }
+#endif
+
+      // Say how often each way was taken, if known.
+      MDNode *Weights = 0;
+      if (hasProfileCounts()) {
+        uint64_t Counts[] = { getEdgeCount(true_edge),
+                              getEdgeCount(false_edge) };
+        Weights = createBranchWeights(Fn->getContext(), Counts);
+      } else if (hasGuessedProbabilities()) {
+        // Otherwise say how likely GCC thinks each way is.  When GCC has no
+        // preference leave it to the LLVM heuristics.
+        uint64_t Probs[] = { getEdgeProbability(true_edge),
+                             getEdgeProbability(false_edge) };
+        if (Probs[0] != Probs[1])
+          Weights = createBranchWeights(Fn->getContext(), Probs);
+      } else {
+        // Otherwise, if one way only leads to a failed check, such as an Ada
+        // range or overflow check, say that it is cold so that the check costs
+        // little more than the comparison in the hot path.
+        bool TrueFails = isCheckFailureBlock(true_edge->dest);
+        bool FalseFails = isCheckFailureBlock(false_edge->dest);
+        if (TrueFails != FalseFails) {
+          uint64_t Probs[] = { TrueFails ? 0 : REG_BR_PROB_BASE,
+                               FalseFails ? 0 : REG_BR_PROB_BASE };
+          Weights = createBranchWeights(Fn->getContext(), Probs);
+        }
+      }
+
       // Branch based on the condition.
-      Builder.CreateCondBr(Cond, IfTrue, IfFalse);
+      Builder.CreateCondBr(Cond, IfTrue, IfFalse, Weights);
     }
 
     void TreeToLLVM::RenderGIMPLE_EH_DISPATCH(GimpleTy *stmt) {
@@ -9903,16 +13306,10 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
         }
       }
 
-      LLVMContext &Context =
-#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
-          TheModule->getContext();
-#else
-          TheContext;
-#endif
       // Emit a branch to the exit label.
       if (!ReturnBB)
         // Create a new block for the return node, but don't insert it yet.
-        ReturnBB = BasicBlock::Create(Context, "return");
+        ReturnBB = CreateNamedBlock("return");
 
       Builder.CreateBr(ReturnBB);
     }
@@ -9928,7 +13325,18 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
           Builder.CreateSwitch(Index, getLabelDeclBlock(default_label),
                                gimple_switch_num_labels(MIG_TO_GSWITCH(stmt)));
 
-      // Add the switch cases.
+      // Add the switch cases.  Ranges are added as one case per value, which
+      // the code generator puts back together into range, bit test and jump
+      // table clusters as it sees fit; that is better than anything that can be
+      // done by hand here.  Only ranges that would add too many cases are
+      // output as an "if" instead.
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 6)
+      const uint64_t MaxCasesPerRange = 1024, MaxCasesFromRanges = 4096;
+#else
+      // Code generators from before case clustering get the old limit.
+      const uint64_t MaxCasesPerRange = 64, MaxCasesFromRanges = ~0ULL;
+#endif
+      uint64_t CasesFromRanges = 0;
       BasicBlock *IfBlock = 0; // Set if a range was output as an "if".
       for (unsigned i = 1, e = gimple_switch_num_labels(MIG_TO_GSWITCH(stmt)); i != e; ++i) {
         tree label = gimple_switch_label(MIG_TO_GSWITCH(stmt), i);
@@ -9955,8 +13363,11 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
 #else
             TheContext;
 #endif
-        if (Range.ult(APInt(Range.getBitWidth(), 64))) {
+        uint64_t NumCases = Range.getLimitedValue(MaxCasesPerRange) + 1;
+        if (NumCases <= MaxCasesPerRange &&
+            NumCases <= MaxCasesFromRanges - CasesFromRanges) {
           // Add all of the necessary successors to the switch.
+          CasesFromRanges += NumCases;
           APInt CurrentValue = LowC->getValue();
           while (1) {
             SI->addCase(LowC, Dest);
@@ -9983,6 +13394,25 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       if (IfBlock) {
         Builder.CreateBr(SI->getDefaultDest());
         SI->setDefaultDest(IfBlock);
+      } else if (hasProfileCounts()) {
+        // Say how often each case was taken, if known.  The profile only has a
+        // count for each destination block, so share it out evenly between the
+        // cases going there.
+        DenseMap<BasicBlock *, uint64_t> DestCounts;
+        edge e;
+        edge_iterator ei;
+        FOR_EACH_EDGE(e, ei, gimple_bb(stmt)->succs)
+          DestCounts[getBasicBlock(e->dest)] += getEdgeCount(e);
+        DenseMap<BasicBlock *, unsigned> DestUses;
+        for (unsigned i = 0, n = SI->getNumSuccessors(); i != n; ++i)
+          ++DestUses[SI->getSuccessor(i)];
+        SmallVector<uint64_t, 16> Counts;
+        for (unsigned i = 0, n = SI->getNumSuccessors(); i != n; ++i) {
+          BasicBlock *Dest = SI->getSuccessor(i);
+          Counts.push_back(DestCounts.lookup(Dest) / DestUses[Dest]);
+        }
+        if (MDNode *Weights = createBranchWeights(Fn->getContext(), Counts))
+          SI->setMetadata(LLVMContext::MD_prof, Weights);
       }
     }
 
@@ -10118,6 +13548,8 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       case RDIV_EXPR:
         RHS = EmitReg_RDIV_EXPR(rhs1, rhs2);
         break;
+#if (GCC_MAJOR < 8)
+      // Since GCC 8 these are the internal functions IFN_REDUC_*.
       case REDUC_MAX_EXPR:
         RHS = EmitReg_ReducMinMaxExpr(rhs1, ICmpInst::ICMP_UGE,
                                       ICmpInst::ICMP_SGE, FCmpInst::FCMP_OGE);
@@ -10129,6 +13561,7 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       case REDUC_PLUS_EXPR:
         RHS = EmitReg_REDUC_PLUS_EXPR(rhs1);
         break;
+#endif
       case ROUND_DIV_EXPR:
         RHS = EmitReg_ROUND_DIV_EXPR(rhs1, rhs2);
         break;
@@ -10198,6 +13631,14 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       case VEC_WIDEN_MULT_LO_EXPR:
         RHS = EmitReg_VEC_WIDEN_MULT_LO_EXPR(type, rhs1, rhs2);
         break;
+#if GCC_VERSION_CODE > GCC_VERSION(4, 7)
+      case VEC_WIDEN_MULT_EVEN_EXPR:
+        RHS = EmitReg_VecWidenMultEvenOddExpr(type, rhs1, rhs2, 0);
+        break;
+      case VEC_WIDEN_MULT_ODD_EXPR:
+        RHS = EmitReg_VecWidenMultEvenOddExpr(type, rhs1, rhs2, 1);
+        break;
+#endif
       case WIDEN_MULT_EXPR:
         RHS = EmitReg_WIDEN_MULT_EXPR(type, rhs1, rhs2);
         break;
@@ -10216,6 +13657,11 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       case VEC_PERM_EXPR:
         RHS = EmitReg_VEC_PERM_EXPR(rhs1, rhs2, rhs3);
         break;
+#endif
+#if (GCC_MAJOR > 6)
+      case BIT_INSERT_EXPR:
+        RHS = EmitReg_BIT_INSERT_EXPR(rhs1, rhs2, rhs3);
+        break;
 #endif
       }
 
@@ -10250,9 +13696,13 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
                                        : EmitCONSTRUCTOR(rhs, 0);
 
         // References (tcc_reference).
+      case BIT_FIELD_REF:
+        // Vector elements are extracted without going through memory.
+        if (Value *Elts = EmitReg_BIT_FIELD_REF(rhs))
+          return Elts;
+        return EmitLoadOfLValue(rhs); // Load from memory.
       case ARRAY_REF:
       case ARRAY_RANGE_REF:
-      case BIT_FIELD_REF:
       case COMPONENT_REF:
       case IMAGPART_EXPR:
       case INDIRECT_REF:
@@ -10279,6 +13729,101 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       }
     }
 
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+    /// getVTablePointer - If the address called by a virtual call was loaded
+    /// from a virtual table, return the SSA name holding the virtual table
+    /// pointer it was loaded with.  Otherwise return null.
+    static tree getVTablePointer(tree fn) {
+      // The address is loaded from a slot in the virtual table...
+      if (!isa<SSA_NAME>(fn))
+        return NULL_TREE;
+      GimpleTy *stmt = SSA_NAME_DEF_STMT(fn);
+      if (!is_gimple_assign(stmt) || !gimple_assign_single_p(stmt) ||
+          !isa<MEM_REF>(gimple_assign_rhs1(stmt)))
+        return NULL_TREE;
+      tree ptr = TREE_OPERAND(gimple_assign_rhs1(stmt), 0);
+      if (!isa<SSA_NAME>(ptr))
+        return NULL_TREE;
+      stmt = SSA_NAME_DEF_STMT(ptr);
+      // ... possibly found by adding an offset to the virtual table pointer...
+      if (is_gimple_assign(stmt) &&
+          gimple_assign_rhs_code(stmt) == POINTER_PLUS_EXPR) {
+        ptr = gimple_assign_rhs1(stmt);
+        if (!isa<SSA_NAME>(ptr))
+          return NULL_TREE;
+        stmt = SSA_NAME_DEF_STMT(ptr);
+      }
+      // ... which is loaded from the object.
+      if (!is_gimple_assign(stmt) || !gimple_assign_single_p(stmt) ||
+          !isa<COMPONENT_REF>(gimple_assign_rhs1(stmt)) ||
+          !DECL_VIRTUAL_P(TREE_OPERAND(gimple_assign_rhs1(stmt), 1)))
+        return NULL_TREE;
+      return ptr;
+    }
+
+    /// EmitTypeTest - Tell LLVM that the virtual table pointer used by the given
+    /// virtual call points into a virtual table of the class being called, so
+    /// that whole program devirtualization can turn the call into a direct one.
+    void TreeToLLVM::EmitTypeTest(tree call_expr) {
+      tree vptr = getVTablePointer(OBJ_TYPE_REF_EXPR(call_expr));
+      if (!vptr)
+        return;
+      // The class is that of the method called.
+      tree fntype = TREE_TYPE(TREE_TYPE(call_expr));
+      if (!isa<METHOD_TYPE>(fntype))
+        return;
+      Metadata *TypeId = getVTableTypeId(TYPE_METHOD_BASETYPE(fntype));
+      if (!TypeId)
+        return;
+      LLVMContext &Context = TheModule->getContext();
+      Value *VTable = Builder.CreateBitCast(EmitRegister(vptr),
+                                            Type::getInt8PtrTy(Context));
+      Value *Test = Builder.CreateCall(
+          Intrinsic::getDeclaration(TheModule, Intrinsic::type_test),
+          { VTable, MetadataAsValue::get(Context, TypeId) });
+      Builder.CreateCall(
+          Intrinsic::getDeclaration(TheModule, Intrinsic::assume), Test);
+    }
+#endif
+
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 5)
+    /// EmitAlignmentAssumption - If the type of the function called says how
+    /// the pointer it returns is aligned, using the assume_aligned or alloc_align
+    /// attributes, then tell LLVM.  Only constant alignments are used.
+    static void EmitAlignmentAssumption(GimpleTy *stmt, tree fntype, Value *Ptr,
+                                        LLVMBuilder &Builder) {
+      uint64_t Align = 0, Misalign = 0;
+      if (tree attr =
+              lookup_attribute("assume_aligned", TYPE_ATTRIBUTES(fntype))) {
+        tree args = TREE_VALUE(attr);
+        if (args && isInt64(TREE_VALUE(args), true)) {
+          Align = getInt64(TREE_VALUE(args), true);
+          if (TREE_CHAIN(args) && isInt64(TREE_VALUE(TREE_CHAIN(args)), true))
+            Misalign = getInt64(TREE_VALUE(TREE_CHAIN(args)), true);
+        }
+      } else if (tree attr =
+                     lookup_attribute("alloc_align", TYPE_ATTRIBUTES(fntype))) {
+        // The alignment is given by one of the arguments.
+        tree args = TREE_VALUE(attr);
+        if (args && isInt64(TREE_VALUE(args), true)) {
+          uint64_t ArgNo = getInt64(TREE_VALUE(args), true);
+          if (ArgNo >= 1 && ArgNo <= gimple_call_num_args(MIG_TO_GCALL(stmt))) {
+            tree arg = gimple_call_arg(MIG_TO_GCALL(stmt), ArgNo - 1);
+            if (isInt64(arg, true))
+              Align = getInt64(arg, true);
+          }
+        }
+      }
+      if (Align <= 1 || (Align & (Align - 1)) || Misalign >= Align)
+        return;
+      const DataLayout &DL = getDataLayout();
+      Builder.CreateAlignmentAssumption(
+          DL, Ptr, Align,
+          Misalign ? ConstantInt::get(DL.getIntPtrType(Ptr->getType()),
+                                      Misalign) : 0);
+    }
+#endif
+
     /// OutputCallRHS - Convert the RHS of a GIMPLE_CALL.
     Value *TreeToLLVM::OutputCallRHS(GimpleTy *stmt, const MemRef * DestLoc) {
       // Check for a built-in function call.  If we can lower it directly, do so
@@ -10287,10 +13832,20 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       if (fndecl && DECL_BUILT_IN(fndecl) &&
           DECL_BUILT_IN_CLASS(fndecl) != BUILT_IN_FRONTEND) {
         Value *Res = 0;
-        if (EmitBuiltinCall(stmt, fndecl, DestLoc, Res))
+        if (EmitBuiltinCall(stmt, fndecl, DestLoc, Res)) {
+          ++ConvStats.BuiltinsLowered;
           return Res ? Mem2Reg(Res, gimple_call_return_type(MIG_TO_GCALL(stmt)), Builder) : 0;
+        }
+        ++ConvStats.BuiltinsCalled;
       }
 
+#if (GCC_MAJOR > 4)
+      // Call a nested function directly rather than through a trampoline that
+      // is only used for calling it.
+      if (!fndecl && RedirectTrampolineCall(MIG_TO_GCALL(stmt)))
+        fndecl = gimple_call_fndecl(stmt);
+#endif
+
       tree call_expr = gimple_call_fn(MIG_TO_GCALL(stmt));
       assert(TREE_TYPE(call_expr) &&
              (isa<POINTER_TYPE>(TREE_TYPE(call_expr)) ||
@@ -10301,6 +13856,10 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
       tree function_type = TREE_TYPE(TREE_TYPE(call_expr));
 #else
       tree function_type = gimple_call_fntype(stmt);
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+      if (flag_whole_program_vtables && isa<OBJ_TYPE_REF>(call_expr))
+        EmitTypeTest(call_expr);
 #endif
       Value *Callee = EmitRegister(call_expr);
       CallingConv::ID CallingConv;
@@ -10331,6 +13890,13 @@ bool TreeToLLVM::EmitBuiltinCall(GimpleTy *stmt, tree fndecl,
 
       Value *Result = EmitCallOf(Callee, stmt, DestLoc, PAL);
 
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 5)
+      if (Result && Result->getType()->isPointerTy() &&
+          isa<ACCESS_TYPE>(gimple_call_return_type(MIG_TO_GCALL(stmt))) &&
+          !(gimple_call_flags(stmt) & ECF_NORETURN))
+        EmitAlignmentAssumption(stmt, function_type, Result, Builder);
+#endif
+
       // When calling a "noreturn" function output an unreachable instruction right
       // after the function to prevent LLVM from thinking that control flow will
       // fall into the subsequent block.
@@ -10377,7 +13943,7 @@ void TreeToLLVM::WriteScalarToLHS(tree lhs, Value * RHS) {
   // TODO: Arrange for Volatile to already be set in the LValue.
   if (!LV.isBitfield()) {
     // Non-bitfield, scalar value.  Just emit a store.
-    StoreRegisterToMemory(RHS, LV, type, describeAliasSet(lhs), Builder);
+    StoreRegisterToMemory(RHS, LV, type, describeAccess(lhs), Builder);
     return;
   }
 
@@ -10386,7 +13952,8 @@ void TreeToLLVM::WriteScalarToLHS(tree lhs, Value * RHS) {
   if (!LV.BitSize)
     return;
 
-  // Load and store the minimum number of bytes that covers the field.
+  // Load and store the minimum number of bytes that covers the field, unless
+  // told how much to access.
   unsigned LoadSizeInBits = LV.BitStart + LV.BitSize;
   LoadSizeInBits =
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
@@ -10394,6 +13961,8 @@ void TreeToLLVM::WriteScalarToLHS(tree lhs, Value * RHS) {
 #else
       (unsigned) RoundUpToAlignment(LoadSizeInBits, BITS_PER_UNIT);
 #endif
+  if (LV.AccessSize)
+    LoadSizeInBits = LV.AccessSize;
   LLVMContext &Context =
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
       RHS->getType()->getContext();
@@ -10403,7 +13972,8 @@ void TreeToLLVM::WriteScalarToLHS(tree lhs, Value * RHS) {
   Type *LoadType = IntegerType::get(Context, LoadSizeInBits);
 
   // Load the existing bits.
-  Value *Ptr = Builder.CreateBitCast(LV.Ptr, LoadType->getPointerTo());
+  Value *Ptr =
+      Builder.CreateBitCast(LV.Ptr, getPointerInSameSpace(LoadType, LV.Ptr));
   Value *Val =
       Builder.CreateAlignedLoad(Ptr, LV.getAlignment(), LV.Volatile);
 
@@ -10421,7 +13991,7 @@ void TreeToLLVM::WriteScalarToLHS(tree lhs, Value * RHS) {
   // and the integer version of RHS.
   unsigned Alignment = std::max(TYPE_ALIGN(type) / 8,
                                 DL.getPrefTypeAlignment(TmpType));
-  Value *Tmp = CreateTemporary(TmpType, Alignment);
+  Value *Tmp = CreateScratchTemporary(TmpType, Alignment);
 
   // Store the right-hand side to it.  Ensure that any extra bits turn up in the
   // high bits of the integer loaded out below.
@@ -213,10 +213,43 @@ static StringRef getLinkageName(tree Node) {
   return StringRef();
 }
 
-DebugInfo::DebugInfo(Module *m)
+/// getTypeIdentifier - Return the ODR identifier for a C++ struct, class or
+/// union with linkage, or the empty string if it has none.  The identifier is
+/// the mangled name of the type's typeinfo name, as used by clang, and is what
+/// lets the code generator move the type into a DWARF type unit that the
+/// linker can deduplicate.  Only computed under -fdebug-types-section.
+static std::string getTypeIdentifier(tree type) {
+#if (GCC_MAJOR > 4) && LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  if (!flag_debug_types_section || dwarf_version < 4)
+    return std::string();
+  if (strcmp(lang_hooks.name, "GNU C++") != 0)
+    return std::string();
+  if (type != TYPE_MAIN_VARIANT(type))
+    return std::string();
+  // Anonymous and function-local types and types in anonymous namespaces
+  // are different in every translation unit, so must not be merged.
+  tree Name = TYPE_NAME(type);
+  if (!Name || !isa<TYPE_DECL>(Name) || !DECL_NAME(Name) ||
+      DECL_IGNORED_P(Name) || !TREE_PUBLIC(Name) ||
+      decl_function_context(Name) || type_in_anonymous_namespace_p(type))
+    return std::string();
+  tree Mangled = DECL_ASSEMBLER_NAME(Name);
+  if (!Mangled || Mangled == DECL_NAME(Name))
+    return std::string();
+  return std::string("_ZTS") + IDENTIFIER_POINTER(Mangled);
+#else
+  (void)type;
+  return std::string();
+#endif
+}
+
+DebugInfo::DebugInfo(Module *m, bool LocationsOnly)
     : M(*m), VMContext(M.getContext()), Builder(M), DeclareFn(0),
-    ValueFn(0), CurFullPath(""), PrevFullPath(""), CurLineNo(0), PrevLineNo(0),
-    PrevBB(NULL) {}
+    ValueFn(0), CurFullPath(""), CurFileID(0), PrevFileID(0), CurLineNo(0),
+    PrevLineNo(0), CurColumnNo(0), PrevColumnNo(0), CurBlock(NULL),
+    PrevBlock(NULL), PrevBB(NULL),
+    LineTablesOnly(LocationsOnly || debug_info_level <= DINFO_LEVEL_TERSE),
+    LocationsOnly(LocationsOnly) {}
 
 /// getFunctionName - Get function name for the given FnDecl. If the
 /// name is constructred on demand (e.g. C++ destructor) then the name
@@ -237,13 +270,40 @@ StringRef DebugInfo::getFunctionName(tree FnDecl) {
   return StringRef(StrPtr);
 }
 
+/// reserveCaches - Make room in the caches for the debug info of roughly the
+/// given number of declarations, so they do not keep growing.
+void DebugInfo::reserveCaches(unsigned NumDecls) {
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 6)
+  // Each declaration usually has a type of its own once pointer, reference and
+  // function types are counted, and each function a subprogram and a region.
+  TypeCache.reserve(NumDecls);
+  SPCache.reserve(NumDecls);
+  RegionMap.reserve(NumDecls);
+#else
+  (void)NumDecls;
+#endif
+}
+
+DebugInfoStatistics DebugInfo::getStatistics() const {
+  DebugInfoStatistics Stats;
+  Stats.Types = TypeCache.size();
+  Stats.Subprograms = SPCache.size() + InlinedSPCache.size();
+  Stats.Scopes = RegionMap.size() + NameSpaceCache.size() +
+                 InlineScopeCache.size();
+  Stats.Variables = VarCache.size();
+  Stats.Locations = LocCache.size();
+  Stats.Files = FileCache.size() + FileIDs.size();
+  return Stats;
+}
+
 /// EmitFunctionStart - Constructs the debug code for entering a function.
 void DebugInfo::EmitFunctionStart(tree FnDecl, Function *Fn) {
-  MigDIType FNType = getOrCreateType(TREE_TYPE(FnDecl));
+  MigDIType FNType = LineTablesOnly ? createOpaqueFunctionType()
+                                    : getOrCreateType(TREE_TYPE(FnDecl));
 
   unsigned lineno = CurLineNo;
 
-  std::map<tree_node *, MigTrackingMDRefType>::iterator I = SPCache.find(FnDecl);
+  TreeMDMap::iterator I = SPCache.find(FnDecl);
   if (I != SPCache.end()) {
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
     DISubprogram *SPDecl = llvm::getDISubprogram(cast<MDNode>(I->second));
@@ -255,6 +315,7 @@ void DebugInfo::EmitFunctionStart(tree FnDecl, Function *Fn) {
 
     // Push function on region stack.
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+    Fn->setSubprogram(SP);
     RegionStack.push_back(SP);
     RegionMap[FnDecl].reset(SP);
 #else
@@ -271,8 +332,10 @@ void DebugInfo::EmitFunctionStart(tree FnDecl, Function *Fn) {
       DECL_ABSTRACT_ORIGIN(FnDecl) != FnDecl)
     ArtificialFnWithAbstractOrigin = true;
 
+  // Line tables have no use for the enclosing classes and namespaces, and
+  // describing them would drag in their types.
   MigDIScope SPContext =
-      ArtificialFnWithAbstractOrigin ?
+      (ArtificialFnWithAbstractOrigin || LineTablesOnly) ?
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
       dyn_cast_or_null<DIScope>(getOrCreateFile(main_input_filename))
 #else
@@ -294,6 +357,7 @@ void DebugInfo::EmitFunctionStart(tree FnDecl, Function *Fn) {
 
     // Push function on region stack.
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+    Fn->setSubprogram(SP);
     RegionStack.push_back(SP);
     RegionMap[FnDecl].reset(SP);
 #else
@@ -310,7 +374,7 @@ void DebugInfo::EmitFunctionStart(tree FnDecl, Function *Fn) {
   unsigned Virtuality = 0;
   unsigned VIndex = 0;
   MigDIType ContainingType;
-  if (DECL_VINDEX(FnDecl) && DECL_CONTEXT(FnDecl) &&
+  if (!LineTablesOnly && DECL_VINDEX(FnDecl) && DECL_CONTEXT(FnDecl) &&
       isa<TYPE>((DECL_CONTEXT(FnDecl)))) { // Workaround GCC PR42653
 #if GCC_VERSION_CODE > GCC_VERSION(4, 8)
     if (tree_fits_uhwi_p(DECL_VINDEX(FnDecl)))
@@ -333,6 +397,7 @@ void DebugInfo::EmitFunctionStart(tree FnDecl, Function *Fn) {
 
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
   SPCache[FnDecl].reset(SP);
+  Fn->setSubprogram(SP);
 
   // Push function on region stack.
   RegionStack.push_back(SP);
@@ -346,7 +411,7 @@ void DebugInfo::EmitFunctionStart(tree FnDecl, Function *Fn) {
 
 /// getOrCreateNameSpace - Get name space descriptor for the tree node.
 MigDINamespace DebugInfo::getOrCreateNameSpace(tree Node, MigDIScope Context) {
-  std::map<tree_node *, MigTrackingMDRefType>::iterator I = NameSpaceCache.find(Node);
+  TreeMDMap::iterator I = NameSpaceCache.find(Node);
   if (I != NameSpaceCache.end())
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
     return dyn_cast_or_null<DINamespace>(cast<MDNode>(I->second));
@@ -383,7 +448,7 @@ MigDIScope DebugInfo::findRegion(tree Node) {
     return getOrCreateFile(main_input_filename);
 #endif
 
-  std::map<tree_node *, MigTrackingMDRefType>::iterator I = RegionMap.find(Node);
+  TreeMDMap::iterator I = RegionMap.find(Node);
   if (I != RegionMap.end())
     if (MDNode *R = cast<MDNode>(&*I->second))
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
@@ -401,6 +466,15 @@ MigDIScope DebugInfo::findRegion(tree Node) {
 #endif
   } else if (DECL_P(Node)) {
     if (isa<NAMESPACE_DECL>(Node)) {
+      // Look in the cache before resolving the enclosing scopes, otherwise
+      // every lookup walks all the way out through the nested namespaces.
+      TreeMDMap::iterator NI = NameSpaceCache.find(Node);
+      if (NI != NameSpaceCache.end())
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+        return dyn_cast_or_null<DIScope>(cast<MDNode>(NI->second));
+#else
+        return DIDescriptor(cast<MDNode>(NI->second));
+#endif
       MigDIScope NSContext = findRegion(DECL_CONTEXT(Node));
       MigDINamespace NS = getOrCreateNameSpace(Node, NSContext);
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
@@ -429,7 +503,12 @@ void DebugInfo::EmitFunctionEnd(bool EndFunction) {
   if (EndFunction) {
     PrevBB = NULL;
     PrevLineNo = 0;
-    PrevFullPath = NULL;
+    PrevColumnNo = 0;
+    PrevFileID = 0;
+    PrevBlock = NULL;
+    LocCache.clear();
+    VarCache.clear();
+    InlineScopeCache.clear();
   }
 }
 
@@ -438,7 +517,7 @@ void DebugInfo::EmitDeclare(tree decl, unsigned Tag, StringRef Name, tree type,
                             Value *AI, LLVMBuilder &IRBuilder) {
 
   // Ignore compiler generated temporaries.
-  if (DECL_IGNORED_P(decl))
+  if (DECL_IGNORED_P(decl) || LineTablesOnly)
     return;
 
   assert(!RegionStack.empty() && "Region stack mismatch, stack empty!");
@@ -485,30 +564,218 @@ void DebugInfo::EmitDeclare(tree decl, unsigned Tag, StringRef Name, tree type,
   Call->setDebugLoc(DebugLoc::get(Loc.line, 0, VarScope));
 }
 
+/// EmitValue - Constructs the debug code for a new value of a variable that
+/// is kept in registers.  Unlike with EmitDeclare there is no memory to point
+/// at, so each definition says what the variable holds from there on.
+void DebugInfo::EmitValue(tree decl, Value *V, LLVMBuilder &IRBuilder) {
+  if (DECL_IGNORED_P(decl) || !DECL_NAME(decl) || LineTablesOnly)
+    return;
+  if (RegionStack.empty() || !IRBuilder.GetInsertBlock())
+    return;
+
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  DIScope *VarScope =
+      dyn_cast_or_null<DIScope>(cast<MDNode>(RegionStack.back()));
+  llvm::DILocalVariable *D;
+#else
+  DIScope VarScope = DIScope(cast<MDNode>(RegionStack.back()));
+  llvm::DIVariable D;
+#endif
+
+  // Every version of the variable must refer to the same descriptor.
+  TreeMDMap::iterator I = VarCache.find(decl);
+  if (I != VarCache.end()) {
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+    D = dyn_cast_or_null<DILocalVariable>(cast<MDNode>(I->second));
+#else
+    D = DIVariable(cast<MDNode>(I->second));
+#endif
+  } else {
+    MigDIType Ty = getOrCreateType(TREE_TYPE(decl));
+    // If type info is not available then do not emit debug info for this var.
+    if (!Ty)
+      return;
+    expanded_location Loc = GetNodeLocation(decl, false);
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+    D = Builder.createAutoVariable(VarScope, GetNodeName(decl),
+                                   getOrCreateFile(Loc.file), Loc.line, Ty,
+                                   optimize);
+    VarCache[decl].reset(D);
+#else
+    D = Builder.createLocalVariable(dwarf::DW_TAG_auto_variable, VarScope,
+                                    GetNodeName(decl),
+                                    getOrCreateFile(Loc.file), Loc.line, Ty,
+                                    optimize);
+    VarCache[decl] = WeakVH(D);
+#endif
+  }
+
+  DebugLoc DL = DebugLoc::get(CurLineNo, CurColumnNo, VarScope);
+  Instruction *Call = Builder.insertDbgValueIntrinsic(
+      V,
+#if LLVM_VERSION_CODE < LLVM_VERSION(6, 0)
+      0,
+#endif
+      D,
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 3)
+      Builder.createExpression(),
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+      DL,
+#endif
+      IRBuilder.GetInsertBlock());
+  Call->setDebugLoc(DL);
+}
+
+/// setLocationFile - Set the file of the current source location.  Files are
+/// numbered so that EmitStopPoint need not compare names.
+void DebugInfo::setLocationFile(const char *FullPath) {
+  if (FullPath == CurFullPath)
+    return;
+  CurFullPath = FullPath;
+  if (!FullPath || !FullPath[0]) {
+    CurFileID = 0;
+    return;
+  }
+  // The same name usually comes back at the same address.
+  unsigned &ID = FileIDsByPointer[FullPath];
+  if (!ID) {
+    unsigned &Interned = FileIDs[FullPath];
+    if (!Interned)
+      Interned = FileIDs.size();
+    ID = Interned;
+  }
+  CurFileID = ID;
+}
+
+/// setLocationColumn - Set the column of the current source location.
+void DebugInfo::setLocationColumn(int ColumnNo) {
+#if (GCC_MAJOR > 7)
+  // Honour -gno-column-info.
+  if (!debug_column_info)
+    ColumnNo = 0;
+#endif
+  CurColumnNo = ColumnNo;
+}
+
 /// EmitStopPoint - Set current source location.
 void DebugInfo::EmitStopPoint(BasicBlock *CurBB, LLVMBuilder &Builder) {
   // Don't bother if things are the same as last time.
-  if (PrevLineNo == CurLineNo && PrevBB == CurBB &&
-      (PrevFullPath == CurFullPath || !strcmp(PrevFullPath, CurFullPath)))
+  if (PrevLineNo == CurLineNo && PrevColumnNo == CurColumnNo &&
+      PrevBB == CurBB && PrevFileID == CurFileID && PrevBlock == CurBlock)
     return;
-  if (!CurFullPath[0] || CurLineNo == 0)
+  if (!CurFileID || CurLineNo == 0)
     return;
 
   // Update last state.
-  PrevFullPath = CurFullPath;
+  PrevFileID = CurFileID;
   PrevLineNo = CurLineNo;
+  PrevColumnNo = CurColumnNo;
+  PrevBlock = CurBlock;
   PrevBB = CurBB;
 
   if (RegionStack.empty())
     return;
   MDNode *Scope = cast<MDNode>(RegionStack.back());
-  Builder.SetCurrentDebugLocation(DebugLoc::get(CurLineNo, 0 /*col*/, Scope));
+  MDNode *InlinedAt = 0;
+  if (CurBlock)
+    getBlockScope(CurBlock, Scope, InlinedAt);
+  LocKeyType Key(std::make_pair(Scope, InlinedAt),
+                 (uint64_t(CurLineNo) << 32) | unsigned(CurColumnNo));
+  LocCacheType::iterator I = LocCache.find(Key);
+  if (I == LocCache.end())
+    I = LocCache.insert(std::make_pair(
+        Key, DebugLoc::get(CurLineNo, CurColumnNo, Scope, InlinedAt))).first;
+  Builder.SetCurrentDebugLocation(I->second);
+}
+
+/// getBlockScope - Work out the scope of code in the given BLOCK, and the
+/// location it was inlined at if GCC's inliner put it there.  The body of an
+/// inlined function hangs off a BLOCK whose abstract origin is the function
+/// and whose source location is the call.  So the scope is the subprogram
+/// of the innermost such BLOCK, and the inlined-at location the call,
+/// itself placed in the scope of the BLOCKs further out.
+void DebugInfo::getBlockScope(tree Block, MDNode *&Scope, MDNode *&InlinedAt) {
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  while (Block && isa<BLOCK>(Block) && !inlined_function_outer_scope_p(Block))
+    Block = BLOCK_SUPERCONTEXT(Block);
+  if (!Block || !isa<BLOCK>(Block))
+    return; // Not inlined: the scope is the function itself.
+
+  InlineScopeMap::iterator I = InlineScopeCache.find(Block);
+  if (I != InlineScopeCache.end()) {
+    Scope = I->second.first;
+    InlinedAt = I->second.second;
+    return;
+  }
+
+  tree Origin = block_ultimate_origin(Block);
+  if (!Origin || !isa<FUNCTION_DECL>(Origin)) {
+    getBlockScope(BLOCK_SUPERCONTEXT(Block), Scope, InlinedAt);
+    return;
+  }
+
+  // The call is in the scope of whatever encloses the inlined body.
+  MDNode *CallScope = Scope, *CallInlinedAt = InlinedAt;
+  getBlockScope(BLOCK_SUPERCONTEXT(Block), CallScope, CallInlinedAt);
+  expanded_location CallLoc = expand_location(BLOCK_SOURCE_LOCATION(Block));
+  unsigned CallColumn = CallLoc.column;
+#if (GCC_MAJOR > 7)
+  if (!debug_column_info)
+    CallColumn = 0;
+#endif
+  Scope = getInlinedSubprogram(Origin);
+  InlinedAt = DILocation::get(VMContext, CallLoc.line, CallColumn, CallScope,
+                              CallInlinedAt);
+  InlineScopeCache[Block] = std::make_pair(Scope, InlinedAt);
+#else
+  // Older LLVM only gets the flattened locations.
+  (void)Block;
+  (void)Scope;
+  (void)InlinedAt;
+#endif
+}
+
+/// getInlinedSubprogram - Get the subprogram used as the scope of the body of
+/// the given function where it has been inlined.  That is the function's own
+/// subprogram if it has been output already.
+MigDISubprogram DebugInfo::getInlinedSubprogram(tree FnDecl) {
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  TreeMDMap::iterator I = SPCache.find(FnDecl);
+  if (I != SPCache.end())
+    if (DISubprogram *SP =
+            dyn_cast_or_null<DISubprogram>(cast<MDNode>(I->second)))
+      if (SP->isDefinition())
+        return SP;
+  I = InlinedSPCache.find(FnDecl);
+  if (I != InlinedSPCache.end())
+    return dyn_cast_or_null<DISubprogram>(cast<MDNode>(I->second));
+
+  expanded_location Loc = GetNodeLocation(FnDecl, false);
+  StringRef FnName = getFunctionName(FnDecl);
+  MigDIScope SPContext =
+      LineTablesOnly ?
+      dyn_cast_or_null<DIScope>(getOrCreateFile(main_input_filename)) :
+      findRegion(DECL_CONTEXT(FnDecl));
+  MigDIType FNType = LineTablesOnly ? createOpaqueFunctionType()
+                                    : getOrCreateType(TREE_TYPE(FnDecl));
+  MigDISubprogram SP = CreateSubprogram(
+      SPContext, FnName, FnName, getLinkageName(FnDecl),
+      getOrCreateFile(Loc.file), Loc.line, FNType, !TREE_PUBLIC(FnDecl),
+      true /*definition*/, nullptr, 0, 0, DECL_ARTIFICIAL(FnDecl), optimize,
+      nullptr);
+  InlinedSPCache[FnDecl].reset(SP);
+  return SP;
+#else
+  (void)FnDecl;
+  return MigDISubprogram();
+#endif
 }
 
 /// EmitGlobalVariable - Emit information about a global variable.
 ///
 void DebugInfo::EmitGlobalVariable(GlobalVariable *GV, tree decl) {
-  if (DECL_ARTIFICIAL(decl) || DECL_IGNORED_P(decl))
+  if (DECL_ARTIFICIAL(decl) || DECL_IGNORED_P(decl) || LineTablesOnly)
     return;
   // Gather location information.
   expanded_location Loc = expand_location(DECL_SOURCE_LOCATION(decl));
@@ -672,7 +939,7 @@ MigDIType DebugInfo::createMethodType(tree type) {
 #endif
 
   RegionStack.pop_back();
-  std::map<tree_node *, MigTrackingMDRefType>::iterator RI = RegionMap.find(type);
+  TreeMDMap::iterator RI = RegionMap.find(type);
   if (RI != RegionMap.end())
     RegionMap.erase(RI);
 
@@ -832,6 +1099,27 @@ MigDIType DebugInfo::createEnumType(tree type) {
       EltArray);
 }
 
+/// createOpaqueFunctionType - Create a function type with no result or
+/// argument types.  Identical types are uniqued, so this need not be cached.
+MigDIType DebugInfo::createOpaqueFunctionType() {
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  llvm::SmallVector<Metadata*, 1>
+#else
+  llvm::SmallVector<Value*, 1>
+#endif
+      EltTys;
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  return Builder.createSubroutineType(
+      Builder.getOrCreateTypeArray(makeArrayRef(EltTys)));
+#elif LLVM_VERSION_CODE > LLVM_VERSION(3, 3)
+  return Builder.createSubroutineType(getOrCreateFile(main_input_filename),
+                                      Builder.getOrCreateTypeArray(EltTys));
+#else
+  return Builder.createSubroutineType(getOrCreateFile(main_input_filename),
+                                      Builder.getOrCreateArray(EltTys));
+#endif
+}
+
 /// createStructType - Create StructType for struct or union or class.
 MigDIType DebugInfo::createStructType(tree type) {
 
@@ -873,7 +1161,7 @@ MigDIType DebugInfo::createStructType(tree type) {
   // Check if this type is created while creating context information
   // descriptor.
   {
-    std::map<tree_node *, MigTrackingMDRefType>::iterator I = TypeCache.find(type);
+    TreeMDMap::iterator I = TypeCache.find(type);
     if (I != TypeCache.end())
       if (MDNode *TN = cast<MDNode>(&*I->second))
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
@@ -959,25 +1247,20 @@ MigDIType DebugInfo::createStructType(tree type) {
     }
   }
 
-  // Now add members of this class.
-  for (tree Member = TYPE_FIELDS(type); Member; Member = TREE_CHAIN(Member)) {
+  // Now add members of this class.  Only fields are wanted: static variables
+  // get their debug info when emitted through EmitGlobalVariable().
+  // FIXME: fields with variable or humongous offset are not in the record
+  // layout, so are skipped for now.
+  ArrayRef<FieldLayout> Fields = getRecordLayout(type);
+  for (unsigned i = 0, e = Fields.size(); i != e; ++i) {
+    tree Member = Fields[i].Field;
     // Should we skip.
-    if (DECL_P(Member) && DECL_IGNORED_P(Member))
+    if (DECL_IGNORED_P(Member))
       continue;
 
     // Get the location of the member.
     expanded_location MemLoc = GetNodeLocation(Member, false);
 
-    if (!isa<FIELD_DECL>(Member))
-      // otherwise is a static variable, whose debug info is emitted
-      // when through EmitGlobalVariable().
-      continue;
-
-    if (!OffsetIsLLVMCompatible(Member))
-      // FIXME: field with variable or humongous offset.
-      // Skip it for now.
-      continue;
-
     /* Ignore nameless fields.  */
     if (DECL_NAME(Member) == NULL_TREE &&
         !isa<RECORD_OR_UNION_TYPE>(TREE_TYPE(Member)))
@@ -996,7 +1279,7 @@ MigDIType DebugInfo::createStructType(tree type) {
     MigDIType DTy = CreateDerivedType(
         DW_TAG_member, findRegion(DECL_CONTEXT(Member)), MemberName,
         getOrCreateFile(MemLoc.file), MemLoc.line, NodeSizeInBits(Member),
-        NodeAlignInBits(FieldNodeType), int_bit_position(Member), MFlags,
+        NodeAlignInBits(FieldNodeType), Fields[i].FirstBit, MFlags,
         MemberType);
     EltTys.push_back(DTy);
   }
@@ -1018,7 +1301,7 @@ MigDIType DebugInfo::createStructType(tree type) {
     if (DECL_P(Member) && DECL_IGNORED_P(Member))
       continue;
 
-    std::map<tree_node *, MigTrackingMDRefType>::iterator I = SPCache.find(Member);
+    TreeMDMap::iterator I = SPCache.find(Member);
     if (I != SPCache.end())
       EltTys.push_back(
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
@@ -1064,7 +1347,7 @@ MigDIType DebugInfo::createStructType(tree type) {
   MigDINodeArray Elements = Builder.getOrCreateArray(EltTys);
 
   RegionStack.pop_back();
-  std::map<tree_node *, MigTrackingMDRefType>::iterator RI = RegionMap.find(type);
+  TreeMDMap::iterator RI = RegionMap.find(type);
   if (RI != RegionMap.end())
     RegionMap.erase(RI);
 
@@ -1083,7 +1366,7 @@ MigDIType DebugInfo::createStructType(tree type) {
       llvm::DIType(),
 #endif
       Elements, RunTimeLang,
-      ContainingType);
+      ContainingType, getTypeIdentifier(type));
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
   RegionMap[type].reset(RealDecl);
 #else
@@ -1105,7 +1388,7 @@ MigDIType DebugInfo::createStructType(tree type) {
 MigDIType DebugInfo::createVariantType(tree type, MigDIType MainTy) {
   MigDIType Ty;
   if (tree TyDef = TYPE_NAME(type)) {
-    std::map<tree_node *, MigTrackingMDRefType>::iterator I = TypeCache.find(TyDef);
+    TreeMDMap::iterator I = TypeCache.find(TyDef);
     if (I != TypeCache.end())
       if (I->second)
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
@@ -1173,7 +1456,7 @@ MigDIType DebugInfo::getOrCreateType(tree type) {
 #endif
 
   // Check to see if the compile unit already has created this type.
-  std::map<tree_node *, MigTrackingMDRefType>::iterator I = TypeCache.find(type);
+  TreeMDMap::iterator I = TypeCache.find(type);
   if (I != TypeCache.end())
     if (I->second)
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
@@ -1265,6 +1548,12 @@ void DebugInfo::Initialize() {
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 3)
   M.addModuleFlag(llvm::Module::Error, "Debug Info Version",
                   llvm::DEBUG_METADATA_VERSION);
+#endif
+#if (GCC_MAJOR > 4) && LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  // Type units only exist from DWARF 4 on, so make sure the code generator
+  // emits at least the version GCC was asked for.
+  if (flag_debug_types_section && dwarf_version >= 4)
+    M.addModuleFlag(llvm::Module::Warning, "Dwarf Version", dwarf_version);
 #endif
   // Each input file is encoded as a separate compile unit in LLVM
   // debugging information output. However, many target specific tool chains
@@ -1319,27 +1608,69 @@ void DebugInfo::getOrCreateCompileUnit(const char *FullPath, bool isMain) {
   unsigned ObjcRunTimeVer = 0;
   //  if (flag_objc_abi != 0 && flag_objc_abi != -1)
   //    ObjcRunTimeVer = flag_objc_abi;
+
+  // With -gsplit-dwarf the compile unit in the object is only a skeleton that
+  // names the .dwo file holding the rest.  GCC's driver extracts the .dwo
+  // sections into that file once the object has been assembled.
+  std::string SplitName;
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 3) && \
+    GCC_VERSION_CODE > GCC_VERSION(4, 7)
+  if (dwarf_split_debug_info)
+    SplitName = std::string(aux_base_name ? aux_base_name : dump_base_name) +
+                ".dwo";
+#endif
+
   Builder.createCompileUnit(LangTag,
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 9)
                             Builder.createFile(FileName, Directory),
 #else
                             FileName, Directory,
 #endif
-                            version_string, optimize, Flags, ObjcRunTimeVer);
+                            version_string, optimize, Flags, ObjcRunTimeVer
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 3)
+                            , SplitName
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+                            , LocationsOnly ? DICompileUnit::NoDebug
+                            : LineTablesOnly ? DICompileUnit::LineTablesOnly
+                                             : DICompileUnit::FullDebug
+#elif LLVM_VERSION_CODE > LLVM_VERSION(3, 5)
+                            , LineTablesOnly ? DIBuilder::LineTablesOnly
+                                             : DIBuilder::FullDebug
+#endif
+                            );
 }
 
 /// getOrCreateFile - Get DIFile descriptor.
 MigDIFile DebugInfo::getOrCreateFile(const char *FullPath) {
   if (!FullPath)
     FullPath = main_input_filename;
-  if (!strcmp(FullPath, ""))
-    FullPath = "<stdin>";
+
+  // GCC hands out the same pointer for the same file, main_input_filename in
+  // particular being asked for by every scope at file level.
+  FileMDMap::iterator I = FileCache.find(FullPath);
+  if (I != FileCache.end())
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+    return cast<DIFile>(cast<MDNode>(I->second));
+#else
+    return DIFile(cast<MDNode>(I->second));
+#endif
+
+  const char *Path = FullPath;
+  if (!strcmp(Path, ""))
+    Path = "<stdin>";
 
   // Get source file information.
   std::string Directory;
   std::string FileName;
-  DirectoryAndFile(FullPath, Directory, FileName);
-  return Builder.createFile(FileName, Directory);
+  DirectoryAndFile(Path, Directory, FileName);
+  MigDIFile F = Builder.createFile(FileName, Directory);
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  FileCache[FullPath].reset(F);
+#else
+  FileCache[FullPath] = WeakVH(F);
+#endif
+  return F;
 }
 
 //===----------------------------------------------------------------------===//
@@ -1406,7 +1737,8 @@ MigDICompositeType DebugInfo::CreateCompositeType(
     unsigned Tag, MigDIScope Context, StringRef Name, MigDIFile F,
     unsigned LineNumber, uint64_t SizeInBits, uint64_t AlignInBits,
     uint64_t OffsetInBits, unsigned Flags, MigDIType DerivedFrom,
-    MigDINodeArray Elements, unsigned RuntimeLang, MDNode *ContainingType) {
+    MigDINodeArray Elements, unsigned RuntimeLang, MDNode *ContainingType,
+    StringRef UniqueIdentifier) {
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 9)
   DINode::DIFlags MigFlags = DINode::FlagZero;
 #else
@@ -1423,7 +1755,8 @@ MigDICompositeType DebugInfo::CreateCompositeType(
                                     DerivedFrom, Elements,
                                     0,
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
-                                    dyn_cast_or_null<DIType>(ContainingType)
+                                    dyn_cast_or_null<DIType>(ContainingType),
+                                    UniqueIdentifier
 #else
                                     DIType(ContainingType)
 #endif
@@ -1432,7 +1765,11 @@ MigDICompositeType DebugInfo::CreateCompositeType(
     return Builder.createUnionType(Context, Name, F, LineNumber, SizeInBits,
                                    AlignInBits,
                                    MigFlags,
-                                   Elements, RuntimeLang);
+                                   Elements, RuntimeLang
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+                                   , UniqueIdentifier
+#endif
+                                   );
   case dwarf::DW_TAG_enumeration_type:
     return Builder.createEnumerationType(Context, Name, F, LineNumber,
                                          SizeInBits, AlignInBits, Elements,
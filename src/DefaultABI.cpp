@@ -24,6 +24,7 @@
 #include "dragonegg/ABI.h"
 
 // LLVM headers
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/IR/Module.h"
 
 // System headers
@@ -177,7 +178,8 @@ void DefaultABI::HandleReturnType(tree type, tree fn, bool isBuiltin) {
               LLVM_AGGR_TYPE_FOR_STRUCT_RETURN(type, C.getCallingConv()))
         C.HandleAggregateResultAsAggregate(AggrTy);
       else if (Type *ScalarTy =
-                   LLVM_SCALAR_TYPE_FOR_STRUCT_RETURN(type, &Offset))
+                   LLVM_SCALAR_TYPE_FOR_STRUCT_RETURN(type, &Offset,
+                                                      C.getCallingConv()))
         C.HandleAggregateResultAsScalar(ScalarTy, Offset);
       else
         llvm_unreachable("Unable to determine how to return this aggregate!");
@@ -200,14 +202,103 @@ void DefaultABI::HandleReturnType(tree type, tree fn, bool isBuiltin) {
 /// argument and invokes methods on the client that indicate how its pieces
 /// should be handled.  This handles things like decimating structures into
 /// their fields.
+namespace {
+/// ArgumentPlan - How an aggregate argument that the target does not pass in
+/// some custom way is to be passed.  Working this out walks the type, often
+/// several times over, so the answer is remembered for each type.
+struct ArgumentPlan {
+  enum PlanKind {
+    Scalar,      // Pass as a single value.
+    FCA,         // Pass as a first class aggregate.
+    MixedRegs,   // Pass in the registers Elts, unless they have run out.
+    ByVal,       // Pass in memory, using a byval pointer.
+    IntegerRegs, // Pass in integer registers (Size, DontCheckAlignment).
+    ZeroSized,   // Drop it.
+    Elements     // Pass each element in turn.
+  } Kind;
+  std::vector<Type *> Elts;
+  unsigned Size;
+  bool DontCheckAlignment;
+  bool EltsMatchType; // MixedRegs with Elts exactly the elements of the type.
+};
+}
+
+/// ArgumentPlans - The plan for each type and calling convention.
+static DenseMap<std::pair<tree, unsigned>, ArgumentPlan> ArgumentPlans;
+
+void flushArgumentPlans() { ArgumentPlans.clear(); }
+
+/// FlattenAggregate - Append the scalars and vectors making up a value of type
+/// Ty to Elts, in the order the code generator assigns them registers.
+static void FlattenAggregate(Type *Ty, std::vector<Type *> &Elts) {
+  if (StructType *STy = llvm::dyn_cast<StructType>(Ty)) {
+    for (unsigned i = 0, e = STy->getNumElements(); i != e; ++i)
+      FlattenAggregate(STy->getElementType(i), Elts);
+  } else if (ArrayType *ATy = llvm::dyn_cast<ArrayType>(Ty)) {
+    for (uint64_t i = 0, e = ATy->getNumElements(); i != e; ++i)
+      FlattenAggregate(ATy->getElementType(), Elts);
+  } else {
+    Elts.push_back(Ty);
+  }
+}
+
+/// ComputeArgumentPlan - Ask the target how to pass an aggregate argument of
+/// the given type, which was converted to Ty.
+static void ComputeArgumentPlan(tree type, Type *Ty, CallingConv::ID CC,
+                                ArgumentPlan &Plan) {
+  (void) CC; // Not used by all ABI macros.
+  Plan.Size = 0;
+  Plan.DontCheckAlignment = false;
+  Plan.EltsMatchType = false;
+  if (Ty->isSingleValueType())
+    Plan.Kind = ArgumentPlan::Scalar;
+  else if (LLVM_SHOULD_PASS_AGGREGATE_AS_FCA(type, Ty))
+    Plan.Kind = ArgumentPlan::FCA;
+  else if (LLVM_SHOULD_PASS_AGGREGATE_IN_MIXED_REGS(type, Ty, CC, Plan.Elts)) {
+    Plan.Kind = ArgumentPlan::MixedRegs;
+    // If the registers hold the fields of the aggregate one for one then the
+    // aggregate itself can be passed, with no need to go through memory.  The
+    // code generator splits it into the same registers.
+    std::vector<Type *> Fields;
+    FlattenAggregate(Ty, Fields);
+    StructType *STy = llvm::dyn_cast<StructType>(Ty);
+    Plan.EltsMatchType = STy && !STy->isPacked() && Fields == Plan.Elts;
+  } else if (LLVM_SHOULD_PASS_AGGREGATE_USING_BYVAL_ATTR(type, Ty))
+    Plan.Kind = ArgumentPlan::ByVal;
+  else if (LLVM_SHOULD_PASS_AGGREGATE_IN_INTEGER_REGS(
+               type, &Plan.Size, &Plan.DontCheckAlignment))
+    Plan.Kind = ArgumentPlan::IntegerRegs;
+  else if (isZeroSizedStructOrUnion(type))
+    Plan.Kind = ArgumentPlan::ZeroSized;
+  else
+    Plan.Kind = ArgumentPlan::Elements;
+}
+
+/// getArgumentPlan - Return in Plan how to pass an aggregate argument of the
+/// given type, which was converted to Ty.
+static void getArgumentPlan(tree type, Type *Ty, CallingConv::ID CC,
+                            ArgumentPlan &Plan) {
+  // While a type cycle is being converted the LLVM type may be a placeholder,
+  // which would give the wrong answer for later queries.
+  if (!Ty->isSized()) {
+    ComputeArgumentPlan(type, Ty, CC, Plan);
+    return;
+  }
+
+  std::pair<tree, unsigned> Key(type, CC);
+  DenseMap<std::pair<tree, unsigned>, ArgumentPlan>::iterator I =
+      ArgumentPlans.find(Key);
+  if (I == ArgumentPlans.end()) {
+    ComputeArgumentPlan(type, Ty, CC, Plan);
+    ArgumentPlans[Key] = Plan;
+  } else {
+    Plan = I->second;
+  }
+}
+
 void DefaultABI::HandleArgument(tree type, std::vector<Type *> &ScalarElts,
                                 AttrBuilder *AttrBuilder) {
-  unsigned Size = 0;
-  bool DontCheckAlignment = false;
   Type *Ty = ConvertType(type);
-  // Figure out if this field is zero bits wide, e.g. {} or [0 x int].  Do
-  // not include variable sized fields here.
-  std::vector<Type *> Elts;
   if (Ty->isVoidTy()) {
     // Handle void explicitly as a {} type.
     Type *OpTy = StructType::get(
@@ -239,36 +330,58 @@ void DefaultABI::HandleArgument(tree type, std::vector<Type *> &ScalarElts,
   } else if (LLVM_TRY_PASS_AGGREGATE_CUSTOM(type, ScalarElts,
                                             C.getCallingConv(), &C)) {
     // Nothing to do.
-  } else if (Ty->isSingleValueType()) {
-    C.HandleScalarArgument(Ty, type);
-    ScalarElts.push_back(Ty);
-  } else if (LLVM_SHOULD_PASS_AGGREGATE_AS_FCA(type, Ty)) {
-    C.HandleFCAArgument(Ty, type);
-  } else if (LLVM_SHOULD_PASS_AGGREGATE_IN_MIXED_REGS(
-                 type, Ty, C.getCallingConv(), Elts)) {
-    if (!LLVM_AGGREGATE_PARTIALLY_PASSED_IN_REGS(
-            Elts, ScalarElts, C.isShadowReturn(), C.getCallingConv()))
-      PassInMixedRegisters(Ty, Elts, ScalarElts);
-    else {
+  } else {
+    ArgumentPlan Plan;
+    getArgumentPlan(type, Ty, C.getCallingConv(), Plan);
+    switch (Plan.Kind) {
+    case ArgumentPlan::Scalar:
+      C.HandleScalarArgument(Ty, type);
+      ScalarElts.push_back(Ty);
+      break;
+    case ArgumentPlan::FCA:
+      C.HandleFCAArgument(Ty, type);
+      break;
+    case ArgumentPlan::MixedRegs:
+      // Whether there are enough registers left depends on the arguments that
+      // came before, so this part cannot be remembered.
+      if (!LLVM_AGGREGATE_PARTIALLY_PASSED_IN_REGS(
+              Plan.Elts, ScalarElts, C.isShadowReturn(), C.getCallingConv())) {
+        if (Plan.EltsMatchType) {
+          C.HandleFCAArgument(Ty, type);
+          ScalarElts.insert(ScalarElts.end(), Plan.Elts.begin(),
+                            Plan.Elts.end());
+        } else {
+          PassInMixedRegisters(Ty, Plan.Elts, ScalarElts);
+        }
+        break;
+      }
+      // Otherwise pass it in memory.
+    case ArgumentPlan::ByVal:
       C.HandleByValArgument(Ty, type);
       if (AttrBuilder) {
         AttrBuilder->addAttribute(Attribute::ByVal);
         AttrBuilder->addAlignmentAttr(LLVM_BYVAL_ALIGNMENT(type));
       }
+      break;
+    case ArgumentPlan::IntegerRegs:
+      PassInIntegerRegisters(type, ScalarElts, Plan.Size,
+                             Plan.DontCheckAlignment);
+      break;
+    case ArgumentPlan::ZeroSized:
+      // Zero sized struct or union, just drop it!
+      break;
+    case ArgumentPlan::Elements:
+      HandleArgumentElements(type, Ty, ScalarElts);
+      break;
     }
-  } else if (LLVM_SHOULD_PASS_AGGREGATE_USING_BYVAL_ATTR(type, Ty)) {
-    C.HandleByValArgument(Ty, type);
-    if (AttrBuilder) {
-      AttrBuilder->addAttribute(Attribute::ByVal);
-      AttrBuilder->addAlignmentAttr(LLVM_BYVAL_ALIGNMENT(type));
-    }
-  } else if (LLVM_SHOULD_PASS_AGGREGATE_IN_INTEGER_REGS(type, &Size,
-                                                        &DontCheckAlignment)) {
-    PassInIntegerRegisters(type, ScalarElts, Size, DontCheckAlignment);
-  } else if (isZeroSizedStructOrUnion(type)) {
-    // Zero sized struct or union, just drop it!
-    ;
-  } else if (isa<RECORD_TYPE>(type)) {
+  }
+}
+
+/// HandleArgumentElements - Pass each element of the given aggregate, which
+/// was converted to Ty, as if it were a separate argument.
+void DefaultABI::HandleArgumentElements(tree type, Type *Ty,
+                                        std::vector<Type *> &ScalarElts) {
+  if (isa<RECORD_TYPE>(type)) {
     for (tree Field = TYPE_FIELDS(type); Field; Field = TREE_CHAIN(Field))
       if (isa<FIELD_DECL>(Field)) {
         const tree Ftype = TREE_TYPE(Field);
@@ -26,6 +26,7 @@
 
 // System headers
 #include <gmp.h>
+#include <map>
 
 // GCC headers
 #include "auto-host.h"
@@ -64,18 +65,24 @@ concatIfNotEmpty(const std::string &Left, const std::string &Right) {
 /// getAssemblerName - Return the name to use for the given tree, or an empty
 /// string if it does not have a name.  This is the official name that should
 /// be used for everything that will end up in the final assembler.
-std::string getAssemblerName(tree t) {
+StringRef getAssemblerName(tree t) {
   tree ident = DECL_ASSEMBLER_NAME(t);
   if (!ident)
     // Does not have a name.
-    return std::string();
+    return "";
 
-  // Replace any leading star by '\1'.
+  // Identifiers are never freed, so the name can usually be used as it is.
   const char *Name = IDENTIFIER_POINTER(ident);
   if (*Name != '*')
-    return std::string(Name, IDENTIFIER_LENGTH(ident));
-
-  return "\1" + std::string(Name + 1, IDENTIFIER_LENGTH(ident) - 1);
+    return StringRef(Name, IDENTIFIER_LENGTH(ident));
+
+  // Otherwise replace the leading star by '\1'.  The result is kept, since the
+  // same names are asked for over and over.
+  static std::map<tree, std::string> StarredNames;
+  std::string &Unstarred = StarredNames[ident];
+  if (Unstarred.empty())
+    Unstarred = "\1" + std::string(Name + 1, IDENTIFIER_LENGTH(ident) - 1);
+  return Unstarred;
 }
 
 /// getDescriptiveName - Return a helpful name for the given tree, or an empty
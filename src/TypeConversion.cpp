@@ -28,13 +28,16 @@
 #include "dragonegg/TypeConversion.h"
 
 // LLVM headers
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/IR/Module.h"
 
 // System headers
 #include <gmp.h>
 #include <map>
+#include <vector>
 
 // GCC headers
 #include "auto-host.h"
@@ -75,6 +78,21 @@ static LLVMContext &TheContext = getGlobalContext();
 /// SCCInProgress - Set of mutually dependent types currently being converted.
 static const std::vector<tree_node *> *SCCInProgress;
 
+/// FreshPlaceholder - If the record type being converted is all on its own in
+/// its strongly connected component, and no placeholder existed for it before,
+/// then its placeholder.  Nothing can refer to this placeholder yet.
+static Type *FreshPlaceholder;
+
+/// UniqueRecordTypes - Map from the layout of each converted record type, as a
+/// literal struct type, to the named struct type used for it.
+static DenseMap<StructType *, StructType *> UniqueRecordTypes;
+
+/// NumRecordTypesMerged - The number of record types that were given the LLVM
+/// type of an earlier record type with the same layout.
+static unsigned NumRecordTypesMerged;
+
+unsigned getNumRecordTypesMerged() { return NumRecordTypesMerged; }
+
 //===----------------------------------------------------------------------===//
 //                       ... ContainedTypeIterator ...
 //===----------------------------------------------------------------------===//
@@ -256,6 +274,72 @@ static int get_decl_index(tree t) {
   return -1;
 }
 
+/// RecordLayouts - The layout summaries computed by getRecordLayout.  A map is
+/// used so that the summary for one type is not moved by adding another.
+static std::map<tree, std::vector<FieldLayout> > RecordLayouts;
+
+ArrayRef<FieldLayout> getRecordLayout(tree type) {
+  assert(isa<RECORD_OR_UNION_TYPE>(type) && "Not a record or union type!");
+  assert(TYPE_SIZE(type) && "Layout of an incomplete type!");
+  std::map<tree, std::vector<FieldLayout> >::iterator I =
+      RecordLayouts.find(type);
+  if (I != RecordLayouts.end())
+    return I->second;
+
+  std::vector<FieldLayout> &Fields = RecordLayouts[type];
+  for (tree field = TYPE_FIELDS(type); field; field = TREE_CHAIN(field)) {
+    if (!isa<FIELD_DECL>(field))
+      continue;
+    // Ignore fields with variable or unknown position since they cannot be
+    // represented by the LLVM type system.
+    if (!OffsetIsLLVMCompatible(field))
+      continue;
+    FieldLayout L;
+    L.Field = field;
+    L.FirstBit = getFieldOffsetInBits(field);
+    L.BitWidth = isInt64(DECL_SIZE(field), true) ?
+                 getInt64(DECL_SIZE(field), true) : NO_LENGTH;
+    L.Bitfield = isBitfield(field);
+    Fields.push_back(L);
+  }
+  return Fields;
+}
+
+void flushRecordLayouts() { RecordLayouts.clear(); }
+
+/// SetFieldIndices - Work out the LLVM field index for every field of the given
+/// GCC record type, which was converted to the given LLVM struct type, while
+/// advancing through the struct layout only once.  This makes indexing all N
+/// fields O(N) rather than O(N log N).
+static void SetFieldIndices(tree type, StructType *STy) {
+  const StructLayout *SL = getDataLayout().getStructLayout(STy);
+  unsigned NumElements = STy->getNumElements();
+  unsigned Index = 0;
+  // Fields at a variable or humongous offset are not listed in the layout, so
+  // are left for GetFieldIndex to deal with.
+  ArrayRef<FieldLayout> Fields = getRecordLayout(type);
+  for (unsigned i = 0, e = Fields.size(); i != e; ++i) {
+    tree field = Fields[i].Field;
+    // Find the LLVM field that contains the first bit of the GCC field.  The
+    // fields usually come in order of increasing offset, so search forwards
+    // from the last one found, falling back to a binary search otherwise.
+    uint64_t OffsetInBytes = Fields[i].FirstBit / 8;
+    if (OffsetInBytes < SL->getElementOffset(Index))
+      Index = SL->getElementContainingOffset(OffsetInBytes);
+    else
+      while (Index + 1 < NumElements &&
+             SL->getElementOffset(Index + 1) <= OffsetInBytes)
+        ++Index;
+
+    // The GCC field must start in the first byte of the LLVM field, and the
+    // index must not be too big to cache.
+    if (OffsetInBytes != SL->getElementOffset(Index) || Index >= INT_MAX)
+      set_decl_index(field, INT_MAX);
+    else
+      set_decl_index(field, Index);
+  }
+}
+
 /// GetFieldIndex - Return the index of the field in the given LLVM type that
 /// corresponds to the GCC field declaration 'decl'.  This means that the LLVM
 /// and GCC fields start in the same byte (if 'decl' is a bitfield, this means
@@ -272,11 +356,6 @@ int GetFieldIndex(tree decl, Type *Ty) {
   if (Index <= INT_MAX)
     return Index;
 
-  // TODO: At this point we could process all fields of DECL_CONTEXT(decl), and
-  // incrementally advance over the StructLayout.  This would make indexing be
-  // O(N) rather than O(N log N) if all N fields are used.  It's not clear if it
-  // would really be a win though.
-
   StructType *STy = llvm::dyn_cast<StructType>(Ty);
   // If this is not a struct type, then for sure there is no corresponding LLVM
   // field (we do not require GCC record types to be converted to LLVM structs).
@@ -287,6 +366,17 @@ int GetFieldIndex(tree decl, Type *Ty) {
   if (STy->element_begin() == STy->element_end())
     return set_decl_index(decl, INT_MAX);
 
+  // Index all of the fields of the containing record at once, as long as it
+  // really is the record that was converted to Ty (see the FIXME above).
+  tree context = DECL_CONTEXT(decl);
+  if (context && isa<RECORD_OR_UNION_TYPE>(context) &&
+      getCachedType(context) == Ty) {
+    SetFieldIndices(context, STy);
+    Index = (unsigned) get_decl_index(decl);
+    if (Index <= INT_MAX)
+      return Index;
+  }
+
   // If the field declaration is at a variable or humongous offset then there
   // can be no corresponding LLVM field.
   if (!OffsetIsLLVMCompatible(decl))
@@ -310,9 +400,22 @@ int GetFieldIndex(tree decl, Type *Ty) {
   return set_decl_index(decl, Index);
 }
 
+// LLVM_ADDRESS_SPACE - Map a GCC address space number to the corresponding LLVM
+// address space.  By default they are numbered the same way.
+#ifndef LLVM_ADDRESS_SPACE
+#define LLVM_ADDRESS_SPACE(AS) (AS)
+#endif
+
+/// getAddressSpace - Returns the LLVM address space of memory holding a value
+/// of the given GCC type, which may be qualified with a named address space.
+unsigned getAddressSpace(tree type) {
+  return LLVM_ADDRESS_SPACE(TYPE_ADDR_SPACE(type));
+}
+
 /// getPointerToType - Returns the LLVM register type to use for a pointer to
-/// the given GCC type.
+/// the given GCC type.  The pointer is into the type's address space.
 Type *getPointerToType(tree type) {
+  unsigned AS = getAddressSpace(type);
   if (isa<VOID_TYPE>(type)) {
     // void* -> byte*
     LLVMContext &Context =
@@ -321,10 +424,9 @@ Type *getPointerToType(tree type) {
 #else
         TheContext;
 #endif
-    return GetUnitPointerType(Context);
+    return GetUnitPointerType(Context, AS);
   }
-  // FIXME: Handle address spaces.
-  return ConvertType(type)->getPointerTo();
+  return ConvertType(type)->getPointerTo(AS);
 }
 
 /// GetUnitType - Returns an integer one address unit wide if 'NumUnits' is 1;
@@ -410,6 +512,12 @@ static Type *CheckTypeConversion(tree type, Type *Ty) {
   return Ty;
 }
 
+// getTypeName - The name to give the LLVM struct type for a GCC type.  Nobody
+// sees it if value names are being discarded, so do not bother working it out.
+static std::string getTypeName(tree type) {
+  return flag_discard_value_names ? std::string() : getDescriptiveName(type);
+}
+
 // RememberTypeConversion - Associate an LLVM type with a GCC type.
 // These are lazily computed by ConvertType.
 static Type *RememberTypeConversion(tree type, Type *Ty) {
@@ -433,7 +541,8 @@ bool isPassedByInvisibleReference(tree Type) {
   // FIXME: Search for TREE_ADDRESSABLE in calls.c, and see if there are other
   // cases that make arguments automatically passed in by reference.
   return TREE_ADDRESSABLE(Type) || TYPE_SIZE(Type) == 0 ||
-         !isa<INTEGER_CST>(TYPE_SIZE(Type));
+         !isa<INTEGER_CST>(TYPE_SIZE(Type)) ||
+         LLVM_SHOULD_PASS_AGGREGATE_BY_REFERENCE(Type);
 }
 
 //===----------------------------------------------------------------------===//
@@ -497,7 +606,7 @@ Type *getRegType(tree type) {
   case POINTER_TYPE:
   case REFERENCE_TYPE: {
     // void* -> byte*
-    unsigned AS = TYPE_ADDR_SPACE(type);
+    unsigned AS = getAddressSpace(TREE_TYPE(type));
     return isa<VOID_TYPE>(TREE_TYPE(type))
            ? GetUnitPointerType(Context, AS)
            : ConvertType(TREE_TYPE(type))->getPointerTo(AS);
@@ -701,6 +810,62 @@ static void HandleArgumentExtension(tree ArgTy, AttrBuilder &AttrBuilder) {
   }
 }
 
+/// isNonNullArg - Whether a nonnull attribute on the given function type says
+/// that the argument with the given (one based) number cannot be null.
+static bool isNonNullArg(tree type, unsigned ArgNo) {
+  for (tree attr = lookup_attribute("nonnull", TYPE_ATTRIBUTES(type)); attr;
+       attr = lookup_attribute("nonnull", TREE_CHAIN(attr))) {
+    // With no argument numbers, every pointer argument is nonnull.
+    if (!TREE_VALUE(attr))
+      return true;
+    for (tree arg = TREE_VALUE(attr); arg; arg = TREE_CHAIN(arg))
+      if (isInt64(TREE_VALUE(arg), true) &&
+          getInt64(TREE_VALUE(arg), true) == ArgNo)
+        return true;
+  }
+  return false;
+}
+
+/// hasVirtualBases - Whether the given class has a virtual base.
+static bool hasVirtualBases(tree binfo) {
+  for (unsigned i = 0, e = BINFO_N_BASE_BINFOS(binfo); i != e; ++i)
+    if (BINFO_VIRTUAL_P(BINFO_BASE_BINFO(binfo, i)) ||
+        hasVirtualBases(BINFO_BASE_BINFO(binfo, i)))
+      return true;
+  return false;
+}
+
+/// HandlePointerAttributes - Mark a pointer argument or return value that
+/// cannot be null as nonnull.  C++ references, and the 'this' pointer of a
+/// method (IsThis), also get a dereferenceable attribute giving the size of
+/// the object.  NonNull says whether a GCC attribute marks the pointer nonnull.
+static void HandlePointerAttributes(tree PtrTy, bool NonNull, bool IsThis,
+                                    AttrBuilder &AttrBuilder) {
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 5)
+  if (!isa<ACCESS_TYPE>(PtrTy) ||
+      !ADDR_SPACE_GENERIC_P(TYPE_ADDR_SPACE(TREE_TYPE(PtrTy))))
+    return;
+  // References and 'this' are never null, unless null pointers are valid.
+  bool Dereferenceable = (isa<REFERENCE_TYPE>(PtrTy) || IsThis) &&
+                         flag_delete_null_pointer_checks;
+  if (!NonNull && !Dereferenceable)
+    return;
+  AttrBuilder.addAttribute(Attribute::NonNull);
+
+  // While a base is being built, 'this' may point to a base subobject, which
+  // does not contain the base's virtual bases.
+  tree pointee = TREE_TYPE(PtrTy);
+  if (IsThis && (!isa<RECORD_TYPE>(pointee) || !TYPE_BINFO(pointee) ||
+                 hasVirtualBases(TYPE_BINFO(pointee))))
+    Dereferenceable = false;
+  if (Dereferenceable && !isa<FUNCTION_TYPE>(pointee) &&
+      !isa<METHOD_TYPE>(pointee) && TYPE_SIZE_UNIT(pointee) &&
+      isInt64(TYPE_SIZE_UNIT(pointee), true))
+    if (uint64_t Size = getInt64(TYPE_SIZE_UNIT(pointee), true))
+      AttrBuilder.addDereferenceableAttr(Size);
+#endif
+}
+
 /// ConvertParamListToLLVMSignature - This method is used to build the argument
 /// type list for K&R prototyped functions.  In this case, we have to figure out
 /// the type list (to build a FunctionType) from the actual DECL_ARGUMENTS list
@@ -761,12 +926,16 @@ FunctionType *ConvertArgListToFnType(
     Attrs.push_back(MigAttributeSet::get(Context, ArgTys.size(), Attribute::Nest));
   }
 
+  unsigned ArgNo = 0;
   for (ArrayRef<tree>::iterator I = Args.begin(), E = Args.end(); I != E; ++I) {
     tree ArgTy = TREE_TYPE(*I);
+    ++ArgNo;
 
     // Determine if there are any attributes for this param.
     AttrBuilder PAttrBuilder;
 
+    unsigned OldSize = ArgTys.size();
+
     ABIConverter.HandleArgument(ArgTy, ScalarArgs, &PAttrBuilder);
 
     // Compute zext/sext attributes.
@@ -776,6 +945,11 @@ FunctionType *ConvertArgListToFnType(
     if (isa<ACCESS_TYPE>(ArgTy) && TYPE_RESTRICT(ArgTy))
       PAttrBuilder.addAttribute(Attribute::NoAlias);
 
+    // Compute nonnull and dereferenceable attributes.
+    if (ArgTys.size() == OldSize + 1 && ArgTys.back()->isPointerTy())
+      HandlePointerAttributes(ArgTy, isNonNullArg(type, ArgNo),
+                              /*IsThis*/ false, PAttrBuilder);
+
     if (PAttrBuilder.hasAttributes())
       Attrs.push_back(MigAttributeSet::get(Context, ArgTys.size(), PAttrBuilder));
   }
@@ -784,8 +958,10 @@ FunctionType *ConvertArgListToFnType(
   return FunctionType::get(RetTy, ArgTys, false);
 }
 
-FunctionType *
-ConvertFunctionType(tree type, tree decl, tree static_chain,
+/// ComputeFunctionType - Do the work of ConvertFunctionType, without looking in
+/// or updating the cache of previous conversions.
+static FunctionType *
+ComputeFunctionType(tree type, tree decl, tree static_chain,
                     CallingConv::ID &CallingConv, MigAttributeSet &PAL) {
   LLVMContext &Context =
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
@@ -833,6 +1009,11 @@ ConvertFunctionType(tree type, tree decl, tree static_chain,
   if (flags & ECF_RETURNS_TWICE)
     FnAttrBuilder.addAttribute(Attribute::ReturnsTwice);
 
+  // Functions marked cold are unlikely to be called, so the optimizers can
+  // move paths leading to calls of them out of the way.
+  if (decl && lookup_attribute("cold", DECL_ATTRIBUTES(decl)))
+    FnAttrBuilder.addAttribute(Attribute::Cold);
+
   // Since they write the return value through a pointer,
   // 'sret' functions cannot be 'readnone' or 'readonly'.
   if (ABIConverter.isShadowReturn()) {
@@ -860,6 +1041,13 @@ ConvertFunctionType(tree type, tree decl, tree static_chain,
   if (flags & ECF_MALLOC)
     RAttrBuilder.addAttribute(Attribute::NoAlias);
 
+  // Compute nonnull and dereferenceable attributes for a returned pointer.
+  if (!ABIConverter.isShadowReturn() && RetTy->isPointerTy())
+    HandlePointerAttributes(TREE_TYPE(type),
+                            lookup_attribute("returns_nonnull",
+                                             TYPE_ATTRIBUTES(type)) != NULL,
+                            /*IsThis*/ false, RAttrBuilder);
+
   if (RAttrBuilder.hasAttributes())
     Attrs.push_back(
         MigAttributeSet::get(Context, MigAttributeSet::ReturnIndex, RAttrBuilder));
@@ -892,12 +1080,26 @@ ConvertFunctionType(tree type, tree decl, tree static_chain,
   // Keep track of whether we see a byval argument.
   bool HasByVal = false;
 
+  // The (one based) numbers of the arguments giving the size of the memory
+  // returned by an allocation function, and where they ended up in the LLVM
+  // argument list.
+  unsigned AllocSizeArgs[2] = { 0, 0 };
+  int AllocSizeIndices[2] = { -1, -1 };
+  if (tree AllocSize = lookup_attribute("alloc_size", TYPE_ATTRIBUTES(type))) {
+    tree arg = TREE_VALUE(AllocSize);
+    for (unsigned i = 0; arg && i < 2; arg = TREE_CHAIN(arg), ++i)
+      if (isInt64(TREE_VALUE(arg), true))
+        AllocSizeArgs[i] = getInt64(TREE_VALUE(arg), true);
+  }
+
   // Check if we have a corresponding decl to inspect.
   tree DeclArgs = (decl) ? DECL_ARGUMENTS(decl) : NULL;
   // Loop over all of the arguments, adding them as we go.
   tree Args = TYPE_ARG_TYPES(type);
+  unsigned ArgNo = 0;
   for (; Args && TREE_VALUE(Args) != void_type_node; Args = TREE_CHAIN(Args)) {
     tree ArgTy = TREE_VALUE(Args);
+    ++ArgNo;
     if (!isPassedByInvisibleReference(ArgTy))
       if (const StructType *STy = llvm::dyn_cast<StructType>(ConvertType(ArgTy)))
         if (STy->isOpaque()) {
@@ -930,6 +1132,19 @@ ConvertFunctionType(tree type, tree decl, tree static_chain,
     if (isa<ACCESS_TYPE>(RestrictArgTy) && TYPE_RESTRICT(RestrictArgTy))
       PAttrBuilder.addAttribute(Attribute::NoAlias);
 
+    // Compute nonnull and dereferenceable attributes.  The first argument of
+    // a method is the 'this' pointer.
+    if (ArgTypes.size() == OldSize + 1 && ArgTypes.back()->isPointerTy())
+      HandlePointerAttributes(ArgTy, isNonNullArg(type, ArgNo),
+                              isa<METHOD_TYPE>(type) && ArgNo == 1,
+                              PAttrBuilder);
+
+    // Note where the arguments giving the size of allocated memory went.
+    for (unsigned i = 0; i < 2; ++i)
+      if (ArgNo == AllocSizeArgs[i] && ArgTypes.size() == OldSize + 1 &&
+          ArgTypes.back()->isIntegerTy())
+        AllocSizeIndices[i] = OldSize;
+
 #ifdef LLVM_TARGET_ENABLE_REGPARM
     // Allow the target to mark this as inreg.
     if (isa<INTEGRAL_TYPE>(ArgTy) || isa<ACCESS_TYPE>(ArgTy) ||
@@ -963,6 +1178,16 @@ ConvertFunctionType(tree type, tree decl, tree static_chain,
 
   assert(RetTy && "Return type not specified!");
 
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  // Tell LLVM the size of the memory returned by an allocation function.
+  if (AllocSizeIndices[0] >= 0 && RetTy->isPointerTy() &&
+      (!AllocSizeArgs[1] || AllocSizeIndices[1] >= 0))
+    FnAttrBuilder.addAllocSizeAttr(
+        AllocSizeIndices[0], AllocSizeArgs[1] ? Optional<unsigned>(
+                                                    AllocSizeIndices[1])
+                                              : Optional<unsigned>());
+#endif
+
   if (FnAttrBuilder.hasAttributes())
     Attrs.push_back(
         MigAttributeSet::get(Context, MigAttributeSet::FunctionIndex, FnAttrBuilder));
@@ -972,6 +1197,69 @@ ConvertFunctionType(tree type, tree decl, tree static_chain,
   return FunctionType::get(RetTy, ArgTypes, Args == 0);
 }
 
+namespace {
+/// ConvertedFunctionType - The result of converting a function type.
+struct ConvertedFunctionType {
+  FunctionType *Ty;
+  CallingConv::ID CallingConv;
+  MigAttributeSet PAL;
+};
+}
+
+/// FunctionTypeCacheKey - The declaration (or the type if there is none), the
+/// type of the static chain and, if the ABI classification of the return value
+/// may depend on it, the current function.
+typedef std::pair<tree, std::pair<tree, tree> > FunctionTypeCacheKey;
+
+/// FunctionTypeCache - Previous results of ConvertFunctionType.  Declarations
+/// and calls with the same prototype are converted over and over again, and
+/// working out how the arguments are passed is far from cheap.
+static DenseMap<FunctionTypeCacheKey, ConvertedFunctionType>
+    FunctionTypeCache;
+
+void flushFunctionTypeCache() {
+  FunctionTypeCache.clear();
+  flushArgumentPlans();
+}
+
+const TypeConversionStatistics &getTypeConversionStatistics() {
+  static TypeConversionStatistics Stats;
+  Stats.RecordLayouts = RecordLayouts.size();
+  Stats.UniqueRecords = UniqueRecordTypes.size();
+  Stats.FunctionTypes = FunctionTypeCache.size();
+  return Stats;
+}
+
+FunctionType *
+ConvertFunctionType(tree type, tree decl, tree static_chain,
+                    CallingConv::ID &CallingConv, MigAttributeSet &PAL) {
+  tree ReturnType = TREE_TYPE(type);
+  tree fn = AGGREGATE_TYPE_P(ReturnType) || isa<COMPLEX_TYPE>(ReturnType) ?
+            current_function_decl : NULL_TREE;
+  FunctionTypeCacheKey Key(decl ? decl : type, std::make_pair(
+      static_chain ? TREE_TYPE(static_chain) : NULL_TREE, fn));
+  DenseMap<FunctionTypeCacheKey, ConvertedFunctionType>::iterator I =
+      FunctionTypeCache.find(Key);
+  if (I != FunctionTypeCache.end()) {
+    CallingConv = I->second.CallingConv;
+    PAL = I->second.PAL;
+    return I->second.Ty;
+  }
+
+  FunctionType *Ty =
+      ComputeFunctionType(type, decl, static_chain, CallingConv, PAL);
+  // A prototype with an argument of incomplete struct type is turned into a
+  // varargs function and gets a different type once the struct is completed,
+  // so do not remember varargs functions.
+  if (!Ty->isVarArg()) {
+    ConvertedFunctionType &Entry = FunctionTypeCache[Key];
+    Entry.Ty = Ty;
+    Entry.CallingConv = CallingConv;
+    Entry.PAL = PAL;
+  }
+  return Ty;
+}
+
 static Type *ConvertPointerTypeRecursive(tree type) {
   // This is where self-recursion loops are broken, by not converting the type
   // pointed to if this would cause trouble (the pointer type is turned into
@@ -1027,7 +1315,7 @@ static Type *ConvertPointerTypeRecursive(tree type) {
       PointeeTy = StructType::get(Context);
   }
 
-  return PointeeTy->getPointerTo(TYPE_ADDR_SPACE(type));
+  return PointeeTy->getPointerTo(getAddressSpace(TREE_TYPE(type)));
 }
 
 typedef Range<uint64_t> BitRange;
@@ -1190,39 +1478,23 @@ static Type *ConvertRecordTypeRecursive(tree type) {
   uint64_t TypeSize =
       isInt64(TYPE_SIZE(type), true) ? getInt64(TYPE_SIZE(type), true) : ~0UL;
 
-  // Record all interesting fields so they can easily be visited backwards.
-  SmallVector<tree, 16> Fields;
-  for (tree field = TYPE_FIELDS(type); field; field = TREE_CHAIN(field)) {
-    if (!isa<FIELD_DECL>(field))
-      continue;
-    // Ignore fields with variable or unknown position since they cannot be
-    // represented by the LLVM type system.
-    if (!OffsetIsLLVMCompatible(field))
-      continue;
-    Fields.push_back(field);
-  }
-
   // Process the fields in reverse order.  This is for the benefit of union
   // types since it means that a zero constant of the LLVM type will fully
   // initialize the first union member, which is needed if the zero constant
   // is to be used as the default value for the union type.
-  for (SmallVector<tree, 16>::reverse_iterator I = Fields.rbegin(),
-                                               E = Fields.rend();
-       I != E; ++I) {
-    tree field = *I;
-    uint64_t FirstBit = getFieldOffsetInBits(field);
+  ArrayRef<FieldLayout> Fields = getRecordLayout(type);
+  for (unsigned i = Fields.size(); i--;) {
+    tree field = Fields[i].Field;
+    uint64_t FirstBit = Fields[i].FirstBit;
     assert(FirstBit <= TypeSize && "Field off end of type!");
-    // Determine the width of the field.
-    uint64_t BitWidth;
+    // Determine the width of the field.  If the field has a size and it is a
+    // constant then use it.  Note that this size may be smaller than the type
+    // size.  For example, if the next field starts inside alignment padding at
+    // the end of this one then DECL_SIZE will be the size with the padding used
+    // by the next field not included.
+    uint64_t BitWidth = Fields[i].BitWidth;
     Type *FieldTy = ConvertType(TREE_TYPE(field));
-    if (isInt64(DECL_SIZE(field), true)) {
-      // The field has a size and it is a constant, so use it.  Note that
-      // this size may be smaller than the type size.  For example, if the
-      // next field starts inside alignment padding at the end of this one
-      // then DECL_SIZE will be the size with the padding used by the next
-      // field not included.
-      BitWidth = getInt64(DECL_SIZE(field), true);
-    } else {
+    if (BitWidth == NO_LENGTH) {
       // If the field has variable or unknown size then use the size of the
       // LLVM type instead as it gives the minimum size the field may have.
       assert(FieldTy->isSized() && "Type field has no size!");
@@ -1319,6 +1591,19 @@ static Type *ConvertRecordTypeRecursive(tree type) {
   Type *STy = getCachedType(type);
   assert(STy && isa<StructType>(STy) && cast<StructType>(STy)->isOpaque() &&
          "Incorrect placeholder for struct type!");
+
+  // If asked to, reuse the type of an earlier record with exactly the same
+  // layout.  This is only possible if nothing refers to the placeholder.
+  if (flag_unique_types && STy == FreshPlaceholder) {
+    StructType *LayoutTy = StructType::get(Context, Elts, Pack);
+    StructType *&Unique = UniqueRecordTypes[LayoutTy];
+    if (Unique) {
+      ++NumRecordTypesMerged;
+      return Unique;
+    }
+    Unique = cast<StructType>(STy);
+  }
+
   cast<StructType>(STy)->setBody(Elts, Pack);
   return STy;
 }
@@ -1446,9 +1731,10 @@ static Type *ConvertTypeRecursive(tree type) {
   case METHOD_TYPE: {
     CallingConv::ID CallingConv;
     MigAttributeSet PAL;
-    // No declaration to pass through, passing NULL.
+    // No declaration to pass through, passing NULL.  The argument types may be
+    // in the middle of being converted, so the result must not be cached.
     return RememberTypeConversion(
-        type, ConvertFunctionType(type, NULL, NULL, CallingConv, PAL));
+        type, ComputeFunctionType(type, NULL, NULL, CallingConv, PAL));
   }
 
   case POINTER_TYPE:
@@ -1497,7 +1783,7 @@ static Type *ConvertTypeNonRecursive(tree type) {
     // Return an opaque struct for an incomplete record type.
     assert(isa<RECORD_OR_UNION_TYPE>(type) && "Unexpected incomplete type!");
     return RememberTypeConversion(
-        type, StructType::create(Context, getDescriptiveName(type)));
+        type, StructType::create(Context, getTypeName(type)));
   }
 
   // From here on we are only dealing with straightforward types.
@@ -1678,6 +1964,47 @@ template <> struct GraphTraits<tree> {
 };
 }
 
+/// OrderSCCForConversion - Order the types in a strongly connected component of
+/// the type graph so that every type comes after the types of the component it
+/// contains directly rather than through a pointer.  Converting a type needs
+/// the types it contains directly to have been converted, so in this order no
+/// type of the component has to be converted in the middle of converting some
+/// other type, and conversion does not recurse deeply however deeply the types
+/// are nested.  Uses an explicit stack for the same reason.
+static void OrderSCCForConversion(const std::vector<tree> &SCC,
+                                  std::vector<tree> &Order) {
+  SmallPtrSet<tree, 16> Members, Visited;
+  for (size_t i = 0, e = SCC.size(); i != e; ++i)
+    Members.insert(SCC[i]);
+
+  // Types reached through a pointer do not need to be converted first.
+  SmallVector<std::pair<tree, RecursiveTypeIterator>, 16> Stack;
+  for (size_t i = 0, e = SCC.size(); i != e; ++i) {
+    if (Visited.count(SCC[i]))
+      continue;
+    Visited.insert(SCC[i]);
+    Stack.push_back(std::make_pair(SCC[i], isa<ACCESS_TYPE>(SCC[i]) ?
+                                   RecursiveTypeIterator::end() :
+                                   RecursiveTypeIterator::begin(SCC[i])));
+    while (!Stack.empty()) {
+      RecursiveTypeIterator &I = Stack.back().second;
+      if (I == RecursiveTypeIterator::end()) {
+        Order.push_back(Stack.back().first);
+        Stack.pop_back();
+        continue;
+      }
+      tree Contained = *I++;
+      if (!Members.count(Contained) || Visited.count(Contained))
+        continue;
+      Visited.insert(Contained);
+      Stack.push_back(std::make_pair(
+          Contained, isa<ACCESS_TYPE>(Contained) ?
+                     RecursiveTypeIterator::end() :
+                     RecursiveTypeIterator::begin(Contained)));
+    }
+  }
+}
+
 Type *ConvertType(tree type) {
   LLVMContext &Context =
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
@@ -1716,6 +2043,7 @@ Type *ConvertType(tree type) {
   // will be visited first.  Note that this analysis is performed only once: the
   // results of the type conversion are cached, and any future conversion of one
   // of the visited types will just return the cached value.
+  PhaseTimer Timer("LLVM type conversion");
   for (scc_iterator<tree> I = scc_begin(type), E = scc_end(type); I != E; ++I) {
     const std::vector<tree> &SCC = *I;
 
@@ -1738,10 +2066,12 @@ Type *ConvertType(tree type) {
         continue;
       }
       // Otherwise register a placeholder for this type.
-      Ty = StructType::create(Context, getDescriptiveName(some_type));
+      Ty = StructType::create(Context, getTypeName(some_type));
       // Associate the placeholder with the GCC type without sanity checking
       // since the type sizes won't match yet.
       setCachedType(some_type, Ty);
+      if (SCC.size() == 1)
+        FreshPlaceholder = Ty;
     }
 
     // Now convert every type in the SCC, filling in the placeholders created
@@ -1753,10 +2083,16 @@ Type *ConvertType(tree type) {
     // in the type graph can only be created by pointer types, "removing" such
     // edges like this destroys all cycles allowing the other types in the SCC
     // to be converted straightforwardly.
+    std::vector<tree> Order;
+    if (SCC.size() > 1)
+      OrderSCCForConversion(SCC, Order);
+    else
+      Order = SCC;
     SCCInProgress = &SCC;
-    for (size_t i = 0, e = SCC.size(); i != e; ++i)
-      ConvertType(SCC[i]);
+    for (size_t i = 0, e = Order.size(); i != e; ++i)
+      ConvertType(Order[i]);
     SCCInProgress = 0;
+    FreshPlaceholder = 0;
 
     // Finally, replace pointer types with a pointer to the pointee type (which
     // has now been computed).  This means that while uses of the pointer type
@@ -1775,7 +2111,7 @@ Type *ConvertType(tree type) {
           // SCC as the pointer (since the SCC contains more than one type).
           Type *PointeeTy = getCachedType(pointee);
           assert(PointeeTy && "Pointee not converted!");
-          unsigned AS = TYPE_ADDR_SPACE(some_type);
+          unsigned AS = getAddressSpace(TREE_TYPE(some_type));
           RememberTypeConversion(some_type, PointeeTy->getPointerTo(AS));
         }
       }
@@ -0,0 +1,591 @@
+//===-------------- Target.cpp - Implements the AArch64 ABI. --------------===//
+//
+// Copyright (C) 2005 to 2013  Evan Cheng, Duncan Sands et al.
+//
+// This file is part of DragonEgg.
+//
+// DragonEgg is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2, or (at your option) any later version.
+//
+// DragonEgg is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// DragonEgg; see the file COPYING.  If not, write to the Free Software
+// Foundation, 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+//
+//===----------------------------------------------------------------------===//
+// This file implements the AAPCS64 ABI and the AArch64 builtins.
+//===----------------------------------------------------------------------===//
+
+// Plugin headers
+#include "dragonegg/ABI.h"
+#include "dragonegg/Target.h"
+
+// LLVM headers
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/MC/SubtargetFeature.h"
+#include "llvm/IR/Module.h"
+
+// System headers
+#include <gmp.h>
+
+// GCC headers
+#include "auto-host.h"
+#ifndef ENABLE_BUILD_WITH_CXX
+#include <cstring> // Otherwise included by system.h with C linkage.
+extern "C" {
+#endif
+#include "config.h"
+// Stop GCC declaring 'getopt' as it can clash with the system's declaration.
+#undef HAVE_DECL_GETOPT
+#include "system.h"
+#include "coretypes.h"
+#include "tm.h"
+#include "target.h"
+#include "tree.h"
+#include "hard-reg-set.h"
+
+#include "diagnostic.h"
+#if (GCC_MAJOR > 4)
+#include "function.h"
+#include "basic-block.h"
+#include "stor-layout.h"
+#endif
+#include "gimple.h"
+#include "toplev.h"
+#ifndef ENABLE_BUILD_WITH_CXX
+} // extern "C"
+#endif
+
+// Trees header.
+#include "dragonegg/Trees.h"
+
+using namespace llvm;
+
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 9)
+static LLVMContext &TheContext = getGlobalContext();
+#endif
+
+//===----------------------------------------------------------------------===//
+//                      Homogeneous aggregates
+//===----------------------------------------------------------------------===//
+
+/// HomogeneousBase - The kind of value making up a homogeneous aggregate.  All
+/// floating point types of the same size are the same kind, as are all short
+/// vectors of the same size.
+struct HomogeneousBase {
+  tree First; // The first member found, or null if none has been found yet.
+  HOST_WIDE_INT Bytes;
+  bool IsVector;
+};
+
+/// CountHomogeneousMembers - If the given type is made up of floating point
+/// values or short vectors all of the same kind as Base (which is filled in by
+/// the first member found if it is empty) and has no padding, return how many
+/// of them there are.  Otherwise return -1.
+static int CountHomogeneousMembers(tree type, HomogeneousBase &Base) {
+  HOST_WIDE_INT Bytes = int_size_in_bytes(type);
+  if (Bytes < 0)
+    return -1;
+
+  int Count = 0;
+  switch (TREE_CODE(type)) {
+  default:
+    return -1;
+
+  case REAL_TYPE:
+  case VECTOR_TYPE: {
+    bool IsVector = isa<VECTOR_TYPE>(type);
+    if (IsVector ? Bytes != 8 && Bytes != 16
+                 : Bytes != 2 && Bytes != 4 && Bytes != 8 && Bytes != 16)
+      return -1;
+    if (!Base.First) {
+      Base.First = type;
+      Base.Bytes = Bytes;
+      Base.IsVector = IsVector;
+    } else if (Base.Bytes != Bytes || Base.IsVector != IsVector) {
+      return -1;
+    }
+    return 1;
+  }
+
+  case COMPLEX_TYPE:
+    if (!isa<REAL_TYPE>(TREE_TYPE(type)) ||
+        CountHomogeneousMembers(TREE_TYPE(type), Base) != 1)
+      return -1;
+    return 2;
+
+  case ARRAY_TYPE: {
+    int EltCount = CountHomogeneousMembers(TREE_TYPE(type), Base);
+    HOST_WIDE_INT EltBytes = int_size_in_bytes(TREE_TYPE(type));
+    if (EltCount < 0 || EltBytes <= 0 || Bytes / EltBytes > 4)
+      return -1;
+    Count = EltCount * (Bytes / EltBytes);
+    break;
+  }
+
+  case RECORD_TYPE:
+  case UNION_TYPE:
+  case QUAL_UNION_TYPE:
+    for (tree Field = TYPE_FIELDS(type); Field; Field = TREE_CHAIN(Field)) {
+      if (!isa<FIELD_DECL>(Field) || TREE_TYPE(Field) == error_mark_node)
+        continue;
+      int FieldCount = CountHomogeneousMembers(TREE_TYPE(Field), Base);
+      if (FieldCount < 0)
+        return -1;
+      // The fields of a union overlap, so take the biggest.
+      Count = isa<RECORD_TYPE>(type) ? Count + FieldCount
+                                     : std::max(Count, FieldCount);
+      if (Count > 4)
+        return -1;
+    }
+    break;
+  }
+
+  // There must be nothing but members.
+  if (Bytes != Count * (Base.First ? Base.Bytes : 0))
+    return -1;
+  return Count;
+}
+
+/// getHomogeneousAggregate - If the given type is a homogeneous floating point
+/// or short vector aggregate (an HFA or HVA), return the number of members and
+/// set Base to the type of the first one.  Otherwise return zero.  This is
+/// asked for every argument and return value, so the answer is remembered.
+static unsigned getHomogeneousAggregate(tree type, tree &Base) {
+  if (!isa<AGGREGATE_TYPE>(type) && !isa<COMPLEX_TYPE>(type))
+    return 0;
+
+  static DenseMap<tree, std::pair<tree, unsigned> > HomogeneousAggregates;
+  std::pair<DenseMap<tree, std::pair<tree, unsigned> >::iterator, bool> I =
+      HomogeneousAggregates.insert(
+          std::make_pair(type, std::make_pair((tree) 0, 0U)));
+  if (I.second) {
+    HomogeneousBase B = { 0, 0, false };
+    int Count = CountHomogeneousMembers(type, B);
+    if (Count > 0 && Count <= 4)
+      I.first->second = std::make_pair(B.First, (unsigned) Count);
+  }
+  Base = I.first->second.first;
+  return I.first->second.second;
+}
+
+//===----------------------------------------------------------------------===//
+//                         ABI target hooks
+//===----------------------------------------------------------------------===//
+
+/* Target hook for llvm-abi.h.  Homogeneous aggregates are returned in SIMD and
+   floating point registers.  */
+bool llvm_aarch64_is_homogeneous_aggregate(tree type) {
+  tree Base;
+  return getHomogeneousAggregate(type, Base) != 0;
+}
+
+/* Target hook for llvm-abi.h.  Anything bigger than two X registers that is
+   not a homogeneous aggregate is passed by reference to a copy.  */
+bool llvm_aarch64_should_pass_aggregate_by_reference(tree type) {
+  return int_size_in_bytes(type) > 16 &&
+         !llvm_aarch64_is_homogeneous_aggregate(type);
+}
+
+/* Target hook for llvm-abi.h.  A homogeneous aggregate is passed as an array
+   of its members: the code generator puts an array either wholly in registers
+   or wholly on the stack, as AAPCS64 requires.  */
+bool llvm_aarch64_should_pass_aggregate_in_mixed_regs(
+    tree type, Type */*Ty*/, std::vector<Type *> &Elts) {
+  tree Base;
+  unsigned Count = getHomogeneousAggregate(type, Base);
+  if (!Count)
+    return false;
+  Elts.push_back(ArrayType::get(ConvertType(Base), Count));
+  return true;
+}
+
+/* Target hook for llvm-abi.h.  Other aggregates of up to 16 bytes are passed
+   in X registers, packed together whatever the alignment of their fields.
+   Those aligned to 16 bytes start at an even numbered register, which is what
+   the code generator does for an i128 field, so they are passed field by
+   field instead.  */
+bool llvm_aarch64_should_pass_aggregate_in_integer_regs(
+    tree type, unsigned */*size*/, bool *DontCheckAlignment) {
+  HOST_WIDE_INT Bytes = int_size_in_bytes(type);
+  if (Bytes <= 0 || Bytes > 16 || (Bytes == 16 && TYPE_ALIGN(type) > 64))
+    return false;
+  *DontCheckAlignment = true;
+  return true;
+}
+
+/* Target hook for llvm-abi.h.  Homogeneous aggregates are returned as a struct
+   with one field per member.  */
+Type *llvm_aarch64_aggr_type_for_struct_return(tree type) {
+  tree Base;
+  unsigned Count = getHomogeneousAggregate(type, Base);
+  if (!Count)
+    return NULL;
+  Type *EltTy = ConvertType(Base);
+  std::vector<Type *> Elts(Count, EltTy);
+  LLVMContext &Context =
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+      EltTy->getContext();
+#else
+      TheContext;
+#endif
+  return StructType::get(Context, Elts, false);
+}
+
+/* Target hook for llvm-abi.h.  Store the members of a returned homogeneous
+   aggregate in Dest.  There is no padding, so member i is at i times the size
+   of a member.  */
+void llvm_aarch64_extract_multiple_return_value(
+    Value *Src, Value *Dest, bool isVolatile, LLVMBuilder &Builder) {
+  StructType *STy = cast<StructType>(Src->getType());
+  unsigned AS = cast<PointerType>(Dest->getType())->getAddressSpace();
+  Value *Ptr = Builder.CreateBitCast(Dest, Builder.getInt8PtrTy(AS));
+  uint64_t Offset = 0;
+  for (unsigned i = 0, e = STy->getNumElements(); i != e; ++i) {
+    Type *EltTy = STy->getElementType(i);
+    Value *EltPtr = Builder.CreateConstGEP1_64(Ptr, Offset);
+    EltPtr = Builder.CreateBitCast(EltPtr, EltTy->getPointerTo(AS));
+    Builder.CreateAlignedStore(Builder.CreateExtractValue(Src, i), EltPtr, 1,
+                               isVolatile);
+    Offset += getDataLayout().getTypeAllocSize(EltTy);
+  }
+}
+
+//===----------------------------------------------------------------------===//
+//                         Subtarget features
+//===----------------------------------------------------------------------===//
+
+static void addFeature(llvm::SubtargetFeatures &F, const char *Feature,
+                       bool Enabled) {
+  const char *Prefix = Enabled ? "+" : "-";
+  F.AddFeature(std::string(Prefix) + Feature);
+}
+
+/// AArch64Feature - The LLVM name of an architecture extension, and the GCC
+/// flag saying whether it is enabled.
+struct AArch64Feature {
+  const char *Name;
+  unsigned long Flag;
+};
+
+void llvm_aarch64_set_subtarget_features(std::string &C,
+                                         llvm::SubtargetFeatures &F) {
+  // Any "+ext" modifiers following the CPU name are already accounted for in
+  // aarch64_isa_flags, along with those of -march.
+  if (aarch64_cpu_string)
+    C = std::string(aarch64_cpu_string, strcspn(aarch64_cpu_string, "+"));
+  else
+    C = "generic";
+
+  // Extensions only appear once both GCC and LLVM know about them: LLVM warns
+  // about features it does not recognize.
+  const AArch64Feature Features[] = {
+    { "fp-armv8", AARCH64_FL_FP },
+    { "neon", AARCH64_FL_SIMD },
+    { "crypto", AARCH64_FL_CRYPTO },
+#ifdef AARCH64_FL_CRC
+    { "crc", AARCH64_FL_CRC },
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 7)
+#ifdef AARCH64_FL_LSE
+    { "lse", AARCH64_FL_LSE },
+#endif
+#ifdef AARCH64_FL_V8_1
+    { "v8.1a", AARCH64_FL_V8_1 },
+#endif
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+#ifdef AARCH64_FL_RDMA
+    { "rdm", AARCH64_FL_RDMA },
+#endif
+#ifdef AARCH64_FL_V8_2
+    { "v8.2a", AARCH64_FL_V8_2 },
+#endif
+#ifdef AARCH64_FL_F16
+    { "fullfp16", AARCH64_FL_F16 },
+#endif
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(4, 0)
+#ifdef AARCH64_FL_V8_3
+    { "v8.3a", AARCH64_FL_V8_3 },
+#endif
+#ifdef AARCH64_FL_RCPC
+    { "rcpc", AARCH64_FL_RCPC },
+#endif
+#ifdef AARCH64_FL_SVE
+    { "sve", AARCH64_FL_SVE },
+#endif
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(5, 0)
+#ifdef AARCH64_FL_DOTPROD
+    { "dotprod", AARCH64_FL_DOTPROD },
+#endif
+#endif
+  };
+  for (unsigned i = 0, e = array_lengthof(Features); i != e; ++i)
+    addFeature(F, Features[i].Name,
+               (aarch64_isa_flags & Features[i].Flag) != 0);
+
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+  // Keep the register allocator away from x18 if GCC was told to (-ffixed-x18),
+  // for example so that it can hold a global register variable.
+  if (fixed_regs[R18_REGNUM])
+    addFeature(F, "reserve-x18", true);
+#endif
+}
+
+//===----------------------------------------------------------------------===//
+//                              Builtins
+//===----------------------------------------------------------------------===//
+
+/// BuiltinCode - A enumerated type with one value for each supported builtin.
+enum BuiltinCode {
+  SearchForHandler, // Builtin not seen before - search for a handler.
+#define DEFINE_BUILTIN(x) BI_##x
+#include "aarch64_builtins"
+#undef DEFINE_BUILTIN
+  ,
+  UnsupportedBuiltin // There is no handler for this builtin.
+};
+
+struct HandlerEntry {
+  const char *Name;
+  BuiltinCode Handler;
+};
+
+static bool HandlerLT(const HandlerEntry &E, const HandlerEntry &F) {
+  return strcmp(E.Name, F.Name) < 0;
+}
+
+/// getBuiltinBaseName - Return the name of an AArch64 builtin with the
+/// "__builtin_aarch64_" prefix and the machine mode and signedness suffixes
+/// removed, or the empty string if this is not an AArch64 builtin.
+static std::string getBuiltinBaseName(const char *Identifier) {
+  static const char Prefix[] = "__builtin_aarch64_";
+  if (strncmp(Identifier, Prefix, sizeof(Prefix) - 1))
+    return std::string();
+  std::string Name(Identifier + sizeof(Prefix) - 1);
+
+  // Builtins operating on unsigned or polynomial vectors end with a letter for
+  // the result and for each operand saying which they are, such as "_uuu".
+  std::string::size_type Underscore = Name.rfind('_');
+  if (Underscore != std::string::npos && Underscore + 1 != Name.size() &&
+      Name.find_first_not_of("usp", Underscore + 1) == std::string::npos)
+    Name.erase(Underscore);
+
+  // Before that comes the machine mode.  The scalar modes are suffixes of the
+  // vector ones, so try the vector modes first.
+  static const char *const Modes[] = {
+    "v16qi", "v8qi", "v8hi", "v4hi", "v4si", "v2si", "v2di", "v8hf", "v4hf",
+    "v4sf", "v2sf", "v2df", "qi", "hi", "si", "di", "hf", "sf", "df"
+  };
+  for (unsigned i = 0, e = array_lengthof(Modes); i != e; ++i) {
+    size_t Len = strlen(Modes[i]);
+    if (Name.size() > Len && !Name.compare(Name.size() - Len, Len, Modes[i])) {
+      Name.erase(Name.size() - Len);
+      break;
+    }
+  }
+  return Name;
+}
+
+/// CreateMinMaxNum - Emit a call to llvm.minnum or llvm.maxnum, or return null
+/// if LLVM is too old to have them.
+static Value *CreateMinMaxNum(bool IsMax, Value *LHS, Value *RHS,
+                              LLVMBuilder &Builder) {
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 5)
+  Function *F = Intrinsic::getDeclaration(
+      TheModule, IsMax ? Intrinsic::maxnum : Intrinsic::minnum, LHS->getType());
+  Value *Args[] = { LHS, RHS };
+  return Builder.CreateCall(F, Args);
+#else
+  (void) IsMax;
+  (void) LHS;
+  (void) RHS;
+  (void) Builder;
+  return 0;
+#endif
+}
+
+/// CombineValues - Apply the binary operation for the given builtin, or for
+/// the reduction across a vector it performs, to LHS and RHS.  Returns null if
+/// this cannot be done.  The floating point maximum and minimum ignore quiet
+/// NaNs, like FMAXNM and FMINNM.
+static Value *CombineValues(BuiltinCode Handler, Value *LHS, Value *RHS,
+                            LLVMBuilder &Builder) {
+  bool IsFP = LHS->getType()->isFPOrFPVectorTy();
+  switch (Handler) {
+  default:
+    llvm_unreachable("Not a binary builtin!");
+  case BI_reduc_plus_scal_:
+    return IsFP ? Builder.CreateFAdd(LHS, RHS) : Builder.CreateAdd(LHS, RHS);
+  case BI_fmax:
+  case BI_smax:
+  case BI_reduc_smax_scal_:
+    if (IsFP)
+      return CreateMinMaxNum(true, LHS, RHS, Builder);
+    return Builder.CreateSelect(Builder.CreateICmpSGT(LHS, RHS), LHS, RHS);
+  case BI_fmin:
+  case BI_smin:
+  case BI_reduc_smin_scal_:
+    if (IsFP)
+      return CreateMinMaxNum(false, LHS, RHS, Builder);
+    return Builder.CreateSelect(Builder.CreateICmpSLT(LHS, RHS), LHS, RHS);
+  case BI_umax:
+  case BI_reduc_umax_scal_:
+    return Builder.CreateSelect(Builder.CreateICmpUGT(LHS, RHS), LHS, RHS);
+  case BI_umin:
+  case BI_reduc_umin_scal_:
+    return Builder.CreateSelect(Builder.CreateICmpULT(LHS, RHS), LHS, RHS);
+  }
+}
+
+/// ReduceVector - Combine the elements of the vector Vec using the operation
+/// for the given builtin.  Neighbouring elements are combined pairwise, like
+/// the across-vector instructions do, which matters for floating point.
+static Value *ReduceVector(BuiltinCode Handler, Value *Vec,
+                           LLVMBuilder &Builder) {
+  unsigned NElts = cast<VectorType>(Vec->getType())->getNumElements();
+  SmallVector<Value *, 16> Elts;
+  for (unsigned i = 0; i != NElts; ++i)
+    Elts.push_back(Builder.CreateExtractElement(Vec, Builder.getInt32(i)));
+  while (Elts.size() > 1) {
+    assert(Elts.size() % 2 == 0 && "Vector length not a power of two!");
+    unsigned Half = Elts.size() / 2;
+    for (unsigned i = 0; i != Half; ++i)
+      if (!(Elts[i] = CombineValues(Handler, Elts[2 * i], Elts[2 * i + 1],
+                                    Builder)))
+        return 0;
+    Elts.resize(Half);
+  }
+  return Elts[0];
+}
+
+/* TargetIntrinsicLower - For builtins that we want to expand to normal LLVM
+ * code, emit the code now.  If we can handle the code, this macro should emit
+ * the code, return true.
+ */
+bool TreeToLLVM::TargetIntrinsicLower(GimpleTy */*stmt*/, tree fndecl,
+                                      const MemRef */*DestLoc*/,
+                                      Value *&Result,
+                                      Type *ResultType,
+                                      std::vector<Value *> &Ops) {
+  // As on x86, the enumerated type of DECL_FUNCTION_CODE values is private to
+  // the GCC backend, so map them to BuiltinCode at run-time using the name.
+  static std::vector<BuiltinCode> FunctionCodeMap;
+  if (FunctionCodeMap.size() <= DECL_FUNCTION_CODE(fndecl))
+    FunctionCodeMap.resize(DECL_FUNCTION_CODE(fndecl) + 1);
+
+  // See if we already associated a BuiltinCode with this DECL_FUNCTION_CODE.
+  BuiltinCode &Handler = FunctionCodeMap[DECL_FUNCTION_CODE(fndecl)];
+  if (Handler == SearchForHandler) {
+    // List of builtin base names and associated BuiltinCode.
+    static const HandlerEntry Handlers[] = {
+#define DEFINE_BUILTIN(x)                                                      \
+  { #x, BI_##x }
+#include "aarch64_builtins"
+#undef DEFINE_BUILTIN
+    };
+    size_t N = sizeof(Handlers) / sizeof(Handlers[0]);
+#ifndef NDEBUG
+    // Check that the list of handlers is sorted by name.
+    static bool Checked = false;
+    if (!Checked) {
+      for (unsigned i = 1; i < N; ++i)
+        assert(HandlerLT(Handlers[i - 1], Handlers[i]) &&
+               "Handlers not sorted!");
+      Checked = true;
+    }
+#endif
+
+    Handler = UnsupportedBuiltin;
+    std::string Name =
+        getBuiltinBaseName(IDENTIFIER_POINTER(DECL_NAME(fndecl)));
+    if (!Name.empty()) {
+      HandlerEntry ToFind = { Name.c_str(), SearchForHandler };
+      const HandlerEntry *E =
+          std::lower_bound(Handlers, Handlers + N, ToFind, HandlerLT);
+      if ((E < Handlers + N) && !strcmp(E->Name, ToFind.Name))
+        Handler = E->Handler;
+    }
+  }
+
+  Intrinsic::ID IID;
+  switch (Handler) {
+  case SearchForHandler:
+    llvm_unreachable("Unexpected builtin code!");
+  case UnsupportedBuiltin:
+    return false;
+  case BI_abs:
+    if (ResultType->isFPOrFPVectorTy()) {
+      IID = Intrinsic::fabs;
+      break;
+    }
+    Result = Builder.CreateSelect(
+        Builder.CreateICmpSLT(Ops[0], Constant::getNullValue(ResultType)),
+        Builder.CreateNeg(Ops[0]), Ops[0]);
+    return true;
+  case BI_btrunc:
+    IID = Intrinsic::trunc;
+    break;
+  case BI_ceil:
+    IID = Intrinsic::ceil;
+    break;
+  case BI_floor:
+    IID = Intrinsic::floor;
+    break;
+  case BI_nearbyint:
+    IID = Intrinsic::nearbyint;
+    break;
+  case BI_popcount:
+    IID = Intrinsic::ctpop;
+    break;
+  case BI_rint:
+    IID = Intrinsic::rint;
+    break;
+  case BI_round:
+    IID = Intrinsic::round;
+    break;
+  case BI_sqrt:
+    IID = Intrinsic::sqrt;
+    break;
+  case BI_clz: {
+    Function *ctlz =
+        Intrinsic::getDeclaration(TheModule, Intrinsic::ctlz, ResultType);
+    Value *Args[] = { Ops[0], Builder.getFalse() };
+    Result = Builder.CreateCall(ctlz, Args);
+    return true;
+  }
+  case BI_fma: {
+    Function *fma =
+        Intrinsic::getDeclaration(TheModule, Intrinsic::fma, ResultType);
+    Result = Builder.CreateCall(fma, Ops);
+    return true;
+  }
+  case BI_fmax:
+  case BI_fmin:
+  case BI_smax:
+  case BI_smin:
+  case BI_umax:
+  case BI_umin:
+    Result = CombineValues(Handler, Ops[0], Ops[1], Builder);
+    return Result != 0;
+  case BI_reduc_plus_scal_:
+  case BI_reduc_smax_scal_:
+  case BI_reduc_smin_scal_:
+  case BI_reduc_umax_scal_:
+  case BI_reduc_umin_scal_:
+    Result = ReduceVector(Handler, Ops[0], Builder);
+    return Result != 0;
+  }
+
+  // A unary operation with an LLVM intrinsic of the same name.
+  Function *F = Intrinsic::getDeclaration(TheModule, IID, ResultType);
+  Result = Builder.CreateCall(F, Ops[0]);
+  return true;
+}
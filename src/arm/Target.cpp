@@ -26,6 +26,8 @@
 #include "dragonegg/Target.h"
 
 // LLVM headers
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/IR/Module.h"
 
 // System headers
@@ -265,28 +267,17 @@ static bool vfp_arg_homogeneous_aggregate_p(enum machine_mode mode, tree type,
 
 // Walk over an LLVM Type that we know is a homogeneous aggregate and
 // push the proper LLVM Types that represent the register types to pass
-// that struct member in.
+// that struct member in.  Vectors are passed in D or Q registers whatever
+// their element type, so they are pushed as they are.
 static void push_elts(Type *Ty, std::vector<Type *> &Elts) {
-  LLVMContext &Context =
-#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
-      Ty->getContext();
-#else
-      TheContext;
-#endif
   for (Type::subtype_iterator I = Ty->subtype_begin(), E = Ty->subtype_end();
        I != E; ++I) {
     Type *STy = *I;
     if (const VectorType *VTy = llvm::dyn_cast<VectorType>(STy)) {
-      switch (VTy->getBitWidth()) {
-      case 64: // v2f32
-        Elts.push_back(VectorType::get(Type::getFloatTy(Context), 2));
-        break;
-      case 128: // v2f64
-        Elts.push_back(VectorType::get(Type::getDoubleTy(Context), 2));
-        break;
-      default:
-        assert(0 && "invalid vector type");
-      }
+      assert((VTy->getBitWidth() == 64 || VTy->getBitWidth() == 128) &&
+             "invalid vector type");
+      (void) VTy; // Otherwise unused if asserts off - avoid compiler warning.
+      Elts.push_back(STy);
     } else if (ArrayType *ATy = llvm::dyn_cast<ArrayType>(STy)) {
       Type *ETy = ATy->getElementType();
 
@@ -628,10 +619,311 @@ bool llvm_arm_should_pass_or_return_aggregate_in_regs(tree TreeType,
     return false;
 
   // Alas, we can't use LLVM Types to figure this out because we need to
-  // examine unions closely.  We'll have to walk the GCC TreeType.
-  int fdt_counts[ARM_FDT_MAX] = { 0 };
-  bool result = false;
-  result = vfp_arg_homogeneous_aggregate_p(TYPE_MODE(TreeType), TreeType,
-                                           fdt_counts);
-  return result && !TREE_ADDRESSABLE(TreeType);
+  // examine unions closely.  We'll have to walk the GCC TreeType.  This is
+  // asked for every argument and return value, so remember the answer.
+  static DenseMap<tree, bool> HomogeneousAggregates;
+  std::pair<DenseMap<tree, bool>::iterator, bool> I =
+      HomogeneousAggregates.insert(std::make_pair(TreeType, false));
+  if (I.second) {
+    int fdt_counts[ARM_FDT_MAX] = { 0 };
+    I.first->second = vfp_arg_homogeneous_aggregate_p(TYPE_MODE(TreeType),
+                                                      TreeType, fdt_counts) &&
+                      !TREE_ADDRESSABLE(TreeType);
+  }
+  return I.first->second;
+}
+
+/// BuiltinCode - A enumerated type with one value for each supported builtin.
+enum BuiltinCode {
+  SearchForHandler, // Builtin not seen before - search for a handler.
+#define DEFINE_BUILTIN(x) BI_##x
+#include "arm_builtins"
+#undef DEFINE_BUILTIN
+  ,
+  UnsupportedBuiltin // There is no handler for this builtin.
+};
+
+struct HandlerEntry {
+  const char *Name;
+  BuiltinCode Handler;
+};
+
+static bool HandlerLT(const HandlerEntry &E, const HandlerEntry &F) {
+  return strcmp(E.Name, F.Name) < 0;
+}
+
+/// getNeonBuiltinBaseName - Return the name of a NEON builtin with the
+/// "__builtin_neon_" prefix and the machine mode suffix removed, or the empty
+/// string if this is not a NEON builtin.
+static std::string getNeonBuiltinBaseName(const char *Identifier) {
+  static const char Prefix[] = "__builtin_neon_";
+  if (strncmp(Identifier, Prefix, sizeof(Prefix) - 1))
+    return std::string();
+  std::string Name(Identifier + sizeof(Prefix) - 1);
+
+  // The scalar modes are suffixes of the vector ones, so try the vector modes
+  // first.
+  static const char *const Modes[] = {
+    "v16qi", "v8qi", "v8hi", "v4hi", "v4si", "v2si", "v2di", "v8hf", "v4hf",
+    "v4sf", "v2sf", "di", "ti", "sf", "si", "hi", "qi"
+  };
+  for (unsigned i = 0, e = array_lengthof(Modes); i != e; ++i) {
+    size_t Len = strlen(Modes[i]);
+    if (Name.size() > Len && !Name.compare(Name.size() - Len, Len, Modes[i])) {
+      Name.erase(Name.size() - Len);
+      break;
+    }
+  }
+  return Name;
+}
+
+/// NeonElementKind - How a NEON builtin treats the vector elements.  Before
+/// GCC 5 this is passed as a final constant argument, afterwards it is part of
+/// the builtin's name for the operations where it matters.
+enum NeonElementKind {
+  NEON_UNSIGNED = 0,
+  NEON_SIGNED = 1,
+  NEON_POLY = 2,
+  NEON_FLOAT = 3,
+  NEON_KIND_MASK = 3,
+  NEON_ROUNDING = 4 // Set for the rounding form of the operation.
+};
+
+/* TargetIntrinsicLower - For builtins that we want to expand to normal LLVM
+ * code, emit the code now.  If we can handle the code, this macro should emit
+ * the code, return true.
+ */
+bool TreeToLLVM::TargetIntrinsicLower(GimpleTy */*stmt*/, tree fndecl,
+                                      const MemRef */*DestLoc*/,
+                                      Value *&Result,
+                                      Type *ResultType,
+                                      std::vector<Value *> &Ops) {
+  // As on x86, the enumerated type of DECL_FUNCTION_CODE values is private to
+  // the GCC backend, so map them to BuiltinCode at run-time using the name.
+  static std::vector<BuiltinCode> FunctionCodeMap;
+  if (FunctionCodeMap.size() <= DECL_FUNCTION_CODE(fndecl))
+    FunctionCodeMap.resize(DECL_FUNCTION_CODE(fndecl) + 1);
+
+  // See if we already associated a BuiltinCode with this DECL_FUNCTION_CODE.
+  BuiltinCode &Handler = FunctionCodeMap[DECL_FUNCTION_CODE(fndecl)];
+  if (Handler == SearchForHandler) {
+    // List of builtin base names and associated BuiltinCode.
+    static const HandlerEntry Handlers[] = {
+#define DEFINE_BUILTIN(x)                                                      \
+  { #x, BI_##x }
+#include "arm_builtins"
+#undef DEFINE_BUILTIN
+    };
+    size_t N = sizeof(Handlers) / sizeof(Handlers[0]);
+#ifndef NDEBUG
+    // Check that the list of handlers is sorted by name.
+    static bool Checked = false;
+    if (!Checked) {
+      for (unsigned i = 1; i < N; ++i)
+        assert(HandlerLT(Handlers[i - 1], Handlers[i]) &&
+               "Handlers not sorted!");
+      Checked = true;
+    }
+#endif
+
+    Handler = UnsupportedBuiltin;
+    std::string Name =
+        getNeonBuiltinBaseName(IDENTIFIER_POINTER(DECL_NAME(fndecl)));
+    if (!Name.empty()) {
+      HandlerEntry ToFind = { Name.c_str(), SearchForHandler };
+      const HandlerEntry *E =
+          std::lower_bound(Handlers, Handlers + N, ToFind, HandlerLT);
+      if ((E < Handlers + N) && !strcmp(E->Name, ToFind.Name))
+        Handler = E->Handler;
+    }
+  }
+
+  if (Handler == UnsupportedBuiltin)
+    return false;
+  assert(Handler != SearchForHandler && "Unexpected builtin code!");
+
+  unsigned Kind = NEON_SIGNED;
+#if (GCC_MAJOR < 5)
+  ConstantInt *KindOp = llvm::dyn_cast<ConstantInt>(Ops.back());
+  if (!KindOp)
+    return false;
+  Kind = KindOp->getZExtValue();
+  Ops.pop_back();
+#endif
+  switch (Handler) {
+  default:
+    break;
+  case BI_vabdu:
+  case BI_vhaddu:
+  case BI_vmaxu:
+  case BI_vminu:
+  case BI_vpmaxu:
+  case BI_vpminu:
+  case BI_vqaddu:
+  case BI_vqsubu:
+    Kind = NEON_UNSIGNED;
+    break;
+  case BI_vrhaddu:
+    Kind = NEON_UNSIGNED | NEON_ROUNDING;
+    break;
+  case BI_vrhadds:
+  case BI_vqrdmulh:
+    Kind = NEON_SIGNED | NEON_ROUNDING;
+    break;
+  case BI_vmulp:
+    Kind = NEON_POLY;
+    break;
+  }
+  bool IsFP = ResultType->isFPOrFPVectorTy();
+  bool IsSigned = (Kind & NEON_KIND_MASK) != NEON_UNSIGNED;
+  bool IsRounding = Kind & NEON_ROUNDING;
+
+  Intrinsic::ID IID;
+  switch (Handler) {
+  default:
+    llvm_unreachable("Unexpected builtin code!");
+  case BI_vadd:
+    Result = IsFP ? Builder.CreateFAdd(Ops[0], Ops[1])
+                  : Builder.CreateAdd(Ops[0], Ops[1]);
+    return true;
+  case BI_vsub:
+    Result = IsFP ? Builder.CreateFSub(Ops[0], Ops[1])
+                  : Builder.CreateSub(Ops[0], Ops[1]);
+    return true;
+  case BI_vmul:
+  case BI_vmulp:
+    if ((Kind & NEON_KIND_MASK) == NEON_POLY) {
+      IID = Intrinsic::arm_neon_vmulp;
+      break;
+    }
+    Result = IsFP ? Builder.CreateFMul(Ops[0], Ops[1])
+                  : Builder.CreateMul(Ops[0], Ops[1]);
+    return true;
+  case BI_vneg:
+    Result = IsFP ? Builder.CreateFNeg(Ops[0]) : Builder.CreateNeg(Ops[0]);
+    return true;
+  case BI_vabs:
+    if (IsFP) {
+      IID = Intrinsic::fabs;
+      break;
+    }
+    Result = Builder.CreateSelect(
+        Builder.CreateICmpSLT(Ops[0], Constant::getNullValue(ResultType)),
+        Builder.CreateNeg(Ops[0]), Ops[0]);
+    return true;
+  case BI_vmax:
+  case BI_vmaxf:
+  case BI_vmaxs:
+  case BI_vmaxu:
+    // The floating point form returns NaN if either operand is a NaN, which
+    // generic IR cannot express.
+    if (IsFP) {
+      IID = Intrinsic::arm_neon_vmaxs;
+      break;
+    }
+    Result = Builder.CreateSelect(IsSigned
+                                      ? Builder.CreateICmpSGT(Ops[0], Ops[1])
+                                      : Builder.CreateICmpUGT(Ops[0], Ops[1]),
+                                  Ops[0], Ops[1]);
+    return true;
+  case BI_vmin:
+  case BI_vminf:
+  case BI_vmins:
+  case BI_vminu:
+    if (IsFP) {
+      IID = Intrinsic::arm_neon_vmins;
+      break;
+    }
+    Result = Builder.CreateSelect(IsSigned
+                                      ? Builder.CreateICmpSLT(Ops[0], Ops[1])
+                                      : Builder.CreateICmpULT(Ops[0], Ops[1]),
+                                  Ops[0], Ops[1]);
+    return true;
+  case BI_vclz: {
+    Function *ctlz =
+        Intrinsic::getDeclaration(TheModule, Intrinsic::ctlz, ResultType);
+    Value *Args[] = { Ops[0], Builder.getFalse() };
+    Result = Builder.CreateCall(ctlz, Args);
+    return true;
+  }
+  case BI_vcnt:
+    IID = Intrinsic::ctpop;
+    break;
+  case BI_vfma: {
+    // The first operand is the addend.
+    Function *fma =
+        Intrinsic::getDeclaration(TheModule, Intrinsic::fma, ResultType);
+    Value *Args[] = { Ops[1], Ops[2], Ops[0] };
+    Result = Builder.CreateCall(fma, Args);
+    return true;
+  }
+  case BI_vabd:
+  case BI_vabdf:
+  case BI_vabds:
+  case BI_vabdu:
+    IID = IsSigned ? Intrinsic::arm_neon_vabds : Intrinsic::arm_neon_vabdu;
+    break;
+  case BI_vhadd:
+  case BI_vhadds:
+  case BI_vhaddu:
+  case BI_vrhadds:
+  case BI_vrhaddu:
+    if (IsRounding)
+      IID = IsSigned ? Intrinsic::arm_neon_vrhadds
+                     : Intrinsic::arm_neon_vrhaddu;
+    else
+      IID = IsSigned ? Intrinsic::arm_neon_vhadds : Intrinsic::arm_neon_vhaddu;
+    break;
+  case BI_vpmax:
+  case BI_vpmaxf:
+  case BI_vpmaxs:
+  case BI_vpmaxu:
+    IID = IsSigned ? Intrinsic::arm_neon_vpmaxs : Intrinsic::arm_neon_vpmaxu;
+    break;
+  case BI_vpmin:
+  case BI_vpminf:
+  case BI_vpmins:
+  case BI_vpminu:
+    IID = IsSigned ? Intrinsic::arm_neon_vpmins : Intrinsic::arm_neon_vpminu;
+    break;
+  case BI_vqadd:
+  case BI_vqadds:
+  case BI_vqaddu:
+    IID = IsSigned ? Intrinsic::arm_neon_vqadds : Intrinsic::arm_neon_vqaddu;
+    break;
+  case BI_vqsub:
+  case BI_vqsubs:
+  case BI_vqsubu:
+    IID = IsSigned ? Intrinsic::arm_neon_vqsubs : Intrinsic::arm_neon_vqsubu;
+    break;
+  case BI_vqdmulh:
+  case BI_vqrdmulh:
+    IID = IsRounding ? Intrinsic::arm_neon_vqrdmulh
+                     : Intrinsic::arm_neon_vqdmulh;
+    break;
+  case BI_vcls:
+    IID = Intrinsic::arm_neon_vcls;
+    break;
+  case BI_vpadd:
+    IID = Intrinsic::arm_neon_vpadd;
+    break;
+  case BI_vrecpe:
+    IID = Intrinsic::arm_neon_vrecpe;
+    break;
+  case BI_vrecps:
+    IID = Intrinsic::arm_neon_vrecps;
+    break;
+  case BI_vrsqrte:
+    IID = Intrinsic::arm_neon_vrsqrte;
+    break;
+  case BI_vrsqrts:
+    IID = Intrinsic::arm_neon_vrsqrts;
+    break;
+  }
+
+  // The remaining operations are an intrinsic overloaded on the result type,
+  // applied to the operands.
+  Function *F = Intrinsic::getDeclaration(TheModule, IID, ResultType);
+  Result = Builder.CreateCall(F, Ops);
+  return true;
 }
@@ -18,5 +18,632 @@
 // Foundation, 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
 //
 //===----------------------------------------------------------------------===//
-// This file implements specific LLVM Mips ABI.
+// This file implements the MIPS O32, N32 and N64 ABIs and the MSA builtins.
 //===----------------------------------------------------------------------===//
+
+// Plugin headers
+#include "dragonegg/ABI.h"
+#include "dragonegg/Target.h"
+
+// LLVM headers
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/MC/SubtargetFeature.h"
+#include "llvm/IR/Module.h"
+
+// System headers
+#include <gmp.h>
+
+// GCC headers
+#include "auto-host.h"
+#ifndef ENABLE_BUILD_WITH_CXX
+#include <cstring> // Otherwise included by system.h with C linkage.
+extern "C" {
+#endif
+#include "config.h"
+// Stop GCC declaring 'getopt' as it can clash with the system's declaration.
+#undef HAVE_DECL_GETOPT
+#include "system.h"
+#include "coretypes.h"
+#include "tm.h"
+#include "target.h"
+#include "tree.h"
+
+#include "diagnostic.h"
+#if (GCC_MAJOR > 4)
+#include "function.h"
+#include "basic-block.h"
+#include "stor-layout.h"
+#endif
+#include "gimple.h"
+#include "toplev.h"
+#ifndef ENABLE_BUILD_WITH_CXX
+} // extern "C"
+#endif
+
+// Trees header.
+#include "dragonegg/Trees.h"
+
+using namespace llvm;
+
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 9)
+static LLVMContext &TheContext = getGlobalContext();
+#endif
+
+//===----------------------------------------------------------------------===//
+//                         ABI target hooks
+//===----------------------------------------------------------------------===//
+
+/// isSupportedABI - Whether the ABI in use is one of O32, N32 and N64.  The
+/// others (EABI and O64) are left to the generic code.
+static bool isSupportedABI() {
+  return mips_abi == ABI_32 || mips_abi == ABI_N32 || mips_abi == ABI_64;
+}
+
+/// getArgumentWords - Set Elts to the type of each word of an aggregate as it
+/// is passed in argument slots: an integer word, or under N32 and N64 with hard
+/// float a double for a word that is exactly a double field of a structure.
+/// Only the fields of the structure itself count, not those of nested
+/// structures.  Returns whether any word is a double.
+static bool getArgumentWords(tree type, std::vector<Type *> &Elts) {
+  LLVMContext &Context =
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+      TheModule->getContext();
+#else
+      TheContext;
+#endif
+  HOST_WIDE_INT Bytes = int_size_in_bytes(type);
+  unsigned Words = (Bytes + UNITS_PER_WORD - 1) / UNITS_PER_WORD;
+  Elts.assign(Words, IntegerType::get(Context, BITS_PER_WORD));
+
+  bool HasFPWords = false;
+  if (TARGET_NEWABI && TARGET_HARD_FLOAT_ABI && isa<RECORD_TYPE>(type))
+    for (tree Field = TYPE_FIELDS(type); Field; Field = TREE_CHAIN(Field)) {
+      if (!isa<FIELD_DECL>(Field) || isBitfield(Field))
+        continue;
+      tree FieldType = TREE_TYPE(Field);
+      if (!SCALAR_FLOAT_TYPE_P(FieldType) ||
+          TYPE_PRECISION(FieldType) != BITS_PER_WORD)
+        continue;
+      uint64_t Offset = getFieldOffsetInBits(Field);
+      if (Offset % BITS_PER_WORD)
+        continue;
+      Elts[Offset / BITS_PER_WORD] = Type::getDoubleTy(Context);
+      HasFPWords = true;
+    }
+  return HasFPWords;
+}
+
+/* Target hook for llvm-abi.h.  Aggregates that are more aligned than a word
+   start at an even numbered argument slot, which the code generator does for
+   byval arguments.  So do those too big for the argument registers, unless
+   they have floating point words: the code generator splits byval arguments
+   between integer registers and the stack itself.  */
+bool llvm_mips_should_pass_aggregate_using_byval_attr(tree type) {
+  HOST_WIDE_INT Bytes = int_size_in_bytes(type);
+  if (!isSupportedABI() || !isa<AGGREGATE_TYPE>(type) || Bytes <= 0)
+    return false;
+  if (TYPE_ALIGN(type) > BITS_PER_WORD)
+    return true;
+  if (Bytes <= MAX_ARGS_IN_REGISTERS * UNITS_PER_WORD)
+    return false;
+  std::vector<Type *> Elts;
+  return !getArgumentWords(type, Elts);
+}
+
+/* Target hook for llvm-abi.h.  Other aggregates are passed a word at a time,
+   each word in the next argument slot whether that is a register or the
+   stack.  The code generator puts the floating point words of variadic
+   arguments in integer registers, as GCC does.  */
+bool llvm_mips_should_pass_aggregate_in_mixed_regs(tree type, Type */*Ty*/,
+                                                   std::vector<Type *> &Elts) {
+  if (!isSupportedABI() || !isa<AGGREGATE_TYPE>(type) ||
+      int_size_in_bytes(type) <= 0 ||
+      llvm_mips_should_pass_aggregate_using_byval_attr(type))
+    return false;
+  getArgumentWords(type, Elts);
+  return true;
+}
+
+/* Target hook for llvm-abi.h.  Under N32 and N64 aggregates of up to 16 bytes
+   are returned in $2 and $3 as if loaded a doubleword at a time, which puts a
+   partial doubleword in the high part of the register on big endian machines.
+   Returning a whole number of doublewords gets that right.  */
+Type *llvm_mips_scalar_type_for_struct_return(tree type, unsigned *Offset) {
+  HOST_WIDE_INT Bytes = int_size_in_bytes(type);
+  if (!TARGET_NEWABI || Bytes <= 0 || Bytes > 16)
+    return getLLVMScalarTypeForStructReturn(type, Offset);
+  LLVMContext &Context =
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+      TheModule->getContext();
+#else
+      TheContext;
+#endif
+  *Offset = 0;
+  return IntegerType::get(Context, Bytes <= 8 ? 64 : 128);
+}
+
+/* Target hook for llvm-abi.h.  Under N32 and N64 with hard float, structures
+   made of one or two floating point fields are returned in $f0 and $f2.  They
+   are returned as a struct with the same fields.  */
+Type *llvm_mips_aggr_type_for_struct_return(tree type) {
+  if (!TARGET_NEWABI || !TARGET_HARD_FLOAT_ABI || !isa<RECORD_TYPE>(type))
+    return NULL;
+
+  SmallVector<tree, 2> Fields;
+  std::vector<Type *> Elts;
+  for (tree Field = TYPE_FIELDS(type); Field; Field = TREE_CHAIN(Field)) {
+    if (!isa<FIELD_DECL>(Field))
+      continue;
+    tree FieldType = TREE_TYPE(Field);
+    if (!SCALAR_FLOAT_TYPE_P(FieldType) || int_size_in_bytes(FieldType) > 8 ||
+        Fields.size() == 2)
+      return NULL;
+    Fields.push_back(Field);
+    Elts.push_back(ConvertType(FieldType));
+  }
+  if (Fields.empty())
+    return NULL;
+
+  LLVMContext &Context =
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+      Elts[0]->getContext();
+#else
+      TheContext;
+#endif
+  StructType *STy = StructType::get(Context, Elts, false);
+  // The fields are stored using the layout of STy, so it had better match.
+  const StructLayout *SL = getDataLayout().getStructLayout(STy);
+  for (unsigned i = 0, e = Fields.size(); i != e; ++i)
+    if (SL->getElementOffsetInBits(i) != getFieldOffsetInBits(Fields[i]))
+      return NULL;
+  return STy;
+}
+
+/* Target hook for llvm-abi.h.  Store the fields of a structure returned in
+   floating point registers in Dest.  */
+void llvm_mips_extract_multiple_return_value(
+    Value *Src, Value *Dest, bool isVolatile, LLVMBuilder &Builder) {
+  StructType *STy = cast<StructType>(Src->getType());
+  const StructLayout *SL = getDataLayout().getStructLayout(STy);
+  unsigned AS = cast<PointerType>(Dest->getType())->getAddressSpace();
+  Value *Ptr = Builder.CreateBitCast(Dest, Builder.getInt8PtrTy(AS));
+  for (unsigned i = 0, e = STy->getNumElements(); i != e; ++i) {
+    Type *EltTy = STy->getElementType(i);
+    Value *EltPtr = Builder.CreateConstGEP1_64(Ptr, SL->getElementOffset(i));
+    EltPtr = Builder.CreateBitCast(EltPtr, EltTy->getPointerTo(AS));
+    Builder.CreateAlignedStore(Builder.CreateExtractValue(Src, i), EltPtr, 1,
+                               isVolatile);
+  }
+}
+
+/* Target hook for llvm-abi.h.  Load the RealSize bytes at L, the last part of
+   an aggregate, into a register of type LLVMTy.  On big endian machines they
+   go in the high part of the register.  */
+Value *llvm_mips_load_scalar_argument(Value *L, Type *LLVMTy,
+                                      unsigned RealSize,
+                                      LLVMBuilder &Builder) {
+  if (!RealSize)
+    return UndefValue::get(LLVMTy);
+
+  assert(LLVMTy->isIntegerTy() && "Expected an integer value!");
+  LLVMContext &Context =
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+      LLVMTy->getContext();
+#else
+      TheContext;
+#endif
+  Type *LoadType = IntegerType::get(Context, RealSize * 8);
+  L = Builder.CreateBitCast(L, LoadType->getPointerTo());
+  Value *Val = Builder.CreateLoad(L);
+  unsigned LoadBits = LoadType->getPrimitiveSizeInBits();
+  unsigned RegBits = LLVMTy->getPrimitiveSizeInBits();
+  if (LoadBits >= RegBits)
+    return Builder.CreateTrunc(Val, LLVMTy);
+  Val = Builder.CreateZExt(Val, LLVMTy);
+  if (BYTES_BIG_ENDIAN)
+    Val = Builder.CreateShl(Val, RegBits - LoadBits);
+  return Val;
+}
+
+/* Target hook for llvm-abi.h.  The inverse of llvm_mips_load_scalar_argument:
+   store the argument ArgVal of type LLVMTy at Loc, keeping only the RealSize
+   bytes that belong to the aggregate if RealSize is not zero.  */
+void llvm_mips_store_scalar_argument(Value *Loc, Value *ArgVal, Type *LLVMTy,
+                                     unsigned RealSize,
+                                     LLVMBuilder &Builder) {
+  if (!RealSize) {
+    // This cast only involves pointers, therefore BitCast.
+    Loc = Builder.CreateBitCast(Loc, LLVMTy->getPointerTo());
+    Builder.CreateAlignedStore(ArgVal, Loc, 1);
+    return;
+  }
+
+  assert(ArgVal->getType()->isIntegerTy() && "Expected an integer value!");
+  LLVMContext &Context =
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+      ArgVal->getType()->getContext();
+#else
+      TheContext;
+#endif
+  Type *StoreType = IntegerType::get(Context, RealSize * 8);
+  unsigned StoreBits = StoreType->getPrimitiveSizeInBits();
+  unsigned RegBits = ArgVal->getType()->getPrimitiveSizeInBits();
+  Loc = Builder.CreateBitCast(Loc, StoreType->getPointerTo());
+  if (RegBits >= StoreBits) {
+    if (BYTES_BIG_ENDIAN && RegBits > StoreBits)
+      ArgVal = Builder.CreateLShr(ArgVal, RegBits - StoreBits);
+    ArgVal = Builder.CreateTrunc(ArgVal, StoreType);
+  } else {
+    ArgVal = Builder.CreateZExt(ArgVal, StoreType);
+  }
+  Builder.CreateStore(ArgVal, Loc);
+}
+
+//===----------------------------------------------------------------------===//
+//                         Subtarget features
+//===----------------------------------------------------------------------===//
+
+static void addFeature(llvm::SubtargetFeatures &F, const char *Feature,
+                       bool Enabled) {
+  const char *Prefix = Enabled ? "+" : "-";
+  F.AddFeature(std::string(Prefix) + Feature);
+}
+
+/// MipsOption - The LLVM name of a CPU or feature, and whether the GCC options
+/// in effect select it.
+struct MipsOption {
+  const char *Name;
+  bool Selected;
+};
+
+void llvm_mips_set_subtarget_features(std::string &C,
+                                      llvm::SubtargetFeatures &F) {
+  // GCC and LLVM agree on the names of the generic processors for each ISA,
+  // but not on those of most others, so pick the CPU by ISA, newest first.
+  // The Octeon is the exception since its extensions matter.
+  const MipsOption CPUs[] = {
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 5) && defined(TARGET_OCTEON)
+    { "octeon", TARGET_OCTEON },
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 4) && defined(ISA_MIPS64R6)
+    { "mips64r6", ISA_MIPS64R6 },
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 5) && defined(ISA_MIPS64R5)
+    { "mips64r5", ISA_MIPS64R5 },
+    { "mips64r3", ISA_MIPS64R3 },
+#endif
+    { "mips64r2", ISA_MIPS64R2 },
+    { "mips64", ISA_MIPS64 },
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 4) && defined(ISA_MIPS32R6)
+    { "mips32r6", ISA_MIPS32R6 },
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 5) && defined(ISA_MIPS32R5)
+    { "mips32r5", ISA_MIPS32R5 },
+    { "mips32r3", ISA_MIPS32R3 },
+#endif
+    { "mips32r2", ISA_MIPS32R2 },
+    { "mips32", ISA_MIPS32 },
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 4)
+    { "mips4", ISA_MIPS4 },
+    { "mips3", ISA_MIPS3 },
+    { "mips2", ISA_MIPS2 },
+    { "mips1", ISA_MIPS1 },
+#endif
+  };
+  for (unsigned i = 0, e = array_lengthof(CPUs); i != e; ++i)
+    if (CPUs[i].Selected) {
+      C = CPUs[i].Name;
+      break;
+    }
+
+  const MipsOption Features[] = {
+    { "soft-float", TARGET_SOFT_FLOAT_ABI },
+    { "single-float", TARGET_SINGLE_FLOAT },
+    { "fp64", TARGET_FLOAT64 },
+    { "mips16", TARGET_MIPS16 },
+    { "dsp", TARGET_DSP },
+    { "dspr2", TARGET_DSPR2 },
+#ifdef TARGET_MICROMIPS
+    { "micromips", TARGET_MICROMIPS },
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 3) && defined(TARGET_MSA)
+    { "msa", TARGET_MSA },
+#endif
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 6)
+    // Later versions take the ABI from the target options instead.
+    { "o32", mips_abi == ABI_32 },
+    { "n32", mips_abi == ABI_N32 },
+    { "n64", mips_abi == ABI_64 },
+#endif
+  };
+  for (unsigned i = 0, e = array_lengthof(Features); i != e; ++i)
+    addFeature(F, Features[i].Name, Features[i].Selected);
+}
+
+//===----------------------------------------------------------------------===//
+//                              Builtins
+//===----------------------------------------------------------------------===//
+
+/// BuiltinCode - A enumerated type with one value for each supported builtin.
+enum BuiltinCode {
+  SearchForHandler, // Builtin not seen before - search for a handler.
+#define DEFINE_BUILTIN(x) BI_##x
+#include "mips_builtins"
+#undef DEFINE_BUILTIN
+  ,
+  UnsupportedBuiltin // There is no handler for this builtin.
+};
+
+struct HandlerEntry {
+  const char *Name;
+  BuiltinCode Handler;
+};
+
+static bool HandlerLT(const HandlerEntry &E, const HandlerEntry &F) {
+  return strcmp(E.Name, F.Name) < 0;
+}
+
+/// getBuiltinBaseName - Return the name of an MSA builtin with the
+/// "__builtin_msa_" prefix and the element format suffix removed, or the empty
+/// string if this is not an MSA builtin.
+static std::string getBuiltinBaseName(const char *Identifier) {
+  static const char Prefix[] = "__builtin_msa_";
+  if (strncmp(Identifier, Prefix, sizeof(Prefix) - 1))
+    return std::string();
+  std::string Name(Identifier + sizeof(Prefix) - 1);
+  size_t Len = Name.size();
+  if (Len > 2 && Name[Len - 2] == '_' && strchr("bhwd", Name[Len - 1]))
+    Name.erase(Len - 2);
+  return Name;
+}
+
+/// CreateMinMaxNum - Emit a call to llvm.minnum or llvm.maxnum, or return null
+/// if LLVM is too old to have them.
+static Value *CreateMinMaxNum(bool IsMax, Value *LHS, Value *RHS,
+                              LLVMBuilder &Builder) {
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 5)
+  Function *F = Intrinsic::getDeclaration(
+      TheModule, IsMax ? Intrinsic::maxnum : Intrinsic::minnum, LHS->getType());
+  Value *Args[] = { LHS, RHS };
+  return Builder.CreateCall(F, Args);
+#else
+  (void) IsMax;
+  (void) LHS;
+  (void) RHS;
+  (void) Builder;
+  return 0;
+#endif
+}
+
+/// SplatImmediate - Turn the scalar Imm into a vector of type VecTy with every
+/// element equal to it.
+static Value *SplatImmediate(Value *Imm, Type *VecTy, bool IsSigned,
+                             LLVMBuilder &Builder) {
+  VectorType *VTy = cast<VectorType>(VecTy);
+  Value *Elt = Builder.CreateIntCast(Imm, VTy->getElementType(), IsSigned);
+  return Builder.CreateVectorSplat(VTy->getNumElements(), Elt);
+}
+
+/* TargetIntrinsicLower - For builtins that we want to expand to normal LLVM
+ * code, emit the code now.  If we can handle the code, this macro should emit
+ * the code, return true.  Builtins not handled here map directly onto the
+ * llvm.mips intrinsics of the same name.
+ */
+bool TreeToLLVM::TargetIntrinsicLower(GimpleTy */*stmt*/, tree fndecl,
+                                      const MemRef */*DestLoc*/,
+                                      Value *&Result,
+                                      Type *ResultType,
+                                      std::vector<Value *> &Ops) {
+  // As on x86, the enumerated type of DECL_FUNCTION_CODE values is private to
+  // the GCC backend, so map them to BuiltinCode at run-time using the name.
+  static std::vector<BuiltinCode> FunctionCodeMap;
+  if (FunctionCodeMap.size() <= DECL_FUNCTION_CODE(fndecl))
+    FunctionCodeMap.resize(DECL_FUNCTION_CODE(fndecl) + 1);
+
+  // See if we already associated a BuiltinCode with this DECL_FUNCTION_CODE.
+  BuiltinCode &Handler = FunctionCodeMap[DECL_FUNCTION_CODE(fndecl)];
+  if (Handler == SearchForHandler) {
+    // List of builtin base names and associated BuiltinCode.
+    static const HandlerEntry Handlers[] = {
+#define DEFINE_BUILTIN(x)                                                      \
+  { #x, BI_##x }
+#include "mips_builtins"
+#undef DEFINE_BUILTIN
+    };
+    size_t N = sizeof(Handlers) / sizeof(Handlers[0]);
+#ifndef NDEBUG
+    // Check that the list of handlers is sorted by name.
+    static bool Checked = false;
+    if (!Checked) {
+      for (unsigned i = 1; i < N; ++i)
+        assert(HandlerLT(Handlers[i - 1], Handlers[i]) &&
+               "Handlers not sorted!");
+      Checked = true;
+    }
+#endif
+
+    Handler = UnsupportedBuiltin;
+    std::string Name =
+        getBuiltinBaseName(IDENTIFIER_POINTER(DECL_NAME(fndecl)));
+    if (!Name.empty()) {
+      HandlerEntry ToFind = { Name.c_str(), SearchForHandler };
+      const HandlerEntry *E =
+          std::lower_bound(Handlers, Handlers + N, ToFind, HandlerLT);
+      if ((E < Handlers + N) && !strcmp(E->Name, ToFind.Name))
+        Handler = E->Handler;
+    }
+  }
+
+  // The immediate forms take a scalar second operand that applies to every
+  // element.  It is signed for the signed operations and for ceqi.
+  switch (Handler) {
+  default:
+    break;
+  case BI_ceqi:
+  case BI_clei_s:
+  case BI_clti_s:
+  case BI_maxi_s:
+  case BI_mini_s:
+    Ops[1] = SplatImmediate(Ops[1], Ops[0]->getType(), true, Builder);
+    break;
+  case BI_addvi:
+  case BI_andi:
+  case BI_clei_u:
+  case BI_clti_u:
+  case BI_maxi_u:
+  case BI_mini_u:
+  case BI_nori:
+  case BI_ori:
+  case BI_slli:
+  case BI_srai:
+  case BI_srli:
+  case BI_subvi:
+  case BI_xori:
+    Ops[1] = SplatImmediate(Ops[1], Ops[0]->getType(), false, Builder);
+    break;
+  }
+
+  Intrinsic::ID IID;
+  switch (Handler) {
+  case SearchForHandler:
+    llvm_unreachable("Unexpected builtin code!");
+  case UnsupportedBuiltin:
+    return false;
+  case BI_addv:
+  case BI_addvi:
+    Result = Builder.CreateAdd(Ops[0], Ops[1]);
+    return true;
+  case BI_subv:
+  case BI_subvi:
+    Result = Builder.CreateSub(Ops[0], Ops[1]);
+    return true;
+  case BI_mulv:
+    Result = Builder.CreateMul(Ops[0], Ops[1]);
+    return true;
+  case BI_and_v:
+  case BI_andi:
+    Result = Builder.CreateAnd(Ops[0], Ops[1]);
+    return true;
+  case BI_or_v:
+  case BI_ori:
+    Result = Builder.CreateOr(Ops[0], Ops[1]);
+    return true;
+  case BI_nor_v:
+  case BI_nori:
+    Result = Builder.CreateNot(Builder.CreateOr(Ops[0], Ops[1]));
+    return true;
+  case BI_xor_v:
+  case BI_xori:
+    Result = Builder.CreateXor(Ops[0], Ops[1]);
+    return true;
+  case BI_sll:
+  case BI_sra:
+  case BI_srl: {
+    // Only the low bits of each shift amount are used, so larger amounts wrap
+    // rather than giving an undefined result.
+    unsigned EltBits = ResultType->getScalarSizeInBits();
+    Value *Mask = ConstantInt::get(ResultType, EltBits - 1);
+    Value *Amount = Builder.CreateAnd(Ops[1], Mask);
+    if (Handler == BI_sll)
+      Result = Builder.CreateShl(Ops[0], Amount);
+    else if (Handler == BI_sra)
+      Result = Builder.CreateAShr(Ops[0], Amount);
+    else
+      Result = Builder.CreateLShr(Ops[0], Amount);
+    return true;
+  }
+  case BI_slli:
+    Result = Builder.CreateShl(Ops[0], Ops[1]);
+    return true;
+  case BI_srai:
+    Result = Builder.CreateAShr(Ops[0], Ops[1]);
+    return true;
+  case BI_srli:
+    Result = Builder.CreateLShr(Ops[0], Ops[1]);
+    return true;
+  case BI_max_s:
+  case BI_maxi_s:
+    Result = Builder.CreateSelect(Builder.CreateICmpSGT(Ops[0], Ops[1]), Ops[0],
+                                  Ops[1]);
+    return true;
+  case BI_max_u:
+  case BI_maxi_u:
+    Result = Builder.CreateSelect(Builder.CreateICmpUGT(Ops[0], Ops[1]), Ops[0],
+                                  Ops[1]);
+    return true;
+  case BI_min_s:
+  case BI_mini_s:
+    Result = Builder.CreateSelect(Builder.CreateICmpSLT(Ops[0], Ops[1]), Ops[0],
+                                  Ops[1]);
+    return true;
+  case BI_min_u:
+  case BI_mini_u:
+    Result = Builder.CreateSelect(Builder.CreateICmpULT(Ops[0], Ops[1]), Ops[0],
+                                  Ops[1]);
+    return true;
+  case BI_ceq:
+  case BI_ceqi:
+    Result = Builder.CreateSExt(Builder.CreateICmpEQ(Ops[0], Ops[1]),
+                                ResultType);
+    return true;
+  case BI_cle_s:
+  case BI_clei_s:
+    Result = Builder.CreateSExt(Builder.CreateICmpSLE(Ops[0], Ops[1]),
+                                ResultType);
+    return true;
+  case BI_cle_u:
+  case BI_clei_u:
+    Result = Builder.CreateSExt(Builder.CreateICmpULE(Ops[0], Ops[1]),
+                                ResultType);
+    return true;
+  case BI_clt_s:
+  case BI_clti_s:
+    Result = Builder.CreateSExt(Builder.CreateICmpSLT(Ops[0], Ops[1]),
+                                ResultType);
+    return true;
+  case BI_clt_u:
+  case BI_clti_u:
+    Result = Builder.CreateSExt(Builder.CreateICmpULT(Ops[0], Ops[1]),
+                                ResultType);
+    return true;
+  case BI_fill:
+  case BI_ldi:
+    Result = SplatImmediate(Ops[0], ResultType, true, Builder);
+    return true;
+  case BI_fadd:
+    Result = Builder.CreateFAdd(Ops[0], Ops[1]);
+    return true;
+  case BI_fsub:
+    Result = Builder.CreateFSub(Ops[0], Ops[1]);
+    return true;
+  case BI_fmul:
+    Result = Builder.CreateFMul(Ops[0], Ops[1]);
+    return true;
+  case BI_fdiv:
+    Result = Builder.CreateFDiv(Ops[0], Ops[1]);
+    return true;
+  case BI_fmax:
+  case BI_fmin:
+    // FMAX and FMIN ignore quiet NaNs, like llvm.maxnum and llvm.minnum.
+    Result = CreateMinMaxNum(Handler == BI_fmax, Ops[0], Ops[1], Builder);
+    return Result != 0;
+  case BI_fsqrt:
+    IID = Intrinsic::sqrt;
+    break;
+  case BI_pcnt:
+    IID = Intrinsic::ctpop;
+    break;
+  case BI_nlzc: {
+    Function *ctlz =
+        Intrinsic::getDeclaration(TheModule, Intrinsic::ctlz, ResultType);
+    Value *Args[] = { Ops[0], Builder.getFalse() };
+    Result = Builder.CreateCall(ctlz, Args);
+    return true;
+  }
+  }
+
+  // Unary operations that map onto an overloaded LLVM intrinsic.
+  Function *F = Intrinsic::getDeclaration(TheModule, IID, ResultType);
+  Result = Builder.CreateCall(F, Ops[0]);
+  return true;
+}
@@ -25,6 +25,9 @@
 #include "dragonegg/Target.h"
 
 // LLVM headers
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/MC/SubtargetFeature.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/MDBuilder.h"
@@ -43,6 +46,7 @@ extern "C" {
 #undef HAVE_DECL_GETOPT
 #include "system.h"
 #include "coretypes.h"
+#include "tm.h"
 #include "target.h"
 #include "tree.h"
 
@@ -79,20 +83,6 @@ extern void debug_gimple_stmt(union gimple_statement_d *);
 // Trees header.
 #include "dragonegg/Trees.h"
 
-// One day we will do parameter marshalling right: by using CUMULATIVE_ARGS.
-// While waiting for that happy day, just include a chunk of i386.c.
-#if (GCC_MAJOR > 7)
-#include "memmodel.h"
-#include "tree-vrp.h"
-#include "ABIHack8.inc"
-#elif GCC_MAJOR > 5
-#include "ABIHack6.inc"
-#elif GCC_VERSION_CODE > GCC_VERSION(4, 8)
-#pragma error("Unimplemented yet about ABIHack4.9.inc")
-#else
-#include "ABIHack.inc"
-#endif
-
 using namespace llvm;
 
 #if LLVM_VERSION_CODE < LLVM_VERSION(3, 9)
@@ -115,6 +105,36 @@ static Value *BitCastToIntVector(Value *Op, LLVMBuilder &Builder) {
                                VectorType::get(IntTy, VecTy->getNumElements()));
 }
 
+/// isWriteMasked - Whether Ops are the operands of an AVX-512 masked builtin
+/// with two vector operands: the operands, a merge source of the same type, and
+/// a write mask with at least one bit per element.  Checked before emitting the
+/// operation so that nothing is left behind if the builtin is not handled.
+static bool isWriteMasked(const std::vector<Value *> &Ops) {
+  if (Ops.size() != 4)
+    return false;
+  VectorType *VecTy = dyn_cast<VectorType>(Ops[0]->getType());
+  if (!VecTy || Ops[1]->getType() != VecTy || Ops[2]->getType() != VecTy)
+    return false;
+  Type *MaskTy = Ops[3]->getType();
+  return MaskTy->isIntegerTy() &&
+         MaskTy->getPrimitiveSizeInBits() >= VecTy->getNumElements();
+}
+
+/// ApplyWriteMask - Merge Op, the result of an AVX-512 masked builtin with
+/// operands Ops, with the merge source Ops[2] under the write mask Ops[3]:
+/// element i comes from Op if bit i of the mask is set, and from the merge
+/// source otherwise.  The operands must satisfy isWriteMasked.
+static Value *ApplyWriteMask(Value *Op, std::vector<Value *> &Ops,
+                             LLVMBuilder &Builder) {
+  assert(isWriteMasked(Ops) && "Not a write masked builtin!");
+  unsigned NElts = cast<VectorType>(Op->getType())->getNumElements();
+  // Only the low NElts bits of the mask are used.
+  Value *Mask = Builder.CreateTrunc(Ops[3], Builder.getIntNTy(NElts));
+  Mask = Builder.CreateBitCast(Mask,
+                               VectorType::get(Builder.getInt1Ty(), NElts));
+  return Builder.CreateSelect(Mask, Op, Ops[2]);
+}
+
 /// BuiltinCode - A enumerated type with one value for each supported builtin.
 enum BuiltinCode {
   SearchForHandler, // Builtin not seen before - search for a handler.
@@ -132,10 +152,6 @@ struct HandlerEntry {
   BuiltinCode Handler;
 };
 
-static bool HandlerLT(const HandlerEntry &E, const HandlerEntry &F) {
-  return strcmp(E.Name, F.Name) < 0;
-}
-
 /* TargetIntrinsicLower - For builtins that we want to expand to normal LLVM
  * code, emit the code now.  If we can handle the code, this macro should emit
  * the code, return true.
@@ -164,34 +180,32 @@ bool TreeToLLVM::TargetIntrinsicLower(GimpleTy *stmt, tree fndecl,
     // No associated BuiltinCode.  Work out what value to use based on the
     // builtin's name.
 
-    // List of builtin names and associated BuiltinCode.
-    static const HandlerEntry Handlers[] = {
-      { "__builtin_clzs", clzs }, // Builtin with exceptional name.
-      { "__builtin_ctzs", ctzs }, // Builtin with exceptional name.
+    // Map from builtin names to the associated BuiltinCode, built on first
+    // use.  The names all start with "__builtin_ia32_", which is left off.
+    static StringMap<BuiltinCode> HandlerMap;
+    if (HandlerMap.empty()) {
+      static const HandlerEntry Handlers[] = {
 #define DEFINE_BUILTIN(x)                                                      \
-  { "__builtin_ia32_" #x, x }
+  { #x, x }
 #include "x86_builtins"
 #undef DEFINE_BUILTIN
-    };
-    size_t N = sizeof(Handlers) / sizeof(Handlers[0]);
-#ifndef NDEBUG
-    // Check that the list of handlers is sorted by name.
-    static bool Checked = false;
-    if (!Checked) {
-      for (unsigned i = 1; i < N; ++i)
-        assert(HandlerLT(Handlers[i - 1], Handlers[i]) &&
-               "Handlers not sorted!");
-      Checked = true;
+      };
+      for (unsigned i = 0, e = array_lengthof(Handlers); i != e; ++i)
+        HandlerMap[Handlers[i].Name] = Handlers[i].Handler;
     }
-#endif
 
     Handler = UnsupportedBuiltin;
-    const char *Identifier = IDENTIFIER_POINTER(DECL_NAME(fndecl));
-    HandlerEntry ToFind = { Identifier, SearchForHandler };
-    const HandlerEntry *E =
-        std::lower_bound(Handlers, Handlers + N, ToFind, HandlerLT);
-    if ((E < Handlers + N) && !strcmp(E->Name, ToFind.Name))
-      Handler = E->Handler;
+    StringRef Identifier = IDENTIFIER_POINTER(DECL_NAME(fndecl));
+    if (Identifier.startswith("__builtin_ia32_")) {
+      StringMap<BuiltinCode>::const_iterator I =
+          HandlerMap.find(Identifier.substr(sizeof("__builtin_ia32_") - 1));
+      if (I != HandlerMap.end())
+        Handler = I->second;
+    } else if (Identifier == "__builtin_clzs") {
+      Handler = clzs; // Builtin with exceptional name.
+    } else if (Identifier == "__builtin_ctzs") {
+      Handler = ctzs; // Builtin with exceptional name.
+    }
   }
 
   bool flip = false;
@@ -252,6 +266,10 @@ bool TreeToLLVM::TargetIntrinsicLower(GimpleTy *stmt, tree fndecl,
   case paddw128:
   case paddd128:
   case paddq128:
+  case paddb256:
+  case paddw256:
+  case paddd256:
+  case paddq256:
     Result = Builder.CreateAdd(Ops[0], Ops[1]);
     return true;
   case subps:
@@ -268,6 +286,10 @@ bool TreeToLLVM::TargetIntrinsicLower(GimpleTy *stmt, tree fndecl,
   case psubw128:
   case psubd128:
   case psubq128:
+  case psubb256:
+  case psubw256:
+  case psubd256:
+  case psubq256:
     Result = Builder.CreateSub(Ops[0], Ops[1]);
     return true;
   case mulps:
@@ -278,7 +300,9 @@ bool TreeToLLVM::TargetIntrinsicLower(GimpleTy *stmt, tree fndecl,
     return true;
   case pmullw:
   case pmullw128:
+  case pmullw256:
   case pmulld128:
+  case pmulld256:
     Result = Builder.CreateMul(Ops[0], Ops[1]);
     return true;
   case divps:
@@ -289,21 +313,131 @@ bool TreeToLLVM::TargetIntrinsicLower(GimpleTy *stmt, tree fndecl,
     return true;
   case pand:
   case pand128:
+  case andsi256:
     Result = Builder.CreateAnd(Ops[0], Ops[1]);
     return true;
   case pandn:
   case pandn128:
+  case andnotsi256:
     Ops[0] = Builder.CreateNot(Ops[0]);
     Result = Builder.CreateAnd(Ops[0], Ops[1]);
     return true;
   case por:
   case por128:
+  case por256:
     Result = Builder.CreateOr(Ops[0], Ops[1]);
     return true;
   case pxor:
   case pxor128:
+  case pxor256:
     Result = Builder.CreateXor(Ops[0], Ops[1]);
     return true;
+  case paddb128_mask:
+  case paddb256_mask:
+  case paddb512_mask:
+  case paddw128_mask:
+  case paddw256_mask:
+  case paddw512_mask:
+  case paddd128_mask:
+  case paddd256_mask:
+  case paddd512_mask:
+  case paddq128_mask:
+  case paddq256_mask:
+  case paddq512_mask:
+    if (!isWriteMasked(Ops))
+      return false;
+    Result = ApplyWriteMask(Builder.CreateAdd(Ops[0], Ops[1]), Ops, Builder);
+    return true;
+  case psubb128_mask:
+  case psubb256_mask:
+  case psubb512_mask:
+  case psubw128_mask:
+  case psubw256_mask:
+  case psubw512_mask:
+  case psubd128_mask:
+  case psubd256_mask:
+  case psubd512_mask:
+  case psubq128_mask:
+  case psubq256_mask:
+  case psubq512_mask:
+    if (!isWriteMasked(Ops))
+      return false;
+    Result = ApplyWriteMask(Builder.CreateSub(Ops[0], Ops[1]), Ops, Builder);
+    return true;
+  case pmullw128_mask:
+  case pmullw256_mask:
+  case pmullw512_mask:
+  case pmulld128_mask:
+  case pmulld256_mask:
+  case pmulld512_mask:
+    if (!isWriteMasked(Ops))
+      return false;
+    Result = ApplyWriteMask(Builder.CreateMul(Ops[0], Ops[1]), Ops, Builder);
+    return true;
+  case pandd128_mask:
+  case pandd256_mask:
+  case pandd512_mask:
+  case pandq128_mask:
+  case pandq256_mask:
+  case pandq512_mask:
+    if (!isWriteMasked(Ops))
+      return false;
+    Result = ApplyWriteMask(Builder.CreateAnd(Ops[0], Ops[1]), Ops, Builder);
+    return true;
+  case pandnd128_mask:
+  case pandnd256_mask:
+  case pandnd512_mask:
+  case pandnq128_mask:
+  case pandnq256_mask:
+  case pandnq512_mask:
+    if (!isWriteMasked(Ops))
+      return false;
+    Ops[0] = Builder.CreateNot(Ops[0]);
+    Result = ApplyWriteMask(Builder.CreateAnd(Ops[0], Ops[1]), Ops, Builder);
+    return true;
+  case pord128_mask:
+  case pord256_mask:
+  case pord512_mask:
+  case porq128_mask:
+  case porq256_mask:
+  case porq512_mask:
+    if (!isWriteMasked(Ops))
+      return false;
+    Result = ApplyWriteMask(Builder.CreateOr(Ops[0], Ops[1]), Ops, Builder);
+    return true;
+  case pxord128_mask:
+  case pxord256_mask:
+  case pxord512_mask:
+  case pxorq128_mask:
+  case pxorq256_mask:
+  case pxorq512_mask:
+    if (!isWriteMasked(Ops))
+      return false;
+    Result = ApplyWriteMask(Builder.CreateXor(Ops[0], Ops[1]), Ops, Builder);
+    return true;
+  case vfmaddpd:
+  case vfmaddpd256:
+  case vfmaddps:
+  case vfmaddps256: {
+    Function *fma =
+        Intrinsic::getDeclaration(TheModule, Intrinsic::fma, ResultType);
+    Result = Builder.CreateCall(fma, Ops);
+    return true;
+  }
+  case vfmaddsd3:
+  case vfmaddss3: {
+    // Fused multiply-add of the low elements; the other elements are taken
+    // from the first operand.
+    Type *EltTy = cast<VectorType>(ResultType)->getElementType();
+    Function *fma = Intrinsic::getDeclaration(TheModule, Intrinsic::fma, EltTy);
+    Value *Zero = Builder.getInt32(0);
+    Value *Args[3];
+    for (unsigned i = 0; i != 3; ++i)
+      Args[i] = Builder.CreateExtractElement(Ops[i], Zero);
+    Result = Builder.CreateCall(fma, Args);
+    Result = Builder.CreateInsertElement(Ops[0], Result, Zero);
+    return true;
+  }
   case andps:
   case andps256:
   case andpd:
@@ -816,7 +950,7 @@ bool TreeToLLVM::TargetIntrinsicLower(GimpleTy *stmt, tree fndecl,
   case ldmxcsr: {
     Function *ldmxcsr =
         Intrinsic::getDeclaration(TheModule, Intrinsic::x86_sse_ldmxcsr);
-    Value *Ptr = CreateTemporary(Type::getInt32Ty(Context));
+    Value *Ptr = CreateScratchTemporary(Type::getInt32Ty(Context));
     Builder.CreateStore(Ops[0], Ptr);
     Ptr = Builder.CreateBitCast(Ptr, Type::getInt8PtrTy(Context));
     Builder.CreateCall(ldmxcsr, Ptr);
@@ -825,7 +959,7 @@ bool TreeToLLVM::TargetIntrinsicLower(GimpleTy *stmt, tree fndecl,
   case stmxcsr: {
     Function *stmxcsr =
         Intrinsic::getDeclaration(TheModule, Intrinsic::x86_sse_stmxcsr);
-    Value *Ptr = CreateTemporary(Type::getInt32Ty(Context));
+    Value *Ptr = CreateScratchTemporary(Type::getInt32Ty(Context));
     Value *BPtr = Builder.CreateBitCast(Ptr, Type::getInt8PtrTy(Context));
     Builder.CreateCall(stmxcsr, BPtr);
 
@@ -958,6 +1092,7 @@ bool TreeToLLVM::TargetIntrinsicLower(GimpleTy *stmt, tree fndecl,
   case movntdq:
   case movntdq256:
   case movnti:
+  case movnti64:
   case movntpd:
   case movntpd256:
   case movntps:
@@ -971,15 +1106,40 @@ bool TreeToLLVM::TargetIntrinsicLower(GimpleTy *stmt, tree fndecl,
 #endif
             (Builder.getInt32(1)));
 
+    // The scalar forms only store the low element of the vector.
+    Value *Val = Ops[1];
+    if (Handler == movntsd || Handler == movntss)
+      Val = Builder.CreateExtractElement(Val, Builder.getInt32(0));
+
     // Convert the type of the pointer to a pointer to the stored type.
     unsigned AS = Ops[0]->getType()->getPointerAddressSpace();
     Value *Ptr = Builder.CreateBitCast(
-        Ops[0], PointerType::get(Ops[1]->getType(), AS), "cast");
+        Ops[0], PointerType::get(Val->getType(), AS), "cast");
 
-    StoreInst *SI = Builder.CreateAlignedStore(Ops[1], Ptr, 16);
+    // The instructions need the address to be aligned to the size stored, and
+    // the code generator only uses them if the store says it is.
+    unsigned Align = getDataLayout().getTypeStoreSize(Val->getType());
+    StoreInst *SI = Builder.CreateAlignedStore(Val, Ptr, Align);
     SI->setMetadata(TheModule->getMDKindID("nontemporal"), Node);
     return true;
   }
+  case movntdqa:
+  case movntdqa256: {
+    MDNode *Node = MDNode::get(Context,
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+            ConstantAsMetadata::get
+#endif
+            (Builder.getInt32(1)));
+
+    unsigned AS = Ops[0]->getType()->getPointerAddressSpace();
+    Value *Ptr = Builder.CreateBitCast(
+        Ops[0], PointerType::get(ResultType, AS), "cast");
+    LoadInst *LI = Builder.CreateAlignedLoad(
+        Ptr, getDataLayout().getTypeStoreSize(ResultType));
+    LI->setMetadata(TheModule->getMDKindID("nontemporal"), Node);
+    Result = LI;
+    return true;
+  }
   case rsqrtf: {
     // rsqrtss with a Newton-Raphson step to improve accuracy:
     //   rsqrtf(x) = rsqrtss(x) * -0.5 * (rsqrtss(x) * x * rsqrtss(x) - 3.0)
@@ -1143,32 +1303,475 @@ bool TreeToLLVM::TargetIntrinsicLower(GimpleTy *stmt, tree fndecl,
   llvm_unreachable("Forgot case for code?");
 }
 
+/// TargetVectorPermute - Permute the elements of the 128 bit vectors V0 and V1
+/// by the variable mask (a vector of i32 indices already reduced modulo twice
+/// the length) with pshufb on the bytes, rather than element by element.  The
+/// second pshufb and the blend are not needed for a one vector permutation.
+/// Returns null if SSSE3 is not available.
+Value *TreeToLLVM::TargetVectorPermute(Value *V0, Value *V1, Value *Mask,
+                                       bool OneInput) {
+  VectorType *VecTy = cast<VectorType>(V0->getType());
+  if (!TARGET_SSSE3 || VecTy->getPrimitiveSizeInBits() != 128)
+    return 0;
+
+  // Byte j of element i of the result is byte Mask[i]*EltBytes+j of the pair
+  // of input vectors.
+  unsigned Length = VecTy->getNumElements();
+  unsigned EltBytes = 16 / Length;
+  Type *ByteVecTy = VectorType::get(Builder.getInt8Ty(), 16);
+  Value *Idx = Mask;
+  if (EltBytes > 1) {
+    SmallVector<Constant *, 16> Spread, Offsets;
+    for (unsigned i = 0; i != 16; ++i) {
+      Spread.push_back(Builder.getInt32(i / EltBytes));
+      Offsets.push_back(Builder.getInt32(i % EltBytes));
+    }
+    Idx = Builder.CreateShuffleVector(Mask, UndefValue::get(Mask->getType()),
+                                      ConstantVector::get(Spread));
+    Idx = Builder.CreateMul(Idx, ConstantInt::get(Idx->getType(), EltBytes));
+    Idx = Builder.CreateAdd(Idx, ConstantVector::get(Offsets));
+  }
+  Idx = Builder.CreateTrunc(Idx, ByteVecTy);
+
+  // Indices with the top bit clear select the byte given by the bottom four.
+  Function *pshufb =
+      Intrinsic::getDeclaration(TheModule, Intrinsic::x86_ssse3_pshuf_b_128);
+  Value *Low = Builder.CreateAnd(Idx, ConstantInt::get(ByteVecTy, 15));
+  Value *Ops[2] = { Builder.CreateBitCast(V0, ByteVecTy), Low };
+  Value *Result = Builder.CreateCall(pshufb, Ops, "pshufb");
+  if (!OneInput) {
+    Ops[0] = Builder.CreateBitCast(V1, ByteVecTy);
+    Value *FromV1 =
+        Builder.CreateICmpUGT(Idx, ConstantInt::get(ByteVecTy, 15));
+    Result = Builder.CreateSelect(
+        FromV1, Builder.CreateCall(pshufb, Ops, "pshufb"), Result);
+  }
+  return Builder.CreateBitCast(Result, VecTy);
+}
+
+/// MAX_CLASSES - The largest number of eightbytes a value passed or returned
+/// in registers can occupy: a 512 bit vector.
+#define MAX_CLASSES 8
+
+/// MergeClasses - Return the class of an eightbyte holding data of both the
+/// given classes.  See the x86-64 PS ABI for details.
+static x86_64_reg_class MergeClasses(x86_64_reg_class Class1,
+                                     x86_64_reg_class Class2) {
+  // Rule #1: If both classes are equal, this is the resulting class.
+  if (Class1 == Class2)
+    return Class1;
+
+  // Rule #2: If one of the classes is NO_CLASS, the resulting class is the
+  // other class.
+  if (Class1 == X86_64_NO_CLASS)
+    return Class2;
+  if (Class2 == X86_64_NO_CLASS)
+    return Class1;
+
+  // Rule #3: If one of the classes is MEMORY, the result is MEMORY.
+  if (Class1 == X86_64_MEMORY_CLASS || Class2 == X86_64_MEMORY_CLASS)
+    return X86_64_MEMORY_CLASS;
+
+  // Rule #4: If one of the classes is INTEGER, the result is INTEGER.
+  if ((Class1 == X86_64_INTEGERSI_CLASS && Class2 == X86_64_SSESF_CLASS) ||
+      (Class2 == X86_64_INTEGERSI_CLASS && Class1 == X86_64_SSESF_CLASS))
+    return X86_64_INTEGERSI_CLASS;
+  if (Class1 == X86_64_INTEGER_CLASS || Class1 == X86_64_INTEGERSI_CLASS ||
+      Class2 == X86_64_INTEGER_CLASS || Class2 == X86_64_INTEGERSI_CLASS)
+    return X86_64_INTEGER_CLASS;
+
+  // Rule #5: If one of the classes is X87, X87UP, or COMPLEX_X87 class,
+  // MEMORY is used.
+  if (Class1 == X86_64_X87_CLASS || Class1 == X86_64_X87UP_CLASS ||
+      Class1 == X86_64_COMPLEX_X87_CLASS || Class2 == X86_64_X87_CLASS ||
+      Class2 == X86_64_X87UP_CLASS || Class2 == X86_64_COMPLEX_X87_CLASS)
+    return X86_64_MEMORY_CLASS;
+
+  // Rule #6: Otherwise class SSE is used.
+  return X86_64_SSE_CLASS;
+}
+
+/// ClassifyInteger - Classify integer data of the given size in bits, which
+/// starts BitOffset bits into an eightbyte.
+static int ClassifyInteger(unsigned Bits, int BitOffset,
+                           x86_64_reg_class Classes[MAX_CLASSES]) {
+  // Analyze the last 128 bits only.
+  unsigned Size = (BitOffset + Bits - 1) & 0x7f;
+  if (Size < 32) {
+    Classes[0] = X86_64_INTEGERSI_CLASS;
+    return 1;
+  }
+  Classes[0] = X86_64_INTEGER_CLASS;
+  if (Size < 64)
+    return 1;
+  Classes[1] = Size < 64 + 32 ? X86_64_INTEGERSI_CLASS : X86_64_INTEGER_CLASS;
+  return 2;
+}
+
+/// getVectorRegisterBytes - The size in bytes of the widest vector registers
+/// values can be passed in.  Vectors of 8 and 16 bytes always use SSE
+/// registers, even if SSE is disabled.
+static unsigned getVectorRegisterBytes() {
+#ifdef TARGET_AVX512F
+  if (TARGET_AVX512F)
+    return 64;
+#endif
+  return TARGET_AVX ? 32 : 16;
+}
+
+/// ClassifyVector - Classify a vector type of the given size in bytes.  Only
+/// vectors that fit in a vector register the ABI knows about are passed in SSE
+/// registers.
+static int ClassifyVector(tree type, HOST_WIDE_INT Bytes, int BitOffset,
+                          x86_64_reg_class Classes[MAX_CLASSES]) {
+  tree EltType = TREE_TYPE(type);
+
+  // There are no vector registers holding x87 values.
+  if (isa<REAL_TYPE>(EltType) && TYPE_PRECISION(EltType) == 80)
+    return 0;
+
+  // A single 64 or 128 bit integer, see ClassifyScalar.
+  if (TYPE_VECTOR_SUBPARTS(type) == 1) {
+    Classes[0] = X86_64_SSE_CLASS;
+    return 1;
+  }
+
+  switch (Bytes) {
+  case 8:
+  case 16:
+  case 32:
+  case 64:
+    if (Bytes > getVectorRegisterBytes())
+      return 0;
+    Classes[0] = X86_64_SSE_CLASS;
+    for (int i = 1, e = Bytes / 8; i < e; ++i)
+      Classes[i] = X86_64_SSEUP_CLASS;
+    return Bytes / 8;
+  default:
+    // Small integer vectors are passed like integers.
+    if (Bytes > 16 || !INTEGRAL_TYPE_P(EltType))
+      return 0;
+    Classes[0] = BitOffset + Bytes * 8 <= 32 ? X86_64_INTEGERSI_CLASS
+                                             : X86_64_INTEGER_CLASS;
+    Classes[1] = X86_64_INTEGER_CLASS;
+    return 1 + (Bytes > 8);
+  }
+}
+
+/// ClassifyScalar - Classify a value of non-aggregate type.
+static int ClassifyScalar(tree type, HOST_WIDE_INT Bytes, int BitOffset,
+                          x86_64_reg_class Classes[MAX_CLASSES]) {
+  // Generic code allows vectors with only one element.  Apart from those of 64
+  // and 128 bit integers, which go in an SSE register, these are passed like
+  // the element.
+  if (isa<VECTOR_TYPE>(type) && TYPE_VECTOR_SUBPARTS(type) == 1 &&
+      (!INTEGRAL_TYPE_P(TREE_TYPE(type)) || (Bytes != 8 && Bytes != 16)))
+    return ClassifyScalar(TREE_TYPE(type), Bytes, BitOffset, Classes);
+
+  // All scalars are naturally aligned, with complex numbers aligned like
+  // their parts.  Misaligned values are always passed in memory.
+  HOST_WIDE_INT Alignment = isa<COMPLEX_TYPE>(type) ? Bytes * 4 : Bytes * 8;
+  if (!Alignment || BitOffset % Alignment)
+    return 0;
+
+  switch (TREE_CODE(type)) {
+  default:
+    return 0;
+
+  case BOOLEAN_TYPE:
+  case ENUMERAL_TYPE:
+  case INTEGER_TYPE:
+#if GCC_VERSION_CODE > GCC_VERSION(4, 5)
+  case NULLPTR_TYPE:
+#endif
+  case OFFSET_TYPE:
+  case POINTER_TYPE:
+  case REFERENCE_TYPE:
+    if (Bytes > 16)
+      return 0;
+    if (Bytes == 16) {
+      Classes[0] = Classes[1] = X86_64_INTEGER_CLASS;
+      return 2;
+    }
+    return ClassifyInteger(Bytes * 8, BitOffset, Classes);
+
+  case REAL_TYPE:
+    if (DECIMAL_FLOAT_TYPE_P(type) || Bytes == 16) {
+      if (Bytes > 16)
+        return 0;
+      // Long double lives in x87 registers, _Float128 and _Decimal128 in SSE.
+      bool IsX87 = !DECIMAL_FLOAT_TYPE_P(type) && TYPE_PRECISION(type) == 80;
+      Classes[0] = IsX87 ? X86_64_X87_CLASS : X86_64_SSE_CLASS;
+      if (Bytes < 16)
+        return 1;
+      Classes[1] = IsX87 ? X86_64_X87UP_CLASS : X86_64_SSEUP_CLASS;
+      return 2;
+    }
+    if (Bytes == 4) {
+      Classes[0] = BitOffset % 64 ? X86_64_SSE_CLASS : X86_64_SSESF_CLASS;
+      return 1;
+    }
+    if (Bytes == 8) {
+      Classes[0] = X86_64_SSEDF_CLASS;
+      return 1;
+    }
+    return 0;
+
+  case COMPLEX_TYPE: {
+    tree EltType = TREE_TYPE(type);
+    if (INTEGRAL_TYPE_P(EltType)) {
+      // Complex integers are classified like one integer of the same size,
+      // except for complex __int128 which is passed in memory.
+      if (Bytes > 16)
+        return 0;
+      if (Bytes == 16) {
+        Classes[0] = Classes[1] = X86_64_INTEGER_CLASS;
+        return 2;
+      }
+      return ClassifyInteger(Bytes * 8, BitOffset, Classes);
+    }
+    if (!isa<REAL_TYPE>(EltType) || DECIMAL_FLOAT_TYPE_P(EltType))
+      return 0;
+    switch (Bytes) {
+    default:
+      return 0;
+    case 8:
+      // Complex float.
+      Classes[0] = X86_64_SSE_CLASS;
+      if (!(BitOffset % 64))
+        return 1;
+      Classes[1] = X86_64_SSESF_CLASS;
+      return 2;
+    case 16:
+      // Complex double.
+      Classes[0] = Classes[1] = X86_64_SSEDF_CLASS;
+      return 2;
+    case 32:
+      // Complex long double goes in x87 registers when returned, and in memory
+      // otherwise.  Complex _Float128 is always passed in memory.
+      if (TYPE_PRECISION(EltType) != 80)
+        return 0;
+      Classes[0] = X86_64_COMPLEX_X87_CLASS;
+      return 1;
+    }
+  }
+
+  case VECTOR_TYPE:
+    return ClassifyVector(type, Bytes, BitOffset, Classes);
+  }
+}
+
+/// ClassifyAt - Classify each eightbyte of a value of the given type which
+/// starts BitOffset bits (taken modulo 512) into the containing aggregate.
+/// Returns the number of eightbytes, or zero if the value is passed in
+/// memory.  As a special case, zero sized aggregates get a single NO_CLASS
+/// eightbyte.  See the x86-64 PS ABI for details.
+static int ClassifyAt(tree type, int BitOffset,
+                      x86_64_reg_class Classes[MAX_CLASSES]) {
+  HOST_WIDE_INT Bytes = int_size_in_bytes(type);
+
+  // Variable sized entities are always passed/returned in memory.
+  if (Bytes < 0)
+    return 0;
+
+  if (targetm.calls.must_pass_in_stack(TYPE_MODE(type), type))
+    return 0;
+
+  if (!AGGREGATE_TYPE_P(type))
+    return ClassifyScalar(type, Bytes, BitOffset, Classes);
+
+  // Aggregates larger than 64 bytes are passed on the stack.
+  if (Bytes > 64)
+    return 0;
+
+  int Words = (Bytes + (BitOffset % 64) / 8 + 7) / 8;
+  for (int i = 0; i < Words; ++i)
+    Classes[i] = X86_64_NO_CLASS;
+
+  // Zero sized arrays or structures are NO_CLASS.  Returning zero means memory,
+  // so this is handled as a special case.
+  if (!Words) {
+    Classes[0] = X86_64_NO_CLASS;
+    return 1;
+  }
+
+  x86_64_reg_class SubClasses[MAX_CLASSES];
+  switch (TREE_CODE(type)) {
+  default:
+    llvm_unreachable("Unexpected aggregate type!");
+
+  case RECORD_TYPE:
+    for (tree Field = TYPE_FIELDS(type); Field; Field = TREE_CHAIN(Field)) {
+      if (!isa<FIELD_DECL>(Field) || TREE_TYPE(Field) == error_mark_node)
+        continue;
+      int FieldOffset = getFieldOffsetInBits(Field) % 512;
+
+      // Bitfields are always classified as integer.
+      if (DECL_BIT_FIELD(Field)) {
+        int Begin = FieldOffset + (BitOffset % 64);
+        int End = Begin + getInt64(DECL_SIZE(Field), true);
+        for (int i = Begin / 64; i < (End + 63) / 64; ++i)
+          Classes[i] = MergeClasses(X86_64_INTEGER_CLASS, Classes[i]);
+        continue;
+      }
+
+      // Flexible array members are ignored.
+      tree FieldType = TREE_TYPE(Field);
+      if (isa<ARRAY_TYPE>(FieldType) && !TYPE_SIZE(FieldType))
+        continue;
+
+      int Num = ClassifyAt(FieldType, (FieldOffset + BitOffset) % 512,
+                           SubClasses);
+      if (!Num)
+        return 0;
+      int Pos = (FieldOffset + (BitOffset % 64)) / 64;
+      for (int i = 0; i < Num && i + Pos < Words; ++i)
+        Classes[i + Pos] = MergeClasses(SubClasses[i], Classes[i + Pos]);
+    }
+    break;
+
+  case ARRAY_TYPE: {
+    // Arrays are handled as small records.
+    int Num = ClassifyAt(TREE_TYPE(type), BitOffset, SubClasses);
+    if (!Num)
+      return 0;
+
+    // The partial classes are now full classes.
+    if (SubClasses[0] == X86_64_SSESF_CLASS && Bytes != 4)
+      SubClasses[0] = X86_64_SSE_CLASS;
+    if (SubClasses[0] == X86_64_INTEGERSI_CLASS &&
+        !((BitOffset % 64) == 0 && Bytes == 4))
+      SubClasses[0] = X86_64_INTEGER_CLASS;
+
+    for (int i = 0; i < Words; ++i)
+      Classes[i] = SubClasses[i % Num];
+    break;
+  }
+
+  case UNION_TYPE:
+  case QUAL_UNION_TYPE:
+    // Unions are similar to records, except that the offset is always zero.
+    for (tree Field = TYPE_FIELDS(type); Field; Field = TREE_CHAIN(Field)) {
+      if (!isa<FIELD_DECL>(Field) || TREE_TYPE(Field) == error_mark_node)
+        continue;
+      int Num = ClassifyAt(TREE_TYPE(Field), BitOffset, SubClasses);
+      if (!Num)
+        return 0;
+      for (int i = 0; i < Num && i < Words; ++i)
+        Classes[i] = MergeClasses(SubClasses[i], Classes[i]);
+    }
+    break;
+  }
+
+  // When the size is more than 16 bytes, everything is passed in memory unless
+  // the whole thing is a single vector: SSE followed by SSEUP only.
+  if (Words > 2) {
+    if (Classes[0] != X86_64_SSE_CLASS)
+      return 0;
+    for (int i = 1; i < Words; ++i)
+      if (Classes[i] != X86_64_SSEUP_CLASS)
+        return 0;
+  }
+
+  // Final merger cleanup.
+  for (int i = 0; i < Words; ++i) {
+    // If one class is MEMORY, everything is passed in memory.
+    if (Classes[i] == X86_64_MEMORY_CLASS)
+      return 0;
+
+    // SSEUP must be preceded by SSE or SSEUP.
+    if (Classes[i] == X86_64_SSEUP_CLASS) {
+      assert(i != 0 && "First eightbyte is SSEUP!");
+      if (Classes[i - 1] != X86_64_SSE_CLASS &&
+          Classes[i - 1] != X86_64_SSEUP_CLASS)
+        Classes[i] = X86_64_SSE_CLASS;
+    }
+
+    // If X87UP is not preceded by X87, everything is passed in memory.
+    if (Classes[i] == X86_64_X87UP_CLASS) {
+      assert(i != 0 && "First eightbyte is X87UP!");
+      if (Classes[i - 1] != X86_64_X87_CLASS)
+        return 0;
+    }
+  }
+  return Words;
+}
+
+namespace {
+/// X86_64Classification - The register classes of the eightbytes making up a
+/// value, see ClassifyAt.
+struct X86_64Classification {
+  int NumClasses;
+  x86_64_reg_class Classes[MAX_CLASSES];
+};
+}
+
+/// ClassificationCache - The classification of each type, together with the
+/// vector registers available when it was computed.
+typedef DenseMap<std::pair<tree, unsigned>, X86_64Classification>
+    ClassificationMap;
+static ClassificationMap ClassificationCache;
+
+/// ClassifyArgument - Classify each eightbyte of a value of the given type, as
+/// an argument or return value.  Returns the number of eightbytes, or zero if
+/// the value is passed in memory.  The result only depends on the type and on
+/// the vector registers available, so it is computed once for each.
+static int ClassifyArgument(tree type, x86_64_reg_class Classes[MAX_CLASSES]) {
+  std::pair<tree, unsigned> Key(type, getVectorRegisterBytes());
+  std::pair<ClassificationMap::iterator, bool> I =
+      ClassificationCache.insert(std::make_pair(Key, X86_64Classification()));
+  X86_64Classification &C = I.first->second;
+  if (I.second)
+    C.NumClasses = ClassifyAt(type, 0, C.Classes);
+
+  std::copy(C.Classes, C.Classes + C.NumClasses, Classes);
+  return C.NumClasses;
+}
+
+/// ExamineArgument - Count the integer and SSE registers needed to pass a value
+/// of the given type.  Returns true if it is passed in memory instead.
+static bool ExamineArgument(tree type, bool InReturn, int &IntRegs,
+                            int &SSERegs) {
+  x86_64_reg_class Classes[MAX_CLASSES];
+  int Num = ClassifyArgument(type, Classes);
+
+  IntRegs = SSERegs = 0;
+  if (!Num)
+    return true;
+  for (int i = 0; i < Num; ++i)
+    switch (Classes[i]) {
+    case X86_64_INTEGER_CLASS:
+    case X86_64_INTEGERSI_CLASS:
+      ++IntRegs;
+      break;
+    case X86_64_SSE_CLASS:
+    case X86_64_SSESF_CLASS:
+    case X86_64_SSEDF_CLASS:
+      ++SSERegs;
+      break;
+    case X86_64_NO_CLASS:
+    case X86_64_SSEUP_CLASS:
+      break;
+    case X86_64_X87_CLASS:
+    case X86_64_X87UP_CLASS:
+    case X86_64_COMPLEX_X87_CLASS:
+      if (!InReturn)
+        return true;
+      break;
+    case X86_64_MEMORY_CLASS:
+      llvm_unreachable("Memory class not eliminated!");
+    }
+  return false;
+}
+
 /* Target hook for llvm-abi.h. It returns true if an aggregate of the
    specified type should be passed in memory. This is only called for
    x86-64. */
-static bool llvm_x86_64_should_pass_aggregate_in_memory(
-    tree TreeType, enum machine_mode Mode) {
+static bool llvm_x86_64_should_pass_aggregate_in_memory(tree TreeType) {
   int IntRegs, SSERegs;
-  /* If examine_argument return 0, then it's passed byval in memory.*/
-#if (GCC_MAJOR > 4)
-  bool ret =
-#else
-  int ret =
-#endif
-      examine_argument(Mode, TreeType, 0, &IntRegs, &SSERegs);
-#if (GCC_MAJOR > 4)
-  if (ret)
-#else
-  if (ret == 0)
-#endif
+  if (ExamineArgument(TreeType, false, IntRegs, SSERegs))
     return true;
-  if (
-#if (GCC_MAJOR > 4)
-      !ret
-#else
-      ret == 1
-#endif
-      && IntRegs == 0 && SSERegs == 0) // zero-sized struct
+  if (IntRegs == 0 && SSERegs == 0) // zero-sized struct
     return true;
   return false;
 }
@@ -1259,15 +1862,48 @@ bool llvm_x86_should_pass_aggregate_as_fca(tree type, Type *Ty) {
            EltTy->isIntegerTy(8));
 }
 
+/* Target hook for llvm-abi.h.  Aggregates passed using the Microsoft x64
+   convention (ms_abi) go in an integer register if they are 1, 2, 4 or 8 bytes
+   long, and otherwise by reference to a copy made by the caller.  The code
+   generator takes care of vectors and scalars. */
+bool llvm_x86_try_pass_aggregate_custom(tree type,
+                                        std::vector<Type *> &ScalarElts,
+                                        CallingConv::ID CC,
+                                        struct DefaultABIClient *C) {
+  if (CC != CallingConv::X86_64_Win64 ||
+      !(isa<AGGREGATE_TYPE>(type) || isa<COMPLEX_TYPE>(type)))
+    return false;
+
+  Type *Ty = ConvertType(type);
+  HOST_WIDE_INT Bytes = int_size_in_bytes(type);
+  if (Bytes != 1 && Bytes != 2 && Bytes != 4 && Bytes != 8) {
+    Type *PtrTy = Ty->getPointerTo();
+    C->HandleByInvisibleReferenceArgument(PtrTy, type);
+    ScalarElts.push_back(PtrTy);
+    return true;
+  }
+
+  LLVMContext &Context =
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+      Ty->getContext();
+#else
+      TheContext;
+#endif
+  Type *IntTy = IntegerType::get(Context, Bytes * 8);
+  C->EnterField(0, StructType::get(Context, IntTy));
+  C->HandleScalarArgument(IntTy, 0);
+  ScalarElts.push_back(IntTy);
+  C->ExitField();
+  return true;
+}
+
 /* Target hook for llvm-abi.h. It returns true if an aggregate of the
    specified type should be passed in memory. */
 bool llvm_x86_should_pass_aggregate_in_memory(tree TreeType, Type *Ty) {
   if (llvm_x86_should_pass_aggregate_as_fca(TreeType, Ty))
     return false;
 
-  enum machine_mode Mode = type_natural_mode(TreeType, NULL);
-  HOST_WIDE_INT Bytes = (Mode == BLKmode) ? int_size_in_bytes(TreeType) : (int)
-                        GET_MODE_SIZE(Mode);
+  HOST_WIDE_INT Bytes = int_size_in_bytes(TreeType);
 
   // Zero sized array, struct, or class, not passed in memory.
   if (Bytes == 0)
@@ -1277,7 +1913,7 @@ bool llvm_x86_should_pass_aggregate_in_memory(tree TreeType, Type *Ty) {
     std::vector<Type *> Elts;
     return !llvm_x86_32_should_pass_aggregate_in_mixed_regs(TreeType, Ty, Elts);
   }
-  return llvm_x86_64_should_pass_aggregate_in_memory(TreeType, Mode);
+  return llvm_x86_64_should_pass_aggregate_in_memory(TreeType);
 }
 
 /* count_num_registers_uses - Return the number of GPRs and XMMs parameter
@@ -1373,11 +2009,9 @@ bool llvm_x86_64_should_pass_aggregate_in_mixed_regs(
     return false;
 
   enum x86_64_reg_class Class[MAX_CLASSES];
-  enum machine_mode Mode = type_natural_mode(TreeType, NULL);
   bool totallyEmpty = true;
-  HOST_WIDE_INT Bytes = (Mode == BLKmode) ? int_size_in_bytes(TreeType) : (int)
-                        GET_MODE_SIZE(Mode);
-  int NumClasses = classify_argument(Mode, TreeType, Class, 0);
+  HOST_WIDE_INT Bytes = int_size_in_bytes(TreeType);
+  int NumClasses = ClassifyArgument(TreeType, Class);
   if (!NumClasses)
     return false;
 
@@ -1502,6 +2136,28 @@ bool llvm_x86_64_should_pass_aggregate_in_mixed_regs(
   return !totallyEmpty;
 }
 
+/* The cost, in element moves, from which an aggregate of the given type is
+   copied or zeroed with memcpy or memset rather than element by element.  The
+   code generator expands those into moves of the widest vector registers
+   available, so they win as soon as they take fewer moves.  */
+unsigned llvm_x86_aggregate_copy_cost(tree type) {
+  if (!isInt64(TYPE_SIZE_UNIT(type), true))
+    return 5;
+  uint64_t Bytes = getInt64(TYPE_SIZE_UNIT(type), true);
+  unsigned Width = UNITS_PER_WORD;
+#ifdef TARGET_AVX512F
+  if (TARGET_AVX512F)
+    Width = 64;
+  else
+#endif
+  if (TARGET_AVX)
+    Width = 32;
+  else if (TARGET_SSE2)
+    Width = 16;
+  uint64_t Moves = (Bytes + Width - 1) / Width;
+  return Moves < 5 ? Moves + 1 : 5;
+}
+
 /* On Darwin x86-32, vectors which are not MMX nor SSE should be passed as
    integers.  On Darwin x86-64, such vectors bigger than 128 bits should be
    passed in memory (byval). */
@@ -1613,8 +2269,7 @@ static bool llvm_suitable_multiple_ret_value_type(Type *Ty, tree TreeType) {
 
   // Let gcc specific routine answer the question.
   enum x86_64_reg_class Class[MAX_CLASSES];
-  enum machine_mode Mode = type_natural_mode(TreeType, NULL);
-  int NumClasses = classify_argument(Mode, TreeType, Class, 0);
+  int NumClasses = ClassifyArgument(TreeType, Class);
   if (NumClasses == 0)
     return false;
 
@@ -1635,7 +2290,8 @@ static bool llvm_suitable_multiple_ret_value_type(Type *Ty, tree TreeType) {
 
 // llvm_x86_scalar_type_for_struct_return - Return LLVM type if TYPE
 // can be returned as a scalar, otherwise return NULL.
-Type *llvm_x86_scalar_type_for_struct_return(tree type, unsigned *Offset) {
+Type *llvm_x86_scalar_type_for_struct_return(tree type, unsigned *Offset,
+                                             CallingConv::ID CC) {
   *Offset = 0;
   Type *Ty = ConvertType(type);
   uint64_t Size = getDataLayout().getTypeAllocSize(Ty);
@@ -1654,6 +2310,11 @@ Type *llvm_x86_scalar_type_for_struct_return(tree type, unsigned *Offset) {
   else if (Size <= 4)
     return Type::getInt32Ty(Context);
 
+  // The Microsoft x64 convention returns aggregates of up to 8 bytes in RAX;
+  // larger ones were already returned in memory.
+  if (CC == CallingConv::X86_64_Win64)
+    return Type::getInt64Ty(Context);
+
   // Check if Ty should be returned using multiple value return instruction.
   if (llvm_suitable_multiple_ret_value_type(Ty, type))
     return NULL;
@@ -1662,8 +2323,7 @@ Type *llvm_x86_scalar_type_for_struct_return(tree type, unsigned *Offset) {
     // This logic relies on llvm_suitable_multiple_ret_value_type to have
     // removed anything not expected here.
     enum x86_64_reg_class Class[MAX_CLASSES];
-    enum machine_mode Mode = type_natural_mode(type, NULL);
-    int NumClasses = classify_argument(Mode, type, Class, 0);
+    int NumClasses = ClassifyArgument(type, Class);
     if (NumClasses == 0)
       return Type::getInt64Ty(Context);
 
@@ -1671,8 +2331,7 @@ Type *llvm_x86_scalar_type_for_struct_return(tree type, unsigned *Offset) {
       if (Class[0] == X86_64_INTEGERSI_CLASS ||
           Class[0] == X86_64_INTEGER_CLASS) {
         // one int register
-        HOST_WIDE_INT Bytes = (Mode == BLKmode) ? int_size_in_bytes(type)
-                                                : (int) GET_MODE_SIZE(Mode);
+        HOST_WIDE_INT Bytes = int_size_in_bytes(type);
         if (Bytes > 4)
           return Type::getInt64Ty(Context);
         else if (Bytes > 2)
@@ -1728,10 +2387,8 @@ Type *llvm_x86_scalar_type_for_struct_return(tree type, unsigned *Offset) {
 static void llvm_x86_64_get_multiple_return_reg_classes(
     tree TreeType, Type */*Ty*/, std::vector<Type *> &Elts) {
   enum x86_64_reg_class Class[MAX_CLASSES];
-  enum machine_mode Mode = type_natural_mode(TreeType, NULL);
-  HOST_WIDE_INT Bytes = (Mode == BLKmode) ? int_size_in_bytes(TreeType) : (int)
-                        GET_MODE_SIZE(Mode);
-  int NumClasses = classify_argument(Mode, TreeType, Class, 0);
+  HOST_WIDE_INT Bytes = int_size_in_bytes(TreeType);
+  int NumClasses = ClassifyArgument(TreeType, Class);
   assert(NumClasses && "This type does not need multiple return registers!");
 
   assert((NumClasses != 1 || Class[0] != X86_64_INTEGERSI_CLASS) &&
@@ -1740,7 +2397,7 @@ static void llvm_x86_64_get_multiple_return_reg_classes(
   assert((NumClasses != 1 || Class[0] != X86_64_INTEGER_CLASS) &&
          "This type does not need multiple return registers!");
 
-  // classify_argument uses a single X86_64_NO_CLASS as a special case for
+  // ClassifyArgument uses a single X86_64_NO_CLASS as a special case for
   // empty structs. Recognize it and don't add any return values in that
   // case.
   if (NumClasses == 1 && Class[0] == X86_64_NO_CLASS)
@@ -1856,9 +2513,10 @@ static void llvm_x86_64_get_multiple_return_reg_classes(
 
 // Return LLVM Type if TYPE can be returned as an aggregate,
 // otherwise return NULL.
-Type *llvm_x86_aggr_type_for_struct_return(tree type) {
+Type *llvm_x86_aggr_type_for_struct_return(tree type, CallingConv::ID CC) {
   Type *Ty = ConvertType(type);
-  if (!llvm_suitable_multiple_ret_value_type(Ty, type))
+  if (CC == CallingConv::X86_64_Win64 ||
+      !llvm_suitable_multiple_ret_value_type(Ty, type))
     return NULL;
 
   StructType *STy = cast<StructType>(Ty);
@@ -2053,14 +2711,12 @@ bool llvm_x86_should_pass_aggregate_in_integer_regs(tree type, unsigned *size,
   *size = 0;
   if (TARGET_64BIT) {
     enum x86_64_reg_class Class[MAX_CLASSES];
-    enum machine_mode Mode = type_natural_mode(type, NULL);
-    int NumClasses = classify_argument(Mode, type, Class, 0);
+    int NumClasses = ClassifyArgument(type, Class);
     *DontCheckAlignment = true;
     if (NumClasses == 1 && (Class[0] == X86_64_INTEGER_CLASS ||
                             Class[0] == X86_64_INTEGERSI_CLASS)) {
       // one int register
-      HOST_WIDE_INT Bytes = (Mode == BLKmode) ? int_size_in_bytes(type) : (int)
-                            GET_MODE_SIZE(Mode);
+      HOST_WIDE_INT Bytes = int_size_in_bytes(type);
       if (Bytes > 4)
         *size = 8;
       else if (Bytes > 2)
@@ -2102,6 +2758,48 @@ static void addFeature(llvm::SubtargetFeatures &F, const char *Feature,
   F.AddFeature(std::string(Prefix) + Feature);
 }
 
+#if GCC_VERSION_CODE > GCC_VERSION(7, 2)
+/// getIndirectBranchType - How indirect calls and jumps in the given function,
+/// if any, are protected against speculation: as given by its attribute, else
+/// by -mindirect-branch=.  AttrName is "function_return" for the same thing
+/// about returns and -mfunction-return=.
+static enum indirect_branch getIndirectBranchType(tree fndecl,
+                                                  const char *AttrName,
+                                                  enum indirect_branch Default) {
+  tree attr = fndecl ? lookup_attribute(AttrName, DECL_ATTRIBUTES(fndecl))
+                     : NULL_TREE;
+  if (!attr)
+    return Default;
+  const char *Kind = TREE_STRING_POINTER(TREE_VALUE(TREE_VALUE(attr)));
+  if (!strcmp(Kind, "thunk"))
+    return indirect_branch_thunk;
+  if (!strcmp(Kind, "thunk-inline"))
+    return indirect_branch_thunk_inline;
+  if (!strcmp(Kind, "thunk-extern"))
+    return indirect_branch_thunk_extern;
+  return indirect_branch_keep;
+}
+#endif
+
+/// llvm_x86_has_own_subtarget - Whether the given function asks for different
+/// Spectre mitigations to the rest of the compilation unit.
+bool llvm_x86_has_own_subtarget(tree fndecl) {
+#if GCC_VERSION_CODE > GCC_VERSION(7, 2)
+  return lookup_attribute("indirect_branch", DECL_ATTRIBUTES(fndecl)) ||
+         lookup_attribute("function_return", DECL_ATTRIBUTES(fndecl));
+#else
+  (void)fndecl;
+  return false;
+#endif
+}
+
+/// X86Feature - The LLVM name of an instruction set extension, and whether GCC
+/// has it enabled.
+struct X86Feature {
+  const char *Name;
+  bool Enabled;
+};
+
 void llvm_x86_set_subtarget_features(std::string &C,
                                      llvm::SubtargetFeatures &F) {
   if (TARGET_MACHO && !strcmp(ix86_arch_string, "apple"))
@@ -2109,24 +2807,254 @@ void llvm_x86_set_subtarget_features(std::string &C,
   else
     C = ix86_arch_string;
 
-  addFeature(F, "64bit", TARGET_64BIT);
-  addFeature(F, "3dnow", TARGET_3DNOW);
-  addFeature(F, "3dnowa", TARGET_3DNOW_A);
-  addFeature(F, "aes", TARGET_AES);
-  addFeature(F, "avx", TARGET_AVX);
-  addFeature(F, "cx16", TARGET_CMPXCHG16B);
-  addFeature(F, "fma", TARGET_FMA);
-  addFeature(F, "fma4", TARGET_FMA4);
-  addFeature(F, "mmx", TARGET_MMX);
-  addFeature(F, "popcnt", TARGET_POPCNT);
+  // Extensions only appear once both GCC and LLVM know about them: LLVM warns
+  // about features it does not recognize.
+  const X86Feature Features[] = {
+    { "64bit", TARGET_64BIT },
+    { "3dnow", TARGET_3DNOW },
+    { "3dnowa", TARGET_3DNOW_A },
+    { "aes", TARGET_AES },
+    { "avx", TARGET_AVX },
+#ifdef TARGET_AVX2
+    { "avx2", TARGET_AVX2 },
+#endif
+#ifdef TARGET_AVX512F
+    { "avx512f", TARGET_AVX512F },
+#endif
+    { "cx16", TARGET_CMPXCHG16B },
+    { "fma", TARGET_FMA },
+    { "fma4", TARGET_FMA4 },
+    { "mmx", TARGET_MMX },
+    { "popcnt", TARGET_POPCNT },
 #ifdef TARGET_RDRND
-  addFeature(F, "rdrnd", TARGET_RDRND);
-#endif
-  addFeature(F, "sse", TARGET_SSE);
-  addFeature(F, "sse2", TARGET_SSE2);
-  addFeature(F, "sse3", TARGET_SSE3);
-  addFeature(F, "sse4.1", TARGET_SSE4_1);
-  addFeature(F, "sse4.2", TARGET_SSE4_2);
-  addFeature(F, "sse4a", TARGET_SSE4A);
-  addFeature(F, "ssse3", TARGET_SSSE3);
+    { "rdrnd", TARGET_RDRND },
+#endif
+    { "sse", TARGET_SSE },
+    { "sse2", TARGET_SSE2 },
+    { "sse3", TARGET_SSE3 },
+    { "sse4.1", TARGET_SSE4_1 },
+    { "sse4.2", TARGET_SSE4_2 },
+    { "sse4a", TARGET_SSE4A },
+    { "ssse3", TARGET_SSSE3 },
+    { "pclmul", TARGET_PCLMUL },
+    { "xop", TARGET_XOP },
+#ifdef TARGET_MOVBE
+    { "movbe", TARGET_MOVBE },
+#endif
+#ifdef TARGET_F16C
+    { "f16c", TARGET_F16C },
+#endif
+#ifdef TARGET_FSGSBASE
+    { "fsgsbase", TARGET_FSGSBASE },
+#endif
+#ifdef TARGET_BMI
+    { "bmi", TARGET_BMI },
+#endif
+#ifdef TARGET_BMI2
+    { "bmi2", TARGET_BMI2 },
+#endif
+#ifdef TARGET_LZCNT
+    { "lzcnt", TARGET_LZCNT },
+#endif
+#ifdef TARGET_TBM
+    { "tbm", TARGET_TBM },
+#endif
+#ifdef TARGET_RTM
+    { "rtm", TARGET_RTM },
+#endif
+#ifdef TARGET_HLE
+    { "hle", TARGET_HLE },
+#endif
+#ifdef TARGET_RDSEED
+    { "rdseed", TARGET_RDSEED },
+#endif
+#ifdef TARGET_PRFCHW
+    { "prfchw", TARGET_PRFCHW },
+#endif
+#ifdef TARGET_ADX
+    { "adx", TARGET_ADX },
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 3)
+#ifdef TARGET_AVX512CD
+    { "avx512cd", TARGET_AVX512CD },
+#endif
+#ifdef TARGET_AVX512ER
+    { "avx512er", TARGET_AVX512ER },
+#endif
+#ifdef TARGET_AVX512PF
+    { "avx512pf", TARGET_AVX512PF },
+#endif
+#ifdef TARGET_SHA
+    { "sha", TARGET_SHA },
+#endif
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 5)
+#ifdef TARGET_AVX512BW
+    { "avx512bw", TARGET_AVX512BW },
+#endif
+#ifdef TARGET_AVX512DQ
+    { "avx512dq", TARGET_AVX512DQ },
+#endif
+#ifdef TARGET_AVX512VL
+    { "avx512vl", TARGET_AVX512VL },
+#endif
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 6)
+#ifdef TARGET_FXSR
+    { "fxsr", TARGET_FXSR },
+#endif
+#ifdef TARGET_XSAVE
+    { "xsave", TARGET_XSAVE },
+#endif
+#ifdef TARGET_XSAVEOPT
+    { "xsaveopt", TARGET_XSAVEOPT },
+#endif
+#ifdef TARGET_XSAVEC
+    { "xsavec", TARGET_XSAVEC },
+#endif
+#ifdef TARGET_XSAVES
+    { "xsaves", TARGET_XSAVES },
+#endif
+#ifdef TARGET_CLFLUSHOPT
+    { "clflushopt", TARGET_CLFLUSHOPT },
+#endif
+#ifdef TARGET_CLWB
+    { "clwb", TARGET_CLWB },
+#endif
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 8)
+#ifdef TARGET_AVX512IFMA
+    { "avx512ifma", TARGET_AVX512IFMA },
+#endif
+#ifdef TARGET_AVX512VBMI
+    { "avx512vbmi", TARGET_AVX512VBMI },
+#endif
+#ifdef TARGET_PKU
+    { "pku", TARGET_PKU },
+#endif
+#ifdef TARGET_PREFETCHWT1
+    { "prefetchwt1", TARGET_PREFETCHWT1 },
+#endif
+#ifdef TARGET_MWAITX
+    { "mwaitx", TARGET_MWAITX },
+#endif
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(4, 0)
+#ifdef TARGET_AVX512VPOPCNTDQ
+    { "avx512vpopcntdq", TARGET_AVX512VPOPCNTDQ },
+#endif
+#ifdef TARGET_CLZERO
+    { "clzero", TARGET_CLZERO },
+#endif
+#ifdef TARGET_SGX
+    { "sgx", TARGET_SGX },
+#endif
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(5, 0)
+#ifdef TARGET_AVX512VBMI2
+    { "avx512vbmi2", TARGET_AVX512VBMI2 },
+#endif
+#ifdef TARGET_AVX512VNNI
+    { "avx512vnni", TARGET_AVX512VNNI },
+#endif
+#ifdef TARGET_AVX512BITALG
+    { "avx512bitalg", TARGET_AVX512BITALG },
+#endif
+#ifdef TARGET_GFNI
+    { "gfni", TARGET_GFNI },
+#endif
+#ifdef TARGET_VAES
+    { "vaes", TARGET_VAES },
+#endif
+#ifdef TARGET_VPCLMULQDQ
+    { "vpclmulqdq", TARGET_VPCLMULQDQ },
+#endif
+#ifdef TARGET_RDPID
+    { "rdpid", TARGET_RDPID },
+#endif
+#ifdef TARGET_SHSTK
+    { "shstk", TARGET_SHSTK },
+#endif
+#ifdef TARGET_LWP
+    { "lwp", TARGET_LWP },
+#endif
+#endif
+  };
+
+  for (unsigned i = 0, e = array_lengthof(Features); i != e; ++i)
+    addFeature(F, Features[i].Name, Features[i].Enabled);
+
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 7)
+  // LLVM has no separate tuning CPU, so -mtune cannot change the scheduling
+  // model without changing the instruction set.  Pass on the tuning choices
+  // GCC made for the -mtune CPU that LLVM models as features instead; these
+  // never enable new instructions.
+  const X86Feature TuningFeatures[] = {
+    { "slow-incdec", !TARGET_USE_INCDEC },
+#ifdef TARGET_PAD_SHORT_FUNCTION
+    { "pad-short-functions", TARGET_PAD_SHORT_FUNCTION },
+#endif
+#ifdef TARGET_AVOID_LEA_FOR_ADDR
+    { "slow-lea", TARGET_AVOID_LEA_FOR_ADDR },
+#endif
+#ifdef TARGET_AVX256_SPLIT_UNALIGNED_LOAD
+    { "slow-unaligned-mem-32", TARGET_AVX256_SPLIT_UNALIGNED_LOAD },
+#endif
+#ifdef TARGET_SSE_UNALIGNED_LOAD_OPTIMAL
+    { "slow-unaligned-mem-16", !TARGET_SSE_UNALIGNED_LOAD_OPTIMAL },
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(3, 9)
+#ifdef TARGET_FUSE_CMP_AND_BRANCH
+    { "macrofusion", TARGET_FUSE_CMP_AND_BRANCH },
+#endif
+#endif
+  };
+
+  for (unsigned i = 0, e = array_lengthof(TuningFeatures); i != e; ++i)
+    addFeature(F, TuningFeatures[i].Name, TuningFeatures[i].Enabled);
+#endif
+
+#if GCC_VERSION_CODE > GCC_VERSION(7, 2)
+  // Spectre mitigations, for the whole unit or for the current function if it
+  // has attributes changing them.  Indirect calls and jumps go through
+  // retpoline thunks, which is done in a register, as -mindirect-branch-register
+  // asks.  LLVM has no inline form, so thunk-inline uses thunks too.
+  enum indirect_branch Branch = getIndirectBranchType(
+      current_function_decl, "indirect_branch", ix86_indirect_branch);
+  bool Retpoline =
+      Branch != indirect_branch_keep && Branch != indirect_branch_unset;
+#if LLVM_VERSION_CODE > LLVM_VERSION(6, 0)
+  addFeature(F, "retpoline-indirect-calls", Retpoline);
+  addFeature(F, "retpoline-indirect-branches", Retpoline);
+#elif LLVM_VERSION_CODE > LLVM_VERSION(5, 0)
+  addFeature(F, "retpoline", Retpoline);
+#endif
+#if LLVM_VERSION_CODE > LLVM_VERSION(5, 0)
+  addFeature(F, "retpoline-external-thunk",
+             Branch == indirect_branch_thunk_extern);
+#else
+  if (Retpoline)
+    error(G_("%<-mindirect-branch=%> is not supported by this version of "
+             "LLVM"));
+#endif
+  if (!current_function_decl && !Retpoline && ix86_indirect_branch_register)
+    warning(0, G_("%<-mindirect-branch-register%> is not supported by this "
+                  "version of LLVM without %<-mindirect-branch=thunk%>"));
+
+  // Returns are never turned into thunks, so refuse to compile code that asks
+  // for it rather than output code without the protection.
+  enum indirect_branch Return = getIndirectBranchType(
+      current_function_decl, "function_return", ix86_function_return);
+  if (Return != indirect_branch_keep && Return != indirect_branch_unset) {
+    if (current_function_decl &&
+        lookup_attribute("function_return",
+                         DECL_ATTRIBUTES(current_function_decl)))
+      error_at(DECL_SOURCE_LOCATION(current_function_decl),
+               G_("%<function_return%> attribute is not supported by this "
+                  "version of LLVM"));
+    else if (!current_function_decl)
+      error(G_("%<-mfunction-return=%> is not supported by this version of "
+               "LLVM"));
+  }
+#endif
 }
@@ -1,15 +1,91 @@
 import DETestRunner
+import lit.Test
 import lit.formats
 
 class CompilatorTest(lit.formats.FileBasedTest):
-    def __init__(self, compilers, compiler_flags, language_flags, skip, xfails):
+    def __init__(self, compilers, compiler_flags, language_flags, skip, xfails,
+                 jobs=1, cache_dir=None):
         self.compilers = compilers
         self.compiler_flags = compiler_flags
         self.language_flags = language_flags
         self.skip = skip
         self.xfails = xfails
+        self.jobs = jobs
+        self.cache_dir = cache_dir
 
     def execute(self, test, litConfig):
         return DETestRunner.executeCompilatorTest(test, litConfig,
           self.compilers, self.compiler_flags, self.language_flags, self.skip,
-          self.xfails)
+          self.xfails, self.jobs, self.cache_dir)
+
+class BenchmarkTest(lit.formats.FileBasedTest):
+    def __init__(self, compilers, compiler_names, compiler_flags,
+                 language_flags, skip, report, baseline, threshold, noise):
+        self.compilers = compilers
+        self.compiler_names = compiler_names
+        self.compiler_flags = compiler_flags
+        self.language_flags = language_flags
+        self.skip = skip
+        self.report = report
+        self.baseline = baseline
+        self.threshold = threshold
+        self.noise = noise
+
+    def execute(self, test, litConfig):
+        return DETestRunner.executeBenchmarkTest(test, litConfig,
+          self.compilers, self.compiler_names, self.compiler_flags,
+          self.language_flags, self.skip, self.report, self.baseline,
+          self.threshold, self.noise)
+
+class RuntimeTest(lit.formats.FileBasedTest):
+    def __init__(self, configs, language_flags, skip, repetitions, report):
+        self.configs = configs
+        self.language_flags = language_flags
+        self.skip = skip
+        self.repetitions = repetitions
+        self.report = report
+
+    def execute(self, test, litConfig):
+        return DETestRunner.executeRuntimeTest(test, litConfig, self.configs,
+          self.language_flags, self.skip, self.repetitions, self.report)
+
+class StressTest(lit.formats.FileBasedTest):
+    def __init__(self, compiler, language_flags, skip, report, max_exponent,
+                 noise):
+        self.compiler = compiler
+        self.language_flags = language_flags
+        self.skip = skip
+        self.report = report
+        self.max_exponent = max_exponent
+        self.noise = noise
+
+    def execute(self, test, litConfig):
+        return DETestRunner.executeStressTest(test, litConfig, self.compiler,
+          self.language_flags, self.skip, self.report, self.max_exponent,
+          self.noise)
+
+class FuzzTest(lit.formats.FileBasedTest):
+    def __init__(self, seeds, configs, size, iterations, repetitions, timeout,
+                 max_slowdown, noise, report):
+        self.seeds = seeds
+        self.configs = configs
+        self.size = size
+        self.iterations = iterations
+        self.repetitions = repetitions
+        self.timeout = timeout
+        self.max_slowdown = max_slowdown
+        self.noise = noise
+        self.report = report
+
+    def getTestsInDirectory(self, testSuite, path_in_suite, litConfig,
+                            localConfig):
+        # There are no test files: each seed is a test, named after the seed.
+        for seed in self.seeds:
+            yield lit.Test.Test(testSuite, path_in_suite + ('seed-%d' % seed,),
+                                localConfig)
+
+    def execute(self, test, litConfig):
+        seed = int(test.path_in_suite[-1][len('seed-'):])
+        return DETestRunner.executeFuzzTest(test, litConfig, seed,
+          self.configs, self.size, self.iterations, self.repetitions,
+          self.timeout, self.max_slowdown, self.noise, self.report)
@@ -0,0 +1,270 @@
+"""Generate random C programs, in the spirit of Csmith, for differential testing.
+
+The programs are free of undefined behaviour: arithmetic is done on unsigned
+values, divisions and shifts are guarded, array indices are reduced modulo the
+array size and every loop has a bounded trip count.  Every function only calls
+functions generated before it, so the programs always terminate.  The output is
+a checksum of all global variables, so any compiler producing different output
+miscompiled the program.  The same seed always produces the same program."""
+
+import random
+
+# Integer types, with their width in bits.
+intTypes = [('signed char', 8), ('unsigned char', 8), ('short', 16),
+            ('unsigned short', 16), ('int', 32), ('unsigned int', 32),
+            ('long long', 64), ('unsigned long long', 64)]
+
+header = r'''#include <stdio.h>
+
+typedef unsigned long long u64;
+
+static inline u64 ADD(u64 a, u64 b) { return a + b; }
+static inline u64 SUB(u64 a, u64 b) { return a - b; }
+static inline u64 MUL(u64 a, u64 b) { return a * b; }
+static inline u64 DIV(u64 a, u64 b) { return b ? a / b : a; }
+static inline u64 MOD(u64 a, u64 b) { return b ? a % b : a; }
+static inline u64 SHL(u64 a, u64 b) { return a << (b & 63); }
+static inline u64 SHR(u64 a, u64 b) { return a >> (b & 63); }
+
+static u64 checksum;
+
+static void mix(u64 value) {
+  checksum = checksum * 1099511628211ULL ^ value;
+}
+'''
+
+class Generator:
+    def __init__(self, seed, size, iterations):
+        self.rng = random.Random(seed)
+        self.size = size
+        self.iterations = iterations
+        self.globals = []   # (name, type, array length or 0)
+        self.structs = []   # (name, [(field, type, bit width or 0)])
+        self.records = []   # (variable name, struct index)
+        self.functions = [] # (name, return type, [param types])
+        self.lines = []
+        self.calls = 0      # Number of calls in the current function.
+
+    def choose(self, seq):
+        return self.rng.choice(seq)
+
+    def chance(self, p):
+        return self.rng.random() < p
+
+    def constant(self, ty):
+        bits = dict(intTypes)[ty]
+        value = self.rng.choice([0, 1, 2, 3, 7, 255, 65535,
+                                 self.rng.getrandbits(bits)])
+        return '%dULL' % (value & ((1 << bits) - 1))
+
+    # Expressions, all of type u64.
+
+    def lvalues(self, locals):
+        values = [name for name,ty,length in self.globals if not length]
+        values += ['%s[%s %% %d]' % (name, self.index(locals), length)
+                   for name,ty,length in self.globals if length]
+        for name,struct in self.records:
+            for field,ty,width in self.structs[struct][1]:
+                values.append('%s.%s' % (name, field))
+        # Loop counters are never assigned to, so every loop terminates.
+        return values + [l for l in locals if not l.startswith('i')]
+
+    def index(self, locals):
+        if locals and self.chance(0.7):
+            return '(u64)%s' % self.choose(locals)
+        return '%d' % self.rng.randrange(16)
+
+    def leaf(self, locals):
+        if self.chance(0.2):
+            return self.constant(self.choose(intTypes)[0])
+        name = self.choose(self.lvalues(locals))
+        return '(u64)%s' % name
+
+    def expression(self, locals, depth):
+        if depth <= 0 or self.chance(0.3):
+            return self.leaf(locals)
+        kind = self.rng.randrange(10)
+        a = self.expression(locals, depth - 1)
+        if kind == 0:
+            return '(u64)(~%s)' % a
+        if kind == 1:
+            return '(u64)(%s %s %s)' % (a, self.choose(['<', '<=', '==', '!=']),
+                                        self.expression(locals, depth - 1))
+        if kind == 2:
+            return '(%s ? %s : %s)' % (a, self.expression(locals, depth - 1),
+                                       self.expression(locals, depth - 1))
+        if kind == 3:
+            # Truncate through a narrower type.
+            return '(u64)(%s)%s' % (self.choose(intTypes)[0], a)
+        b = self.expression(locals, depth - 1)
+        if kind == 4:
+            return '(%s %s %s)' % (a, self.choose(['&', '|', '^']), b)
+        op = self.choose(['ADD', 'ADD', 'SUB', 'MUL', 'DIV', 'MOD', 'SHL',
+                          'SHR'])
+        return '%s(%s, %s)' % (op, a, b)
+
+    # Statements.
+
+    def statement(self, locals, loopVars, indent, depth):
+        pad = '  ' * indent
+        kind = self.rng.randrange(9) if depth > 0 else 0
+        if kind <= 2:
+            target = self.choose(self.lvalues(locals))
+            op = self.choose(['=', '=', '+=', '^=', '|=', '&='])
+            self.lines.append('%s%s %s %s;' % (pad, target, op,
+                                               self.expression(locals, 3)))
+        elif kind == 3:
+            self.lines.append('%sif (%s) {' % (pad, self.expression(locals, 2)))
+            self.block(locals, loopVars, indent + 1, depth - 1)
+            if self.chance(0.5):
+                self.lines.append('%s} else {' % pad)
+                self.block(locals, loopVars, indent + 1, depth - 1)
+            self.lines.append('%s}' % pad)
+        elif kind == 4 or kind == 5:
+            var = 'i%d' % len(loopVars)
+            trips = self.choose([2, 3, 8, 17, 32])
+            self.lines.append('%sfor (%s = 0; %s < %d; %s++) {' %
+                              (pad, var, var, trips, var))
+            self.block(locals + [var], loopVars + [var], indent + 1, depth - 1)
+            self.lines.append('%s}' % pad)
+        elif kind == 6:
+            self.lines.append('%sswitch (%s %% 5) {' %
+                              (pad, self.expression(locals, 2)))
+            for case in range(self.rng.randrange(1, 5)):
+                self.lines.append('%scase %d:' % (pad, case))
+                self.block(locals, loopVars, indent + 1, depth - 1)
+                if self.chance(0.7):
+                    self.lines.append('%s  break;' % pad)
+            self.lines.append('%sdefault:' % pad)
+            self.block(locals, loopVars, indent + 1, depth - 1)
+            self.lines.append('%s}' % pad)
+        elif kind == 8 and self.calls < 2 and self.functions:
+            # Calls may change any global, so they are only made where the
+            # order in which things are evaluated cannot matter.  They are
+            # limited so that the running time stays reasonable.
+            self.calls += 1
+            name,ret,params = self.choose(self.functions)
+            args = [self.expression(locals, 2) for p in params]
+            self.lines.append('%s%s = %s(%s);' % (pad,
+                                                  self.choose(self.lvalues(locals)),
+                                                  name, ', '.join(args)))
+        else:
+            # Work through a pointer to a global.
+            name,ty,length = self.choose(self.globals)
+            target = name if not length else \
+                '%s[%s %% %d]' % (name, self.index(locals), length)
+            self.lines.append('%s{' % pad)
+            self.lines.append('%s  %s *p = &%s;' % (pad, ty, target))
+            self.lines.append('%s  *p = ADD(*p, %s);' %
+                              (pad, self.expression(locals, 2)))
+            self.lines.append('%s}' % pad)
+
+    def block(self, locals, loopVars, indent, depth):
+        for i in range(self.rng.randrange(1, 4)):
+            self.statement(locals, loopVars, indent, depth)
+
+    # Top level.
+
+    def declareStruct(self):
+        name = 'S%d' % len(self.structs)
+        fields = []
+        self.lines.append('struct %s {' % name)
+        for i in range(self.rng.randrange(1, 6)):
+            ty,bits = self.choose(intTypes)
+            field = 'f%d' % i
+            if bits > 8 and ty != 'long long' and ty != 'unsigned long long' \
+                    and self.chance(0.4):
+                width = self.rng.randrange(1, 17)
+                base = 'unsigned int' if ty.startswith('unsigned') else 'int'
+                self.lines.append('  %s %s : %d;' % (base, field, width))
+                fields.append((field, base, width))
+            else:
+                self.lines.append('  %s %s;' % (ty, field))
+                fields.append((field, ty, 0))
+        self.lines.append('};')
+        self.structs.append((name, fields))
+
+    def declareGlobal(self):
+        if self.structs and self.chance(0.3):
+            struct = self.rng.randrange(len(self.structs))
+            name = 'r%d' % len(self.records)
+            self.lines.append('static struct %s %s;' %
+                              (self.structs[struct][0], name))
+            self.records.append((name, struct))
+            return
+        ty,bits = self.choose(intTypes)
+        name = 'g%d' % len(self.globals)
+        if self.chance(0.3):
+            length = self.rng.randrange(2, 9)
+            values = [self.constant(ty) for i in range(length)]
+            self.lines.append('static %s %s[%d] = { %s };' %
+                              (ty, name, length, ', '.join(values)))
+        else:
+            length = 0
+            self.lines.append('static %s %s = %s;' %
+                              (ty, name, self.constant(ty)))
+        self.globals.append((name, ty, length))
+
+    def declareFunction(self):
+        name = 'func%d' % len(self.functions)
+        ret = self.choose(intTypes)[0]
+        params = [self.choose(intTypes)[0]
+                  for i in range(self.rng.randrange(0, 4))]
+        locals = ['p%d' % i for i in range(len(params))]
+        decls = ', '.join(['%s p%d' % (ty, i) for i,ty in enumerate(params)])
+        self.lines.append('')
+        self.lines.append('static __attribute__((noinline)) %s %s(%s) {' %
+                          (ret, name, decls or 'void'))
+        self.lines.append('  int i0, i1, i2;')
+        self.calls = 0
+        for i in range(self.rng.randrange(0, 3)):
+            ty = self.choose(intTypes)[0]
+            local = 'l%d' % i
+            self.lines.append('  %s %s = %s;' % (ty, local,
+                                                 self.expression(locals, 2)))
+            locals.append(local)
+        self.block(locals, [], 1, 3)
+        self.lines.append('  return %s;' % self.expression(locals, 3))
+        self.lines.append('}')
+        self.functions.append((name, ret, params))
+
+    def generate(self):
+        self.lines.append(header)
+        for i in range(self.rng.randrange(1, 4)):
+            self.declareStruct()
+        for i in range(self.size):
+            self.declareGlobal()
+        if not self.globals:
+            self.declareGlobal()
+        for i in range(self.size):
+            self.declareFunction()
+
+        # Call every function a number of times, then print a checksum of all
+        # the globals.
+        self.lines.append('')
+        self.lines.append('int main(void) {')
+        self.lines.append('  unsigned n;')
+        self.lines.append('  for (n = 0; n < %d; n++) {' % self.iterations)
+        for name,ret,params in self.functions:
+            args = [self.constant(p) for p in params]
+            self.lines.append('    mix(%s(%s));' % (name, ', '.join(args)))
+        self.lines.append('  }')
+        for name,ty,length in self.globals:
+            if length:
+                for i in range(length):
+                    self.lines.append('  mix(%s[%d]);' % (name, i))
+            else:
+                self.lines.append('  mix(%s);' % name)
+        for name,struct in self.records:
+            for field,ty,width in self.structs[struct][1]:
+                self.lines.append('  mix(%s.%s);' % (name, field))
+        self.lines.append('  printf("%llu\\n", checksum);')
+        self.lines.append('  return 0;')
+        self.lines.append('}')
+        return '\n'.join(self.lines) + '\n'
+
+def generate(seed, size=8, iterations=1000):
+    """Return the source of the random C program for the given seed.  The size
+    is the number of global variables and of functions, and main calls every
+    function the given number of times."""
+    return Generator(seed, size, iterations).generate()
@@ -1,5 +1,12 @@
+import hashlib
+import json
+import math
+import multiprocessing.pool
 import os
+import shutil
 import StringIO
+import tempfile
+import DERandomProgram
 import DEUtils
 
 from lit import Test
@@ -21,11 +28,7 @@ def describeFailure(output, cmd, out, err, exitCode):
         print >>output, "--"
 
 
-def compareCommands(cmds, args, cwd=None):
-    def executeOne(cmd):
-        return DEUtils.executeCommand(cmd + args, cwd)
-
-    results = map(executeOne, cmds)
+def compareResults(cmds, args, results):
     failed = False
 
     # Check that all commands exited with the same code.
@@ -49,40 +52,84 @@ def compareCommands(cmds, args, cwd=None):
     return (Test.FAIL, output.getvalue())
 
 
-def generateFortranModules(cmd, srcPath, OutputDir):
-    # Fortran 90 code often fails to compile because it needs modules defined by
-    # other files in the same directory.  If this seems to be happening then try
-    # to generate all of the required modules by compiling every Fortran file in
-    # the same directory.
-    srcDir,srcBase = os.path.split(srcPath)
-    cmd = cmd + ['-I', srcDir, '-fsyntax-only']
+def compareCommands(cmds, args, cwd=None):
+    def executeOne(cmd):
+        return DEUtils.executeCommand(cmd + args, cwd)
 
-    # If the file compiles OK or isn't failing because of lacking modules then
-    # there is no point in trying to generate modules.
-    out,err,exitCode = DEUtils.executeCommand(cmd + [srcPath], OutputDir)
-    if exitCode == 0 or err is None or "Can't open module file" not in err:
-        return
+    return compareResults(cmds, args, map(executeOne, cmds))
 
-    # Drat, it fails to compile.  Generate modules for every Fortran file in the
-    # source directory.
+
+def getCompilerKey(cmd):
+    # Something that changes if the compiler is rebuilt or the command changes.
+    key = '\0'.join(cmd)
+    if os.path.exists(cmd[0]):
+        st = os.stat(cmd[0])
+        key += '\0%d\0%d' % (st.st_size, st.st_mtime)
+    return key
+
+
+def writeCacheEntry(path, data):
+    # Write to a temporary file then rename, so that other processes never see
+    # a partly written entry.
+    dir = os.path.dirname(path)
+    lit.util.mkdir_p(dir)
+    fd,tmpPath = tempfile.mkstemp(dir=dir)
+    f = os.fdopen(fd, 'w')
+    json.dump(data, f)
+    f.close()
+    os.rename(tmpPath, path)
+
+
+def executeCachedCommand(cmd, args, srcPath, cwd, cacheDir):
+    # Compile srcPath, or if the same command was already run on a file with
+    # the same contents then return what happened that time.  Other files, such
+    # as headers, that the compile reads are not taken into account.
+    if not cacheDir:
+        return DEUtils.executeCommand(cmd + args, cwd)
+
+    hash = hashlib.sha1()
+    hash.update(getCompilerKey(cmd + args))
+    hash.update(open(srcPath, 'rb').read())
+    key = hash.hexdigest()
+    path = os.path.join(cacheDir, 'results', key[:2], key[2:])
+    if os.path.exists(path):
+        data = json.load(open(path))
+        return data['out'], data['err'], data['exitCode']
+
+    out,err,exitCode = DEUtils.executeCommand(cmd + args, cwd)
+    writeCacheEntry(path, { 'out' : out, 'err' : err, 'exitCode' : exitCode })
+    return out, err, exitCode
+
+
+def getFortranFiles(srcDir):
     fortranSuffixes = DEUtils.getSuffixesForLanguage('fortran')
-    filesToCompile = []
-    for filename in os.listdir(srcDir):
+    files = []
+    for filename in sorted(os.listdir(srcDir)):
         filepath = os.path.join(srcDir, filename)
         if not os.path.isdir(filepath):
             base,ext = os.path.splitext(filename)
             if ext in fortranSuffixes:
-                filesToCompile.append(filepath)
+                files.append(filepath)
+    return files
+
+
+def isMissingModule(err):
+    # Older versions of gfortran say "Can't", newer ones "Cannot".
+    return err is not None and ("Can't open module file" in err or
+                                "Cannot open module file" in err)
+
 
-    # Compile every file, returning triumphantly once the original file manages
-    # to compile, or giving up miserably if no progress is being made.
+def compileFortranFiles(cmd, filesToCompile, srcPath, OutputDir):
+    # Compile every file, returning triumphantly once srcPath manages to compile
+    # (never, if it is None), or giving up miserably if no progress is being
+    # made.
     newFilesToCompile = []
     while filesToCompile != newFilesToCompile:
         newFilesToCompile = []
         # Compile each file in turn.
         for path in filesToCompile:
             out,err,exitCode = DEUtils.executeCommand(cmd + [path], OutputDir)
-            if exitCode != 0 and err is not None and "Can't open module file" in err:
+            if exitCode != 0 and isMissingModule(err):
                 # It failed to compile due to a missing module.  Remember it for
                 # the next round.
                 newFilesToCompile.append(path);
@@ -98,8 +145,54 @@ def generateFortranModules(cmd, srcPath, OutputDir):
     return
 
 
+def generateFortranModules(cmd, srcPath, OutputDir, cacheDir=None):
+    # Fortran 90 code often fails to compile because it needs modules defined by
+    # other files in the same directory.  If this seems to be happening then try
+    # to generate all of the required modules by compiling every Fortran file in
+    # the same directory.  Returns the directory holding the modules, if any.
+    srcDir,srcBase = os.path.split(srcPath)
+    cmd = cmd + ['-I', srcDir, '-fsyntax-only']
+
+    # With a cache, the modules for a directory are generated once and shared by
+    # every test in it, until a Fortran file in the directory changes.
+    moduleDir = None
+    if cacheDir:
+        hash = hashlib.sha1()
+        hash.update(getCompilerKey(cmd))
+        for path in getFortranFiles(srcDir):
+            hash.update('\0%s\0%d' % (path, os.stat(path).st_mtime))
+        moduleDir = os.path.join(cacheDir, 'modules', hash.hexdigest())
+        if os.path.isdir(moduleDir):
+            return moduleDir
+
+    # If the file compiles OK or isn't failing because of lacking modules then
+    # there is no point in trying to generate modules.
+    out,err,exitCode = DEUtils.executeCommand(cmd + [srcPath], OutputDir)
+    if exitCode == 0 or not isMissingModule(err):
+        return None
+
+    # Drat, it fails to compile.  Generate modules for every Fortran file in the
+    # source directory.
+    if not moduleDir:
+        compileFortranFiles(cmd, getFortranFiles(srcDir), srcPath, OutputDir)
+        return OutputDir
+
+    # Other tests will want modules that this one does not, so generate all of
+    # them.  This is done in a private directory which is then renamed, so that
+    # tests running in parallel never see a partial set.
+    lit.util.mkdir_p(os.path.dirname(moduleDir))
+    tmpDir = tempfile.mkdtemp(dir=os.path.dirname(moduleDir))
+    compileFortranFiles(cmd, getFortranFiles(srcDir), None, tmpDir)
+    try:
+        os.rename(tmpDir, moduleDir)
+    except OSError:
+        # Someone else got there first.
+        shutil.rmtree(tmpDir, ignore_errors=True)
+    return moduleDir
+
+
 def executeCompilatorTest(test, litConfig, compilers, flags, language_flags,
-                          skip, xfails):
+                          skip, xfails, jobs=1, cacheDir=None):
     test_path = '/'.join(test.path_in_suite)
 
     # Skip this test if requested to do so.
@@ -116,9 +209,9 @@ def executeCompilatorTest(test, litConfig, compilers, flags, language_flags,
     # Is this test expected to fail?
     isXFail = test_path in xfails
 
-    # The file should be compiled to assembler.
+    # The file should be compiled to assembler, which is thrown away.
     srcPath = test.getSourcePath();
-    common_args = ['-S', srcPath]
+    common_args = ['-S', srcPath, '-o', os.devnull]
 
     # Look for headers and such-like in the directory containing the source.
     srcDir,srcBase = os.path.split(srcPath)
@@ -133,11 +226,362 @@ def executeCompilatorTest(test, litConfig, compilers, flags, language_flags,
     # Fortran files may not compile because they need modules provided by other
     # Fortran files.  Workaround this by generating missing modules if possible.
     if language == 'fortran':
-      generateFortranModules(compilers[0], srcPath, tmpDir)
+      moduleDir = generateFortranModules(compilers[0], srcPath, tmpDir,
+                                         cacheDir)
+      if moduleDir:
+        common_args += ['-I', moduleDir]
 
-    # Compile the test.
-    for args in flags:
-        result,output = compareCommands(compilers, common_args + args, tmpDir)
+    # Compile the test with every compiler and set of flags, several at a time.
+    # Each compile gets its own directory, since some languages write files
+    # (Fortran modules, Ada .ali files) to the current directory.  What GCC does
+    # without the plugin is cached, as it only changes if GCC does.
+    def executeOne(job):
+        i,j = job
+        jobDir = os.path.join(tmpDir, '%d-%d' % (i, j))
+        lit.util.mkdir_p(jobDir)
+        args = common_args + flags[i]
+        if j == 0:
+            return executeCachedCommand(compilers[j], args, srcPath, jobDir,
+                                        cacheDir)
+        return DEUtils.executeCommand(compilers[j] + args, jobDir)
+
+    allJobs = [(i, j) for i in range(len(flags)) for j in range(len(compilers))]
+    if jobs > 1:
+        pool = multiprocessing.pool.ThreadPool(min(jobs, len(allJobs)))
+        try:
+            results = pool.map(executeOne, allJobs)
+        finally:
+            pool.terminate()
+    else:
+        results = map(executeOne, allJobs)
+
+    for i,args in enumerate(flags):
+        start = i * len(compilers)
+        result,output = compareResults(compilers, common_args + args,
+                                       results[start:start + len(compilers)])
         if result != Test.PASS:
             return (Test.XFAIL if isXFail else result,output)
     return (Test.XPASS if isXFail else Test.PASS, None)
+
+
+def readBenchmarkReport(path):
+    # Map (test, compiler, flags) to the user time recorded in the given report.
+    times = {}
+    if not path or not os.path.exists(path):
+        return times
+    for line in open(path):
+        fields = line.rstrip('\n').split(',')
+        if len(fields) != 6 or fields[0] == 'test':
+            continue
+        test,compiler,flags,wall,user,rss = fields
+        times[(test, compiler, flags)] = float(user)
+    return times
+
+
+def executeBenchmarkTest(test, litConfig, compilers, compiler_names, flags,
+                         language_flags, skip, report, baseline, threshold,
+                         noise):
+    test_path = '/'.join(test.path_in_suite)
+
+    # Skip this test if requested to do so.
+    if test_path in skip:
+        return (Test.UNSUPPORTED, None)
+
+    # Create the output directory if it does not already exist.
+    execPath = test.getExecPath()
+    execDir,execBase = os.path.split(execPath)
+    tmpDir = os.path.join(execDir, 'Output')
+    tmpDir = os.path.join(tmpDir, execBase)
+    lit.util.mkdir_p(tmpDir)
+
+    # The file should be compiled to assembler, which is thrown away.
+    srcPath = test.getSourcePath();
+    common_args = ['-S', srcPath, '-o', os.devnull]
+
+    # Look for headers and such-like in the directory containing the source.
+    srcDir,srcBase = os.path.split(srcPath)
+    common_args += ['-I', srcDir]
+
+    # Add any file specific flags.
+    srcBase,srcExt = os.path.splitext(srcPath)
+    language = DEUtils.getLanguageForSuffix(srcExt)
+    if language in language_flags:
+      common_args += language_flags[language]
+
+    # Time every compiler with every set of flags.  Files that plain GCC cannot
+    # compile tell us nothing, so are not reported.
+    rows = []
+    output = StringIO.StringIO()
+    failed = False
+    for args in flags:
+        flag_string = ' '.join(args)
+        for name,cmd in zip(compiler_names, compilers):
+            out,err,exitCode,wall,user,rss = DEUtils.executeCommandWithUsage(
+                cmd + common_args + args, tmpDir)
+            if exitCode != 0:
+                if name == compiler_names[0]:
+                    return (Test.UNSUPPORTED, None)
+                describeFailure(output, cmd + common_args + args, out, err,
+                                exitCode)
+                failed = True
+                continue
+            rows.append((test_path, name, flag_string, wall, user, rss))
+
+            # Compare with the baseline, ignoring differences too small to be
+            # anything but noise.
+            old = baseline.get((test_path, name, flag_string))
+            if old is not None and user > old * (1 + threshold) and \
+               user - old > noise:
+                print >>output, "%s %s: user time %.3fs, was %.3fs (+%.0f%%)" % \
+                    (name, flag_string or '-O0', user, old,
+                     100 * (user - old) / old)
+                failed = True
+
+    # Append to the report.  Lines are written in one go, so runs in parallel
+    # do not mix them up, but run with -j1 for reliable timings.
+    lines = ''.join(['%s,%s,%s,%.3f,%.3f,%d\n' % row for row in rows])
+    f = open(report, 'a')
+    f.write(lines)
+    f.close()
+
+    if failed:
+        return (Test.FAIL, output.getvalue())
+    return (Test.PASS, None)
+
+
+# Two sided 95% points of Student's t-distribution, by degrees of freedom.
+tDistribution95 = [None, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365,
+                   2.306, 2.262, 2.228, 2.201, 2.179, 2.160, 2.145, 2.131,
+                   2.120, 2.110, 2.101, 2.093, 2.086]
+
+def meanAndError(samples):
+    # Return the mean of the samples and the half width of its 95% confidence
+    # interval.
+    n = len(samples)
+    mean = sum(samples) / n
+    if n < 2:
+        return mean, 0.0
+    variance = sum([(x - mean) ** 2 for x in samples]) / (n - 1)
+    t = tDistribution95[n - 1] if n - 1 < len(tDistribution95) else 1.960
+    return mean, t * math.sqrt(variance / n)
+
+
+def executeRuntimeTest(test, litConfig, configs, language_flags, skip,
+                       repetitions, report):
+    test_path = '/'.join(test.path_in_suite)
+
+    # Skip this test if requested to do so.
+    if test_path in skip:
+        return (Test.UNSUPPORTED, None)
+
+    # Create the output directory if it does not already exist.
+    execPath = test.getExecPath()
+    execDir,execBase = os.path.split(execPath)
+    tmpDir = os.path.join(execDir, 'Output')
+    tmpDir = os.path.join(tmpDir, execBase)
+    lit.util.mkdir_p(tmpDir)
+
+    srcPath = test.getSourcePath();
+    srcBase,srcExt = os.path.splitext(srcPath)
+    language = DEUtils.getLanguageForSuffix(srcExt)
+    lang_args = language_flags.get(language, [])
+
+    # Build an executable for each configuration, checking that they all print
+    # the same thing: a speedup is no use if the answer is wrong.
+    output = StringIO.StringIO()
+    times = []
+    expected = None
+    for name,cmd in configs:
+        exePath = os.path.join(tmpDir, name)
+        compile_cmd = cmd + [srcPath, '-o', exePath] + lang_args
+        out,err,exitCode = DEUtils.executeCommand(compile_cmd, tmpDir)
+        if exitCode != 0:
+            describeFailure(output, compile_cmd, out, err, exitCode)
+            return (Test.FAIL, output.getvalue())
+
+        samples = []
+        for i in range(repetitions):
+            out,err,exitCode,wall,user,rss = DEUtils.executeCommandWithUsage(
+                [exePath], tmpDir)
+            if exitCode != 0 or (expected is not None and out != expected):
+                describeFailure(output, [exePath], out, err, exitCode)
+                if exitCode == 0:
+                    print >>output, "Expected output:"
+                    output.write(expected)
+                return (Test.FAIL, output.getvalue())
+            expected = out
+            samples.append(wall)
+        times.append(meanAndError(samples))
+
+    # Work out how much faster than the first configuration each of the others
+    # is.  The relative errors of the two means are combined to give the error
+    # in the speedup.
+    base,baseError = times[0]
+    lines = ''
+    for (name,cmd),(mean,error) in zip(configs, times):
+        speedup = base / mean
+        relError = math.sqrt((baseError / base) ** 2 + (error / mean) ** 2)
+        lines += '%s,%s,%.4f,%.4f,%.3f,%.3f,%.3f\n' % (test_path, name, mean,
+          error, speedup, speedup * (1 - relError), speedup * (1 + relError))
+
+    # Append to the report.  Lines are written in one go, so runs in parallel
+    # do not mix them up, but run with -j1 for reliable timings.
+    f = open(report, 'a')
+    f.write(lines)
+    f.close()
+
+    return (Test.PASS, lines)
+
+
+# The phases in the plugin's statistics file that make up converting GCC's
+# representation to LLVM's.
+conversionPhases = ['LLVM gimple to IR conversion', 'LLVM global variables',
+                    'LLVM streamed initializers']
+
+def executeStressTest(test, litConfig, compiler, language_flags, skip, report,
+                      max_exponent, noise):
+    test_path = '/'.join(test.path_in_suite)
+
+    # Skip this test if requested to do so.
+    if test_path in skip:
+        return (Test.UNSUPPORTED, None)
+
+    # Create the output directory if it does not already exist.
+    execPath = test.getExecPath()
+    execDir,execBase = os.path.split(execPath)
+    tmpDir = os.path.join(execDir, 'Output')
+    tmpDir = os.path.join(tmpDir, execBase)
+    lit.util.mkdir_p(tmpDir)
+
+    # The test is a Python script defining the language of the code it outputs,
+    # the sizes to try, and a function generating code of a given size.
+    generator = {}
+    execfile(test.getSourcePath(), generator)
+    language = generator['language']
+    suffix = sorted(DEUtils.getSuffixesForLanguage(language))[0]
+    lang_args = language_flags.get(language, [])
+
+    output = StringIO.StringIO()
+    rows = []
+    for size in generator['sizes']:
+        srcPath = os.path.join(tmpDir, 'size-%d%s' % (size, suffix))
+        statsPath = os.path.join(tmpDir, 'size-%d.json' % size)
+        f = open(srcPath, 'w')
+        f.write(generator['generate'](size))
+        f.close()
+
+        cmd = compiler + ['-S', srcPath, '-o', os.devnull,
+                          '-fplugin-arg-dragonegg-stats-file=' + statsPath]
+        cmd += lang_args
+        out,err,exitCode,wall,user,rss = DEUtils.executeCommandWithUsage(cmd,
+                                                                        tmpDir)
+        if exitCode != 0:
+            describeFailure(output, cmd, out, err, exitCode)
+            return (Test.FAIL, output.getvalue())
+
+        phases = json.load(open(statsPath))['phases']
+        conversion = sum([phases.get(p, 0.0) for p in conversionPhases])
+        rows.append((test_path, size, conversion, user, rss))
+
+    # Append to the report.  Lines are written in one go, so runs in parallel
+    # do not mix them up, but run with -j1 for reliable timings.
+    lines = ''.join(['%s,%d,%.3f,%.3f,%d\n' % row for row in rows])
+    f = open(report, 'a')
+    f.write(lines)
+    f.close()
+
+    # Going from one size to the next, the conversion time should grow like
+    # size^exponent for an exponent not much more than one.  Times too small to
+    # be anything but noise are not checked.
+    failed = False
+    for row1,row2 in zip(rows, rows[1:]):
+        n1,time1 = row1[1:3]
+        n2,time2 = row2[1:3]
+        if time1 < noise or time2 < noise:
+            continue
+        exponent = math.log(time2 / time1) / math.log(float(n2) / n1)
+        if exponent > max_exponent:
+            print >>output, "size %d -> %d: conversion time %.3fs -> %.3fs," \
+                " growing like size^%.2f" % (n1, n2, time1, time2, exponent)
+            failed = True
+
+    if failed:
+        return (Test.FAIL, output.getvalue())
+    return (Test.PASS, lines)
+
+
+def executeFuzzTest(test, litConfig, seed, configs, size, iterations,
+                    repetitions, timeout, max_slowdown, noise, report):
+    # Create the output directory if it does not already exist.
+    execPath = test.getExecPath()
+    execDir,execBase = os.path.split(execPath)
+    tmpDir = os.path.join(execDir, 'Output')
+    tmpDir = os.path.join(tmpDir, execBase)
+    lit.util.mkdir_p(tmpDir)
+
+    # The program is left behind, so that failures can be looked into.
+    srcPath = os.path.join(tmpDir, '%s.c' % execBase)
+    f = open(srcPath, 'w')
+    f.write(DERandomProgram.generate(seed, size, iterations))
+    f.close()
+
+    output = StringIO.StringIO()
+    def fail(message):
+        print >>output, message
+        print >>output, "Program: %s" % srcPath
+        print >>output, "Reproduce with --param seed=%d --param count=1" \
+            " --param size=%d --param iterations=%d" % (seed, size, iterations)
+        return (Test.FAIL, output.getvalue())
+
+    # Build and run the program in every configuration.  The program prints a
+    # checksum of its global variables, so they should all print the same.
+    times = {}
+    expected = None
+    for name,cmd,baseline in configs:
+        exePath = os.path.join(tmpDir, name)
+        compile_cmd = cmd + [srcPath, '-o', exePath]
+        out,err,exitCode = DEUtils.executeCommand(compile_cmd, tmpDir)
+        if exitCode != 0:
+            describeFailure(output, compile_cmd, out, err, exitCode)
+            return fail("%s failed to compile the program." % name)
+
+        run_cmd = [exePath]
+        if timeout:
+            run_cmd = ['timeout', str(timeout)] + run_cmd
+        best = None
+        for i in range(repetitions):
+            out,err,exitCode,wall,user,rss = DEUtils.executeCommandWithUsage(
+                run_cmd, tmpDir)
+            if exitCode != 0:
+                describeFailure(output, run_cmd, out, err, exitCode)
+                return fail("The program built by %s did not run." % name)
+            if expected is None:
+                expected = (configs[0][0], out)
+            elif out != expected[1]:
+                return fail("The program built by %s printed %r, but the one" \
+                    " built by %s printed %r." % (name, out.strip(),
+                    expected[0], expected[1].strip()))
+            best = wall if best is None else min(best, wall)
+        times[name] = best
+
+    # Code generated with the plugin should not be much slower than what GCC
+    # produces at the same optimization level.
+    lines = ''
+    failed = False
+    for name,cmd,baseline in configs:
+        slowdown = times[name] / times[baseline] if baseline else 1.0
+        lines += '%d,%s,%.4f,%.3f\n' % (seed, name, times[name], slowdown)
+        if baseline and times[baseline] > noise and slowdown > max_slowdown:
+            print >>output, "%s: %.3fs, %.2f times slower than %s" % (name,
+                times[name], slowdown, baseline)
+            failed = True
+
+    # Append to the report.  Lines are written in one go, so runs in parallel
+    # do not mix them up.
+    f = open(report, 'a')
+    f.write(lines)
+    f.close()
+
+    if failed:
+        return fail("The program built with the plugin is too slow.")
+    return (Test.PASS, lines)
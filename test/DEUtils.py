@@ -2,6 +2,7 @@ import os
 import signal
 import subprocess
 import tempfile
+import time
 
 suffixMap = {
   '.adb'   : 'ada',
@@ -44,6 +45,37 @@ def executeCommand(command, cwd=None, env=None):
 
     return out, err, exitCode
 
+def executeCommandWithUsage(command, cwd=None, env=None):
+    """Like executeCommand, but also return the wall time and user time in
+    seconds and the peak resident set size in kilobytes used by the command."""
+    outFile = tempfile.TemporaryFile()
+    errFile = tempfile.TemporaryFile()
+    start = time.time()
+    p = subprocess.Popen(command, cwd=cwd,
+                         stdin=open(os.devnull),
+                         stdout=outFile,
+                         stderr=errFile,
+                         env=env, close_fds=True)
+    # Use wait4 rather than wait in order to get the resource usage of just
+    # this command (the compiler driver and everything it ran).
+    pid,status,usage = os.wait4(p.pid, 0)
+    wall = time.time() - start
+    p.returncode = 0 # Stop the Popen object from waiting for the child too.
+
+    if os.WIFSIGNALED(status):
+        exitCode = -os.WTERMSIG(status)
+    else:
+        exitCode = os.WEXITSTATUS(status)
+
+    # Detect Ctrl-C in subprocess.
+    if exitCode == -signal.SIGINT:
+        raise KeyboardInterrupt
+
+    outFile.seek(0)
+    errFile.seek(0)
+    return outFile.read(), errFile.read(), exitCode, wall, usage.ru_utime, \
+           usage.ru_maxrss
+
 def getLanguageForSuffix(suffix):
   return suffixMap[suffix]
 
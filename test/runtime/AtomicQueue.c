@@ -0,0 +1,43 @@
+// A single producer, single consumer lock free ring buffer, driven by two
+// threads.  Tests the atomic builtins and their memory orderings.  Waiting
+// threads yield so that this finishes even on a machine with only one core.
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+#define ITEMS 100000000
+#define QUEUE_SIZE 1024
+
+static unsigned Ring[QUEUE_SIZE];
+static unsigned long Head, Tail;
+
+static void *producer(void *arg) {
+  unsigned long tail = 0;
+  unsigned i;
+  (void)arg;
+  for (i = 1; i <= ITEMS; ++i) {
+    while (tail - __atomic_load_n(&Head, __ATOMIC_ACQUIRE) == QUEUE_SIZE)
+      sched_yield();
+    Ring[tail % QUEUE_SIZE] = i;
+    __atomic_store_n(&Tail, ++tail, __ATOMIC_RELEASE);
+  }
+  return 0;
+}
+
+int main(void) {
+  pthread_t thread;
+  unsigned long head = 0, sum = 0;
+  unsigned n;
+  if (pthread_create(&thread, 0, producer, 0))
+    return 1;
+  for (n = 0; n < ITEMS; ++n) {
+    while (__atomic_load_n(&Tail, __ATOMIC_ACQUIRE) == head)
+      sched_yield();
+    sum += Ring[head % QUEUE_SIZE] ^ n;
+    __atomic_store_n(&Head, ++head, __ATOMIC_RELEASE);
+  }
+  pthread_join(thread, 0);
+  printf("%lu\n", sum);
+  return 0;
+}
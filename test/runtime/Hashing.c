@@ -0,0 +1,61 @@
+// FNV-1a and MurmurHash3 finalizer style hashing of a buffer, feeding an open
+// addressing hash table.  Tests integer multiplies, shifts and unpredictable
+// memory accesses.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define KEYS (1 << 18)
+#define TABLE_SIZE (1 << 20)
+#define ROUNDS 8
+
+static uint64_t Table[TABLE_SIZE];
+
+static uint64_t fnv1a(const unsigned char *p, size_t n) {
+  uint64_t h = 14695981039346656037ULL;
+  size_t i;
+  for (i = 0; i < n; ++i) {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static uint64_t mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+static int insert(uint64_t key) {
+  uint64_t slot = mix(key) & (TABLE_SIZE - 1);
+  while (Table[slot]) {
+    if (Table[slot] == key)
+      return 0;
+    slot = (slot + 1) & (TABLE_SIZE - 1);
+  }
+  Table[slot] = key;
+  return 1;
+}
+
+int main(void) {
+  unsigned char key[24];
+  uint64_t check = 0;
+  unsigned inserted = 0;
+  int r, i;
+  for (r = 0; r < ROUNDS; ++r) {
+    memset(Table, 0, sizeof(Table));
+    for (i = 0; i < KEYS; ++i) {
+      int len = sprintf((char *)key, "key-%d-%d", i % (KEYS / 2), r);
+      uint64_t h = fnv1a(key, len) | 1;
+      inserted += insert(h);
+      check ^= mix(h + i);
+    }
+  }
+  printf("%u %llu\n", inserted, (unsigned long long)check);
+  return 0;
+}
@@ -0,0 +1,46 @@
+// Many small static constructors, as in a program made of many C++ units with
+// dynamic initializers.  The program starts itself over and over, so this
+// measures process startup, where each constructor on a page of its own costs
+// a page fault.  Tests -fplugin-arg-dragonegg-merge-constructors.
+
+#include <spawn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/wait.h>
+
+#define STARTS 2000
+
+extern char **environ;
+
+static uint32_t table[4096];
+
+#define CTOR(n)                                                                \
+  static __attribute__((constructor)) void init_##n(void) {                    \
+    table[n - 10000] = (uint32_t)n * 2654435761u;                              \
+  }
+#define C4(n) CTOR(n##0) CTOR(n##1) CTOR(n##2) CTOR(n##3)
+#define C16(n) C4(n##0) C4(n##1) C4(n##2) C4(n##3)
+#define C64(n) C16(n##0) C16(n##1) C16(n##2) C16(n##3)
+#define C256(n) C64(n##0) C64(n##1) C64(n##2) C64(n##3)
+
+C256(1)
+
+int main(int argc, char **argv) {
+  uint32_t total = 0;
+  unsigned i;
+  for (i = 0; i != sizeof(table) / sizeof(table[0]); ++i)
+    total ^= table[i];
+  if (argc > 1)
+    return total & 1; // A child: only starting up counts.
+
+  for (i = 0; i != STARTS; ++i) {
+    char *args[] = { argv[0], (char *)"child", 0 };
+    pid_t pid;
+    int status;
+    if (posix_spawn(&pid, argv[0], 0, 0, args, environ) ||
+        waitpid(pid, &status, 0) != pid)
+      return 1;
+  }
+  printf("%u\n", total);
+  return 0;
+}
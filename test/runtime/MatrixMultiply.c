@@ -0,0 +1,40 @@
+// Dense single precision matrix multiply, using the cache friendly i-k-j loop
+// order.  Tests vectorization of the inner loop.
+
+#include <stdio.h>
+
+#define N 512
+#define ITERATIONS 12
+
+static float A[N][N], B[N][N], C[N][N];
+
+static void multiply(void) {
+  int i, j, k;
+  for (i = 0; i < N; ++i)
+    for (j = 0; j < N; ++j)
+      C[i][j] = 0;
+  for (i = 0; i < N; ++i)
+    for (k = 0; k < N; ++k) {
+      float a = A[i][k];
+      for (j = 0; j < N; ++j)
+        C[i][j] += a * B[k][j];
+    }
+}
+
+int main(void) {
+  double sum = 0;
+  int i, j, n;
+  for (i = 0; i < N; ++i)
+    for (j = 0; j < N; ++j) {
+      A[i][j] = (float)((i * 7 + j * 3) % 17) / 16;
+      B[i][j] = (float)((i * 5 + j * 11) % 13) / 12;
+    }
+  for (n = 0; n < ITERATIONS; ++n) {
+    multiply();
+    sum += C[n][N - 1 - n];
+  }
+  for (i = 0; i < N; ++i)
+    sum += C[i][i];
+  printf("%.1f\n", sum);
+  return 0;
+}
@@ -0,0 +1,73 @@
+// Rank propagation over a random graph in compressed sparse row form, and a
+// walk along a linked list threaded through it in random order.  Tests loops
+// whose memory accesses miss the cache, which is where prefetching pays off.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define VERTICES (1 << 20)
+#define DEGREE 8
+#define EDGES (VERTICES * DEGREE)
+#define ROUNDS 8
+
+static unsigned Offsets[VERTICES + 1], Targets[EDGES], Next[VERTICES];
+static double Rank[VERTICES], NewRank[VERTICES];
+
+static uint32_t Seed = 12345;
+
+static uint32_t rnd(void) {
+  Seed = Seed * 1664525u + 1013904223u;
+  return Seed >> 8;
+}
+
+static void build(void) {
+  unsigned i, j;
+  for (i = 0; i < VERTICES; ++i) {
+    Offsets[i] = i * DEGREE;
+    for (j = 0; j < DEGREE; ++j)
+      Targets[i * DEGREE + j] = rnd() % VERTICES;
+    Next[i] = i;
+    Rank[i] = 1.0 / VERTICES;
+  }
+  Offsets[VERTICES] = EDGES;
+  // Shuffle, then link each vertex to the one after it in the shuffled order.
+  for (i = VERTICES - 1; i > 0; --i) {
+    unsigned k = rnd() % (i + 1), t = Next[i];
+    Next[i] = Next[k];
+    Next[k] = t;
+  }
+}
+
+static void propagate(void) {
+  unsigned i, e;
+  for (i = 0; i < VERTICES; ++i) {
+    double Sum = 0;
+    for (e = Offsets[i]; e < Offsets[i + 1]; ++e)
+      Sum += Rank[Targets[e]];
+    NewRank[i] = 0.15 / VERTICES + 0.85 * Sum / DEGREE;
+  }
+  for (i = 0; i < VERTICES; ++i)
+    Rank[i] = NewRank[i];
+}
+
+static double walk(void) {
+  unsigned i, v = Next[0];
+  double Sum = 0;
+  for (i = 0; i < VERTICES; ++i) {
+    Sum += Rank[v];
+    v = Next[v];
+  }
+  return Sum;
+}
+
+int main(void) {
+  double Check = 0;
+  int r;
+  build();
+  for (r = 0; r < ROUNDS; ++r) {
+    propagate();
+    Check += walk();
+  }
+  printf("%.6f\n", Check * 1000);
+  return 0;
+}
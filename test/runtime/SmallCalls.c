@@ -0,0 +1,35 @@
+// Many calls to small functions that cannot be inlined, using values that are
+// live across the calls.  Tests the cost of saving and restoring registers
+// around calls, which interprocedural register allocation can avoid.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define ITERATIONS 50000000
+
+static __attribute__((noinline)) uint32_t rotate(uint32_t x, unsigned n) {
+  return (x << n) | (x >> (32 - n));
+}
+
+static __attribute__((noinline)) uint32_t scramble(uint32_t x) {
+  return (x ^ 0x9e3779b9u) * 0x85ebca6bu;
+}
+
+static __attribute__((noinline)) uint32_t step(uint32_t a, uint32_t b) {
+  return rotate(a + b, 7) ^ scramble(b);
+}
+
+int main(void) {
+  uint32_t a = 1, b = 2, c = 3, d = 4, e = 5, f = 6;
+  int i;
+  for (i = 0; i < ITERATIONS; ++i) {
+    a = step(a, b);
+    b = step(b, c) + a;
+    c += d ^ e;
+    d += e ^ f;
+    e += f ^ a;
+    f += a ^ b;
+  }
+  printf("%u %u %u %u %u %u\n", a, b, c, d, e, f);
+  return 0;
+}
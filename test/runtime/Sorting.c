@@ -0,0 +1,104 @@
+// Quicksort with an insertion sort cutoff, and a heapsort, of 32 bit integers.
+// Tests branchy, recursive integer code.
+
+#include <stdio.h>
+#include <string.h>
+
+#define N (1 << 20)
+#define ROUNDS 3
+
+static int Input[N], Work[N];
+
+static void insertion_sort(int *a, int n) {
+  int i, j;
+  for (i = 1; i < n; ++i) {
+    int v = a[i];
+    for (j = i; j > 0 && a[j - 1] > v; --j)
+      a[j] = a[j - 1];
+    a[j] = v;
+  }
+}
+
+static void quick_sort(int *a, int n) {
+  while (n > 16) {
+    int pivot = a[n / 2], i = 0, j = n - 1;
+    while (i <= j) {
+      while (a[i] < pivot)
+        ++i;
+      while (a[j] > pivot)
+        --j;
+      if (i <= j) {
+        int t = a[i];
+        a[i++] = a[j];
+        a[j--] = t;
+      }
+    }
+    // Recurse into the smaller half, loop on the larger one.
+    if (j + 1 < n - i) {
+      quick_sort(a, j + 1);
+      a += i;
+      n -= i;
+    } else {
+      quick_sort(a + i, n - i);
+      n = j + 1;
+    }
+  }
+  insertion_sort(a, n);
+}
+
+static void sift_down(int *a, int root, int n) {
+  while (2 * root + 1 < n) {
+    int child = 2 * root + 1;
+    if (child + 1 < n && a[child] < a[child + 1])
+      ++child;
+    if (a[root] >= a[child])
+      return;
+    int t = a[root];
+    a[root] = a[child];
+    a[child] = t;
+    root = child;
+  }
+}
+
+static void heap_sort(int *a, int n) {
+  int i;
+  for (i = n / 2 - 1; i >= 0; --i)
+    sift_down(a, i, n);
+  for (i = n - 1; i > 0; --i) {
+    int t = a[0];
+    a[0] = a[i];
+    a[i] = t;
+    sift_down(a, 0, i);
+  }
+}
+
+static unsigned long check(const int *a, int n) {
+  unsigned long sum = 0;
+  int i;
+  for (i = 1; i < n; ++i)
+    if (a[i - 1] > a[i])
+      return 0;
+  for (i = 0; i < n; i += 997)
+    sum = sum * 31 + (unsigned)a[i];
+  return sum;
+}
+
+int main(void) {
+  unsigned seed = 42;
+  unsigned long sum = 0;
+  int i, r;
+  for (r = 0; r < ROUNDS; ++r) {
+    for (i = 0; i < N; ++i) {
+      seed = seed * 1664525 + 1013904223;
+      Input[i] = (int)(seed >> 1) - (1 << 30);
+    }
+    memcpy(Work, Input, sizeof(Work));
+    quick_sort(Work, N);
+    sum += check(Work, N);
+    memcpy(Work, Input, sizeof(Work));
+    heap_sort(Work, N);
+    sum += check(Work, N);
+  }
+  printf("%lu\n", sum);
+  return 0;
+}
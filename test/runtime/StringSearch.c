@@ -0,0 +1,59 @@
+// Naive and Boyer-Moore-Horspool substring search over a generated text.  Tests
+// byte loads, compares and poorly predictable branches.
+
+#include <stdio.h>
+#include <string.h>
+
+#define TEXT_SIZE (1 << 22)
+#define ROUNDS 4
+
+static char Text[TEXT_SIZE + 1];
+
+static int naive_count(const char *text, int n, const char *pat, int m) {
+  int count = 0, i, j;
+  for (i = 0; i + m <= n; ++i) {
+    for (j = 0; j < m && text[i + j] == pat[j]; ++j)
+      ;
+    count += j == m;
+  }
+  return count;
+}
+
+static int horspool_count(const char *text, int n, const char *pat, int m) {
+  int skip[256];
+  int count = 0, i;
+  for (i = 0; i < 256; ++i)
+    skip[i] = m;
+  for (i = 0; i < m - 1; ++i)
+    skip[(unsigned char)pat[i]] = m - 1 - i;
+  i = 0;
+  while (i + m <= n) {
+    int j = m - 1;
+    while (j >= 0 && text[i + j] == pat[j])
+      --j;
+    if (j < 0)
+      ++count;
+    i += skip[(unsigned char)text[i + m - 1]];
+  }
+  return count;
+}
+
+int main(void) {
+  static const char *const Patterns[] = { "abc", "acab", "bacabca",
+                                          "cabbacbacab", "aaaa" };
+  unsigned seed = 12345;
+  long total = 0;
+  int i, r, p;
+  for (i = 0; i < TEXT_SIZE; ++i) {
+    seed = seed * 1103515245 + 12345;
+    Text[i] = 'a' + (seed >> 16) % 3;
+  }
+  for (r = 0; r < ROUNDS; ++r)
+    for (p = 0; p < 5; ++p) {
+      int m = strlen(Patterns[p]);
+      total += naive_count(Text, TEXT_SIZE, Patterns[p], m);
+      total += horspool_count(Text, TEXT_SIZE, Patterns[p], m);
+    }
+  printf("%ld\n", total);
+  return 0;
+}
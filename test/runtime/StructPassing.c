@@ -0,0 +1,52 @@
+// Small structs passed and returned by value through calls that are not
+// inlined.  Tests the ABI code: how aggregates are split into registers, and
+// whether they take a trip through memory on the way.
+
+#include <stdio.h>
+
+#define ITERATIONS 50000000
+
+typedef struct { double x, y; } Vec2;
+typedef struct { float r, g, b, a; } Color;
+typedef struct { int lo; short mid; char hi; } Mixed;
+typedef struct { long a, b, c; } Big;
+
+__attribute__((noinline)) static Vec2 vec_add(Vec2 p, Vec2 q) {
+  Vec2 r = { p.x + q.x, p.y + q.y };
+  return r;
+}
+
+__attribute__((noinline)) static Color blend(Color c, Color d) {
+  Color r = { (c.r + d.r) * 0.5f, (c.g + d.g) * 0.5f, (c.b + d.b) * 0.5f,
+              c.a };
+  return r;
+}
+
+__attribute__((noinline)) static Mixed bump(Mixed m) {
+  m.lo += 3;
+  m.mid ^= 5;
+  m.hi += 1;
+  return m;
+}
+
+__attribute__((noinline)) static Big rotate(Big b) {
+  Big r = { b.b, b.c, b.a + 1 };
+  return r;
+}
+
+int main(void) {
+  Vec2 v = { 0, 0 }, step = { 0.5, -0.25 };
+  Color c = { 0, 0, 0, 1 }, white = { 1, 1, 1, 1 };
+  Mixed m = { 0, 0, 0 };
+  Big b = { 1, 2, 3 };
+  long i;
+  for (i = 0; i < ITERATIONS; ++i) {
+    v = vec_add(v, step);
+    c = blend(c, white);
+    m = bump(m);
+    b = rotate(b);
+  }
+  printf("%.2f %.2f %.3f %d %d %d %ld\n", v.x, v.y, c.r, m.lo, m.mid, m.hi,
+         b.a + b.b + b.c);
+  return 0;
+}
@@ -0,0 +1,50 @@
+// Short inner loops with few instructions, entered many times and running for
+// only a few iterations each time.  Tests how the placement of loop headers in
+// memory affects instruction fetch, which -falign-loops controls.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define SIZE 64
+#define ITERATIONS 2000000
+
+static uint32_t data[SIZE];
+
+static __attribute__((noinline)) uint32_t sum(unsigned n) {
+  uint32_t s = 0;
+  unsigned i;
+  for (i = 0; i < n; ++i)
+    s += data[i];
+  return s;
+}
+
+static __attribute__((noinline)) unsigned count_below(unsigned n, uint32_t x) {
+  unsigned c = 0;
+  unsigned i;
+  for (i = 0; i < n; ++i)
+    c += data[i] < x;
+  return c;
+}
+
+static __attribute__((noinline)) uint32_t hash(unsigned n) {
+  uint32_t h = 2166136261u;
+  unsigned i;
+  for (i = 0; i < n; ++i)
+    h = (h ^ data[i]) * 16777619u;
+  return h;
+}
+
+int main(void) {
+  uint32_t total = 0;
+  int i;
+  for (i = 0; i < SIZE; ++i)
+    data[i] = (uint32_t)i * 2654435761u;
+  for (i = 0; i < ITERATIONS; ++i) {
+    unsigned n = 5 + (i & 15);
+    total += sum(n);
+    total += count_below(n, (uint32_t)i * 40503u);
+    total ^= hash(n);
+  }
+  printf("%u\n", total);
+  return 0;
+}
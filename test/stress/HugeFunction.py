@@ -0,0 +1,24 @@
+# A single function made of a long run of statements, mixing arithmetic, loads,
+# stores and calls.
+
+language = 'c'
+sizes = [6250, 25000, 100000]
+
+def generate(n):
+    lines = ['extern void use(int);',
+             'int g[64];',
+             'int huge(int a, int b) {',
+             '  int x = a, y = b;']
+    for i in range(n):
+        kind = i % 4
+        if kind == 0:
+            lines.append('  x = x * %d + y;' % (i % 13 + 1))
+        elif kind == 1:
+            lines.append('  y ^= g[%d] + x;' % (i % 64))
+        elif kind == 2:
+            lines.append('  g[%d] = x - y;' % (i * 7 % 64))
+        else:
+            lines.append('  if (x > y) use(x); else use(y);')
+    lines.append('  return x + y;')
+    lines.append('}')
+    return '\n'.join(lines) + '\n'
@@ -0,0 +1,22 @@
+# A struct with many fields of assorted types, each of which is accessed.
+
+language = 'c'
+sizes = [625, 2500, 10000]
+
+def generate(n):
+    types = ['char', 'short', 'int', 'long', 'float', 'double']
+    lines = ['struct huge {']
+    for i in range(n):
+        lines.append('  %s f%d;' % (types[i % len(types)], i))
+    lines.append('};')
+    lines.append('double sum(struct huge *p) {')
+    lines.append('  double s = 0;')
+    for i in range(n):
+        lines.append('  s += p->f%d;' % i)
+    lines.append('  return s;')
+    lines.append('}')
+    lines.append('void clear(struct huge *p) {')
+    for i in range(n):
+        lines.append('  p->f%d = 0;' % i)
+    lines.append('}')
+    return '\n'.join(lines) + '\n'
@@ -0,0 +1,19 @@
+# A switch with many cases, every other one a case range.
+
+language = 'c'
+sizes = [625, 2500, 10000]
+
+def generate(n):
+    lines = ['extern int use(int);',
+             'int huge(int x) {',
+             '  switch (x) {']
+    for i in range(n):
+        if i % 2:
+            lines.append('  case %d ... %d: return use(%d);' %
+                         (i * 8, i * 8 + 3, i))
+        else:
+            lines.append('  case %d: return use(%d);' % (i * 8, i))
+    lines.append('  default: return 0;')
+    lines.append('  }')
+    lines.append('}')
+    return '\n'.join(lines) + '\n'
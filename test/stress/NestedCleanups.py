@@ -0,0 +1,23 @@
+# Deeply nested scopes, each with an object needing destruction and a try block,
+# with calls that may throw at every level.
+
+language = 'c++'
+sizes = [32, 128, 512]
+
+def generate(n):
+    lines = ['extern void may_throw(int);',
+             'struct Guard { Guard(int); ~Guard(); int x; };',
+             'void nested() {']
+    for i in range(n):
+        indent = '  ' * (i + 1)
+        lines.append(indent + 'try {')
+        lines.append(indent + '  Guard g%d(%d);' % (i, i))
+        lines.append(indent + '  may_throw(%d);' % i)
+    for i in reversed(range(n)):
+        indent = '  ' * (i + 1)
+        lines.append(indent + '  may_throw(-%d);' % i)
+        lines.append(indent + '} catch (int e) {')
+        lines.append(indent + '  may_throw(e + %d);' % i)
+        lines.append(indent + '}')
+    lines.append('}')
+    return '\n'.join(lines) + '\n'
@@ -0,0 +1,11 @@
+# A huge array with an initializer that only sets one element in a thousand.
+
+language = 'c'
+sizes = [625000, 2500000, 10000000]
+
+def generate(n):
+    lines = ['int huge[%d] = {' % n]
+    for i in range(0, n, 1000):
+        lines.append('  [%d] = %d,' % (i + i % 7, i % 997 + 1))
+    lines.append('};')
+    return '\n'.join(lines) + '\n'
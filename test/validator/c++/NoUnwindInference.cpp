@@ -0,0 +1,31 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+// RUN: %dragonegg -S %s -o - | FileCheck %s --check-prefix=ODR
+// Check that functions which cannot throw are marked nounwind, and that calls
+// to them are not invokes.  Inline functions are left alone, since the copy
+// from another unit may be the one linked in.
+
+struct Guard {
+  ~Guard();
+};
+
+static int leaf(int x) { return x * 2; }
+// CHECK: define internal {{.*}}@_ZL4leafi({{.*}}) [[NOUNWIND:#[0-9]+]]
+
+int caller(int x) {
+  Guard g;
+  return leaf(x);
+}
+// CHECK: define {{.*}}@_Z6calleri
+// CHECK-NOT: invoke {{.*}}@_ZL4leafi
+// CHECK: call {{.*}}@_ZL4leafi
+
+// CHECK: attributes [[NOUNWIND]] = { {{.*}}nounwind
+
+inline int twice(int x) { return x * 2; }
+
+int odr_caller(int x) {
+  Guard g;
+  return twice(x);
+}
+// ODR: define {{.*}}@_Z10odr_calleri
+// ODR: invoke {{.*}}@_Z5twicei
@@ -0,0 +1,24 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+// XFAIL: gcc-4.5, gcc-4.6, gcc-4.7, gcc-4.8
+// Check that pointers which cannot be null are marked nonnull, and where the
+// size of what they point to is known also dereferenceable.
+
+int deref(int &r) { return r; }
+// CHECK: define {{.*}}@_Z5derefRi(i32* nonnull dereferenceable(4)
+
+struct S {
+  int a, b;
+  int get();
+};
+int S::get() { return b; }
+// CHECK: define {{.*}}@_ZN1S3getEv(%struct.S* nonnull dereferenceable(8)
+
+__attribute__((nonnull(1))) int first(int *p, int *q);
+__attribute__((returns_nonnull)) int *get();
+
+int use() {
+  int x = 0;
+  return first(&x, get());
+}
+// CHECK: call nonnull i32* @_Z3getv()
+// CHECK: call {{.*}}@_Z5firstPiS_(i32* nonnull dereferenceable(4)
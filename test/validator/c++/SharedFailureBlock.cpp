@@ -0,0 +1,14 @@
+// RUN: %dragonegg -xc++ -S -o - %s | FileCheck %s
+// Must-not-throw regions that call the same function share the failure code.
+
+struct A { ~A(); };
+void f();
+
+void g() {
+// CHECK: @_Z1gv
+// CHECK: call void @_ZSt9terminatev
+// CHECK-NOT: call void @_ZSt9terminatev
+// CHECK: }
+  { A a; f(); }
+  { A b; f(); }
+}
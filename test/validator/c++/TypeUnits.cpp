@@ -0,0 +1,20 @@
+// RUN: %dragonegg -S -g -gdwarf-4 -fdebug-types-section %s -o - | FileCheck %s
+// XFAIL: gcc-4.5, gcc-4.6, gcc-4.7, gcc-4.8
+
+// Types with linkage get an ODR identifier so they can go in a type unit.
+struct Shared {
+  int a;
+  double b;
+};
+// CHECK-DAG: identifier: "_ZTS6Shared"
+
+// Types private to this translation unit must not be merged.
+namespace {
+struct Private {
+  int c;
+};
+}
+// CHECK-NOT: identifier: "{{.*}}Private
+
+Shared s;
+Private p;
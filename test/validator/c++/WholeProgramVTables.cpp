@@ -0,0 +1,27 @@
+// RUN: %dragonegg -S %s -o - -fplugin-arg-dragonegg-whole-program-vtables | FileCheck %s
+// XFAIL: i386, i486, i586, i686
+// Check that virtual tables and virtual calls are described with type metadata.
+
+struct Base {
+  virtual int f();
+  virtual int g();
+};
+
+struct Derived : Base {
+  virtual int g();
+};
+
+int Base::f() { return 1; }
+int Base::g() { return 2; }
+int Derived::g() { return 3; }
+
+// CHECK-DAG: @_ZTV4Base = {{.*}} !type [[BASE:![0-9]+]]
+// CHECK-DAG: @_ZTV7Derived = {{.*}} !type [[DERIVED:![0-9]+]], !type [[BASE]]
+
+int call(Base *b) { return b->g(); }
+// CHECK: define {{.*}}@_Z4callP4Base
+// CHECK: [[TEST:%[0-9a-z_.]+]] = call i1 @llvm.type.test(i8* {{.*}}, metadata !"_ZTS4Base")
+// CHECK: call void @llvm.assume(i1 [[TEST]])
+
+// CHECK-DAG: [[BASE]] = !{i64 16, !"_ZTS4Base"}
+// CHECK-DAG: [[DERIVED]] = !{i64 16, !"_ZTS7Derived"}
@@ -0,0 +1,24 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+// XFAIL: gcc-4.5, gcc-4.6, gcc-4.7, gcc-4.8, gcc-5, arm, powerpc
+
+struct per_cpu { int id; long counter; };
+
+int load_gs(__seg_gs int *p) {
+// CHECK: @load_gs
+// CHECK: load {{.*}}i32 addrspace(256)*
+  return *p;
+}
+
+void store_fs(__seg_fs long *p, long v) {
+// CHECK: @store_fs
+// CHECK: store i64 {{.*}}i64 addrspace(257)*
+  *p = v;
+}
+
+long bump(__seg_gs struct per_cpu *cpu) {
+// CHECK: @bump
+// CHECK: addrspace(256)*
+// CHECK-NOT: addrspacecast
+// CHECK: ret
+  return ++cpu->counter;
+}
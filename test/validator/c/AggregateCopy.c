@@ -0,0 +1,12 @@
+// RUN: %dragonegg -S -O0 -msse2 %s -o - | FileCheck %s
+// Check that an aggregate that fits in a vector register is copied with memcpy,
+// which the code generator turns into a single vector move, rather than element
+// by element.
+
+struct S { double a, b; };
+
+void foo(struct S *p, struct S *q) {
+// CHECK: @foo
+// CHECK: llvm.memcpy
+  *p = *q;
+}
@@ -0,0 +1,31 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+// XFAIL: gcc-4.5, gcc-4.6, gcc-4.7, gcc-4.8
+// Check that GCC's allocation attributes are passed on to LLVM.
+
+typedef __SIZE_TYPE__ size_t;
+
+__attribute__((malloc, alloc_size(2, 3)))
+void *pool_calloc(void *pool, size_t n, size_t size);
+
+__attribute__((malloc, alloc_size(1), assume_aligned(64)))
+void *pool_alloc(size_t size);
+
+__attribute__((alloc_align(2)))
+void *pool_memalign(size_t size, size_t align);
+
+void *use(void *pool) {
+  void *p = pool_calloc(pool, 4, 8);
+  void *q = pool_alloc(32);
+  void *r = pool_memalign(16, 32);
+  return (char *)p + (q != r);
+}
+// CHECK: call noalias i8* @pool_calloc({{.*}}) [[CALLOC:#[0-9]+]]
+// CHECK: [[Q:%[0-9a-z_.]+]] = call noalias i8* @pool_alloc
+// CHECK: ptrtoint i8* [[Q]]
+// CHECK: and {{.*}}, 63
+// CHECK: call void @llvm.assume
+// CHECK: [[R:%[0-9a-z_.]+]] = call i8* @pool_memalign
+// CHECK: ptrtoint i8* [[R]]
+// CHECK: and {{.*}}, 31
+// CHECK: call void @llvm.assume
+// CHECK: attributes [[CALLOC]] = {{.*}}allocsize(1,2)
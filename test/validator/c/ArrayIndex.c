@@ -0,0 +1,17 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+// XFAIL: i386, i486, i586, i686
+
+int table[256];
+
+int load_signed(int i) {
+// CHECK: @load_signed
+// CHECK-NOT: sext
+// CHECK: getelementptr {{.*}}i32 %
+  return table[i];
+}
+
+int load_unsigned(unsigned char i) {
+// CHECK: @load_unsigned
+// CHECK: zext i8 {{.*}} to i64
+  return table[i];
+}
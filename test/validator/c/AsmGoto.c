@@ -0,0 +1,14 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+// XFAIL: gcc-4.5, llvm-4.0, llvm-5.0, llvm-6.0, llvm-7.0, llvm-8.0
+// An asm goto becomes a callbr that either falls through or jumps to one of its
+// labels, so static branches cost no more than the asm itself.  LLVM before 9
+// has no callbr, so asm goto is rejected there.
+
+int static_branch(void) {
+  asm goto("jmp %l0" : : : : yes);
+  return 0;
+yes:
+  return 1;
+}
+// CHECK: callbr void asm sideeffect "jmp ${0:l}", "X{{[^"]*}}"(i8* blockaddress(@static_branch, %[[YES:[^)]+]]))
+// CHECK-NEXT: to label %{{[^ ]+}} [label %[[YES]]]
@@ -0,0 +1,49 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+// XFAIL: gcc-4.5, gcc-4.6
+// The sized __atomic builtins become LLVM atomic operations with the memory
+// order asked for, rather than calls to libatomic.
+
+int load_acquire(int *p) {
+// CHECK: @load_acquire
+// CHECK-NOT: call
+// CHECK: load atomic {{.*}} acquire
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+void store_release(int *p, int v) {
+// CHECK: @store_release
+// CHECK-NOT: call
+// CHECK: store atomic {{.*}} release
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+long fetch_add_relaxed(long *p, long v) {
+// CHECK: @fetch_add_relaxed
+// CHECK-NOT: call
+// CHECK: atomicrmw add {{.*}} monotonic
+  return __atomic_fetch_add(p, v, __ATOMIC_RELAXED);
+}
+
+unsigned nand_fetch(unsigned *p, unsigned v) {
+// CHECK: @nand_fetch
+// CHECK: atomicrmw nand {{.*}} seq_cst
+// CHECK: and
+// CHECK: xor {{.*}}, -1
+  return __atomic_nand_fetch(p, v, __ATOMIC_SEQ_CST);
+}
+
+int cas_weak(int *p, int *expected, int desired) {
+// CHECK: @cas_weak
+// CHECK-NOT: call
+// CHECK: cmpxchg weak {{.*}} acq_rel acquire
+  return __atomic_compare_exchange_n(p, expected, desired, 1, __ATOMIC_ACQ_REL,
+                                     __ATOMIC_ACQUIRE);
+}
+
+void fences(void) {
+// CHECK: @fences
+// CHECK: fence release
+// CHECK: fence {{.*}}singlethread{{.*}} acquire
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_signal_fence(__ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,13 @@
+// RUN: %dragonegg -S -O0 %s -o - -fplugin-arg-dragonegg-llvm-ir-optimize=auto | FileCheck %s
+// Check that choosing the IR optimization level by looking at loops never
+// optimizes functions that are not to be optimized, even loop heavy ones.
+
+int sum(int a[8][8]) {
+// CHECK: @sum
+// CHECK: alloca
+  int s = 0, i, j;
+  for (i = 0; i < 8; ++i)
+    for (j = 0; j < 8; ++j)
+      s += a[i][j];
+  return s;
+}
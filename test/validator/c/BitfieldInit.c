@@ -0,0 +1,4 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+
+struct { unsigned a : 3, b : 5, c : 4, d : 6; } s = { 5, 3, 9, 33 };
+// CHECK: @s = {{.*}}{ i8 29, i16 537
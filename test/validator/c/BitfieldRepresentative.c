@@ -0,0 +1,32 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+// XFAIL: gcc-4.5, gcc-4.6
+// Check that bitfields sharing a representative are all accessed with loads
+// and stores of the representative's width.
+
+struct S {
+  unsigned a : 3;
+  unsigned b : 5;
+  unsigned c : 12;
+  int x;
+};
+
+void set(struct S *s) {
+// CHECK: define {{.*}}@set
+// CHECK-NOT: load i8
+// CHECK-NOT: store i8
+// CHECK: load i32
+// CHECK: store i32
+// CHECK: load i32
+// CHECK: store i32
+// CHECK: ret
+  s->a = 1;
+  s->c = 2;
+}
+
+unsigned get(struct S *s) {
+// CHECK: define {{.*}}@get
+// CHECK: load i32
+// CHECK-NOT: load i16
+// CHECK: ret
+  return s->c;
+}
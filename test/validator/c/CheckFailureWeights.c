@@ -0,0 +1,15 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+// Check that branches to calls that do not return are weighted as cold.
+
+void abort(void);
+
+int get(int *p, int i) {
+  if (i >= 16)
+    abort();
+  return p[i];
+}
+// CHECK: define {{.*}}@get
+// CHECK: br i1 {{[^,]*}}, label %[[FAIL:[^,]+]], label %{{[^,]+}}, !prof [[COLD:![0-9]+]]
+// CHECK: {{^(; <label>:)?}}[[FAIL]]:
+// CHECK-NEXT: call void @abort
+// CHECK: [[COLD]] = !{!"branch_weights", i32 1, i32 10001}
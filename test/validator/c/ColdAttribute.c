@@ -0,0 +1,12 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+// The cold attribute is passed on to LLVM.
+
+void fail(void) __attribute__((cold));
+
+void check(int x) {
+  if (x)
+    fail();
+}
+
+// CHECK: declare void @fail() #[[COLD:[0-9]+]]
+// CHECK: attributes #[[COLD]] = { {{.*}}cold
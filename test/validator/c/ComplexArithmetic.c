@@ -0,0 +1,31 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+// RUN: %dragonegg -S %s -o - -fcx-limited-range | FileCheck -check-prefix=LIMITED %s
+// RUN: %dragonegg -S %s -o - -fcx-fortran-rules | FileCheck -check-prefix=FORTRAN %s
+// Check that complex multiplication and division only call libgcc when full
+// C99 semantics are wanted.
+
+_Complex double mul(_Complex double x, _Complex double y) {
+  return x * y;
+}
+// CHECK: define {{.*}}@mul
+// CHECK: fcmp uno
+// CHECK: call {{.*}}@__muldc3
+// LIMITED: define {{.*}}@mul
+// LIMITED-NOT: call
+// LIMITED: ret
+// FORTRAN: define {{.*}}@mul
+// FORTRAN-NOT: call
+// FORTRAN: ret
+
+_Complex double div(_Complex double x, _Complex double y) {
+  return x / y;
+}
+// CHECK: define {{.*}}@div
+// CHECK: call {{.*}}@__divdc3
+// LIMITED: define {{.*}}@div
+// LIMITED-NOT: call
+// LIMITED: ret
+// FORTRAN: define {{.*}}@div
+// FORTRAN: @llvm.fabs.f64
+// FORTRAN-NOT: @__divdc3
+// FORTRAN: ret
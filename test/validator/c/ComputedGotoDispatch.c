@@ -0,0 +1,23 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+// Check that each computed goto gets its own indirect branch, rather than all
+// of them jumping to one shared indirect branch.
+
+int run(const unsigned char *code) {
+  static void *labels[] = { &&inc, &&dec, &&halt };
+  int acc = 0;
+  goto *labels[*code++];
+inc:
+  acc++;
+  goto *labels[*code++];
+dec:
+  acc--;
+  goto *labels[*code++];
+halt:
+  return acc;
+}
+// CHECK: define {{.*}}@run
+// CHECK: indirectbr
+// CHECK: indirectbr
+// CHECK: indirectbr
+// CHECK-NOT: indirectbr
+// CHECK: ret
@@ -0,0 +1,19 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+// XFAIL: gcc-4.5, gcc-4.6
+// Check that a variable length array of small constant size gets a fixed slot
+// in the frame rather than being allocated on each iteration.
+
+void use(int *);
+
+void loop(void) {
+// CHECK: define {{.*}}@loop
+// CHECK: alloca [64 x i8], align
+// CHECK-NOT: alloca i8, i
+// CHECK: ret
+  int i;
+  for (i = 0; i < 10; ++i) {
+    int n = 16;
+    int a[n];
+    use(a);
+  }
+}
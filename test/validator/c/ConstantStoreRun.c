@@ -0,0 +1,14 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+// Check that a long run of constant stores into a local array, as GCC makes
+// for an initializer that is not entirely constant, becomes a single memcpy.
+
+void use(int *);
+
+// CHECK: private unnamed_addr constant <{ i32, i32, i32
+// CHECK: <{ i32 1, i32 2, i32 3, i32 4, i32 5, i32 6, i32 7, i32 8, i32 9,
+void f(int x) {
+// CHECK: @f
+// CHECK: call void @llvm.memcpy
+  int t[16] = { x, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+  use(t);
+}
@@ -0,0 +1,7 @@
+// RUN: %dragonegg -S -g %s -o - | FileCheck %s
+// Statement locations carry the column as well as the line.
+
+int f(int a, int b) {
+  return a * b;
+}
+// CHECK: !DILocation(line: 5, column: {{[1-9][0-9]*}}
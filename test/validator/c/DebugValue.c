@@ -0,0 +1,11 @@
+// RUN: %dragonegg -S -O1 -g %s -o - | FileCheck %s
+// Variables kept in registers are described with dbg.value, not memory.
+
+int f(int a, int b) {
+  int x = a * b;
+  return x + a;
+}
+// CHECK: @f
+// CHECK-NOT: alloca
+// CHECK: call void @llvm.dbg.value(
+// CHECK: !DILocalVariable(name: "x"
@@ -0,0 +1,25 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+// Check that a big cycle of types, nested very deeply, can be converted.
+
+struct root;
+
+#define N1(T) struct { T in; struct root *back; }
+#define N2(T) N1(N1(T))
+#define N4(T) N2(N2(T))
+#define N8(T) N4(N4(T))
+#define N16(T) N8(N8(T))
+#define N32(T) N16(N16(T))
+#define N64(T) N32(N32(T))
+#define N128(T) N64(N64(T))
+#define N256(T) N128(N128(T))
+#define N512(T) N256(N256(T))
+
+struct root {
+  N512(int) *deep;
+  int x;
+};
+
+int get(struct root *r) {
+// CHECK: @get
+  return r->deep->back->x;
+}
@@ -0,0 +1,15 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+// XFAIL: gcc-4.5, gcc-4.6, gcc-4.7, gcc-4.8, gcc-4.9
+// Check that a nested function whose address is only used to call it is called
+// directly with its static chain rather than through a trampoline.
+
+int sum(int n) {
+  int total = 0;
+  void add(int i) { total += i; }
+  void (*f)(int) = add;
+  for (int i = 0; i < n; ++i)
+    f(i);
+  return total;
+}
+// CHECK-NOT: llvm.init.trampoline
+// CHECK: call void @add{{[.0-9]*}}(i8* nest
@@ -0,0 +1,16 @@
+// RUN: %dragonegg -S %s -o - -fplugin-arg-dragonegg-value-names=discard | FileCheck %s
+// RUN: %dragonegg -S %s -o - | FileCheck -check-prefix=KEEP %s
+// Check that values are only named after the GCC variables they come from if
+// names are wanted.
+
+int sum(int *p, int n) {
+  int total = 0, i;
+  for (i = 0; i < n; ++i)
+    total += p[i];
+  return total;
+}
+// CHECK: define {{.*}}@sum
+// CHECK-NOT: %total
+// CHECK: ret i32
+// KEEP: define {{.*}}@sum
+// KEEP: %total
@@ -0,0 +1,6 @@
+// RUN: %eggdragon -S %s -o - -fplugin-arg-dragonegg-embed-bitcode | FileCheck %s
+// Check that the module is output as bitcode next to the target code.
+
+int foo(int x) { return x + 1; }
+// CHECK: foo:
+// CHECK: .section .llvmbc
@@ -0,0 +1,6 @@
+// RUN: %eggdragon -S %s -o %t.bc -fplugin-arg-dragonegg-emit-bitcode
+// RUN: llvm-dis %t.bc -o - | FileCheck %s
+// Check that the module is output as bitcode when asked.
+
+int foo(int x) { return x + 1; }
+// CHECK: define {{.*}}i32 @foo
@@ -0,0 +1,9 @@
+// RUN: %eggdragon -S %s -o - -O2 -mfma -ffp-contract=fast | FileCheck -check-prefix=FAST %s
+// RUN: %eggdragon -S %s -o - -O2 -mfma -ffp-contract=off | FileCheck -check-prefix=OFF %s
+// With -ffp-contract=fast a separate multiply and add become one FMA.
+
+double madd(double a, double b, double c) {
+// FAST: vfmadd
+// OFF-NOT: vfmadd
+  return a * b + c;
+}
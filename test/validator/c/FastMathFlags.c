@@ -0,0 +1,12 @@
+// RUN: %dragonegg -S %s -o - -fassociative-math -fno-signed-zeros -fno-trapping-math | FileCheck %s
+// Each GCC floating point option turns on its own fast-math flag, rather than
+// all or nothing.
+
+float sum(float a, float b) {
+// CHECK: @sum
+// CHECK: fadd
+// CHECK-NOT: nnan
+// CHECK-NOT: ninf
+// CHECK: nsz
+  return a + b;
+}
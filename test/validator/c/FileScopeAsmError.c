@@ -0,0 +1,7 @@
+// RUN: not %eggdragon -S %s -o /dev/null -fplugin-arg-dragonegg-emit-obj 2>&1 | FileCheck %s
+// Check that problems the integrated assembler finds in file-scope asm, which
+// has no source location, are reported as errors quoting the asm.
+
+asm("bogus_mnemonic");
+
+// CHECK: error: {{.*}} in asm 'bogus_mnemonic'
@@ -0,0 +1,7 @@
+// RUN: %dragonegg -S %s -o - -fplugin-arg-dragonegg-flat-initializers=8 | FileCheck %s
+
+unsigned char bytes[2][4] = { { 1, 2 }, { 3 } };
+// CHECK: @bytes = {{.*}}[8 x i8] c"\01\02\00\00\03\00\00\00"
+
+void *addrs[4] = { &bytes };
+// CHECK: @addrs = {{.*}}@bytes
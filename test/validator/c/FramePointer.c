@@ -0,0 +1,26 @@
+// RUN: %dragonegg -S -O2 %s -o - -fno-omit-frame-pointer | FileCheck %s
+// RUN: %dragonegg -S -O2 %s -o - -fno-omit-frame-pointer -momit-leaf-frame-pointer | FileCheck %s --check-prefix=LEAF
+// XFAIL: gcc-4.5
+// Check that frame pointers are kept or eliminated per function, following
+// -fno-omit-frame-pointer, -momit-leaf-frame-pointer and optimize attributes.
+// Frame pointers are kept in non-leaf functions only when the attribute
+// "no-frame-pointer-elim-non-leaf" follows "no-frame-pointer-elim"="false".
+
+void use(int);
+
+// CHECK: define void @kept({{.*}} #[[K:[0-9]+]]
+// LEAF: define void @kept({{.*}} #[[K:[0-9]+]]
+void kept(int x) {
+  use(x);
+}
+
+// CHECK: define void @omitted({{.*}} #[[O:[0-9]+]]
+// LEAF: define void @omitted({{.*}} #[[O:[0-9]+]]
+__attribute__((optimize("omit-frame-pointer"))) void omitted(int x) {
+  use(x);
+}
+
+// CHECK: attributes #[[K]] = {{{.*}}"no-frame-pointer-elim"="true"
+// CHECK: attributes #[[O]] = {{{.*}}"no-frame-pointer-elim"="false" {{([^"]|"[^n]|"n[^o]|"no-[^f])}}
+// LEAF: attributes #[[K]] = {{{.*}}"no-frame-pointer-elim"="false" "no-frame-pointer-elim-non-leaf"
+// LEAF: attributes #[[O]] = {{{.*}}"no-frame-pointer-elim"="false" {{([^"]|"[^n]|"n[^o]|"no-[^f])}}
@@ -0,0 +1,15 @@
+// RUN: %dragonegg -S %s -o - -O2 -falign-functions=64 | FileCheck %s
+// XFAIL: gcc-4.5
+// Check that -falign-functions raises the alignment of functions, except those
+// given an alignment explicitly or marked cold.
+
+void plain(void) {}
+// CHECK: define void @plain() {{.*}}align 64
+
+__attribute__((aligned(8))) void explicit(void) {}
+// CHECK: define void @explicit() {{.*}}align 8
+
+__attribute__((cold)) void rare(void) {}
+// CHECK: define void @rare()
+// CHECK-NOT: align 64
+// CHECK: ret void
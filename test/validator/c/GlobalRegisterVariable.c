@@ -0,0 +1,16 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+// XFAIL: i386, i486, i586, i686, arm, aarch64, powerpc
+// Check that global register variables in the stack pointer are accessed with
+// llvm.read_register and llvm.write_register, not inline asm.
+
+register unsigned long stack_pointer asm("rsp");
+
+unsigned long get_sp(void) { return stack_pointer; }
+// CHECK: define {{.*}}@get_sp
+// CHECK: call i64 @llvm.read_register.i64(metadata [[RSP:![0-9]+]])
+
+void set_sp(unsigned long sp) { stack_pointer = sp; }
+// CHECK: define {{.*}}@set_sp
+// CHECK: call void @llvm.write_register.i64(metadata [[RSP]], i64 %
+
+// CHECK: [[RSP]] = !{!"rsp"}
@@ -0,0 +1,12 @@
+// RUN: %dragonegg -S %s -o - -O2 -freorder-functions | FileCheck %s
+// Check that functions marked hot or cold are given the section prefixes
+// that place them in .text.hot and .text.unlikely.
+
+__attribute__((cold, noinline)) void rare(void) {}
+// CHECK: define void @rare() {{.*}}!section_prefix ![[UNLIKELY:[0-9]+]]
+
+__attribute__((hot, noinline)) void often(void) {}
+// CHECK: define void @often() {{.*}}!section_prefix ![[HOT:[0-9]+]]
+
+// CHECK-DAG: ![[UNLIKELY]] = !{!"function_section_prefix", !".unlikely"}
+// CHECK-DAG: ![[HOT]] = !{!"function_section_prefix", !".hot"}
@@ -0,0 +1,12 @@
+// RUN: %dragonegg -S %s -o /dev/null -O1 -fplugin-arg-dragonegg-ir-lint -fplugin-arg-dragonegg-stats-file=%t.json
+// RUN: FileCheck %s < %t.json
+// XFAIL: gcc-4.5
+// Functions whose converted IR has patterns that get in the way of optimizing
+// it are listed in the statistics file.
+
+struct __attribute__((packed)) P { char c; int i; };
+
+int packed(struct P *p) { return p->i; }
+// CHECK: "ir_lint": [
+// CHECK: "function": "packed"
+// CHECK-SAME: "unaligned_accesses": 1
@@ -0,0 +1,10 @@
+// RUN: %dragonegg -S %s -o - -mindirect-branch=thunk | FileCheck %s
+// XFAIL: gcc-4.5, gcc-4.6, gcc-4.7, gcc-4.8, gcc-4.9, gcc-5, gcc-6, gcc-7
+// Check that a function can opt out of -mindirect-branch=thunk.
+
+__attribute__((indirect_branch("keep"))) void dispatch(void (*f)(void)) {
+  f();
+}
+
+// CHECK: define void @dispatch({{.*}} [[KEEP:#[0-9]+]]
+// CHECK: attributes [[KEEP]] = { {{.*}}"target-features"="{{[^"]*}}-retpoline
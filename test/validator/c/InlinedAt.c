@@ -0,0 +1,13 @@
+// RUN: %dragonegg -S -O2 -g -fplugin-arg-dragonegg-enable-gcc-optzns %s -o - | FileCheck %s
+// Code inlined by GCC keeps the callee as its scope, inlined at the call.
+
+static int callee(int x) {
+  return x * x + 3;
+}
+
+int caller(int y) {
+  return callee(y) + 1;
+}
+// CHECK-DAG: !DILocation(line: 5, {{.*}}scope: [[CALLEE:![0-9]+]], inlinedAt: [[CALL:![0-9]+]])
+// CHECK-DAG: [[CALLEE]] = distinct !DISubprogram(name: "callee"
+// CHECK-DAG: [[CALL]] = !DILocation(line: 9,
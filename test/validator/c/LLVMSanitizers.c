@@ -0,0 +1,20 @@
+// RUN: %dragonegg -S %s -o - -fsanitize=address -fplugin-arg-dragonegg-llvm-sanitizers | FileCheck %s
+// XFAIL: gcc-4.5, gcc-4.6, gcc-4.7, gcc-4.8
+// Check that with llvm-sanitizers LLVM's AddressSanitizer instruments the code
+// in place of GCC's, leaving alone functions that ask not to be instrumented.
+
+int load(int *p) {
+  return *p;
+}
+// CHECK: define i32 @load({{.*}} [[ASAN:#[0-9]+]]
+// CHECK: call void @__asan_report_load4
+
+__attribute__((no_sanitize_address)) int plain(int *p) {
+  return *p;
+}
+// CHECK: define i32 @plain({{.*}} [[PLAIN:#[0-9]+]]
+// CHECK-NOT: __asan_report
+// CHECK: ret i32
+
+// CHECK: attributes [[ASAN]] = { {{.*}}sanitize_address
+// CHECK-NOT: attributes [[PLAIN]] = { {{.*}}sanitize_address
@@ -0,0 +1,19 @@
+// RUN: %dragonegg -S -g1 %s -o - | FileCheck %s
+// At -g1 only subprograms and line tables are described.
+
+struct S { int a, b; };
+struct S global;
+
+int f(struct S *s) {
+  int t = s->a;
+  return t + s->b;
+}
+// CHECK-NOT: DILocalVariable
+// CHECK-NOT: DIGlobalVariable
+// CHECK-NOT: DICompositeType
+// CHECK: emissionKind: LineTablesOnly
+// CHECK-NOT: DILocalVariable
+// CHECK-NOT: DICompositeType
+// CHECK: !DISubprogram(name: "f"
+// CHECK-NOT: DILocalVariable
+// CHECK-NOT: DICompositeType
@@ -0,0 +1,16 @@
+// RUN: %dragonegg -S %s -o - -O1 -fplugin-arg-dragonegg-llvm-ir-optimize=0 | FileCheck %s
+// XFAIL: gcc-4.5, gcc-4.6, gcc-4.7, gcc-4.8
+// GCC's loop pragmas are passed on as LLVM loop metadata.
+
+void add(int *a, int *b, int n) {
+// CHECK: @add
+// CHECK: load {{.*}} !llvm.mem.parallel_loop_access ![[IVDEP:[0-9]+]]
+// CHECK: br {{.*}} !llvm.loop ![[IVDEP]]
+  int i;
+#pragma GCC ivdep
+  for (i = 0; i < n; ++i)
+    a[i] += b[i];
+}
+
+// CHECK: ![[IVDEP]] = distinct !{![[IVDEP]], ![[ENABLE:[0-9]+]]}
+// CHECK: ![[ENABLE]] = !{!"llvm.loop.vectorize.enable", i1 true}
@@ -0,0 +1,15 @@
+// RUN: %dragonegg -S %s -o - -fplugin-arg-dragonegg-merge-constructors | FileCheck %s
+// Static constructors with the same priority are called from one function, in
+// the order they were defined.
+
+int x, y;
+
+__attribute__((constructor)) void init_x(void) { x = 1; }
+__attribute__((constructor)) void init_y(void) { y = 2; }
+
+// CHECK: @llvm.global_ctors = appending global [1 x { i32, void ()* }] [{ i32, void ()* } { i32 {{[0-9]+}}, void ()* @_GLOBAL__I_merged }]
+// CHECK: define internal void @_GLOBAL__I_merged()
+// CHECK-NEXT: entry:
+// CHECK-NEXT: call void @init_x()
+// CHECK-NEXT: call void @init_y()
+// CHECK-NEXT: ret void
@@ -0,0 +1,14 @@
+// RUN: %dragonegg -S %s -o - -Os -fplugin-arg-dragonegg-minsize | FileCheck %s
+// Check that -fplugin-arg-dragonegg-minsize marks functions minsize when
+// optimizing for size, except for those marked hot.
+
+void small(void) {}
+// CHECK: define void @small() #[[SMALL:[0-9]+]]
+
+__attribute__((hot)) void fast(void) {}
+// CHECK: define void @fast() #[[FAST:[0-9]+]]
+
+// CHECK: attributes #[[SMALL]] = { {{.*}}minsize{{.*}}optsize
+// CHECK: attributes #[[FAST]] = {
+// CHECK-NOT: minsize
+// CHECK-SAME: optsize
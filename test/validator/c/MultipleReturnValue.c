@@ -0,0 +1,14 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+// XFAIL: i386, i486, i586, i686
+// Values returned in several registers are rebuilt without a stack temporary.
+
+_Complex double make(void);
+
+double real_part(void) {
+// CHECK: @real_part
+// CHECK-NOT: alloca
+// CHECK: call {{.*}} @make
+// CHECK-NOT: store
+// CHECK: ret double
+  return __real__ make();
+}
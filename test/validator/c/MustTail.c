@@ -0,0 +1,24 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+// RUN: not %dragonegg -S %s -o /dev/null -DMISMATCH 2>&1 | FileCheck %s --check-prefix=ERROR
+// XFAIL: gcc-4.5, gcc-4.6, gcc-4.7, gcc-4.8, gcc-4.9, gcc-5, gcc-6, gcc-7, gcc-8, gcc-9, gcc-10, gcc-11, gcc-12, gcc-13, gcc-14
+// Check that calls GCC says must be tail calls become musttail calls followed
+// by the return, and that calls LLVM cannot make musttail are rejected.  The
+// musttail attribute needs GCC 15.
+
+int next(int);
+
+int dispatch(int x) {
+  __attribute__((musttail)) return next(x + 1);
+}
+// CHECK: define {{.*}}@dispatch
+// CHECK: musttail call {{.*}}@next
+// CHECK-NEXT: ret
+
+#ifdef MISMATCH
+int two(int, int);
+
+int spread(int x) {
+  __attribute__((musttail)) return two(x, x);
+}
+// ERROR: cannot tail-call: callee takes a different number of arguments
+#endif
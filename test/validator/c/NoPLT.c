@@ -0,0 +1,16 @@
+// RUN: %dragonegg -S %s -o - -fPIC -fno-plt | FileCheck %s
+// XFAIL: gcc-4.5, gcc-4.6, gcc-4.7, gcc-4.8, gcc-4.9, gcc-5
+// Check that with -fno-plt calls to functions that may be defined elsewhere go
+// through the GOT, while functions known to be local are called directly.
+
+void external(void);
+__attribute__((visibility("hidden"))) void hidden(void);
+
+void f(void) {
+  external();
+  hidden();
+}
+
+// CHECK-DAG: declare void @external() [[EXT:#[0-9]+]]
+// CHECK-DAG: declare dso_local hidden void @hidden()
+// CHECK-DAG: attributes [[EXT]] = { {{.*}}nonlazybind
@@ -0,0 +1,24 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+// The object size builtin is left to LLVM, which works it out once inlining
+// has shown what the pointer points to.
+
+unsigned long max_size(char *p) {
+// CHECK: @max_size
+// CHECK: call i{{[0-9]+}} @llvm.objectsize.{{.*}}, i1 false
+  return __builtin_object_size(p, 0);
+}
+
+unsigned long min_size(char *p) {
+// CHECK: @min_size
+// CHECK: call i{{[0-9]+}} @llvm.objectsize.{{.*}}, i1 true
+  return __builtin_object_size(p, 2);
+}
+
+struct S { char a[4]; char b[8]; } s;
+
+unsigned long min_subobject(void) {
+// CHECK: @min_subobject
+// CHECK-NOT: objectsize
+// CHECK: ret
+  return __builtin_object_size(&s.b[0], 3);
+}
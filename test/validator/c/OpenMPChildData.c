@@ -0,0 +1,14 @@
+// RUN: %dragonegg -S %s -o - -fopenmp | FileCheck %s
+// XFAIL: gcc-4.5, gcc-4.6, gcc-4.7, gcc-4.8
+// Check that the data passed to the body of an OpenMP parallel region does not
+// escape, and that the body knows how much of it there is.
+
+void f(int *a, int n) {
+  int i;
+#pragma omp parallel for
+  for (i = 0; i < n; ++i)
+    a[i] = i;
+}
+
+// CHECK: call void @GOMP_parallel({{.*}}, i8* {{.*}}nocapture
+// CHECK: define internal void @{{.*}}omp_fn{{.*}}(i8* {{.*}}dereferenceable({{[0-9]+}})
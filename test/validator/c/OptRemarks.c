@@ -0,0 +1,13 @@
+// RUN: %eggdragon -S %s -o /dev/null -O2 -fplugin-arg-dragonegg-opt-remarks-file=%t -fplugin-arg-dragonegg-opt-remarks-filter=loop-vectorize
+// RUN: FileCheck %s < %t
+// Optimization remarks are written as YAML, with locations even without -g.
+
+void scale(float *restrict a, float *restrict b, int n) {
+  for (int i = 0; i < n; ++i)
+    a[i] = 2 * b[i];
+}
+// CHECK: --- !Passed
+// CHECK-NEXT: Pass: loop-vectorize
+// CHECK-NEXT: Name: Vectorized
+// CHECK-NEXT: DebugLoc: { File: {{.*}}OptRemarks.c, Line: 7
+// CHECK-NOT: Pass: inline
@@ -0,0 +1,18 @@
+// RUN: %dragonegg -S -O0 %s -o - | FileCheck %s
+// Check that a function with its own optimization level is optimized at that
+// level even though the rest of the file is not optimized.
+
+int foo(int x) {
+// CHECK: @foo
+// CHECK: alloca
+  int y = x + 1;
+  return y;
+}
+
+__attribute__ ((optimize ("O2"))) int bar(int x) {
+// CHECK: @bar
+// CHECK-NOT: alloca
+// CHECK: ret
+  int y = x + 1;
+  return y;
+}
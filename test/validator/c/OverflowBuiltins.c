@@ -0,0 +1,23 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+// XFAIL: gcc-4.5, gcc-4.6, gcc-4.7, gcc-4.8, gcc-4.9
+// The overflow checking builtins become internal function calls, which are
+// turned into the LLVM overflow intrinsics when the types agree.
+
+int add(int a, int b, int *r) {
+// CHECK: @add
+// CHECK: call { i32, i1 } @llvm.sadd.with.overflow.i32
+  return __builtin_add_overflow(a, b, r);
+}
+
+int umul(unsigned a, unsigned b, unsigned *r) {
+// CHECK: @umul
+// CHECK: call { i32, i1 } @llvm.umul.with.overflow.i32
+  return __builtin_mul_overflow(a, b, r);
+}
+
+int mixed(long a, unsigned b, short *r) {
+// CHECK: @mixed
+// CHECK-NOT: with.overflow
+// CHECK: ret
+  return __builtin_sub_overflow(a, b, r);
+}
@@ -0,0 +1,25 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+
+float f(float x) {
+// CHECK: @f
+// CHECK: fmul float %{{.*}}, 0x3FB99999A0000000
+  return x * 0.1f;
+}
+
+double d(double x) {
+// CHECK: @d
+// CHECK: fmul double %{{.*}}, 0x3FB999999999999A
+  return x * 0.1;
+}
+
+long double ld(long double x) {
+// CHECK: @ld
+// CHECK: fmul x86_fp80 %{{.*}}, 0xK3FFBCCCCCCCCCCCCCCCD
+  return x * 0.1L;
+}
+
+__float128 q(__float128 x) {
+// CHECK: @q
+// CHECK: fmul fp128 %{{.*}}, 0xL999999999999999A3FFB999999999999
+  return x * 0.1Q;
+}
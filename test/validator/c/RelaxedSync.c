@@ -0,0 +1,17 @@
+// RUN: %dragonegg -S -fplugin-arg-dragonegg-relaxed-sync=stat_ %s -o - | FileCheck %s
+// Counters named by the relaxed-sync prefix are updated with monotonic
+// ordering; other __sync builtins stay sequentially consistent.
+
+long stat_hits;
+struct { int misses; } stat_cache;
+long shared;
+
+void count(void) {
+// CHECK: @count
+// CHECK: atomicrmw add {{.*}}@stat_hits{{.*}} monotonic
+// CHECK: atomicrmw sub {{.*}} monotonic
+// CHECK: atomicrmw add {{.*}}@shared{{.*}} seq_cst
+  __sync_fetch_and_add(&stat_hits, 1);
+  __sync_sub_and_fetch(&stat_cache.misses, 1);
+  __sync_fetch_and_add(&shared, 1);
+}
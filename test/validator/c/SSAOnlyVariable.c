@@ -0,0 +1,16 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+// Variables that only live in SSA names are not given stack slots.
+
+void foo(int *);
+
+int bar(int x) {
+// CHECK-LABEL: define {{.*}}@bar
+// CHECK-NOT: %a = alloca
+// CHECK: %b = alloca
+// CHECK-NOT: %a = alloca
+// CHECK: ret
+  int a = x * 2;
+  int b;
+  foo(&b);
+  return a + b;
+}
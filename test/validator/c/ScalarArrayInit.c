@@ -0,0 +1,7 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+
+unsigned short crc[8] = { 0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5 };
+// CHECK: @crc = {{.*}}[8 x i16] [i16 0, i16 4129, i16 8258, i16 12387, i16 16516, i16 20645, i16 0, i16 0]
+
+double weights[3] = { 0.5, -1.0, 2.0 };
+// CHECK: @weights = {{.*}}[3 x double] [double 5.000000e-01, double -1.000000e+00, double 2.000000e+00]
@@ -0,0 +1,23 @@
+// RUN: %dragonegg -S %s -o - -O1 -fplugin-arg-dragonegg-llvm-ir-optimize=0 | FileCheck %s
+// XFAIL: gcc-4.5, gcc-4.6
+// Variables in disjoint scopes get lifetime markers so that they can share a
+// stack slot.
+
+void use(char *);
+
+void f(int c) {
+// CHECK: @f
+  if (c) {
+// CHECK: call void @llvm.lifetime.start
+// CHECK: call void @use
+// CHECK: call void @llvm.lifetime.end
+    char a[100];
+    use(a);
+  } else {
+// CHECK: call void @llvm.lifetime.start
+// CHECK: call void @use
+// CHECK: call void @llvm.lifetime.end
+    char b[100];
+    use(b);
+  }
+}
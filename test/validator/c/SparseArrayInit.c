@@ -0,0 +1,7 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+
+int table[1 << 24] = { [5] = 1 };
+// CHECK: @table = {{.*}}{ [6 x i32], [16777210 x i32] } { [6 x i32] [i32 0, i32 0, i32 0, i32 0, i32 0, i32 1], [16777210 x i32] zeroinitializer }
+
+short ends[1000] = { 1, [999] = 2 };
+// CHECK: @ends = {{.*}}{ i16, [998 x i16], i16 } { i16 1, [998 x i16] zeroinitializer, i16 2 }
@@ -0,0 +1,12 @@
+// RUN: %dragonegg -S %s -o - -fsplit-stack | FileCheck %s
+// XFAIL: gcc-4.5
+// With -fsplit-stack functions get a __morestack prologue, unless marked
+// no_split_stack.
+
+void grows(void) {}
+__attribute__((no_split_stack)) void fixed(void) {}
+
+// CHECK: define void @grows() [[GROWS:#[0-9]+]]
+// CHECK: define void @fixed() [[FIXED:#[0-9]+]]
+// CHECK: attributes [[GROWS]] = { {{.*}}"split-stack"
+// CHECK-NOT: attributes [[FIXED]] = { {{.*}}"split-stack"
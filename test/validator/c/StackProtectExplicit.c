@@ -0,0 +1,21 @@
+// RUN: %dragonegg -S %s -o - -fstack-protector-explicit | FileCheck %s
+// XFAIL: gcc-4.5, gcc-4.6, gcc-4.7, gcc-4.8, gcc-4.9
+// Check that only functions with the stack_protect attribute are protected
+// when protection is explicit.
+
+void use(char *);
+
+// CHECK: define void @protected({{.*}} #[[P:[0-9]+]]
+__attribute__((stack_protect)) void protected(void) {
+  char buf[64];
+  use(buf);
+}
+
+// CHECK: define void @unprotected({{.*}} #[[U:[0-9]+]]
+void unprotected(void) {
+  char buf[64];
+  use(buf);
+}
+
+// CHECK: attributes #[[P]] = {{{.*}}sspreq
+// CHECK-NOT: attributes #[[U]] = {{{.*}}ssp
@@ -0,0 +1,13 @@
+// RUN: %eggdragon -S %s -o %t.s -O2 -fstack-usage
+// RUN: FileCheck %s < %t.su
+// XFAIL: gcc-4.5
+// The stack usage of each function is written in GCC's format, using the frame
+// sizes from the code generator.
+
+void use(char *);
+
+void fixed(void) { char buf[64]; use(buf); }
+// CHECK: StackUsage.c:9:6:fixed{{[[:space:]]+}}{{[0-9]+}}{{[[:space:]]+}}static
+
+void variable(int n) { char buf[n]; use(buf); }
+// CHECK: StackUsage.c:12:6:variable{{[[:space:]]+}}{{[0-9]+}}{{[[:space:]]+}}dynamic
@@ -0,0 +1,14 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+// XFAIL: arm, powerpc
+
+char exact[] = "web";
+// CHECK: @exact = {{.*}}[4 x i8] c"web\00"
+
+char padded[6] = "ab";
+// CHECK: @padded = {{.*}}[6 x i8] c"ab\00\00\00\00"
+
+char truncated[2] = "abc";
+// CHECK: @truncated = {{.*}}[2 x i8] c"ab"
+
+__CHAR16_TYPE__ wide[3] = u"hi";
+// CHECK: @wide = {{.*}}[3 x i16] [i16 104, i16 105, i16 0]
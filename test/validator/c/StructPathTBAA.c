@@ -0,0 +1,13 @@
+// RUN: %dragonegg -S -O2 -fplugin-arg-dragonegg-llvm-ir-optimize=0 %s -o - | FileCheck %s
+
+struct point { int x, y; };
+
+int sum(struct point *p) {
+// CHECK: load i32{{.*}}, !tbaa [[X:![0-9]+]]
+// CHECK: load i32{{.*}}, !tbaa [[Y:![0-9]+]]
+  return p->x + p->y;
+}
+
+// CHECK: [[X]] = !{[[POINT:![0-9]+]], [[INT:![0-9]+]], i64 0}
+// CHECK: [[POINT]] = !{!"alias set {{[0-9]+}}: struct point", [[INT]], i64 0, [[INT]], i64 4}
+// CHECK: [[Y]] = !{[[POINT]], [[INT]], i64 4}
@@ -0,0 +1,17 @@
+// RUN: %dragonegg -S -O0 %s -o - | FileCheck %s
+// Check that case ranges are added to the switch, so the code generator can
+// build a jump table or bit tests for them, unless they are very big.
+
+int foo(int c) {
+// CHECK: @foo
+// CHECK: switch i32
+// CHECK: i32 199, label
+// CHECK: icmp ule
+  switch (c) {
+  case 0 ... 199:
+    return 1;
+  case 1000 ... 100000:
+    return 2;
+  }
+  return 0;
+}
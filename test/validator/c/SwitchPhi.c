@@ -0,0 +1,33 @@
+// RUN: %dragonegg -S -O2 -fplugin-arg-dragonegg-llvm-ir-optimize=0 %s -o - | FileCheck %s
+// A phi fed by a switch with thousands of cases going straight to the block
+// containing the phi, so that the phi gets an operand for each case.  This
+// used to take time quadratic in the number of cases.
+
+#define C1(n) case 2 * (n):
+#define C4(n) C1(n) C1(n + 1) C1(n + 2) C1(n + 3)
+#define C16(n) C4(n) C4(n + 4) C4(n + 8) C4(n + 12)
+#define C64(n) C16(n) C16(n + 16) C16(n + 32) C16(n + 48)
+#define C256(n) C64(n) C64(n + 64) C64(n + 128) C64(n + 192)
+#define C1024(n) C256(n) C256(n + 256) C256(n + 512) C256(n + 768)
+
+int foo(int x, int y) {
+// CHECK: @foo
+// CHECK: switch i32
+  switch (x) {
+  C1024(0)
+  C1024(1024)
+  C1024(2048)
+  C1024(3072)
+  C1024(4096)
+  C1024(5120)
+  C1024(6144)
+  C1024(7168)
+  C1024(8192)
+  C1024(9216)
+    break;
+  default:
+    y = 0;
+  }
+// CHECK: phi i32
+  return y;
+}
@@ -0,0 +1,9 @@
+// RUN: %dragonegg -S -O2 %s -o - -fplugin-arg-dragonegg-enable-gcc-optzns -fplugin-arg-dragonegg-llvm-ir-optimize=0 | FileCheck %s
+// Check that calls GCC found to be tail calls are marked as such, without
+// needing the LLVM optimizers to find them again.
+
+int next(int);
+
+int dispatch(int x) { return next(x + 1); }
+// CHECK: define {{.*}}@dispatch
+// CHECK: tail call {{.*}}@next
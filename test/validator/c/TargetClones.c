@@ -0,0 +1,15 @@
+// RUN: %dragonegg -S %s -o - -march=x86-64 -O1 | FileCheck %s
+// XFAIL: gcc-4.5, gcc-4.6, gcc-4.7, gcc-4.8, gcc-4.9, gcc-5
+
+// CHECK: @foo = ifunc
+int __attribute__((target_clones("avx2", "default"))) foo(int x) {
+  return x + 1;
+}
+
+// CHECK: define{{.*}} @bar{{.*}} [[BAR:#[0-9]+]]
+int __attribute__((target("arch=haswell"))) bar(int x) {
+  return x * 3;
+}
+
+// CHECK: attributes [[BAR]] = {{.*}}"target-cpu"="haswell"
+// CHECK-SAME: "target-features"={{.*}}+avx2
@@ -0,0 +1,14 @@
+// RUN: %dragonegg -S -O2 %s -o - -fplugin-arg-dragonegg-enable-gcc-optzns -fplugin-arg-dragonegg-llvm-ir-optimize=0 | FileCheck %s
+// XFAIL: gcc-4.5, i386, i486, i586, i686, arm, powerpc
+// Check that the addresses IVOPTs forms use a GEP scaled by the step rather
+// than a multiplication.
+
+void scale(double *x, const double *y, long n) {
+// CHECK: define {{.*}}@scale
+// CHECK-NOT: mul i64
+// CHECK: getelementptr {{.*}}double
+// CHECK: ret
+  long i;
+  for (i = 0; i < n; ++i)
+    x[i] = 2 * y[i + 1];
+}
@@ -0,0 +1,10 @@
+// RUN: %dragonegg -S %s -o - -fplugin-arg-dragonegg-unique-types | FileCheck %s
+// Check that record types with the same layout share one LLVM type.
+
+struct a { int x; float y; };
+struct b { int p; float q; };
+
+// CHECK: %struct.a = type { i32, float }
+// CHECK-NOT: %struct.b = type
+struct a A;
+struct b B;
@@ -0,0 +1,14 @@
+// RUN: %dragonegg -S %s -o - -O1 -fplugin-arg-dragonegg-llvm-ir-optimize=0 | FileCheck %s
+// A condition leading to __builtin_unreachable is passed on to the optimizers
+// as an assumption that it does not hold.
+
+void scale(float *p, unsigned n) {
+  unsigned i;
+  if (n % 8 != 0)
+    __builtin_unreachable();
+  for (i = 0; i < n; ++i)
+    p[i] *= 2;
+}
+// CHECK: define void @scale
+// CHECK: call void @llvm.assume(i1
+// CHECK: unreachable
@@ -0,0 +1,23 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s --check-prefix=DEFAULT
+// RUN: %dragonegg -S %s -o - -fno-asynchronous-unwind-tables -fno-unwind-tables -fno-exceptions | FileCheck %s
+// XFAIL: gcc-4.5
+// Check that functions only ask for unwind tables if GCC would emit them,
+// following optimize attributes as well as the command line.
+
+int f(int x) {
+  return x + 1;
+}
+
+__attribute__((optimize("asynchronous-unwind-tables"))) int g(int x) {
+  return x - 1;
+}
+
+// DEFAULT: define {{.*}}@f({{.*}} [[F:#[0-9]+]]
+// DEFAULT: attributes [[F]] = { {{.*}}uwtable
+
+// CHECK: define {{.*}}@f({{.*}} [[F:#[0-9]+]]
+// CHECK: define {{.*}}@g({{.*}} [[G:#[0-9]+]]
+// CHECK: attributes [[F]] = { {{.*}}nounwind
+// CHECK-NOT: uwtable
+// CHECK-SAME: }
+// CHECK: attributes [[G]] = { {{.*}}uwtable
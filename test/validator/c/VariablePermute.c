@@ -0,0 +1,22 @@
+// RUN: %dragonegg -S %s -o - -mssse3 | FileCheck %s
+// XFAIL: gcc-4.5, gcc-4.6
+// Permutations by a variable mask use pshufb rather than going through memory.
+
+typedef char v16qi __attribute__ ((vector_size (16)));
+typedef int v4si __attribute__ ((vector_size (16)));
+
+v16qi one(v16qi a, v16qi m) {
+// CHECK: @one
+// CHECK: call <16 x i8> @llvm.x86.ssse3.pshuf.b.128
+// CHECK-NOT: pshuf.b
+// CHECK: ret
+  return __builtin_shuffle(a, m);
+}
+
+v4si two(v4si a, v4si b, v4si m) {
+// CHECK: @two
+// CHECK: call <16 x i8> @llvm.x86.ssse3.pshuf.b.128
+// CHECK: call <16 x i8> @llvm.x86.ssse3.pshuf.b.128
+// CHECK: select
+  return __builtin_shuffle(a, b, m);
+}
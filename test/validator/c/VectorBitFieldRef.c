@@ -0,0 +1,14 @@
+// RUN: %dragonegg -S %s -o - -O1 -fplugin-arg-dragonegg-llvm-ir-optimize=0 | FileCheck %s
+// Vector operations that GCC splits into operations on the elements should
+// access the elements directly rather than through memory.
+
+typedef int v4si __attribute__((vector_size(16)));
+
+v4si div(v4si a, v4si b) {
+// CHECK: @div
+// CHECK-NOT: alloca
+// CHECK: extractelement <4 x i32>
+// CHECK: sdiv i32
+// CHECK: ret <4 x i32>
+  return a / b;
+}
@@ -0,0 +1,17 @@
+// RUN: %dragonegg -S %s -o - -O3 -msse2 | FileCheck %s
+// The sum at the end of a vectorized dot product is formed by repeatedly
+// adding the top half of the vector to the bottom half, not element by element.
+
+int dot(int *a, int *b) {
+// CHECK: @dot
+// CHECK: mul <4 x i32>
+// CHECK: shufflevector <4 x i32>
+// CHECK: add <4 x i32>
+// CHECK: shufflevector <4 x i32>
+// CHECK: add <4 x i32>
+// CHECK: extractelement <4 x i32> {{.*}}, i32 0
+  int i, s = 0;
+  for (i = 0; i < 1024; ++i)
+    s += a[i] * b[i];
+  return s;
+}
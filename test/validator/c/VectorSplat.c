@@ -0,0 +1,13 @@
+// RUN: %dragonegg -S %s -o - -O1 -fplugin-arg-dragonegg-llvm-ir-optimize=0 | FileCheck %s
+// Vectors with every element the same value are built with a broadcast, and
+// the constant elements of other vectors are not inserted one at a time.
+
+typedef float v4sf __attribute__((vector_size(16)));
+
+v4sf splat(float x) { return (v4sf){ x, x, x, x }; }
+// CHECK: define <4 x float> @splat
+// CHECK: shufflevector <4 x float> {{.*}}, <4 x float> undef, <4 x i32> zeroinitializer
+
+v4sf mixed(float x) { return (v4sf){ 1, x, 2, 3 }; }
+// CHECK: define <4 x float> @mixed
+// CHECK: insertelement <4 x float> <float 1.000000e+00, float undef, float 2.000000e+00, float 3.000000e+00>, float %{{[^,]+}}, i32 1
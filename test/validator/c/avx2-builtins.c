@@ -0,0 +1,36 @@
+// RUN: %dragonegg -S %s -o - -mavx2 -mfma | FileCheck %s
+// XFAIL: gcc-4.5, gcc-4.6
+
+#include <immintrin.h>
+
+__v8si add_epi32(__v8si a, __v8si b) {
+// CHECK: @add_epi32
+// CHECK: add <8 x i32>
+  return __builtin_ia32_paddd256(a, b);
+}
+
+__v16hi mullo_epi16(__v16hi a, __v16hi b) {
+// CHECK: @mullo_epi16
+// CHECK: mul <16 x i16>
+  return __builtin_ia32_pmullw256(a, b);
+}
+
+__v4di andnot_si256(__v4di a, __v4di b) {
+// CHECK: @andnot_si256
+// CHECK: xor <4 x i64>
+// CHECK: and <4 x i64>
+  return __builtin_ia32_andnotsi256(a, b);
+}
+
+__v8sf fmadd_ps(__v8sf a, __v8sf b, __v8sf c) {
+// CHECK: @fmadd_ps
+// CHECK: call <8 x float> @llvm.fma.v8f32
+  return __builtin_ia32_vfmaddps256(a, b, c);
+}
+
+__v2df fmadd_sd(__v2df a, __v2df b, __v2df c) {
+// CHECK: @fmadd_sd
+// CHECK: call double @llvm.fma.f64
+// CHECK: insertelement <2 x double>
+  return __builtin_ia32_vfmaddsd3(a, b, c);
+}
@@ -0,0 +1,22 @@
+// RUN: %dragonegg -S %s -o - -msse4.1 | FileCheck %s
+// XFAIL: gcc-4.5
+
+#include <immintrin.h>
+
+void stream_ps(float *p, __m128 v) {
+// CHECK: @stream_ps
+// CHECK: store <4 x float> {{.*}}, align 16, !nontemporal
+  _mm_stream_ps(p, v);
+}
+
+void stream_si32(int *p, int v) {
+// CHECK: @stream_si32
+// CHECK: store i32 {{.*}}, align 4, !nontemporal
+  _mm_stream_si32(p, v);
+}
+
+__m128i stream_load(__m128i *p) {
+// CHECK: @stream_load
+// CHECK: load {{.*}}, align 16, !nontemporal
+  return _mm_stream_load_si128(p);
+}
@@ -0,0 +1,20 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+// XFAIL: i386, i486, i586, i686
+// Aggregates are split into eightbytes classified as in the x86-64 PS ABI.
+
+struct FI { float f; int i; };
+struct DD { double a, b; };
+struct LLL { long a, b, c; };
+struct LD { long double x; };
+
+// CHECK: @fi(i64
+int fi(struct FI s) { return s.i; }
+
+// CHECK: @dd(%struct.DD
+double dd(struct DD s) { return s.b; }
+
+// CHECK: @lll({{.*}} byval
+long lll(struct LLL s) { return s.c; }
+
+// CHECK: @ld({{.*}} byval
+long double ld(struct LD s) { return s.x; }
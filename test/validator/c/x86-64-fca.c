@@ -0,0 +1,17 @@
+// RUN: %dragonegg -S -O1 %s -o - | FileCheck %s
+// XFAIL: i386, i486, i586, i686
+// Small aggregates whose fields each fill a register are passed directly,
+// unless the registers run out.
+
+struct span { const char *p; long n; };
+
+// CHECK: define{{.*}} @length(%struct.span
+// CHECK-NOT: alloca
+// CHECK: ret
+long length(struct span s) { return s.n; }
+
+long last(long a, long b, long c, long d, long e, struct span s);
+
+// CHECK: @call_last
+// CHECK: call{{.*}} @last({{.*}}, %struct.span* byval
+long call_last(struct span s) { return last(1, 2, 3, 4, 5, s); }
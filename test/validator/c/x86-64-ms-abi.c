@@ -0,0 +1,17 @@
+// RUN: %dragonegg -S %s -o - | FileCheck %s
+// XFAIL: i386, i486, i586, i686
+// Functions with the ms_abi attribute use the Microsoft x64 convention: small
+// aggregates go in one integer register, others by reference to a copy.
+
+struct FF { float a, b; };
+struct DD { double a, b; };
+
+__attribute__((ms_abi)) struct FF small(struct FF x) { return x; }
+// CHECK: define x86_64_win64cc i64 @small(i64
+
+__attribute__((ms_abi)) double big(struct DD x) { return x.a + x.b; }
+// CHECK: define x86_64_win64cc double @big(%struct.DD*
+
+__attribute__((ms_abi)) void callee(struct DD);
+void caller(struct DD *p) { callee(*p); }
+// CHECK: call x86_64_win64cc void @callee(%struct.DD*
@@ -0,0 +1,16 @@
+// RUN: %dragonegg -S -O2 -march=x86-64 -mbmi2 -mlzcnt %s -o - | FileCheck %s
+// XFAIL: gcc-4.5, gcc-4.6
+// Extensions enabled on the GCC command line reach the code generator even
+// when the CPU does not imply them.
+
+unsigned long shift(unsigned long x, unsigned long n) {
+// CHECK: shift
+// CHECK: shrx
+  return x >> n;
+}
+
+int leading_zeros(unsigned x) {
+// CHECK: leading_zeros
+// CHECK: lzcnt
+  return __builtin_clz(x);
+}
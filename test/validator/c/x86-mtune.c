@@ -0,0 +1,9 @@
+// RUN: %dragonegg -S -O2 -march=x86-64 -mtune=nocona %s -o - | FileCheck %s
+// Tuning for a CPU where inc is slow keeps the ISA but avoids inc.
+
+void increment(int *p) {
+// CHECK: increment
+// CHECK-NOT: inc{{l?}} (
+// CHECK: add{{l?}} $1, (
+  ++*p;
+}
@@ -0,0 +1,15 @@
+! RUN: %dragonegg -S %s -o - | FileCheck %s
+! Check that the data of assumed shape dummy arguments, which is reached through
+! their array descriptors, is known not to overlap.
+subroutine axpy(a, x, y)
+  real(kind=8), intent(in) :: a
+  real(kind=8), intent(in), dimension(:) :: x
+  real(kind=8), intent(inout), dimension(:) :: y
+  integer :: i
+  do i = 1, size(x)
+    y(i) = y(i) + a * x(i)
+  end do
+end subroutine axpy
+! CHECK: define {{.*}}@axpy_({{.*}} noalias {{.*}} noalias {{.*}} noalias
+! CHECK: load double, {{.*}} !alias.scope [[X:![0-9]+]], !noalias
+! CHECK: store double {{.*}} !alias.scope [[Y:![0-9]+]], !noalias
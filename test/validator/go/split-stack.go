@@ -0,0 +1,28 @@
+// RUN: %dragonegg -S %s -o - -fsplit-stack | FileCheck %s
+// XFAIL: gcc-4.5
+// Goroutines start on small split stacks, so spawning many of them is cheap.
+// CHECK: "split-stack"
+
+package main
+
+import "sync"
+
+func work(n int, wg *sync.WaitGroup, out *int64) {
+	defer wg.Done()
+	var buf [64]int64
+	for i := range buf {
+		buf[i] = int64(n * i)
+	}
+	*out = buf[n%64]
+}
+
+func main() {
+	const goroutines = 100000
+	var wg sync.WaitGroup
+	results := make([]int64, goroutines)
+	wg.Add(goroutines)
+	for i := 0; i < goroutines; i++ {
+		go work(i, &wg, &results[i])
+	}
+	wg.Wait()
+}
@@ -0,0 +1,115 @@
+//===------------ ADTBench.cpp - Timing of the plugin's ADTs --------------===//
+//
+// This file is part of DragonEgg.
+//
+// DragonEgg is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2, or (at your option) any later version.
+//
+// DragonEgg is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// DragonEgg; see the file COPYING.  If not, write to the Free Software
+// Foundation, 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+//
+//===----------------------------------------------------------------------===//
+// This file times IntervalList on synthetic inputs shaped like the records and
+// initializers seen when compiling real code, so that changes to it can be
+// measured without a GCC in the loop.  Each benchmark is repeated until it has
+// run for long enough to time, and the time per run is printed in the style of
+// google-benchmark.  Pass a number to change the size of the inputs.
+//===----------------------------------------------------------------------===//
+
+// System headers
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// Unit test headers
+#include "Pieces.h"
+
+/// Size - The number of intervals added by each benchmark.
+static int Size = 10000;
+
+/// Sink - Somewhere to put results so that the work is not optimized away.
+static volatile unsigned Sink;
+
+/// InOrder - The fields of a big struct, in order.
+static void InOrder() {
+  PieceList L;
+  for (int i = 0; i < Size; ++i)
+    L.AddInterval(Piece(32 * i, 32 * i + 32, i));
+  Sink = L.getNumIntervals();
+}
+
+/// Reversed - The same fields, last to first.
+static void Reversed() {
+  PieceList L;
+  for (int i = Size; i-- > 0;)
+    L.AddInterval(Piece(32 * i, 32 * i + 32, i));
+  Sink = L.getNumIntervals();
+}
+
+/// Overwrite - A zeroed array followed by designated initializers for every
+/// other element, as when part of a constructor is overridden.
+static void Overwrite() {
+  PieceList L;
+  L.AddInterval(Piece(0, 32 * Size, 0));
+  for (int i = 0; i < Size; i += 2)
+    L.AddInterval(Piece(32 * i, 32 * i + 32, i));
+  Sink = L.getNumIntervals();
+}
+
+/// Scattered - Designated initializers in no particular order, some of them
+/// for ranges of elements that overlap earlier ones.
+static void Scattered() {
+  PieceList L;
+  unsigned Seed = 1;
+  for (int i = 0; i < Size; ++i) {
+    Seed = Seed * 1103515245 + 12345;
+    int First = 32 * (int)((Seed >> 8) % Size);
+    L.AddInterval(Piece(First, First + 32 * (1 + i % 4), i));
+  }
+  Sink = L.getNumIntervals();
+}
+
+/// Bitfields - Runs of three bit fields, which get merged into whole bytes.
+static void Bitfields() {
+  PieceList L;
+  for (int i = 0; i < Size; ++i)
+    L.AddInterval(Piece(3 * i, 3 * i + 3, i));
+  L.AlignBoundaries(8);
+  Sink = L.getNumIntervals();
+}
+
+/// Run - Time the given benchmark, doubling the number of runs until they take
+/// at least a tenth of a second.
+static void Run(const char *Name, void (*Bench)()) {
+  typedef std::chrono::steady_clock Clock;
+  for (unsigned long Iterations = 1;; Iterations *= 2) {
+    Clock::time_point Start = Clock::now();
+    for (unsigned long i = 0; i < Iterations; ++i)
+      Bench();
+    double Seconds = std::chrono::duration<double>(Clock::now() - Start).count();
+    if (Seconds >= 0.1 || Iterations >= (1UL << 30)) {
+      printf("%-24s %12.0f ns %12lu\n", Name, Seconds * 1e9 / Iterations,
+             Iterations);
+      return;
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1)
+    Size = std::max(1, atoi(argv[1]));
+  printf("%-24s %15s %12s\n", "Benchmark", "Time", "Iterations");
+  Run("IntervalList/InOrder", InOrder);
+  Run("IntervalList/Reversed", Reversed);
+  Run("IntervalList/Overwrite", Overwrite);
+  Run("IntervalList/Scattered", Scattered);
+  Run("IntervalList/Bitfields", Bitfields);
+  return 0;
+}
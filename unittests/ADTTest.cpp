@@ -0,0 +1,203 @@
+//===------------ ADTTest.cpp - Unit tests for the plugin's ADTs ----------===//
+//
+// This file is part of DragonEgg.
+//
+// DragonEgg is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2, or (at your option) any later version.
+//
+// DragonEgg is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// DragonEgg; see the file COPYING.  If not, write to the Free Software
+// Foundation, 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+//
+//===----------------------------------------------------------------------===//
+// This file tests Range and IntervalList on synthetic inputs.  It does not need
+// GCC, so it is built as an ordinary program: run it and check that it exits
+// with status zero.
+//===----------------------------------------------------------------------===//
+
+// System headers
+#include <algorithm>
+#include <cstdio>
+
+// Unit test headers
+#include "Pieces.h"
+
+static unsigned Failures;
+
+#define CHECK(COND)                                                            \
+  do {                                                                         \
+    if (!(COND)) {                                                             \
+      fprintf(stderr, "%s:%d: %s: check failed: %s\n", __FILE__, __LINE__,     \
+              __func__, #COND);                                                \
+      ++Failures;                                                              \
+    }                                                                          \
+  } while (0)
+
+/// CheckPieces - Check that the list holds exactly the given pieces, given as
+/// first, last and tag for each.
+static void CheckPieces(PieceList &L, const int (*Expected)[3], unsigned Num,
+                        int Line) {
+  if (L.getNumIntervals() != Num) {
+    fprintf(stderr, "%s:%d: expected %u intervals, got %u\n", __FILE__, Line,
+            Num, L.getNumIntervals());
+    ++Failures;
+    return;
+  }
+  for (unsigned i = 0; i != Num; ++i) {
+    Piece P = L.getInterval(i);
+    if (!(P.getRange() == SignedRange(Expected[i][0], Expected[i][1])) ||
+        P.getTag() != Expected[i][2]) {
+      fprintf(stderr, "%s:%d: interval %u is [%d, %d) tag %d, expected [%d, "
+              "%d) tag %d\n", __FILE__, Line, i, P.getRange().getFirst(),
+              P.getRange().getLast(), P.getTag(), Expected[i][0],
+              Expected[i][1], Expected[i][2]);
+      ++Failures;
+    }
+  }
+}
+
+#define CHECK_PIECES(L, E) CheckPieces(L, E, sizeof(E) / sizeof(E[0]), __LINE__)
+
+static void TestRange() {
+  SignedRange Empty, A(0, 8), B(4, 12), C(8, 16);
+  CHECK(Empty.empty());
+  CHECK(SignedRange(5, 5).empty());
+  CHECK(SignedRange(5, 3) == Empty);
+  CHECK(A.getWidth() == 8);
+  CHECK(Empty.getWidth() == 0);
+  CHECK(A.contains(SignedRange(2, 6)));
+  CHECK(A.contains(Empty));
+  CHECK(!Empty.contains(A));
+  CHECK(!A.contains(B));
+  CHECK(A.intersects(B));
+  CHECK(!A.intersects(C)); // Ranges are half open.
+  CHECK(A.Join(C) == SignedRange(0, 16));
+  CHECK(A.Join(Empty) == A);
+  CHECK(A.Meet(B) == SignedRange(4, 8));
+  CHECK(A.Meet(C).empty());
+  CHECK(B.Displace(-4) == A);
+  CHECK(Empty.Displace(3).empty());
+}
+
+static void TestAppend() {
+  // Intervals arriving in order, with and without gaps, as for the fields of
+  // an ordinary struct.
+  PieceList L;
+  L.AddInterval(Piece(0, 8, 1));
+  L.AddInterval(Piece(8, 16, 2));
+  L.AddInterval(Piece(32, 64, 3));
+  L.AddInterval(Piece(70, 70, 4)); // Empty, so dropped.
+  const int Expected[][3] = { { 0, 8, 1 }, { 8, 16, 2 }, { 32, 64, 3 } };
+  CHECK_PIECES(L, Expected);
+}
+
+static void TestOutOfOrder() {
+  PieceList L;
+  L.AddInterval(Piece(32, 64, 3));
+  L.AddInterval(Piece(0, 8, 1));
+  L.AddInterval(Piece(16, 24, 2));
+  const int Expected[][3] = { { 0, 8, 1 }, { 16, 24, 2 }, { 32, 64, 3 } };
+  CHECK_PIECES(L, Expected);
+}
+
+static void TestOverlap() {
+  // A later interval wins where it overlaps earlier ones, as for designated
+  // initializers overriding earlier ones.
+  PieceList L;
+  L.AddInterval(Piece(0, 16, 1));
+  L.AddInterval(Piece(16, 32, 2));
+  L.AddInterval(Piece(32, 48, 3));
+  L.AddInterval(Piece(8, 40, 4)); // Trims 1 and 3, replaces 2.
+  const int Expected[][3] = { { 0, 8, 1 }, { 8, 40, 4 }, { 40, 48, 3 } };
+  CHECK_PIECES(L, Expected);
+
+  // An interval inside another splits it in two.
+  L.AddInterval(Piece(16, 24, 5));
+  const int Split[][3] = { { 0, 8, 1 }, { 8, 16, 4 }, { 16, 24, 5 },
+                           { 24, 40, 4 }, { 40, 48, 3 } };
+  CHECK_PIECES(L, Split);
+
+  // Overlapping only the end of the last interval just trims it.
+  L.AddInterval(Piece(44, 56, 6));
+  const int End[][3] = { { 0, 8, 1 }, { 8, 16, 4 }, { 16, 24, 5 },
+                         { 24, 40, 4 }, { 40, 44, 3 }, { 44, 56, 6 } };
+  CHECK_PIECES(L, End);
+}
+
+static void TestManyOutOfOrder() {
+  // Add lots of overlapping intervals in a scrambled order without looking at
+  // the list in between, and compare with painting each interval's tag over
+  // the bits it covers.  Once the list is long, the intervals are set aside and
+  // merged in one go, which must give the same result as adding them one by
+  // one.
+  const int Width = 8192;
+  int Painted[Width];
+  std::fill(Painted, Painted + Width, -1);
+  PieceList L;
+  unsigned Seed = 1;
+  for (int Tag = 0; Tag != 2000; ++Tag) {
+    Seed = Seed * 1103515245 + 12345;
+    int First = (Seed >> 8) % Width;
+    Seed = Seed * 1103515245 + 12345;
+    int Last = std::min(Width, First + (int)((Seed >> 8) % 48));
+    L.AddInterval(Piece(First, Last, Tag));
+    std::fill(Painted + First, Painted + Last, Tag);
+  }
+  unsigned i = 0;
+  for (int First = 0; First != Width;) {
+    int Last = First + 1;
+    while (Last != Width && Painted[Last] == Painted[First])
+      ++Last;
+    if (Painted[First] != -1) {
+      CHECK(i < L.getNumIntervals());
+      if (i < L.getNumIntervals()) {
+        Piece P = L.getInterval(i);
+        CHECK(P.getRange() == SignedRange(First, Last));
+        CHECK(P.getTag() == Painted[First]);
+      }
+      ++i;
+    }
+    First = Last;
+  }
+  CHECK(i == L.getNumIntervals());
+}
+
+static void TestAlignBoundaries() {
+  // Bitfields sharing bytes are merged into whole bytes.
+  PieceList L;
+  L.AddInterval(Piece(0, 3, 1));
+  L.AddInterval(Piece(3, 5, 2));
+  L.AddInterval(Piece(9, 16, 3));
+  L.AddInterval(Piece(16, 32, 4));
+  L.AlignBoundaries(8);
+  const int Expected[][3] = { { 0, 8, -1 }, { 8, 16, 3 }, { 16, 32, 4 } };
+  CHECK_PIECES(L, Expected);
+
+  // An interval grown by merging is chopped at the alignment boundary.
+  PieceList M;
+  M.AddInterval(Piece(4, 6, 1));
+  M.AddInterval(Piece(7, 20, 2));
+  M.AlignBoundaries(8);
+  const int Chopped[][3] = { { 0, 8, -1 }, { 8, 24, -1 } };
+  CHECK_PIECES(M, Chopped);
+}
+
+int main() {
+  TestRange();
+  TestAppend();
+  TestOutOfOrder();
+  TestOverlap();
+  TestManyOutOfOrder();
+  TestAlignBoundaries();
+  if (Failures) {
+    fprintf(stderr, "%u checks failed\n", Failures);
+    return 1;
+  }
+  printf("All checks passed\n");
+  return 0;
+}
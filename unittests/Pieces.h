@@ -0,0 +1,55 @@
+//===------- Pieces.h - Synthetic intervals for the ADT unit tests -*- C++ -*-===//
+//
+// This file is part of DragonEgg.
+//
+// DragonEgg is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2, or (at your option) any later version.
+//
+// DragonEgg is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// DragonEgg; see the file COPYING.  If not, write to the Free Software
+// Foundation, 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+//
+//===----------------------------------------------------------------------===//
+// This file defines an interval type for IntervalList that behaves like the
+// TypedRange and FieldContents intervals used when converting records and
+// their initializers, without needing GCC trees or LLVM types.
+//===----------------------------------------------------------------------===//
+
+#ifndef DRAGONEGG_UNITTESTS_PIECES_H
+#define DRAGONEGG_UNITTESTS_PIECES_H
+
+// Plugin headers
+#include "dragonegg/ADT/IntervalList.h"
+#include "dragonegg/ADT/Range.h"
+
+typedef Range<int> SignedRange;
+
+/// Piece - An interval with a tag standing for its contents.  Like TypedRange,
+/// changing the shape of a piece keeps its contents, while joining it with
+/// another piece loses them (the tag becomes -1).
+class Piece {
+  SignedRange R;
+  int Tag;
+
+public:
+  Piece(int First, int Last, int tag) : R(First, Last), Tag(tag) {}
+
+  SignedRange getRange() const { return R; }
+  int getTag() const { return Tag; }
+
+  void ChangeRangeTo(SignedRange r) { R = r; }
+
+  void JoinWith(const Piece &S) {
+    R = R.Join(S.R);
+    Tag = -1;
+  }
+};
+
+typedef IntervalList<Piece, int, 16> PieceList;
+
+#endif /* DRAGONEGG_UNITTESTS_PIECES_H */
@@ -0,0 +1,268 @@
+//===-- CodeGenDaemon.cpp - Generate code for modules sent by the plugin --===//
+//
+// This file is part of DragonEgg.
+//
+// DragonEgg is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2, or (at your option) any later version.
+//
+// DragonEgg is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// DragonEgg; see the file COPYING.  If not, write to the Free Software
+// Foundation, 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+//
+//===----------------------------------------------------------------------===//
+// A long running program that generates code for the modules sent to it by
+// the plugin, see -fplugin-arg-dragonegg-codegen-daemon.  Target machines are
+// kept between requests, so compiles do not pay for creating them, and the
+// daemon's code and data stay warm.  Usage:
+//   dragonegg-codegen-daemon [-j threads] socket-path
+// The LLVM options given by the first request are used for all of them, since
+// LLVM only has one set; requests giving other options are refused, and the
+// plugin then generates code itself.
+//===----------------------------------------------------------------------===//
+
+// Plugin headers
+#include "dragonegg/CodeGenDaemon.h"
+
+// LLVM headers
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/DiagnosticPrinter.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+
+// System headers
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <signal.h>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+using namespace llvm;
+
+/// Lock - Protects the state shared between the threads serving requests.
+static std::mutex Lock;
+
+/// IdleMachines - Target machines not currently in use, by the part of the
+/// request they were created for.
+static std::multimap<std::string, std::unique_ptr<TargetMachine> > IdleMachines;
+
+/// ParsedOptions - The LLVM options given by the first request, if any.
+static bool HaveOptions;
+static std::string ParsedOptions;
+
+/// SetOptions - Parse the LLVM options of a request if it is the first one.
+/// Returns false if they differ from those already parsed.
+static bool SetOptions(const std::string &Options) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  if (HaveOptions)
+    return Options == ParsedOptions;
+  HaveOptions = true;
+  ParsedOptions = Options;
+  std::vector<const char *> Args;
+  Args.push_back("dragonegg-codegen-daemon");
+  for (size_t Start = 0; Start < Options.size();) {
+    Args.push_back(Options.c_str() + Start);
+    Start = Options.find('\0', Start) + 1;
+  }
+  cl::ParseCommandLineOptions(Args.size(), &Args[0]);
+  return true;
+}
+
+/// TakeMachine - Return a target machine for the given request, reusing an
+/// idle one if there is one.
+static std::unique_ptr<TargetMachine> TakeMachine(const CodeGenRequest &Req,
+                                                  std::string &Error) {
+  std::string Key = Req.getMachineKey();
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    auto I = IdleMachines.find(Key);
+    if (I != IdleMachines.end()) {
+      std::unique_ptr<TargetMachine> TM = std::move(I->second);
+      IdleMachines.erase(I);
+      return TM;
+    }
+  }
+  const Target *T = TargetRegistry::lookupTarget(Req.Triple, Error);
+  if (!T)
+    return nullptr;
+  return std::unique_ptr<TargetMachine>(T->createTargetMachine(
+      Req.Triple, Req.CPU, Req.Features, Req.Options,
+      (Reloc::Model)Req.RelocModel, (CodeModel::Model)Req.CodeModel,
+      (CodeGenOpt::Level)Req.OptLevel));
+}
+
+/// ReturnMachine - Make a target machine taken with TakeMachine available for
+/// other requests.
+static void ReturnMachine(const CodeGenRequest &Req,
+                          std::unique_ptr<TargetMachine> TM) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  IdleMachines.insert(std::make_pair(Req.getMachineKey(), std::move(TM)));
+}
+
+/// HandleDiagnostic - Note errors reported by the code generator in the string
+/// pointed to by Context, rather than exiting as LLVM does by default.  Other
+/// diagnostics are dropped; the plugin reports errors properly when it then
+/// generates code itself.
+static void HandleDiagnostic(const DiagnosticInfo &DI, void *Context) {
+  if (DI.getSeverity() != DS_Error)
+    return;
+  std::string &Error = *static_cast<std::string *>(Context);
+  raw_string_ostream OS(Error);
+  DiagnosticPrinterRawOStream DP(OS);
+  DI.print(DP);
+}
+
+/// HandleInlineAsmDiagnostic - Likewise for problems found in inline asm.
+static void HandleInlineAsmDiagnostic(const SMDiagnostic &D, void *Context,
+                                      unsigned /*LocCookie*/) {
+  if (D.getKind() == SourceMgr::DK_Error)
+    *static_cast<std::string *>(Context) = D.getMessage().str();
+}
+
+/// GenerateCode - Generate code for the module in the given request.  Returns
+/// false with an error message if that is not possible.
+static bool GenerateCode(const CodeGenRequest &Req, SmallString<0> &Output,
+                         std::string &Error) {
+  if (!SetOptions(Req.LLVMOptions)) {
+    Error = "the daemon is using different LLVM options";
+    return false;
+  }
+
+  LLVMContext Context;
+  std::string CodeGenError;
+#if LLVM_VERSION_MAJOR > 5
+  Context.setDiagnosticHandlerCallBack(HandleDiagnostic, &CodeGenError);
+#else
+  Context.setDiagnosticHandler(HandleDiagnostic, &CodeGenError);
+#endif
+  Context.setInlineAsmDiagnosticHandler(HandleInlineAsmDiagnostic,
+                                        &CodeGenError);
+  Expected<std::unique_ptr<Module> > MOrErr = parseBitcodeFile(
+      MemoryBufferRef(Req.Bitcode, "<request>"), Context);
+  if (!MOrErr) {
+    Error = toString(MOrErr.takeError());
+    return false;
+  }
+  std::unique_ptr<Module> M = std::move(*MOrErr);
+
+  std::unique_ptr<TargetMachine> TM = TakeMachine(Req, Error);
+  if (!TM)
+    return false;
+
+  legacy::PassManager PM;
+  PM.add(createTargetTransformInfoWrapperPass(TM->getTargetIRAnalysis()));
+  TargetLibraryInfoImpl TLII(Triple(M->getTargetTriple()));
+  PM.add(new TargetLibraryInfoWrapperPass(TLII));
+  raw_svector_ostream OS(Output);
+  if (TM->addPassesToEmitFile(PM, OS, Req.EmitObj
+                                          ? TargetMachine::CGFT_ObjectFile
+                                          : TargetMachine::CGFT_AssemblyFile)) {
+    Error = "the target cannot generate this kind of output";
+    return false;
+  }
+  PM.run(*M);
+  ReturnMachine(Req, std::move(TM));
+  if (!CodeGenError.empty()) {
+    Error = CodeGenError;
+    return false;
+  }
+  return true;
+}
+
+/// Serve - Answer the requests made over the given connection.
+static void Serve(int FD) {
+  std::string Message;
+  while (ReceiveDaemonMessage(FD, Message)) {
+    CodeGenRequest Req;
+    DaemonMessageReader R(Message);
+    SmallString<0> Output;
+    std::string Error = "malformed request";
+    bool OK = Req.read(R) && GenerateCode(Req, Output, Error);
+    {
+      std::string Freed;
+      Message.swap(Freed); // Free the bitcode.
+      Req.Bitcode.swap(Freed);
+    }
+
+    DaemonMessageWriter Reply;
+    Reply.addInt(OK);
+    Reply.addString(OK ? Output.str() : StringRef(Error));
+    if (!SendDaemonMessage(FD, Reply.getData()))
+      break;
+  }
+  close(FD);
+}
+
+int main(int argc, char **argv) {
+  unsigned Threads = 0;
+  int i = 1;
+  if (i + 1 < argc && !strcmp(argv[i], "-j")) {
+    Threads = atoi(argv[i + 1]);
+    i += 2;
+  }
+  if (i + 1 != argc) {
+    fprintf(stderr, "Usage: %s [-j threads] socket-path\n", argv[0]);
+    return 1;
+  }
+  const char *Path = argv[i];
+
+  InitializeAllTargetInfos();
+  InitializeAllTargets();
+  InitializeAllTargetMCs();
+  InitializeAllAsmPrinters();
+  InitializeAllAsmParsers();
+
+  // Plugins that go away mid-request must not take the daemon with them.
+  signal(SIGPIPE, SIG_IGN);
+
+  // Only the user running the daemon may connect to it.
+  struct sockaddr_un Addr;
+  if (strlen(Path) >= sizeof(Addr.sun_path)) {
+    fprintf(stderr, "%s: socket path too long\n", argv[0]);
+    return 1;
+  }
+  memset(&Addr, 0, sizeof(Addr));
+  Addr.sun_family = AF_UNIX;
+  strcpy(Addr.sun_path, Path);
+  umask(077);
+  unlink(Path);
+  int Listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (Listener < 0 || bind(Listener, (struct sockaddr *)&Addr, sizeof(Addr)) ||
+      listen(Listener, SOMAXCONN)) {
+    perror(Path);
+    return 1;
+  }
+
+  ThreadPool Pool(Threads ? Threads : std::thread::hardware_concurrency());
+  while (true) {
+    int FD = accept(Listener, 0, 0);
+    if (FD < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("accept");
+      return 1;
+    }
+    Pool.async(Serve, FD);
+  }
+}